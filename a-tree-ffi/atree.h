@@ -6,6 +6,11 @@
 #include <stdint.h>
 #include <stdlib.h>
 
+/**
+ * Number of levels whose popped nodes are counted apart in `AtreeSearchStats`
+ */
+#define ATREE_STATS_LEVELS 16
+
 /**
  * Attribute types supported by the A-Tree
  */
@@ -23,6 +28,31 @@ typedef enum AtreeAttributeType {
  */
 typedef struct ATreeHandle ATreeHandle;
 
+/**
+ * Opaque handle to a search context that is reused between searches
+ */
+typedef struct ATreeSearchContext ATreeSearchContext;
+
+/**
+ * Opaque handle to an A-Tree that can be searched by many threads while it is updated
+ */
+typedef struct ATreeSharedHandle ATreeSharedHandle;
+
+/**
+ * Opaque handle to a snapshot of a shared A-Tree
+ */
+typedef struct ATreeSnapshot ATreeSnapshot;
+
+/**
+ * Opaque handle to an A-Tree partitioned in shards that are searched by a pool of threads
+ */
+typedef struct ATreeShardedHandle ATreeShardedHandle;
+
+/**
+ * Opaque handle to a batch of events filled from columns
+ */
+typedef struct ATreeEventBatch ATreeEventBatch;
+
 /**
  * Attribute definition for creating an A-Tree
  */
@@ -47,6 +77,134 @@ typedef struct AtreeSearchResult {
   uintptr_t count;
 } AtreeSearchResult;
 
+/**
+ * Pre-resolved handle to an attribute returned by `atree_attribute()`
+ */
+typedef struct AtreeAttributeHandle {
+  uintptr_t index;
+} AtreeAttributeHandle;
+
+/**
+ * Interned string returned by `atree_intern()`
+ */
+typedef struct AtreeStringId {
+  uintptr_t id;
+} AtreeStringId;
+
+/**
+ * Memory used by an A-Tree, in bytes, returned by `atree_memory_usage()`
+ */
+typedef struct AtreeMemoryUsage {
+  /**
+   * Slots of the nodes, including the vacant ones left behind by the deletions
+   */
+  uintptr_t nodes;
+  /**
+   * Subscriptions, priorities, parents and children of the nodes
+   */
+  uintptr_t node_vectors;
+  /**
+   * Lists of the predicates, predicates evaluated eagerly and predicate index
+   */
+  uintptr_t predicates;
+  /**
+   * Interned strings
+   */
+  uintptr_t strings;
+  /**
+   * Maps from the expressions and from the subscriptions to their nodes and roots
+   */
+  uintptr_t maps;
+  /**
+   * Sum of all the above
+   */
+  uintptr_t total;
+} AtreeMemoryUsage;
+
+/**
+ * Statistics of the searches made with `atree_search_stats()`
+ */
+typedef struct AtreeSearchStats {
+  /**
+   * Searches that were made
+   */
+  uint64_t searches;
+  /**
+   * Predicates that were evaluated, either eagerly or because a node needed them
+   */
+  uint64_t predicates_evaluated;
+  /**
+   * Predicates that were not evaluated eagerly since nothing needed their result yet
+   */
+  uint64_t predicates_delayed;
+  /**
+   * Predicates that were not evaluated eagerly since they already were
+   */
+  uint64_t predicates_skipped;
+  /**
+   * Nodes popped from the queue of each level; the first entry is for the nodes right above
+   * the predicates and the last one also counts the nodes of the levels above it
+   */
+  uint64_t nodes_popped[ATREE_STATS_LEVELS];
+  /**
+   * AND nodes that failed because of a child without being evaluated
+   */
+  uint64_t and_short_circuits;
+  /**
+   * Matches that were found
+   */
+  uint64_t matches;
+  /**
+   * Time spent evaluating the predicates, in nanoseconds
+   */
+  uint64_t predicates_ns;
+  /**
+   * Time spent evaluating the nodes above the predicates, in nanoseconds
+   */
+  uint64_t levels_ns;
+} AtreeSearchStats;
+
+#ifndef ARROW_C_DATA_INTERFACE
+#define ARROW_C_DATA_INTERFACE
+/**
+ * Array of the Arrow C Data Interface (https://arrow.apache.org/docs/format/CDataInterface.html)
+ *
+ * The layout is the one of `struct ArrowArray` so the arrays exported by an Arrow library can be
+ * passed as is.
+ */
+struct ArrowArray {
+  int64_t length;
+  int64_t null_count;
+  int64_t offset;
+  int64_t n_buffers;
+  int64_t n_children;
+  const void **buffers;
+  struct ArrowArray **children;
+  struct ArrowArray *dictionary;
+  void (*release)(struct ArrowArray *array);
+  void *private_data;
+};
+#endif  /* ARROW_C_DATA_INTERFACE */
+
+/**
+ * Values of an attribute for all the events of a batch searched with `atree_search_columns()`
+ */
+typedef struct AtreeColumn {
+  struct AtreeAttributeHandle attribute;
+  enum AtreeAttributeType attr_type;
+  /**
+   * Number of decimal places of the `Float` columns (e.g., 123.45 = 12345 with a scale of 2);
+   * at most 28
+   */
+  uint32_t scale;
+  const struct ArrowArray *array;
+} AtreeColumn;
+
+/**
+ * Callback receiving the subscription IDs matched by `atree_search_visit()`
+ */
+typedef void (*AtreeMatchCallback)(uint64_t subscription_id, void *user_data);
+
 /**
  * Create a new A-Tree with the given attribute definitions.
  *
@@ -76,6 +234,10 @@ void atree_free(struct ATreeHandle *handle);
 /**
  * Insert a boolean expression associated with a subscription ID.
  *
+ * The subscription ID is an opaque 64-bit value that is stored as is and handed back by the
+ * searches, so it can also hold a payload such as a pointer (e.g. `(uint64_t)(uintptr_t)ptr`)
+ * that the matches are used through without looking them up.
+ *
  * # Arguments
  * * `handle` - Valid ATree handle
  * * `subscription_id` - Unique ID for this subscription
@@ -93,6 +255,33 @@ struct AtreeResult atree_insert(struct ATreeHandle *handle,
                                 uint64_t subscription_id,
                                 const char *expression);
 
+/**
+ * Insert many boolean expressions at once.
+ *
+ * This is faster than calling `atree_insert()` for each expression when loading a lot of
+ * subscriptions. All the expressions are parsed and optimized over the available cores before
+ * any of them is inserted; if one of them is invalid, none of them is inserted.
+ *
+ * # Arguments
+ * * `handle` - Valid ATree handle
+ * * `subscription_ids` - Array of unique IDs, one per expression
+ * * `expressions` - Array of null-terminated boolean expression strings
+ * * `count` - Number of entries in both arrays
+ *
+ * # Returns
+ * Result indicating success or failure
+ *
+ * # Safety
+ * - `handle` must be a valid pointer returned by `atree_new()`
+ * - `subscription_ids` must point to `count` u64 values
+ * - `expressions` must point to `count` valid null-terminated C strings
+ * - Caller must free result.error_message with `atree_free_error()` if !success
+ */
+struct AtreeResult atree_insert_batch(struct ATreeHandle *handle,
+                                      const uint64_t *subscription_ids,
+                                      const char *const *expressions,
+                                      uintptr_t count);
+
 /**
  * Delete a subscription by ID.
  *
@@ -105,6 +294,49 @@ struct AtreeResult atree_insert(struct ATreeHandle *handle,
  */
 void atree_delete(struct ATreeHandle *handle, uint64_t subscription_id);
 
+/**
+ * Delete many subscriptions at once.
+ *
+ * The IDs that are not in the tree are ignored.
+ *
+ * # Arguments
+ * * `handle` - Valid ATree handle
+ * * `subscription_ids` - Array of the IDs of the subscriptions to delete
+ * * `count` - Number of IDs in the array
+ *
+ * # Safety
+ * - `handle` must be a valid pointer returned by `atree_new()`
+ * - `subscription_ids` must point to `count` u64 values
+ */
+void atree_delete_batch(struct ATreeHandle *handle,
+                        const uint64_t *subscription_ids,
+                        uintptr_t count);
+
+/**
+ * Get the memory used by the tree, broken down by its parts.
+ *
+ * # Returns
+ * Memory usage in bytes; all the fields are zero if `handle` is null
+ *
+ * # Safety
+ * - `handle` must be a valid pointer returned by `atree_new()`
+ */
+struct AtreeMemoryUsage atree_memory_usage(const struct ATreeHandle *handle);
+
+/**
+ * Release the memory left behind by the deletions.
+ *
+ * Renumbers the nodes densely, drops the strings that no expression references anymore and
+ * shrinks the buffers. This walks over the whole tree so it is meant to be called during
+ * low-traffic windows.
+ *
+ * # Safety
+ * - `handle` must be a valid pointer returned by `atree_new()`
+ * - No event builder of `handle` may be alive
+ * - The IDs returned by `atree_intern()` are invalidated and must be interned again
+ */
+void atree_compact(struct ATreeHandle *handle);
+
 /**
  * Export the tree structure as a Graphviz DOT format string.
  *
@@ -117,6 +349,45 @@ void atree_delete(struct ATreeHandle *handle, uint64_t subscription_id);
  */
 char *atree_to_graphviz(const struct ATreeHandle *handle);
 
+/**
+ * Save a snapshot of the tree in a file.
+ *
+ * The snapshot can be loaded with `atree_load()` without parsing the expressions again.
+ *
+ * # Arguments
+ * * `handle` - Valid ATree handle
+ * * `path` - Null-terminated path of the file to write
+ *
+ * # Returns
+ * Result indicating success or failure
+ *
+ * # Safety
+ * - `handle` must be a valid pointer returned by `atree_new()`
+ * - `path` must be a valid null-terminated C string
+ * - Caller must free result.error_message with `atree_free_error()` if !success
+ */
+struct AtreeResult atree_save(const struct ATreeHandle *handle,
+                              const char *path);
+
+/**
+ * Load a tree from a snapshot file written by `atree_save()`.
+ *
+ * The file is mapped in memory and decoded into a new tree, which does not reference the file
+ * once it is loaded.
+ *
+ * # Arguments
+ * * `path` - Null-terminated path of the snapshot file
+ *
+ * # Returns
+ * Pointer to ATreeHandle on success, null on failure (e.g. the file is missing, is not a
+ * snapshot or was written by an incompatible version)
+ *
+ * # Safety
+ * - `path` must be a valid null-terminated C string
+ * - Caller must free the returned handle with `atree_free()`
+ */
+struct ATreeHandle *atree_load(const char *path);
+
 /**
  * Free a string returned by the library.
  *
@@ -213,6 +484,175 @@ struct AtreeResult atree_event_builder_with_integer_list(void *builder,
  */
 struct AtreeResult atree_event_builder_with_undefined(void *builder, const char *name);
 
+/**
+ * Resolve the handle of an attribute once so that the events can set it without looking up its
+ * name.
+ *
+ * # Arguments
+ * * `handle` - Valid ATree handle
+ * * `name` - Name of the attribute
+ * * `out` - Receives the handle of the attribute
+ *
+ * # Returns
+ * Result indicating success or failure
+ *
+ * # Safety
+ * - `handle` must be a valid pointer returned by `atree_new()`
+ * - `name` must be a valid null-terminated C string
+ * - `out` must point to writable memory for an AtreeAttributeHandle
+ * - Caller must free result.error_message with `atree_free_error()` if !success
+ */
+struct AtreeResult atree_attribute(const struct ATreeHandle *handle,
+                                   const char *name,
+                                   struct AtreeAttributeHandle *out);
+
+/**
+ * Intern a string so that the events can set it without hashing it again.
+ *
+ * The ID stays valid for the lifetime of the tree, so the strings that appear in many events
+ * (e.g. a dictionary of deal IDs) can be interned once and reused across the events. Every
+ * interned string is kept by the tree.
+ *
+ * # Arguments
+ * * `handle` - Valid ATree handle
+ * * `value` - String to intern
+ * * `out` - Receives the ID of the string
+ *
+ * # Returns
+ * Result indicating success or failure
+ *
+ * # Safety
+ * - `handle` must be a valid pointer returned by `atree_new()`
+ * - `value` must be a valid null-terminated C string
+ * - `out` must point to writable memory for an AtreeStringId
+ * - Caller must free result.error_message with `atree_free_error()` if !success
+ */
+struct AtreeResult atree_intern(struct ATreeHandle *handle,
+                                const char *value,
+                                struct AtreeStringId *out);
+
+/**
+ * Set a boolean attribute of the event through its handle.
+ *
+ * # Safety
+ * - `builder` must be a valid pointer returned by `atree_event_builder_new()`
+ * - `attribute` must have been returned by `atree_attribute()` for the builder's tree
+ */
+struct AtreeResult atree_event_builder_set_boolean(void *builder,
+                                                   struct AtreeAttributeHandle attribute,
+                                                   bool value);
+
+/**
+ * Set an integer attribute of the event through its handle.
+ *
+ * # Safety
+ * - `builder` must be a valid pointer returned by `atree_event_builder_new()`
+ * - `attribute` must have been returned by `atree_attribute()` for the builder's tree
+ */
+struct AtreeResult atree_event_builder_set_integer(void *builder,
+                                                   struct AtreeAttributeHandle attribute,
+                                                   int64_t value);
+
+/**
+ * Set a string attribute of the event through its handle.
+ *
+ * # Safety
+ * - `builder` must be a valid pointer returned by `atree_event_builder_new()`
+ * - `attribute` must have been returned by `atree_attribute()` for the builder's tree
+ * - `value` must be a valid null-terminated C string
+ */
+struct AtreeResult atree_event_builder_set_string(void *builder,
+                                                  struct AtreeAttributeHandle attribute,
+                                                  const char *value);
+
+/**
+ * Set a float attribute of the event through its handle.
+ *
+ * The float is represented as a decimal with a mantissa and scale.
+ * For example, 123.45 would be represented as number=12345, scale=2.
+ *
+ * # Safety
+ * - `builder` must be a valid pointer returned by `atree_event_builder_new()`
+ * - `attribute` must have been returned by `atree_attribute()` for the builder's tree
+ */
+struct AtreeResult atree_event_builder_set_float(void *builder,
+                                                 struct AtreeAttributeHandle attribute,
+                                                 int64_t number,
+                                                 uint32_t scale);
+
+/**
+ * Set a string attribute of the event to a string interned by `atree_intern()`.
+ *
+ * # Safety
+ * - `builder` must be a valid pointer returned by `atree_event_builder_new()`
+ * - `attribute` must have been returned by `atree_attribute()` for the builder's tree
+ * - `value` must have been returned by `atree_intern()` for the builder's tree
+ */
+struct AtreeResult atree_event_builder_set_string_id(void *builder,
+                                                     struct AtreeAttributeHandle attribute,
+                                                     struct AtreeStringId value);
+
+/**
+ * Set a string list attribute of the event to strings interned by `atree_intern()`.
+ *
+ * # Safety
+ * - `builder` must be a valid pointer returned by `atree_event_builder_new()`
+ * - `attribute` must have been returned by `atree_attribute()` for the builder's tree
+ * - `values` must point to an array of `count` IDs returned by `atree_intern()` for the
+ *   builder's tree
+ */
+struct AtreeResult atree_event_builder_set_string_id_list(void *builder,
+                                                          struct AtreeAttributeHandle attribute,
+                                                          const struct AtreeStringId *values,
+                                                          uintptr_t count);
+
+/**
+ * Set a string list attribute of the event through its handle.
+ *
+ * # Safety
+ * - `builder` must be a valid pointer returned by `atree_event_builder_new()`
+ * - `attribute` must have been returned by `atree_attribute()` for the builder's tree
+ * - `values` must point to an array of `count` valid null-terminated C strings
+ */
+struct AtreeResult atree_event_builder_set_string_list(void *builder,
+                                                       struct AtreeAttributeHandle attribute,
+                                                       const char *const *values,
+                                                       uintptr_t count);
+
+/**
+ * Set an integer list attribute of the event through its handle.
+ *
+ * # Safety
+ * - `builder` must be a valid pointer returned by `atree_event_builder_new()`
+ * - `attribute` must have been returned by `atree_attribute()` for the builder's tree
+ * - `values` must point to an array of `count` i64 values
+ */
+struct AtreeResult atree_event_builder_set_integer_list(void *builder,
+                                                        struct AtreeAttributeHandle attribute,
+                                                        const int64_t *values,
+                                                        uintptr_t count);
+
+/**
+ * Set an attribute of the event to undefined through its handle.
+ *
+ * # Safety
+ * - `builder` must be a valid pointer returned by `atree_event_builder_new()`
+ * - `attribute` must have been returned by `atree_attribute()` for the builder's tree
+ */
+struct AtreeResult atree_event_builder_set_undefined(void *builder,
+                                                     struct AtreeAttributeHandle attribute);
+
+/**
+ * Set all the attributes of the event back to undefined so that the builder can be reused.
+ *
+ * The builder keeps its memory (including the buffers of the list attributes) so building the
+ * next event does not allocate.
+ *
+ * # Safety
+ * - `builder` must be a valid pointer returned by `atree_event_builder_new()`
+ */
+void atree_event_builder_reset(void *builder);
+
 /**
  * Search the A-Tree for matching expressions.
  *
@@ -225,28 +665,657 @@ struct AtreeResult atree_event_builder_with_undefined(void *builder, const char
 struct AtreeSearchResult atree_search(const struct ATreeHandle *handle, void *builder);
 
 /**
- * Free a search result.
+ * Create a search context that can be reused between searches with `atree_search_with()`.
+ *
+ * Reusing a search context avoids allocating and clearing the whole evaluation state of the
+ * tree on every search.
+ *
+ * # Returns
+ * Pointer to ATreeSearchContext on success, null on failure
  *
  * # Safety
- * - `result` must be a valid search result returned by `atree_search()`
- * - `result` must not be used after this call
+ * - `handle` must be a valid pointer returned by `atree_new()`
+ * - Caller must free the returned context with `atree_search_context_free()`
  */
-void atree_search_result_free(struct AtreeSearchResult result);
+struct ATreeSearchContext *atree_search_context_new(const struct ATreeHandle *handle);
 
 /**
- * Free an error message string.
+ * Free a search context.
  *
  * # Safety
- * - `error` must be a valid pointer from AtreeResult.error_message
+ * - `context` must be a valid pointer returned by `atree_search_context_new()`
+ * - `context` must not be used after this call
  */
-void atree_free_error(char *error);
+void atree_search_context_free(struct ATreeSearchContext *context);
 
 /**
- * Free an event builder without using it.
+ * Search the A-Tree for matching expressions by reusing a search context.
  *
  * # Safety
+ * - `handle` must be a valid pointer returned by `atree_new()`
+ * - `context` must be a valid pointer returned by `atree_search_context_new()` for `handle` or for
+ *   another snapshot of the same shared tree
+ * - `context` must not be used by another search at the same time
  * - `builder` must be a valid pointer returned by `atree_event_builder_new()`
+ * - `builder` will be consumed by this call and must not be used after
+ * - Caller must free the returned result with `atree_search_result_free()`
  */
-void atree_event_builder_free(void *builder);
+struct AtreeSearchResult atree_search_with(const struct ATreeHandle *handle,
+                                           struct ATreeSearchContext *context,
+                                           void *builder);
+
+/**
+ * Search the A-Tree and write the matching subscription IDs into a caller-owned buffer.
+ *
+ * Unlike `atree_search()`, no memory is allocated for the results and nothing has to be freed.
+ *
+ * # Arguments
+ * * `handle` - Valid ATree handle
+ * * `builder` - Event builder (consumed by this call)
+ * * `buffer` - Array receiving up to `capacity` subscription IDs
+ * * `capacity` - Number of IDs that fit in `buffer`
+ * * `out_len` - Receives the number of matching subscription IDs
+ *
+ * # Returns
+ * Result indicating success or failure; if more than `capacity` subscriptions match, the first
+ * `capacity` IDs are written, `out_len` receives the total and an error is returned
+ *
+ * # Safety
+ * - `handle` must be a valid pointer returned by `atree_new()`
+ * - `builder` must be a valid pointer returned by `atree_event_builder_new()`
+ * - `builder` will be consumed by this call and must not be used after
+ * - `buffer` must point to writable memory for `capacity` u64 values
+ * - `out_len` must point to writable memory for a size_t
+ * - Caller must free result.error_message with `atree_free_error()` if !success
+ */
+struct AtreeResult atree_search_into(const struct ATreeHandle *handle,
+                                     void *builder,
+                                     uint64_t *buffer,
+                                     uintptr_t capacity,
+                                     uintptr_t *out_len);
+
+/**
+ * Search the A-Tree by reusing a search context and write the matching subscription IDs into a
+ * caller-owned buffer.
+ *
+ * Combined with a search context, the search does not allocate any memory.
+ *
+ * # Arguments
+ * * `handle` - Valid ATree handle
+ * * `context` - Search context to reuse, or null to search without one
+ * * `builder` - Event builder (consumed by this call)
+ * * `buffer` - Array receiving up to `capacity` subscription IDs
+ * * `capacity` - Number of IDs that fit in `buffer`
+ * * `out_len` - Receives the number of matching subscription IDs
+ *
+ * # Returns
+ * Result indicating success or failure; if more than `capacity` subscriptions match, the first
+ * `capacity` IDs are written, `out_len` receives the total and an error is returned
+ *
+ * # Safety
+ * - `handle` must be a valid pointer returned by `atree_new()`
+ * - `context` must be null or satisfy the requirements of `atree_search_with()`
+ * - `builder` must be a valid pointer returned by `atree_event_builder_new()`
+ * - `builder` will be consumed by this call and must not be used after
+ * - `buffer` must point to writable memory for `capacity` u64 values
+ * - `out_len` must point to writable memory for a size_t
+ * - Caller must free result.error_message with `atree_free_error()` if !success
+ */
+struct AtreeResult atree_search_with_into(const struct ATreeHandle *handle,
+                                          struct ATreeSearchContext *context,
+                                          void *builder,
+                                          uint64_t *buffer,
+                                          uintptr_t capacity,
+                                          uintptr_t *out_len);
+
+/**
+ * Search the A-Tree like `atree_search_visit()` while recording what the search did.
+ *
+ * The statistics of the search are added to the ones already in `stats` so that they can be
+ * accumulated over many searches (e.g. one `AtreeSearchStats` per thread that is exported once
+ * in a while). The other search functions are not instrumented.
+ *
+ * # Arguments
+ * * `handle` - Valid ATree handle
+ * * `context` - Search context to reuse, or null to search without one
+ * * `builder` - Event builder (consumed by this call)
+ * * `callback` - Function called with each matching subscription ID and `user_data`
+ * * `user_data` - Pointer passed as is to `callback`
+ * * `stats` - Statistics the ones of the search are added to
+ *
+ * # Returns
+ * Result indicating success or failure
+ *
+ * # Safety
+ * - `handle` must be a valid pointer returned by `atree_new()`
+ * - `context` must be null or satisfy the requirements of `atree_search_with()`
+ * - `builder` must be a valid pointer returned by `atree_event_builder_new()`
+ * - `builder` will be consumed by this call and must not be used after
+ * - `callback` must not call back into the library with `handle` or `context`
+ * - `stats` must point to an initialized AtreeSearchStats (e.g. zeroed)
+ * - Caller must free result.error_message with `atree_free_error()` if !success
+ */
+struct AtreeResult atree_search_stats(const struct ATreeHandle *handle,
+                                      struct ATreeSearchContext *context,
+                                      void *builder,
+                                      AtreeMatchCallback callback,
+                                      void *user_data,
+                                      struct AtreeSearchStats *stats);
+
+/**
+ * Search the A-Tree and call a function for each matching subscription ID.
+ *
+ * The subscription IDs are handed to the callback as they are read from the search results so
+ * they can be put straight into the caller's own storage.
+ *
+ * # Arguments
+ * * `handle` - Valid ATree handle
+ * * `context` - Search context to reuse, or null to search without one
+ * * `builder` - Event builder (consumed by this call)
+ * * `callback` - Function called with each matching subscription ID and `user_data`
+ * * `user_data` - Pointer passed as is to `callback`
+ *
+ * # Returns
+ * Result indicating success or failure
+ *
+ * # Safety
+ * - `handle` must be a valid pointer returned by `atree_new()`
+ * - `context` must be null or satisfy the requirements of `atree_search_with()`
+ * - `builder` must be a valid pointer returned by `atree_event_builder_new()`
+ * - `builder` will be consumed by this call and must not be used after
+ * - `callback` must not call back into the library with `handle` or `context`
+ * - Caller must free result.error_message with `atree_free_error()` if !success
+ */
+struct AtreeResult atree_search_visit(const struct ATreeHandle *handle,
+                                      struct ATreeSearchContext *context,
+                                      void *builder,
+                                      AtreeMatchCallback callback,
+                                      void *user_data);
+
+/**
+ * Search the A-Tree without consuming the event builder and write the matching subscription IDs
+ * into a caller-owned buffer.
+ *
+ * The builder can then be reset with `atree_event_builder_reset()` and reused for the next event.
+ *
+ * # Arguments
+ * * `handle` - Valid ATree handle
+ * * `context` - Search context to reuse, or null to search without one
+ * * `builder` - Event builder (left untouched by this call)
+ * * `buffer` - Array receiving up to `capacity` subscription IDs
+ * * `capacity` - Number of IDs that fit in `buffer`
+ * * `out_len` - Receives the number of matching subscription IDs
+ *
+ * # Returns
+ * Result indicating success or failure; if more than `capacity` subscriptions match, the first
+ * `capacity` IDs are written, `out_len` receives the total and an error is returned
+ *
+ * # Safety
+ * - `handle` must be a valid pointer returned by `atree_new()`
+ * - `context` must be null or satisfy the requirements of `atree_search_with()`
+ * - `builder` must be a valid pointer returned by `atree_event_builder_new()` for `handle`
+ * - Caller still owns `builder` and must free it with `atree_event_builder_free()`
+ * - `buffer` must point to writable memory for `capacity` u64 values
+ * - `out_len` must point to writable memory for a size_t
+ * - Caller must free result.error_message with `atree_free_error()` if !success
+ */
+struct AtreeResult atree_search_reused_into(const struct ATreeHandle *handle,
+                                            struct ATreeSearchContext *context,
+                                            const void *builder,
+                                            uint64_t *buffer,
+                                            uintptr_t capacity,
+                                            uintptr_t *out_len);
+
+/**
+ * Search the A-Tree without consuming the event builder and call a function for each matching
+ * subscription ID.
+ *
+ * # Arguments
+ * * `handle` - Valid ATree handle
+ * * `context` - Search context to reuse, or null to search without one
+ * * `builder` - Event builder (left untouched by this call)
+ * * `callback` - Function called with each matching subscription ID and `user_data`
+ * * `user_data` - Pointer passed as is to `callback`
+ *
+ * # Returns
+ * Result indicating success or failure
+ *
+ * # Safety
+ * - `handle` must be a valid pointer returned by `atree_new()`
+ * - `context` must be null or satisfy the requirements of `atree_search_with()`
+ * - `builder` must be a valid pointer returned by `atree_event_builder_new()` for `handle`
+ * - Caller still owns `builder` and must free it with `atree_event_builder_free()`
+ * - `callback` must not call back into the library with `handle`, `context` or `builder`
+ * - Caller must free result.error_message with `atree_free_error()` if !success
+ */
+struct AtreeResult atree_search_reused_visit(const struct ATreeHandle *handle,
+                                             struct ATreeSearchContext *context,
+                                             const void *builder,
+                                             AtreeMatchCallback callback,
+                                             void *user_data);
+
+/**
+ * Search the A-Tree for the expressions matching each event of a batch.
+ *
+ * Each predicate is evaluated once for the whole batch which is faster than searching the
+ * events one after the other.
+ *
+ * # Arguments
+ * * `handle` - Valid ATree handle
+ * * `builders` - Array of event builders
+ * * `count` - Number of event builders in the array
+ * * `results` - Array of `count` search results that receives the matches of each event
+ *
+ * # Returns
+ * Result indicating success or failure
+ *
+ * # Safety
+ * - `handle` must be a valid pointer returned by `atree_new()`
+ * - `builders` must point to `count` pointers returned by `atree_event_builder_new()`
+ * - All the non-null builders will be consumed by this call, even when it fails, and must not be
+ *   used after
+ * - `results` must point to writable memory for `count` AtreeSearchResult structs
+ * - On success, caller must free each result with `atree_search_result_free()`
+ * - Caller must free result.error_message with `atree_free_error()` if !success
+ */
+struct AtreeResult atree_search_batch(const struct ATreeHandle *handle,
+                                      void *const *builders,
+                                      uintptr_t count,
+                                      struct AtreeSearchResult *results);
+
+/**
+ * Create a batch of events that is filled from columns by `atree_search_columns()`.
+ *
+ * The batch keeps its events and their buffers between the searches so that it does not
+ * allocate once it has grown enough.
+ *
+ * # Safety
+ * - Caller must free the returned batch with `atree_event_batch_free()`
+ */
+struct ATreeEventBatch *atree_event_batch_new(void);
+
+/**
+ * Free a batch of events.
+ *
+ * # Safety
+ * - `batch` must be a valid pointer returned by `atree_event_batch_new()`
+ * - `batch` must not be used after this call
+ */
+void atree_event_batch_free(struct ATreeEventBatch *batch);
+
+/**
+ * Search the A-Tree for the expressions matching each event of a batch laid out as columns.
+ *
+ * Each column holds the values of an attribute for all the events as an Arrow array; the
+ * attributes without a column are undefined. The arrays are only read: they are neither copied
+ * nor released. The expected Arrow layouts are:
+ * - `Boolean`: `boolean`
+ * - `Integer`: `int64`
+ * - `Float`: `int64` mantissas sharing the column's `scale`
+ * - `String`: `utf8`
+ * - `IntegerList`: `list<int64>`
+ * - `StringList`: `list<utf8>`
+ *
+ * The null values leave the attribute undefined; the null values inside the lists are skipped.
+ *
+ * # Arguments
+ * * `handle` - Valid ATree handle
+ * * `batch` - Batch of events reused between the searches
+ * * `columns` - Array of columns, at most one per attribute
+ * * `column_count` - Number of columns in the array
+ * * `rows` - Number of events in the batch
+ * * `results` - Array of `rows` search results that receives the matches of each event
+ *
+ * # Returns
+ * Result indicating success or failure
+ *
+ * # Safety
+ * - `handle` must be a valid pointer returned by `atree_new()`
+ * - `batch` must be a valid pointer returned by `atree_event_batch_new()`
+ * - `columns` must point to `column_count` AtreeColumn structs whose arrays are valid and hold
+ *   at least `rows` values
+ * - `results` must point to writable memory for `rows` AtreeSearchResult structs
+ * - On success, caller must free each result with `atree_search_result_free()`
+ * - Caller must free result.error_message with `atree_free_error()` if !success
+ */
+struct AtreeResult atree_search_columns(const struct ATreeHandle *handle,
+                                        struct ATreeEventBatch *batch,
+                                        const struct AtreeColumn *columns,
+                                        uintptr_t column_count,
+                                        uintptr_t rows,
+                                        struct AtreeSearchResult *results);
+
+/**
+ * Free a search result.
+ *
+ * # Safety
+ * - `result` must be a valid search result returned by `atree_search()`, `atree_search_with()`,
+ *   `atree_search_batch()` or `atree_search_columns()`
+ * - `result` must not be used after this call
+ */
+void atree_search_result_free(struct AtreeSearchResult result);
+
+/**
+ * Free an error message string.
+ *
+ * # Safety
+ * - `error` must be a valid pointer from AtreeResult.error_message
+ */
+void atree_free_error(char *error);
+
+/**
+ * Free an event builder without using it.
+ *
+ * # Safety
+ * - `builder` must be a valid pointer returned by `atree_event_builder_new()`
+ */
+void atree_event_builder_free(void *builder);
+
+/**
+ * Create a new shared A-Tree that can be searched by many threads while it is updated.
+ *
+ * The insertions and deletions are staged and only become visible to the searches once
+ * `atree_shared_publish()` is called. The searches are made on the snapshots returned by
+ * `atree_shared_snapshot()` and never wait on the writers.
+ *
+ * # Arguments
+ * * `defs` - Array of attribute definitions
+ * * `count` - Number of definitions in the array
+ *
+ * # Returns
+ * Pointer to ATreeSharedHandle on success, null on failure
+ *
+ * # Safety
+ * - `defs` must point to valid memory containing `count` AtreeAttributeDef structs
+ * - Each `name` field must be a valid null-terminated C string
+ * - Caller must free the returned handle with `atree_shared_free()`
+ */
+struct ATreeSharedHandle *atree_shared_new(const struct AtreeAttributeDef *defs,
+                                           uintptr_t count);
+
+/**
+ * Free a shared A-Tree handle.
+ *
+ * # Safety
+ * - `handle` must be a valid pointer returned by `atree_shared_new()`
+ * - All the snapshots of `handle` must have been freed
+ * - `handle` must not be used after this call
+ */
+void atree_shared_free(struct ATreeSharedHandle *handle);
+
+/**
+ * Stage the insertion of a boolean expression in a shared A-Tree.
+ *
+ * This function is thread-safe; the expression is only matched by the searches once
+ * `atree_shared_publish()` is called.
+ *
+ * # Arguments
+ * * `handle` - Valid shared ATree handle
+ * * `subscription_id` - Unique ID for this subscription
+ * * `expression` - Null-terminated boolean expression string
+ *
+ * # Returns
+ * Result indicating success or failure
+ *
+ * # Safety
+ * - `handle` must be a valid pointer returned by `atree_shared_new()`
+ * - `expression` must be a valid null-terminated C string
+ * - Caller must free result.error_message with `atree_free_error()` if !success
+ */
+struct AtreeResult atree_shared_insert(const struct ATreeSharedHandle *handle,
+                                       uint64_t subscription_id,
+                                       const char *expression);
+
+/**
+ * Stage the deletion of a subscription from a shared A-Tree.
+ *
+ * This function is thread-safe; the subscription keeps being matched by the searches until
+ * `atree_shared_publish()` is called.
+ *
+ * # Arguments
+ * * `handle` - Valid shared ATree handle
+ * * `subscription_id` - ID of the subscription to delete
+ *
+ * # Safety
+ * - `handle` must be a valid pointer returned by `atree_shared_new()`
+ */
+void atree_shared_delete(const struct ATreeSharedHandle *handle,
+                         uint64_t subscription_id);
+
+/**
+ * Make the staged insertions and deletions of a shared A-Tree visible to the searches.
+ *
+ * This function is thread-safe. It waits for the snapshots taken before the previous publish
+ * to be freed.
+ *
+ * # Safety
+ * - `handle` must be a valid pointer returned by `atree_shared_new()`
+ * - The calling thread must not hold a snapshot of `handle`
+ */
+void atree_shared_publish(const struct ATreeSharedHandle *handle);
+
+/**
+ * Take a snapshot of a shared A-Tree to search it.
+ *
+ * Taking a snapshot never blocks. The snapshot does not see the writes that are published
+ * afterwards and it delays the next publish until it is freed, so it should be short-lived.
+ *
+ * # Returns
+ * Pointer to ATreeSnapshot on success, null on failure
+ *
+ * # Safety
+ * - `handle` must be a valid pointer returned by `atree_shared_new()`
+ * - Caller must free the returned snapshot with `atree_snapshot_free()` before freeing `handle`
+ */
+struct ATreeSnapshot *atree_shared_snapshot(const struct ATreeSharedHandle *handle);
+
+/**
+ * Get the tree of a snapshot.
+ *
+ * The returned handle can be used with all the functions that do not modify the tree (e.g.
+ * `atree_event_builder_new()`, `atree_search()`, `atree_search_with()`, `atree_search_batch()`
+ * and `atree_to_graphviz()`).
+ *
+ * # Returns
+ * Pointer to the ATreeHandle of the snapshot, null on failure
+ *
+ * # Safety
+ * - `snapshot` must be a valid pointer returned by `atree_shared_snapshot()`
+ * - The returned handle must not be used after `snapshot` is freed and must not be freed with
+ *   `atree_free()`
+ */
+const struct ATreeHandle *atree_snapshot_tree(const struct ATreeSnapshot *snapshot);
+
+/**
+ * Free a snapshot of a shared A-Tree.
+ *
+ * # Safety
+ * - `snapshot` must be a valid pointer returned by `atree_shared_snapshot()`
+ * - `snapshot` must not be used after this call
+ */
+void atree_snapshot_free(struct ATreeSnapshot *snapshot);
+
+/**
+ * Create a new A-Tree partitioned in shards along with the pool of threads that searches them.
+ *
+ * The subscriptions are assigned to the shards by the hash of their IDs. The shard `i` is always
+ * searched (and built by `atree_sharded_insert_batch()`) by the thread `i % threads` of the pool
+ * so that pinning the threads with `atree_sharded_pin_thread()` keeps the shards on the NUMA node
+ * of their thread. The threads of the pool run all the work, the calling thread only waits.
+ *
+ * # Arguments
+ * * `defs` - Array of attribute definitions
+ * * `count` - Number of definitions in the array
+ * * `shards` - Number of shards (at least one)
+ * * `threads` - Number of worker threads of the pool (at least one)
+ *
+ * # Returns
+ * Pointer to ATreeShardedHandle on success, null on failure
+ *
+ * # Safety
+ * - `defs` must point to valid memory containing `count` AtreeAttributeDef structs
+ * - Each `name` field must be a valid null-terminated C string
+ * - Caller must free the returned handle with `atree_sharded_free()`
+ */
+struct ATreeShardedHandle *atree_sharded_new(const struct AtreeAttributeDef *defs,
+                                             uintptr_t count,
+                                             uintptr_t shards,
+                                             uintptr_t threads);
+
+/**
+ * Free a sharded A-Tree handle and stop the threads of its pool.
+ *
+ * # Safety
+ * - `handle` must be a valid pointer returned by `atree_sharded_new()`
+ * - `handle` must not be used after this call
+ */
+void atree_sharded_free(struct ATreeShardedHandle *handle);
+
+/**
+ * Get the number of shards of a sharded A-Tree; zero if `handle` is null.
+ *
+ * # Safety
+ * - `handle` must be a valid pointer returned by `atree_sharded_new()`
+ */
+uintptr_t atree_sharded_shards(const struct ATreeShardedHandle *handle);
+
+/**
+ * Get the number of threads of the pool of a sharded A-Tree; zero if `handle` is null.
+ *
+ * # Safety
+ * - `handle` must be a valid pointer returned by `atree_sharded_new()`
+ */
+uintptr_t atree_sharded_threads(const struct ATreeShardedHandle *handle);
+
+/**
+ * Restrict a thread of the pool of a sharded A-Tree to the specified CPUs.
+ *
+ * Pinning the threads before inserting the expressions with `atree_sharded_insert_batch()`
+ * allocates the memory of their shards on the NUMA node of their CPUs. Pinning is only
+ * supported on Linux.
+ *
+ * # Arguments
+ * * `handle` - Valid sharded ATree handle
+ * * `thread` - Index of the worker thread, below `atree_sharded_threads()`
+ * * `cpus` - Array of CPU indexes
+ * * `cpu_count` - Number of CPU indexes in the array
+ *
+ * # Returns
+ * Result indicating success or failure
+ *
+ * # Safety
+ * - `handle` must be a valid pointer returned by `atree_sharded_new()`
+ * - `cpus` must point to `cpu_count` size_t values
+ * - Caller must free result.error_message with `atree_free_error()` if !success
+ */
+struct AtreeResult atree_sharded_pin_thread(const struct ATreeShardedHandle *handle,
+                                            uintptr_t thread,
+                                            const uintptr_t *cpus,
+                                            uintptr_t cpu_count);
+
+/**
+ * Insert a boolean expression in the shard of its subscription.
+ *
+ * # Arguments
+ * * `handle` - Valid sharded ATree handle
+ * * `subscription_id` - Unique ID for this subscription
+ * * `expression` - Null-terminated boolean expression string
+ *
+ * # Returns
+ * Result indicating success or failure
+ *
+ * # Safety
+ * - `handle` must be a valid pointer returned by `atree_sharded_new()`
+ * - `expression` must be a valid null-terminated C string
+ * - Caller must free result.error_message with `atree_free_error()` if !success
+ */
+struct AtreeResult atree_sharded_insert(struct ATreeShardedHandle *handle,
+                                        uint64_t subscription_id,
+                                        const char *expression);
+
+/**
+ * Insert many boolean expressions at once; each shard is built by the thread that searches it.
+ *
+ * All the expressions are parsed before any of them is inserted; if one of them is invalid,
+ * none of them is inserted.
+ *
+ * # Arguments
+ * * `handle` - Valid sharded ATree handle
+ * * `subscription_ids` - Array of unique IDs, one per expression
+ * * `expressions` - Array of null-terminated boolean expression strings
+ * * `count` - Number of entries in both arrays
+ *
+ * # Returns
+ * Result indicating success or failure
+ *
+ * # Safety
+ * - `handle` must be a valid pointer returned by `atree_sharded_new()`
+ * - `subscription_ids` must point to `count` u64 values
+ * - `expressions` must point to `count` valid null-terminated C strings
+ * - Caller must free result.error_message with `atree_free_error()` if !success
+ */
+struct AtreeResult atree_sharded_insert_batch(struct ATreeShardedHandle *handle,
+                                              const uint64_t *subscription_ids,
+                                              const char *const *expressions,
+                                              uintptr_t count);
+
+/**
+ * Delete a subscription by ID from its shard.
+ *
+ * # Arguments
+ * * `handle` - Valid sharded ATree handle
+ * * `subscription_id` - ID of the subscription to delete
+ *
+ * # Safety
+ * - `handle` must be a valid pointer returned by `atree_sharded_new()`
+ */
+void atree_sharded_delete(struct ATreeShardedHandle *handle, uint64_t subscription_id);
+
+/**
+ * Get a shard of a sharded A-Tree.
+ *
+ * The returned handle can be used with all the functions that do not modify the tree (e.g.
+ * `atree_memory_usage()`). The shards share the same string IDs, so the event builders created
+ * by `atree_event_builder_new()` for any of them can be searched with
+ * `atree_sharded_search_visit()`.
+ *
+ * # Returns
+ * Pointer to the ATreeHandle of the shard, null if `handle` is null or `index` is out of range
+ *
+ * # Safety
+ * - `handle` must be a valid pointer returned by `atree_sharded_new()`
+ * - The returned handle must not be used after `handle` is modified or freed and must not be
+ *   freed with `atree_free()`
+ */
+const struct ATreeHandle *atree_sharded_shard(const struct ATreeShardedHandle *handle,
+                                             uintptr_t index);
+
+/**
+ * Search every shard of a sharded A-Tree over the threads of its pool and hand each matching
+ * subscription ID to a callback.
+ *
+ * The searches of the same handle can be made from many threads at the same time.
+ *
+ * # Arguments
+ * * `handle` - Valid sharded ATree handle
+ * * `builder` - Event builder of one of the shards (consumed by this call)
+ * * `callback` - Function called with each matching subscription ID and `user_data`
+ * * `user_data` - Pointer passed as is to `callback`
+ *
+ * # Returns
+ * Result indicating success or failure
+ *
+ * # Safety
+ * - `handle` must be a valid pointer returned by `atree_sharded_new()`
+ * - `builder` must be a valid pointer returned by `atree_event_builder_new()` for a shard of
+ *   `handle`
+ * - `builder` will be consumed by this call and must not be used after
+ * - `callback` must not call back into the library with `handle`
+ * - Caller must free result.error_message with `atree_free_error()` if !success
+ */
+struct AtreeResult atree_sharded_search_visit(const struct ATreeShardedHandle *handle,
+                                              void *builder,
+                                              AtreeMatchCallback callback,
+                                              void *user_data);
 
 #endif  /* ATREE_H */
@@ -12,11 +12,17 @@
 
 #include <algorithm>
 #include <cstdint>
+#include <cstring>
+#include <fstream>
 #include <memory>
 #include <optional>
+#if __cplusplus >= 202002L
+#include <span>
+#endif
 #include <stdexcept>
 #include <string>
 #include <string_view>
+#include <type_traits>
 #include <utility>
 #include <vector>
 
@@ -205,13 +211,121 @@ struct AttributeDefinition {
     }
 };
 
+// ============================================================================
+// Payloads
+// ============================================================================
+
+/// @brief How the payloads of a BasicTree are stored as the 64-bit subscription IDs of the C API
+///
+/// The payload is stored bit for bit in the tree and handed back by the searches,
+/// so a pointer or a small struct can be matched without looking it up afterwards.
+/// The payloads are compared bit for bit to find the subscription to delete.
+template <typename Payload>
+struct PayloadTraits {
+    static_assert(std::is_trivially_copyable_v<Payload>,
+                  "the payloads are copied bit for bit into the tree");
+    static_assert(std::is_trivially_default_constructible_v<Payload>,
+                  "the payloads are decoded by copying their bits into a default-constructed one");
+    static_assert(sizeof(Payload) <= sizeof(uint64_t),
+                  "the payloads must fit in the 64 bits of a subscription ID; store a pointer instead");
+    static_assert(std::has_unique_object_representations_v<Payload>,
+                  "the payloads are compared bit for bit so they must not have padding bits");
+
+    /// @brief Get the subscription ID storing the payload
+    static uint64_t encode(const Payload& payload) {
+        uint64_t id = 0;
+        std::memcpy(&id, &payload, sizeof(Payload));
+        return id;
+    }
+
+    /// @brief Get the payload stored in the subscription ID
+    static Payload decode(uint64_t id) {
+        Payload payload;
+        std::memcpy(&payload, &id, sizeof(Payload));
+        return payload;
+    }
+};
+
 // ============================================================================
 // Forward Declarations
 // ============================================================================
 
-class Tree;
+template <typename Payload>
+class BasicTree;
+/// @brief A-Tree whose subscriptions are identified by 64-bit IDs
+using Tree = BasicTree<uint64_t>;
 class TreeBuilder;
+class AttributeHandle;
 class EventBuilder;
+class EventBatch;
+template <typename Payload>
+class BasicSearchContext;
+/// @brief Search context of a Tree
+using SearchContext = BasicSearchContext<uint64_t>;
+class Snapshot;
+class ConcurrentTree;
+class ShardedTree;
+
+// ============================================================================
+// AttributeHandle - Pre-resolved attribute
+// ============================================================================
+
+/// @brief Attribute resolved once with Tree::attribute() to set it in the events
+/// without looking up its name
+///
+/// A handle is only valid for the Tree that returned it.
+class AttributeHandle {
+private:
+    AtreeAttributeHandle handle_;
+
+    template <typename>
+    friend class BasicTree;
+    friend class EventBuilder;
+
+    explicit AttributeHandle(AtreeAttributeHandle handle) : handle_(handle) {}
+
+public:
+    /// @brief Get the position of the attribute in the tree's definitions
+    size_t index() const { return handle_.index; }
+
+    /// @brief Describe the Arrow array holding the attribute's values for a batch of events
+    /// @param type Type of the attribute, which selects the expected Arrow layout
+    /// @param array Arrow array; it is only read and must outlive the search
+    /// @param scale Number of decimal places of the mantissas of a Float column
+    /// @return Column to pass to Tree::search_columns()
+    AtreeColumn column(AttributeType type, const ArrowArray& array, uint32_t scale = 0) const {
+        return AtreeColumn{handle_, static_cast<AtreeAttributeType>(type), scale, &array};
+    }
+};
+
+// ============================================================================
+// StringId - Interned string
+// ============================================================================
+
+/// @brief String interned once with Tree::intern() to set it in the events
+/// without hashing it again
+///
+/// An ID is only valid for the Tree that returned it and until Tree::compact()
+/// is called.
+using StringId = AtreeStringId;
+
+// ============================================================================
+// MemoryUsage - Memory accounting
+// ============================================================================
+
+/// @brief Memory used by a Tree in bytes, broken down by its parts
+using MemoryUsage = AtreeMemoryUsage;
+
+// ============================================================================
+// SearchStats - Per-search statistics
+// ============================================================================
+
+/// @brief What the searches made with Tree::search_with_stats() did
+///
+/// The statistics of every search are added to the ones already in the struct
+/// so that it can be kept per thread and exported once in a while; a
+/// value-initialized struct (i.e. `SearchStats{}`) starts from zero.
+using SearchStats = AtreeSearchStats;
 
 // ============================================================================
 // EventBuilder - Fluent API for building events
@@ -222,8 +336,11 @@ class EventBuilder {
 private:
     void* builder_;
     bool consumed_;
+    std::vector<const char*> strings_;
 
-    friend class Tree;
+    template <typename>
+    friend class BasicTree;
+    friend class ShardedTree;
 
     // Private constructor - only Tree can create builders
     explicit EventBuilder(void* builder) : builder_(builder), consumed_(false) {
@@ -246,7 +363,8 @@ public:
 
     // Enable moving
     EventBuilder(EventBuilder&& other) noexcept
-        : builder_(other.builder_), consumed_(other.consumed_) {
+        : builder_(other.builder_), consumed_(other.consumed_),
+          strings_(std::move(other.strings_)) {
         other.builder_ = nullptr;
         other.consumed_ = true;
     }
@@ -258,6 +376,7 @@ public:
             }
             builder_ = other.builder_;
             consumed_ = other.consumed_;
+            strings_ = std::move(other.strings_);
             other.builder_ = nullptr;
             other.consumed_ = true;
         }
@@ -346,6 +465,121 @@ public:
         return *this;
     }
 
+    /// @brief Set a boolean attribute through its handle
+    EventBuilder& with_boolean(AttributeHandle attribute, bool value) {
+        check_not_consumed();
+        handle_result(atree_event_builder_set_boolean(builder_, attribute.handle_, value));
+        return *this;
+    }
+
+    /// @brief Set an integer attribute through its handle
+    EventBuilder& with_integer(AttributeHandle attribute, int64_t value) {
+        check_not_consumed();
+        handle_result(atree_event_builder_set_integer(builder_, attribute.handle_, value));
+        return *this;
+    }
+
+    /// @brief Set a string attribute through its handle
+    EventBuilder& with_string(AttributeHandle attribute, const char* value) {
+        check_not_consumed();
+        handle_result(atree_event_builder_set_string(builder_, attribute.handle_, value));
+        return *this;
+    }
+
+    /// @brief Set a string attribute through its handle
+    EventBuilder& with_string(AttributeHandle attribute, const std::string& value) {
+        return with_string(attribute, value.c_str());
+    }
+
+    /// @brief Set a float attribute through its handle (using decimal representation)
+    /// @param attribute Handle of the attribute
+    /// @param number Mantissa of the decimal number
+    /// @param scale Number of decimal places (e.g., 123.45 = number:12345, scale:2)
+    EventBuilder& with_float(AttributeHandle attribute, int64_t number, uint32_t scale) {
+        check_not_consumed();
+        handle_result(
+            atree_event_builder_set_float(builder_, attribute.handle_, number, scale));
+        return *this;
+    }
+
+    /// @brief Set a float attribute through its handle from a double
+    /// @param attribute Handle of the attribute
+    /// @param value Double value (converted to decimal with 6 decimal places)
+    EventBuilder& with_float(AttributeHandle attribute, double value) {
+        int64_t number = static_cast<int64_t>(value * 1000000);
+        return with_float(attribute, number, 6);
+    }
+
+    /// @brief Set a string attribute through its handle to an interned string
+    EventBuilder& with_string_id(AttributeHandle attribute, StringId value) {
+        check_not_consumed();
+        handle_result(atree_event_builder_set_string_id(builder_, attribute.handle_, value));
+        return *this;
+    }
+
+    /// @brief Set a string list attribute through its handle
+    EventBuilder& with_string_list(AttributeHandle attribute,
+                                   const std::vector<std::string>& values) {
+        check_not_consumed();
+        strings_.clear();
+        for (const auto& s : values) {
+            strings_.push_back(s.c_str());
+        }
+        handle_result(atree_event_builder_set_string_list(
+            builder_, attribute.handle_, strings_.data(), strings_.size()));
+        return *this;
+    }
+
+    /// @brief Set a string list attribute through its handle to interned strings
+    EventBuilder& with_string_id_list(AttributeHandle attribute, const StringId* values,
+                                      size_t count) {
+        check_not_consumed();
+        handle_result(atree_event_builder_set_string_id_list(
+            builder_, attribute.handle_, values, count));
+        return *this;
+    }
+
+    /// @brief Set a string list attribute through its handle to interned strings
+    EventBuilder& with_string_id_list(AttributeHandle attribute,
+                                      const std::vector<StringId>& values) {
+        return with_string_id_list(attribute, values.data(), values.size());
+    }
+
+    /// @brief Set an integer list attribute through its handle
+    EventBuilder& with_integer_list(AttributeHandle attribute, const int64_t* values,
+                                    size_t count) {
+        check_not_consumed();
+        handle_result(atree_event_builder_set_integer_list(
+            builder_, attribute.handle_, values, count));
+        return *this;
+    }
+
+    /// @brief Set an integer list attribute through its handle
+    EventBuilder& with_integer_list(AttributeHandle attribute,
+                                    const std::vector<int64_t>& values) {
+        return with_integer_list(attribute, values.data(), values.size());
+    }
+
+    /// @brief Set an attribute to undefined/null through its handle
+    EventBuilder& with_undefined(AttributeHandle attribute) {
+        check_not_consumed();
+        handle_result(atree_event_builder_set_undefined(builder_, attribute.handle_));
+        return *this;
+    }
+
+    /// @brief Set all the attributes back to undefined to build another event
+    ///
+    /// The builder keeps its memory, so reusing it with Tree::search_reused()
+    /// does not allocate once its lists have grown enough.
+    EventBuilder& reset() {
+        check_not_consumed();
+        atree_event_builder_reset(builder_);
+        return *this;
+    }
+
+    /// @brief Whether the builder was consumed by a search or moved from
+    bool is_consumed() const noexcept { return consumed_; }
+
 private:
     void check_not_consumed() const {
         if (consumed_) {
@@ -368,6 +602,113 @@ private:
     }
 };
 
+// ============================================================================
+// SearchContext - Reusable search buffers
+// ============================================================================
+
+/// @brief Buffers reused between searches to avoid allocating on every search
+///
+/// A search context is bound to the Tree that created it and must not be used
+/// by more than one search at the same time (e.g. keep one per thread).
+template <typename Payload>
+class BasicSearchContext {
+private:
+    ATreeSearchContext* context_;
+    std::vector<Payload> matches_;
+
+    template <typename>
+    friend class BasicTree;
+
+    // Private constructor - only Tree can create search contexts
+    explicit BasicSearchContext(ATreeSearchContext* context) : context_(context) {
+        if (!context_) {
+            throw Error("Failed to create search context");
+        }
+    }
+
+public:
+    /// @brief Destructor - frees the search context
+    ~BasicSearchContext() {
+        if (context_) {
+            atree_search_context_free(context_);
+        }
+    }
+
+    // Disable copying
+    BasicSearchContext(const BasicSearchContext&) = delete;
+    BasicSearchContext& operator=(const BasicSearchContext&) = delete;
+
+    // Enable moving
+    BasicSearchContext(BasicSearchContext&& other) noexcept
+        : context_(other.context_), matches_(std::move(other.matches_)) {
+        other.context_ = nullptr;
+    }
+
+    BasicSearchContext& operator=(BasicSearchContext&& other) noexcept {
+        if (this != &other) {
+            if (context_) {
+                atree_search_context_free(context_);
+            }
+            context_ = other.context_;
+            matches_ = std::move(other.matches_);
+            other.context_ = nullptr;
+        }
+        return *this;
+    }
+
+    /// @brief Get the matches of the last search made with this context
+    const std::vector<Payload>& matches() const { return matches_; }
+};
+
+// ============================================================================
+// EventBatch - Reusable columnar batch
+// ============================================================================
+
+/// @brief Events filled from columns by Tree::search_columns()
+///
+/// The batch keeps its events and their buffers between the searches.
+class EventBatch {
+private:
+    ATreeEventBatch* batch_;
+
+    template <typename>
+    friend class BasicTree;
+
+public:
+    EventBatch() : batch_(atree_event_batch_new()) {
+        if (!batch_) {
+            throw Error("Failed to create event batch");
+        }
+    }
+
+    /// @brief Destructor - frees the batch
+    ~EventBatch() {
+        if (batch_) {
+            atree_event_batch_free(batch_);
+        }
+    }
+
+    // Disable copying
+    EventBatch(const EventBatch&) = delete;
+    EventBatch& operator=(const EventBatch&) = delete;
+
+    // Enable moving
+    EventBatch(EventBatch&& other) noexcept : batch_(other.batch_) {
+        other.batch_ = nullptr;
+    }
+
+    EventBatch& operator=(EventBatch&& other) noexcept {
+        if (this != &other) {
+            if (batch_) {
+                atree_event_batch_free(batch_);
+            }
+            batch_ = other.batch_;
+            other.batch_ = nullptr;
+        }
+        return *this;
+    }
+};
+
 // ============================================================================
 // TreeBuilder - Fluent API for building Trees
 // ============================================================================
@@ -417,10 +758,12 @@ public:
     }
 
     /// @brief Build the tree (throws on error)
-    Tree build() &&;
+    template <typename Payload = uint64_t>
+    BasicTree<Payload> build() &&;
 
     /// @brief Build the tree (returns Result)
-    Result<Tree> try_build() &&;
+    template <typename Payload = uint64_t>
+    Result<BasicTree<Payload>> try_build() &&;
 };
 
 // ============================================================================
@@ -428,15 +771,99 @@ public:
 // ============================================================================
 
 /// @brief A-Tree container for boolean expression matching
-class Tree {
+///
+/// The subscriptions are identified by their payloads, which the searches hand
+/// back: 64-bit IDs for a Tree, or pointers and small structs (see PayloadTraits)
+/// for a BasicTree<Payload> so that the matches need no lookup after the searches.
+template <typename Payload>
+class BasicTree {
 private:
     ATreeHandle* handle_;
+    bool owned_ = true;
+
+    friend class Snapshot;
+
+    // Private constructor - only Snapshot can create non-owning views of a tree
+    BasicTree(const ATreeHandle* handle, bool owned)
+        : handle_(const_cast<ATreeHandle*>(handle)), owned_(owned) {
+        if (!handle_) {
+            throw Error("Failed to get the tree of the snapshot");
+        }
+    }
+
+    using Traits = PayloadTraits<Payload>;
+
+    static void push_match(uint64_t subscription_id, void* user_data) {
+        static_cast<std::vector<Payload>*>(user_data)->push_back(Traits::decode(subscription_id));
+    }
+
+    static std::vector<std::vector<Payload>> take_results(std::vector<AtreeSearchResult>& results) {
+        std::vector<std::vector<Payload>> matches(results.size());
+        for (size_t i = 0; i < results.size(); ++i) {
+            if (results[i].ids != nullptr && results[i].count > 0) {
+                matches[i].reserve(results[i].count);
+                for (size_t j = 0; j < results[i].count; ++j) {
+                    matches[i].push_back(Traits::decode(results[i].ids[j]));
+                }
+                atree_search_result_free(results[i]);
+            }
+        }
+        return matches;
+    }
+
+    Result<void> visit(ATreeSearchContext* context, EventBuilder& builder,
+                       std::vector<Payload>& matches) const {
+        builder.check_not_consumed();
+        matches.clear();
+        AtreeResult result = atree_search_visit(
+            handle_, context, builder.release(), &BasicTree::push_match, &matches);
+
+        if (result.success) {
+            return Result<void>::ok();
+        } else {
+            std::string error_msg = result.error_message;
+            atree_free_error(result.error_message);
+            return Result<void>::err(std::move(error_msg));
+        }
+    }
+
+    Result<void> visit_stats(ATreeSearchContext* context, EventBuilder& builder,
+                             std::vector<Payload>& matches, SearchStats& stats) const {
+        builder.check_not_consumed();
+        matches.clear();
+        AtreeResult result = atree_search_stats(
+            handle_, context, builder.release(), &BasicTree::push_match, &matches, &stats);
+
+        if (result.success) {
+            return Result<void>::ok();
+        } else {
+            std::string error_msg = result.error_message;
+            atree_free_error(result.error_message);
+            return Result<void>::err(std::move(error_msg));
+        }
+    }
+
+    Result<void> visit_reused(ATreeSearchContext* context, const EventBuilder& builder,
+                              std::vector<Payload>& matches) const {
+        builder.check_not_consumed();
+        matches.clear();
+        AtreeResult result = atree_search_reused_visit(
+            handle_, context, builder.builder_, &BasicTree::push_match, &matches);
+
+        if (result.success) {
+            return Result<void>::ok();
+        } else {
+            std::string error_msg = result.error_message;
+            atree_free_error(result.error_message);
+            return Result<void>::err(std::move(error_msg));
+        }
+    }
 
 public:
     /// @brief Create a new A-Tree with the given attribute definitions
     /// @param definitions Vector of attribute definitions
     /// @throws Error if creation fails
-    explicit Tree(const std::vector<AttributeDefinition>& definitions) {
+    explicit BasicTree(const std::vector<AttributeDefinition>& definitions) {
         std::vector<AtreeAttributeDef> c_defs;
         c_defs.reserve(definitions.size());
 
@@ -454,27 +881,28 @@ public:
     }
 
     /// @brief Destructor - frees the tree
-    ~Tree() {
-        if (handle_) {
+    ~BasicTree() {
+        if (handle_ && owned_) {
             atree_free(handle_);
         }
     }
 
     // Disable copying
-    Tree(const Tree&) = delete;
-    Tree& operator=(const Tree&) = delete;
+    BasicTree(const BasicTree&) = delete;
+    BasicTree& operator=(const BasicTree&) = delete;
 
     // Enable moving
-    Tree(Tree&& other) noexcept : handle_(other.handle_) {
+    BasicTree(BasicTree&& other) noexcept : handle_(other.handle_), owned_(other.owned_) {
         other.handle_ = nullptr;
     }
 
-    Tree& operator=(Tree&& other) noexcept {
+    BasicTree& operator=(BasicTree&& other) noexcept {
         if (this != &other) {
-            if (handle_) {
+            if (handle_ && owned_) {
                 atree_free(handle_);
             }
             handle_ = other.handle_;
+            owned_ = other.owned_;
             other.handle_ = nullptr;
         }
         return *this;
@@ -485,13 +913,35 @@ public:
         return TreeBuilder();
     }
 
+    /// @brief Load a tree from a snapshot file written by save() (throws on error)
+    /// @param path Path of the snapshot file
+    /// @throws Error if the file cannot be read or is not a compatible snapshot
+    static BasicTree load(const std::string& path) {
+        ATreeHandle* handle = atree_load(path.c_str());
+        if (!handle) {
+            throw Error("Failed to load A-Tree snapshot from " + path);
+        }
+        return BasicTree(handle, true);
+    }
+
+    /// @brief Load a tree from a snapshot file written by save() (returns Result)
+    /// @param path Path of the snapshot file
+    /// @return Result containing the loaded tree
+    static Result<BasicTree> try_load(const std::string& path) {
+        ATreeHandle* handle = atree_load(path.c_str());
+        if (!handle) {
+            return Result<BasicTree>::err("Failed to load A-Tree snapshot from " + path);
+        }
+        return Result<BasicTree>::ok(BasicTree(handle, true));
+    }
+
     /// @brief Insert a boolean expression (throws on error)
-    /// @param subscription_id Unique identifier for this subscription
+    /// @param payload Unique payload identifying this subscription
     /// @param expression Boolean expression string
     /// @throws Error if insertion fails
-    void insert(uint64_t subscription_id, std::string_view expression) {
+    void insert(const Payload& payload, std::string_view expression) {
         AtreeResult result = atree_insert(
-            handle_, subscription_id, std::string(expression).c_str());
+            handle_, Traits::encode(payload), std::string(expression).c_str());
 
         if (!result.success) {
             std::string error_msg = result.error_message;
@@ -501,12 +951,12 @@ public:
     }
 
     /// @brief Insert a boolean expression (returns Result)
-    /// @param subscription_id Unique identifier for this subscription
+    /// @param payload Unique payload identifying this subscription
     /// @param expression Boolean expression string
     /// @return Result indicating success or failure
-    Result<void> try_insert(uint64_t subscription_id, std::string_view expression) {
+    Result<void> try_insert(const Payload& payload, std::string_view expression) {
         AtreeResult result = atree_insert(
-            handle_, subscription_id, std::string(expression).c_str());
+            handle_, Traits::encode(payload), std::string(expression).c_str());
 
         if (result.success) {
             return Result<void>::ok();
@@ -517,10 +967,69 @@ public:
         }
     }
 
-    /// @brief Delete a subscription by ID
-    /// @param subscription_id ID of the subscription to remove
-    void delete_subscription(uint64_t subscription_id) {
-        atree_delete(handle_, subscription_id);
+    /// @brief Insert many boolean expressions at once (throws on error)
+    /// @param expressions Pairs of unique payload and boolean expression
+    /// @throws Error if one of the expressions is invalid; none of them is inserted then
+    void insert_many(const std::vector<std::pair<Payload, std::string>>& expressions) {
+        try_insert_many(expressions).unwrap();
+    }
+
+    /// @brief Insert many boolean expressions at once (returns Result)
+    /// @param expressions Pairs of unique payload and boolean expression
+    /// @return Result indicating success or failure; nothing is inserted on failure
+    Result<void> try_insert_many(
+        const std::vector<std::pair<Payload, std::string>>& expressions) {
+        std::vector<Payload> ids;
+        std::vector<const char*> c_strs;
+        ids.reserve(expressions.size());
+        c_strs.reserve(expressions.size());
+        for (const auto& [payload, expression] : expressions) {
+            ids.push_back(Traits::encode(payload));
+            c_strs.push_back(expression.c_str());
+        }
+
+        AtreeResult result = atree_insert_batch(handle_, ids.data(), c_strs.data(), ids.size());
+        if (result.success) {
+            return Result<void>::ok();
+        } else {
+            std::string error_msg = result.error_message;
+            atree_free_error(result.error_message);
+            return Result<void>::err(std::move(error_msg));
+        }
+    }
+
+    /// @brief Delete a subscription by payload
+    /// @param payload Payload of the subscription to remove
+    void delete_subscription(const Payload& payload) {
+        atree_delete(handle_, Traits::encode(payload));
+    }
+
+    /// @brief Delete many subscriptions at once
+    /// @param payloads Payloads of the subscriptions to remove; the unknown ones are ignored
+    void delete_many(const std::vector<Payload>& payloads) {
+        std::vector<uint64_t> ids;
+        ids.reserve(payloads.size());
+        for (const auto& payload : payloads) {
+            ids.push_back(Traits::encode(payload));
+        }
+        atree_delete_batch(handle_, ids.data(), ids.size());
+    }
+
+    /// @brief Get the memory used by the tree
+    /// @return Memory usage in bytes, broken down by its parts
+    MemoryUsage memory_usage() const {
+        return atree_memory_usage(handle_);
+    }
+
+    /// @brief Release the memory left behind by the deletions
+    ///
+    /// Renumbers the nodes densely, drops the strings that no expression
+    /// references anymore and shrinks the buffers. This walks over the whole
+    /// tree so it is meant to be called during low-traffic windows. No event
+    /// builder of the tree may be alive and the IDs returned by intern() must be
+    /// interned again.
+    void compact() {
+        atree_compact(handle_);
     }
 
     /// @brief Create a new event builder
@@ -530,51 +1039,389 @@ public:
         return EventBuilder(builder);
     }
 
-    /// @brief Search for expressions (throws on error)
-    /// @param builder EventBuilder containing the event data (consumed by this call)
-    /// @return Vector of matching subscription IDs
-    std::vector<uint64_t> search(EventBuilder& builder) const {
-        AtreeSearchResult result = atree_search(handle_, builder.release());
+    /// @brief Resolve an attribute once to set it in the events by handle (throws on error)
+    /// @param name Name of the attribute
+    /// @return Handle of the attribute
+    /// @throws Error if the attribute does not exist
+    AttributeHandle attribute(std::string_view name) const {
+        return try_attribute(name).unwrap();
+    }
 
-        std::vector<uint64_t> matches;
-        if (result.ids != nullptr && result.count > 0) {
-            matches.assign(result.ids, result.ids + result.count);
-            atree_search_result_free(result);
+    /// @brief Resolve an attribute once to set it in the events by handle (returns Result)
+    /// @param name Name of the attribute
+    /// @return Result containing the handle of the attribute
+    Result<AttributeHandle> try_attribute(std::string_view name) const {
+        AtreeAttributeHandle handle{};
+        AtreeResult result = atree_attribute(handle_, std::string(name).c_str(), &handle);
+
+        if (result.success) {
+            return Result<AttributeHandle>::ok(AttributeHandle(handle));
+        } else {
+            std::string error_msg = result.error_message;
+            atree_free_error(result.error_message);
+            return Result<AttributeHandle>::err(std::move(error_msg));
+        }
+    }
+
+    /// @brief Intern a string once to set it in the events by ID (throws on error)
+    ///
+    /// The ID stays valid until compact() is called; every interned string is
+    /// kept by the tree until then.
+    /// @param value String to intern
+    /// @return ID of the string
+    StringId intern(std::string_view value) {
+        return try_intern(value).unwrap();
+    }
+
+    /// @brief Intern a string once to set it in the events by ID (returns Result)
+    /// @param value String to intern
+    /// @return Result containing the ID of the string
+    Result<StringId> try_intern(std::string_view value) {
+        StringId id{};
+        AtreeResult result = atree_intern(handle_, std::string(value).c_str(), &id);
+
+        if (result.success) {
+            return Result<StringId>::ok(id);
+        } else {
+            std::string error_msg = result.error_message;
+            atree_free_error(result.error_message);
+            return Result<StringId>::err(std::move(error_msg));
         }
+    }
 
+    /// @brief Search for expressions (throws on error)
+    /// @param builder EventBuilder containing the event data (consumed by this call)
+    /// @return Vector of matching payloads
+    std::vector<Payload> search(EventBuilder& builder) const {
+        std::vector<Payload> matches;
+        search_into(builder, matches);
         return matches;
     }
 
     /// @brief Search for expressions (rvalue overload, throws on error)
     /// @param builder EventBuilder containing the event data (consumed by this call)
-    /// @return Vector of matching subscription IDs
-    std::vector<uint64_t> search(EventBuilder&& builder) const {
+    /// @return Vector of matching payloads
+    std::vector<Payload> search(EventBuilder&& builder) const {
         return search(builder);
     }
 
     /// @brief Search for expressions (returns Result)
     /// @param builder EventBuilder containing the event data (consumed by this call)
-    /// @return Result containing vector of matching subscription IDs
-    Result<std::vector<uint64_t>> try_search(EventBuilder& builder) const {
-        AtreeSearchResult result = atree_search(handle_, builder.release());
-
-        std::vector<uint64_t> matches;
-        if (result.ids != nullptr && result.count > 0) {
-            matches.assign(result.ids, result.ids + result.count);
-            atree_search_result_free(result);
+    /// @return Result containing vector of matching payloads
+    Result<std::vector<Payload>> try_search(EventBuilder& builder) const {
+        std::vector<Payload> matches;
+        auto result = try_search_into(builder, matches);
+        if (result.is_err()) {
+            return Result<std::vector<Payload>>::err(result.error());
         }
 
-        return Result<std::vector<uint64_t>>::ok(std::move(matches));
+        return Result<std::vector<Payload>>::ok(std::move(matches));
     }
 
     /// @brief Search for expressions (rvalue overload, returns Result)
     /// @param builder EventBuilder containing the event data (consumed by this call)
-    /// @return Result containing vector of matching subscription IDs
-    Result<std::vector<uint64_t>> try_search(EventBuilder&& builder) const {
+    /// @return Result containing vector of matching payloads
+    Result<std::vector<Payload>> try_search(EventBuilder&& builder) const {
         return try_search(builder);
     }
 
-    /// @brief Export the tree structure as Graphviz DOT format (throws on error)
+    /// @brief Search for expressions while recording what the search did (throws on error)
+    ///
+    /// Only the searches made with this function are instrumented.
+    /// @param builder EventBuilder containing the event data (consumed by this call)
+    /// @param stats Statistics the ones of the search are added to
+    /// @return Vector of matching payloads
+    std::vector<Payload> search_with_stats(EventBuilder& builder, SearchStats& stats) const {
+        return try_search_with_stats(builder, stats).unwrap();
+    }
+
+    /// @brief Search for expressions while recording what the search did (rvalue overload)
+    std::vector<Payload> search_with_stats(EventBuilder&& builder, SearchStats& stats) const {
+        return search_with_stats(builder, stats);
+    }
+
+    /// @brief Search for expressions while recording what the search did (returns Result)
+    /// @param builder EventBuilder containing the event data (consumed by this call)
+    /// @param stats Statistics the ones of the search are added to
+    /// @return Result containing vector of matching payloads
+    Result<std::vector<Payload>> try_search_with_stats(EventBuilder& builder,
+                                                        SearchStats& stats) const {
+        std::vector<Payload> matches;
+        auto result = visit_stats(nullptr, builder, matches, stats);
+        if (result.is_err()) {
+            return Result<std::vector<Payload>>::err(result.error());
+        }
+
+        return Result<std::vector<Payload>>::ok(std::move(matches));
+    }
+
+    /// @brief Search for expressions into a caller-owned vector (throws on error)
+    ///
+    /// The vector is cleared and the matches are appended to it as they are found, so
+    /// reusing the same vector between searches does not allocate once it has grown enough.
+    /// @param builder EventBuilder containing the event data (consumed by this call)
+    /// @param matches Vector receiving the matching payloads
+    void search_into(EventBuilder& builder, std::vector<Payload>& matches) const {
+        try_search_into(builder, matches).unwrap();
+    }
+
+    /// @brief Search for expressions into a caller-owned vector (rvalue overload)
+    /// @param builder EventBuilder containing the event data (consumed by this call)
+    /// @param matches Vector receiving the matching payloads
+    void search_into(EventBuilder&& builder, std::vector<Payload>& matches) const {
+        search_into(builder, matches);
+    }
+
+    /// @brief Search for expressions into a caller-owned vector (returns Result)
+    /// @param builder EventBuilder containing the event data (consumed by this call)
+    /// @param matches Vector receiving the matching payloads
+    /// @return Result indicating success or failure
+    Result<void> try_search_into(EventBuilder& builder, std::vector<Payload>& matches) const {
+        return visit(nullptr, builder, matches);
+    }
+
+    /// @brief Search for expressions into a caller-owned buffer (throws on error)
+    /// @param builder EventBuilder containing the event data (consumed by this call)
+    /// @param data Buffer receiving the matching payloads
+    /// @param capacity Number of payloads that fit in the buffer
+    /// @return Number of matching payloads written to the buffer
+    /// @throws Error if more than `capacity` subscriptions match
+    size_t search_into(EventBuilder& builder, Payload* data, size_t capacity) const {
+        return try_search_into(builder, data, capacity).unwrap();
+    }
+
+    /// @brief Search for expressions into a caller-owned buffer (rvalue overload)
+    size_t search_into(EventBuilder&& builder, Payload* data, size_t capacity) const {
+        return search_into(builder, data, capacity);
+    }
+
+    /// @brief Search for expressions into a caller-owned buffer (returns Result)
+    /// @param builder EventBuilder containing the event data (consumed by this call)
+    /// @param data Buffer receiving the matching payloads
+    /// @param capacity Number of payloads that fit in the buffer
+    /// @return Result containing the number of matching payloads written to the buffer
+    Result<size_t> try_search_into(EventBuilder& builder, Payload* data, size_t capacity) const {
+        static_assert(sizeof(Payload) == sizeof(uint64_t),
+                      "the buffer is filled with 64-bit subscription IDs; search into a vector instead");
+        builder.check_not_consumed();
+        size_t count = 0;
+        AtreeResult result = atree_search_into(
+            handle_, builder.release(), reinterpret_cast<uint64_t*>(data), capacity, &count);
+
+        if (result.success) {
+            return Result<size_t>::ok(count);
+        } else {
+            std::string error_msg = result.error_message;
+            atree_free_error(result.error_message);
+            return Result<size_t>::err(std::move(error_msg));
+        }
+    }
+
+#if __cplusplus >= 202002L
+    /// @brief Search for expressions into a caller-owned span (throws on error)
+    /// @param builder EventBuilder containing the event data (consumed by this call)
+    /// @param matches Span receiving the matching payloads
+    /// @return Number of matching payloads written to the span
+    /// @throws Error if more subscriptions match than the span can hold
+    size_t search_into(EventBuilder& builder, std::span<Payload> matches) const {
+        return search_into(builder, matches.data(), matches.size());
+    }
+
+    /// @brief Search for expressions into a caller-owned span (rvalue overload)
+    size_t search_into(EventBuilder&& builder, std::span<Payload> matches) const {
+        return search_into(builder, matches.data(), matches.size());
+    }
+
+    /// @brief Search for expressions into a caller-owned span (returns Result)
+    Result<size_t> try_search_into(EventBuilder& builder, std::span<Payload> matches) const {
+        return try_search_into(builder, matches.data(), matches.size());
+    }
+#endif
+
+    /// @brief Search for the expressions matching each event of a batch (throws on error)
+    /// @param builders EventBuilders containing the events data (all consumed by this call)
+    /// @return Vector of matching payloads for each event, in the same order
+    /// @throws Error if one of the events cannot be built
+    std::vector<std::vector<Payload>> search_batch(std::vector<EventBuilder>& builders) const {
+        return try_search_batch(builders).unwrap();
+    }
+
+    /// @brief Search for the expressions matching each event of a batch (rvalue overload)
+    /// @param builders EventBuilders containing the events data (all consumed by this call)
+    /// @return Vector of matching payloads for each event, in the same order
+    /// @throws Error if one of the events cannot be built
+    std::vector<std::vector<Payload>> search_batch(std::vector<EventBuilder>&& builders) const {
+        return search_batch(builders);
+    }
+
+    /// @brief Search for the expressions matching each event of a batch (returns Result)
+    /// @param builders EventBuilders containing the events data (all consumed by this call)
+    /// @return Result containing the matching payloads for each event, in the same order
+    Result<std::vector<std::vector<Payload>>> try_search_batch(
+        std::vector<EventBuilder>& builders) const {
+        std::vector<void*> c_builders;
+        c_builders.reserve(builders.size());
+        for (auto& builder : builders) {
+            builder.check_not_consumed();
+        }
+        for (auto& builder : builders) {
+            c_builders.push_back(builder.release());
+        }
+
+        std::vector<AtreeSearchResult> results(builders.size());
+        AtreeResult result = atree_search_batch(
+            handle_, c_builders.data(), c_builders.size(), results.data());
+        if (!result.success) {
+            std::string error_msg = result.error_message;
+            atree_free_error(result.error_message);
+            return Result<std::vector<std::vector<Payload>>>::err(std::move(error_msg));
+        }
+
+        return Result<std::vector<std::vector<Payload>>>::ok(take_results(results));
+    }
+
+    /// @brief Search for the expressions matching each event of a columnar batch (throws on error)
+    /// @param batch EventBatch reused between the searches
+    /// @param rows Number of events in the batch
+    /// @param columns Columns of the attributes, created with AttributeHandle::column()
+    /// @return Vector of matching payloads for each event, in the same order
+    /// @throws Error if a column does not match its attribute
+    std::vector<std::vector<Payload>> search_columns(
+        EventBatch& batch, size_t rows, const std::vector<AtreeColumn>& columns) const {
+        return try_search_columns(batch, rows, columns).unwrap();
+    }
+
+    /// @brief Search for the expressions matching each event of a columnar batch (returns Result)
+    /// @param batch EventBatch reused between the searches
+    /// @param rows Number of events in the batch
+    /// @param columns Columns of the attributes, created with AttributeHandle::column()
+    /// @return Result containing the matching payloads for each event, in the same order
+    Result<std::vector<std::vector<Payload>>> try_search_columns(
+        EventBatch& batch, size_t rows, const std::vector<AtreeColumn>& columns) const {
+        std::vector<AtreeSearchResult> results(rows);
+        AtreeResult result = atree_search_columns(
+            handle_, batch.batch_, columns.data(), columns.size(), rows, results.data());
+        if (!result.success) {
+            std::string error_msg = result.error_message;
+            atree_free_error(result.error_message);
+            return Result<std::vector<std::vector<Payload>>>::err(std::move(error_msg));
+        }
+
+        return Result<std::vector<std::vector<Payload>>>::ok(take_results(results));
+    }
+
+    /// @brief Create a search context that can be reused between searches
+    /// @return SearchContext bound to this tree
+    /// @throws Error if creation fails
+    BasicSearchContext<Payload> make_search_context() const {
+        return BasicSearchContext<Payload>(atree_search_context_new(handle_));
+    }
+
+    /// @brief Search for expressions by reusing a search context
+    /// @param context SearchContext created by this tree
+    /// @param builder EventBuilder containing the event data (consumed by this call)
+    /// @return Matching payloads; valid until the next search with the context
+    const std::vector<Payload>& search(BasicSearchContext<Payload>& context, EventBuilder& builder) const {
+        search_into(context, builder, context.matches_);
+        return context.matches_;
+    }
+
+    /// @brief Search for expressions by reusing a search context (rvalue overload)
+    /// @param context SearchContext created by this tree
+    /// @param builder EventBuilder containing the event data (consumed by this call)
+    /// @return Matching payloads; valid until the next search with the context
+    const std::vector<Payload>& search(BasicSearchContext<Payload>& context, EventBuilder&& builder) const {
+        return search(context, builder);
+    }
+
+    /// @brief Search for expressions by reusing a search context into a caller-owned vector
+    ///
+    /// With a reused context and vector, the search does not allocate any memory.
+    /// @param context SearchContext created by this tree
+    /// @param builder EventBuilder containing the event data (consumed by this call)
+    /// @param matches Vector receiving the matching payloads
+    /// @throws Error if the event cannot be built
+    void search_into(BasicSearchContext<Payload>& context, EventBuilder& builder,
+                     std::vector<Payload>& matches) const {
+        visit(context.context_, builder, matches).unwrap();
+    }
+
+    /// @brief Search for expressions by reusing a search context into a caller-owned vector
+    /// (rvalue overload)
+    void search_into(BasicSearchContext<Payload>& context, EventBuilder&& builder,
+                     std::vector<Payload>& matches) const {
+        search_into(context, builder, matches);
+    }
+
+    /// @brief Search for expressions by reusing a search context while recording what the
+    /// search did
+    /// @param context SearchContext created by this tree
+    /// @param builder EventBuilder containing the event data (consumed by this call)
+    /// @param stats Statistics the ones of the search are added to
+    /// @return Matching payloads; valid until the next search with the context
+    /// @throws Error if the event cannot be built
+    const std::vector<Payload>& search_with_stats(BasicSearchContext<Payload>& context, EventBuilder& builder,
+                                                   SearchStats& stats) const {
+        visit_stats(context.context_, builder, context.matches_, stats).unwrap();
+        return context.matches_;
+    }
+
+    /// @brief Search for expressions by reusing a search context while recording what the
+    /// search did (rvalue overload)
+    const std::vector<Payload>& search_with_stats(BasicSearchContext<Payload>& context, EventBuilder&& builder,
+                                                   SearchStats& stats) const {
+        return search_with_stats(context, builder, stats);
+    }
+
+    /// @brief Search for expressions without consuming the builder (throws on error)
+    ///
+    /// The builder can then be reset() and reused for the next event.
+    /// @param builder EventBuilder containing the event data (left untouched)
+    /// @param matches Vector receiving the matching payloads
+    void search_reused(const EventBuilder& builder, std::vector<Payload>& matches) const {
+        visit_reused(nullptr, builder, matches).unwrap();
+    }
+
+    /// @brief Search for expressions without consuming the builder (returns Result)
+    /// @param builder EventBuilder containing the event data (left untouched)
+    /// @param matches Vector receiving the matching payloads
+    /// @return Result indicating success or failure
+    Result<void> try_search_reused(const EventBuilder& builder,
+                                   std::vector<Payload>& matches) const {
+        return visit_reused(nullptr, builder, matches);
+    }
+
+    /// @brief Search for expressions by reusing a search context and without consuming the
+    /// builder (throws on error)
+    ///
+    /// With a reused context, builder and vector, the search does not allocate any memory.
+    /// @param context SearchContext created by this tree
+    /// @param builder EventBuilder containing the event data (left untouched)
+    /// @param matches Vector receiving the matching payloads
+    void search_reused(BasicSearchContext<Payload>& context, const EventBuilder& builder,
+                       std::vector<Payload>& matches) const {
+        visit_reused(context.context_, builder, matches).unwrap();
+    }
+
+    /// @brief Search for expressions by reusing a search context and without consuming the
+    /// builder (returns Result)
+    Result<void> try_search_reused(BasicSearchContext<Payload>& context, const EventBuilder& builder,
+                                   std::vector<Payload>& matches) const {
+        return visit_reused(context.context_, builder, matches);
+    }
+
+    /// @brief Search for expressions by reusing a search context and without consuming the
+    /// builder
+    /// @param context SearchContext created by this tree
+    /// @param builder EventBuilder containing the event data (left untouched)
+    /// @return Matching payloads; valid until the next search with the context
+    const std::vector<Payload>& search_reused(BasicSearchContext<Payload>& context,
+                                               const EventBuilder& builder) const {
+        search_reused(context, builder, context.matches_);
+        return context.matches_;
+    }
+
+    /// @brief Export the tree structure as Graphviz DOT format (throws on error)
     /// @return DOT format string
     /// @throws Error if export fails
     std::string to_graphviz() const {
@@ -600,21 +1447,550 @@ public:
         atree_free_string(dot);
         return Result<std::string>::ok(std::move(result));
     }
+
+    /// @brief Save a snapshot of the tree that can be loaded with load() (throws on error)
+    /// @param path Path of the file to write
+    void save(const std::string& path) const {
+        AtreeResult result = atree_save(handle_, path.c_str());
+
+        if (!result.success) {
+            std::string error_msg = result.error_message;
+            atree_free_error(result.error_message);
+            throw Error(error_msg);
+        }
+    }
+
+    /// @brief Save a snapshot of the tree that can be loaded with load() (returns Result)
+    /// @param path Path of the file to write
+    /// @return Result indicating success or failure
+    Result<void> try_save(const std::string& path) const {
+        AtreeResult result = atree_save(handle_, path.c_str());
+
+        if (result.success) {
+            return Result<void>::ok();
+        } else {
+            std::string error_msg = result.error_message;
+            atree_free_error(result.error_message);
+            return Result<void>::err(std::move(error_msg));
+        }
+    }
+};
+
+// ============================================================================
+// ConcurrentTree - Thread-safe A-Tree with non-blocking searches
+// ============================================================================
+
+/// @brief Read-only snapshot of a ConcurrentTree
+///
+/// The snapshot does not see the writes published after it was taken and it
+/// delays the next publish until it is destroyed, so it should be short-lived.
+/// It must be destroyed before the ConcurrentTree that created it.
+class Snapshot {
+private:
+    ATreeSnapshot* snapshot_;
+    Tree tree_;
+
+    friend class ConcurrentTree;
+
+    // Private constructor - only ConcurrentTree can create snapshots
+    explicit Snapshot(ATreeSnapshot* snapshot)
+        : snapshot_(snapshot), tree_(checked_tree(snapshot), false) {}
+
+    static const ATreeHandle* checked_tree(ATreeSnapshot* snapshot) {
+        if (!snapshot) {
+            throw Error("Failed to take a snapshot");
+        }
+        return atree_snapshot_tree(snapshot);
+    }
+
+public:
+    /// @brief Destructor - releases the snapshot
+    ~Snapshot() {
+        if (snapshot_) {
+            atree_snapshot_free(snapshot_);
+        }
+    }
+
+    // Disable copying
+    Snapshot(const Snapshot&) = delete;
+    Snapshot& operator=(const Snapshot&) = delete;
+
+    // Enable moving
+    Snapshot(Snapshot&& other) noexcept
+        : snapshot_(other.snapshot_), tree_(std::move(other.tree_)) {
+        other.snapshot_ = nullptr;
+    }
+
+    Snapshot& operator=(Snapshot&& other) noexcept {
+        if (this != &other) {
+            if (snapshot_) {
+                atree_snapshot_free(snapshot_);
+            }
+            snapshot_ = other.snapshot_;
+            tree_ = std::move(other.tree_);
+            other.snapshot_ = nullptr;
+        }
+        return *this;
+    }
+
+    /// @brief Get the tree of the snapshot; only its read-only operations are available
+    const Tree& tree() const { return tree_; }
+
+    /// @brief Access the read-only operations of the tree of the snapshot
+    const Tree* operator->() const { return &tree_; }
+};
+
+/// @brief A-Tree that can be searched by many threads while it is updated
+///
+/// All the operations are thread-safe. The insertions and deletions are staged
+/// and only become visible to the searches once publish() is called, so a single
+/// publish can cover many updates. The searches never wait on the writers.
+class ConcurrentTree {
+private:
+    ATreeSharedHandle* handle_;
+
+public:
+    /// @brief Create a new concurrent A-Tree with the given attribute definitions
+    /// @param definitions Vector of attribute definitions
+    /// @throws Error if creation fails
+    explicit ConcurrentTree(const std::vector<AttributeDefinition>& definitions) {
+        std::vector<AtreeAttributeDef> c_defs;
+        c_defs.reserve(definitions.size());
+
+        for (const auto& def : definitions) {
+            c_defs.push_back({
+                def.name.c_str(),
+                static_cast<AtreeAttributeType>(def.type)
+            });
+        }
+
+        handle_ = atree_shared_new(c_defs.data(), c_defs.size());
+        if (!handle_) {
+            throw Error("Failed to create A-Tree");
+        }
+    }
+
+    /// @brief Destructor - frees the tree; all its snapshots must have been destroyed
+    ~ConcurrentTree() {
+        if (handle_) {
+            atree_shared_free(handle_);
+        }
+    }
+
+    // Disable copying
+    ConcurrentTree(const ConcurrentTree&) = delete;
+    ConcurrentTree& operator=(const ConcurrentTree&) = delete;
+
+    // Enable moving
+    ConcurrentTree(ConcurrentTree&& other) noexcept : handle_(other.handle_) {
+        other.handle_ = nullptr;
+    }
+
+    ConcurrentTree& operator=(ConcurrentTree&& other) noexcept {
+        if (this != &other) {
+            if (handle_) {
+                atree_shared_free(handle_);
+            }
+            handle_ = other.handle_;
+            other.handle_ = nullptr;
+        }
+        return *this;
+    }
+
+    /// @brief Stage the insertion of a boolean expression (throws on error)
+    /// @param subscription_id Unique identifier for this subscription
+    /// @param expression Boolean expression string
+    /// @throws Error if insertion fails
+    void insert(uint64_t subscription_id, std::string_view expression) {
+        try_insert(subscription_id, expression).unwrap();
+    }
+
+    /// @brief Stage the insertion of a boolean expression (returns Result)
+    /// @param subscription_id Unique identifier for this subscription
+    /// @param expression Boolean expression string
+    /// @return Result indicating success or failure
+    Result<void> try_insert(uint64_t subscription_id, std::string_view expression) {
+        AtreeResult result = atree_shared_insert(
+            handle_, subscription_id, std::string(expression).c_str());
+
+        if (result.success) {
+            return Result<void>::ok();
+        } else {
+            std::string error_msg = result.error_message;
+            atree_free_error(result.error_message);
+            return Result<void>::err(std::move(error_msg));
+        }
+    }
+
+    /// @brief Stage the deletion of a subscription by ID
+    /// @param subscription_id ID of the subscription to remove
+    void delete_subscription(uint64_t subscription_id) {
+        atree_shared_delete(handle_, subscription_id);
+    }
+
+    /// @brief Make the staged insertions and deletions visible to the searches
+    ///
+    /// Waits for the snapshots taken before the previous publish to be destroyed;
+    /// the calling thread must not hold a snapshot.
+    void publish() {
+        atree_shared_publish(handle_);
+    }
+
+    /// @brief Take a snapshot of the tree to search it without blocking
+    /// @return Snapshot of the published state of the tree
+    /// @throws Error if the snapshot cannot be taken
+    Snapshot snapshot() const {
+        return Snapshot(atree_shared_snapshot(handle_));
+    }
+
+    /// @brief Search the published state of the tree
+    /// @param build_event Callable that receives the EventBuilder to fill
+    /// @return Vector of matching subscription IDs
+    template <typename BuildEvent>
+    std::vector<uint64_t> search(BuildEvent&& build_event) const {
+        Snapshot current = snapshot();
+        EventBuilder event = current.tree().make_event();
+        std::forward<BuildEvent>(build_event)(event);
+        return current.tree().search(event);
+    }
+};
+
+// ============================================================================
+// NUMA Topology
+// ============================================================================
+
+namespace numa {
+
+/// @brief Parse a list of CPUs in the format of the Linux sysfs (e.g. "0-3,8,10-11")
+/// @param list List of CPU indexes and ranges separated by commas
+/// @return CPU indexes in the order of the list; empty if the list is malformed
+inline std::vector<size_t> parse_cpu_list(std::string_view list) {
+    std::vector<size_t> cpus;
+    auto parse_number = [&list](size_t& value) {
+        size_t digits = 0;
+        value = 0;
+        while (digits < list.size() && list[digits] >= '0' && list[digits] <= '9') {
+            value = value * 10 + static_cast<size_t>(list[digits] - '0');
+            ++digits;
+        }
+        list.remove_prefix(digits);
+        return digits > 0;
+    };
+
+    while (!list.empty() && list.back() == '\n') {
+        list.remove_suffix(1);
+    }
+    while (!list.empty()) {
+        size_t first = 0;
+        size_t last = 0;
+        if (!parse_number(first)) {
+            return {};
+        }
+        last = first;
+        if (!list.empty() && list.front() == '-') {
+            list.remove_prefix(1);
+            if (!parse_number(last) || last < first) {
+                return {};
+            }
+        }
+        for (size_t cpu = first; cpu <= last; ++cpu) {
+            cpus.push_back(cpu);
+        }
+        if (!list.empty()) {
+            if (list.front() != ',') {
+                return {};
+            }
+            list.remove_prefix(1);
+        }
+    }
+    return cpus;
+}
+
+/// @brief Get the CPUs of every online NUMA node from /sys/devices/system/node
+/// @return CPUs of each node that has some, in the order of the nodes; empty if
+/// the topology is not available (e.g. outside of Linux)
+inline std::vector<std::vector<size_t>> nodes() {
+    auto read_line = [](const std::string& path) {
+        std::ifstream file(path);
+        std::string line;
+        std::getline(file, line);
+        return line;
+    };
+
+    std::vector<std::vector<size_t>> nodes;
+    for (size_t node : parse_cpu_list(read_line("/sys/devices/system/node/online"))) {
+        std::vector<size_t> cpus = parse_cpu_list(read_line(
+            "/sys/devices/system/node/node" + std::to_string(node) + "/cpulist"));
+        if (!cpus.empty()) {
+            nodes.push_back(std::move(cpus));
+        }
+    }
+    return nodes;
+}
+
+} // namespace numa
+
+// ============================================================================
+// ShardedTree - A-Tree partitioned across threads and NUMA nodes
+// ============================================================================
+
+/// @brief A-Tree whose subscriptions are partitioned in shards that are searched
+/// at the same time by a pool of threads
+///
+/// The subscriptions are assigned to the shards by the hash of their IDs. The
+/// shard `i` is always searched (and built by insert_many()) by the thread
+/// `i % threads()` of the pool, so pinning the threads with pin_to_numa_nodes()
+/// before loading the tree keeps every shard in the memory of the node that
+/// searches it. The calling thread only waits for the pool and is never pinned.
+///
+/// The searches can be made from many threads at the same time whereas the
+/// insertions and deletions must not run concurrently with anything else.
+class ShardedTree {
+private:
+    ATreeShardedHandle* handle_;
+
+    static void push_match(uint64_t subscription_id, void* user_data) {
+        static_cast<std::vector<uint64_t>*>(user_data)->push_back(subscription_id);
+    }
+
+public:
+    /// @brief Create a new sharded A-Tree with the given attribute definitions
+    /// @param definitions Vector of attribute definitions
+    /// @param shards Number of shards
+    /// @param threads Number of worker threads of the pool
+    /// @throws Error if creation fails
+    ShardedTree(const std::vector<AttributeDefinition>& definitions, size_t shards, size_t threads) {
+        std::vector<AtreeAttributeDef> c_defs;
+        c_defs.reserve(definitions.size());
+
+        for (const auto& def : definitions) {
+            c_defs.push_back({
+                def.name.c_str(),
+                static_cast<AtreeAttributeType>(def.type)
+            });
+        }
+
+        handle_ = atree_sharded_new(c_defs.data(), c_defs.size(), shards, threads);
+        if (!handle_) {
+            throw Error("Failed to create A-Tree");
+        }
+    }
+
+    /// @brief Destructor - frees the shards and stops the threads of the pool
+    ~ShardedTree() {
+        if (handle_) {
+            atree_sharded_free(handle_);
+        }
+    }
+
+    // Disable copying
+    ShardedTree(const ShardedTree&) = delete;
+    ShardedTree& operator=(const ShardedTree&) = delete;
+
+    // Enable moving
+    ShardedTree(ShardedTree&& other) noexcept : handle_(other.handle_) {
+        other.handle_ = nullptr;
+    }
+
+    ShardedTree& operator=(ShardedTree&& other) noexcept {
+        if (this != &other) {
+            if (handle_) {
+                atree_sharded_free(handle_);
+            }
+            handle_ = other.handle_;
+            other.handle_ = nullptr;
+        }
+        return *this;
+    }
+
+    /// @brief Get the number of shards
+    size_t shards() const { return atree_sharded_shards(handle_); }
+
+    /// @brief Get the number of worker threads of the pool
+    size_t threads() const { return atree_sharded_threads(handle_); }
+
+    /// @brief Restrict a thread of the pool to the given CPUs (throws on error)
+    /// @param thread Index of the worker thread, below threads()
+    /// @param cpus CPU indexes
+    /// @throws Error if the thread or the CPUs are invalid or pinning is not supported
+    void pin_thread(size_t thread, const std::vector<size_t>& cpus) {
+        try_pin_thread(thread, cpus).unwrap();
+    }
+
+    /// @brief Restrict a thread of the pool to the given CPUs (returns Result)
+    /// @param thread Index of the worker thread, below threads()
+    /// @param cpus CPU indexes
+    /// @return Result indicating success or failure
+    Result<void> try_pin_thread(size_t thread, const std::vector<size_t>& cpus) {
+        AtreeResult result = atree_sharded_pin_thread(handle_, thread, cpus.data(), cpus.size());
+
+        if (result.success) {
+            return Result<void>::ok();
+        } else {
+            std::string error_msg = result.error_message;
+            atree_free_error(result.error_message);
+            return Result<void>::err(std::move(error_msg));
+        }
+    }
+
+    /// @brief Spread the threads of the pool over the NUMA nodes (throws on error)
+    ///
+    /// The worker thread `t` is pinned to the CPUs of the node `t % nodes`; the
+    /// calling thread keeps its affinity. This is meant to be called before
+    /// inserting the expressions.
+    /// @return Number of nodes the threads were spread over; 0 if the topology is
+    /// not available, in which case nothing is pinned
+    /// @throws Error if a thread cannot be pinned
+    size_t pin_to_numa_nodes() {
+        return try_pin_to_numa_nodes().unwrap();
+    }
+
+    /// @brief Spread the threads of the pool over the NUMA nodes (returns Result)
+    /// @return Result containing the number of nodes the threads were spread over
+    Result<size_t> try_pin_to_numa_nodes() {
+        std::vector<std::vector<size_t>> nodes = numa::nodes();
+        for (size_t thread = 0; !nodes.empty() && thread < threads(); ++thread) {
+            auto result = try_pin_thread(thread, nodes[thread % nodes.size()]);
+            if (result.is_err()) {
+                return Result<size_t>::err(result.error());
+            }
+        }
+        return Result<size_t>::ok(nodes.size());
+    }
+
+    /// @brief Insert a boolean expression in the shard of its subscription (throws on error)
+    /// @param subscription_id Unique identifier for this subscription
+    /// @param expression Boolean expression string
+    /// @throws Error if insertion fails
+    void insert(uint64_t subscription_id, std::string_view expression) {
+        try_insert(subscription_id, expression).unwrap();
+    }
+
+    /// @brief Insert a boolean expression in the shard of its subscription (returns Result)
+    /// @param subscription_id Unique identifier for this subscription
+    /// @param expression Boolean expression string
+    /// @return Result indicating success or failure
+    Result<void> try_insert(uint64_t subscription_id, std::string_view expression) {
+        AtreeResult result = atree_sharded_insert(
+            handle_, subscription_id, std::string(expression).c_str());
+
+        if (result.success) {
+            return Result<void>::ok();
+        } else {
+            std::string error_msg = result.error_message;
+            atree_free_error(result.error_message);
+            return Result<void>::err(std::move(error_msg));
+        }
+    }
+
+    /// @brief Insert many boolean expressions at once on the threads of the shards (throws on error)
+    /// @param expressions Pairs of unique ID and boolean expression
+    /// @throws Error if one of the expressions is invalid; none of them is inserted then
+    void insert_many(const std::vector<std::pair<uint64_t, std::string>>& expressions) {
+        try_insert_many(expressions).unwrap();
+    }
+
+    /// @brief Insert many boolean expressions at once on the threads of the shards (returns Result)
+    /// @param expressions Pairs of unique ID and boolean expression
+    /// @return Result indicating success or failure; nothing is inserted on failure
+    Result<void> try_insert_many(
+        const std::vector<std::pair<uint64_t, std::string>>& expressions) {
+        std::vector<uint64_t> ids;
+        std::vector<const char*> c_strs;
+        ids.reserve(expressions.size());
+        c_strs.reserve(expressions.size());
+        for (const auto& [id, expression] : expressions) {
+            ids.push_back(id);
+            c_strs.push_back(expression.c_str());
+        }
+
+        AtreeResult result = atree_sharded_insert_batch(handle_, ids.data(), c_strs.data(), ids.size());
+        if (result.success) {
+            return Result<void>::ok();
+        } else {
+            std::string error_msg = result.error_message;
+            atree_free_error(result.error_message);
+            return Result<void>::err(std::move(error_msg));
+        }
+    }
+
+    /// @brief Delete a subscription by ID from its shard
+    /// @param subscription_id ID of the subscription to remove
+    void delete_subscription(uint64_t subscription_id) {
+        atree_sharded_delete(handle_, subscription_id);
+    }
+
+    /// @brief Get the memory used by a shard
+    /// @param index Index of the shard
+    /// @return Memory usage in bytes, broken down by its parts; all zero if the
+    /// index is out of range
+    MemoryUsage memory_usage(size_t index) const {
+        return atree_memory_usage(atree_sharded_shard(handle_, index));
+    }
+
+    /// @brief Create a new event builder that can be searched in every shard
+    /// @return EventBuilder for constructing an event
+    EventBuilder make_event() const {
+        void* builder = atree_event_builder_new(atree_sharded_shard(handle_, 0));
+        return EventBuilder(builder);
+    }
+
+    /// @brief Search every shard for expressions (throws on error)
+    /// @param builder EventBuilder containing the event data (consumed by this call)
+    /// @return Vector of the matching subscription IDs, grouped by thread
+    std::vector<uint64_t> search(EventBuilder& builder) const {
+        return try_search(builder).unwrap();
+    }
+
+    /// @brief Search every shard for expressions (rvalue overload, throws on error)
+    std::vector<uint64_t> search(EventBuilder&& builder) const {
+        return search(builder);
+    }
+
+    /// @brief Search every shard for expressions (returns Result)
+    /// @param builder EventBuilder containing the event data (consumed by this call)
+    /// @return Result containing vector of the matching subscription IDs
+    Result<std::vector<uint64_t>> try_search(EventBuilder& builder) const {
+        builder.check_not_consumed();
+        std::vector<uint64_t> matches;
+        AtreeResult result = atree_sharded_search_visit(
+            handle_, builder.release(), &ShardedTree::push_match, &matches);
+
+        if (result.success) {
+            return Result<std::vector<uint64_t>>::ok(std::move(matches));
+        } else {
+            std::string error_msg = result.error_message;
+            atree_free_error(result.error_message);
+            return Result<std::vector<uint64_t>>::err(std::move(error_msg));
+        }
+    }
+
+    /// @brief Search every shard for expressions
+    /// @param build_event Callable that receives the EventBuilder to fill
+    /// @return Vector of matching subscription IDs
+    template <typename BuildEvent>
+    std::vector<uint64_t> search(BuildEvent&& build_event) const {
+        EventBuilder event = make_event();
+        std::forward<BuildEvent>(build_event)(event);
+        return search(event);
+    }
 };
 
 // ============================================================================
 // TreeBuilder Implementation
 // ============================================================================
 
-inline Tree TreeBuilder::build() && {
-    return Tree(std::move(definitions_));
+template <typename Payload>
+inline BasicTree<Payload> TreeBuilder::build() && {
+    return BasicTree<Payload>(std::move(definitions_));
 }
 
-inline Result<Tree> TreeBuilder::try_build() && {
+template <typename Payload>
+inline Result<BasicTree<Payload>> TreeBuilder::try_build() && {
     try {
-        return Result<Tree>::ok(Tree(std::move(definitions_)));
+        return Result<BasicTree<Payload>>::ok(BasicTree<Payload>(std::move(definitions_)));
     } catch (const Error& e) {
-        return Result<Tree>::err(e.what());
+        return Result<BasicTree<Payload>>::err(e.what());
     }
 }
 
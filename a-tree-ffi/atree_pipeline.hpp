@@ -0,0 +1,455 @@
+// Copyright (c) 2026 A-Tree Contributors
+// SPDX-License-Identifier: MIT OR Apache-2.0
+
+/// @file atree_pipeline.hpp
+/// @brief Asynchronous search pipeline over the batch searches of atree.hpp
+///
+/// The callers submit their events without blocking and get a future (or, in
+/// C++20, an awaitable) back. The events go through a lock-free ring buffer to
+/// dedicated worker threads that group them into micro-batches searched with
+/// Tree::search_batch().
+
+#ifndef ATREE_PIPELINE_HPP
+#define ATREE_PIPELINE_HPP
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstddef>
+#include <exception>
+#include <functional>
+#include <future>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <string>
+#include <thread>
+#include <utility>
+#include <vector>
+#if __cplusplus >= 202002L && __has_include(<coroutine>)
+#include <coroutine>
+#define ATREE_PIPELINE_COROUTINES 1
+#endif
+
+#include "atree.hpp"
+
+namespace atree {
+
+// ============================================================================
+// PipelineConfig - Tuning of the micro-batches
+// ============================================================================
+
+/// @brief Configuration of a SearchPipeline
+struct PipelineConfig {
+    /// @brief Number of worker threads, each with its own ring buffer
+    size_t workers = 1;
+    /// @brief Number of pending events per worker; it is rounded up to a power of two
+    size_t capacity = 1024;
+    /// @brief Maximum number of events searched in a single batch
+    size_t max_batch_size = 64;
+    /// @brief How long a worker waits for more events once it has the first one of a batch
+    std::chrono::microseconds window{100};
+};
+
+namespace detail {
+
+// ============================================================================
+// Ring - Bounded lock-free multi-producer single-consumer queue
+// ============================================================================
+
+/// @brief Bounded queue of pointers that many threads push to and a single one pops from
+///
+/// Every slot has a sequence number telling whether it is free for the lap of
+/// the producers or filled for the lap of the consumer, so the producers only
+/// race on the tail and the consumer never waits on the ones that are behind.
+template <typename T>
+class Ring {
+private:
+    struct Slot {
+        std::atomic<size_t> sequence;
+        T* value;
+    };
+
+    std::unique_ptr<Slot[]> slots_;
+    size_t mask_;
+    alignas(64) std::atomic<size_t> tail_{0};
+    alignas(64) size_t head_ = 0;
+
+    static size_t round_up(size_t capacity) {
+        size_t size = 2;
+        while (size < capacity) {
+            size *= 2;
+        }
+        return size;
+    }
+
+public:
+    explicit Ring(size_t capacity)
+        : slots_(new Slot[round_up(capacity)]), mask_(round_up(capacity) - 1) {
+        for (size_t i = 0; i <= mask_; ++i) {
+            slots_[i].sequence.store(i, std::memory_order_relaxed);
+        }
+    }
+
+    /// @brief Push a value from any thread
+    /// @return false if the queue is full
+    bool push(T* value) {
+        size_t position = tail_.load(std::memory_order_relaxed);
+        for (;;) {
+            Slot& slot = slots_[position & mask_];
+            size_t sequence = slot.sequence.load(std::memory_order_acquire);
+            // The difference stays meaningful when the positions wrap around.
+            auto lap = static_cast<std::ptrdiff_t>(sequence - position);
+            if (lap == 0) {
+                if (tail_.compare_exchange_weak(position, position + 1, std::memory_order_relaxed)) {
+                    slot.value = value;
+                    slot.sequence.store(position + 1, std::memory_order_seq_cst);
+                    return true;
+                }
+            } else if (lap < 0) {
+                return false;
+            } else {
+                position = tail_.load(std::memory_order_relaxed);
+            }
+        }
+    }
+
+    /// @brief Pop a value from the consumer thread
+    /// @return nullptr if the queue is empty
+    T* pop() {
+        Slot& slot = slots_[head_ & mask_];
+        if (slot.sequence.load(std::memory_order_seq_cst) != head_ + 1) {
+            return nullptr;
+        }
+        T* value = slot.value;
+        slot.sequence.store(head_ + mask_ + 1, std::memory_order_release);
+        ++head_;
+        return value;
+    }
+
+    /// @brief Check from the consumer thread whether a value is ready to be popped
+    bool ready() const {
+        return slots_[head_ & mask_].sequence.load(std::memory_order_seq_cst) == head_ + 1;
+    }
+};
+
+} // namespace detail
+
+// ============================================================================
+// SearchPipeline - Micro-batched searches on worker threads
+// ============================================================================
+
+/// @brief Searches the events submitted by many threads in micro-batches on
+/// dedicated worker threads
+///
+/// Submitting an event only pushes it to the ring buffer of a worker (chosen
+/// round-robin), so it never blocks the calling thread. A worker searches up to
+/// `max_batch_size` events at once with Tree::search_batch(), waiting at most
+/// `window` after the first event of a batch for the others to arrive. The
+/// futures and awaitables are completed on the worker threads; the coroutines
+/// are only resumed once every search of their batch is completed, either on
+/// the worker thread or on the executor given to search_async().
+///
+/// The events of a batch are built together: if one of them cannot be built,
+/// all the searches of its batch fail with the same error. When the ring buffer
+/// of a worker is full, the search fails right away instead of waiting.
+///
+/// The tree must outlive the pipeline and must not be modified while it is
+/// running. Destroying the pipeline completes the events that are still
+/// pending before stopping the workers.
+template <typename Payload>
+class BasicSearchPipeline {
+public:
+    /// @brief Matches of a search, in the order of Tree::search()
+    using Matches = std::vector<Payload>;
+
+private:
+    /// @brief Event waiting in a ring buffer along with how to complete its search
+    struct Request {
+        EventBuilder builder;
+
+        explicit Request(EventBuilder&& builder) : builder(std::move(builder)) {}
+        virtual ~Request() = default;
+        /// @return true if resume() must be called once the whole batch is completed
+        virtual bool complete(Result<Matches> matches) = 0;
+        virtual void resume() {}
+    };
+
+    struct FutureRequest final : Request {
+        std::promise<Matches> promise;
+
+        using Request::Request;
+
+        bool complete(Result<Matches> matches) override {
+            if (matches.is_ok()) {
+                promise.set_value(std::move(matches).unwrap());
+            } else {
+                promise.set_exception(std::make_exception_ptr(Error(matches.error())));
+            }
+            delete this;
+            return false;
+        }
+    };
+
+    struct Worker {
+        detail::Ring<Request> ring;
+        std::mutex mutex;
+        std::condition_variable wakeup;
+        std::atomic<bool> sleeping{false};
+        std::thread thread;
+
+        explicit Worker(size_t capacity) : ring(capacity) {}
+    };
+
+    const BasicTree<Payload>& tree_;
+    PipelineConfig config_;
+    std::vector<std::unique_ptr<Worker>> workers_;
+    std::atomic<size_t> next_{0};
+    std::atomic<bool> stopping_{false};
+
+    /// @brief Push a request to the next worker and wake it up if it sleeps
+    /// @return false if its ring buffer is full
+    bool submit(Request* request) {
+        Worker& worker = *workers_[next_.fetch_add(1, std::memory_order_relaxed) % workers_.size()];
+        if (!worker.ring.push(request)) {
+            return false;
+        }
+        if (worker.sleeping.load(std::memory_order_seq_cst)) {
+            // Taking the lock orders the notification after the worker started waiting.
+            std::lock_guard<std::mutex> lock(worker.mutex);
+            worker.wakeup.notify_one();
+        }
+        return true;
+    }
+
+    /// @brief Sleep until an event is ready, the deadline passes or the pipeline stops
+    void wait(Worker& worker, std::optional<std::chrono::steady_clock::time_point> deadline) {
+        std::unique_lock<std::mutex> lock(worker.mutex);
+        worker.sleeping.store(true, std::memory_order_seq_cst);
+        auto woken = [this, &worker] {
+            return worker.ring.ready() || stopping_.load(std::memory_order_acquire);
+        };
+        if (deadline) {
+            worker.wakeup.wait_until(lock, *deadline, woken);
+        } else {
+            worker.wakeup.wait(lock, woken);
+        }
+        worker.sleeping.store(false, std::memory_order_relaxed);
+    }
+
+    void run(Worker& worker) {
+        std::vector<Request*> requests;
+        std::vector<EventBuilder> builders;
+        std::vector<Request*> resumable;
+        requests.reserve(config_.max_batch_size);
+        builders.reserve(config_.max_batch_size);
+        resumable.reserve(config_.max_batch_size);
+        for (;;) {
+            Request* first = worker.ring.pop();
+            if (!first) {
+                if (stopping_.load(std::memory_order_acquire)) {
+                    return;
+                }
+                wait(worker, std::nullopt);
+                continue;
+            }
+
+            requests.push_back(first);
+            auto deadline = std::chrono::steady_clock::now() + config_.window;
+            while (requests.size() < config_.max_batch_size) {
+                if (Request* request = worker.ring.pop()) {
+                    requests.push_back(request);
+                } else if (stopping_.load(std::memory_order_acquire) ||
+                           std::chrono::steady_clock::now() >= deadline) {
+                    break;
+                } else {
+                    wait(worker, deadline);
+                }
+            }
+            search(requests, builders, resumable);
+        }
+    }
+
+    void search(std::vector<Request*>& requests, std::vector<EventBuilder>& builders,
+                std::vector<Request*>& resumable) {
+        for (Request* request : requests) {
+            builders.push_back(std::move(request->builder));
+        }
+        // Nothing may escape a worker thread: the requests of the batch would never complete.
+        std::optional<Result<std::vector<Matches>>> result;
+        try {
+            result.emplace(tree_.try_search_batch(builders));
+        } catch (const std::exception& error) {
+            result.emplace(Result<std::vector<Matches>>::err(error.what()));
+        } catch (...) {
+            result.emplace(Result<std::vector<Matches>>::err("The batch search failed"));
+        }
+        for (size_t i = 0; i < requests.size(); ++i) {
+            bool resume = result->is_ok()
+                ? requests[i]->complete(Result<Matches>::ok(std::move(result->unwrap()[i])))
+                : requests[i]->complete(Result<Matches>::err(result->error()));
+            if (resume) {
+                resumable.push_back(requests[i]);
+            }
+        }
+        requests.clear();
+        builders.clear();
+        // A resumed coroutine runs until its next suspension, so the other searches of the
+        // batch are all completed first.
+        for (Request* request : resumable) {
+            request->resume();
+        }
+        resumable.clear();
+    }
+
+    /// @brief Error of the events that cannot be submitted, or none
+    static std::optional<std::string> reject(const EventBuilder& builder) {
+        if (builder.is_consumed()) {
+            return "EventBuilder has already been consumed by search()";
+        }
+        return std::nullopt;
+    }
+
+public:
+    /// @brief Start the workers of a pipeline searching the given tree
+    /// @param tree Tree to search; it must outlive the pipeline
+    /// @param config Number of workers, capacity of their ring buffers and batching window
+    /// @throws Error if the configuration has no worker or an empty batch size
+    explicit BasicSearchPipeline(const BasicTree<Payload>& tree, PipelineConfig config = {})
+        : tree_(tree), config_(config) {
+        if (config_.workers == 0 || config_.max_batch_size == 0) {
+            throw Error("A search pipeline needs at least one worker and one event per batch");
+        }
+        workers_.reserve(config_.workers);
+        for (size_t i = 0; i < config_.workers; ++i) {
+            workers_.push_back(std::make_unique<Worker>(config_.capacity));
+        }
+        for (auto& worker : workers_) {
+            worker->thread = std::thread([this, &worker = *worker] { run(worker); });
+        }
+    }
+
+    /// @brief Destructor - completes the pending events and stops the workers
+    ~BasicSearchPipeline() {
+        stopping_.store(true, std::memory_order_release);
+        for (auto& worker : workers_) {
+            {
+                std::lock_guard<std::mutex> lock(worker->mutex);
+                worker->wakeup.notify_one();
+            }
+            worker->thread.join();
+        }
+    }
+
+    // Disable copying and moving since the workers refer to the pipeline
+    BasicSearchPipeline(const BasicSearchPipeline&) = delete;
+    BasicSearchPipeline& operator=(const BasicSearchPipeline&) = delete;
+
+    /// @brief Get the configuration of the pipeline
+    const PipelineConfig& config() const { return config_; }
+
+    /// @brief Submit an event to search without blocking
+    /// @param builder EventBuilder of the tree containing the event data (consumed by this call)
+    /// @return Future of the matching payloads; it holds an Error if the event
+    /// cannot be built, the builder was already consumed or the pipeline is full
+    std::future<Matches> search(EventBuilder&& builder) {
+        std::optional<std::string> rejected = reject(builder);
+        auto* request = new FutureRequest(std::move(builder));
+        std::future<Matches> matches = request->promise.get_future();
+        if (rejected) {
+            request->complete(Result<Matches>::err(std::move(*rejected)));
+        } else if (!submit(request)) {
+            request->complete(Result<Matches>::err("The search pipeline is full"));
+        }
+        return matches;
+    }
+
+    /// @brief Submit an event to search without blocking
+    /// @param build_event Callable that receives the EventBuilder to fill
+    /// @return Future of the matching payloads
+    template <typename BuildEvent>
+    std::future<Matches> search(BuildEvent&& build_event) {
+        EventBuilder event = tree_.make_event();
+        std::forward<BuildEvent>(build_event)(event);
+        return search(std::move(event));
+    }
+
+#ifdef ATREE_PIPELINE_COROUTINES
+    /// @brief Executor that a coroutine is handed to instead of being resumed on a worker thread
+    using Executor = std::function<void(std::coroutine_handle<>)>;
+
+    /// @brief Search awaited by a coroutine; it resumes on a worker thread or on its executor
+    class Awaitable {
+    private:
+        struct AwaitRequest final : Request {
+            std::coroutine_handle<> coroutine;
+            Executor executor;
+            std::optional<Result<Matches>> matches;
+
+            AwaitRequest(EventBuilder&& builder, Executor&& executor)
+                : Request(std::move(builder)), executor(std::move(executor)) {}
+
+            bool complete(Result<Matches> result) override {
+                matches = std::move(result);
+                return true;
+            }
+
+            void resume() override {
+                if (executor) {
+                    executor(coroutine);
+                } else {
+                    coroutine.resume();
+                }
+            }
+        };
+
+        BasicSearchPipeline& pipeline_;
+        AwaitRequest request_;
+
+    public:
+        Awaitable(BasicSearchPipeline& pipeline, EventBuilder&& builder, Executor executor)
+            : pipeline_(pipeline), request_(std::move(builder), std::move(executor)) {}
+
+        bool await_ready() const noexcept { return false; }
+
+        bool await_suspend(std::coroutine_handle<> coroutine) {
+            request_.coroutine = coroutine;
+            if (std::optional<std::string> rejected = reject(request_.builder)) {
+                request_.matches = Result<Matches>::err(std::move(*rejected));
+                return false;
+            }
+            if (!pipeline_.submit(&request_)) {
+                request_.matches = Result<Matches>::err("The search pipeline is full");
+                return false;
+            }
+            return true;
+        }
+
+        /// @throws Error if the event cannot be built, the builder was already
+        /// consumed or the pipeline is full
+        Matches await_resume() {
+            return std::move(*request_.matches).unwrap();
+        }
+    };
+
+    /// @brief Submit an event to search and suspend the coroutine until it is done
+    ///
+    /// Without an executor, the coroutine resumes on the worker thread and
+    /// delays the next batch of that worker until it suspends again.
+    /// @param builder EventBuilder of the tree containing the event data (consumed by this call)
+    /// @param executor Called on the worker thread with the coroutine to resume
+    /// once its batch is completed (e.g. to post it to the event loop of the caller)
+    /// @return Awaitable of the matching payloads that throws an Error if the
+    /// event cannot be built, the builder was already consumed or the pipeline is full
+    Awaitable search_async(EventBuilder&& builder, Executor executor = {}) {
+        return Awaitable(*this, std::move(builder), std::move(executor));
+    }
+#endif
+};
+
+/// @brief Search pipeline of a Tree
+using SearchPipeline = BasicSearchPipeline<uint64_t>;
+
+} // namespace atree
+
+#endif // ATREE_PIPELINE_HPP
@@ -0,0 +1,392 @@
+// Google Benchmark suite measuring the A-Tree through the C++ wrapper
+//
+// The workloads are generated with a port of the generator of the Criterion
+// benchmarks of the crate (benches/workload/mod.rs) so that, for the same tree
+// size, the numbers can be compared to isolate the cost of the FFI:
+// - BM_BuildEvent only marshals the events across the FFI
+// - BM_Search marshals and searches them with a reused search context
+// - BM_SearchReused searches events that are already built
+// - BM_SearchBatch marshals and searches batches of events
+// - BM_BulkLoad, BM_Churn and BM_MemoryUsage mirror the Rust groups
+
+#include <benchmark/benchmark.h>
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <map>
+#include <memory>
+#include <string>
+#include <utility>
+#include <vector>
+#include "../atree.hpp"
+
+using namespace atree;
+
+namespace {
+
+constexpr size_t EVENTS = 256;
+constexpr size_t BATCH_SIZE = 64;
+
+// ============================================================================
+// Workload generator (keep in sync with benches/workload/mod.rs)
+// ============================================================================
+
+struct WorkloadConfig {
+    size_t attributes = 16;
+    size_t cardinality = 1000;
+    double skew = 1.0;
+    double attribute_skew = 0.5;
+    size_t depth = 3;
+    size_t list_size = 4;
+    double shared = 0.3;
+    size_t pool_size = 256;
+    uint64_t seed = 0x5eed;
+};
+
+enum class Kind { Integer, String, IntegerList, StringList, Boolean };
+
+constexpr Kind KINDS[] = {Kind::Integer, Kind::String, Kind::IntegerList, Kind::StringList,
+                          Kind::Boolean};
+
+Kind kind(size_t index) { return KINDS[index % std::size(KINDS)]; }
+
+std::string name(size_t index) { return "attribute_" + std::to_string(index); }
+
+class SplitMix64 {
+    uint64_t state_;
+
+public:
+    explicit SplitMix64(uint64_t seed) : state_(seed) {}
+
+    uint64_t next() {
+        state_ += 0x9e3779b97f4a7c15ULL;
+        uint64_t z = state_;
+        z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ULL;
+        z = (z ^ (z >> 27)) * 0x94d049bb133111ebULL;
+        return z ^ (z >> 31);
+    }
+
+    double unit() { return static_cast<double>(next() >> 11) / static_cast<double>(1ULL << 53); }
+
+    uint64_t below(uint64_t bound) { return next() % bound; }
+
+    bool chance(double probability) { return unit() < probability; }
+};
+
+class Zipf {
+    std::vector<double> cumulative_;
+
+public:
+    Zipf(size_t n, double exponent) {
+        double total = 0.0;
+        for (size_t rank = 1; rank <= std::max<size_t>(n, 1); ++rank) {
+            total += 1.0 / std::pow(static_cast<double>(rank), exponent);
+            cumulative_.push_back(total);
+        }
+        for (auto& weight : cumulative_) {
+            weight /= total;
+        }
+    }
+
+    size_t sample(SplitMix64& random) const {
+        double needle = random.unit();
+        auto position = std::upper_bound(cumulative_.begin(), cumulative_.end(), needle);
+        return std::min<size_t>(position - cumulative_.begin(), cumulative_.size() - 1);
+    }
+};
+
+/// @brief The values of an event, one entry per attribute
+struct AttributeValue {
+    int64_t integer = 0;
+    std::string string;
+    std::vector<int64_t> integers;
+    std::vector<std::string> strings;
+    bool boolean = false;
+};
+
+using GeneratedEvent = std::vector<AttributeValue>;
+
+class Workload {
+    WorkloadConfig config_;
+    SplitMix64 random_;
+    Zipf attributes_;
+    Zipf values_;
+    std::vector<std::string> pool_;
+
+    size_t pool_depth() const { return std::max<size_t>(config_.depth > 0 ? config_.depth - 1 : 0, 1); }
+
+    int64_t value() { return static_cast<int64_t>(values_.sample(random_)); }
+
+    std::string string() { return "value-" + std::to_string(values_.sample(random_)); }
+
+    std::string integers() {
+        std::string list;
+        for (size_t i = 0; i < config_.list_size; ++i) {
+            list += (i == 0 ? "" : ", ") + std::to_string(value());
+        }
+        return list;
+    }
+
+    std::string strings() {
+        std::string list;
+        for (size_t i = 0; i < config_.list_size; ++i) {
+            list += (i == 0 ? "\"" : ", \"") + string() + "\"";
+        }
+        return list;
+    }
+
+    std::string predicate() {
+        size_t index = attributes_.sample(random_);
+        std::string attribute = name(index);
+        uint64_t choice = random_.below(8);
+        switch (kind(index)) {
+            case Kind::Integer:
+                if (choice == 0) return attribute + " < " + std::to_string(value());
+                if (choice == 1) return attribute + " in [" + integers() + "]";
+                return attribute + " = " + std::to_string(value());
+            case Kind::String:
+                if (choice == 0) return attribute + " in [" + strings() + "]";
+                return attribute + " = \"" + string() + "\"";
+            case Kind::IntegerList:
+                if (choice == 0) return attribute + " none of [" + integers() + "]";
+                if (choice == 1) return attribute + " all of [" + integers() + "]";
+                return attribute + " one of [" + integers() + "]";
+            case Kind::StringList:
+                if (choice == 0) return attribute + " none of [" + strings() + "]";
+                return attribute + " one of [" + strings() + "]";
+            case Kind::Boolean:
+                if (choice == 0) return "not " + attribute;
+                return attribute;
+        }
+        return attribute;
+    }
+
+    std::string subexpression(size_t depth, bool can_share) {
+        if (can_share && depth == pool_depth() && !pool_.empty() &&
+            random_.chance(config_.shared)) {
+            return pool_[random_.below(pool_.size())];
+        }
+        if (depth <= 1) {
+            return predicate();
+        }
+        std::string left = subexpression(depth - 1, can_share);
+        std::string right = subexpression(depth - 1, can_share);
+        const char* op = random_.chance(0.9) ? "and" : "or";
+        return "(" + left + ") " + op + " (" + right + ")";
+    }
+
+public:
+    explicit Workload(WorkloadConfig config = {})
+        : config_(config),
+          random_(config.seed),
+          attributes_(config.attributes, config.attribute_skew),
+          values_(config.cardinality, config.skew) {
+        for (size_t i = 0; i < config_.pool_size; ++i) {
+            pool_.push_back(subexpression(pool_depth(), false));
+        }
+    }
+
+    std::vector<AttributeDefinition> definitions() const {
+        std::vector<AttributeDefinition> definitions;
+        for (size_t index = 0; index < config_.attributes; ++index) {
+            switch (kind(index)) {
+                case Kind::Integer: definitions.push_back(AttributeDefinition::integer(name(index))); break;
+                case Kind::String: definitions.push_back(AttributeDefinition::string(name(index))); break;
+                case Kind::IntegerList: definitions.push_back(AttributeDefinition::integer_list(name(index))); break;
+                case Kind::StringList: definitions.push_back(AttributeDefinition::string_list(name(index))); break;
+                case Kind::Boolean: definitions.push_back(AttributeDefinition::boolean(name(index))); break;
+            }
+        }
+        return definitions;
+    }
+
+    /// @brief Generate the next expressions, numbered from the first ID
+    std::vector<std::pair<uint64_t, std::string>> expressions(size_t count, uint64_t first = 0) {
+        std::vector<std::pair<uint64_t, std::string>> expressions;
+        expressions.reserve(count);
+        for (size_t i = 0; i < count; ++i) {
+            expressions.emplace_back(first + i, subexpression(config_.depth, true));
+        }
+        return expressions;
+    }
+
+    std::unique_ptr<Tree> tree(size_t size) {
+        auto tree = std::make_unique<Tree>(definitions());
+        tree->insert_many(expressions(size));
+        return tree;
+    }
+
+    std::vector<GeneratedEvent> events(size_t count) {
+        std::vector<GeneratedEvent> events(count);
+        for (auto& event : events) {
+            event.resize(config_.attributes);
+            for (size_t index = 0; index < config_.attributes; ++index) {
+                auto& value = event[index];
+                switch (kind(index)) {
+                    case Kind::Integer: value.integer = this->value(); break;
+                    case Kind::String: value.string = string(); break;
+                    case Kind::IntegerList:
+                        for (size_t i = 0; i < config_.list_size; ++i) value.integers.push_back(this->value());
+                        break;
+                    case Kind::StringList:
+                        for (size_t i = 0; i < config_.list_size; ++i) value.strings.push_back(string());
+                        break;
+                    case Kind::Boolean: value.boolean = random_.below(2) == 0; break;
+                }
+            }
+        }
+        return events;
+    }
+};
+
+EventBuilder build(const Tree& tree, const GeneratedEvent& event) {
+    EventBuilder builder = tree.make_event();
+    for (size_t index = 0; index < event.size(); ++index) {
+        const auto& value = event[index];
+        std::string attribute = name(index);
+        switch (kind(index)) {
+            case Kind::Integer: builder.with_integer(attribute, value.integer); break;
+            case Kind::String: builder.with_string(attribute, value.string); break;
+            case Kind::IntegerList: builder.with_integer_list(attribute, value.integers); break;
+            case Kind::StringList: builder.with_string_list(attribute, value.strings); break;
+            case Kind::Boolean: builder.with_boolean(attribute, value.boolean); break;
+        }
+    }
+    return builder;
+}
+
+// ============================================================================
+// Fixtures (built once per tree size and shared by the benchmarks)
+// ============================================================================
+
+struct Fixture {
+    std::unique_ptr<Tree> tree;
+    std::vector<GeneratedEvent> events;
+};
+
+Fixture& fixture(size_t size) {
+    static std::map<size_t, Fixture> fixtures;
+    auto found = fixtures.find(size);
+    if (found == fixtures.end()) {
+        Workload workload;
+        Fixture fixture;
+        fixture.tree = workload.tree(size);
+        fixture.events = workload.events(EVENTS);
+        found = fixtures.emplace(size, std::move(fixture)).first;
+    }
+    return found->second;
+}
+
+// ============================================================================
+// Benchmarks
+// ============================================================================
+
+void BM_BulkLoad(benchmark::State& state) {
+    size_t size = static_cast<size_t>(state.range(0));
+    Workload workload;
+    auto definitions = workload.definitions();
+    auto expressions = workload.expressions(size);
+    for (auto _ : state) {
+        state.PauseTiming();
+        auto tree = std::make_unique<Tree>(definitions);
+        state.ResumeTiming();
+        tree->insert_many(expressions);
+        state.PauseTiming();
+        tree.reset();
+        state.ResumeTiming();
+    }
+    state.SetItemsProcessed(state.iterations() * static_cast<int64_t>(size));
+}
+
+void BM_BuildEvent(benchmark::State& state) {
+    auto& [tree, events] = fixture(static_cast<size_t>(state.range(0)));
+    size_t next = 0;
+    for (auto _ : state) {
+        EventBuilder builder = build(*tree, events[next++ % events.size()]);
+        benchmark::DoNotOptimize(builder);
+    }
+    state.SetItemsProcessed(state.iterations());
+}
+
+void BM_Search(benchmark::State& state) {
+    auto& [tree, events] = fixture(static_cast<size_t>(state.range(0)));
+    SearchContext context = tree->make_search_context();
+    size_t next = 0;
+    for (auto _ : state) {
+        const auto& matches = tree->search(context, build(*tree, events[next++ % events.size()]));
+        benchmark::DoNotOptimize(matches.data());
+    }
+    state.SetItemsProcessed(state.iterations());
+}
+
+void BM_SearchReused(benchmark::State& state) {
+    auto& [tree, events] = fixture(static_cast<size_t>(state.range(0)));
+    std::vector<EventBuilder> builders;
+    builders.reserve(events.size());
+    for (const auto& event : events) {
+        builders.push_back(build(*tree, event));
+    }
+    SearchContext context = tree->make_search_context();
+    size_t next = 0;
+    for (auto _ : state) {
+        const auto& matches = tree->search_reused(context, builders[next++ % builders.size()]);
+        benchmark::DoNotOptimize(matches.data());
+    }
+    state.SetItemsProcessed(state.iterations());
+}
+
+void BM_SearchBatch(benchmark::State& state) {
+    auto& [tree, events] = fixture(static_cast<size_t>(state.range(0)));
+    for (auto _ : state) {
+        std::vector<EventBuilder> builders;
+        builders.reserve(BATCH_SIZE);
+        for (size_t i = 0; i < BATCH_SIZE; ++i) {
+            builders.push_back(build(*tree, events[i]));
+        }
+        auto matches = tree->search_batch(builders);
+        benchmark::DoNotOptimize(matches.data());
+    }
+    state.SetItemsProcessed(state.iterations() * static_cast<int64_t>(BATCH_SIZE));
+}
+
+void BM_Churn(benchmark::State& state) {
+    size_t size = static_cast<size_t>(state.range(0));
+    Workload workload;
+    auto tree = workload.tree(size);
+    auto replacements = workload.expressions(size);
+    auto events = workload.events(EVENTS);
+    size_t oldest = 0;
+    for (auto _ : state) {
+        tree->delete_subscription(oldest);
+        tree->insert(oldest + size, replacements[oldest % size].second);
+        ++oldest;
+        auto matches = tree->search(build(*tree, events[oldest % events.size()]));
+        benchmark::DoNotOptimize(matches.data());
+    }
+    state.SetItemsProcessed(state.iterations());
+}
+
+void BM_MemoryUsage(benchmark::State& state) {
+    const Tree& tree = *fixture(static_cast<size_t>(state.range(0))).tree;
+    MemoryUsage usage{};
+    for (auto _ : state) {
+        usage = tree.memory_usage();
+        benchmark::DoNotOptimize(usage);
+    }
+    state.counters["bytes"] = static_cast<double>(usage.total);
+    state.counters["bytes_per_expression"] =
+        static_cast<double>(usage.total) / static_cast<double>(state.range(0));
+}
+
+}  // namespace
+
+BENCHMARK(BM_BulkLoad)->Arg(1000)->Arg(10000)->Arg(100000)->Unit(benchmark::kMillisecond);
+BENCHMARK(BM_BuildEvent)->Arg(1000)->Arg(10000)->Arg(100000)->Unit(benchmark::kMicrosecond);
+BENCHMARK(BM_Search)->Arg(1000)->Arg(10000)->Arg(100000)->Unit(benchmark::kMicrosecond);
+BENCHMARK(BM_SearchReused)->Arg(1000)->Arg(10000)->Arg(100000)->Unit(benchmark::kMicrosecond);
+BENCHMARK(BM_SearchBatch)->Arg(1000)->Arg(10000)->Arg(100000)->Unit(benchmark::kMicrosecond);
+BENCHMARK(BM_Churn)->Arg(1000)->Arg(10000)->Arg(100000)->Unit(benchmark::kMicrosecond);
+BENCHMARK(BM_MemoryUsage)->Arg(1000)->Arg(10000)->Arg(100000);
+
+BENCHMARK_MAIN();
@@ -5,15 +5,34 @@
 // - String list and integer list attributes
 // - Undefined/null attribute handling
 // - Delete operation
+// - Batches of events searched straight from Arrow columns
+// - Concurrent trees searched while they are updated
+// - Sharded trees searched by a pool of threads
+// - Events searched asynchronously in micro-batches
+// - Payloads matched instead of subscription IDs
+// - Snapshots saved to and loaded from a file
 // - Graphviz export
 // - Modern C++ Result-based error handling
 
+#include <atomic>
+#include <cstdio>
 #include <iostream>
 #include <iomanip>
+#include <thread>
 #include "../atree.hpp"
+#include "../atree_pipeline.hpp"
 
 using namespace atree;
 
+// The buffers of the Arrow arrays below are owned by the example itself
+static void release_nothing(ArrowArray* array) {
+    array->release = nullptr;
+}
+
+static ArrowArray arrow_array(int64_t length, int64_t null_count, const void** buffers) {
+    return ArrowArray{length, null_count, 0, 2, 0, buffers, nullptr, nullptr, &release_nothing, nullptr};
+}
+
 void print_separator(const std::string& title) {
     std::cout << "\n" << std::string(60, '=') << "\n";
     std::cout << title << "\n";
@@ -46,10 +65,12 @@ int main() {
         tree.insert(2, "price >= 50.0 and price <= 100.0");
         std::cout << "✓ Inserted subscription 2: 'price >= 50.0 and price <= 100.0'\n";
 
-        tree.insert(3, "country = \"US\"");
+        // Many expressions can be loaded at once
+        tree.insert_many({
+            {3, "country = \"US\""},
+            {4, "price > 25.0"},
+        });
         std::cout << "✓ Inserted subscription 3: 'country = \"US\"'\n";
-
-        tree.insert(4, "price > 25.0");
         std::cout << "✓ Inserted subscription 4: 'price > 25.0'\n";
 
         // ====================================================================
@@ -164,6 +185,326 @@ int main() {
         for (auto id : matches6) std::cout << id << " ";
         std::cout << "\nExpected: none (3 was deleted)\n";
 
+        tree.insert_many({
+            {10, "country = \"CA\""},
+            {11, "country = \"CA\" and price > 10.0"},
+        });
+        tree.delete_many({10, 11, 12});
+        std::cout << "✓ Deleted subscriptions 10 and 11 at once (12 was never inserted)\n";
+
+        // ====================================================================
+        print_separator("Search Statistics");
+
+        atree::SearchStats stats{};
+        for (int64_t user_id : {50, 150}) {
+            tree.search_with_stats(
+                tree.make_event()
+                    .with_boolean("is_active", true)
+                    .with_integer("user_id", user_id)
+                    .with_undefined("price")
+                    .with_undefined("country")
+                    .with_undefined("tags")
+                    .with_undefined("categories"),
+                stats
+            );
+        }
+        std::cout << "Searches: " << stats.searches << "\n";
+        std::cout << "Predicates evaluated: " << stats.predicates_evaluated
+                  << ", delayed: " << stats.predicates_delayed << "\n";
+        std::cout << "Nodes popped right above the predicates: " << stats.nodes_popped[0] << "\n";
+        std::cout << "AND short-circuits: " << stats.and_short_circuits
+                  << ", matches: " << stats.matches << "\n";
+
+        // ====================================================================
+        print_separator("Compacting After Deletions");
+
+        atree::MemoryUsage before = tree.memory_usage();
+        tree.compact();
+        atree::MemoryUsage after = tree.memory_usage();
+        std::cout << "Memory before compacting: " << before.total << " bytes\n";
+        std::cout << "Memory after compacting:  " << after.total << " bytes\n";
+
+        // ====================================================================
+        print_separator("Reusing a Search Context");
+
+        auto context = tree.make_search_context();
+        for (int64_t user_id : {50, 150, 200}) {
+            const auto& matches = tree.search(
+                context,
+                tree.make_event()
+                    .with_boolean("is_active", true)
+                    .with_integer("user_id", user_id)
+                    .with_undefined("price")
+                    .with_undefined("country")
+                    .with_undefined("tags")
+                    .with_undefined("categories")
+            );
+            std::cout << "user_id=" << user_id << ": found " << matches.size() << " match(es): ";
+            for (auto id : matches) std::cout << id << " ";
+            std::cout << "\n";
+        }
+        std::cout << "Expected: none for 50, subscription 1 otherwise\n";
+
+        // The matches can also go straight into a vector that is reused between searches
+        std::vector<uint64_t> reused;
+        for (int64_t user_id : {150, 200}) {
+            tree.search_into(
+                context,
+                tree.make_event()
+                    .with_boolean("is_active", true)
+                    .with_integer("user_id", user_id),
+                reused
+            );
+            std::cout << "user_id=" << user_id << ": " << reused.size() << " match(es) in the reused vector\n";
+        }
+
+        uint64_t buffer[8];
+        size_t written = tree.search_into(
+            tree.make_event().with_boolean("is_active", true).with_integer("user_id", 150),
+            buffer, 8);
+        std::cout << "Wrote " << written << " match(es) into a fixed buffer\n";
+
+        // ====================================================================
+        print_separator("Reusing an Event Builder with Attribute Handles");
+
+        // The attributes are resolved once; the builder is reset between the events
+        const auto is_active = tree.attribute("is_active");
+        const auto user_id_attribute = tree.attribute("user_id");
+        auto reusable = tree.make_event();
+        for (int64_t user_id : {50, 150, 200}) {
+            reusable.reset()
+                .with_boolean(is_active, true)
+                .with_integer(user_id_attribute, user_id);
+            tree.search_reused(context, reusable, reused);
+            std::cout << "user_id=" << user_id << ": " << reused.size() << " match(es)\n";
+        }
+        std::cout << "Expected: none for 50, subscription 1 otherwise\n";
+
+        auto unknown = tree.try_attribute("unknown");
+        if (unknown.is_err()) {
+            std::cout << "✓ Correctly caught error: " << unknown.error() << "\n";
+        }
+
+        // ====================================================================
+        print_separator("Setting Interned Strings");
+
+        tree.insert(5, "country = \"US\" and tags one of [\"sports\"]");
+
+        // The frequent strings are interned once and set by ID without hashing them again
+        const auto country = tree.attribute("country");
+        const auto tags = tree.attribute("tags");
+        const std::vector<StringId> hot_tags = {tree.intern("sports"), tree.intern("news")};
+        const StringId us = tree.intern("US");
+        reusable.reset()
+            .with_string_id(country, us)
+            .with_string_id_list(tags, hot_tags);
+        tree.search_reused(context, reusable, reused);
+        std::cout << "country=US: " << reused.size() << " match(es)\n";
+        std::cout << "Expected: subscription 5\n";
+
+        // ====================================================================
+        print_separator("Searching a Batch of Events");
+
+        std::vector<EventBuilder> batch;
+        for (int64_t user_id : {50, 150}) {
+            auto event = tree.make_event();
+            event.with_boolean("is_active", true)
+                .with_integer("user_id", user_id)
+                .with_float("price", 30.0)
+                .with_undefined("country")
+                .with_undefined("tags")
+                .with_undefined("categories");
+            batch.push_back(std::move(event));
+        }
+        auto batch_matches = tree.search_batch(batch);
+        for (size_t i = 0; i < batch_matches.size(); ++i) {
+            std::cout << "Event " << i << ": found " << batch_matches[i].size() << " match(es): ";
+            for (auto id : batch_matches[i]) std::cout << id << " ";
+            std::cout << "\n";
+        }
+        std::cout << "Expected: subscription 4 for event 0, subscriptions 1 and 4 for event 1\n";
+
+        // ====================================================================
+        print_separator("Searching Arrow Columns");
+
+        // Three events as columns: is_active (bit-packed), user_id and price (mantissas
+        // with 2 decimal places, undefined for the second event)
+        const uint8_t is_active_bits[] = {0b011};
+        const int64_t user_ids[] = {150, 50, 200};
+        const uint8_t price_validity[] = {0b101};
+        const int64_t prices[] = {3000, 0, 6000};
+        const void* is_active_buffers[] = {nullptr, is_active_bits};
+        const void* user_id_buffers[] = {nullptr, user_ids};
+        const void* price_buffers[] = {price_validity, prices};
+        ArrowArray is_active_array = arrow_array(3, 0, is_active_buffers);
+        ArrowArray user_id_array = arrow_array(3, 0, user_id_buffers);
+        ArrowArray price_array = arrow_array(3, 1, price_buffers);
+
+        EventBatch columnar;
+        auto column_matches = tree.search_columns(columnar, 3, {
+            tree.attribute("is_active").column(AttributeType::Boolean, is_active_array),
+            tree.attribute("user_id").column(AttributeType::Integer, user_id_array),
+            tree.attribute("price").column(AttributeType::Float, price_array, 2),
+        });
+        for (size_t i = 0; i < column_matches.size(); ++i) {
+            std::cout << "Event " << i << ": found " << column_matches[i].size() << " match(es): ";
+            for (auto id : column_matches[i]) std::cout << id << " ";
+            std::cout << "\n";
+        }
+        std::cout << "Expected: 1 and 4 for event 0, none for event 1, 2 and 4 for event 2\n";
+
+        // ====================================================================
+        print_separator("Searching While Updating a Concurrent Tree");
+
+        ConcurrentTree shared({
+            AttributeDefinition::integer("user_id"),
+        });
+        shared.insert(1, "user_id > 100");
+        shared.publish();
+
+        std::atomic<bool> done{false};
+        std::vector<std::thread> readers;
+        for (int i = 0; i < 4; ++i) {
+            readers.emplace_back([&shared, &done] {
+                while (!done.load()) {
+                    shared.search([](EventBuilder& event) { event.with_integer("user_id", 150); });
+                }
+            });
+        }
+        for (uint64_t id = 2; id <= 100; ++id) {
+            shared.insert(id, "user_id > " + std::to_string(id));
+            if (id % 10 == 0) {
+                shared.publish();
+            }
+        }
+        shared.publish();
+        done.store(true);
+        for (auto& reader : readers) {
+            reader.join();
+        }
+
+        auto concurrent_matches = shared.search([](EventBuilder& event) {
+            event.with_integer("user_id", 150);
+        });
+        std::cout << "Found " << concurrent_matches.size() << " match(es) once published\n";
+        std::cout << "Expected: 100 matches\n";
+
+        // ====================================================================
+        print_separator("Searching a Sharded Tree");
+
+        ShardedTree sharded({
+            AttributeDefinition::integer("user_id"),
+            AttributeDefinition::string("country"),
+        }, 4, 2);
+        size_t numa_nodes = sharded.pin_to_numa_nodes();
+        std::cout << "Spread " << sharded.threads() << " thread(s) over " << numa_nodes
+                  << " NUMA node(s)\n";
+
+        std::vector<std::pair<uint64_t, std::string>> sharded_expressions;
+        for (uint64_t id = 1; id <= 100; ++id) {
+            sharded_expressions.emplace_back(
+                id, "user_id > " + std::to_string(id) + " and country = \"CA\"");
+        }
+        sharded.insert_many(sharded_expressions);
+        sharded.delete_subscription(1);
+
+        size_t sharded_nodes = 0;
+        for (size_t shard = 0; shard < sharded.shards(); ++shard) {
+            sharded_nodes += sharded.memory_usage(shard).nodes > 0 ? 1 : 0;
+        }
+        auto sharded_matches = sharded.search([](EventBuilder& event) {
+            event.with_integer("user_id", 50).with_string("country", "CA");
+        });
+        std::cout << "Found " << sharded_matches.size() << " match(es) over "
+                  << sharded_nodes << " non-empty shard(s)\n";
+        std::cout << "Expected: 48 matches (1 was deleted)\n";
+
+        // ====================================================================
+        print_separator("Searching Asynchronously in Micro-Batches");
+
+        Tree pipelined({AttributeDefinition::integer("user_id")});
+        for (uint64_t id = 1; id <= 10; ++id) {
+            pipelined.insert(id, "user_id > " + std::to_string(id * 10));
+        }
+        {
+            SearchPipeline pipeline(pipelined, PipelineConfig{2, 256, 32, std::chrono::microseconds(200)});
+            std::vector<std::future<std::vector<uint64_t>>> pending;
+            for (int64_t user_id = 0; user_id < 120; user_id += 10) {
+                pending.push_back(pipeline.search([user_id](EventBuilder& event) {
+                    event.with_integer("user_id", user_id);
+                }));
+            }
+            size_t pipelined_matches = 0;
+            for (auto& matches : pending) {
+                pipelined_matches += matches.get().size();
+            }
+            std::cout << "Found " << pipelined_matches << " match(es) over " << pending.size()
+                      << " event(s)\n";
+            std::cout << "Expected: 55 matches over 12 events\n";
+
+            // A builder that was moved from fails its own search instead of the whole batch
+            auto event = pipelined.make_event();
+            event.with_integer("user_id", 50);
+            auto moved = std::move(event);
+            auto rejected = pipeline.search(std::move(event));
+            auto accepted = pipeline.search(std::move(moved));
+            try {
+                rejected.get();
+                std::cout << "The moved-from builder was searched\n";
+            } catch (const Error& e) {
+                std::cout << "Rejected the moved-from builder: " << e.what() << "\n";
+            }
+            std::cout << "Found " << accepted.get().size() << " match(es) for the moved-to builder\n";
+            std::cout << "Expected: a rejection and 4 matches\n";
+        }
+
+        // ====================================================================
+        print_separator("Matching Payloads Instead of IDs");
+
+        // The pointers are stored in the tree so the matches need no lookup afterwards
+        struct Campaign {
+            const char* name;
+        };
+        Campaign summer{"summer"};
+        Campaign winter{"winter"};
+        auto campaigns = std::move(Tree::builder()
+            .with_string("country")
+            .with_integer("user_id"))
+            .build<const Campaign*>();
+        campaigns.insert(&summer, "country = \"CA\"");
+        campaigns.insert(&winter, "country = \"CA\" and user_id > 100");
+        campaigns.delete_subscription(&winter);
+        auto campaign_matches = campaigns.search(
+            campaigns.make_event()
+                .with_string("country", "CA")
+                .with_integer("user_id", 150)
+        );
+        std::cout << "Found " << campaign_matches.size() << " campaign(s): ";
+        for (const Campaign* campaign : campaign_matches) std::cout << campaign->name << " ";
+        std::cout << "\nExpected: summer (winter was deleted)\n";
+
+        // ====================================================================
+        print_separator("Saving and Loading a Snapshot");
+
+        const std::string snapshot_path = "advanced_cpp.atree";
+        tree.save(snapshot_path);
+        Tree loaded = Tree::load(snapshot_path);
+        std::remove(snapshot_path.c_str());
+
+        auto loaded_matches = loaded.search(
+            loaded.make_event()
+                .with_boolean("is_active", true)
+                .with_integer("user_id", 150)
+        );
+        std::cout << "Found " << loaded_matches.size() << " match(es) in the loaded tree: ";
+        for (auto id : loaded_matches) std::cout << id << " ";
+        std::cout << "\nExpected: subscription 1\n";
+
+        auto missing = Tree::try_load("missing.atree");
+        if (missing.is_err()) {
+            std::cout << "✓ Correctly caught error: " << missing.error() << "\n";
+        }
+
         // ====================================================================
         print_separator("Graphviz Export");
 
@@ -196,7 +537,17 @@ int main() {
         std::cout << "  ✓ Fluent builder API with method chaining\n";
         std::cout << "  ✓ Result-based error handling\n";
         std::cout << "  ✓ RAII memory management\n";
+        std::cout << "  ✓ Bulk insertions\n";
         std::cout << "  ✓ Delete operations\n";
+        std::cout << "  ✓ Reusable search contexts\n";
+        std::cout << "  ✓ Searches into caller-owned buffers\n";
+        std::cout << "  ✓ Reusable event builders with attribute handles\n";
+        std::cout << "  ✓ Interned strings set by ID\n";
+        std::cout << "  ✓ Batch searches\n";
+        std::cout << "  ✓ Columnar batches from Arrow arrays\n";
+        std::cout << "  ✓ Concurrent trees with non-blocking searches\n";
+        std::cout << "  ✓ Payloads matched without a second lookup\n";
+        std::cout << "  ✓ Snapshots that load without parsing the expressions\n";
         std::cout << "  ✓ Graphviz export for visualization\n";
 
         return 0;
@@ -76,6 +76,42 @@ int main(void) {
         atree_search_result_free(search_result);
     }
 
+    // Search again, writing the matches into a buffer owned by the caller
+    printf("\nSearching into a caller-owned buffer...\n");
+    builder = atree_event_builder_new(tree);
+    atree_event_builder_with_boolean(builder, "private", true);
+    atree_event_builder_with_integer(builder, "exchange_id", 1);
+    uint64_t ids[16];
+    size_t count = 0;
+    result = atree_search_into(tree, builder, ids, 16, &count);
+    if (!result.success) {
+        fprintf(stderr, "Failed to search: %s\n", result.error_message);
+        atree_free_error(result.error_message);
+    } else {
+        printf("Found %zu match(es) without allocating\n", count);
+    }
+
+    // Resolve the attributes once and reuse the same builder for several events
+    printf("\nReusing an event builder...\n");
+    AtreeAttributeHandle private_attribute;
+    AtreeAttributeHandle exchange_id_attribute;
+    atree_attribute(tree, "private", &private_attribute);
+    atree_attribute(tree, "exchange_id", &exchange_id_attribute);
+    builder = atree_event_builder_new(tree);
+    for (int64_t exchange_id = 0; exchange_id < 3; exchange_id++) {
+        atree_event_builder_reset(builder);
+        atree_event_builder_set_boolean(builder, private_attribute, true);
+        atree_event_builder_set_integer(builder, exchange_id_attribute, exchange_id);
+        result = atree_search_reused_into(tree, NULL, builder, ids, 16, &count);
+        if (!result.success) {
+            fprintf(stderr, "Failed to search: %s\n", result.error_message);
+            atree_free_error(result.error_message);
+        } else {
+            printf("exchange_id=%ld: %zu match(es)\n", exchange_id, count);
+        }
+    }
+    atree_event_builder_free(builder);
+
     // Clean up
     printf("\nCleaning up...\n");
     atree_free(tree);
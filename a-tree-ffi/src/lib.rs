@@ -3,17 +3,48 @@
 //! This crate provides a C-compatible API for using the a-tree library from C/C++ code.
 
 use std::ffi::{CStr, CString};
+use std::fs::File;
 use std::os::raw::{c_char, c_void};
 use std::ptr;
 use std::slice;
 
-use a_tree::{ATree, AttributeDefinition};
+use a_tree::{ATree, AttributeDefinition, ShardedATree, SharedATree, ThreadPool};
 
 /// Opaque handle to an ATree instance
+#[repr(transparent)]
 pub struct ATreeHandle {
     tree: ATree<u64>,
 }
 
+/// Opaque handle to a search context that is reused between searches
+pub struct ATreeSearchContext {
+    // The context only reads references to the tree while a search is running; the ones left
+    // behind by a search are never read since every search starts by clearing them.
+    context: a_tree::SearchContext<'static, u64>,
+}
+
+/// Opaque handle to an A-Tree that can be searched by many threads while it is updated
+pub struct ATreeSharedHandle {
+    tree: SharedATree<u64>,
+}
+
+/// Opaque handle to a snapshot of a shared A-Tree
+pub struct ATreeSnapshot {
+    // The snapshot borrows the shared tree; the caller frees it before the shared tree.
+    guard: a_tree::ReadGuard<'static, u64>,
+}
+
+/// Opaque handle to an A-Tree partitioned in shards that are searched by a pool of threads
+pub struct ATreeShardedHandle {
+    tree: ShardedATree<u64>,
+    pool: ThreadPool,
+}
+
+/// Opaque handle to a batch of events filled from columns
+pub struct ATreeEventBatch {
+    batch: a_tree::EventBatch,
+}
+
 /// Attribute types supported by the A-Tree
 #[repr(C)]
 #[derive(Debug, Copy, Clone)]
@@ -47,6 +78,140 @@ pub struct AtreeSearchResult {
     pub count: usize,
 }
 
+/// Pre-resolved handle to an attribute returned by `atree_attribute()`
+#[repr(C)]
+#[derive(Debug, Copy, Clone)]
+pub struct AtreeAttributeHandle {
+    pub index: usize,
+}
+
+impl From<AtreeAttributeHandle> for a_tree::AttributeHandle {
+    fn from(handle: AtreeAttributeHandle) -> Self {
+        a_tree::AttributeHandle::from_index(handle.index)
+    }
+}
+
+/// Interned string returned by `atree_intern()`
+#[repr(C)]
+#[derive(Debug, Copy, Clone)]
+pub struct AtreeStringId {
+    pub id: usize,
+}
+
+impl From<AtreeStringId> for a_tree::StringId {
+    fn from(string: AtreeStringId) -> Self {
+        a_tree::StringId::from_index(string.id)
+    }
+}
+
+/// Memory used by an A-Tree, in bytes, returned by `atree_memory_usage()`
+#[repr(C)]
+#[derive(Debug, Default, Copy, Clone)]
+pub struct AtreeMemoryUsage {
+    /// Slots of the nodes, including the vacant ones left behind by the deletions
+    pub nodes: usize,
+    /// Subscriptions, priorities, parents and children of the nodes
+    pub node_vectors: usize,
+    /// Lists of the predicates, predicates evaluated eagerly and predicate index
+    pub predicates: usize,
+    /// Interned strings
+    pub strings: usize,
+    /// Maps from the expressions and from the subscriptions to their nodes and roots
+    pub maps: usize,
+    /// Sum of all the above
+    pub total: usize,
+}
+
+impl From<a_tree::MemoryUsage> for AtreeMemoryUsage {
+    fn from(usage: a_tree::MemoryUsage) -> Self {
+        Self {
+            nodes: usage.nodes,
+            node_vectors: usage.node_vectors,
+            predicates: usage.predicates,
+            strings: usage.strings,
+            maps: usage.maps,
+            total: usage.total(),
+        }
+    }
+}
+
+/// Number of levels whose popped nodes are counted apart in `AtreeSearchStats`
+pub const ATREE_STATS_LEVELS: usize = 16;
+
+/// Statistics of the searches made with `atree_search_stats()`
+#[repr(C)]
+#[derive(Debug, Default, Copy, Clone)]
+pub struct AtreeSearchStats {
+    /// Searches that were made
+    pub searches: u64,
+    /// Predicates that were evaluated, either eagerly or because a node needed them
+    pub predicates_evaluated: u64,
+    /// Predicates that were not evaluated eagerly since nothing needed their result yet
+    pub predicates_delayed: u64,
+    /// Predicates that were not evaluated eagerly since they already were
+    pub predicates_skipped: u64,
+    /// Nodes popped from the queue of each level; the first entry is for the nodes right above
+    /// the predicates and the last one also counts the nodes of the levels above it
+    pub nodes_popped: [u64; ATREE_STATS_LEVELS],
+    /// AND nodes that failed because of a child without being evaluated
+    pub and_short_circuits: u64,
+    /// Matches that were found
+    pub matches: u64,
+    /// Time spent evaluating the predicates, in nanoseconds
+    pub predicates_ns: u64,
+    /// Time spent evaluating the nodes above the predicates, in nanoseconds
+    pub levels_ns: u64,
+}
+
+impl AtreeSearchStats {
+    fn add(&mut self, stats: &a_tree::SearchStats) {
+        let nanoseconds = |duration: std::time::Duration| duration.as_nanos() as u64;
+        self.searches += stats.searches;
+        self.predicates_evaluated += stats.predicates_evaluated;
+        self.predicates_delayed += stats.predicates_delayed;
+        self.predicates_skipped += stats.predicates_skipped;
+        for (level, popped) in stats.nodes_popped.iter().enumerate() {
+            self.nodes_popped[level.min(ATREE_STATS_LEVELS - 1)] += popped;
+        }
+        self.and_short_circuits += stats.and_short_circuits;
+        self.matches += stats.matches;
+        self.predicates_ns += nanoseconds(stats.predicates_time);
+        self.levels_ns += nanoseconds(stats.levels_time);
+    }
+}
+
+/// Array of the Arrow C Data Interface (https://arrow.apache.org/docs/format/CDataInterface.html)
+///
+/// The layout is the one of `struct ArrowArray` so the arrays exported by an Arrow library can be
+/// passed as is.
+#[repr(C)]
+pub struct ArrowArray {
+    pub length: i64,
+    pub null_count: i64,
+    pub offset: i64,
+    pub n_buffers: i64,
+    pub n_children: i64,
+    pub buffers: *mut *const c_void,
+    pub children: *mut *mut ArrowArray,
+    pub dictionary: *mut ArrowArray,
+    pub release: Option<unsafe extern "C" fn(array: *mut ArrowArray)>,
+    pub private_data: *mut c_void,
+}
+
+/// Values of an attribute for all the events of a batch searched with `atree_search_columns()`
+#[repr(C)]
+pub struct AtreeColumn {
+    pub attribute: AtreeAttributeHandle,
+    pub attr_type: AtreeAttributeType,
+    /// Number of decimal places of the `Float` columns (e.g., 123.45 = 12345 with a scale of 2);
+    /// at most 28
+    pub scale: u32,
+    pub array: *const ArrowArray,
+}
+
+/// Callback receiving the subscription IDs matched by `atree_search_visit()`
+pub type AtreeMatchCallback = Option<unsafe extern "C" fn(subscription_id: u64, user_data: *mut c_void)>;
+
 impl AtreeResult {
     fn ok() -> Self {
         Self {
@@ -83,17 +248,27 @@ pub unsafe extern "C" fn atree_new(defs: *const AtreeAttributeDef, count: usize)
         return ptr::null_mut();
     }
 
+    match attribute_definitions(defs, count).and_then(|attr_defs| ATree::<u64>::new(&attr_defs).ok()) {
+        Some(tree) => Box::into_raw(Box::new(ATreeHandle { tree })),
+        _ => ptr::null_mut(),
+    }
+}
+
+unsafe fn attribute_definitions(
+    defs: *const AtreeAttributeDef,
+    count: usize,
+) -> Option<Vec<AttributeDefinition>> {
     let defs_slice = slice::from_raw_parts(defs, count);
     let mut attr_defs = Vec::with_capacity(count);
 
     for def in defs_slice {
         if def.name.is_null() {
-            return ptr::null_mut();
+            return None;
         }
 
         let name = match CStr::from_ptr(def.name).to_str() {
             Ok(s) => s,
-            Err(_) => return ptr::null_mut(),
+            Err(_) => return None,
         };
 
         let attr_def = match def.attr_type {
@@ -108,10 +283,7 @@ pub unsafe extern "C" fn atree_new(defs: *const AtreeAttributeDef, count: usize)
         attr_defs.push(attr_def);
     }
 
-    match ATree::<u64>::new(&attr_defs) {
-        Ok(tree) => Box::into_raw(Box::new(ATreeHandle { tree })),
-        Err(_) => ptr::null_mut(),
-    }
+    Some(attr_defs)
 }
 
 /// Free an A-Tree handle.
@@ -128,6 +300,10 @@ pub unsafe extern "C" fn atree_free(handle: *mut ATreeHandle) {
 
 /// Insert a boolean expression associated with a subscription ID.
 ///
+/// The subscription ID is an opaque 64-bit value that is stored as is and handed back by the
+/// searches, so it can also hold a payload such as a pointer (e.g. `(uint64_t)(uintptr_t)ptr`)
+/// that the matches are used through without looking them up.
+///
 /// # Arguments
 /// * `handle` - Valid ATree handle
 /// * `subscription_id` - Unique ID for this subscription
@@ -162,6 +338,60 @@ pub unsafe extern "C" fn atree_insert(
     }
 }
 
+/// Insert many boolean expressions at once.
+///
+/// This is faster than calling `atree_insert()` for each expression when loading a lot of
+/// subscriptions. All the expressions are parsed and optimized over the available cores before
+/// any of them is inserted; if one of them is invalid, none of them is inserted.
+///
+/// # Arguments
+/// * `handle` - Valid ATree handle
+/// * `subscription_ids` - Array of unique IDs, one per expression
+/// * `expressions` - Array of null-terminated boolean expression strings
+/// * `count` - Number of entries in both arrays
+///
+/// # Returns
+/// Result indicating success or failure
+///
+/// # Safety
+/// - `handle` must be a valid pointer returned by `atree_new()`
+/// - `subscription_ids` must point to `count` u64 values
+/// - `expressions` must point to `count` valid null-terminated C strings
+/// - Caller must free result.error_message with `atree_free_error()` if !success
+#[no_mangle]
+pub unsafe extern "C" fn atree_insert_batch(
+    handle: *mut ATreeHandle,
+    subscription_ids: *const u64,
+    expressions: *const *const c_char,
+    count: usize,
+) -> AtreeResult {
+    if handle.is_null() || (count > 0 && (subscription_ids.is_null() || expressions.is_null())) {
+        return AtreeResult::err("Invalid arguments");
+    }
+    if count == 0 {
+        return AtreeResult::ok();
+    }
+
+    let ids_slice = slice::from_raw_parts(subscription_ids, count);
+    let expressions_slice = slice::from_raw_parts(expressions, count);
+    let mut entries = Vec::with_capacity(count);
+    for (&id, &expression) in ids_slice.iter().zip(expressions_slice) {
+        if expression.is_null() {
+            return AtreeResult::err("Null pointer in expressions");
+        }
+        match CStr::from_ptr(expression).to_str() {
+            Ok(s) => entries.push((id, s)),
+            Err(_) => return AtreeResult::err("Invalid UTF-8 in expression"),
+        }
+    }
+
+    let handle_ref = &mut *handle;
+    match handle_ref.tree.insert_bulk_parallel(entries) {
+        Ok(_) => AtreeResult::ok(),
+        Err(e) => AtreeResult::err(&format!("{:?}", e)),
+    }
+}
+
 /// Delete a subscription by ID.
 ///
 /// # Arguments
@@ -183,6 +413,71 @@ pub unsafe extern "C" fn atree_delete(
     handle_ref.tree.delete(&subscription_id);
 }
 
+/// Delete many subscriptions at once.
+///
+/// The IDs that are not in the tree are ignored.
+///
+/// # Arguments
+/// * `handle` - Valid ATree handle
+/// * `subscription_ids` - Array of the IDs of the subscriptions to delete
+/// * `count` - Number of IDs in the array
+///
+/// # Safety
+/// - `handle` must be a valid pointer returned by `atree_new()`
+/// - `subscription_ids` must point to `count` u64 values
+#[no_mangle]
+pub unsafe extern "C" fn atree_delete_batch(
+    handle: *mut ATreeHandle,
+    subscription_ids: *const u64,
+    count: usize,
+) {
+    if handle.is_null() || subscription_ids.is_null() || count == 0 {
+        return;
+    }
+
+    let handle_ref = &mut *handle;
+    handle_ref
+        .tree
+        .delete_bulk(std::slice::from_raw_parts(subscription_ids, count));
+}
+
+/// Get the memory used by the tree, broken down by its parts.
+///
+/// # Returns
+/// Memory usage in bytes; all the fields are zero if `handle` is null
+///
+/// # Safety
+/// - `handle` must be a valid pointer returned by `atree_new()`
+#[no_mangle]
+pub unsafe extern "C" fn atree_memory_usage(handle: *const ATreeHandle) -> AtreeMemoryUsage {
+    if handle.is_null() {
+        return AtreeMemoryUsage::default();
+    }
+
+    let handle_ref = &*handle;
+    handle_ref.tree.memory_usage().into()
+}
+
+/// Release the memory left behind by the deletions.
+///
+/// Renumbers the nodes densely, drops the strings that no expression references anymore and
+/// shrinks the buffers. This walks over the whole tree so it is meant to be called during
+/// low-traffic windows.
+///
+/// # Safety
+/// - `handle` must be a valid pointer returned by `atree_new()`
+/// - No event builder of `handle` may be alive
+/// - The IDs returned by `atree_intern()` are invalidated and must be interned again
+#[no_mangle]
+pub unsafe extern "C" fn atree_compact(handle: *mut ATreeHandle) {
+    if handle.is_null() {
+        return;
+    }
+
+    let handle_ref = &mut *handle;
+    handle_ref.tree.compact();
+}
+
 /// Export the tree structure as a Graphviz DOT format string.
 ///
 /// # Returns
@@ -206,6 +501,72 @@ pub unsafe extern "C" fn atree_to_graphviz(handle: *const ATreeHandle) -> *mut c
     }
 }
 
+/// Save a snapshot of the tree in a file.
+///
+/// The snapshot can be loaded with `atree_load()` without parsing the expressions again.
+///
+/// # Arguments
+/// * `handle` - Valid ATree handle
+/// * `path` - Null-terminated path of the file to write
+///
+/// # Returns
+/// Result indicating success or failure
+///
+/// # Safety
+/// - `handle` must be a valid pointer returned by `atree_new()`
+/// - `path` must be a valid null-terminated C string
+/// - Caller must free result.error_message with `atree_free_error()` if !success
+#[no_mangle]
+pub unsafe extern "C" fn atree_save(handle: *const ATreeHandle, path: *const c_char) -> AtreeResult {
+    if handle.is_null() || path.is_null() {
+        return AtreeResult::err("Null pointer provided");
+    }
+
+    let path = match CStr::from_ptr(path).to_str() {
+        Ok(s) => s,
+        Err(_) => return AtreeResult::err("Invalid UTF-8 in path"),
+    };
+
+    let handle_ref = &*handle;
+    let result = File::create(path).and_then(|mut file| handle_ref.tree.save(&mut file));
+    match result {
+        Ok(_) => AtreeResult::ok(),
+        Err(e) => AtreeResult::err(&format!("{:?}", e)),
+    }
+}
+
+/// Load a tree from a snapshot file written by `atree_save()`.
+///
+/// The file is mapped in memory and decoded into a new tree, which does not reference the file
+/// once it is loaded.
+///
+/// # Arguments
+/// * `path` - Null-terminated path of the snapshot file
+///
+/// # Returns
+/// Pointer to ATreeHandle on success, null on failure (e.g. the file is missing, is not a
+/// snapshot or was written by an incompatible version)
+///
+/// # Safety
+/// - `path` must be a valid null-terminated C string
+/// - Caller must free the returned handle with `atree_free()`
+#[no_mangle]
+pub unsafe extern "C" fn atree_load(path: *const c_char) -> *mut ATreeHandle {
+    if path.is_null() {
+        return ptr::null_mut();
+    }
+
+    let path = match CStr::from_ptr(path).to_str() {
+        Ok(s) => s,
+        Err(_) => return ptr::null_mut(),
+    };
+
+    match ATree::<u64>::load_mmap(path) {
+        Ok(tree) => Box::into_raw(Box::new(ATreeHandle { tree })),
+        Err(_) => ptr::null_mut(),
+    }
+}
+
 /// Free a string returned by the library.
 ///
 /// # Safety
@@ -450,96 +811,1671 @@ pub unsafe extern "C" fn atree_event_builder_with_undefined(
     }
 }
 
-/// Search the A-Tree for matching expressions.
+/// Resolve the handle of an attribute once so that the events can set it without looking up its
+/// name.
+///
+/// # Arguments
+/// * `handle` - Valid ATree handle
+/// * `name` - Name of the attribute
+/// * `out` - Receives the handle of the attribute
+///
+/// # Returns
+/// Result indicating success or failure
 ///
 /// # Safety
 /// - `handle` must be a valid pointer returned by `atree_new()`
-/// - `builder` must be a valid pointer returned by `atree_event_builder_new()`
-/// - `builder` will be consumed by this call and must not be used after
-/// - Caller must free the returned result with `atree_search_result_free()`
+/// - `name` must be a valid null-terminated C string
+/// - `out` must point to writable memory for an AtreeAttributeHandle
+/// - Caller must free result.error_message with `atree_free_error()` if !success
 #[no_mangle]
-pub unsafe extern "C" fn atree_search(
+pub unsafe extern "C" fn atree_attribute(
     handle: *const ATreeHandle,
-    builder: *mut c_void,
-) -> AtreeSearchResult {
-    if handle.is_null() || builder.is_null() {
-        return AtreeSearchResult {
-            ids: ptr::null_mut(),
-            count: 0,
-        };
+    name: *const c_char,
+    out: *mut AtreeAttributeHandle,
+) -> AtreeResult {
+    if handle.is_null() || name.is_null() || out.is_null() {
+        return AtreeResult::err("Invalid arguments");
     }
 
-    let handle_ref = &*handle;
-    let builder_owned = Box::from_raw(builder as *mut a_tree::EventBuilder);
-
-    let event = match builder_owned.build() {
-        Ok(e) => e,
-        Err(_) => {
-            return AtreeSearchResult {
-                ids: ptr::null_mut(),
-                count: 0,
-            }
-        }
-    };
-
-    let report = match handle_ref.tree.search(&event) {
-        Ok(r) => r,
-        Err(_) => {
-            return AtreeSearchResult {
-                ids: ptr::null_mut(),
-                count: 0,
-            }
-        }
+    let name_str = match CStr::from_ptr(name).to_str() {
+        Ok(s) => s,
+        Err(_) => return AtreeResult::err("Invalid UTF-8 in name"),
     };
 
-    let matches: Vec<u64> = report.matches().iter().map(|&&id| id).collect();
-    let count = matches.len();
-
-    if count == 0 {
-        AtreeSearchResult {
-            ids: ptr::null_mut(),
-            count: 0,
+    let handle_ref = &*handle;
+    match handle_ref.tree.attribute(name_str) {
+        Ok(attribute) => {
+            *out = AtreeAttributeHandle {
+                index: attribute.index(),
+            };
+            AtreeResult::ok()
         }
-    } else {
-        let boxed = matches.into_boxed_slice();
-        let ptr = Box::into_raw(boxed) as *mut u64;
-        AtreeSearchResult { ids: ptr, count }
+        Err(e) => AtreeResult::err(&format!("{:?}", e)),
     }
 }
 
-/// Free a search result.
+/// Intern a string so that the events can set it without hashing it again.
+///
+/// The ID stays valid for the lifetime of the tree, so the strings that appear in many events
+/// (e.g. a dictionary of deal IDs) can be interned once and reused across the events. Every
+/// interned string is kept by the tree.
+///
+/// # Arguments
+/// * `handle` - Valid ATree handle
+/// * `value` - String to intern
+/// * `out` - Receives the ID of the string
+///
+/// # Returns
+/// Result indicating success or failure
 ///
 /// # Safety
-/// - `result` must be a valid search result returned by `atree_search()`
-/// - `result` must not be used after this call
+/// - `handle` must be a valid pointer returned by `atree_new()`
+/// - `value` must be a valid null-terminated C string
+/// - `out` must point to writable memory for an AtreeStringId
+/// - Caller must free result.error_message with `atree_free_error()` if !success
 #[no_mangle]
-pub unsafe extern "C" fn atree_search_result_free(result: AtreeSearchResult) {
-    if !result.ids.is_null() && result.count > 0 {
-        drop(Box::from_raw(slice::from_raw_parts_mut(
-            result.ids,
-            result.count,
-        )));
+pub unsafe extern "C" fn atree_intern(
+    handle: *mut ATreeHandle,
+    value: *const c_char,
+    out: *mut AtreeStringId,
+) -> AtreeResult {
+    if handle.is_null() || value.is_null() || out.is_null() {
+        return AtreeResult::err("Invalid arguments");
     }
-}
 
-/// Free an error message string.
-///
-/// # Safety
-/// - `error` must be a valid pointer from AtreeResult.error_message
+    let value_str = match CStr::from_ptr(value).to_str() {
+        Ok(s) => s,
+        Err(_) => return AtreeResult::err("Invalid UTF-8 in value"),
+    };
+
+    let handle_ref = &mut *handle;
+    *out = AtreeStringId {
+        id: handle_ref.tree.intern(value_str).index(),
+    };
+    AtreeResult::ok()
+}
+
+/// Set a boolean attribute of the event through its handle.
+///
+/// # Safety
+/// - `builder` must be a valid pointer returned by `atree_event_builder_new()`
+/// - `attribute` must have been returned by `atree_attribute()` for the builder's tree
 #[no_mangle]
-pub unsafe extern "C" fn atree_free_error(error: *mut c_char) {
-    if !error.is_null() {
-        drop(CString::from_raw(error));
+pub unsafe extern "C" fn atree_event_builder_set_boolean(
+    builder: *mut c_void,
+    attribute: AtreeAttributeHandle,
+    value: bool,
+) -> AtreeResult {
+    set_attribute(builder, |builder_ref| {
+        builder_ref.set_boolean(attribute.into(), value)
+    })
+}
+
+/// Set an integer attribute of the event through its handle.
+///
+/// # Safety
+/// - `builder` must be a valid pointer returned by `atree_event_builder_new()`
+/// - `attribute` must have been returned by `atree_attribute()` for the builder's tree
+#[no_mangle]
+pub unsafe extern "C" fn atree_event_builder_set_integer(
+    builder: *mut c_void,
+    attribute: AtreeAttributeHandle,
+    value: i64,
+) -> AtreeResult {
+    set_attribute(builder, |builder_ref| {
+        builder_ref.set_integer(attribute.into(), value)
+    })
+}
+
+/// Set a string attribute of the event through its handle.
+///
+/// # Safety
+/// - `builder` must be a valid pointer returned by `atree_event_builder_new()`
+/// - `attribute` must have been returned by `atree_attribute()` for the builder's tree
+/// - `value` must be a valid null-terminated C string
+#[no_mangle]
+pub unsafe extern "C" fn atree_event_builder_set_string(
+    builder: *mut c_void,
+    attribute: AtreeAttributeHandle,
+    value: *const c_char,
+) -> AtreeResult {
+    if value.is_null() {
+        return AtreeResult::err("Invalid arguments");
     }
+
+    let value_str = match CStr::from_ptr(value).to_str() {
+        Ok(s) => s,
+        Err(_) => return AtreeResult::err("Invalid UTF-8 in value"),
+    };
+
+    set_attribute(builder, |builder_ref| {
+        builder_ref.set_string(attribute.into(), value_str)
+    })
 }
 
-/// Free an event builder without using it.
+/// Set a float attribute of the event through its handle.
+///
+/// The float is represented as a decimal with a mantissa and scale.
+/// For example, 123.45 would be represented as number=12345, scale=2.
 ///
 /// # Safety
 /// - `builder` must be a valid pointer returned by `atree_event_builder_new()`
+/// - `attribute` must have been returned by `atree_attribute()` for the builder's tree
 #[no_mangle]
-pub unsafe extern "C" fn atree_event_builder_free(builder: *mut c_void) {
+pub unsafe extern "C" fn atree_event_builder_set_float(
+    builder: *mut c_void,
+    attribute: AtreeAttributeHandle,
+    number: i64,
+    scale: u32,
+) -> AtreeResult {
+    set_attribute(builder, |builder_ref| {
+        builder_ref.set_float(attribute.into(), number, scale)
+    })
+}
+
+/// Set a string attribute of the event to a string interned by `atree_intern()`.
+///
+/// # Safety
+/// - `builder` must be a valid pointer returned by `atree_event_builder_new()`
+/// - `attribute` must have been returned by `atree_attribute()` for the builder's tree
+/// - `value` must have been returned by `atree_intern()` for the builder's tree
+#[no_mangle]
+pub unsafe extern "C" fn atree_event_builder_set_string_id(
+    builder: *mut c_void,
+    attribute: AtreeAttributeHandle,
+    value: AtreeStringId,
+) -> AtreeResult {
+    set_attribute(builder, |builder_ref| {
+        builder_ref.set_string_id(attribute.into(), value.into())
+    })
+}
+
+/// Set a string list attribute of the event to strings interned by `atree_intern()`.
+///
+/// # Safety
+/// - `builder` must be a valid pointer returned by `atree_event_builder_new()`
+/// - `attribute` must have been returned by `atree_attribute()` for the builder's tree
+/// - `values` must point to an array of `count` IDs returned by `atree_intern()` for the
+///   builder's tree
+#[no_mangle]
+pub unsafe extern "C" fn atree_event_builder_set_string_id_list(
+    builder: *mut c_void,
+    attribute: AtreeAttributeHandle,
+    values: *const AtreeStringId,
+    count: usize,
+) -> AtreeResult {
+    if values.is_null() {
+        return AtreeResult::err("Invalid arguments");
+    }
+
+    // SAFETY: `AtreeStringId` and `a_tree::StringId` are both a single `usize`.
+    let values_slice = slice::from_raw_parts(values as *const a_tree::StringId, count);
+    set_attribute(builder, |builder_ref| {
+        builder_ref.set_string_id_list(attribute.into(), values_slice)
+    })
+}
+
+/// Set a string list attribute of the event through its handle.
+///
+/// # Safety
+/// - `builder` must be a valid pointer returned by `atree_event_builder_new()`
+/// - `attribute` must have been returned by `atree_attribute()` for the builder's tree
+/// - `values` must point to an array of `count` valid null-terminated C strings
+#[no_mangle]
+pub unsafe extern "C" fn atree_event_builder_set_string_list(
+    builder: *mut c_void,
+    attribute: AtreeAttributeHandle,
+    values: *const *const c_char,
+    count: usize,
+) -> AtreeResult {
+    if values.is_null() {
+        return AtreeResult::err("Invalid arguments");
+    }
+
+    let values_slice = slice::from_raw_parts(values, count);
+    let mut string_vec = Vec::with_capacity(count);
+
+    for &value_ptr in values_slice {
+        if value_ptr.is_null() {
+            return AtreeResult::err("Null pointer in string list");
+        }
+        let value_str = match CStr::from_ptr(value_ptr).to_str() {
+            Ok(s) => s,
+            Err(_) => return AtreeResult::err("Invalid UTF-8 in string list"),
+        };
+        string_vec.push(value_str);
+    }
+
+    set_attribute(builder, |builder_ref| {
+        builder_ref.set_string_list(attribute.into(), &string_vec)
+    })
+}
+
+/// Set an integer list attribute of the event through its handle.
+///
+/// # Safety
+/// - `builder` must be a valid pointer returned by `atree_event_builder_new()`
+/// - `attribute` must have been returned by `atree_attribute()` for the builder's tree
+/// - `values` must point to an array of `count` i64 values
+#[no_mangle]
+pub unsafe extern "C" fn atree_event_builder_set_integer_list(
+    builder: *mut c_void,
+    attribute: AtreeAttributeHandle,
+    values: *const i64,
+    count: usize,
+) -> AtreeResult {
+    if values.is_null() {
+        return AtreeResult::err("Invalid arguments");
+    }
+
+    let values_slice = slice::from_raw_parts(values, count);
+    set_attribute(builder, |builder_ref| {
+        builder_ref.set_integer_list(attribute.into(), values_slice)
+    })
+}
+
+/// Set an attribute of the event to undefined through its handle.
+///
+/// # Safety
+/// - `builder` must be a valid pointer returned by `atree_event_builder_new()`
+/// - `attribute` must have been returned by `atree_attribute()` for the builder's tree
+#[no_mangle]
+pub unsafe extern "C" fn atree_event_builder_set_undefined(
+    builder: *mut c_void,
+    attribute: AtreeAttributeHandle,
+) -> AtreeResult {
+    set_attribute(builder, |builder_ref| {
+        builder_ref.set_undefined(attribute.into())
+    })
+}
+
+/// Set all the attributes of the event back to undefined so that the builder can be reused.
+///
+/// The builder keeps its memory (including the buffers of the list attributes) so building the
+/// next event does not allocate.
+///
+/// # Safety
+/// - `builder` must be a valid pointer returned by `atree_event_builder_new()`
+#[no_mangle]
+pub unsafe extern "C" fn atree_event_builder_reset(builder: *mut c_void) {
     if !builder.is_null() {
-        drop(Box::from_raw(builder as *mut a_tree::EventBuilder));
+        let builder_ref = &mut *(builder as *mut a_tree::EventBuilder);
+        builder_ref.reset();
+    }
+}
+
+unsafe fn set_attribute<F>(builder: *mut c_void, f: F) -> AtreeResult
+where
+    F: FnOnce(&mut a_tree::EventBuilder) -> Result<(), a_tree::EventError>,
+{
+    if builder.is_null() {
+        return AtreeResult::err("Invalid arguments");
+    }
+
+    let builder_ref = &mut *(builder as *mut a_tree::EventBuilder);
+    match f(builder_ref) {
+        Ok(_) => AtreeResult::ok(),
+        Err(e) => AtreeResult::err(&format!("{:?}", e)),
+    }
+}
+
+/// Search the A-Tree for matching expressions.
+///
+/// # Safety
+/// - `handle` must be a valid pointer returned by `atree_new()`
+/// - `builder` must be a valid pointer returned by `atree_event_builder_new()`
+/// - `builder` will be consumed by this call and must not be used after
+/// - Caller must free the returned result with `atree_search_result_free()`
+#[no_mangle]
+pub unsafe extern "C" fn atree_search(
+    handle: *const ATreeHandle,
+    builder: *mut c_void,
+) -> AtreeSearchResult {
+    if handle.is_null() || builder.is_null() {
+        return AtreeSearchResult {
+            ids: ptr::null_mut(),
+            count: 0,
+        };
+    }
+
+    let handle_ref = &*handle;
+    let builder_owned = Box::from_raw(builder as *mut a_tree::EventBuilder);
+
+    let event = match builder_owned.build() {
+        Ok(e) => e,
+        Err(_) => {
+            return AtreeSearchResult {
+                ids: ptr::null_mut(),
+                count: 0,
+            }
+        }
+    };
+
+    let report = match handle_ref.tree.search(&event) {
+        Ok(r) => r,
+        Err(_) => {
+            return AtreeSearchResult {
+                ids: ptr::null_mut(),
+                count: 0,
+            }
+        }
+    };
+
+    let matches: Vec<u64> = report.matches().iter().map(|&&id| id).collect();
+    let count = matches.len();
+
+    if count == 0 {
+        AtreeSearchResult {
+            ids: ptr::null_mut(),
+            count: 0,
+        }
+    } else {
+        let boxed = matches.into_boxed_slice();
+        let ptr = Box::into_raw(boxed) as *mut u64;
+        AtreeSearchResult { ids: ptr, count }
+    }
+}
+
+/// Create a search context that can be reused between searches with `atree_search_with()`.
+///
+/// Reusing a search context avoids allocating and clearing the whole evaluation state of the
+/// tree on every search.
+///
+/// # Returns
+/// Pointer to ATreeSearchContext on success, null on failure
+///
+/// # Safety
+/// - `handle` must be a valid pointer returned by `atree_new()`
+/// - Caller must free the returned context with `atree_search_context_free()`
+#[no_mangle]
+pub unsafe extern "C" fn atree_search_context_new(
+    handle: *const ATreeHandle,
+) -> *mut ATreeSearchContext {
+    if handle.is_null() {
+        return ptr::null_mut();
+    }
+
+    let handle_ref = &*handle;
+    let context = handle_ref.tree.make_search_context();
+    // SAFETY: the context does not hold any reference to the tree outside of a search.
+    let context = std::mem::transmute::<
+        a_tree::SearchContext<'_, u64>,
+        a_tree::SearchContext<'static, u64>,
+    >(context);
+    Box::into_raw(Box::new(ATreeSearchContext { context }))
+}
+
+/// Free a search context.
+///
+/// # Safety
+/// - `context` must be a valid pointer returned by `atree_search_context_new()`
+/// - `context` must not be used after this call
+#[no_mangle]
+pub unsafe extern "C" fn atree_search_context_free(context: *mut ATreeSearchContext) {
+    if !context.is_null() {
+        drop(Box::from_raw(context));
+    }
+}
+
+/// Search the A-Tree for matching expressions by reusing a search context.
+///
+/// # Safety
+/// - `handle` must be a valid pointer returned by `atree_new()`
+/// - `context` must be a valid pointer returned by `atree_search_context_new()` for `handle` or for
+///   another snapshot of the same shared tree
+/// - `context` must not be used by another search at the same time
+/// - `builder` must be a valid pointer returned by `atree_event_builder_new()`
+/// - `builder` will be consumed by this call and must not be used after
+/// - Caller must free the returned result with `atree_search_result_free()`
+#[no_mangle]
+pub unsafe extern "C" fn atree_search_with(
+    handle: *const ATreeHandle,
+    context: *mut ATreeSearchContext,
+    builder: *mut c_void,
+) -> AtreeSearchResult {
+    if handle.is_null() || context.is_null() || builder.is_null() {
+        return AtreeSearchResult {
+            ids: ptr::null_mut(),
+            count: 0,
+        };
+    }
+
+    let handle_ref = &*handle;
+    let context_ref =
+        &mut *ptr::addr_of_mut!((*context).context).cast::<a_tree::SearchContext<'_, u64>>();
+    let builder_owned = Box::from_raw(builder as *mut a_tree::EventBuilder);
+
+    let event = match builder_owned.build() {
+        Ok(e) => e,
+        Err(_) => {
+            return AtreeSearchResult {
+                ids: ptr::null_mut(),
+                count: 0,
+            }
+        }
+    };
+
+    let matches: Vec<u64> = match handle_ref.tree.search_with(context_ref, &event) {
+        Ok(matches) => matches.iter().map(|&&id| id).collect(),
+        Err(_) => {
+            return AtreeSearchResult {
+                ids: ptr::null_mut(),
+                count: 0,
+            }
+        }
+    };
+    let count = matches.len();
+
+    if count == 0 {
+        AtreeSearchResult {
+            ids: ptr::null_mut(),
+            count: 0,
+        }
+    } else {
+        let boxed = matches.into_boxed_slice();
+        let ptr = Box::into_raw(boxed) as *mut u64;
+        AtreeSearchResult { ids: ptr, count }
+    }
+}
+
+/// Search the A-Tree and write the matching subscription IDs into a caller-owned buffer.
+///
+/// Unlike `atree_search()`, no memory is allocated for the results and nothing has to be freed.
+///
+/// # Arguments
+/// * `handle` - Valid ATree handle
+/// * `builder` - Event builder (consumed by this call)
+/// * `buffer` - Array receiving up to `capacity` subscription IDs
+/// * `capacity` - Number of IDs that fit in `buffer`
+/// * `out_len` - Receives the number of matching subscription IDs
+///
+/// # Returns
+/// Result indicating success or failure; if more than `capacity` subscriptions match, the first
+/// `capacity` IDs are written, `out_len` receives the total and an error is returned
+///
+/// # Safety
+/// - `handle` must be a valid pointer returned by `atree_new()`
+/// - `builder` must be a valid pointer returned by `atree_event_builder_new()`
+/// - `builder` will be consumed by this call and must not be used after
+/// - `buffer` must point to writable memory for `capacity` u64 values
+/// - `out_len` must point to writable memory for a size_t
+/// - Caller must free result.error_message with `atree_free_error()` if !success
+#[no_mangle]
+pub unsafe extern "C" fn atree_search_into(
+    handle: *const ATreeHandle,
+    builder: *mut c_void,
+    buffer: *mut u64,
+    capacity: usize,
+    out_len: *mut usize,
+) -> AtreeResult {
+    atree_search_with_into(handle, ptr::null_mut(), builder, buffer, capacity, out_len)
+}
+
+/// Search the A-Tree by reusing a search context and write the matching subscription IDs into a
+/// caller-owned buffer.
+///
+/// Combined with a search context, the search does not allocate any memory.
+///
+/// # Arguments
+/// * `handle` - Valid ATree handle
+/// * `context` - Search context to reuse, or null to search without one
+/// * `builder` - Event builder (consumed by this call)
+/// * `buffer` - Array receiving up to `capacity` subscription IDs
+/// * `capacity` - Number of IDs that fit in `buffer`
+/// * `out_len` - Receives the number of matching subscription IDs
+///
+/// # Returns
+/// Result indicating success or failure; if more than `capacity` subscriptions match, the first
+/// `capacity` IDs are written, `out_len` receives the total and an error is returned
+///
+/// # Safety
+/// - `handle` must be a valid pointer returned by `atree_new()`
+/// - `context` must be null or satisfy the requirements of `atree_search_with()`
+/// - `builder` must be a valid pointer returned by `atree_event_builder_new()`
+/// - `builder` will be consumed by this call and must not be used after
+/// - `buffer` must point to writable memory for `capacity` u64 values
+/// - `out_len` must point to writable memory for a size_t
+/// - Caller must free result.error_message with `atree_free_error()` if !success
+#[no_mangle]
+pub unsafe extern "C" fn atree_search_with_into(
+    handle: *const ATreeHandle,
+    context: *mut ATreeSearchContext,
+    builder: *mut c_void,
+    buffer: *mut u64,
+    capacity: usize,
+    out_len: *mut usize,
+) -> AtreeResult {
+    if out_len.is_null() || (capacity > 0 && buffer.is_null()) {
+        if !builder.is_null() {
+            drop(Box::from_raw(builder as *mut a_tree::EventBuilder));
+        }
+        return AtreeResult::err("Invalid arguments");
+    }
+
+    search_matches(handle, context, builder, |matches| {
+        write_matches(matches, buffer, capacity, out_len)
+    })
+}
+
+/// Search the A-Tree like `atree_search_visit()` while recording what the search did.
+///
+/// The statistics of the search are added to the ones already in `stats` so that they can be
+/// accumulated over many searches (e.g. one `AtreeSearchStats` per thread that is exported once
+/// in a while). The other search functions are not instrumented.
+///
+/// # Arguments
+/// * `handle` - Valid ATree handle
+/// * `context` - Search context to reuse, or null to search without one
+/// * `builder` - Event builder (consumed by this call)
+/// * `callback` - Function called with each matching subscription ID and `user_data`
+/// * `user_data` - Pointer passed as is to `callback`
+/// * `stats` - Statistics the ones of the search are added to
+///
+/// # Returns
+/// Result indicating success or failure
+///
+/// # Safety
+/// - `handle` must be a valid pointer returned by `atree_new()`
+/// - `context` must be null or satisfy the requirements of `atree_search_with()`
+/// - `builder` must be a valid pointer returned by `atree_event_builder_new()`
+/// - `builder` will be consumed by this call and must not be used after
+/// - `callback` must not call back into the library with `handle` or `context`
+/// - `stats` must point to an initialized AtreeSearchStats (e.g. zeroed)
+/// - Caller must free result.error_message with `atree_free_error()` if !success
+#[no_mangle]
+pub unsafe extern "C" fn atree_search_stats(
+    handle: *const ATreeHandle,
+    context: *mut ATreeSearchContext,
+    builder: *mut c_void,
+    callback: AtreeMatchCallback,
+    user_data: *mut c_void,
+    stats: *mut AtreeSearchStats,
+) -> AtreeResult {
+    if builder.is_null() {
+        return AtreeResult::err("Null pointer provided");
+    }
+    let builder_owned = Box::from_raw(builder as *mut a_tree::EventBuilder);
+    let callback = match callback {
+        Some(callback) if !handle.is_null() && !stats.is_null() => callback,
+        _ => return AtreeResult::err("Invalid arguments"),
+    };
+    let event = match builder_owned.build() {
+        Ok(e) => e,
+        Err(e) => return AtreeResult::err(&format!("{:?}", e)),
+    };
+
+    let handle_ref = &*handle;
+    let mut owned_context;
+    let context_ref = if context.is_null() {
+        owned_context = handle_ref.tree.make_search_context();
+        &mut owned_context
+    } else {
+        &mut *ptr::addr_of_mut!((*context).context).cast::<a_tree::SearchContext<'_, u64>>()
+    };
+    let mut search_stats = a_tree::SearchStats::default();
+    let result = match handle_ref.tree.search_with_stats(context_ref, &event, &mut search_stats) {
+        Ok(matches) => {
+            for id in matches {
+                callback(**id, user_data);
+            }
+            AtreeResult::ok()
+        }
+        Err(e) => AtreeResult::err(&format!("{:?}", e)),
+    };
+    (*stats).add(&search_stats);
+    result
+}
+
+/// Search the A-Tree and call a function for each matching subscription ID.
+///
+/// The subscription IDs are handed to the callback as they are read from the search results so
+/// they can be put straight into the caller's own storage.
+///
+/// # Arguments
+/// * `handle` - Valid ATree handle
+/// * `context` - Search context to reuse, or null to search without one
+/// * `builder` - Event builder (consumed by this call)
+/// * `callback` - Function called with each matching subscription ID and `user_data`
+/// * `user_data` - Pointer passed as is to `callback`
+///
+/// # Returns
+/// Result indicating success or failure
+///
+/// # Safety
+/// - `handle` must be a valid pointer returned by `atree_new()`
+/// - `context` must be null or satisfy the requirements of `atree_search_with()`
+/// - `builder` must be a valid pointer returned by `atree_event_builder_new()`
+/// - `builder` will be consumed by this call and must not be used after
+/// - `callback` must not call back into the library with `handle` or `context`
+/// - Caller must free result.error_message with `atree_free_error()` if !success
+#[no_mangle]
+pub unsafe extern "C" fn atree_search_visit(
+    handle: *const ATreeHandle,
+    context: *mut ATreeSearchContext,
+    builder: *mut c_void,
+    callback: AtreeMatchCallback,
+    user_data: *mut c_void,
+) -> AtreeResult {
+    let callback = match callback {
+        Some(callback) => callback,
+        None => {
+            if !builder.is_null() {
+                drop(Box::from_raw(builder as *mut a_tree::EventBuilder));
+            }
+            return AtreeResult::err("Invalid arguments");
+        }
+    };
+
+    search_matches(handle, context, builder, |matches| {
+        for id in matches {
+            callback(**id, user_data);
+        }
+        AtreeResult::ok()
+    })
+}
+
+unsafe fn search_matches<F>(
+    handle: *const ATreeHandle,
+    context: *mut ATreeSearchContext,
+    builder: *mut c_void,
+    f: F,
+) -> AtreeResult
+where
+    F: FnOnce(&[&u64]) -> AtreeResult,
+{
+    if builder.is_null() {
+        return AtreeResult::err("Null pointer provided");
+    }
+    let builder_owned = Box::from_raw(builder as *mut a_tree::EventBuilder);
+    let event = match builder_owned.build() {
+        Ok(e) => e,
+        Err(e) => return AtreeResult::err(&format!("{:?}", e)),
+    };
+    search_event(handle, context, &event, f)
+}
+
+unsafe fn search_event<F>(
+    handle: *const ATreeHandle,
+    context: *mut ATreeSearchContext,
+    event: &a_tree::Event,
+    f: F,
+) -> AtreeResult
+where
+    F: FnOnce(&[&u64]) -> AtreeResult,
+{
+    if handle.is_null() {
+        return AtreeResult::err("Null pointer provided");
+    }
+
+    let handle_ref = &*handle;
+    if context.is_null() {
+        match handle_ref.tree.search(event) {
+            Ok(report) => f(report.matches()),
+            Err(e) => AtreeResult::err(&format!("{:?}", e)),
+        }
+    } else {
+        let context_ref =
+            &mut *ptr::addr_of_mut!((*context).context).cast::<a_tree::SearchContext<'_, u64>>();
+        match handle_ref.tree.search_with(context_ref, event) {
+            Ok(matches) => f(matches),
+            Err(e) => AtreeResult::err(&format!("{:?}", e)),
+        }
+    }
+}
+
+unsafe fn write_matches(
+    matches: &[&u64],
+    buffer: *mut u64,
+    capacity: usize,
+    out_len: *mut usize,
+) -> AtreeResult {
+    *out_len = matches.len();
+    let written = matches.len().min(capacity);
+    for (i, id) in matches[..written].iter().enumerate() {
+        *buffer.add(i) = **id;
+    }
+    if matches.len() > capacity {
+        AtreeResult::err(&format!(
+            "Buffer too small: {} matches for a capacity of {}",
+            matches.len(),
+            capacity
+        ))
+    } else {
+        AtreeResult::ok()
+    }
+}
+
+/// Search the A-Tree without consuming the event builder and write the matching subscription IDs
+/// into a caller-owned buffer.
+///
+/// The builder can then be reset with `atree_event_builder_reset()` and reused for the next event.
+///
+/// # Arguments
+/// * `handle` - Valid ATree handle
+/// * `context` - Search context to reuse, or null to search without one
+/// * `builder` - Event builder (left untouched by this call)
+/// * `buffer` - Array receiving up to `capacity` subscription IDs
+/// * `capacity` - Number of IDs that fit in `buffer`
+/// * `out_len` - Receives the number of matching subscription IDs
+///
+/// # Returns
+/// Result indicating success or failure; if more than `capacity` subscriptions match, the first
+/// `capacity` IDs are written, `out_len` receives the total and an error is returned
+///
+/// # Safety
+/// - `handle` must be a valid pointer returned by `atree_new()`
+/// - `context` must be null or satisfy the requirements of `atree_search_with()`
+/// - `builder` must be a valid pointer returned by `atree_event_builder_new()` for `handle`
+/// - Caller still owns `builder` and must free it with `atree_event_builder_free()`
+/// - `buffer` must point to writable memory for `capacity` u64 values
+/// - `out_len` must point to writable memory for a size_t
+/// - Caller must free result.error_message with `atree_free_error()` if !success
+#[no_mangle]
+pub unsafe extern "C" fn atree_search_reused_into(
+    handle: *const ATreeHandle,
+    context: *mut ATreeSearchContext,
+    builder: *const c_void,
+    buffer: *mut u64,
+    capacity: usize,
+    out_len: *mut usize,
+) -> AtreeResult {
+    if builder.is_null() || out_len.is_null() || (capacity > 0 && buffer.is_null()) {
+        return AtreeResult::err("Invalid arguments");
+    }
+
+    let builder_ref = &*(builder as *const a_tree::EventBuilder);
+    search_event(handle, context, builder_ref.event(), |matches| {
+        write_matches(matches, buffer, capacity, out_len)
+    })
+}
+
+/// Search the A-Tree without consuming the event builder and call a function for each matching
+/// subscription ID.
+///
+/// # Arguments
+/// * `handle` - Valid ATree handle
+/// * `context` - Search context to reuse, or null to search without one
+/// * `builder` - Event builder (left untouched by this call)
+/// * `callback` - Function called with each matching subscription ID and `user_data`
+/// * `user_data` - Pointer passed as is to `callback`
+///
+/// # Returns
+/// Result indicating success or failure
+///
+/// # Safety
+/// - `handle` must be a valid pointer returned by `atree_new()`
+/// - `context` must be null or satisfy the requirements of `atree_search_with()`
+/// - `builder` must be a valid pointer returned by `atree_event_builder_new()` for `handle`
+/// - Caller still owns `builder` and must free it with `atree_event_builder_free()`
+/// - `callback` must not call back into the library with `handle`, `context` or `builder`
+/// - Caller must free result.error_message with `atree_free_error()` if !success
+#[no_mangle]
+pub unsafe extern "C" fn atree_search_reused_visit(
+    handle: *const ATreeHandle,
+    context: *mut ATreeSearchContext,
+    builder: *const c_void,
+    callback: AtreeMatchCallback,
+    user_data: *mut c_void,
+) -> AtreeResult {
+    let callback = match callback {
+        Some(callback) if !builder.is_null() => callback,
+        _ => return AtreeResult::err("Invalid arguments"),
+    };
+
+    let builder_ref = &*(builder as *const a_tree::EventBuilder);
+    search_event(handle, context, builder_ref.event(), |matches| {
+        for id in matches {
+            callback(**id, user_data);
+        }
+        AtreeResult::ok()
+    })
+}
+
+/// Search the A-Tree for the expressions matching each event of a batch.
+///
+/// Each predicate is evaluated once for the whole batch which is faster than searching the
+/// events one after the other.
+///
+/// # Arguments
+/// * `handle` - Valid ATree handle
+/// * `builders` - Array of event builders
+/// * `count` - Number of event builders in the array
+/// * `results` - Array of `count` search results that receives the matches of each event
+///
+/// # Returns
+/// Result indicating success or failure
+///
+/// # Safety
+/// - `handle` must be a valid pointer returned by `atree_new()`
+/// - `builders` must point to `count` pointers returned by `atree_event_builder_new()`
+/// - All the non-null builders will be consumed by this call, even when it fails, and must not be
+///   used after
+/// - `results` must point to writable memory for `count` AtreeSearchResult structs
+/// - On success, caller must free each result with `atree_search_result_free()`
+/// - Caller must free result.error_message with `atree_free_error()` if !success
+#[no_mangle]
+pub unsafe extern "C" fn atree_search_batch(
+    handle: *const ATreeHandle,
+    builders: *const *mut c_void,
+    count: usize,
+    results: *mut AtreeSearchResult,
+) -> AtreeResult {
+    if count > 0 && builders.is_null() {
+        return AtreeResult::err("Invalid arguments");
+    }
+    let builders = if count == 0 {
+        &[][..]
+    } else {
+        slice::from_raw_parts(builders, count)
+    };
+    if handle.is_null()
+        || (count > 0 && results.is_null())
+        || builders.iter().any(|builder| builder.is_null())
+    {
+        // The builders are consumed even when the arguments are invalid.
+        for builder in builders.iter().filter(|builder| !builder.is_null()) {
+            drop(Box::from_raw(*builder as *mut a_tree::EventBuilder));
+        }
+        return AtreeResult::err("Invalid arguments");
+    }
+    if count == 0 {
+        return AtreeResult::ok();
+    }
+
+    let handle_ref = &*handle;
+
+    let mut events = Vec::with_capacity(count);
+    let mut error = None;
+    for builder in builders {
+        let builder_owned = Box::from_raw(*builder as *mut a_tree::EventBuilder);
+        match builder_owned.build() {
+            Ok(event) => events.push(event),
+            Err(e) => {
+                error.get_or_insert_with(|| format!("{:?}", e));
+            }
+        }
+    }
+    if let Some(error) = error {
+        return AtreeResult::err(&error);
+    }
+
+    let reports = match handle_ref.tree.search_batch(&events) {
+        Ok(reports) => reports,
+        Err(e) => return AtreeResult::err(&format!("{:?}", e)),
+    };
+
+    let results = slice::from_raw_parts_mut(results, count);
+    for (result, report) in results.iter_mut().zip(reports) {
+        *result = search_result(report.matches());
+    }
+
+    AtreeResult::ok()
+}
+
+/// Create a batch of events that is filled from columns by `atree_search_columns()`.
+///
+/// The batch keeps its events and their buffers between the searches so that it does not
+/// allocate once it has grown enough.
+///
+/// # Safety
+/// - Caller must free the returned batch with `atree_event_batch_free()`
+#[no_mangle]
+pub unsafe extern "C" fn atree_event_batch_new() -> *mut ATreeEventBatch {
+    Box::into_raw(Box::new(ATreeEventBatch {
+        batch: a_tree::EventBatch::new(),
+    }))
+}
+
+/// Free a batch of events.
+///
+/// # Safety
+/// - `batch` must be a valid pointer returned by `atree_event_batch_new()`
+/// - `batch` must not be used after this call
+#[no_mangle]
+pub unsafe extern "C" fn atree_event_batch_free(batch: *mut ATreeEventBatch) {
+    if !batch.is_null() {
+        drop(Box::from_raw(batch));
+    }
+}
+
+/// Search the A-Tree for the expressions matching each event of a batch laid out as columns.
+///
+/// Each column holds the values of an attribute for all the events as an Arrow array; the
+/// attributes without a column are undefined. The arrays are only read: they are neither copied
+/// nor released. The expected Arrow layouts are:
+/// - `Boolean`: `boolean`
+/// - `Integer`: `int64`
+/// - `Float`: `int64` mantissas sharing the column's `scale`
+/// - `String`: `utf8`
+/// - `IntegerList`: `list<int64>`
+/// - `StringList`: `list<utf8>`
+///
+/// The null values leave the attribute undefined; the null values inside the lists are skipped.
+///
+/// # Arguments
+/// * `handle` - Valid ATree handle
+/// * `batch` - Batch of events reused between the searches
+/// * `columns` - Array of columns, at most one per attribute
+/// * `column_count` - Number of columns in the array
+/// * `rows` - Number of events in the batch
+/// * `results` - Array of `rows` search results that receives the matches of each event
+///
+/// # Returns
+/// Result indicating success or failure
+///
+/// # Safety
+/// - `handle` must be a valid pointer returned by `atree_new()`
+/// - `batch` must be a valid pointer returned by `atree_event_batch_new()`
+/// - `columns` must point to `column_count` AtreeColumn structs whose arrays are valid and hold
+///   at least `rows` values
+/// - `results` must point to writable memory for `rows` AtreeSearchResult structs
+/// - On success, caller must free each result with `atree_search_result_free()`
+/// - Caller must free result.error_message with `atree_free_error()` if !success
+#[no_mangle]
+pub unsafe extern "C" fn atree_search_columns(
+    handle: *const ATreeHandle,
+    batch: *mut ATreeEventBatch,
+    columns: *const AtreeColumn,
+    column_count: usize,
+    rows: usize,
+    results: *mut AtreeSearchResult,
+) -> AtreeResult {
+    if handle.is_null()
+        || batch.is_null()
+        || (column_count > 0 && columns.is_null())
+        || (rows > 0 && results.is_null())
+    {
+        return AtreeResult::err("Invalid arguments");
+    }
+
+    let handle_ref = &*handle;
+    let batch_ref = &mut (*batch).batch;
+    let columns = if column_count == 0 {
+        &[]
+    } else {
+        slice::from_raw_parts(columns, column_count)
+    };
+    let columns = match columns
+        .iter()
+        .map(|column| arrow_column(column, rows))
+        .collect::<Result<Vec<_>, _>>()
+    {
+        Ok(columns) => columns,
+        Err(e) => return AtreeResult::err(&e),
+    };
+
+    let reports = match handle_ref.tree.search_columns(batch_ref, rows, &columns) {
+        Ok(reports) => reports,
+        Err(e) => return AtreeResult::err(&format!("{:?}", e)),
+    };
+
+    if rows > 0 {
+        let results = slice::from_raw_parts_mut(results, rows);
+        for (result, report) in results.iter_mut().zip(reports) {
+            *result = search_result(report.matches());
+        }
+    }
+
+    AtreeResult::ok()
+}
+
+fn search_result(matches: &[&u64]) -> AtreeSearchResult {
+    if matches.is_empty() {
+        AtreeSearchResult {
+            ids: ptr::null_mut(),
+            count: 0,
+        }
+    } else {
+        let matches: Vec<u64> = matches.iter().map(|&&id| id).collect();
+        let count = matches.len();
+        let boxed = matches.into_boxed_slice();
+        let ptr = Box::into_raw(boxed) as *mut u64;
+        AtreeSearchResult { ids: ptr, count }
+    }
+}
+
+/// Borrow the buffers of an Arrow array as a column holding `rows` values.
+unsafe fn arrow_column<'a>(column: &AtreeColumn, rows: usize) -> Result<a_tree::Column<'a>, String> {
+    let attribute = column.attribute.into();
+    let array = arrow_array(column.array, rows)?;
+    let (length, offset) = (array.length as usize, array.offset as usize);
+
+    let values = match column.attr_type {
+        AtreeAttributeType::Boolean => {
+            expect_layout(array, 2, 0)?;
+            a_tree::Column::boolean(attribute, bitmap(array, 1)?.ok_or("Missing boolean values")?)
+        }
+        AtreeAttributeType::Integer => {
+            expect_layout(array, 2, 0)?;
+            a_tree::Column::integer(attribute, &arrow_buffer::<i64>(array, 1, offset + length)?[offset..])
+        }
+        AtreeAttributeType::Float => {
+            expect_layout(array, 2, 0)?;
+            let numbers = &arrow_buffer::<i64>(array, 1, offset + length)?[offset..];
+            a_tree::Column::float(attribute, numbers, column.scale)
+        }
+        AtreeAttributeType::String => {
+            expect_layout(array, 3, 0)?;
+            a_tree::Column::string(attribute, string_array(array)?)
+        }
+        AtreeAttributeType::IntegerList => {
+            expect_layout(array, 2, 1)?;
+            let offsets = &arrow_buffer::<i32>(array, 1, offset + length + 1)?[offset..];
+            let child = arrow_array(*array.children, 0)?;
+            expect_layout(child, 2, 0)?;
+            let (child_length, child_offset) = (child.length as usize, child.offset as usize);
+            let values = &arrow_buffer::<i64>(child, 1, child_offset + child_length)?[child_offset..];
+            let mut values = a_tree::IntegerArray::new(values);
+            if let Some(validity) = bitmap(child, 0)? {
+                values = values.with_validity(validity);
+            }
+            a_tree::Column::integer_list(attribute, offsets, values)
+        }
+        AtreeAttributeType::StringList => {
+            expect_layout(array, 2, 1)?;
+            let offsets = &arrow_buffer::<i32>(array, 1, offset + length + 1)?[offset..];
+            let child = arrow_array(*array.children, 0)?;
+            expect_layout(child, 3, 0)?;
+            a_tree::Column::string_list(attribute, offsets, string_array(child)?)
+        }
+    };
+
+    Ok(match bitmap(array, 0)? {
+        Some(validity) if array.null_count != 0 => values.with_validity(validity),
+        _ => values,
+    })
+}
+
+unsafe fn arrow_array<'a>(array: *const ArrowArray, rows: usize) -> Result<&'a ArrowArray, String> {
+    if array.is_null() {
+        return Err("Null pointer provided for an Arrow array".to_string());
+    }
+    let array = &*array;
+    if array.release.is_none() {
+        return Err("The Arrow array has been released".to_string());
+    }
+    if array.length < 0 || array.offset < 0 || (array.length as u64) < rows as u64 {
+        return Err(format!(
+            "The Arrow array holds {} values for a batch of {} events",
+            array.length, rows
+        ));
+    }
+    Ok(array)
+}
+
+fn expect_layout(array: &ArrowArray, buffers: i64, children: i64) -> Result<(), String> {
+    if array.n_buffers != buffers
+        || array.n_children != children
+        || array.buffers.is_null()
+        || (children > 0 && array.children.is_null())
+    {
+        return Err(format!(
+            "Unexpected Arrow layout: {} buffers and {} children instead of {} and {}",
+            array.n_buffers, array.n_children, buffers, children
+        ));
+    }
+    Ok(())
+}
+
+unsafe fn arrow_buffer<'a, T>(array: &ArrowArray, index: usize, length: usize) -> Result<&'a [T], String> {
+    if length == 0 {
+        return Ok(&[]);
+    }
+    let buffer = *array.buffers.add(index) as *const T;
+    if buffer.is_null() || buffer.align_offset(std::mem::align_of::<T>()) != 0 {
+        return Err(format!("Missing or misaligned Arrow buffer {}", index));
+    }
+    Ok(slice::from_raw_parts(buffer, length))
+}
+
+unsafe fn bitmap<'a>(array: &ArrowArray, index: usize) -> Result<Option<a_tree::Bitmap<'a>>, String> {
+    if (*array.buffers.add(index)).is_null() {
+        return Ok(None);
+    }
+    let offset = array.offset as usize;
+    let bytes = arrow_buffer::<u8>(array, index, (offset + array.length as usize).div_ceil(8))?;
+    Ok(Some(a_tree::Bitmap::new(bytes, offset)))
+}
+
+unsafe fn string_array<'a>(array: &ArrowArray) -> Result<a_tree::StringArray<'a>, String> {
+    let (length, offset) = (array.length as usize, array.offset as usize);
+    let offsets = &arrow_buffer::<i32>(array, 1, offset + length + 1)?[offset..];
+    let data_length = usize::try_from(offsets[length]).map_err(|_| "Negative Arrow offset".to_string())?;
+    let mut values = a_tree::StringArray::new(offsets, arrow_buffer::<u8>(array, 2, data_length)?);
+    if let Some(validity) = bitmap(array, 0)? {
+        values = values.with_validity(validity);
+    }
+    Ok(values)
+}
+
+/// Free a search result.
+///
+/// # Safety
+/// - `result` must be a valid search result returned by `atree_search()`, `atree_search_with()`,
+///   `atree_search_batch()` or `atree_search_columns()`
+/// - `result` must not be used after this call
+#[no_mangle]
+pub unsafe extern "C" fn atree_search_result_free(result: AtreeSearchResult) {
+    if !result.ids.is_null() && result.count > 0 {
+        drop(Box::from_raw(slice::from_raw_parts_mut(
+            result.ids,
+            result.count,
+        )));
+    }
+}
+
+/// Free an error message string.
+///
+/// # Safety
+/// - `error` must be a valid pointer from AtreeResult.error_message
+#[no_mangle]
+pub unsafe extern "C" fn atree_free_error(error: *mut c_char) {
+    if !error.is_null() {
+        drop(CString::from_raw(error));
+    }
+}
+
+/// Free an event builder without using it.
+///
+/// # Safety
+/// - `builder` must be a valid pointer returned by `atree_event_builder_new()`
+#[no_mangle]
+pub unsafe extern "C" fn atree_event_builder_free(builder: *mut c_void) {
+    if !builder.is_null() {
+        drop(Box::from_raw(builder as *mut a_tree::EventBuilder));
+    }
+}
+
+/// Create a new shared A-Tree that can be searched by many threads while it is updated.
+///
+/// The insertions and deletions are staged and only become visible to the searches once
+/// `atree_shared_publish()` is called. The searches are made on the snapshots returned by
+/// `atree_shared_snapshot()` and never wait on the writers.
+///
+/// # Arguments
+/// * `defs` - Array of attribute definitions
+/// * `count` - Number of definitions in the array
+///
+/// # Returns
+/// Pointer to ATreeSharedHandle on success, null on failure
+///
+/// # Safety
+/// - `defs` must point to valid memory containing `count` AtreeAttributeDef structs
+/// - Each `name` field must be a valid null-terminated C string
+/// - Caller must free the returned handle with `atree_shared_free()`
+#[no_mangle]
+pub unsafe extern "C" fn atree_shared_new(
+    defs: *const AtreeAttributeDef,
+    count: usize,
+) -> *mut ATreeSharedHandle {
+    if defs.is_null() || count == 0 {
+        return ptr::null_mut();
+    }
+
+    match attribute_definitions(defs, count).and_then(|attr_defs| SharedATree::<u64>::new(&attr_defs).ok()) {
+        Some(tree) => Box::into_raw(Box::new(ATreeSharedHandle { tree })),
+        _ => ptr::null_mut(),
+    }
+}
+
+/// Free a shared A-Tree handle.
+///
+/// # Safety
+/// - `handle` must be a valid pointer returned by `atree_shared_new()`
+/// - All the snapshots of `handle` must have been freed
+/// - `handle` must not be used after this call
+#[no_mangle]
+pub unsafe extern "C" fn atree_shared_free(handle: *mut ATreeSharedHandle) {
+    if !handle.is_null() {
+        drop(Box::from_raw(handle));
+    }
+}
+
+/// Stage the insertion of a boolean expression in a shared A-Tree.
+///
+/// This function is thread-safe; the expression is only matched by the searches once
+/// `atree_shared_publish()` is called.
+///
+/// # Arguments
+/// * `handle` - Valid shared ATree handle
+/// * `subscription_id` - Unique ID for this subscription
+/// * `expression` - Null-terminated boolean expression string
+///
+/// # Returns
+/// Result indicating success or failure
+///
+/// # Safety
+/// - `handle` must be a valid pointer returned by `atree_shared_new()`
+/// - `expression` must be a valid null-terminated C string
+/// - Caller must free result.error_message with `atree_free_error()` if !success
+#[no_mangle]
+pub unsafe extern "C" fn atree_shared_insert(
+    handle: *const ATreeSharedHandle,
+    subscription_id: u64,
+    expression: *const c_char,
+) -> AtreeResult {
+    if handle.is_null() || expression.is_null() {
+        return AtreeResult::err("Invalid arguments");
+    }
+
+    let expr_str = match CStr::from_ptr(expression).to_str() {
+        Ok(s) => s,
+        Err(_) => return AtreeResult::err("Invalid UTF-8 in expression"),
+    };
+
+    let handle_ref = &*handle;
+    match handle_ref.tree.insert(&subscription_id, expr_str) {
+        Ok(_) => AtreeResult::ok(),
+        Err(e) => AtreeResult::err(&format!("{:?}", e)),
+    }
+}
+
+/// Stage the deletion of a subscription from a shared A-Tree.
+///
+/// This function is thread-safe; the subscription keeps being matched by the searches until
+/// `atree_shared_publish()` is called.
+///
+/// # Arguments
+/// * `handle` - Valid shared ATree handle
+/// * `subscription_id` - ID of the subscription to delete
+///
+/// # Safety
+/// - `handle` must be a valid pointer returned by `atree_shared_new()`
+#[no_mangle]
+pub unsafe extern "C" fn atree_shared_delete(
+    handle: *const ATreeSharedHandle,
+    subscription_id: u64,
+) {
+    if handle.is_null() {
+        return;
+    }
+
+    let handle_ref = &*handle;
+    handle_ref.tree.delete(&subscription_id);
+}
+
+/// Make the staged insertions and deletions of a shared A-Tree visible to the searches.
+///
+/// This function is thread-safe. It waits for the snapshots taken before the previous publish
+/// to be freed.
+///
+/// # Safety
+/// - `handle` must be a valid pointer returned by `atree_shared_new()`
+/// - The calling thread must not hold a snapshot of `handle`
+#[no_mangle]
+pub unsafe extern "C" fn atree_shared_publish(handle: *const ATreeSharedHandle) {
+    if handle.is_null() {
+        return;
+    }
+
+    let handle_ref = &*handle;
+    handle_ref.tree.publish();
+}
+
+/// Take a snapshot of a shared A-Tree to search it.
+///
+/// Taking a snapshot never blocks. The snapshot does not see the writes that are published
+/// afterwards and it delays the next publish until it is freed, so it should be short-lived.
+///
+/// # Returns
+/// Pointer to ATreeSnapshot on success, null on failure
+///
+/// # Safety
+/// - `handle` must be a valid pointer returned by `atree_shared_new()`
+/// - Caller must free the returned snapshot with `atree_snapshot_free()` before freeing `handle`
+#[no_mangle]
+pub unsafe extern "C" fn atree_shared_snapshot(
+    handle: *const ATreeSharedHandle,
+) -> *mut ATreeSnapshot {
+    if handle.is_null() {
+        return ptr::null_mut();
+    }
+
+    let handle_ref = &*handle;
+    let guard = handle_ref.tree.read();
+    // SAFETY: the caller frees the snapshot before the shared tree.
+    let guard =
+        std::mem::transmute::<a_tree::ReadGuard<'_, u64>, a_tree::ReadGuard<'static, u64>>(guard);
+    Box::into_raw(Box::new(ATreeSnapshot { guard }))
+}
+
+/// Get the tree of a snapshot.
+///
+/// The returned handle can be used with all the functions that do not modify the tree (e.g.
+/// `atree_event_builder_new()`, `atree_search()`, `atree_search_with()`, `atree_search_batch()`
+/// and `atree_to_graphviz()`).
+///
+/// # Returns
+/// Pointer to the ATreeHandle of the snapshot, null on failure
+///
+/// # Safety
+/// - `snapshot` must be a valid pointer returned by `atree_shared_snapshot()`
+/// - The returned handle must not be used after `snapshot` is freed and must not be freed with
+///   `atree_free()`
+#[no_mangle]
+pub unsafe extern "C" fn atree_snapshot_tree(snapshot: *const ATreeSnapshot) -> *const ATreeHandle {
+    if snapshot.is_null() {
+        return ptr::null();
+    }
+
+    let tree: &ATree<u64> = &(*snapshot).guard;
+    // SAFETY: `ATreeHandle` is a transparent wrapper around the tree.
+    (tree as *const ATree<u64>).cast::<ATreeHandle>()
+}
+
+/// Free a snapshot of a shared A-Tree.
+///
+/// # Safety
+/// - `snapshot` must be a valid pointer returned by `atree_shared_snapshot()`
+/// - `snapshot` must not be used after this call
+#[no_mangle]
+pub unsafe extern "C" fn atree_snapshot_free(snapshot: *mut ATreeSnapshot) {
+    if !snapshot.is_null() {
+        drop(Box::from_raw(snapshot));
+    }
+}
+
+/// Create a new A-Tree partitioned in shards along with the pool of threads that searches them.
+///
+/// The subscriptions are assigned to the shards by the hash of their IDs. The shard `i` is always
+/// searched (and built by `atree_sharded_insert_batch()`) by the thread `i % threads` of the pool
+/// so that pinning the threads with `atree_sharded_pin_thread()` keeps the shards on the NUMA node
+/// of their thread. The threads of the pool run all the work, the calling thread only waits.
+///
+/// # Arguments
+/// * `defs` - Array of attribute definitions
+/// * `count` - Number of definitions in the array
+/// * `shards` - Number of shards (at least one)
+/// * `threads` - Number of worker threads of the pool (at least one)
+///
+/// # Returns
+/// Pointer to ATreeShardedHandle on success, null on failure
+///
+/// # Safety
+/// - `defs` must point to valid memory containing `count` AtreeAttributeDef structs
+/// - Each `name` field must be a valid null-terminated C string
+/// - Caller must free the returned handle with `atree_sharded_free()`
+#[no_mangle]
+pub unsafe extern "C" fn atree_sharded_new(
+    defs: *const AtreeAttributeDef,
+    count: usize,
+    shards: usize,
+    threads: usize,
+) -> *mut ATreeShardedHandle {
+    if defs.is_null() || count == 0 {
+        return ptr::null_mut();
+    }
+
+    match attribute_definitions(defs, count).and_then(|attr_defs| ShardedATree::<u64>::new(&attr_defs, shards).ok()) {
+        Some(tree) => Box::into_raw(Box::new(ATreeShardedHandle {
+            tree,
+            pool: ThreadPool::new(threads),
+        })),
+        _ => ptr::null_mut(),
+    }
+}
+
+/// Free a sharded A-Tree handle and stop the threads of its pool.
+///
+/// # Safety
+/// - `handle` must be a valid pointer returned by `atree_sharded_new()`
+/// - `handle` must not be used after this call
+#[no_mangle]
+pub unsafe extern "C" fn atree_sharded_free(handle: *mut ATreeShardedHandle) {
+    if !handle.is_null() {
+        drop(Box::from_raw(handle));
+    }
+}
+
+/// Get the number of shards of a sharded A-Tree; zero if `handle` is null.
+///
+/// # Safety
+/// - `handle` must be a valid pointer returned by `atree_sharded_new()`
+#[no_mangle]
+pub unsafe extern "C" fn atree_sharded_shards(handle: *const ATreeShardedHandle) -> usize {
+    if handle.is_null() {
+        return 0;
+    }
+
+    (*handle).tree.shards()
+}
+
+/// Get the number of threads of the pool of a sharded A-Tree; zero if `handle` is null.
+///
+/// # Safety
+/// - `handle` must be a valid pointer returned by `atree_sharded_new()`
+#[no_mangle]
+pub unsafe extern "C" fn atree_sharded_threads(handle: *const ATreeShardedHandle) -> usize {
+    if handle.is_null() {
+        return 0;
+    }
+
+    (*handle).pool.threads()
+}
+
+/// Restrict a thread of the pool of a sharded A-Tree to the specified CPUs.
+///
+/// Pinning the threads before inserting the expressions with `atree_sharded_insert_batch()`
+/// allocates the memory of their shards on the NUMA node of their CPUs. Pinning is only
+/// supported on Linux.
+///
+/// # Arguments
+/// * `handle` - Valid sharded ATree handle
+/// * `thread` - Index of the worker thread, below `atree_sharded_threads()`
+/// * `cpus` - Array of CPU indexes
+/// * `cpu_count` - Number of CPU indexes in the array
+///
+/// # Returns
+/// Result indicating success or failure
+///
+/// # Safety
+/// - `handle` must be a valid pointer returned by `atree_sharded_new()`
+/// - `cpus` must point to `cpu_count` size_t values
+/// - Caller must free result.error_message with `atree_free_error()` if !success
+#[no_mangle]
+pub unsafe extern "C" fn atree_sharded_pin_thread(
+    handle: *const ATreeShardedHandle,
+    thread: usize,
+    cpus: *const usize,
+    cpu_count: usize,
+) -> AtreeResult {
+    if handle.is_null() || cpus.is_null() || cpu_count == 0 {
+        return AtreeResult::err("Invalid arguments");
+    }
+
+    let cpus = slice::from_raw_parts(cpus, cpu_count);
+    match (*handle).pool.pin(thread, cpus) {
+        Ok(()) => AtreeResult::ok(),
+        Err(e) => AtreeResult::err(&e.to_string()),
+    }
+}
+
+/// Insert a boolean expression in the shard of its subscription.
+///
+/// # Arguments
+/// * `handle` - Valid sharded ATree handle
+/// * `subscription_id` - Unique ID for this subscription
+/// * `expression` - Null-terminated boolean expression string
+///
+/// # Returns
+/// Result indicating success or failure
+///
+/// # Safety
+/// - `handle` must be a valid pointer returned by `atree_sharded_new()`
+/// - `expression` must be a valid null-terminated C string
+/// - Caller must free result.error_message with `atree_free_error()` if !success
+#[no_mangle]
+pub unsafe extern "C" fn atree_sharded_insert(
+    handle: *mut ATreeShardedHandle,
+    subscription_id: u64,
+    expression: *const c_char,
+) -> AtreeResult {
+    if handle.is_null() || expression.is_null() {
+        return AtreeResult::err("Invalid arguments");
+    }
+
+    let expr_str = match CStr::from_ptr(expression).to_str() {
+        Ok(s) => s,
+        Err(_) => return AtreeResult::err("Invalid UTF-8 in expression"),
+    };
+
+    let handle_ref = &mut *handle;
+    match handle_ref.tree.insert(&subscription_id, expr_str) {
+        Ok(_) => AtreeResult::ok(),
+        Err(e) => AtreeResult::err(&format!("{:?}", e)),
+    }
+}
+
+/// Insert many boolean expressions at once; each shard is built by the thread that searches it.
+///
+/// All the expressions are parsed before any of them is inserted; if one of them is invalid,
+/// none of them is inserted.
+///
+/// # Arguments
+/// * `handle` - Valid sharded ATree handle
+/// * `subscription_ids` - Array of unique IDs, one per expression
+/// * `expressions` - Array of null-terminated boolean expression strings
+/// * `count` - Number of entries in both arrays
+///
+/// # Returns
+/// Result indicating success or failure
+///
+/// # Safety
+/// - `handle` must be a valid pointer returned by `atree_sharded_new()`
+/// - `subscription_ids` must point to `count` u64 values
+/// - `expressions` must point to `count` valid null-terminated C strings
+/// - Caller must free result.error_message with `atree_free_error()` if !success
+#[no_mangle]
+pub unsafe extern "C" fn atree_sharded_insert_batch(
+    handle: *mut ATreeShardedHandle,
+    subscription_ids: *const u64,
+    expressions: *const *const c_char,
+    count: usize,
+) -> AtreeResult {
+    if handle.is_null() || (count > 0 && (subscription_ids.is_null() || expressions.is_null())) {
+        return AtreeResult::err("Invalid arguments");
+    }
+    if count == 0 {
+        return AtreeResult::ok();
+    }
+
+    let ids_slice = slice::from_raw_parts(subscription_ids, count);
+    let expressions_slice = slice::from_raw_parts(expressions, count);
+    let mut entries = Vec::with_capacity(count);
+    for (&id, &expression) in ids_slice.iter().zip(expressions_slice) {
+        if expression.is_null() {
+            return AtreeResult::err("Null pointer in expressions");
+        }
+        match CStr::from_ptr(expression).to_str() {
+            Ok(s) => entries.push((id, s)),
+            Err(_) => return AtreeResult::err("Invalid UTF-8 in expression"),
+        }
+    }
+
+    let handle_ref = &mut *handle;
+    match handle_ref.tree.insert_bulk(entries, &handle_ref.pool) {
+        Ok(_) => AtreeResult::ok(),
+        Err(e) => AtreeResult::err(&format!("{:?}", e)),
+    }
+}
+
+/// Delete a subscription by ID from its shard.
+///
+/// # Arguments
+/// * `handle` - Valid sharded ATree handle
+/// * `subscription_id` - ID of the subscription to delete
+///
+/// # Safety
+/// - `handle` must be a valid pointer returned by `atree_sharded_new()`
+#[no_mangle]
+pub unsafe extern "C" fn atree_sharded_delete(
+    handle: *mut ATreeShardedHandle,
+    subscription_id: u64,
+) {
+    if handle.is_null() {
+        return;
+    }
+
+    let handle_ref = &mut *handle;
+    handle_ref.tree.delete(&subscription_id);
+}
+
+/// Get a shard of a sharded A-Tree.
+///
+/// The returned handle can be used with all the functions that do not modify the tree (e.g.
+/// `atree_memory_usage()`). The shards share the same string IDs, so the event builders created
+/// by `atree_event_builder_new()` for any of them can be searched with
+/// `atree_sharded_search_visit()`.
+///
+/// # Returns
+/// Pointer to the ATreeHandle of the shard, null if `handle` is null or `index` is out of range
+///
+/// # Safety
+/// - `handle` must be a valid pointer returned by `atree_sharded_new()`
+/// - The returned handle must not be used after `handle` is modified or freed and must not be
+///   freed with `atree_free()`
+#[no_mangle]
+pub unsafe extern "C" fn atree_sharded_shard(
+    handle: *const ATreeShardedHandle,
+    index: usize,
+) -> *const ATreeHandle {
+    if handle.is_null() || index >= (*handle).tree.shards() {
+        return ptr::null();
+    }
+
+    let tree: &ATree<u64> = (*handle).tree.shard(index);
+    // SAFETY: `ATreeHandle` is a transparent wrapper around the tree.
+    (tree as *const ATree<u64>).cast::<ATreeHandle>()
+}
+
+/// Search every shard of a sharded A-Tree over the threads of its pool and hand each matching
+/// subscription ID to a callback.
+///
+/// The searches of the same handle can be made from many threads at the same time.
+///
+/// # Arguments
+/// * `handle` - Valid sharded ATree handle
+/// * `builder` - Event builder of one of the shards (consumed by this call)
+/// * `callback` - Function called with each matching subscription ID and `user_data`
+/// * `user_data` - Pointer passed as is to `callback`
+///
+/// # Returns
+/// Result indicating success or failure
+///
+/// # Safety
+/// - `handle` must be a valid pointer returned by `atree_sharded_new()`
+/// - `builder` must be a valid pointer returned by `atree_event_builder_new()` for a shard of
+///   `handle`
+/// - `builder` will be consumed by this call and must not be used after
+/// - `callback` must not call back into the library with `handle`
+/// - Caller must free result.error_message with `atree_free_error()` if !success
+#[no_mangle]
+pub unsafe extern "C" fn atree_sharded_search_visit(
+    handle: *const ATreeShardedHandle,
+    builder: *mut c_void,
+    callback: AtreeMatchCallback,
+    user_data: *mut c_void,
+) -> AtreeResult {
+    if builder.is_null() {
+        return AtreeResult::err("Null pointer provided");
+    }
+    let builder_owned = Box::from_raw(builder as *mut a_tree::EventBuilder);
+    let (handle_ref, callback) = match (handle.as_ref(), callback) {
+        (Some(handle_ref), Some(callback)) => (handle_ref, callback),
+        _ => return AtreeResult::err("Invalid arguments"),
+    };
+    let event = match builder_owned.build() {
+        Ok(e) => e,
+        Err(e) => return AtreeResult::err(&format!("{:?}", e)),
+    };
+
+    match handle_ref.tree.search(&event, &handle_ref.pool) {
+        Ok(report) => {
+            for id in report.matches() {
+                callback(**id, user_data);
+            }
+            AtreeResult::ok()
+        }
+        Err(e) => AtreeResult::err(&format!("{:?}", e)),
     }
 }
@@ -1,13 +1,22 @@
-use a_tree::{ATree, AttributeDefinition};
-use criterion::{criterion_group, criterion_main, BatchSize, Criterion};
+mod workload;
+
+use a_tree::{ATree, AttributeDefinition, MemoryUsage, ThreadPool};
+use criterion::{criterion_group, criterion_main, BatchSize, BenchmarkId, Criterion, Throughput};
 use itertools::Itertools;
 use serde::Deserialize;
 use std::collections::HashMap;
+use workload::{numbered, Workload, WorkloadConfig};
 
 const AN_EXPRESSION: &str = r#"exchange_id = 1 and deal_ids one of ["deal-1", "deal-2"] and segment_ids one of [1, 2, 3] and country = 'CA' and city in ['QC'] or country = 'US' and city in ['AZ']"#;
 const ID: u64 = 1;
 const AN_ID: &u64 = &ID;
 
+/// The amounts of expressions of the trees built from the generated workloads.
+const TREE_SIZES: [usize; 3] = [1_000, 10_000, 100_000];
+/// The amount of distinct events searched against the trees built from the generated workloads.
+const EVENTS: usize = 256;
+const BATCH_SIZE: usize = 64;
+
 const SEARCH_FILE: &str = include_str!(concat!(
     env!("CARGO_MANIFEST_DIR"),
     "/benches/data/search.json"
@@ -62,6 +71,41 @@ pub fn search(c: &mut Criterion) {
     });
 }
 
+const LIST_SHAPES: [(&str, usize, usize); 3] = [
+    ("small_small", 8, 8),
+    ("small_large", 4, 4096),
+    ("large_large", 1024, 1024),
+];
+
+pub fn list_operators(c: &mut Criterion) {
+    let attributes = [AttributeDefinition::integer_list("segment_ids")];
+    let mut group = c.benchmark_group("list_operators");
+    for operator in ["one of", "all of", "none of"] {
+        for (shape, event_size, expression_size) in LIST_SHAPES {
+            let mut atree = ATree::new(&attributes).unwrap();
+            let segments = (0..expression_size).map(|i| (i * 3).to_string()).join(", ");
+            atree
+                .insert(AN_ID, &format!("segment_ids {operator} [{segments}]"))
+                .unwrap();
+            let mut builder = atree.make_event();
+            let stride = (3 * expression_size / event_size).max(1) as i64;
+            builder
+                .with_integer_list(
+                    "segment_ids",
+                    &(0..event_size as i64).map(|i| i * stride + 1).collect_vec(),
+                )
+                .unwrap();
+            let event = builder.build().unwrap();
+            group.bench_function(format!("{operator}/{shape}"), |b| {
+                b.iter(|| {
+                    let _ = std::hint::black_box(atree.search(&event));
+                })
+            });
+        }
+    }
+    group.finish();
+}
+
 #[derive(Deserialize)]
 struct SearchContent {
     attributes: HashMap<String, AttributeType>,
@@ -151,7 +195,174 @@ pub fn search_with_files(c: &mut Criterion) {
             }
         })
     });
+    let pool = ThreadPool::with_available_parallelism().with_threshold(0);
+    c.bench_function("search_parallel_with_files", |b| {
+        b.iter(|| {
+            for event in &events {
+                let _ = std::hint::black_box(atree.search_parallel(event, &pool));
+            }
+        })
+    });
+}
+
+pub fn bulk_load(c: &mut Criterion) {
+    let mut group = c.benchmark_group("bulk_load");
+    group.sample_size(10);
+    for size in TREE_SIZES {
+        let mut workload = Workload::new(WorkloadConfig::default());
+        let definitions = workload.definitions();
+        let expressions = workload.expressions(size);
+        group.throughput(Throughput::Elements(size as u64));
+        group.bench_with_input(
+            BenchmarkId::new("insert_bulk", size),
+            &expressions,
+            |b, expressions| {
+                b.iter_batched(
+                    || ATree::new(&definitions).unwrap(),
+                    |mut atree| {
+                        atree.insert_bulk(numbered(expressions)).unwrap();
+                        atree
+                    },
+                    BatchSize::LargeInput,
+                )
+            },
+        );
+        group.bench_with_input(
+            BenchmarkId::new("insert_bulk_parallel", size),
+            &expressions,
+            |b, expressions| {
+                b.iter_batched(
+                    || ATree::new(&definitions).unwrap(),
+                    |mut atree| {
+                        atree.insert_bulk_parallel(numbered(expressions)).unwrap();
+                        atree
+                    },
+                    BatchSize::LargeInput,
+                )
+            },
+        );
+    }
+    group.finish();
+}
+
+pub fn search_generated(c: &mut Criterion) {
+    let mut group = c.benchmark_group("search_generated");
+    group.throughput(Throughput::Elements(1));
+    for size in TREE_SIZES {
+        let mut workload = Workload::new(WorkloadConfig::default());
+        let atree = workload.tree(size);
+        let events = workload.events(&atree, EVENTS);
+        let mut context = atree.make_search_context();
+        let mut events = events.iter().cycle();
+        group.bench_function(BenchmarkId::from_parameter(size), |b| {
+            b.iter(|| {
+                let event = events.next().unwrap();
+                std::hint::black_box(atree.search_with(&mut context, event).unwrap().len())
+            })
+        });
+    }
+    group.finish();
+}
+
+pub fn search_batch_generated(c: &mut Criterion) {
+    let mut group = c.benchmark_group("search_batch_generated");
+    group.throughput(Throughput::Elements(BATCH_SIZE as u64));
+    for size in TREE_SIZES {
+        let mut workload = Workload::new(WorkloadConfig::default());
+        let atree = workload.tree(size);
+        let events = workload.events(&atree, BATCH_SIZE);
+        group.bench_function(BenchmarkId::new("search_batch", size), |b| {
+            b.iter(|| std::hint::black_box(atree.search_batch(&events).unwrap()))
+        });
+        // The same events searched one by one, as a baseline for the batch.
+        let mut context = atree.make_search_context();
+        group.bench_function(BenchmarkId::new("search_each", size), |b| {
+            b.iter(|| {
+                for event in &events {
+                    std::hint::black_box(atree.search_with(&mut context, event).unwrap().len());
+                }
+            })
+        });
+    }
+    group.finish();
+}
+
+/// Replace the oldest subscription by a new one and search an event, keeping the size of the
+/// tree steady.
+pub fn churn(c: &mut Criterion) {
+    let mut group = c.benchmark_group("churn");
+    group.throughput(Throughput::Elements(1));
+    for size in TREE_SIZES {
+        let mut workload = Workload::new(WorkloadConfig::default());
+        let mut atree = workload.tree(size);
+        let replacements = workload.expressions(size);
+        let events = workload.events(&atree, EVENTS);
+        let mut oldest = 0usize;
+        group.bench_function(BenchmarkId::from_parameter(size), |b| {
+            b.iter(|| {
+                atree.delete(&(oldest as u64));
+                atree
+                    .insert(&((oldest + size) as u64), &replacements[oldest % size])
+                    .unwrap();
+                oldest += 1;
+                let event = &events[oldest % events.len()];
+                std::hint::black_box(atree.search(event).unwrap().matches().len())
+            })
+        });
+    }
+    group.finish();
+}
+
+/// Report the memory used by the trees and measure the compaction after deleting half of their
+/// expressions.
+pub fn memory(c: &mut Criterion) {
+    let mut group = c.benchmark_group("memory");
+    group.sample_size(10);
+    for size in TREE_SIZES {
+        let mut workload = Workload::new(WorkloadConfig::default());
+        let mut atree = workload.tree(size);
+        report_memory(size, "loaded", size, atree.memory_usage());
+        for id in (0..size as u64).step_by(2) {
+            atree.delete(&id);
+        }
+        let remaining = size / 2;
+        report_memory(size, "half deleted", remaining, atree.memory_usage());
+        let mut compacted = atree.clone();
+        compacted.compact();
+        report_memory(size, "compacted", remaining, compacted.memory_usage());
+
+        group.bench_with_input(BenchmarkId::new("compact", size), &atree, |b, atree| {
+            b.iter_batched(
+                || atree.clone(),
+                |mut atree| {
+                    atree.compact();
+                    atree
+                },
+                BatchSize::LargeInput,
+            )
+        });
+    }
+    group.finish();
+}
+
+fn report_memory(size: usize, stage: &str, expressions: usize, usage: MemoryUsage) {
+    eprintln!(
+        "memory/{size}/{stage}: {} bytes, {} bytes per expression ({usage:?})",
+        usage.total(),
+        usage.total() / expressions.max(1)
+    );
 }
 
-criterion_group!(benches, insert_expression, search, search_with_files);
+criterion_group!(
+    benches,
+    insert_expression,
+    search,
+    list_operators,
+    search_with_files,
+    bulk_load,
+    search_generated,
+    search_batch_generated,
+    churn,
+    memory
+);
 criterion_main!(benches);
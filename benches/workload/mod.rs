@@ -0,0 +1,296 @@
+//! A generator of synthetic workloads for the benchmarks.
+//!
+//! The expressions and the events are drawn from a seeded pseudo-random generator so that every
+//! run measures the same workload. The values of the attributes (and the attributes referenced by
+//! the expressions) follow a Zipfian distribution like the segments, the deals and the countries
+//! of real traffic do, and a share of the subexpressions is drawn from a pool common to all the
+//! expressions so that the tree has shared nodes to reuse.
+//!
+//! The C++ benchmarks of `a-tree-ffi` port the same generator so that their workloads match.
+use a_tree::{ATree, AttributeDefinition, Event};
+
+/// The parameters of a workload.
+#[derive(Clone, Debug)]
+pub struct WorkloadConfig {
+    /// The amount of attributes; their types cycle through the ones of [`AttributeKind`].
+    pub attributes: usize,
+    /// The amount of distinct values of each attribute.
+    pub cardinality: usize,
+    /// The exponent of the Zipfian distribution of the values; `0.0` draws them uniformly.
+    pub skew: f64,
+    /// The exponent of the Zipfian distribution of the attributes referenced by the predicates.
+    pub attribute_skew: f64,
+    /// The depth of the expressions; `1` makes expressions of a single predicate.
+    pub depth: usize,
+    /// The size of the lists of the expressions and of the events.
+    pub list_size: usize,
+    /// The share, from `0.0` to `1.0`, of the subexpressions drawn from the common pool.
+    pub shared: f64,
+    /// The amount of subexpressions in the common pool.
+    pub pool_size: usize,
+    /// The seed of the pseudo-random generator.
+    pub seed: u64,
+}
+
+impl Default for WorkloadConfig {
+    fn default() -> Self {
+        Self {
+            attributes: 16,
+            cardinality: 1_000,
+            skew: 1.0,
+            attribute_skew: 0.5,
+            depth: 3,
+            list_size: 4,
+            shared: 0.3,
+            pool_size: 256,
+            seed: 0x5eed,
+        }
+    }
+}
+
+#[derive(Clone, Copy, Debug)]
+enum AttributeKind {
+    Integer,
+    String,
+    IntegerList,
+    StringList,
+    Boolean,
+}
+
+const KINDS: [AttributeKind; 5] = [
+    AttributeKind::Integer,
+    AttributeKind::String,
+    AttributeKind::IntegerList,
+    AttributeKind::StringList,
+    AttributeKind::Boolean,
+];
+
+pub struct Workload {
+    config: WorkloadConfig,
+    random: SplitMix64,
+    attributes: Zipf,
+    values: Zipf,
+    pool: Vec<String>,
+}
+
+impl Workload {
+    pub fn new(config: WorkloadConfig) -> Self {
+        let mut workload = Self {
+            random: SplitMix64(config.seed),
+            attributes: Zipf::new(config.attributes, config.attribute_skew),
+            values: Zipf::new(config.cardinality, config.skew),
+            pool: Vec::with_capacity(config.pool_size),
+            config,
+        };
+        let depth = workload.pool_depth();
+        for _ in 0..workload.config.pool_size {
+            let subexpression = workload.subexpression(depth, false);
+            workload.pool.push(subexpression);
+        }
+        workload
+    }
+
+    pub fn definitions(&self) -> Vec<AttributeDefinition> {
+        (0..self.config.attributes)
+            .map(|index| {
+                let name = name(index);
+                match kind(index) {
+                    AttributeKind::Integer => AttributeDefinition::integer(&name),
+                    AttributeKind::String => AttributeDefinition::string(&name),
+                    AttributeKind::IntegerList => AttributeDefinition::integer_list(&name),
+                    AttributeKind::StringList => AttributeDefinition::string_list(&name),
+                    AttributeKind::Boolean => AttributeDefinition::boolean(&name),
+                }
+            })
+            .collect()
+    }
+
+    /// Generate the next expressions of the workload.
+    pub fn expressions(&mut self, count: usize) -> Vec<String> {
+        (0..count)
+            .map(|_| self.subexpression(self.config.depth, true))
+            .collect()
+    }
+
+    /// Build an [`ATree`] with the next expressions of the workload, their subscription IDs
+    /// being their ranks.
+    pub fn tree(&mut self, size: usize) -> ATree<u64> {
+        let definitions = self.definitions();
+        let mut atree = ATree::new(&definitions).unwrap();
+        let expressions = self.expressions(size);
+        atree.insert_bulk(numbered(&expressions)).unwrap();
+        atree
+    }
+
+    /// Generate the next events of the workload; every attribute is defined.
+    pub fn events(&mut self, atree: &ATree<u64>, count: usize) -> Vec<Event> {
+        (0..count).map(|_| self.event(atree)).collect()
+    }
+
+    fn event(&mut self, atree: &ATree<u64>) -> Event {
+        let mut builder = atree.make_event();
+        for index in 0..self.config.attributes {
+            let name = name(index);
+            match kind(index) {
+                AttributeKind::Integer => builder.with_integer(&name, self.value()).unwrap(),
+                AttributeKind::String => builder.with_string(&name, &self.string()).unwrap(),
+                AttributeKind::IntegerList => {
+                    let values = self.list(|workload| workload.value());
+                    builder.with_integer_list(&name, &values).unwrap()
+                }
+                AttributeKind::StringList => {
+                    let values = self.list(|workload| workload.string());
+                    let values = values.iter().map(String::as_str).collect::<Vec<_>>();
+                    builder.with_string_list(&name, &values).unwrap()
+                }
+                AttributeKind::Boolean => builder
+                    .with_boolean(&name, self.random.below(2) == 0)
+                    .unwrap(),
+            }
+        }
+        builder.build().unwrap()
+    }
+
+    /// The depth of the subexpressions of the pool: the ones right under the root.
+    fn pool_depth(&self) -> usize {
+        self.config.depth.saturating_sub(1).max(1)
+    }
+
+    fn subexpression(&mut self, depth: usize, can_share: bool) -> String {
+        if can_share
+            && depth == self.pool_depth()
+            && !self.pool.is_empty()
+            && self.random.chance(self.config.shared)
+        {
+            let index = self.random.below(self.pool.len() as u64) as usize;
+            return self.pool[index].clone();
+        }
+        if depth <= 1 {
+            return self.predicate();
+        }
+        let left = self.subexpression(depth - 1, can_share);
+        let right = self.subexpression(depth - 1, can_share);
+        let operator = if self.random.chance(0.9) { "and" } else { "or" };
+        format!("({left}) {operator} ({right})")
+    }
+
+    fn predicate(&mut self) -> String {
+        let index = self.attributes.sample(&mut self.random);
+        let name = name(index);
+        let choice = self.random.below(8);
+        match kind(index) {
+            AttributeKind::Integer => match choice {
+                0 => format!("{name} < {}", self.value()),
+                1 => format!("{name} in [{}]", self.integers()),
+                _ => format!("{name} = {}", self.value()),
+            },
+            AttributeKind::String => match choice {
+                0 => format!("{name} in [{}]", self.strings()),
+                _ => format!(r#"{name} = "{}""#, self.string()),
+            },
+            AttributeKind::IntegerList => match choice {
+                0 => format!("{name} none of [{}]", self.integers()),
+                1 => format!("{name} all of [{}]", self.integers()),
+                _ => format!("{name} one of [{}]", self.integers()),
+            },
+            AttributeKind::StringList => match choice {
+                0 => format!("{name} none of [{}]", self.strings()),
+                _ => format!("{name} one of [{}]", self.strings()),
+            },
+            AttributeKind::Boolean => match choice {
+                0 => format!("not {name}"),
+                _ => name,
+            },
+        }
+    }
+
+    fn value(&mut self) -> i64 {
+        self.values.sample(&mut self.random) as i64
+    }
+
+    fn string(&mut self) -> String {
+        format!("value-{}", self.values.sample(&mut self.random))
+    }
+
+    fn list<V>(&mut self, mut generate: impl FnMut(&mut Self) -> V) -> Vec<V> {
+        (0..self.config.list_size).map(|_| generate(self)).collect()
+    }
+
+    fn integers(&mut self) -> String {
+        self.list(|workload| workload.value().to_string())
+            .join(", ")
+    }
+
+    fn strings(&mut self) -> String {
+        self.list(|workload| format!(r#""{}""#, workload.string()))
+            .join(", ")
+    }
+}
+
+/// Pair the expressions with their ranks as their subscription IDs.
+pub fn numbered(expressions: &[String]) -> impl Iterator<Item = (u64, &str)> {
+    expressions
+        .iter()
+        .enumerate()
+        .map(|(id, expression)| (id as u64, expression.as_str()))
+}
+
+fn name(index: usize) -> String {
+    format!("attribute_{index}")
+}
+
+fn kind(index: usize) -> AttributeKind {
+    KINDS[index % KINDS.len()]
+}
+
+/// A small and fast pseudo-random generator that is simple to port to the other benchmarks.
+struct SplitMix64(u64);
+
+impl SplitMix64 {
+    fn next(&mut self) -> u64 {
+        self.0 = self.0.wrapping_add(0x9e37_79b9_7f4a_7c15);
+        let mut z = self.0;
+        z = (z ^ (z >> 30)).wrapping_mul(0xbf58_476d_1ce4_e5b9);
+        z = (z ^ (z >> 27)).wrapping_mul(0x94d0_49bb_1331_11eb);
+        z ^ (z >> 31)
+    }
+
+    /// A number in `[0, 1)`.
+    fn unit(&mut self) -> f64 {
+        (self.next() >> 11) as f64 / (1u64 << 53) as f64
+    }
+
+    fn below(&mut self, bound: u64) -> u64 {
+        self.next() % bound
+    }
+
+    fn chance(&mut self, probability: f64) -> bool {
+        self.unit() < probability
+    }
+}
+
+/// Draws ranks in `[0, n)` where the rank `k` has a probability proportional to `1 / (k + 1)^s`.
+struct Zipf {
+    cumulative: Vec<f64>,
+}
+
+impl Zipf {
+    fn new(n: usize, exponent: f64) -> Self {
+        let mut total = 0.0;
+        let mut cumulative = (1..=n.max(1))
+            .map(|rank| {
+                total += 1.0 / (rank as f64).powf(exponent);
+                total
+            })
+            .collect::<Vec<_>>();
+        cumulative.iter_mut().for_each(|weight| *weight /= total);
+        Self { cumulative }
+    }
+
+    fn sample(&self, random: &mut SplitMix64) -> usize {
+        let needle = random.unit();
+        self.cumulative
+            .partition_point(|weight| *weight <= needle)
+            .min(self.cumulative.len() - 1)
+    }
+}
@@ -1,22 +1,24 @@
-use crate::predicates::Predicate;
+use crate::{predicates::Predicate, strings::StringRemap};
 use std::cmp::{max, min};
 use std::hash::{DefaultHasher, Hash, Hasher};
 
-pub type TreeNode = Box<Node>;
+/// The index of a node in the [`Arena`] it was allocated in.
+pub type NodeRef = u32;
 
 #[derive(PartialEq, Clone, Debug)]
 pub enum Node {
-    And(TreeNode, TreeNode),
-    Or(TreeNode, TreeNode),
-    Not(TreeNode),
+    And(NodeRef, NodeRef),
+    Or(NodeRef, NodeRef),
+    Not(NodeRef),
     Value(Predicate),
 }
 
-#[derive(PartialEq, Clone, Debug)]
-pub enum OptimizedNode {
-    And(Box<OptimizedNode>, Box<OptimizedNode>),
-    Or(Box<OptimizedNode>, Box<OptimizedNode>),
-    Value(Predicate),
+/// A node of an optimized expression, i.e. of an expression without negations.
+#[derive(PartialEq, Clone, Copy, Debug)]
+pub enum OptimizedNode<'a> {
+    And(NodeRef, NodeRef),
+    Or(NodeRef, NodeRef),
+    Value(&'a Predicate),
 }
 
 #[derive(Debug, Hash, Clone, Eq, PartialEq)]
@@ -25,77 +27,180 @@ pub enum Operator {
     Or,
 }
 
-impl OptimizedNode {
+#[derive(Clone, Debug)]
+struct Slot {
+    node: Node,
+    /// The ID of the expression rooted at the node; it is only set once the node is optimized.
+    id: u64,
+    /// The cost of the expression rooted at the node; it is only set once the node is optimized.
+    cost: u64,
+}
+
+/// The buffer in which the nodes of the expressions are allocated while they are inserted.
+///
+/// The parser pushes the nodes one after the other and refers to their children by their
+/// [`NodeRef`] instead of boxing them, and the optimization rewrites them in place. Parsing and
+/// optimizing an expression thus only allocates when the buffer has to grow. An arena is used for
+/// each insertion (or for each chunk of a bulk insertion) and dropped once its expressions are
+/// inserted.
+#[derive(Clone, Debug, Default)]
+pub struct Arena {
+    slots: Vec<Slot>,
+}
+
+impl Arena {
+    /// A low estimate of the length of an expression per node so that reserving the nodes of the
+    /// expressions up front rarely has to grow the buffer afterwards.
+    const BYTES_PER_NODE: usize = 4;
+
+    /// Create an [`Arena`] large enough for expressions of the specified total length.
     #[inline]
-    pub fn id(&self) -> u64 {
-        match self {
-            Self::And(left, right) => {
-                let mut hasher = DefaultHasher::new();
-                Operator::And.hash(&mut hasher);
-
-                let left_id = left.id();
-                let right_id = right.id();
-                min(left_id, right_id).hash(&mut hasher);
-                max(left_id, right_id).hash(&mut hasher);
-                hasher.finish()
-            }
-            Self::Or(left, right) => {
-                let mut hasher = DefaultHasher::new();
-                Operator::Or.hash(&mut hasher);
-
-                let left_id = left.id();
-                let right_id = right.id();
-                min(left_id, right_id).hash(&mut hasher);
-                max(left_id, right_id).hash(&mut hasher);
-                hasher.finish()
-            }
-            Self::Value(node) => node.id(),
+    pub fn for_input(bytes: usize) -> Self {
+        Self {
+            slots: Vec::with_capacity(bytes / Self::BYTES_PER_NODE + 1),
         }
     }
 
     #[inline]
-    pub fn cost(&self) -> u64 {
-        match self {
-            // There is more chance that the evaluation leads to a `false` result which means that
-            // `AND` nodes are usually less expansive since they might be skipped entirely because
-            // of the propagation on demand.
-            Self::And(left, right) => left.cost() + right.cost() + 50,
-            Self::Or(left, right) => left.cost() + right.cost() + 60,
-            Self::Value(node) => node.cost(),
+    pub fn push(&mut self, node: Node) -> NodeRef {
+        let node_ref = self.slots.len() as NodeRef;
+        self.slots.push(Slot {
+            node,
+            id: 0,
+            cost: 0,
+        });
+        node_ref
+    }
+
+    /// The node of an optimized expression.
+    ///
+    /// # Panics
+    ///
+    /// Panics if the node is a negation (i.e. it is not part of an optimized expression).
+    #[inline]
+    pub fn node(&self, node_ref: NodeRef) -> OptimizedNode<'_> {
+        match &self.slots[node_ref as usize].node {
+            Node::And(left, right) => OptimizedNode::And(*left, *right),
+            Node::Or(left, right) => OptimizedNode::Or(*left, *right),
+            Node::Value(predicate) => OptimizedNode::Value(predicate),
+            Node::Not(_) => unreachable!("the optimized expressions do not have negations"),
         }
     }
-}
 
-impl Node {
+    /// The ID of the optimized expression rooted at the node.
     #[inline]
-    pub fn optimize(self) -> OptimizedNode {
-        self.zero_suppression_filter(false)
+    pub fn id(&self, node_ref: NodeRef) -> u64 {
+        self.slots[node_ref as usize].id
     }
 
-    pub fn zero_suppression_filter(self, negate: bool) -> OptimizedNode {
-        match (self, negate) {
-            (Self::And(left, right), true) => OptimizedNode::Or(
-                Box::new(left.zero_suppression_filter(true)),
-                Box::new(right.zero_suppression_filter(true)),
-            ),
-            (Self::Or(left, right), true) => OptimizedNode::And(
-                Box::new(left.zero_suppression_filter(true)),
-                Box::new(right.zero_suppression_filter(true)),
-            ),
-            (Self::Not(value), true) => value.zero_suppression_filter(false),
-            (Self::Not(value), false) => value.zero_suppression_filter(true),
-            (Self::Value(predicate), true) => OptimizedNode::Value(!predicate),
-            (Self::And(left, right), false) => OptimizedNode::And(
-                Box::new(left.zero_suppression_filter(false)),
-                Box::new(right.zero_suppression_filter(false)),
-            ),
-            (Self::Or(left, right), false) => OptimizedNode::Or(
-                Box::new(left.zero_suppression_filter(false)),
-                Box::new(right.zero_suppression_filter(false)),
-            ),
-            (Self::Value(predicate), _) => OptimizedNode::Value(predicate),
+    /// The cost of the optimized expression rooted at the node.
+    #[inline]
+    pub fn cost(&self, node_ref: NodeRef) -> u64 {
+        self.slots[node_ref as usize].cost
+    }
+
+    /// Translate the string IDs of the predicates to the ones of the table their table was
+    /// merged in.
+    pub fn remap_strings(&mut self, remap: &StringRemap) {
+        for slot in &mut self.slots {
+            if let Node::Value(predicate) = &mut slot.node {
+                predicate.remap_strings(remap);
+            }
         }
     }
+
+    /// Optimize the expression rooted at the node and return the root of the optimized
+    /// expression.
+    ///
+    /// The negations are pushed down to the predicates by rewriting the nodes in place and the
+    /// IDs and the costs of the subexpressions are computed from the leaves up along the way.
+    #[inline]
+    pub fn optimize(&mut self, root: NodeRef) -> NodeRef {
+        self.zero_suppression_filter(root, false)
+    }
+
+    fn zero_suppression_filter(&mut self, node_ref: NodeRef, negate: bool) -> NodeRef {
+        let slot = &mut self.slots[node_ref as usize];
+        // `not (a and b)` is `not a or not b` and `not (a or b)` is `not a and not b`.
+        let (is_and, left, right) = match &mut slot.node {
+            Node::Not(value) => {
+                let value = *value;
+                return self.zero_suppression_filter(value, !negate);
+            }
+            Node::Value(predicate) => {
+                if negate {
+                    predicate.negate();
+                }
+                slot.id = predicate.id();
+                slot.cost = predicate.cost();
+                return node_ref;
+            }
+            Node::And(left, right) => (!negate, *left, *right),
+            Node::Or(left, right) => (negate, *left, *right),
+        };
+
+        let left = self.zero_suppression_filter(left, negate);
+        let right = self.zero_suppression_filter(right, negate);
+        let (left_slot, right_slot) = (&self.slots[left as usize], &self.slots[right as usize]);
+        // There is more chance that the evaluation leads to a `false` result which means that
+        // `AND` nodes are usually less expansive since they might be skipped entirely because
+        // of the propagation on demand.
+        let (operator, node, cost) = if is_and {
+            (Operator::And, Node::And(left, right), 50)
+        } else {
+            (Operator::Or, Node::Or(left, right), 60)
+        };
+        self.slots[node_ref as usize] = Slot {
+            id: combine_ids(&operator, left_slot.id, right_slot.id),
+            cost: left_slot.cost + right_slot.cost + cost,
+            node,
+        };
+        node_ref
+    }
+}
+
+#[cfg(test)]
+impl Arena {
+    /// Allocate the nodes of a boxed expression.
+    pub fn push_expression(&mut self, expression: crate::test_utils::Expression) -> NodeRef {
+        use crate::test_utils::Expression;
+        let node = match expression {
+            Expression::And(left, right) => {
+                Node::And(self.push_expression(*left), self.push_expression(*right))
+            }
+            Expression::Or(left, right) => {
+                Node::Or(self.push_expression(*left), self.push_expression(*right))
+            }
+            Expression::Not(value) => Node::Not(self.push_expression(*value)),
+            Expression::Value(predicate) => Node::Value(predicate),
+        };
+        self.push(node)
+    }
+
+    /// The boxed expression rooted at the node.
+    pub fn expression(&self, node_ref: NodeRef) -> crate::test_utils::Expression {
+        use crate::test_utils::Expression;
+        let boxed = |node_ref| Box::new(self.expression(node_ref));
+        match &self.slots[node_ref as usize].node {
+            Node::And(left, right) => Expression::And(boxed(*left), boxed(*right)),
+            Node::Or(left, right) => Expression::Or(boxed(*left), boxed(*right)),
+            Node::Not(value) => Expression::Not(boxed(*value)),
+            Node::Value(predicate) => Expression::Value(predicate.clone()),
+        }
+    }
+}
+
+/// The ID of the expression that combines the expressions of the two IDs with the operator.
+///
+/// The IDs are combined in the same order whatever the order of the operands so that `a and b`
+/// and `b and a` share the same ID.
+#[inline]
+pub fn combine_ids(operator: &Operator, left_id: u64, right_id: u64) -> u64 {
+    let mut hasher = DefaultHasher::new();
+    operator.hash(&mut hasher);
+    min(left_id, right_id).hash(&mut hasher);
+    max(left_id, right_id).hash(&mut hasher);
+    hasher.finish()
 }
 
 #[cfg(test)]
@@ -107,7 +212,7 @@ mod tests {
         predicates::PredicateKind,
         test_utils::{
             ast::{and, not, or, value},
-            optimized_node,
+            optimized_node, Expression,
         },
     };
 
@@ -124,7 +229,7 @@ mod tests {
                 optimized_node::value!(!a_predicate.clone()),
                 optimized_node::value!(a_predicate)
             ),
-            expression.optimize()
+            optimize(expression)
         );
     }
 
@@ -143,7 +248,7 @@ mod tests {
                 optimized_node::value!(!a_predicate.clone()),
                 optimized_node::value!(a_predicate)
             ),
-            expression.optimize()
+            optimize(expression)
         );
     }
 
@@ -153,7 +258,7 @@ mod tests {
         let a_predicate = Predicate::new(&attributes, "private", PredicateKind::Variable).unwrap();
         let expression = not!(value!(a_predicate.clone()));
 
-        assert_eq!(optimized_node::value!(!a_predicate), expression.optimize());
+        assert_eq!(optimized_node::value!(!a_predicate), optimize(expression));
     }
 
     #[test]
@@ -162,7 +267,7 @@ mod tests {
         let a_predicate = Predicate::new(&attributes, "private", PredicateKind::Variable).unwrap();
         let expression = not!(not!(value!(a_predicate.clone())));
 
-        assert_eq!(optimized_node::value!(a_predicate), expression.optimize());
+        assert_eq!(optimized_node::value!(a_predicate), optimize(expression));
     }
 
     #[test]
@@ -197,7 +302,7 @@ mod tests {
                     )
                 )
             ),
-            expression.optimize()
+            optimize(expression)
         );
     }
 
@@ -208,7 +313,7 @@ mod tests {
 
         assert_eq!(
             optimized_node::value!(a_predicate.clone()),
-            value!(a_predicate).optimize()
+            optimize(value!(a_predicate))
         );
     }
 
@@ -223,7 +328,7 @@ mod tests {
                 optimized_node::value!(a_predicate.clone()),
                 optimized_node::value!(a_predicate.clone())
             ),
-            expression.optimize()
+            optimize(expression)
         );
     }
 
@@ -238,7 +343,7 @@ mod tests {
                 optimized_node::value!(a_predicate.clone()),
                 optimized_node::value!(a_predicate.clone())
             ),
-            expression.optimize()
+            optimize(expression)
         );
     }
 
@@ -262,7 +367,7 @@ mod tests {
                 ),
                 optimized_node::value!(a_predicate)
             ),
-            expression.optimize()
+            optimize(expression)
         );
     }
 
@@ -286,7 +391,7 @@ mod tests {
                 ),
                 optimized_node::value!(a_predicate)
             ),
-            expression.optimize()
+            optimize(expression)
         );
     }
 
@@ -305,7 +410,7 @@ mod tests {
             optimized_node::value!(another_predicate)
         );
 
-        assert_ne!(expression.id(), another_expression.id());
+        assert_ne!(id(expression), id(another_expression));
     }
 
     #[test]
@@ -323,7 +428,7 @@ mod tests {
             optimized_node::value!(another_predicate)
         );
 
-        assert_eq!(expression.id(), another_expression.id());
+        assert_eq!(id(expression), id(another_expression));
     }
 
     #[test]
@@ -341,7 +446,21 @@ mod tests {
             optimized_node::value!(a_predicate)
         );
 
-        assert_eq!(expression.id(), another_expression.id());
+        assert_eq!(id(expression), id(another_expression));
+    }
+
+    fn optimize(expression: Expression) -> Expression {
+        let mut arena = Arena::default();
+        let root = arena.push_expression(expression);
+        let root = arena.optimize(root);
+        arena.expression(root)
+    }
+
+    fn id(expression: Expression) -> u64 {
+        let mut arena = Arena::default();
+        let root = arena.push_expression(expression);
+        let root = arena.optimize(root);
+        arena.id(root)
     }
 
     fn define_attributes() -> AttributeTable {
@@ -1,14 +1,50 @@
 use crate::{
     ast::*,
-    error::ATreeError,
-    evaluation::EvaluationResult,
-    events::{AttributeDefinition, AttributeTable, Event, EventBuilder},
+    bulk,
+    columns::{Column, EventBatch},
+    encoding::Persist,
+    error::{ATreeError, SnapshotError},
+    evaluation::{BatchEvaluationResult, EvaluationResult},
+    events::{
+        AttributeDefinition, AttributeHandle, AttributeId, AttributeTable, Event, EventBuilder,
+        EventError,
+    },
+    index::PredicateIndex,
+    mmap::Mmap,
     parser,
-    predicates::Predicate,
-    strings::StringTable,
+    pool::ThreadPool,
+    predicates::{NullOperator, Predicate, PredicateKind},
+    strings::{StringId, StringTable},
 };
 use slab::Slab;
-use std::{collections::HashMap, fmt::Debug, hash::Hash};
+use std::{
+    collections::HashMap,
+    fmt::Debug,
+    hash::Hash,
+    io::{self, Write},
+    ops::Deref,
+    path::Path,
+};
+
+mod cache;
+mod collectors;
+mod delta;
+mod frozen;
+mod memory;
+mod parallel;
+mod snapshot;
+mod statistics;
+#[cfg(feature = "stats")]
+mod stats;
+
+use cache::ExpressionCache;
+use collectors::{Collector, Limit, Probe, Stage, TopK};
+pub use delta::DeltaContext;
+pub use frozen::{FrozenATree, FrozenSearchContext};
+pub use memory::MemoryUsage;
+use statistics::{Outcomes, Sampling};
+#[cfg(feature = "stats")]
+pub use stats::SearchStats;
 
 type NodeId = usize;
 type ExpressionId = u64;
@@ -23,9 +59,13 @@ pub struct ATree<T> {
     nodes: Slab<Entry<T>>,
     strings: StringTable,
     attributes: AttributeTable,
-    roots: Vec<NodeId>,
+    roots: Roots,
     max_level: usize,
-    predicates: Vec<NodeId>,
+    /// The predicates that are evaluated eagerly by the searches.
+    predicates: Predicates,
+    index: Option<PredicateIndex>,
+    sampling: Option<Sampling>,
+    expression_cache: Option<ExpressionCache>,
     expression_to_node: HashMap<ExpressionId, NodeId>,
     nodes_by_ids: HashMap<T, NodeId>,
 }
@@ -67,11 +107,14 @@ impl<T: Eq + Hash + Clone + Debug> ATree<T> {
         let attributes = AttributeTable::new(definitions).map_err(ATreeError::Event)?;
         let strings = StringTable::new();
         Ok(Self {
+            predicates: Predicates::with_capacity(attributes.len(), Self::DEFAULT_PREDICATES),
             attributes,
             strings,
             max_level: 1,
-            roots: Vec::with_capacity(Self::DEFAULT_ROOTS),
-            predicates: Vec::with_capacity(Self::DEFAULT_PREDICATES),
+            roots: Roots::with_capacity(Self::DEFAULT_ROOTS),
+            index: None,
+            sampling: None,
+            expression_cache: None,
             nodes: Slab::with_capacity(Self::DEFAULT_NODES),
             expression_to_node: HashMap::new(),
             nodes_by_ids: HashMap::new(),
@@ -95,36 +138,205 @@ impl<T: Eq + Hash + Clone + Debug> ATree<T> {
     /// ```
     #[inline]
     pub fn insert<'a>(
-        &'a mut self,
+        &mut self,
+        subscription_id: &T,
+        expression: &'a str,
+    ) -> Result<(), ATreeError<'a>> {
+        self.insert_with_priority(subscription_id, expression, 0)
+    }
+
+    /// Insert an arbitrary boolean expression inside the [`ATree`] along with the static priority
+    /// of its subscription that ranks it in the searches made with [`ATree::search_top_k()`].
+    ///
+    /// The subscriptions inserted with [`ATree::insert()`] have the lowest priority (i.e. `0`).
+    ///
+    /// # Examples
+    ///
+    /// ```rust
+    /// use a_tree::{ATree, AttributeDefinition};
+    ///
+    /// let definitions = [AttributeDefinition::integer("exchange_id")];
+    /// let mut atree = ATree::new(&definitions).unwrap();
+    /// atree.insert_with_priority(&1u64, "exchange_id = 5", 10).unwrap();
+    /// atree.insert_with_priority(&2u64, "exchange_id > 1", 20).unwrap();
+    ///
+    /// let mut builder = atree.make_event();
+    /// builder.with_integer("exchange_id", 5).unwrap();
+    /// let report = atree.search_top_k(&builder.build().unwrap(), 1).unwrap();
+    /// assert_eq!(report.matches(), [&2u64]);
+    /// ```
+    pub fn insert_with_priority<'a>(
+        &mut self,
         subscription_id: &T,
         expression: &'a str,
+        priority: u32,
     ) -> Result<(), ATreeError<'a>> {
-        let ast = parser::parse(expression, &self.attributes, &mut self.strings)
+        let key = self.cache_key(expression);
+        if let Some(node_id) = key.and_then(|key| self.cached_node(key)) {
+            self.attach(subscription_id, priority, node_id);
+            return Ok(());
+        }
+
+        let mut arena = Arena::for_input(expression.len());
+        let root = parser::parse(expression, &self.attributes, &mut self.strings, &mut arena)
+            .map_err(ATreeError::ParseError)?;
+        let root = arena.optimize(root);
+        self.insert_root(&arena, subscription_id, root, priority);
+        if let Some(key) = key {
+            self.cache_expression(key, arena.id(root));
+        }
+        Ok(())
+    }
+
+    /// Insert many arbitrary boolean expressions inside the [`ATree`] at once.
+    ///
+    /// All the expressions are parsed and optimized before any of them is inserted; if one of
+    /// them is invalid, an error is returned and none of them is inserted.
+    ///
+    /// # Examples
+    ///
+    /// ```rust
+    /// use a_tree::{ATree, AttributeDefinition};
+    ///
+    /// let definitions = [
+    ///     AttributeDefinition::boolean("private"),
+    ///     AttributeDefinition::integer("exchange_id")
+    /// ];
+    /// let mut atree = ATree::new(&definitions).unwrap();
+    /// let expressions = [(1u64, "exchange_id = 5"), (2u64, "private")];
+    /// assert!(atree.insert_bulk(expressions).is_ok());
+    /// assert!(atree.insert_bulk([(3u64, "exchange_id ="), (4u64, "private")]).is_err());
+    /// ```
+    pub fn insert_bulk<'a, I>(&mut self, expressions: I) -> Result<(), ATreeError<'a>>
+    where
+        I: IntoIterator<Item = (T, &'a str)>,
+    {
+        let batch = self.parse_batch(expressions.into_iter().collect())?;
+        self.insert_batch(batch);
+        Ok(())
+    }
+
+    /// Parse and optimize the expressions of [`ATree::insert_bulk()`] without inserting them.
+    ///
+    /// Only the strings of the expressions are added to the tree so that the batch can be
+    /// dropped if another one fails, as the [`crate::ShardedATree`] does.
+    pub(crate) fn parse_batch<'a>(
+        &mut self,
+        expressions: Vec<(T, &'a str)>,
+    ) -> Result<Batch<T>, ATreeError<'a>> {
+        let length = expressions
+            .iter()
+            .map(|(_, expression)| expression.len())
+            .sum();
+        let mut batch = Batch {
+            arena: Arena::for_input(length),
+            roots: Vec::with_capacity(expressions.len()),
+            cached: vec![],
+            parsed: HashMap::new(),
+        };
+        for (subscription_id, expression) in expressions {
+            let key = self.cache_key(expression);
+            if let Some(key) = key {
+                if let Some(node_id) = self.cached_node(key) {
+                    batch.cached.push((subscription_id, node_id));
+                    continue;
+                }
+                if let Some(root) = batch.parsed.get(&key) {
+                    batch.roots.push((subscription_id, *root));
+                    continue;
+                }
+            }
+            let root = parser::parse(
+                expression,
+                &self.attributes,
+                &mut self.strings,
+                &mut batch.arena,
+            )
             .map_err(ATreeError::ParseError)?;
-        let ast = ast.optimize();
-        self.insert_root(subscription_id, ast);
+            let root = batch.arena.optimize(root);
+            if let Some(key) = key {
+                batch.parsed.insert(key, root);
+            }
+            batch.roots.push((subscription_id, root));
+        }
+        Ok(batch)
+    }
+
+    /// Insert the expressions of a batch returned by [`ATree::parse_batch()`].
+    pub(crate) fn insert_batch(&mut self, batch: Batch<T>) {
+        let Batch {
+            arena,
+            roots,
+            cached,
+            parsed,
+        } = batch;
+        self.insert_roots(&arena, roots);
+        for (subscription_id, node_id) in cached {
+            self.attach(&subscription_id, 0, node_id);
+        }
+        for (key, root) in parsed {
+            self.cache_expression(key, arena.id(root));
+        }
+    }
+
+    /// Insert many arbitrary boolean expressions inside the [`ATree`] at once while parsing and
+    /// optimizing them over all the available cores.
+    ///
+    /// The expressions are then inserted in their order so the resulting [`ATree`] is the same as
+    /// the one built by [`ATree::insert_bulk`]. If one of the expressions is invalid, the error of
+    /// the first invalid one is returned and none of them is inserted.
+    ///
+    /// # Examples
+    ///
+    /// ```rust
+    /// use a_tree::{ATree, AttributeDefinition};
+    ///
+    /// let definitions = [
+    ///     AttributeDefinition::string("country"),
+    ///     AttributeDefinition::integer("exchange_id")
+    /// ];
+    /// let mut atree = ATree::new(&definitions).unwrap();
+    /// let expressions = (0..10_000u64)
+    ///     .map(|i| (i, format!(r#"exchange_id = {i} and country = "C{}""#, i % 100)))
+    ///     .collect::<Vec<_>>();
+    /// let expressions = expressions.iter().map(|(i, expression)| (*i, expression.as_str()));
+    /// assert!(atree.insert_bulk_parallel(expressions).is_ok());
+    /// ```
+    pub fn insert_bulk_parallel<'a, I>(&mut self, expressions: I) -> Result<(), ATreeError<'a>>
+    where
+        T: Send,
+        I: IntoIterator<Item = (T, &'a str)>,
+    {
+        let expressions = expressions.into_iter().collect();
+        let chunks = bulk::parse(expressions, &self.attributes, &mut self.strings)?;
+        for (arena, roots) in chunks {
+            self.insert_roots(&arena, roots);
+        }
         Ok(())
     }
 
-    fn insert_root(&mut self, subscription_id: &T, root: OptimizedNode) {
-        let expression_id = root.id();
+    fn insert_roots(&mut self, arena: &Arena, roots: Vec<(T, NodeRef)>) {
+        self.nodes.reserve(roots.len());
+        self.nodes_by_ids.reserve(roots.len());
+        for (subscription_id, root) in roots {
+            self.insert_root(arena, &subscription_id, root, 0);
+        }
+    }
+
+    fn insert_root(&mut self, arena: &Arena, subscription_id: &T, root: NodeRef, priority: u32) {
+        let expression_id = arena.id(root);
         if let Some(node_id) = self.expression_to_node.get(&expression_id) {
-            add_subscription_id(
-                subscription_id,
-                *node_id,
-                &mut self.nodes,
-                &mut self.nodes_by_ids,
-            );
-            increment_use_count(*node_id, &mut self.nodes);
+            self.attach(subscription_id, priority, *node_id);
             return;
         }
 
-        let is_and = matches!(&root, OptimizedNode::And(_, _));
-        let cost = root.cost();
+        let cost = arena.cost(root);
+        let root = arena.node(root);
+        let is_and = matches!(root, OptimizedNode::And(_, _));
         let node_id = match root {
             OptimizedNode::And(left, right) | OptimizedNode::Or(left, right) => {
-                let left_id = self.insert_node(*left);
-                let right_id = self.insert_node(*right);
+                let left_id = self.insert_node(arena, left);
+                let right_id = self.insert_node(arena, right);
                 let left_entry = &self.nodes[left_id];
                 let right_entry = &self.nodes[right_id];
                 let rnode = ATreeNode::RNode(RNode {
@@ -141,7 +353,7 @@ impl<T: Eq + Hash + Clone + Debug> ATree<T> {
                     &mut self.nodes,
                     &expression_id,
                     rnode,
-                    Some(subscription_id.clone()),
+                    Some((subscription_id.clone(), priority)),
                     cost,
                 );
                 if is_and {
@@ -151,48 +363,94 @@ impl<T: Eq + Hash + Clone + Debug> ATree<T> {
                         node_id,
                         &mut self.nodes,
                         &mut self.predicates,
+                        &mut self.index,
                     );
                 } else {
                     add_parent(&mut self.nodes[left_id], node_id);
                     add_parent(&mut self.nodes[right_id], node_id);
-                    add_predicate(left_id, &self.nodes, &mut self.predicates);
-                    add_predicate(right_id, &self.nodes, &mut self.predicates);
+                    add_predicate(left_id, &self.nodes, &mut self.predicates, &mut self.index);
+                    add_predicate(right_id, &self.nodes, &mut self.predicates, &mut self.index);
                 }
                 node_id
             }
             OptimizedNode::Value(value) => {
-                let lnode = ATreeNode::lnode(&value);
+                let lnode = ATreeNode::lnode(value);
                 let node_id = insert_node(
                     &mut self.expression_to_node,
                     &mut self.nodes,
                     &expression_id,
                     lnode,
-                    Some(subscription_id.clone()),
+                    Some((subscription_id.clone(), priority)),
                     cost,
                 );
-                self.predicates.push(node_id);
+                add_predicate(node_id, &self.nodes, &mut self.predicates, &mut self.index);
                 node_id
             }
         };
+        raise_bound(node_id, priority, &mut self.nodes);
         self.nodes_by_ids.insert(subscription_id.clone(), node_id);
-        self.roots.push(node_id);
-        self.max_level = get_max_level(&self.roots, &self.nodes);
+        self.roots.insert(node_id, self.nodes[node_id].level());
+        self.max_level = self.roots.max_level();
+    }
+
+    /// Subscribe to the expression of an existing node.
+    fn attach(&mut self, subscription_id: &T, priority: u32, node_id: NodeId) {
+        add_subscription_id(
+            subscription_id,
+            priority,
+            node_id,
+            &mut self.nodes,
+            &mut self.nodes_by_ids,
+        );
+        increment_use_count(node_id, &mut self.nodes);
+        raise_bound(node_id, priority, &mut self.nodes);
+        // An existing predicate might have been only reachable through its parents so far
+        // (e.g. the non-access child of an AND node); it has to be evaluated eagerly now that
+        // it has subscribers.
+        add_predicate(node_id, &self.nodes, &mut self.predicates, &mut self.index);
+    }
+
+    /// The key of the expression in the expression cache, if it is enabled.
+    #[inline]
+    fn cache_key(&self, expression: &str) -> Option<u128> {
+        self.expression_cache
+            .as_ref()
+            .and_then(|_| cache::normalize(expression))
+    }
+
+    /// The node of the cached expression, if it was not deleted since it was cached.
+    #[inline]
+    fn cached_node(&mut self, key: u128) -> Option<NodeId> {
+        let cache = self.expression_cache.as_mut()?;
+        let node_id = self.expression_to_node.get(&cache.get(key)?).copied();
+        if node_id.is_none() {
+            cache.remove(key);
+        }
+        node_id
+    }
+
+    #[inline]
+    fn cache_expression(&mut self, key: u128, expression_id: ExpressionId) {
+        if let Some(cache) = self.expression_cache.as_mut() {
+            cache.insert(key, expression_id);
+        }
     }
 
-    fn insert_node(&mut self, node: OptimizedNode) -> NodeId {
-        let expression_id = node.id();
+    fn insert_node(&mut self, arena: &Arena, node_ref: NodeRef) -> NodeId {
+        let expression_id = arena.id(node_ref);
         if let Some(node_id) = self.expression_to_node.get(&expression_id) {
             change_rnode_to_inode(*node_id, &mut self.nodes);
             increment_use_count(*node_id, &mut self.nodes);
             return *node_id;
         }
 
+        let node = arena.node(node_ref);
+        let cost = arena.cost(node_ref);
         let is_and = matches!(node, OptimizedNode::And(_, _));
-        let cost = node.cost();
         match node {
             OptimizedNode::And(left, right) | OptimizedNode::Or(left, right) => {
-                let left_id = self.insert_node(*left);
-                let right_id = self.insert_node(*right);
+                let left_id = self.insert_node(arena, left);
+                let right_id = self.insert_node(arena, right);
                 let left_entry = &self.nodes[left_id];
                 let right_entry = &self.nodes[right_id];
                 let inode = INode {
@@ -221,17 +479,18 @@ impl<T: Eq + Hash + Clone + Debug> ATree<T> {
                         node_id,
                         &mut self.nodes,
                         &mut self.predicates,
+                        &mut self.index,
                     );
                 } else {
                     add_parent(&mut self.nodes[left_id], node_id);
                     add_parent(&mut self.nodes[right_id], node_id);
-                    add_predicate(left_id, &self.nodes, &mut self.predicates);
-                    add_predicate(right_id, &self.nodes, &mut self.predicates);
+                    add_predicate(left_id, &self.nodes, &mut self.predicates, &mut self.index);
+                    add_predicate(right_id, &self.nodes, &mut self.predicates, &mut self.index);
                 }
                 node_id
             }
             OptimizedNode::Value(node) => {
-                let lnode = ATreeNode::lnode(&node);
+                let lnode = ATreeNode::lnode(node);
                 insert_node(
                     &mut self.expression_to_node,
                     &mut self.nodes,
@@ -252,834 +511,2948 @@ impl<T: Eq + Hash + Clone + Debug> ATree<T> {
         EventBuilder::new(&self.attributes, &self.strings)
     }
 
-    /// Search the [`ATree`] for arbitrary boolean expressions that match the [`Event`].
-    pub fn search(&'_ self, event: &Event) -> Result<Report<'_, T>, ATreeError<'_>> {
-        let mut results = EvaluationResult::new(self.nodes.len());
-        let mut matches = Vec::with_capacity(50);
+    /// Resolve the [`AttributeHandle`] of the specified attribute to set it in the events without
+    /// looking up its name.
+    ///
+    /// # Examples
+    ///
+    /// ```rust
+    /// use a_tree::{ATree, AttributeDefinition};
+    ///
+    /// let definitions = [AttributeDefinition::integer_list("segment_ids")];
+    /// let atree = ATree::<u64>::new(&definitions).unwrap();
+    /// let segment_ids = atree.attribute("segment_ids").unwrap();
+    ///
+    /// let mut builder = atree.make_event();
+    /// builder.set_integer_list(segment_ids, &[1, 2, 3]).unwrap();
+    /// assert!(builder.set_integer(segment_ids, 1).is_err());
+    /// assert!(atree.attribute("country").is_err());
+    /// ```
+    #[inline]
+    pub fn attribute(&self, name: &str) -> Result<AttributeHandle, EventError> {
+        self.attributes.handle(name)
+    }
 
-        // Since the predicates will already be evaluated and their parents will be put into the
-        // queues, then there is no need to keep a queue for them.
-        let mut queues = vec![Vec::with_capacity(50); self.max_level - 1];
-        process_predicates(
-            &self.predicates,
-            &self.nodes,
-            event,
-            &mut matches,
-            &mut results,
-            &mut queues,
-        );
+    /// Intern the specified string so that it can be set in the events by its [`StringId`]
+    /// without hashing it again.
+    ///
+    /// The ID stays valid until [`ATree::compact()`] is called, even when expressions that contain
+    /// the string are inserted afterwards. Every interned string is kept by the [`ATree`] until
+    /// then so this is meant for the strings that appear in many events (e.g. a dictionary of deal
+    /// IDs).
+    ///
+    /// # Examples
+    ///
+    /// ```rust
+    /// use a_tree::{ATree, AttributeDefinition};
+    ///
+    /// let definitions = [AttributeDefinition::string_list("deal_ids")];
+    /// let mut atree = ATree::new(&definitions).unwrap();
+    /// let deal = atree.intern("deal-1");
+    /// atree.insert(&1u64, r#"deal_ids one of ["deal-1", "deal-2"]"#).unwrap();
+    /// let deal_ids = atree.attribute("deal_ids").unwrap();
+    ///
+    /// let mut builder = atree.make_event();
+    /// builder.set_string_id_list(deal_ids, &[deal]).unwrap();
+    /// let report = atree.search(&builder.build().unwrap()).unwrap();
+    /// assert_eq!(report.matches(), [&1u64]);
+    /// ```
+    #[inline]
+    pub fn intern(&mut self, value: &str) -> StringId {
+        self.strings.get_or_update(value)
+    }
 
-        for level in 0..queues.len() {
-            while let Some((node_id, node)) = queues[level].pop() {
-                if results.is_evaluated(node_id) {
-                    continue;
-                }
+    /// Build an inverted index over the predicates of the [`ATree`] so that the searches only
+    /// evaluate the predicates that can be true for the [`Event`] instead of all of them.
+    ///
+    /// The index is kept up to date by the subsequent insertions and deletions. This is worth it
+    /// when the [`ATree`] contains a lot of predicates of which only a few can match an event
+    /// (e.g. `exchange_id = 1`, `country in ['CA', 'US']`, `bidfloor < 2.0`, etc.).
+    ///
+    /// # Examples
+    ///
+    /// ```rust
+    /// use a_tree::{ATree, AttributeDefinition};
+    ///
+    /// let definitions = [
+    ///     AttributeDefinition::integer("exchange_id"),
+    ///     AttributeDefinition::string("country"),
+    /// ];
+    /// let mut atree = ATree::new(&definitions).unwrap();
+    /// atree.enable_predicate_index();
+    /// atree.insert(&1u64, "exchange_id = 1 and country in ['CA', 'US']").unwrap();
+    /// atree.insert(&2u64, "exchange_id = 2").unwrap();
+    ///
+    /// let mut builder = atree.make_event();
+    /// builder.with_integer("exchange_id", 1).unwrap();
+    /// builder.with_string("country", "CA").unwrap();
+    /// let event = builder.build().unwrap();
+    ///
+    /// let report = atree.search(&event).unwrap();
+    /// assert_eq!(report.matches(), [&1u64]);
+    /// ```
+    pub fn enable_predicate_index(&mut self) {
+        if self.index.is_some() {
+            return;
+        }
 
-                let result = evaluate_node(
-                    node_id,
-                    event,
-                    node,
-                    &self.nodes,
-                    &mut results,
-                    &mut matches,
-                );
-                add_matches(result, node, &mut matches);
+        let mut index = PredicateIndex::new(self.attributes.len());
+        for predicate_id in self.predicates.iter() {
+            if let Some(predicate) = self.nodes[*predicate_id].node.predicate() {
+                index.insert(*predicate_id, predicate);
+            }
+        }
+        self.index = Some(index);
+    }
 
-                if node.is_root() {
-                    continue;
-                }
+    /// Record the outcomes of the nodes evaluated by one search out of `period` so that
+    /// [`ATree::reoptimize()`] can reorder the nodes based on them.
+    ///
+    /// The outcomes are sampled by the searches made with [`ATree::search()`] and
+    /// [`ATree::search_with()`]; a sampled search pays for walking over the nodes it evaluated
+    /// while the other ones are left untouched. A `period` of `1` samples every search.
+    pub fn enable_outcome_sampling(&mut self, period: u64) {
+        self.sampling = Some(Sampling::new(period));
+    }
 
-                for parent_id in node.parents() {
-                    let entry = &self.nodes[*parent_id];
-                    let is_evaluated = results.is_evaluated(*parent_id);
-                    if !is_evaluated
-                        && matches!(entry.operator(), Operator::And)
-                        && !result.unwrap_or(true)
-                    {
-                        results.set_result(*parent_id, Some(false));
-                        continue;
-                    }
+    /// Stop sampling the outcomes of the searches; the outcomes recorded so far are kept.
+    pub fn disable_outcome_sampling(&mut self) {
+        self.sampling = None;
+    }
 
-                    if !is_evaluated {
-                        queues[entry.level() - 2].push((*parent_id, entry));
-                    }
-                }
-            }
+    /// Cache the inserted expressions by a 128-bit hash of their normalized text so that
+    /// inserting an expression that is already in the [`ATree`] only subscribes to it instead of
+    /// parsing and optimizing it again.
+    ///
+    /// The expressions are normalized by their tokens: they can differ by their whitespace, the
+    /// quotes of their strings, the spelling of their operators (e.g. `&&` or `and`) and the
+    /// order of the terms of a top-level chain of a single operator (e.g. `a and b and c`). The
+    /// other duplicates are still found once parsed.
+    ///
+    /// The cache is filled by the subsequent calls to [`ATree::insert()`],
+    /// [`ATree::insert_with_priority()`] and [`ATree::insert_bulk()`] (which also reuses the
+    /// duplicates of its batch); it is worth it when many subscriptions share their expressions
+    /// (e.g. when reloading the campaigns). [`ATree::save()`] only keeps whether the cache is
+    /// enabled: a loaded tree has it enabled again but empty until the next insertions.
+    ///
+    /// # Examples
+    ///
+    /// ```rust
+    /// use a_tree::{ATree, AttributeDefinition};
+    ///
+    /// let definitions = [
+    ///     AttributeDefinition::integer("exchange_id"),
+    ///     AttributeDefinition::boolean("private"),
+    /// ];
+    /// let mut atree = ATree::new(&definitions).unwrap();
+    /// atree.enable_expression_cache();
+    /// atree.insert(&1u64, "exchange_id = 1 and private").unwrap();
+    /// atree.insert(&2u64, "private&&exchange_id=1").unwrap();
+    ///
+    /// let mut builder = atree.make_event();
+    /// builder.with_integer("exchange_id", 1).unwrap();
+    /// builder.with_boolean("private", true).unwrap();
+    /// let report = atree.search(&builder.build().unwrap()).unwrap();
+    /// let mut matches = report.matches().to_vec();
+    /// matches.sort();
+    /// assert_eq!(matches, [&1u64, &2u64]);
+    /// ```
+    pub fn enable_expression_cache(&mut self) {
+        if self.expression_cache.is_none() {
+            self.expression_cache = Some(ExpressionCache::default());
         }
+    }
 
-        Ok(Report::new(matches))
+    /// Stop caching the inserted expressions and drop the cache.
+    pub fn disable_expression_cache(&mut self) {
+        self.expression_cache = None;
     }
 
-    #[inline]
-    /// Delete the specified expression
-    pub fn delete(&mut self, subscription_id: &T) {
-        if let Some(node_id) = self.nodes_by_ids.get(subscription_id) {
-            self.delete_node(subscription_id, *node_id);
-        }
+    /// Reorder the children of the nodes based on the outcomes sampled by the searches.
+    ///
+    /// The children are ordered at insertion by their static cost only. This pass orders the
+    /// children of each `and` node by their cost per chance of failing (and those of each `or`
+    /// node by their cost per chance of succeeding) so that the evaluation short-circuits as
+    /// early and as cheaply as it can. It also moves the access child of the `and` nodes (i.e.
+    /// the child that is evaluated eagerly and that triggers the evaluation of its parent) to
+    /// the child with the lowest expected cost. The nodes that were never sampled keep their
+    /// order. The matches of the searches are not affected.
+    ///
+    /// # Examples
+    ///
+    /// ```rust
+    /// use a_tree::{ATree, AttributeDefinition};
+    ///
+    /// let definitions = [
+    ///     AttributeDefinition::string("country"),
+    ///     AttributeDefinition::string_list("deal_ids"),
+    /// ];
+    /// let mut atree = ATree::new(&definitions).unwrap();
+    /// atree.insert(&1u64, r#"country = 'US' and deal_ids one of ["deal-1"]"#).unwrap();
+    /// atree.enable_outcome_sampling(1);
+    ///
+    /// let mut builder = atree.make_event();
+    /// builder.with_string("country", "US").unwrap();
+    /// builder.with_string_list("deal_ids", &["deal-2"]).unwrap();
+    /// let event = builder.build().unwrap();
+    /// for _ in 0..10 {
+    ///     assert!(atree.search(&event).unwrap().matches().is_empty());
+    /// }
+    ///
+    /// atree.reoptimize();
+    /// assert!(atree.search(&event).unwrap().matches().is_empty());
+    /// ```
+    pub fn reoptimize(&mut self) {
+        statistics::reoptimize(&mut self.nodes, &mut self.predicates, &mut self.index);
+    }
+
+    /// Create a [`FrozenATree`], an immutable copy of the [`ATree`] whose nodes are laid out
+    /// contiguously in level order so that searches touch fewer cache lines.
+    ///
+    /// The [`FrozenATree`] does not see the insertions and deletions made afterwards; it has to be
+    /// frozen again to reflect them.
+    pub fn freeze(&self) -> FrozenATree<T> {
+        FrozenATree::new(self)
+    }
+
+    /// Write a snapshot of the [`ATree`] that can be loaded back without parsing the expressions.
+    ///
+    /// The snapshot is a versioned binary format whose values are written in little endian. It
+    /// contains the nodes, the predicates, the strings, the attributes and the mappings from the
+    /// expressions and the subscription IDs to the nodes so the loaded tree can keep being
+    /// updated.
+    ///
+    /// # Examples
+    ///
+    /// ```rust
+    /// use a_tree::{ATree, AttributeDefinition};
+    ///
+    /// let definitions = [
+    ///     AttributeDefinition::boolean("private"),
+    ///     AttributeDefinition::integer("exchange_id")
+    /// ];
+    /// let mut atree = ATree::new(&definitions).unwrap();
+    /// atree.insert(&1u64, "exchange_id = 5 and not private").unwrap();
+    ///
+    /// let mut snapshot = Vec::new();
+    /// atree.save(&mut snapshot).unwrap();
+    /// let loaded = ATree::<u64>::load(&snapshot).unwrap();
+    ///
+    /// let mut builder = loaded.make_event();
+    /// builder.with_integer("exchange_id", 5).unwrap();
+    /// builder.with_boolean("private", false).unwrap();
+    /// let event = builder.build().unwrap();
+    /// assert_eq!(loaded.search(&event).unwrap().matches(), [&1u64]);
+    /// ```
+    pub fn save<W: Write>(&self, writer: &mut W) -> io::Result<()>
+    where
+        T: Persist,
+    {
+        snapshot::save(self, writer)
+    }
+
+    /// Load an [`ATree`] from a snapshot written by [`ATree::save()`].
+    ///
+    /// An error is returned if the bytes are not a snapshot, if its version is not supported or if
+    /// it is corrupted.
+    pub fn load(bytes: &[u8]) -> Result<Self, SnapshotError>
+    where
+        T: Persist,
+    {
+        snapshot::load(bytes)
+    }
+
+    /// Load an [`ATree`] from a snapshot file written by [`ATree::save()`].
+    ///
+    /// The file is mapped in memory (on Unix) and read sequentially to rebuild the nodes, the
+    /// predicates and the mappings of the tree on the heap, without reading the whole file in a
+    /// buffer first. The loaded tree does not reference the file afterwards; to search the nodes
+    /// in place from the mapped pages instead, write a frozen image with [`ATree::save_frozen()`]
+    /// and load it with [`FrozenATree::load_mmap()`].
+    pub fn load_mmap<P: AsRef<Path>>(path: P) -> Result<Self, SnapshotError>
+    where
+        T: Persist,
+    {
+        let mapping = Mmap::open(path)?;
+        snapshot::load(&mapping)
     }
 
+    /// Create a new [`SearchContext`] that can be reused between the searches made with the
+    /// [`ATree::search_with()`] function.
     #[inline]
-    fn delete_node(&mut self, subscription_id: &T, node_id: NodeId) {
-        let children = decrement_use_count(
-            subscription_id,
-            node_id,
-            &mut self.nodes,
-            &mut self.expression_to_node,
-            &mut self.roots,
-            &mut self.predicates,
-            &mut self.nodes_by_ids,
-            &mut self.max_level,
-        );
+    pub fn make_search_context(&'_ self) -> SearchContext<'_, T> {
+        SearchContext::new(self.nodes.capacity(), self.max_level)
+    }
 
-        if let Some(children) = children {
-            for child in children {
-                self.delete_node(subscription_id, child);
-            }
-        }
+    /// Search the [`ATree`] for arbitrary boolean expressions that match the [`Event`].
+    pub fn search(&'_ self, event: &Event) -> Result<Report<'_, T>, ATreeError<'_>> {
+        let mut context = self.make_search_context();
+        self.search_with(&mut context, event)?;
+        Ok(Report::new(context.matches))
     }
 
-    /// Export the [`ATree`] to the Graphviz format.
-    pub fn to_graphviz(&self) -> String {
-        const DEFAULT_CAPACITY: usize = 100_000;
-        let mut builder = String::with_capacity(DEFAULT_CAPACITY);
-        builder.push_str("digraph {\n");
-        builder.push_str("rankdir = TB;\n");
-        builder.push_str(r#"node [shape = "record"];"#);
-        builder.push('\n');
-        let mut relations = Vec::with_capacity(DEFAULT_CAPACITY);
-        let mut levels = vec![vec![]; self.max_level];
-        for (id, entry) in &self.nodes {
-            match &entry.node {
-                ATreeNode::LNode(LNode {
-                    parents, predicate, ..
-                }) => {
-                    let node = format!(
-                        r#"node_{id} [label = "{{{id} | level: {} | {predicate} | subscriptions: {:?} | l-node}}", style = "rounded"];"#,
-                        entry.level(),
-                        entry.subscription_ids
-                    );
-                    levels[entry.level() - 1].push((id, node));
+    /// Search the [`ATree`] for arbitrary boolean expressions that match the [`Event`] by reusing
+    /// the buffers of the [`SearchContext`].
+    ///
+    /// # Examples
+    ///
+    /// ```rust
+    /// use a_tree::{ATree, AttributeDefinition};
+    ///
+    /// let definitions = [
+    ///     AttributeDefinition::boolean("private"),
+    ///     AttributeDefinition::integer("exchange_id")
+    /// ];
+    /// let mut atree = ATree::new(&definitions).unwrap();
+    /// atree.insert(&1u64, "exchange_id = 5").unwrap();
+    /// atree.insert(&2u64, "private").unwrap();
+    ///
+    /// let mut context = atree.make_search_context();
+    /// for exchange_id in [1, 5] {
+    ///     let mut builder = atree.make_event();
+    ///     builder.with_integer("exchange_id", exchange_id).unwrap();
+    ///     builder.with_boolean("private", false).unwrap();
+    ///     let event = builder.build().unwrap();
+    ///
+    ///     let matches = atree.search_with(&mut context, &event).unwrap();
+    ///     assert_eq!(exchange_id == 5, matches == [&1u64]);
+    /// }
+    /// ```
+    pub fn search_with<'a, 'c>(
+        &'a self,
+        context: &'c mut SearchContext<'a, T>,
+        event: &Event,
+    ) -> Result<&'c [&'a T], ATreeError<'a>> {
+        context.prepare(self.nodes.capacity(), self.max_level - 1);
+        let SearchContext {
+            results,
+            queues,
+            candidates,
+            matches,
+        } = context;
+        self.search_into(event, results, queues, candidates, matches);
+        Ok(matches)
+    }
 
-                    for parent_id in parents {
-                        relations.push(format!("node_{id} -> node_{parent_id};"));
-                    }
-                }
-                ATreeNode::INode(INode {
-                    children,
-                    parents,
-                    operator,
-                    ..
-                }) => {
-                    let node = format!(
-                        r#"node_{id} [label = "{{{id} | level: {} | {operator:#?} | subscriptions: {:?} | i-node}}"];"#,
-                        entry.level(),
-                        entry.subscription_ids
-                    );
-                    levels[entry.level() - 1].push((id, node));
+    /// Search the [`ATree`] like [`ATree::search_with()`] while adding what the search did to the
+    /// [`SearchStats`].
+    ///
+    /// The statistics are added to the ones already in `stats` so that they can be accumulated
+    /// over many searches (e.g. by keeping a [`SearchStats`] per thread). The other searches are
+    /// not instrumented and this function is only available with the `stats` feature.
+    ///
+    /// # Examples
+    ///
+    /// ```rust
+    /// use a_tree::{ATree, AttributeDefinition, SearchStats};
+    ///
+    /// let definitions = [
+    ///     AttributeDefinition::boolean("private"),
+    ///     AttributeDefinition::integer("exchange_id")
+    /// ];
+    /// let mut atree = ATree::new(&definitions).unwrap();
+    /// atree.insert(&1u64, "exchange_id = 5 and private").unwrap();
+    ///
+    /// let mut builder = atree.make_event();
+    /// builder.with_integer("exchange_id", 1).unwrap();
+    /// builder.with_boolean("private", false).unwrap();
+    /// let event = builder.build().unwrap();
+    /// let mut context = atree.make_search_context();
+    /// let mut stats = SearchStats::default();
+    ///
+    /// let matches = atree.search_with_stats(&mut context, &event, &mut stats).unwrap();
+    /// assert!(matches.is_empty());
+    /// assert_eq!(1, stats.searches);
+    /// assert_eq!(1, stats.predicates_evaluated);
+    /// assert_eq!(1, stats.and_short_circuits);
+    /// ```
+    #[cfg(feature = "stats")]
+    pub fn search_with_stats<'a, 'c>(
+        &'a self,
+        context: &'c mut SearchContext<'a, T>,
+        event: &Event,
+        stats: &mut SearchStats,
+    ) -> Result<&'c [&'a T], ATreeError<'a>> {
+        context.prepare(self.nodes.capacity(), self.max_level - 1);
+        let SearchContext {
+            results,
+            queues,
+            candidates,
+            matches,
+        } = context;
+        stats.searches += 1;
+        let mut collector = stats::Instrumented::new(matches, stats);
+        self.search_into(event, results, queues, candidates, &mut collector);
+        Ok(matches)
+    }
 
-                    for parent_id in parents {
-                        relations.push(format!("node_{id} -> node_{parent_id};"));
-                    }
+    /// Create a new [`DeltaContext`] to search the events that only differ from a base event by a
+    /// few attributes with [`ATree::search_delta()`].
+    pub fn make_delta_context(&'_ self) -> DeltaContext<'_, T> {
+        DeltaContext::new(&self.nodes, self.attributes.len(), self.max_level)
+    }
 
-                    for child_id in children {
-                        relations.push(format!("node_{id} -> node_{child_id};"));
-                    }
-                }
-                ATreeNode::RNode(RNode {
-                    children, operator, ..
-                }) => {
-                    let node = format!(
-                        r#"node_{id} [label = "{{{id} | level: {} | {operator:#?} | subscriptions: {:?} | r-node}}"];"#,
-                        entry.level(),
-                        entry.subscription_ids
-                    );
-                    levels[entry.level() - 1].push((id, node));
+    /// Search the [`ATree`] for the arbitrary boolean expressions that match the [`Event`] and
+    /// keep its evaluation in the [`DeltaContext`] as the base of the next delta searches.
+    pub fn search_base<'a, 'c>(
+        &'a self,
+        context: &'c mut DeltaContext<'a, T>,
+        event: &Event,
+    ) -> Result<&'c [&'a T], ATreeError<'a>> {
+        self.search_with(context.base_mut(), event)?;
+        Ok(context.rebase(&self.nodes))
+    }
 
-                    for child_id in children {
-                        relations.push(format!("node_{id} -> node_{child_id};"));
-                    }
-                }
-            }
+    /// Search the [`ATree`] for the arbitrary boolean expressions that match an [`Event`] that
+    /// only differs from the base event of the [`DeltaContext`] by the changed attributes.
+    ///
+    /// Only the predicates that reference the changed attributes and the nodes above them are
+    /// evaluated again, the other nodes keeping their results for the base event. The event must
+    /// have the same values as the base event for all the other attributes; the matches are not
+    /// in any particular order. If no base event was searched with the context yet, the event
+    /// is searched as the base.
+    ///
+    /// # Examples
+    ///
+    /// ```rust
+    /// use a_tree::{ATree, AttributeDefinition};
+    ///
+    /// let definitions = [
+    ///     AttributeDefinition::string("country"),
+    ///     AttributeDefinition::integer("placement_id"),
+    /// ];
+    /// let mut atree = ATree::new(&definitions).unwrap();
+    /// atree.insert(&1u64, r#"country = "CA" and placement_id = 1"#).unwrap();
+    /// atree.insert(&2u64, r#"country = "CA""#).unwrap();
+    /// let placement_id = atree.attribute("placement_id").unwrap();
+    ///
+    /// let mut builder = atree.make_event();
+    /// builder.with_string("country", "CA").unwrap();
+    /// builder.set_integer(placement_id, 1).unwrap();
+    /// let mut context = atree.make_delta_context();
+    /// let mut matches = atree.search_base(&mut context, &builder.build().unwrap()).unwrap().to_vec();
+    /// matches.sort();
+    /// assert_eq!(matches, [&1u64, &2u64]);
+    ///
+    /// let mut builder = atree.make_event();
+    /// builder.with_string("country", "CA").unwrap();
+    /// builder.set_integer(placement_id, 2).unwrap();
+    /// let event = builder.build().unwrap();
+    /// let matches = atree.search_delta(&mut context, &event, &[placement_id]).unwrap();
+    /// assert_eq!(matches, [&2u64]);
+    /// ```
+    pub fn search_delta<'a, 'c>(
+        &'a self,
+        context: &'c mut DeltaContext<'a, T>,
+        event: &Event,
+        changed: &[AttributeHandle],
+    ) -> Result<&'c [&'a T], ATreeError<'a>> {
+        if !context.has_base() {
+            return self.search_base(context, event);
         }
+        Ok(delta::search(&self.nodes, context, event, changed))
+    }
 
-        builder.push_str("\n// nodes\n");
-        for entries in levels.into_iter().rev() {
-            for (_, node) in entries.iter() {
-                builder.push_str(node);
-                builder.push('\n');
-            }
+    /// Check whether any of the arbitrary boolean expressions of the [`ATree`] matches the
+    /// [`Event`].
+    ///
+    /// The search stops as soon as the first match is found.
+    ///
+    /// # Examples
+    ///
+    /// ```rust
+    /// use a_tree::{ATree, AttributeDefinition};
+    ///
+    /// let definitions = [AttributeDefinition::integer("exchange_id")];
+    /// let mut atree = ATree::new(&definitions).unwrap();
+    /// atree.insert(&1u64, "exchange_id = 5").unwrap();
+    ///
+    /// for exchange_id in [1, 5] {
+    ///     let mut builder = atree.make_event();
+    ///     builder.with_integer("exchange_id", exchange_id).unwrap();
+    ///     let event = builder.build().unwrap();
+    ///     assert_eq!(exchange_id == 5, atree.search_any(&event).unwrap());
+    /// }
+    /// ```
+    pub fn search_any(&'_ self, event: &Event) -> Result<bool, ATreeError<'_>> {
+        Ok(!self.search_limit(event, 1)?.matches().is_empty())
+    }
 
-            builder.push_str("{rank = same; ");
-            for (id, _) in entries {
-                builder.push_str(&format!("node_{id}; "));
-            }
-            builder.push_str("};\n");
+    /// Search the [`ATree`] for at most `limit` arbitrary boolean expressions that match the
+    /// [`Event`].
+    ///
+    /// The search stops as soon as enough matches are found, so which of the matches are returned
+    /// depends on the order in which the nodes are evaluated.
+    ///
+    /// # Examples
+    ///
+    /// ```rust
+    /// use a_tree::{ATree, AttributeDefinition};
+    ///
+    /// let definitions = [AttributeDefinition::integer("exchange_id")];
+    /// let mut atree = ATree::new(&definitions).unwrap();
+    /// for i in 0..10u64 {
+    ///     atree.insert(&i, &format!("exchange_id > {i}")).unwrap();
+    /// }
+    ///
+    /// let mut builder = atree.make_event();
+    /// builder.with_integer("exchange_id", 100).unwrap();
+    /// let report = atree.search_limit(&builder.build().unwrap(), 3).unwrap();
+    /// assert_eq!(3, report.matches().len());
+    /// ```
+    pub fn search_limit(
+        &'_ self,
+        event: &Event,
+        limit: usize,
+    ) -> Result<Report<'_, T>, ATreeError<'_>> {
+        if limit == 0 {
+            return Ok(Report::new(vec![]));
         }
+        let mut collector = Limit::new(limit);
+        self.search_collect(event, &mut collector);
+        Ok(Report::new(collector.into_matches()))
+    }
 
-        builder.push_str("\n// edges\n");
-        for relation in relations {
-            builder.push_str(&relation);
-            builder.push('\n');
+    /// Search the [`ATree`] for the `k` arbitrary boolean expressions of the highest priorities
+    /// that match the [`Event`].
+    ///
+    /// The priorities are the ones set by [`ATree::insert_with_priority()`]; the matches are
+    /// returned from the highest priority to the lowest. Every node knows the highest priority of
+    /// the expressions it is part of, so once `k` matches are found, the nodes that cannot lead to
+    /// a higher priority are not evaluated.
+    pub fn search_top_k(
+        &'_ self,
+        event: &Event,
+        k: usize,
+    ) -> Result<Report<'_, T>, ATreeError<'_>> {
+        if k == 0 {
+            return Ok(Report::new(vec![]));
         }
+        let mut collector = TopK::new(k);
+        self.search_collect(event, &mut collector);
+        Ok(Report::new(collector.into_matches()))
+    }
 
-        builder.push('}');
-        builder
+    #[inline]
+    fn search_collect<'a, C: Collector<'a, T>>(&'a self, event: &Event, collector: &mut C) {
+        let mut context = self.make_search_context();
+        let SearchContext {
+            results,
+            queues,
+            candidates,
+            ..
+        } = &mut context;
+        self.search_into(event, results, queues, candidates, collector);
     }
-}
 
-#[inline]
-#[allow(clippy::too_many_arguments)]
-fn decrement_use_count<T: Eq + Hash>(
-    subscription_id: &T,
-    node_id: NodeId,
-    nodes: &mut Slab<Entry<T>>,
-    expression_to_node: &mut HashMap<ExpressionId, NodeId>,
-    roots: &mut Vec<NodeId>,
-    predicates: &mut Vec<NodeId>,
-    nodes_by_ids: &mut HashMap<T, NodeId>,
-    max_level: &mut usize,
-) -> Option<Vec<NodeId>> {
-    let node = &mut nodes[node_id];
-    node.use_count -= 1;
-    let mut children = None;
-    node.subscription_ids.retain(|x| *x != *subscription_id);
-    nodes_by_ids.remove(subscription_id);
-    if node.use_count == 0 {
-        if !node.is_leaf() {
-            children = Some(node.children().to_vec());
+    #[inline]
+    fn search_into<'a, C: Collector<'a, T>>(
+        &'a self,
+        event: &Event,
+        results: &mut EvaluationResult,
+        queues: &mut [Vec<(NodeId, &'a Entry<T>)>],
+        candidates: &mut Vec<NodeId>,
+        collector: &mut C,
+    ) {
+        // Since the predicates will already be evaluated and their parents will be put into the
+        // queues, then there is no need to keep a queue for them.
+        let levels = self.max_level - 1;
+        let start = collector.start();
+        if let Some(index) = &self.index {
+            index.candidates(event, candidates);
+            process_predicates(candidates, &self.nodes, event, collector, results, queues);
+        } else {
+            // Only the null checks can be true on the attributes that the event leaves undefined.
+            let predicates = self.predicates.null_checks();
+            process_predicates(predicates, &self.nodes, event, collector, results, queues);
+            for attribute in event.defined() {
+                let predicates = self.predicates.by_attribute(attribute);
+                process_predicates(predicates, &self.nodes, event, collector, results, queues);
+            }
         }
-        let expression_id = node.id;
-        roots.retain(|x| *x != node_id);
-        predicates.retain(|x| *x != node_id);
-        *max_level = get_max_level(roots, nodes);
-        expression_to_node.remove(&expression_id);
-        nodes.remove(node_id);
-    }
+        collector.observe(Probe::Finished(Stage::Predicates, start));
 
-    children
-}
+        let start = collector.start();
+        'levels: for level in 0..levels {
+            while let Some((node_id, node)) = queues[level].pop() {
+                collector.observe(Probe::Popped(level));
+                if collector.is_done() {
+                    break 'levels;
+                }
+                if results.is_evaluated(node_id) || collector.can_skip(node) {
+                    continue;
+                }
 
-#[inline]
-fn insert_node<T>(
-    expression_to_node: &mut HashMap<ExpressionId, NodeId>,
-    nodes: &mut Slab<Entry<T>>,
-    expression_id: &ExpressionId,
-    node: ATreeNode,
-    subscription_id: Option<T>,
-    cost: u64,
-) -> NodeId {
-    let entry = Entry::new(*expression_id, node, subscription_id, cost);
-    let node_id = nodes.insert(entry);
-    if expression_to_node.insert(*expression_id, node_id).is_some() {
-        unreachable!("{expression_id} is already present; this is a bug");
-    }
-    node_id
-}
+                let result = evaluate_node(node_id, event, node, &self.nodes, results, collector);
+                add_matches(result, node, collector);
 
-#[inline]
-fn add_parent<T>(entry: &mut Entry<T>, node_id: NodeId) {
-    entry.node.add_parent(node_id);
-}
+                if node.is_root() {
+                    continue;
+                }
 
-#[inline]
-fn add_subscription_id<T: Eq + Hash + Clone>(
-    subscription_id: &T,
-    node_id: NodeId,
-    nodes: &mut Slab<Entry<T>>,
-    nodes_by_ids: &mut HashMap<T, NodeId>,
-) {
-    nodes[node_id]
-        .subscription_ids
-        .push(subscription_id.clone());
-    nodes_by_ids.insert(subscription_id.clone(), node_id);
-}
+                for parent_id in node.parents() {
+                    let entry = &self.nodes[*parent_id];
+                    let is_evaluated = results.is_evaluated(*parent_id);
+                    if !is_evaluated
+                        && matches!(entry.operator(), Operator::And)
+                        && !result.unwrap_or(true)
+                    {
+                        results.set_result(*parent_id, Some(false));
+                        collector.observe(Probe::ShortCircuit);
+                        continue;
+                    }
 
-#[inline]
-fn increment_use_count<T>(node_id: NodeId, nodes: &mut Slab<Entry<T>>) {
-    nodes[node_id].use_count += 1;
-}
+                    if !is_evaluated {
+                        queues[entry.level() - 2].push((*parent_id, entry));
+                    }
+                }
+            }
+        }
+        collector.observe(Probe::Finished(Stage::Levels, start));
 
-#[inline]
-fn get_max_level<T>(roots: &[NodeId], nodes: &Slab<Entry<T>>) -> usize {
-    roots
-        .iter()
-        .map(|root_id| nodes[*root_id].level())
-        .max()
-        .unwrap_or(1)
-}
+        if self.sampling.as_ref().is_some_and(Sampling::is_due) {
+            statistics::record(&self.nodes, results);
+        }
+    }
 
-#[inline]
-fn change_rnode_to_inode<T>(node_id: NodeId, nodes: &mut Slab<Entry<T>>) {
-    let entry = &mut nodes[node_id];
-    if let ATreeNode::RNode(RNode {
-        children,
-        level,
-        operator,
-    }) = &entry.node
+    /// Search the [`ATree`] for arbitrary boolean expressions that match the [`Event`] by
+    /// spreading the evaluation over the threads of the [`ThreadPool`].
+    ///
+    /// The predicates are split between the threads and then each level of the tree is evaluated
+    /// in parallel once the levels under it are done. The matches are the same as the ones of
+    /// [`ATree::search()`] but their order can change from one search to the next. This is only
+    /// worth it for the large trees so the trees that have fewer nodes than the
+    /// [`ThreadPool::threshold()`] are searched on the calling thread.
+    pub fn search_parallel(
+        &'_ self,
+        event: &Event,
+        pool: &ThreadPool,
+    ) -> Result<Report<'_, T>, ATreeError<'_>>
+    where
+        T: Sync,
     {
-        let inode = ATreeNode::INode(INode {
-            parents: vec![],
-            children: children.to_vec(),
-            level: *level,
-            operator: operator.clone(),
-        });
-        entry.node = inode;
+        if pool.threads() == 1 || self.nodes.len() < pool.threshold() {
+            return self.search(event);
+        }
+
+        let levels = self.max_level - 1;
+        let matches = if let Some(index) = &self.index {
+            let mut candidates = Vec::with_capacity(SearchContext::<T>::DEFAULT_CAPACITY);
+            index.candidates(event, &mut candidates);
+            parallel::search(&self.nodes, &candidates, levels, event, pool)
+        } else {
+            parallel::search(&self.nodes, &self.predicates, levels, event, pool)
+        };
+        Ok(Report::new(matches))
     }
-}
 
-#[inline]
-fn choose_access_child<T>(
-    left_id: NodeId,
-    right_id: NodeId,
-    parent_id: NodeId,
-    nodes: &mut Slab<Entry<T>>,
-    predicates: &mut Vec<NodeId>,
-) {
-    let left_entry = &nodes[left_id];
-    let right_entry = &nodes[right_id];
-    let accessor_id = if left_entry.cost < right_entry.cost {
-        left_id
-    } else {
-        right_id
-    };
-    add_parent(&mut nodes[accessor_id], parent_id);
-    add_predicate(accessor_id, nodes, predicates);
-}
-
-#[inline]
-fn add_predicate<T>(node_id: NodeId, nodes: &Slab<Entry<T>>, predicates: &mut Vec<NodeId>) {
-    let entry = &nodes[node_id];
-    if entry.is_leaf() && !predicates.contains(&node_id) {
-        predicates.push(node_id);
-    }
-}
-
-#[inline]
-fn process_predicates<'a, T>(
-    predicates: &[NodeId],
-    nodes: &'a Slab<Entry<T>>,
-    event: &Event,
-    matches: &mut Vec<&'a T>,
-    results: &mut EvaluationResult,
-    queues: &mut [Vec<(NodeId, &'a Entry<T>)>],
-) {
-    for predicate_id in predicates {
-        let node = &nodes[*predicate_id];
-        // The evaluation is delayed as much as possible; if the predicate has no
-        // subscribers and no parents, there is no point in evaluating eagerly and
-        // it should only be evaluated if there is a need for it.
-        let delay_evaluation = node.subscription_ids.is_empty() && node.parents().is_empty();
-        if delay_evaluation || results.is_evaluated(*predicate_id) {
-            continue;
+    /// Search the [`ATree`] for arbitrary boolean expressions that match each [`Event`] of the
+    /// batch.
+    ///
+    /// Instead of searching the events one after the other, each predicate is evaluated for the
+    /// whole batch at once and the results of the nodes are kept as bitsets over the batch that
+    /// are combined level by level. The reports are returned in the same order as the events.
+    ///
+    /// # Examples
+    ///
+    /// ```rust
+    /// use a_tree::{ATree, AttributeDefinition};
+    ///
+    /// let definitions = [
+    ///     AttributeDefinition::boolean("private"),
+    ///     AttributeDefinition::integer("exchange_id")
+    /// ];
+    /// let mut atree = ATree::new(&definitions).unwrap();
+    /// atree.insert(&1u64, "exchange_id = 5 and not private").unwrap();
+    /// atree.insert(&2u64, "private").unwrap();
+    ///
+    /// let events = [(5, false), (5, true), (1, false)].map(|(exchange_id, private)| {
+    ///     let mut builder = atree.make_event();
+    ///     builder.with_integer("exchange_id", exchange_id).unwrap();
+    ///     builder.with_boolean("private", private).unwrap();
+    ///     builder.build().unwrap()
+    /// });
+    ///
+    /// let reports = atree.search_batch(&events).unwrap();
+    /// assert_eq!(reports[0].matches(), [&1u64]);
+    /// assert_eq!(reports[1].matches(), [&2u64]);
+    /// assert!(reports[2].matches().is_empty());
+    /// ```
+    pub fn search_batch(&'_ self, events: &[Event]) -> Result<Vec<Report<'_, T>>, ATreeError<'_>> {
+        let mut matches = vec![Vec::new(); events.len()];
+        if events.is_empty() {
+            return Ok(vec![]);
         }
 
-        let result = node.evaluate(event);
-        results.set_result(*predicate_id, result);
-        add_matches(result, node, matches);
-
-        node.parents()
-            .iter()
-            .map(|parent_id| (*parent_id, &nodes[*parent_id]))
-            .for_each(|(parent_id, parent)| {
-                if matches!(parent.operator(), Operator::And) && !result.unwrap_or(true) {
-                    results.set_result(parent_id, Some(false));
-                } else {
-                    queues[parent.level() - 2].push((parent_id, parent));
-                }
-            })
-    }
-}
-
-#[inline]
-fn evaluate_node<'a, T>(
-    node_id: NodeId,
-    event: &Event,
-    node: &'a Entry<T>,
-    nodes: &'a Slab<Entry<T>>,
-    results: &mut EvaluationResult,
-    matches: &mut Vec<&'a T>,
-) -> Option<bool> {
-    let operator = node.operator();
-    let result = match operator {
-        Operator::And => evaluate_and(node.children(), event, nodes, results, matches),
-        Operator::Or => evaluate_or(node.children(), event, nodes, results, matches),
-    };
-    results.set_result(node_id, result);
-    result
-}
+        let mut results = BatchEvaluationResult::new(self.nodes.capacity(), events.len());
+        let buckets = BatchEvaluationResult::buckets_for(events.len());
+        let mut all = vec![0u64; buckets];
+        BatchEvaluationResult::fill(events.len(), &mut all);
+        let mut lanes = vec![0u64; buckets];
+        let mut success = vec![0u64; buckets];
+        let mut queues = vec![Vec::with_capacity(50); self.max_level - 1];
 
-#[inline]
-fn evaluate_and<'a, T>(
-    children: &[NodeId],
-    event: &Event,
-    nodes: &'a Slab<Entry<T>>,
-    results: &mut EvaluationResult,
-    matches: &mut Vec<&'a T>,
-) -> Option<bool> {
-    let mut acc = Some(true);
-    for child_id in children {
-        let result = lazy_evaluate(*child_id, event, nodes, results, matches);
-        match (acc, result) {
-            (Some(false), _) => {
-                acc = Some(false);
-                break;
-            }
-            (_, Some(false)) => {
-                acc = Some(false);
-                break;
+        if let Some(index) = &self.index {
+            // With the index, the predicates are only evaluated for the events where they are
+            // candidates; they are known to be false for the other ones.
+            let mut candidates = Vec::with_capacity(50);
+            let mut lanes_by_predicates = Vec::with_capacity(events.len() * 50);
+            for (event_id, event) in events.iter().enumerate() {
+                candidates.clear();
+                index.candidates(event, &mut candidates);
+                lanes_by_predicates.extend(candidates.iter().map(|id| (*id, event_id)));
             }
-            (Some(a), Some(b)) => {
-                acc = Some(a && b);
+            lanes_by_predicates.sort_unstable();
+            lanes_by_predicates.dedup();
+            for chunk in lanes_by_predicates.chunk_by(|(a, _), (b, _)| a == b) {
+                let predicate_id = chunk[0].0;
+                lanes.fill(0);
+                for (_, event_id) in chunk {
+                    BatchEvaluationResult::set_bit(&mut lanes, *event_id);
+                }
+                batch_process_predicate(
+                    predicate_id,
+                    &self.nodes,
+                    events,
+                    &lanes,
+                    &all,
+                    &mut success,
+                    &mut results,
+                    &mut matches,
+                    &mut queues,
+                );
             }
-            (_, _) => {
-                acc = None;
+        } else {
+            for predicate_id in self.predicates.iter() {
+                batch_process_predicate(
+                    *predicate_id,
+                    &self.nodes,
+                    events,
+                    &all,
+                    &all,
+                    &mut success,
+                    &mut results,
+                    &mut matches,
+                    &mut queues,
+                );
             }
         }
-    }
-    acc
-}
 
-#[inline]
-fn evaluate_or<'a, T>(
-    children: &[NodeId],
-    event: &Event,
-    nodes: &'a Slab<Entry<T>>,
-    results: &mut EvaluationResult,
-    matches: &mut Vec<&'a T>,
-) -> Option<bool> {
-    let mut acc = Some(false);
-    for child_id in children {
-        let result = lazy_evaluate(*child_id, event, nodes, results, matches);
-        match (acc, result) {
-            (Some(true), _) => {
-                acc = Some(true);
-                break;
-            }
-            (_, Some(true)) => {
-                acc = Some(true);
-                break;
-            }
-            (Some(a), Some(b)) => {
-                acc = Some(a || b);
-            }
-            (_, _) => {
-                acc = None;
+        let mut child_success = vec![0u64; buckets];
+        let mut missing = vec![0u64; buckets];
+        for level in 0..queues.len() {
+            while let Some(node_id) = queues[level].pop() {
+                let node = &self.nodes[node_id];
+                match node.operator() {
+                    Operator::And => {
+                        success.copy_from_slice(&all);
+                        for child_id in node.children() {
+                            batch_evaluate_child(
+                                *child_id,
+                                &self.nodes,
+                                events,
+                                &success,
+                                &mut child_success,
+                                &mut missing,
+                                &mut results,
+                                &mut matches,
+                            );
+                            let entries = success.iter_mut().zip(&child_success);
+                            entries.for_each(|(entry, child)| *entry &= child);
+                            if success.iter().all(|entry| *entry == 0) {
+                                break;
+                            }
+                        }
+                    }
+                    Operator::Or => {
+                        success.fill(0);
+                        for child_id in node.children() {
+                            batch_evaluate_child(
+                                *child_id,
+                                &self.nodes,
+                                events,
+                                &all,
+                                &mut child_success,
+                                &mut missing,
+                                &mut results,
+                                &mut matches,
+                            );
+                            let entries = success.iter_mut().zip(&child_success);
+                            entries.for_each(|(entry, child)| *entry |= child);
+                        }
+                    }
+                }
+                results.set_results(node_id, &success, &all);
+                batch_propagate(
+                    node,
+                    &success,
+                    &self.nodes,
+                    &mut results,
+                    &mut matches,
+                    &mut queues,
+                );
             }
         }
-    }
 
-    acc
-}
+        Ok(matches.into_iter().map(Report::new).collect())
+    }
 
-#[inline]
-fn lazy_evaluate<'a, T>(
-    node_id: NodeId,
-    event: &Event,
-    nodes: &'a Slab<Entry<T>>,
-    results: &mut EvaluationResult,
-    matches: &mut Vec<&'a T>,
-) -> Option<bool> {
-    if results.is_evaluated(node_id) {
-        return results.get_result(node_id);
+    /// Search the [`ATree`] for the arbitrary boolean expressions matching each event of a batch
+    /// laid out as columns.
+    ///
+    /// The events are filled in the [`EventBatch`] straight from the columns (one per attribute,
+    /// the other attributes being left `undefined`) and then searched with
+    /// [`ATree::search_batch()`]. Reusing the same [`EventBatch`] keeps the events and their
+    /// buffers between the batches.
+    ///
+    /// # Examples
+    ///
+    /// ```rust
+    /// use a_tree::{ATree, AttributeDefinition, Bitmap, Column, EventBatch, IntegerArray};
+    ///
+    /// let definitions = [
+    ///     AttributeDefinition::integer("exchange_id"),
+    ///     AttributeDefinition::integer_list("segment_ids"),
+    /// ];
+    /// let mut atree = ATree::new(&definitions).unwrap();
+    /// atree.insert(&1u64, "exchange_id = 5 and segment_ids one of [2]").unwrap();
+    /// atree.insert(&2u64, "exchange_id is null").unwrap();
+    /// let exchange_id = atree.attribute("exchange_id").unwrap();
+    /// let segment_ids = atree.attribute("segment_ids").unwrap();
+    ///
+    /// // Three events: the exchange of the last one is undefined
+    /// let exchange_ids = [5, 5, 0];
+    /// let validity = [0b011];
+    /// let offsets = [0, 2, 3, 3];
+    /// let segments = [1, 2, 3];
+    /// let columns = [
+    ///     Column::integer(exchange_id, &exchange_ids).with_validity(Bitmap::new(&validity, 0)),
+    ///     Column::integer_list(segment_ids, &offsets, IntegerArray::new(&segments)),
+    /// ];
+    ///
+    /// let mut batch = EventBatch::new();
+    /// let reports = atree.search_columns(&mut batch, 3, &columns).unwrap();
+    /// assert_eq!(reports[0].matches(), [&1u64]);
+    /// assert!(reports[1].matches().is_empty());
+    /// assert_eq!(reports[2].matches(), [&2u64]);
+    /// ```
+    pub fn search_columns(
+        &'_ self,
+        batch: &mut EventBatch,
+        rows: usize,
+        columns: &[Column<'_>],
+    ) -> Result<Vec<Report<'_, T>>, ATreeError<'_>> {
+        batch
+            .fill(&self.attributes, &self.strings, rows, columns)
+            .map_err(ATreeError::Event)?;
+        self.search_batch(batch.events())
     }
-    let node = &nodes[node_id];
-    let result = if node.is_leaf() {
-        let result = node.evaluate(event);
-        results.set_result(node_id, result);
-        result
-    } else {
-        evaluate_node(node_id, event, node, nodes, results, matches)
-    };
-    add_matches(result, node, matches);
-    result
-}
 
-#[inline]
-fn add_matches<'a, T>(result: Option<bool>, node: &'a Entry<T>, matches: &mut Vec<&'a T>) {
-    if !node.subscription_ids.is_empty() {
-        if let Some(true) = result {
-            for subscription_id in &node.subscription_ids {
-                matches.push(subscription_id);
-            }
+    #[inline]
+    /// Delete the specified expression
+    ///
+    /// Deleting an expression only goes through its own nodes: the roots and the predicates are
+    /// removed from their lists in constant time so the cost does not grow with the tree.
+    pub fn delete(&mut self, subscription_id: &T) {
+        if let Some(node_id) = self.nodes_by_ids.get(subscription_id) {
+            self.delete_node(subscription_id, *node_id);
         }
     }
-}
-
-#[derive(Clone, Debug)]
-struct Entry<T> {
-    id: ExpressionId,
-    subscription_ids: Vec<T>,
-    node: ATreeNode,
-    use_count: usize,
-    cost: u64,
-}
 
-impl<T> Entry<T> {
-    fn new(id: ExpressionId, node: ATreeNode, subscription_id: Option<T>, cost: u64) -> Self {
-        Self {
-            id,
-            node,
-            use_count: 1,
-            subscription_ids: subscription_id
-                .map_or_else(Vec::new, |subscription_id| vec![subscription_id]),
-            cost,
+    /// Delete many expressions at once.
+    ///
+    /// The subscriptions that are not in the [`ATree`] are ignored.
+    ///
+    /// # Examples
+    ///
+    /// ```rust
+    /// use a_tree::{ATree, AttributeDefinition};
+    ///
+    /// let definitions = [AttributeDefinition::integer("exchange_id")];
+    /// let mut atree = ATree::new(&definitions).unwrap();
+    /// atree.insert_bulk([(1u64, "exchange_id = 1"), (2u64, "exchange_id = 2")]).unwrap();
+    ///
+    /// atree.delete_bulk(&[1u64, 2u64, 3u64]);
+    ///
+    /// let mut builder = atree.make_event();
+    /// builder.with_integer("exchange_id", 1).unwrap();
+    /// assert!(atree.search(&builder.build().unwrap()).unwrap().matches().is_empty());
+    /// ```
+    pub fn delete_bulk<'a, I>(&mut self, subscription_ids: I)
+    where
+        I: IntoIterator<Item = &'a T>,
+        T: 'a,
+    {
+        for subscription_id in subscription_ids {
+            self.delete(subscription_id);
         }
     }
 
     #[inline]
-    const fn is_leaf(&self) -> bool {
-        matches!(self.node, ATreeNode::LNode(_))
+    fn delete_node(&mut self, subscription_id: &T, node_id: NodeId) {
+        let children = decrement_use_count(
+            subscription_id,
+            node_id,
+            &mut self.nodes,
+            &mut self.expression_to_node,
+            &mut self.roots,
+            &mut self.predicates,
+            &mut self.index,
+            &mut self.nodes_by_ids,
+            &mut self.max_level,
+        );
+
+        if let Some(children) = children {
+            for child in children {
+                self.delete_node(subscription_id, child);
+            }
+        }
     }
 
-    #[inline]
-    const fn is_root(&self) -> bool {
-        matches!(self.node, ATreeNode::RNode(_))
+    /// The memory used by the [`ATree`], broken down by its parts.
+    ///
+    /// # Examples
+    ///
+    /// ```rust
+    /// use a_tree::{ATree, AttributeDefinition};
+    ///
+    /// let definitions = [AttributeDefinition::string("country")];
+    /// let mut atree = ATree::new(&definitions).unwrap();
+    /// atree.insert(&1u64, "country = 'CA'").unwrap();
+    ///
+    /// let usage = atree.memory_usage();
+    /// assert!(usage.strings > 0);
+    /// assert!(usage.total() > usage.nodes);
+    /// ```
+    pub fn memory_usage(&self) -> MemoryUsage {
+        memory::usage(self)
     }
 
-    #[inline]
-    const fn level(&self) -> usize {
-        self.node.level()
+    /// Release the memory left behind by the deletions.
+    ///
+    /// The deletions leave vacant slots between the nodes and keep the strings of the deleted
+    /// expressions along with the buffers sized for the largest state the [`ATree`] ever had.
+    /// Compacting renumbers the nodes densely, rebuilds the predicates to evaluate (and the
+    /// predicate index, if any), drops the strings that no predicate references anymore and
+    /// shrinks the buffers to what is used. The matches of the searches are not affected but the
+    /// [`StringId`] returned by [`ATree::intern()`] and the events built before compacting are
+    /// invalidated.
+    ///
+    /// This walks over the whole tree; it is meant to be called once in a while (e.g. after a
+    /// rotation of the expressions or during a low-traffic window).
+    ///
+    /// # Examples
+    ///
+    /// ```rust
+    /// use a_tree::{ATree, AttributeDefinition};
+    ///
+    /// let definitions = [AttributeDefinition::string("country")];
+    /// let mut atree = ATree::new(&definitions).unwrap();
+    /// for id in 0..100u64 {
+    ///     atree.insert(&id, &format!("country = 'country-{id}'")).unwrap();
+    /// }
+    /// for id in 1..100u64 {
+    ///     atree.delete(&id);
+    /// }
+    /// let before = atree.memory_usage();
+    ///
+    /// atree.compact();
+    ///
+    /// assert!(atree.memory_usage().total() < before.total());
+    /// let mut builder = atree.make_event();
+    /// builder.with_string("country", "country-0").unwrap();
+    /// let report = atree.search(&builder.build().unwrap()).unwrap();
+    /// assert_eq!(report.matches(), [&0u64]);
+    /// ```
+    pub fn compact(&mut self) {
+        memory::compact(self);
     }
 
-    #[inline]
-    fn evaluate(&self, event: &Event) -> Option<bool> {
-        self.node.evaluate(event)
-    }
-
-    #[inline]
-    fn operator(&self) -> Operator {
-        self.node.operator()
-    }
-
-    #[inline]
-    fn children(&self) -> &[NodeId] {
-        self.node.children()
-    }
-
-    #[inline]
-    fn parents(&self) -> &[NodeId] {
-        self.node.parents()
-    }
-}
+    /// Export the [`ATree`] to the Graphviz format.
+    pub fn to_graphviz(&self) -> String {
+        const DEFAULT_CAPACITY: usize = 100_000;
+        let mut builder = String::with_capacity(DEFAULT_CAPACITY);
+        builder.push_str("digraph {\n");
+        builder.push_str("rankdir = TB;\n");
+        builder.push_str(r#"node [shape = "record"];"#);
+        builder.push('\n');
+        let mut relations = Vec::with_capacity(DEFAULT_CAPACITY);
+        let mut levels = vec![vec![]; self.max_level];
+        for (id, entry) in &self.nodes {
+            match &entry.node {
+                ATreeNode::LNode(LNode {
+                    parents, predicate, ..
+                }) => {
+                    let node = format!(
+                        r#"node_{id} [label = "{{{id} | level: {} | {predicate} | subscriptions: {:?} | l-node}}", style = "rounded"];"#,
+                        entry.level(),
+                        entry.subscription_ids
+                    );
+                    levels[entry.level() - 1].push((id, node));
 
-#[derive(Clone, Debug)]
-#[allow(clippy::enum_variant_names)]
-enum ATreeNode {
-    LNode(LNode),
-    INode(INode),
-    RNode(RNode),
-}
+                    for parent_id in parents {
+                        relations.push(format!("node_{id} -> node_{parent_id};"));
+                    }
+                }
+                ATreeNode::INode(INode {
+                    children,
+                    parents,
+                    operator,
+                    ..
+                }) => {
+                    let node = format!(
+                        r#"node_{id} [label = "{{{id} | level: {} | {operator:#?} | subscriptions: {:?} | i-node}}"];"#,
+                        entry.level(),
+                        entry.subscription_ids
+                    );
+                    levels[entry.level() - 1].push((id, node));
 
-impl ATreeNode {
-    #[inline]
-    fn lnode(predicate: &Predicate) -> Self {
-        Self::LNode(LNode {
-            level: 1,
-            parents: vec![],
-            predicate: predicate.clone(),
-        })
-    }
+                    for parent_id in parents {
+                        relations.push(format!("node_{id} -> node_{parent_id};"));
+                    }
 
-    #[inline]
-    const fn level(&self) -> usize {
-        match self {
-            Self::RNode(node) => node.level,
-            Self::LNode(node) => node.level,
-            Self::INode(node) => node.level,
-        }
-    }
+                    for child_id in children {
+                        relations.push(format!("node_{id} -> node_{child_id};"));
+                    }
+                }
+                ATreeNode::RNode(RNode {
+                    children, operator, ..
+                }) => {
+                    let node = format!(
+                        r#"node_{id} [label = "{{{id} | level: {} | {operator:#?} | subscriptions: {:?} | r-node}}"];"#,
+                        entry.level(),
+                        entry.subscription_ids
+                    );
+                    levels[entry.level() - 1].push((id, node));
 
-    #[inline]
-    fn evaluate(&self, event: &Event) -> Option<bool> {
-        match self {
-            Self::LNode(node) => node.predicate.evaluate(event),
-            node => unreachable!("evaluating {node:?} which is not a predicate; this is a bug."),
+                    for child_id in children {
+                        relations.push(format!("node_{id} -> node_{child_id};"));
+                    }
+                }
+            }
         }
-    }
 
-    #[inline]
-    fn operator(&self) -> Operator {
-        match self {
-            Self::LNode(_) => {
-                unreachable!("trying to get the operator of leaf node; this is a bug");
+        builder.push_str("\n// nodes\n");
+        for entries in levels.into_iter().rev() {
+            for (_, node) in entries.iter() {
+                builder.push_str(node);
+                builder.push('\n');
             }
-            Self::RNode(RNode { operator, .. }) | Self::INode(INode { operator, .. }) => {
-                operator.clone()
+
+            builder.push_str("{rank = same; ");
+            for (id, _) in entries {
+                builder.push_str(&format!("node_{id}; "));
             }
+            builder.push_str("};\n");
         }
-    }
 
-    #[inline]
-    fn children(&self) -> &[NodeId] {
-        match self {
-            Self::INode(INode { children, .. }) | Self::RNode(RNode { children, .. }) => children,
-            Self::LNode(_) => unreachable!("cannot get children for l-node; this is a bug"),
+        builder.push_str("\n// edges\n");
+        for relation in relations {
+            builder.push_str(&relation);
+            builder.push('\n');
         }
+
+        builder.push('}');
+        builder
     }
+}
 
-    #[inline]
-    fn parents(&self) -> &[NodeId] {
-        match self {
-            Self::INode(INode { parents, .. }) | Self::LNode(LNode { parents, .. }) => parents,
-            Self::RNode(_) => unreachable!("cannot get parents for r-node; this is a bug"),
-        }
+impl ATree<u64> {
+    /// Write a frozen image of the [`ATree`] that [`FrozenATree::load_mmap()`] searches in place
+    /// from the mapped file.
+    ///
+    /// The image holds what the [`FrozenATree`] of the [`ATree`] needs to search, i.e. the
+    /// attributes, the strings and the predicates followed by the nodes, their children, their
+    /// parents and their subscription IDs as arrays of fixed-width little-endian records that are
+    /// aligned on 8 bytes. Unlike a snapshot, it cannot be loaded back into an [`ATree`].
+    ///
+    /// # Examples
+    ///
+    /// ```rust
+    /// use a_tree::{ATree, AttributeDefinition, FrozenATree};
+    ///
+    /// let definitions = [AttributeDefinition::integer("exchange_id")];
+    /// let mut atree = ATree::new(&definitions).unwrap();
+    /// atree.insert(&1u64, "exchange_id = 5").unwrap();
+    ///
+    /// let mut image = Vec::new();
+    /// atree.save_frozen(&mut image).unwrap();
+    /// let frozen = FrozenATree::load(&image).unwrap();
+    ///
+    /// let mut builder = frozen.make_event();
+    /// builder.with_integer("exchange_id", 5).unwrap();
+    /// let event = builder.build().unwrap();
+    /// assert_eq!(frozen.search(&event).unwrap().matches(), [&1u64]);
+    /// ```
+    pub fn save_frozen<W: Write>(&self, writer: &mut W) -> io::Result<()> {
+        frozen::save(self, writer)
     }
+}
 
-    #[inline]
-    fn add_parent(&mut self, parent_id: NodeId) {
-        match self {
-            ATreeNode::INode(node) => {
-                node.parents.push(parent_id);
-            }
-            ATreeNode::LNode(node) => {
-                node.parents.push(parent_id);
-            }
-            ATreeNode::RNode(node) => {
-                unreachable!("trying to insert parents to r-node {node:?} which cannot have any parents; this is a bug");
+#[inline]
+#[allow(clippy::too_many_arguments)]
+fn decrement_use_count<T: Eq + Hash>(
+    subscription_id: &T,
+    node_id: NodeId,
+    nodes: &mut Slab<Entry<T>>,
+    expression_to_node: &mut HashMap<ExpressionId, NodeId>,
+    roots: &mut Roots,
+    predicates: &mut Predicates,
+    index: &mut Option<PredicateIndex>,
+    nodes_by_ids: &mut HashMap<T, NodeId>,
+    max_level: &mut usize,
+) -> Option<Vec<NodeId>> {
+    let node = &mut nodes[node_id];
+    node.use_count -= 1;
+    let mut children = None;
+    // The same ID can have been inserted more than once for the expression; all of its
+    // occurrences go since the ID is no longer mapped to the node.
+    let mut position = 0;
+    node.priorities.retain(|_| {
+        let keep = node.subscription_ids[position] != *subscription_id;
+        position += 1;
+        keep
+    });
+    node.subscription_ids.retain(|x| x != subscription_id);
+    nodes_by_ids.remove(subscription_id);
+    if node.use_count == 0 {
+        if !node.is_leaf() {
+            children = Some(node.children().to_vec());
+        }
+        let expression_id = node.id;
+        roots.remove(node_id, node.level());
+        if let Some(predicate) = node.node.predicate() {
+            predicates.remove(node_id, predicate);
+            if let Some(index) = index.as_mut() {
+                index.remove(node_id, predicate);
             }
         }
+        *max_level = roots.max_level();
+        expression_to_node.remove(&expression_id);
+        nodes.remove(node_id);
+        // The children that are shared with other expressions outlive the node so they must not
+        // keep it as a parent.
+        for child_id in children.iter().flatten() {
+            nodes[*child_id].node.remove_parent(node_id);
+        }
     }
-}
 
-#[derive(Clone, Debug)]
-struct LNode {
-    parents: Vec<NodeId>,
-    level: usize,
-    predicate: Predicate,
+    children
 }
 
-#[derive(Clone, Debug)]
-struct INode {
-    parents: Vec<NodeId>,
-    children: Vec<NodeId>,
-    level: usize,
-    operator: Operator,
+#[inline]
+fn insert_node<T>(
+    expression_to_node: &mut HashMap<ExpressionId, NodeId>,
+    nodes: &mut Slab<Entry<T>>,
+    expression_id: &ExpressionId,
+    node: ATreeNode,
+    subscription: Option<(T, u32)>,
+    cost: u64,
+) -> NodeId {
+    let entry = Entry::new(*expression_id, node, subscription, cost);
+    let node_id = nodes.insert(entry);
+    if expression_to_node.insert(*expression_id, node_id).is_some() {
+        unreachable!("{expression_id} is already present; this is a bug");
+    }
+    node_id
 }
 
-#[derive(Clone, Debug)]
-struct RNode {
-    children: Vec<NodeId>,
-    level: usize,
-    operator: Operator,
+#[inline]
+fn add_parent<T>(entry: &mut Entry<T>, node_id: NodeId) {
+    entry.node.add_parent(node_id);
 }
 
-#[derive(Debug)]
-/// Structure that holds the search results from the [`ATree::search()`] function
-pub struct Report<'a, T> {
-    matches: Vec<&'a T>,
+#[inline]
+fn add_subscription_id<T: Eq + Hash + Clone>(
+    subscription_id: &T,
+    priority: u32,
+    node_id: NodeId,
+    nodes: &mut Slab<Entry<T>>,
+    nodes_by_ids: &mut HashMap<T, NodeId>,
+) {
+    let entry = &mut nodes[node_id];
+    entry.subscription_ids.push(subscription_id.clone());
+    entry.priorities.push(priority);
+    nodes_by_ids.insert(subscription_id.clone(), node_id);
 }
 
-impl<'a, T> Report<'a, T> {
-    const fn new(matches: Vec<&'a T>) -> Self {
-        Self { matches }
+/// Raise the bounds of the node and of all the nodes under it to the priority.
+///
+/// The bounds are never lowered when a subscription is deleted; a bound that is too high only
+/// makes [`ATree::search_top_k()`] evaluate more nodes than needed.
+fn raise_bound<T>(node_id: NodeId, priority: u32, nodes: &mut Slab<Entry<T>>) {
+    let entry = &mut nodes[node_id];
+    if entry.bound >= priority {
+        return;
+    }
+    entry.bound = priority;
+    if !entry.is_leaf() {
+        for child_id in entry.children().to_vec() {
+            raise_bound(child_id, priority, nodes);
+        }
     }
+}
+
+#[inline]
+fn increment_use_count<T>(node_id: NodeId, nodes: &mut Slab<Entry<T>>) {
+    nodes[node_id].use_count += 1;
+}
+
+#[inline]
+fn change_rnode_to_inode<T>(node_id: NodeId, nodes: &mut Slab<Entry<T>>) {
+    let entry = &mut nodes[node_id];
+    if let ATreeNode::RNode(RNode {
+        children,
+        level,
+        operator,
+    }) = &entry.node
+    {
+        let inode = ATreeNode::INode(INode {
+            parents: vec![],
+            children: children.to_vec(),
+            level: *level,
+            operator: operator.clone(),
+        });
+        entry.node = inode;
+    }
+}
+
+#[inline]
+fn choose_access_child<T>(
+    left_id: NodeId,
+    right_id: NodeId,
+    parent_id: NodeId,
+    nodes: &mut Slab<Entry<T>>,
+    predicates: &mut Predicates,
+    index: &mut Option<PredicateIndex>,
+) {
+    let left_entry = &nodes[left_id];
+    let right_entry = &nodes[right_id];
+    let accessor_id = if left_entry.cost < right_entry.cost {
+        left_id
+    } else {
+        right_id
+    };
+    add_parent(&mut nodes[accessor_id], parent_id);
+    add_predicate(accessor_id, nodes, predicates, index);
+}
+
+#[inline]
+fn add_predicate<T>(
+    node_id: NodeId,
+    nodes: &Slab<Entry<T>>,
+    predicates: &mut Predicates,
+    index: &mut Option<PredicateIndex>,
+) {
+    let entry = &nodes[node_id];
+    if let Some(predicate) = entry.node.predicate() {
+        if predicates.insert(node_id, predicate) {
+            if let Some(index) = index {
+                index.insert(node_id, predicate);
+            }
+        }
+    }
+}
+
+#[inline]
+fn process_predicates<'a, T, C: Collector<'a, T>>(
+    predicates: &[NodeId],
+    nodes: &'a Slab<Entry<T>>,
+    event: &Event,
+    matches: &mut C,
+    results: &mut EvaluationResult,
+    queues: &mut [Vec<(NodeId, &'a Entry<T>)>],
+) {
+    for predicate_id in predicates {
+        if matches.is_done() {
+            return;
+        }
+
+        let node = &nodes[*predicate_id];
+        // The evaluation is delayed as much as possible; if the predicate has no
+        // subscribers and no parents, there is no point in evaluating eagerly and
+        // it should only be evaluated if there is a need for it.
+        let delay_evaluation = node.subscription_ids.is_empty() && node.parents().is_empty();
+        if delay_evaluation {
+            matches.observe(Probe::Delayed);
+            continue;
+        }
+        if results.is_evaluated(*predicate_id) || matches.can_skip(node) {
+            matches.observe(Probe::Skipped);
+            continue;
+        }
+
+        let result = node.evaluate(event);
+        matches.observe(Probe::Evaluated);
+        results.set_result(*predicate_id, result);
+        add_matches(result, node, matches);
+
+        node.parents()
+            .iter()
+            .map(|parent_id| (*parent_id, &nodes[*parent_id]))
+            .for_each(|(parent_id, parent)| {
+                if matches!(parent.operator(), Operator::And) && !result.unwrap_or(true) {
+                    results.set_result(parent_id, Some(false));
+                    matches.observe(Probe::ShortCircuit);
+                } else {
+                    queues[parent.level() - 2].push((parent_id, parent));
+                }
+            })
+    }
+}
+
+#[inline]
+#[allow(clippy::too_many_arguments)]
+fn batch_process_predicate<'a, T>(
+    predicate_id: NodeId,
+    nodes: &'a Slab<Entry<T>>,
+    events: &[Event],
+    lanes: &[u64],
+    all: &[u64],
+    success: &mut [u64],
+    results: &mut BatchEvaluationResult,
+    matches: &mut [Vec<&'a T>],
+    queues: &mut [Vec<NodeId>],
+) {
+    let node = &nodes[predicate_id];
+    // Same as for a single event, the evaluation of the predicates without subscribers and
+    // parents is delayed until there is a need for it.
+    let delay_evaluation = node.subscription_ids.is_empty() && node.parents().is_empty();
+    if delay_evaluation || results.contains(predicate_id) {
+        return;
+    }
+
+    success.fill(0);
+    for event_id in BatchEvaluationResult::events(lanes) {
+        if let Some(true) = node.evaluate(&events[event_id]) {
+            BatchEvaluationResult::set_bit(success, event_id);
+        }
+    }
+    results.set_results(predicate_id, success, all);
+    batch_propagate(node, success, nodes, results, matches, queues);
+}
+
+/// Get the successes of a child for the specified events.
+///
+/// The results of the i-nodes are always known at this point since a node that succeeds for an
+/// event is always scheduled before its parents; only the predicates that are not part of the
+/// eagerly evaluated ones (i.e. the non-access children of the AND nodes) have to be evaluated.
+/// The `missing` lanes are a scratch buffer of the size of `lanes` that is kept for the whole
+/// batch so that visiting a child does not allocate.
+#[inline]
+#[allow(clippy::too_many_arguments)]
+fn batch_evaluate_child<'a, T>(
+    child_id: NodeId,
+    nodes: &'a Slab<Entry<T>>,
+    events: &[Event],
+    lanes: &[u64],
+    success: &mut [u64],
+    missing: &mut [u64],
+    results: &mut BatchEvaluationResult,
+    matches: &mut [Vec<&'a T>],
+) {
+    let child = &nodes[child_id];
+    if child.is_leaf() {
+        let evaluated = results.evaluated(child_id);
+        missing.copy_from_slice(lanes);
+        if let Some(evaluated) = evaluated {
+            let entries = missing.iter_mut().zip(evaluated);
+            entries.for_each(|(entry, evaluated)| *entry &= !evaluated);
+        }
+        if missing.iter().any(|entry| *entry != 0) {
+            success.fill(0);
+            for event_id in BatchEvaluationResult::events(missing) {
+                if let Some(true) = child.evaluate(&events[event_id]) {
+                    BatchEvaluationResult::set_bit(success, event_id);
+                    matches[event_id].extend(child.subscription_ids.iter());
+                }
+            }
+            results.set_results(child_id, success, missing);
+        }
+    }
+
+    match results.success(child_id) {
+        Some(results) => {
+            let entries = success.iter_mut().zip(results.iter().zip(lanes));
+            entries.for_each(|(entry, (result, lane))| *entry = result & lane);
+        }
+        None => success.fill(0),
+    }
+}
+
+#[inline]
+fn batch_propagate<'a, T>(
+    node: &'a Entry<T>,
+    success: &[u64],
+    nodes: &Slab<Entry<T>>,
+    results: &mut BatchEvaluationResult,
+    matches: &mut [Vec<&'a T>],
+    queues: &mut [Vec<NodeId>],
+) {
+    if success.iter().all(|entry| *entry == 0) {
+        return;
+    }
+
+    if !node.subscription_ids.is_empty() {
+        for event_id in BatchEvaluationResult::events(success) {
+            matches[event_id].extend(node.subscription_ids.iter());
+        }
+    }
+
+    if node.is_root() {
+        return;
+    }
+
+    for parent_id in node.parents() {
+        if results.insert(*parent_id) {
+            queues[nodes[*parent_id].level() - 2].push(*parent_id);
+        }
+    }
+}
+
+#[inline]
+fn evaluate_node<'a, T, C: Collector<'a, T>>(
+    node_id: NodeId,
+    event: &Event,
+    node: &'a Entry<T>,
+    nodes: &'a Slab<Entry<T>>,
+    results: &mut EvaluationResult,
+    matches: &mut C,
+) -> Option<bool> {
+    let children = node
+        .children()
+        .iter()
+        .map(|child_id| lazy_evaluate(*child_id, event, nodes, results, matches));
+    let result = match node.operator() {
+        Operator::And => evaluate_and(children),
+        Operator::Or => evaluate_or(children),
+    };
+    results.set_result(node_id, result);
+    result
+}
+
+/// Combine the results of the children of an `and` node; the children are evaluated lazily and
+/// the evaluation stops at the first one that fails.
+#[inline]
+fn evaluate_and(children: impl Iterator<Item = Option<bool>>) -> Option<bool> {
+    let mut acc = Some(true);
+    for result in children {
+        match (acc, result) {
+            (Some(false), _) => {
+                acc = Some(false);
+                break;
+            }
+            (_, Some(false)) => {
+                acc = Some(false);
+                break;
+            }
+            (Some(a), Some(b)) => {
+                acc = Some(a && b);
+            }
+            (_, _) => {
+                acc = None;
+            }
+        }
+    }
+    acc
+}
+
+/// Combine the results of the children of an `or` node; the children are evaluated lazily and
+/// the evaluation stops at the first one that succeeds.
+#[inline]
+fn evaluate_or(children: impl Iterator<Item = Option<bool>>) -> Option<bool> {
+    let mut acc = Some(false);
+    for result in children {
+        match (acc, result) {
+            (Some(true), _) => {
+                acc = Some(true);
+                break;
+            }
+            (_, Some(true)) => {
+                acc = Some(true);
+                break;
+            }
+            (Some(a), Some(b)) => {
+                acc = Some(a || b);
+            }
+            (_, _) => {
+                acc = None;
+            }
+        }
+    }
+
+    acc
+}
+
+#[inline]
+fn lazy_evaluate<'a, T, C: Collector<'a, T>>(
+    node_id: NodeId,
+    event: &Event,
+    nodes: &'a Slab<Entry<T>>,
+    results: &mut EvaluationResult,
+    matches: &mut C,
+) -> Option<bool> {
+    if results.is_evaluated(node_id) {
+        return results.get_result(node_id);
+    }
+    let node = &nodes[node_id];
+    let result = if node.is_leaf() {
+        let result = node.evaluate(event);
+        matches.observe(Probe::Evaluated);
+        results.set_result(node_id, result);
+        result
+    } else {
+        evaluate_node(node_id, event, node, nodes, results, matches)
+    };
+    add_matches(result, node, matches);
+    result
+}
+
+#[inline]
+fn add_matches<'a, T, C: Collector<'a, T>>(
+    result: Option<bool>,
+    node: &'a Entry<T>,
+    matches: &mut C,
+) {
+    if !node.subscription_ids.is_empty() {
+        if let Some(true) = result {
+            matches.collect(node);
+        }
+    }
+}
+
+/// A set of nodes kept in a contiguous list so that it is iterated as a slice (e.g. the
+/// predicates evaluated eagerly).
+///
+/// The position of every node in the list is tracked so that a node is removed by swapping it
+/// with the last one instead of searching the list.
+#[derive(Clone, Debug, Default)]
+struct NodeSet {
+    ids: Vec<NodeId>,
+    /// The position of every node in `ids` or [`NodeSet::ABSENT`] for the nodes not in the set.
+    positions: Vec<u32>,
+}
+
+impl NodeSet {
+    const ABSENT: u32 = u32::MAX;
+
+    fn with_capacity(capacity: usize) -> Self {
+        Self {
+            ids: Vec::with_capacity(capacity),
+            positions: Vec::with_capacity(capacity),
+        }
+    }
+
+    #[inline]
+    fn contains(&self, node_id: NodeId) -> bool {
+        self.positions
+            .get(node_id)
+            .is_some_and(|position| *position != Self::ABSENT)
+    }
+
+    /// Add the node and return whether it was not already present.
+    #[inline]
+    fn insert(&mut self, node_id: NodeId) -> bool {
+        if self.contains(node_id) {
+            return false;
+        }
+        if node_id >= self.positions.len() {
+            self.positions.resize(node_id + 1, Self::ABSENT);
+        }
+        self.positions[node_id] = self.ids.len() as u32;
+        self.ids.push(node_id);
+        true
+    }
+
+    /// Remove the node and return whether it was present.
+    #[inline]
+    fn remove(&mut self, node_id: NodeId) -> bool {
+        if !self.contains(node_id) {
+            return false;
+        }
+        let position = std::mem::replace(&mut self.positions[node_id], Self::ABSENT);
+        self.ids.swap_remove(position as usize);
+        if let Some(moved_id) = self.ids.get(position as usize) {
+            self.positions[*moved_id] = position;
+        }
+        true
+    }
+
+    fn memory_usage(&self) -> usize {
+        self.ids.capacity() * std::mem::size_of::<NodeId>()
+            + self.positions.capacity() * std::mem::size_of::<u32>()
+    }
+}
+
+impl Deref for NodeSet {
+    type Target = [NodeId];
+
+    #[inline]
+    fn deref(&self) -> &Self::Target {
+        &self.ids
+    }
+}
+
+/// The predicates evaluated eagerly, also grouped by the attribute they refer to so that the
+/// searches skip the groups of the attributes that the [`Event`] leaves undefined.
+///
+/// A predicate on an undefined attribute evaluates to `None`, which cannot make any node true, so
+/// skipping it does not change the matches. The `is null` and `is not null` checks are the
+/// exception and are kept in a group of their own that is always evaluated.
+#[derive(Clone, Debug, Default)]
+struct Predicates {
+    nodes: NodeSet,
+    /// A group per attribute followed by the group of the null checks.
+    groups: Vec<Vec<NodeId>>,
+    /// The position of every predicate in its group.
+    positions: Vec<u32>,
+}
+
+impl Predicates {
+    fn with_capacity(attributes: usize, capacity: usize) -> Self {
+        Self {
+            nodes: NodeSet::with_capacity(capacity),
+            groups: vec![vec![]; attributes + 1],
+            positions: Vec::with_capacity(capacity),
+        }
+    }
+
+    #[inline]
+    fn contains(&self, node_id: NodeId) -> bool {
+        self.nodes.contains(node_id)
+    }
+
+    #[inline]
+    fn group(&self, predicate: &Predicate) -> usize {
+        match predicate.kind() {
+            PredicateKind::Null(NullOperator::IsNull | NullOperator::IsNotNull) => {
+                self.groups.len() - 1
+            }
+            _ => predicate.attribute().index(),
+        }
+    }
+
+    /// Add the predicate and return whether it was not already present.
+    #[inline]
+    fn insert(&mut self, node_id: NodeId, predicate: &Predicate) -> bool {
+        if !self.nodes.insert(node_id) {
+            return false;
+        }
+        let group = self.group(predicate);
+        if node_id >= self.positions.len() {
+            self.positions.resize(node_id + 1, NodeSet::ABSENT);
+        }
+        self.positions[node_id] = self.groups[group].len() as u32;
+        self.groups[group].push(node_id);
+        true
+    }
+
+    /// Remove the predicate and return whether it was present.
+    #[inline]
+    fn remove(&mut self, node_id: NodeId, predicate: &Predicate) -> bool {
+        if !self.nodes.remove(node_id) {
+            return false;
+        }
+        let group = self.group(predicate);
+        let group = &mut self.groups[group];
+        let position = std::mem::replace(&mut self.positions[node_id], NodeSet::ABSENT);
+        group.swap_remove(position as usize);
+        if let Some(moved_id) = group.get(position as usize) {
+            self.positions[*moved_id] = position;
+        }
+        true
+    }
+
+    /// The predicates on the attribute, without its null checks.
+    #[inline]
+    fn by_attribute(&self, id: AttributeId) -> &[NodeId] {
+        &self.groups[id.index()]
+    }
+
+    #[inline]
+    fn null_checks(&self) -> &[NodeId] {
+        self.groups.last().map_or(&[], Vec::as_slice)
+    }
+
+    fn memory_usage(&self) -> usize {
+        self.nodes.memory_usage()
+            + self.positions.capacity() * std::mem::size_of::<u32>()
+            + self.groups.capacity() * std::mem::size_of::<Vec<NodeId>>()
+            + self
+                .groups
+                .iter()
+                .map(|group| group.capacity() * std::mem::size_of::<NodeId>())
+                .sum::<usize>()
+    }
+}
+
+impl Deref for Predicates {
+    type Target = [NodeId];
+
+    #[inline]
+    fn deref(&self) -> &Self::Target {
+        &self.nodes
+    }
+}
+
+/// The roots of the tree along with their amount per level so that the highest level is kept
+/// up to date without going through all the roots when one of them is deleted.
+#[derive(Clone, Debug, Default)]
+struct Roots {
+    nodes: NodeSet,
+    levels: Vec<usize>,
+}
+
+impl Roots {
+    fn with_capacity(capacity: usize) -> Self {
+        Self {
+            nodes: NodeSet::with_capacity(capacity),
+            levels: vec![],
+        }
+    }
+
+    #[inline]
+    fn insert(&mut self, node_id: NodeId, level: usize) {
+        if self.nodes.insert(node_id) {
+            if level >= self.levels.len() {
+                self.levels.resize(level + 1, 0);
+            }
+            self.levels[level] += 1;
+        }
+    }
+
+    #[inline]
+    fn remove(&mut self, node_id: NodeId, level: usize) {
+        if self.nodes.remove(node_id) {
+            self.levels[level] -= 1;
+            while self.levels.last() == Some(&0) {
+                self.levels.pop();
+            }
+        }
+    }
+
+    /// The highest level of the roots or `1` if there are none.
+    #[inline]
+    fn max_level(&self) -> usize {
+        self.levels.len().saturating_sub(1).max(1)
+    }
+
+    fn memory_usage(&self) -> usize {
+        self.nodes.memory_usage() + self.levels.capacity() * std::mem::size_of::<usize>()
+    }
+}
+
+impl Deref for Roots {
+    type Target = [NodeId];
+
+    #[inline]
+    fn deref(&self) -> &Self::Target {
+        &self.nodes
+    }
+}
+
+#[derive(Clone, Debug)]
+struct Entry<T> {
+    id: ExpressionId,
+    subscription_ids: Vec<T>,
+    /// The priorities of the subscriptions, in the same order.
+    priorities: Vec<u32>,
+    /// The highest priority of the subscriptions of this node and of the nodes above it.
+    bound: u32,
+    node: ATreeNode,
+    use_count: usize,
+    cost: u64,
+    outcomes: Outcomes,
+}
+
+impl<T> Entry<T> {
+    fn new(id: ExpressionId, node: ATreeNode, subscription: Option<(T, u32)>, cost: u64) -> Self {
+        let (subscription_ids, priorities) = subscription
+            .map_or_else(Default::default, |(subscription_id, priority)| {
+                (vec![subscription_id], vec![priority])
+            });
+        Self {
+            id,
+            node,
+            use_count: 1,
+            subscription_ids,
+            priorities,
+            bound: 0,
+            cost,
+            outcomes: Outcomes::default(),
+        }
+    }
+
+    #[inline]
+    const fn is_leaf(&self) -> bool {
+        matches!(self.node, ATreeNode::LNode(_))
+    }
+
+    #[inline]
+    const fn is_root(&self) -> bool {
+        matches!(self.node, ATreeNode::RNode(_))
+    }
+
+    #[inline]
+    const fn level(&self) -> usize {
+        self.node.level()
+    }
+
+    #[inline]
+    fn evaluate(&self, event: &Event) -> Option<bool> {
+        self.node.evaluate(event)
+    }
+
+    #[inline]
+    fn operator(&self) -> Operator {
+        self.node.operator()
+    }
+
+    #[inline]
+    fn children(&self) -> &[NodeId] {
+        self.node.children()
+    }
+
+    #[inline]
+    fn parents(&self) -> &[NodeId] {
+        self.node.parents()
+    }
+}
+
+#[derive(Clone, Debug)]
+#[allow(clippy::enum_variant_names)]
+enum ATreeNode {
+    LNode(LNode),
+    INode(INode),
+    RNode(RNode),
+}
+
+impl ATreeNode {
+    #[inline]
+    fn lnode(predicate: &Predicate) -> Self {
+        Self::LNode(LNode {
+            level: 1,
+            parents: vec![],
+            predicate: predicate.clone(),
+        })
+    }
+
+    #[inline]
+    const fn level(&self) -> usize {
+        match self {
+            Self::RNode(node) => node.level,
+            Self::LNode(node) => node.level,
+            Self::INode(node) => node.level,
+        }
+    }
+
+    #[inline]
+    fn predicate(&self) -> Option<&Predicate> {
+        match self {
+            Self::LNode(node) => Some(&node.predicate),
+            _ => None,
+        }
+    }
+
+    #[inline]
+    fn evaluate(&self, event: &Event) -> Option<bool> {
+        match self {
+            Self::LNode(node) => node.predicate.evaluate(event),
+            node => unreachable!("evaluating {node:?} which is not a predicate; this is a bug."),
+        }
+    }
+
+    #[inline]
+    fn operator(&self) -> Operator {
+        match self {
+            Self::LNode(_) => {
+                unreachable!("trying to get the operator of leaf node; this is a bug");
+            }
+            Self::RNode(RNode { operator, .. }) | Self::INode(INode { operator, .. }) => {
+                operator.clone()
+            }
+        }
+    }
+
+    #[inline]
+    fn children(&self) -> &[NodeId] {
+        match self {
+            Self::INode(INode { children, .. }) | Self::RNode(RNode { children, .. }) => children,
+            Self::LNode(_) => unreachable!("cannot get children for l-node; this is a bug"),
+        }
+    }
+
+    #[inline]
+    fn parents(&self) -> &[NodeId] {
+        match self {
+            Self::INode(INode { parents, .. }) | Self::LNode(LNode { parents, .. }) => parents,
+            Self::RNode(_) => unreachable!("cannot get parents for r-node; this is a bug"),
+        }
+    }
+
+    #[inline]
+    fn add_parent(&mut self, parent_id: NodeId) {
+        match self {
+            ATreeNode::INode(node) => {
+                node.parents.push(parent_id);
+            }
+            ATreeNode::LNode(node) => {
+                node.parents.push(parent_id);
+            }
+            ATreeNode::RNode(node) => {
+                unreachable!("trying to insert parents to r-node {node:?} which cannot have any parents; this is a bug");
+            }
+        }
+    }
+
+    #[inline]
+    fn remove_parent(&mut self, parent_id: NodeId) {
+        let parents = match self {
+            ATreeNode::INode(INode { parents, .. }) | ATreeNode::LNode(LNode { parents, .. }) => {
+                parents
+            }
+            ATreeNode::RNode(_) => return,
+        };
+        if let Some(position) = parents.iter().position(|id| *id == parent_id) {
+            parents.swap_remove(position);
+        }
+    }
+
+    #[inline]
+    fn children_mut(&mut self) -> &mut [NodeId] {
+        match self {
+            Self::INode(INode { children, .. }) | Self::RNode(RNode { children, .. }) => children,
+            Self::LNode(_) => unreachable!("cannot get children for l-node; this is a bug"),
+        }
+    }
+}
+
+#[derive(Clone, Debug)]
+struct LNode {
+    parents: Vec<NodeId>,
+    level: usize,
+    predicate: Predicate,
+}
+
+#[derive(Clone, Debug)]
+struct INode {
+    parents: Vec<NodeId>,
+    children: Vec<NodeId>,
+    level: usize,
+    operator: Operator,
+}
+
+#[derive(Clone, Debug)]
+struct RNode {
+    children: Vec<NodeId>,
+    level: usize,
+    operator: Operator,
+}
+
+/// Buffers that are reused between the searches made with the [`ATree::search_with()`] function.
+///
+/// Keeping a [`SearchContext`] around (e.g. one per thread) avoids allocating and initializing the
+/// evaluation results, the queues and the matches on every search; only the parts of the
+/// evaluation results that were modified by the previous search are reset.
+#[derive(Debug)]
+pub struct SearchContext<'atree, T> {
+    results: EvaluationResult,
+    queues: Vec<Vec<(NodeId, &'atree Entry<T>)>>,
+    candidates: Vec<NodeId>,
+    matches: Vec<&'atree T>,
+}
+
+impl<T> SearchContext<'_, T> {
+    const DEFAULT_CAPACITY: usize = 50;
+
+    fn new(nodes: usize, max_level: usize) -> Self {
+        Self {
+            results: EvaluationResult::new(nodes),
+            queues: vec![Vec::with_capacity(Self::DEFAULT_CAPACITY); max_level - 1],
+            candidates: Vec::with_capacity(Self::DEFAULT_CAPACITY),
+            matches: Vec::with_capacity(Self::DEFAULT_CAPACITY),
+        }
+    }
+
+    #[inline]
+    fn prepare(&mut self, nodes: usize, levels: usize) {
+        self.results.clear();
+        self.results.reserve(nodes);
+        if self.queues.len() < levels {
+            self.queues
+                .resize_with(levels, || Vec::with_capacity(Self::DEFAULT_CAPACITY));
+        }
+        self.queues.iter_mut().for_each(Vec::clear);
+        self.candidates.clear();
+        self.matches.clear();
+    }
+}
+
+/// The expressions of a bulk insertion once they are parsed and optimized.
+pub(crate) struct Batch<T> {
+    arena: Arena,
+    roots: Vec<(T, NodeRef)>,
+    /// The expressions already in the tree, if they are cached.
+    cached: Vec<(T, NodeId)>,
+    /// The roots of the cached expressions of the batch so that their duplicates are reused.
+    parsed: HashMap<u128, NodeRef>,
+}
+
+#[derive(Debug)]
+/// Structure that holds the search results from the [`ATree::search()`] function
+pub struct Report<'a, T> {
+    matches: Vec<&'a T>,
+}
+
+impl<'a, T> Report<'a, T> {
+    pub(crate) const fn new(matches: Vec<&'a T>) -> Self {
+        Self { matches }
+    }
+
+    #[inline]
+    /// Get the search matches
+    pub fn matches(&self) -> &[&'a T] {
+        &self.matches
+    }
+}
+
+#[cfg(test)]
+mod tests {
+    use super::*;
+
+    const AN_INVALID_BOOLEAN_EXPRESSION: &str = "invalid in (1, 2, 3 and";
+    const AN_EXPRESSION: &str = "exchange_id = 1";
+    const A_NOT_EXPRESSION: &str = "not private";
+    const AN_EXPRESSION_WITH_AND_OPERATORS: &str =
+        r#"exchange_id = 1 and deals one of ["deal-1", "deal-2"]"#;
+    const AN_EXPRESSION_WITH_OR_OPERATORS: &str =
+        r#"exchange_id = 1 or deals one of ["deal-1", "deal-2"]"#;
+    const A_COMPLEX_EXPRESSION: &str = r#"exchange_id = 1 and not private and deal_ids one of ["deal-1", "deal-2"] and segment_ids one of [1, 2, 3] and country = 'CA' and city in ['QC'] or country = 'US' and city in ['AZ']"#;
+    const ANOTHER_COMPLEX_EXPRESSION: &str = r#"exchange_id = 1 and not private and deal_ids one of ["deal-1", "deal-2"] and segment_ids one of [1, 2, 3] and country in ['FR', 'GB']"#;
+
+    fn is_sync_and_send<T: Send + Sync>() {}
+
+    #[test]
+    fn support_sync_and_send_traits() {
+        is_sync_and_send::<ATree<u64>>();
+    }
+
+    #[test]
+    fn can_build_an_atree() {
+        let definitions = [
+            AttributeDefinition::boolean("private"),
+            AttributeDefinition::string_list("deals"),
+            AttributeDefinition::integer("exchange_id"),
+            AttributeDefinition::float("bidfloor"),
+            AttributeDefinition::string("country"),
+            AttributeDefinition::integer_list("segment_ids"),
+        ];
+
+        let result = ATree::<u64>::new(&definitions);
+
+        assert!(result.is_ok());
+    }
+
+    #[test]
+    fn return_an_error_on_duplicate_definitions() {
+        let definitions = [
+            AttributeDefinition::boolean("private"),
+            AttributeDefinition::string("country"),
+            AttributeDefinition::string_list("deals"),
+            AttributeDefinition::integer("exchange_id"),
+            AttributeDefinition::float("bidfloor"),
+            AttributeDefinition::integer("country"),
+            AttributeDefinition::integer_list("segment_ids"),
+        ];
+
+        let result = ATree::<u64>::new(&definitions);
+
+        assert!(result.is_err());
+    }
+
+    #[test]
+    fn return_an_error_on_invalid_boolean_expression() {
+        let definitions = [
+            AttributeDefinition::boolean("private"),
+            AttributeDefinition::string("country"),
+            AttributeDefinition::string_list("deals"),
+            AttributeDefinition::integer("exchange_id"),
+            AttributeDefinition::integer_list("segment_ids"),
+        ];
+        let mut atree = ATree::new(&definitions).unwrap();
+
+        let result = atree.insert(&1u64, AN_INVALID_BOOLEAN_EXPRESSION);
+
+        assert!(result.is_err());
+    }
+
+    #[test]
+    fn return_an_error_on_empty_boolean_expression() {
+        let definitions = [
+            AttributeDefinition::boolean("private"),
+            AttributeDefinition::string("country"),
+            AttributeDefinition::string_list("deals"),
+            AttributeDefinition::integer("exchange_id"),
+            AttributeDefinition::integer_list("segment_ids"),
+        ];
+        let mut atree = ATree::new(&definitions).unwrap();
+
+        let result = atree.insert(&1u64, "");
+
+        assert!(result.is_err());
+    }
+
+    #[test]
+    fn can_insert_a_simple_expression() {
+        let definitions = [
+            AttributeDefinition::boolean("private"),
+            AttributeDefinition::string("country"),
+            AttributeDefinition::string_list("deals"),
+            AttributeDefinition::integer("exchange_id"),
+            AttributeDefinition::integer_list("segment_ids"),
+        ];
+        let mut atree = ATree::new(&definitions).unwrap();
+
+        let result = atree.insert(&1u64, AN_EXPRESSION);
+
+        assert!(result.is_ok());
+    }
+
+    #[test]
+    fn can_insert_an_expression_that_refers_to_a_rnode() {
+        let definitions = [
+            AttributeDefinition::boolean("private"),
+            AttributeDefinition::integer("exchange_id"),
+            AttributeDefinition::string_list("deal_ids"),
+        ];
+        let an_expression = "private or exchange_id = 1";
+        let another_expression =
+            r#"private or exchange_id = 1 or deal_ids one of ["deal-1", "deal-2"]"#;
+        let mut atree = ATree::new(&definitions).unwrap();
+        assert!(atree.insert(&1u64, an_expression).is_ok());
+        assert!(atree.insert(&2u64, another_expression).is_ok());
+    }
+
+    #[test]
+    fn can_insert_the_same_expression_multiple_times() {
+        let definitions = [
+            AttributeDefinition::boolean("private"),
+            AttributeDefinition::string("country"),
+            AttributeDefinition::string_list("deals"),
+            AttributeDefinition::integer("exchange_id"),
+            AttributeDefinition::integer_list("segment_ids"),
+        ];
+        let mut atree = ATree::new(&definitions).unwrap();
+
+        assert!(atree.insert(&1u64, AN_EXPRESSION).is_ok());
+        assert!(atree.insert(&2u64, AN_EXPRESSION).is_ok());
+    }
+
+    #[test]
+    fn can_insert_a_negative_expression() {
+        let definitions = [
+            AttributeDefinition::boolean("private"),
+            AttributeDefinition::string("country"),
+            AttributeDefinition::string_list("deals"),
+            AttributeDefinition::integer("exchange_id"),
+            AttributeDefinition::integer_list("segment_ids"),
+        ];
+        let mut atree = ATree::new(&definitions).unwrap();
+
+        let result = atree.insert(&1u64, A_NOT_EXPRESSION);
+
+        assert!(result.is_ok());
+    }
+
+    #[test]
+    fn can_insert_an_expression_with_and_operators() {
+        let definitions = [
+            AttributeDefinition::boolean("private"),
+            AttributeDefinition::string("country"),
+            AttributeDefinition::string_list("deals"),
+            AttributeDefinition::integer("exchange_id"),
+            AttributeDefinition::integer_list("segment_ids"),
+        ];
+        let mut atree = ATree::new(&definitions).unwrap();
+
+        let result = atree.insert(&1u64, AN_EXPRESSION_WITH_AND_OPERATORS);
+
+        assert!(result.is_ok());
+    }
+
+    #[test]
+    fn can_insert_an_expression_with_or_operators() {
+        let definitions = [
+            AttributeDefinition::boolean("private"),
+            AttributeDefinition::string("country"),
+            AttributeDefinition::string_list("deals"),
+            AttributeDefinition::integer("exchange_id"),
+            AttributeDefinition::integer_list("segment_ids"),
+        ];
+        let mut atree = ATree::new(&definitions).unwrap();
+
+        let result = atree.insert(&1u64, AN_EXPRESSION_WITH_OR_OPERATORS);
+
+        assert!(result.is_ok());
+    }
+
+    #[test]
+    fn can_insert_an_expression_with_mixed_operators() {
+        let definitions = [
+            AttributeDefinition::boolean("private"),
+            AttributeDefinition::integer("exchange_id"),
+            AttributeDefinition::string_list("deal_ids"),
+            AttributeDefinition::integer_list("segment_ids"),
+            AttributeDefinition::string("country"),
+            AttributeDefinition::string("city"),
+        ];
+        let mut atree = ATree::new(&definitions).unwrap();
+
+        let result = atree.insert(&1u64, A_COMPLEX_EXPRESSION);
+
+        assert!(result.is_ok());
+    }
+
+    #[test]
+    fn can_insert_multiple_expressions_with_mixed_operators() {
+        let definitions = [
+            AttributeDefinition::boolean("private"),
+            AttributeDefinition::integer("exchange_id"),
+            AttributeDefinition::string_list("deal_ids"),
+            AttributeDefinition::integer_list("segment_ids"),
+            AttributeDefinition::string("country"),
+            AttributeDefinition::string("city"),
+        ];
+        let mut atree = ATree::new(&definitions).unwrap();
+
+        assert!(atree.insert(&1u64, A_COMPLEX_EXPRESSION).is_ok());
+        assert!(atree.insert(&2u64, ANOTHER_COMPLEX_EXPRESSION).is_ok());
+    }
+
+    #[test]
+    fn return_the_same_matches_when_inserting_in_bulk() {
+        let definitions = [
+            AttributeDefinition::boolean("private"),
+            AttributeDefinition::integer("exchange_id"),
+            AttributeDefinition::string_list("deal_ids"),
+            AttributeDefinition::integer_list("segment_ids"),
+            AttributeDefinition::string("country"),
+            AttributeDefinition::string("city"),
+        ];
+        let expressions = [
+            (1u64, A_COMPLEX_EXPRESSION),
+            (2u64, ANOTHER_COMPLEX_EXPRESSION),
+            (3u64, "exchange_id = 1"),
+            (4u64, "exchange_id = 1 and not private"),
+            (5u64, "exchange_id = 1"),
+        ];
+        let mut atree = ATree::new(&definitions).unwrap();
+        for (id, expression) in expressions {
+            atree.insert(&id, expression).unwrap();
+        }
+        let mut bulk = ATree::new(&definitions).unwrap();
+
+        bulk.insert_bulk(expressions).unwrap();
+
+        assert_eq!(atree.max_level, bulk.max_level);
+        assert_eq!(atree.predicates.len(), bulk.predicates.len());
+        let mut builder = bulk.make_event();
+        builder.with_integer("exchange_id", 1).unwrap();
+        builder.with_boolean("private", false).unwrap();
+        builder
+            .with_string_list("deal_ids", &["deal-1", "deal-3"])
+            .unwrap();
+        builder.with_integer_list("segment_ids", &[2, 3]).unwrap();
+        builder.with_string("country", "CA").unwrap();
+        builder.with_string("city", "QC").unwrap();
+        let event = builder.build().unwrap();
+        let mut expected = atree.search(&event).unwrap().matches().to_vec();
+        let mut results = bulk.search(&event).unwrap().matches().to_vec();
+        expected.sort();
+        results.sort();
+        assert_eq!(expected, results);
+    }
+
+    #[test]
+    fn do_not_insert_any_expression_of_the_bulk_if_one_is_invalid() {
+        let definitions = [AttributeDefinition::integer("exchange_id")];
+        let mut atree = ATree::new(&definitions).unwrap();
+
+        let result =
+            atree.insert_bulk([(1u64, AN_EXPRESSION), (2u64, AN_INVALID_BOOLEAN_EXPRESSION)]);
+
+        assert!(result.is_err());
+        assert!(atree.nodes.is_empty());
+        assert!(atree.predicates.is_empty());
+    }
+
+    #[test]
+    fn can_search_an_empty_tree() {
+        let definitions = [
+            AttributeDefinition::boolean("private"),
+            AttributeDefinition::integer("exchange_id"),
+            AttributeDefinition::string_list("deal_ids"),
+            AttributeDefinition::string_list("deals"),
+            AttributeDefinition::integer_list("segment_ids"),
+            AttributeDefinition::string("country"),
+            AttributeDefinition::string("city"),
+        ];
+        let atree = ATree::new(&definitions).unwrap();
+        let mut builder = atree.make_event();
+        builder.with_boolean("private", false).unwrap();
+        let event = builder.build().unwrap();
+
+        let expected: Vec<&u64> = vec![];
+        let actual = atree.search(&event).unwrap().matches().to_vec();
+        assert_eq!(expected, actual);
+    }
+
+    #[test]
+    fn can_search_a_single_predicate() {
+        let definitions = [
+            AttributeDefinition::boolean("private"),
+            AttributeDefinition::integer("exchange_id"),
+            AttributeDefinition::string_list("deal_ids"),
+            AttributeDefinition::string_list("deals"),
+            AttributeDefinition::integer_list("segment_ids"),
+            AttributeDefinition::string("country"),
+            AttributeDefinition::string("city"),
+        ];
+        let mut atree = ATree::new(&definitions).unwrap();
+        atree.insert(&1u64, "private").unwrap();
+        let mut builder = atree.make_event();
+        builder.with_boolean("private", true).unwrap();
+        let event = builder.build().unwrap();
+
+        let expected = vec![&1u64];
+        let actual = atree.search(&event).unwrap().matches().to_vec();
+        assert_eq!(expected, actual);
+    }
+
+    #[test]
+    fn ignore_results_that_are_not_matched() {
+        let definitions = [
+            AttributeDefinition::boolean("private"),
+            AttributeDefinition::integer("exchange_id"),
+            AttributeDefinition::string_list("deal_ids"),
+            AttributeDefinition::string_list("deals"),
+            AttributeDefinition::integer_list("segment_ids"),
+            AttributeDefinition::string("country"),
+            AttributeDefinition::string("city"),
+        ];
+        let mut atree = ATree::new(&definitions).unwrap();
+        atree.insert(&1u64, "private").unwrap();
+        atree.insert(&2u64, A_COMPLEX_EXPRESSION).unwrap();
+        let mut builder = atree.make_event();
+        builder.with_boolean("private", false).unwrap();
+        let event = builder.build().unwrap();
+
+        let expected: Vec<&u64> = vec![];
+        let actual = atree.search(&event).unwrap().matches().to_vec();
+        assert_eq!(expected, actual);
+    }
+
+    #[test]
+    fn can_search_simple_expressions() {
+        let definitions = [
+            AttributeDefinition::boolean("private"),
+            AttributeDefinition::integer("exchange_id"),
+            AttributeDefinition::string_list("deal_ids"),
+            AttributeDefinition::string_list("deals"),
+            AttributeDefinition::integer_list("segment_ids"),
+            AttributeDefinition::string("country"),
+            AttributeDefinition::string("city"),
+        ];
+        let mut atree = ATree::new(&definitions).unwrap();
+        atree.insert(&1u64, "private").unwrap();
+        atree.insert(&2u64, "not private").unwrap();
+        let mut builder = atree.make_event();
+        builder.with_boolean("private", true).unwrap();
+        let event = builder.build().unwrap();
+
+        let expected = vec![&1u64];
+        let mut actual = atree.search(&event).unwrap().matches().to_vec();
+        actual.sort();
+        assert_eq!(expected, actual);
+    }
+
+    #[test]
+    fn can_search_complex_expressions() {
+        let definitions = [
+            AttributeDefinition::boolean("private"),
+            AttributeDefinition::integer("exchange_id"),
+            AttributeDefinition::string_list("deal_ids"),
+            AttributeDefinition::string_list("deals"),
+            AttributeDefinition::integer_list("segment_ids"),
+            AttributeDefinition::string("country"),
+            AttributeDefinition::string("city"),
+        ];
+        let mut atree = ATree::new(&definitions).unwrap();
+
+        atree.insert(&1, A_COMPLEX_EXPRESSION).unwrap();
+        atree.insert(&2, AN_EXPRESSION_WITH_AND_OPERATORS).unwrap();
+        atree.insert(&3, AN_EXPRESSION_WITH_OR_OPERATORS).unwrap();
+        let mut builder = atree.make_event();
+        builder.with_integer("exchange_id", 1).unwrap();
+        builder.with_boolean("private", true).unwrap();
+        builder
+            .with_string_list("deal_ids", &["deal-1", "deal-2"])
+            .unwrap();
+        builder
+            .with_string_list("deals", &["deal-1", "deal-2"])
+            .unwrap();
+        builder.with_integer_list("segment_ids", &[2, 3]).unwrap();
+        builder.with_string("country", "FR").unwrap();
+        let event = builder.build().unwrap();
+
+        let expected = vec![&2, &3];
+        let mut actual = atree.search(&event).unwrap().matches().to_vec();
+        actual.sort();
+        assert_eq!(expected, actual);
+    }
+
+    #[test]
+    fn can_search_a_tree_with_multiple_shared_sub_expressions() {
+        let definitions = [
+            AttributeDefinition::boolean("private"),
+            AttributeDefinition::integer("exchange_id"),
+            AttributeDefinition::string_list("deals"),
+            AttributeDefinition::integer_list("segment_ids"),
+            AttributeDefinition::string("country"),
+            AttributeDefinition::string("city"),
+        ];
+        let mut atree = ATree::new(&definitions).unwrap();
+        [
+            (
+                1,
+                r#"exchange_id = 1 and not private and deals one of ["deal-1", "deal-2"]"#,
+            ),
+            (
+                2,
+                r#"exchange_id = 1 and not private and deals one of ["deal-2", "deal-3"]"#,
+            ),
+            (
+                3,
+                r#"exchange_id = 1 and not private and deals one of ["deal-2", "deal-3"] and segment_ids one of [1, 2, 3, 4]"#,
+            ),
+            (
+                4,
+                r#"exchange_id = 1 and not private and deals one of ["deal-2", "deal-3"] and segment_ids one of [5, 6, 7, 8] and country in ["CA", "US"]"#,
+            ),
+        ].into_iter().for_each(|(id, expression)| {
+                atree.insert(&id, expression).unwrap()
+        });
+
+        let mut builder = atree.make_event();
+        builder.with_boolean("private", false).unwrap();
+        builder.with_integer("exchange_id", 1).unwrap();
+        builder
+            .with_string_list("deals", &["deal-1", "deal-3"])
+            .unwrap();
+        builder.with_integer_list("segment_ids", &[2, 3]).unwrap();
+        builder.with_string("country", "CA").unwrap();
+        let event = builder.build().unwrap();
+
+        let mut matches = atree.search(&event).unwrap().matches().to_vec();
+        matches.sort();
+        assert_eq!(vec![&1, &2, &3], matches);
+    }
+
+    #[test]
+    fn can_delete_a_single_predicate() {
+        let definitions = [AttributeDefinition::boolean("private")];
+        let mut atree = ATree::new(&definitions).unwrap();
+        atree.insert(&1u64, "private").unwrap();
+        let mut builder = atree.make_event();
+        builder.with_boolean("private", true).unwrap();
+        let event = builder.build().unwrap();
+
+        let results = atree.search(&event).unwrap().matches().to_vec();
+        assert_eq!(vec![&1u64], results);
+
+        atree.delete(&1u64);
+        let mut builder = atree.make_event();
+        builder.with_boolean("private", true).unwrap();
+        let event = builder.build().unwrap();
+        let results = atree.search(&event).unwrap().matches().to_vec();
+        assert!(results.is_empty());
+    }
+
+    #[test]
+    fn deleting_an_expression_only_removes_the_id_not_the_expression_if_it_is_still_referenced() {
+        let definitions = [
+            AttributeDefinition::boolean("private"),
+            AttributeDefinition::integer("exchange_id"),
+            AttributeDefinition::string_list("deal_ids"),
+            AttributeDefinition::string_list("deals"),
+            AttributeDefinition::integer_list("segment_ids"),
+            AttributeDefinition::string("country"),
+            AttributeDefinition::string("city"),
+        ];
+        let an_expression = "private or exchange_id = 1";
+        let another_expression =
+            r#"private or exchange_id = 1 or deal_ids one of ["deal-1", "deal-2"]"#;
+        let mut atree = ATree::new(&definitions).unwrap();
+        atree.insert(&1u64, an_expression).unwrap();
+        atree.insert(&2u64, another_expression).unwrap();
+        let mut builder = atree.make_event();
+        builder.with_integer("exchange_id", 1).unwrap();
+        let event = builder.build().unwrap();
 
-    #[inline]
-    /// Get the search matches
-    pub fn matches(&self) -> &[&'a T] {
-        &self.matches
-    }
-}
+        let results = atree.search(&event).unwrap().matches().to_vec();
+        assert_eq!(vec![&1u64, &2u64], results);
 
-#[cfg(test)]
-mod tests {
-    use super::*;
+        atree.delete(&1u64);
+        let mut builder = atree.make_event();
+        builder.with_integer("exchange_id", 1).unwrap();
+        let event = builder.build().unwrap();
+        let results = atree.search(&event).unwrap().matches().to_vec();
+        assert_eq!(vec![&2u64], results);
+    }
 
-    const AN_INVALID_BOOLEAN_EXPRESSION: &str = "invalid in (1, 2, 3 and";
-    const AN_EXPRESSION: &str = "exchange_id = 1";
-    const A_NOT_EXPRESSION: &str = "not private";
-    const AN_EXPRESSION_WITH_AND_OPERATORS: &str =
-        r#"exchange_id = 1 and deals one of ["deal-1", "deal-2"]"#;
-    const AN_EXPRESSION_WITH_OR_OPERATORS: &str =
-        r#"exchange_id = 1 or deals one of ["deal-1", "deal-2"]"#;
-    const A_COMPLEX_EXPRESSION: &str = r#"exchange_id = 1 and not private and deal_ids one of ["deal-1", "deal-2"] and segment_ids one of [1, 2, 3] and country = 'CA' and city in ['QC'] or country = 'US' and city in ['AZ']"#;
-    const ANOTHER_COMPLEX_EXPRESSION: &str = r#"exchange_id = 1 and not private and deal_ids one of ["deal-1", "deal-2"] and segment_ids one of [1, 2, 3] and country in ['FR', 'GB']"#;
+    #[test]
+    fn deleting_an_expression_only_removes_the_id_not_the_expression_if_it_has_multiple_subscription_ids(
+    ) {
+        let definitions = [
+            AttributeDefinition::boolean("private"),
+            AttributeDefinition::integer("exchange_id"),
+        ];
+        let an_expression = "private or exchange_id = 1";
+        let mut atree = ATree::new(&definitions).unwrap();
+        atree.insert(&1u64, an_expression).unwrap();
+        atree.insert(&2u64, an_expression).unwrap();
+        let mut builder = atree.make_event();
+        builder.with_integer("exchange_id", 1).unwrap();
+        let event = builder.build().unwrap();
 
-    fn is_sync_and_send<T: Send + Sync>() {}
+        let results = atree.search(&event).unwrap().matches().to_vec();
+        assert_eq!(vec![&1u64, &2u64], results);
 
-    #[test]
-    fn support_sync_and_send_traits() {
-        is_sync_and_send::<ATree<u64>>();
+        atree.delete(&1u64);
+        let mut builder = atree.make_event();
+        builder.with_integer("exchange_id", 1).unwrap();
+        let event = builder.build().unwrap();
+        let results = atree.search(&event).unwrap().matches().to_vec();
+        assert_eq!(vec![&2u64], results);
     }
 
     #[test]
-    fn can_build_an_atree() {
+    fn can_delete_root_node_when_all_references_are_deleted() {
         let definitions = [
             AttributeDefinition::boolean("private"),
-            AttributeDefinition::string_list("deals"),
             AttributeDefinition::integer("exchange_id"),
-            AttributeDefinition::float("bidfloor"),
-            AttributeDefinition::string("country"),
-            AttributeDefinition::integer_list("segment_ids"),
         ];
+        let an_expression = "private or exchange_id = 1";
+        let mut atree = ATree::new(&definitions).unwrap();
+        atree.insert(&1u64, an_expression).unwrap();
+        atree.insert(&2u64, an_expression).unwrap();
+        let mut builder = atree.make_event();
+        builder.with_integer("exchange_id", 1).unwrap();
+        let event = builder.build().unwrap();
 
-        let result = ATree::<u64>::new(&definitions);
+        let results = atree.search(&event).unwrap().matches().to_vec();
+        assert_eq!(vec![&1u64, &2u64], results);
 
-        assert!(result.is_ok());
+        atree.delete(&1u64);
+        atree.delete(&2u64);
+        let mut builder = atree.make_event();
+        builder.with_integer("exchange_id", 1).unwrap();
+        let event = builder.build().unwrap();
+        let results = atree.search(&event).unwrap().matches().to_vec();
+        assert!(results.is_empty());
     }
 
     #[test]
-    fn return_an_error_on_duplicate_definitions() {
+    fn return_the_same_matches_with_the_predicate_index() {
         let definitions = [
             AttributeDefinition::boolean("private"),
-            AttributeDefinition::string("country"),
-            AttributeDefinition::string_list("deals"),
             AttributeDefinition::integer("exchange_id"),
-            AttributeDefinition::float("bidfloor"),
-            AttributeDefinition::integer("country"),
+            AttributeDefinition::string_list("deal_ids"),
             AttributeDefinition::integer_list("segment_ids"),
+            AttributeDefinition::string("country"),
+            AttributeDefinition::string("city"),
+            AttributeDefinition::float("bidfloor"),
         ];
+        let expressions = [
+            A_COMPLEX_EXPRESSION,
+            ANOTHER_COMPLEX_EXPRESSION,
+            "exchange_id = 1",
+            "exchange_id <> 1 and country = 'CA'",
+            "not private or bidfloor >= 1.5",
+            "bidfloor < 2.0 and segment_ids none of [4, 5]",
+            "city is null or country not in ['CA']",
+            "exchange_id > 0 and exchange_id <= 1",
+        ];
+        let mut atree = ATree::new(&definitions).unwrap();
+        for (id, expression) in expressions.iter().enumerate() {
+            atree.insert(&(id as u64), expression).unwrap();
+        }
+        let mut indexed = atree.clone();
+        indexed.enable_predicate_index();
+        let mut builder = atree.make_event();
+        builder.with_integer("exchange_id", 1).unwrap();
+        builder.with_boolean("private", false).unwrap();
+        builder
+            .with_string_list("deal_ids", &["deal-1", "deal-3"])
+            .unwrap();
+        builder.with_integer_list("segment_ids", &[2, 4]).unwrap();
+        builder.with_string("country", "CA").unwrap();
+        builder.with_string("city", "QC").unwrap();
+        builder.with_float("bidfloor", 175, 2).unwrap();
+        let event = builder.build().unwrap();
 
-        let result = ATree::<u64>::new(&definitions);
-
-        assert!(result.is_err());
+        let mut expected = atree.search(&event).unwrap().matches().to_vec();
+        let mut results = indexed.search(&event).unwrap().matches().to_vec();
+        expected.sort();
+        results.sort();
+        assert_eq!(vec![&2u64, &4u64, &7u64], expected);
+        assert_eq!(expected, results);
     }
 
     #[test]
-    fn return_an_error_on_invalid_boolean_expression() {
+    fn keep_the_predicate_index_up_to_date_on_insertions_and_deletions() {
         let definitions = [
             AttributeDefinition::boolean("private"),
-            AttributeDefinition::string("country"),
-            AttributeDefinition::string_list("deals"),
             AttributeDefinition::integer("exchange_id"),
-            AttributeDefinition::integer_list("segment_ids"),
+            AttributeDefinition::string("country"),
         ];
         let mut atree = ATree::new(&definitions).unwrap();
+        atree.enable_predicate_index();
+        atree.insert(&1u64, "exchange_id = 1").unwrap();
+        atree
+            .insert(&2u64, "exchange_id = 1 and country in ['CA', 'US']")
+            .unwrap();
+        atree.insert(&3u64, "private or country = 'CA'").unwrap();
+        let mut builder = atree.make_event();
+        builder.with_integer("exchange_id", 1).unwrap();
+        builder.with_string("country", "CA").unwrap();
+        builder.with_boolean("private", false).unwrap();
+        let event = builder.build().unwrap();
 
-        let result = atree.insert(&1u64, AN_INVALID_BOOLEAN_EXPRESSION);
+        let mut results = atree.search(&event).unwrap().matches().to_vec();
+        results.sort();
+        assert_eq!(vec![&1u64, &2u64, &3u64], results);
 
-        assert!(result.is_err());
+        atree.delete(&1u64);
+        atree.delete(&3u64);
+        let mut builder = atree.make_event();
+        builder.with_integer("exchange_id", 1).unwrap();
+        builder.with_string("country", "CA").unwrap();
+        let event = builder.build().unwrap();
+        let results = atree.search(&event).unwrap().matches().to_vec();
+        assert_eq!(vec![&2u64], results);
     }
 
     #[test]
-    fn return_an_error_on_empty_boolean_expression() {
+    fn can_reuse_a_search_context_between_searches() {
         let definitions = [
             AttributeDefinition::boolean("private"),
-            AttributeDefinition::string("country"),
-            AttributeDefinition::string_list("deals"),
             AttributeDefinition::integer("exchange_id"),
+            AttributeDefinition::string_list("deal_ids"),
             AttributeDefinition::integer_list("segment_ids"),
+            AttributeDefinition::string("country"),
+            AttributeDefinition::string("city"),
         ];
         let mut atree = ATree::new(&definitions).unwrap();
+        atree.insert(&1u64, A_COMPLEX_EXPRESSION).unwrap();
+        atree.insert(&2u64, ANOTHER_COMPLEX_EXPRESSION).unwrap();
+        atree.insert(&3u64, "exchange_id = 1 or private").unwrap();
+        let events = [("FR", 1, false), ("CA", 2, true), ("GB", 1, false)]
+            .into_iter()
+            .map(|(country, exchange_id, private)| {
+                let mut builder = atree.make_event();
+                builder.with_integer("exchange_id", exchange_id).unwrap();
+                builder.with_boolean("private", private).unwrap();
+                builder.with_string_list("deal_ids", &["deal-2"]).unwrap();
+                builder.with_integer_list("segment_ids", &[3]).unwrap();
+                builder.with_string("country", country).unwrap();
+                builder.build().unwrap()
+            })
+            .collect::<Vec<_>>();
+
+        let mut context = atree.make_search_context();
+        for event in events.iter().chain(events.iter()) {
+            let mut expected = atree.search(event).unwrap().matches().to_vec();
+            let mut results = atree.search_with(&mut context, event).unwrap().to_vec();
+            expected.sort();
+            results.sort();
+            assert_eq!(expected, results);
+        }
+    }
+
+    #[test]
+    fn can_search_after_deleting_expressions() {
+        let definitions = [AttributeDefinition::integer("exchange_id")];
+        let mut atree = ATree::new(&definitions).unwrap();
+        let expressions = (0..200)
+            .map(|i| format!("exchange_id = {i}"))
+            .collect::<Vec<_>>();
+        for (id, expression) in expressions.iter().enumerate() {
+            atree.insert(&(id as u64), expression).unwrap();
+        }
+        for id in 0..150 {
+            atree.delete(&id);
+        }
+        let mut builder = atree.make_event();
+        builder.with_integer("exchange_id", 199).unwrap();
+        let event = builder.build().unwrap();
 
-        let result = atree.insert(&1u64, "");
+        let results = atree.search(&event).unwrap().matches().to_vec();
 
-        assert!(result.is_err());
+        assert_eq!(vec![&199u64], results);
     }
 
     #[test]
-    fn can_insert_a_simple_expression() {
+    fn match_the_null_checks_and_the_negations_of_the_undefined_attributes() {
         let definitions = [
             AttributeDefinition::boolean("private"),
-            AttributeDefinition::string("country"),
-            AttributeDefinition::string_list("deals"),
             AttributeDefinition::integer("exchange_id"),
-            AttributeDefinition::integer_list("segment_ids"),
+            AttributeDefinition::string("country"),
         ];
         let mut atree = ATree::new(&definitions).unwrap();
+        atree
+            .insert(&1u64, "exchange_id = 1 and country is null")
+            .unwrap();
+        atree
+            .insert(&2u64, "exchange_id = 1 and country is not null")
+            .unwrap();
+        atree
+            .insert(&3u64, "not private or exchange_id = 1")
+            .unwrap();
+        atree.insert(&4u64, "exchange_id <> 2").unwrap();
+        atree.insert(&5u64, "private is null").unwrap();
+        let mut builder = atree.make_event();
+        builder.with_integer("exchange_id", 1).unwrap();
+        let event = builder.build().unwrap();
 
-        let result = atree.insert(&1u64, AN_EXPRESSION);
+        let mut matches = atree.search(&event).unwrap().matches().to_vec();
+        matches.sort();
+        let frozen = atree.freeze();
+        let mut frozen_matches = frozen.search(&event).unwrap().matches().to_vec();
+        frozen_matches.sort();
 
-        assert!(result.is_ok());
+        assert_eq!(vec![&1u64, &3u64, &4u64, &5u64], matches);
+        assert_eq!(matches, frozen_matches);
     }
 
     #[test]
-    fn can_insert_an_expression_that_refers_to_a_rnode() {
+    fn keep_the_groups_of_the_predicates_consistent_when_deleting() {
         let definitions = [
-            AttributeDefinition::boolean("private"),
             AttributeDefinition::integer("exchange_id"),
-            AttributeDefinition::string_list("deal_ids"),
+            AttributeDefinition::string("country"),
         ];
-        let an_expression = "private or exchange_id = 1";
-        let another_expression =
-            r#"private or exchange_id = 1 or deal_ids one of ["deal-1", "deal-2"]"#;
         let mut atree = ATree::new(&definitions).unwrap();
-        assert!(atree.insert(&1u64, an_expression).is_ok());
-        assert!(atree.insert(&2u64, another_expression).is_ok());
+        for id in 0..20u64 {
+            let expression = format!("exchange_id = {id} or country is null");
+            atree.insert(&id, &expression).unwrap();
+        }
+
+        atree.delete_bulk(&(0..20u64).filter(|id| id % 2 == 0).collect::<Vec<_>>());
+
+        for (group, predicates) in atree.predicates.groups.iter().enumerate() {
+            for (position, node_id) in predicates.iter().enumerate() {
+                assert_eq!(position as u32, atree.predicates.positions[*node_id]);
+                assert!(atree.predicates.contains(*node_id));
+                let predicate = atree.nodes[*node_id].node.predicate().unwrap();
+                assert_eq!(group, atree.predicates.group(predicate));
+            }
+        }
+        assert_eq!(
+            atree.predicates.len(),
+            atree.predicates.groups.iter().map(Vec::len).sum::<usize>()
+        );
     }
 
     #[test]
-    fn can_insert_the_same_expression_multiple_times() {
+    fn keep_the_roots_and_the_predicates_consistent_when_deleting_in_any_order() {
+        let definitions = [AttributeDefinition::integer("exchange_id")];
+        let mut atree = ATree::new(&definitions).unwrap();
+        let expressions = (0..50)
+            .map(|i| format!("exchange_id = {i} or exchange_id = {}", i + 100))
+            .collect::<Vec<_>>();
+        for (id, expression) in expressions.iter().enumerate() {
+            atree.insert(&(id as u64), expression).unwrap();
+        }
+
+        let deleted = (0..50u64).filter(|id| id % 3 != 1).collect::<Vec<_>>();
+        atree.delete_bulk(&deleted);
+
+        for (position, node_id) in atree.predicates.iter().enumerate() {
+            assert_eq!(position as u32, atree.predicates.positions[*node_id]);
+            assert!(atree.nodes.contains(*node_id));
+        }
+        assert_eq!(2 * (50 - deleted.len()), atree.predicates.len());
+        assert_eq!(50 - deleted.len(), atree.roots.len());
+        assert!(atree
+            .roots
+            .iter()
+            .all(|node_id| atree.nodes.contains(*node_id)));
+        for i in 0..50 {
+            let mut builder = atree.make_event();
+            builder.with_integer("exchange_id", i + 100).unwrap();
+            let event = builder.build().unwrap();
+            let expected = if i % 3 == 1 { vec![i as u64] } else { vec![] };
+            let results = atree.search(&event).unwrap().matches().to_vec();
+            assert_eq!(expected.iter().collect::<Vec<_>>(), results);
+        }
+    }
+
+    #[test]
+    fn lower_the_maximum_level_once_the_highest_roots_are_deleted() {
         let definitions = [
             AttributeDefinition::boolean("private"),
-            AttributeDefinition::string("country"),
-            AttributeDefinition::string_list("deals"),
             AttributeDefinition::integer("exchange_id"),
-            AttributeDefinition::integer_list("segment_ids"),
         ];
         let mut atree = ATree::new(&definitions).unwrap();
+        atree.insert(&1u64, "exchange_id = 1").unwrap();
+        atree
+            .insert(&2u64, "(exchange_id = 2 or private) and exchange_id > 0")
+            .unwrap();
+        atree
+            .insert(&3u64, "(exchange_id = 3 or private) and exchange_id > 0")
+            .unwrap();
+        assert_eq!(3, atree.max_level);
 
-        assert!(atree.insert(&1u64, AN_EXPRESSION).is_ok());
-        assert!(atree.insert(&2u64, AN_EXPRESSION).is_ok());
+        atree.delete(&2u64);
+        assert_eq!(3, atree.max_level);
+        atree.delete(&3u64);
+        assert_eq!(1, atree.max_level);
+        atree.delete(&1u64);
+        assert_eq!(1, atree.max_level);
+        assert!(atree.roots.is_empty());
     }
 
     #[test]
-    fn can_insert_a_negative_expression() {
+    fn can_search_after_deleting_an_expression_that_shares_a_predicate() {
         let definitions = [
             AttributeDefinition::boolean("private"),
-            AttributeDefinition::string("country"),
-            AttributeDefinition::string_list("deals"),
             AttributeDefinition::integer("exchange_id"),
-            AttributeDefinition::integer_list("segment_ids"),
         ];
         let mut atree = ATree::new(&definitions).unwrap();
+        atree.insert(&1u64, "exchange_id = 1 or private").unwrap();
+        atree.insert(&2u64, "exchange_id = 1").unwrap();
+        atree.delete(&1u64);
+        let mut builder = atree.make_event();
+        builder.with_integer("exchange_id", 1).unwrap();
+        builder.with_boolean("private", false).unwrap();
+        let event = builder.build().unwrap();
 
-        let result = atree.insert(&1u64, A_NOT_EXPRESSION);
+        let results = atree.search(&event).unwrap().matches().to_vec();
 
-        assert!(result.is_ok());
+        assert_eq!(vec![&2u64], results);
     }
 
     #[test]
-    fn can_insert_an_expression_with_and_operators() {
+    fn subscribe_to_the_cached_node_of_a_normalized_duplicate() {
         let definitions = [
             AttributeDefinition::boolean("private"),
-            AttributeDefinition::string("country"),
-            AttributeDefinition::string_list("deals"),
             AttributeDefinition::integer("exchange_id"),
-            AttributeDefinition::integer_list("segment_ids"),
+            AttributeDefinition::string("country"),
         ];
         let mut atree = ATree::new(&definitions).unwrap();
+        atree.enable_expression_cache();
+        atree
+            .insert(&1u64, "exchange_id = 1 and private and country = 'CA'")
+            .unwrap();
+        let nodes = atree.nodes.len();
 
-        let result = atree.insert(&1u64, AN_EXPRESSION_WITH_AND_OPERATORS);
+        atree
+            .insert(&2u64, r#"country="CA" && exchange_id=1 && private"#)
+            .unwrap();
+        atree.delete(&1u64);
+        let mut builder = atree.make_event();
+        builder.with_integer("exchange_id", 1).unwrap();
+        builder.with_boolean("private", true).unwrap();
+        builder.with_string("country", "CA").unwrap();
+        let event = builder.build().unwrap();
 
-        assert!(result.is_ok());
+        assert_eq!(nodes, atree.nodes.len());
+        assert_eq!(
+            vec![&2u64],
+            atree.search(&event).unwrap().matches().to_vec()
+        );
     }
 
     #[test]
-    fn can_insert_an_expression_with_or_operators() {
+    fn parse_again_a_cached_expression_that_was_deleted() {
+        let definitions = [AttributeDefinition::integer("exchange_id")];
+        let mut atree = ATree::new(&definitions).unwrap();
+        atree.enable_expression_cache();
+        atree.insert(&1u64, "exchange_id = 1").unwrap();
+        atree.delete(&1u64);
+
+        atree.insert(&2u64, "exchange_id = 1").unwrap();
+        let mut builder = atree.make_event();
+        builder.with_integer("exchange_id", 1).unwrap();
+        let event = builder.build().unwrap();
+
+        assert_eq!(
+            vec![&2u64],
+            atree.search(&event).unwrap().matches().to_vec()
+        );
+    }
+
+    #[test]
+    fn reuse_the_duplicates_of_a_bulk_insertion() {
         let definitions = [
             AttributeDefinition::boolean("private"),
-            AttributeDefinition::string("country"),
-            AttributeDefinition::string_list("deals"),
             AttributeDefinition::integer("exchange_id"),
-            AttributeDefinition::integer_list("segment_ids"),
         ];
         let mut atree = ATree::new(&definitions).unwrap();
+        atree.enable_expression_cache();
+        atree.insert(&0u64, "private").unwrap();
+
+        atree
+            .insert_bulk([
+                (1u64, "exchange_id = 1 or private or exchange_id = 2"),
+                (2u64, "exchange_id = 2  or  exchange_id = 1 or private"),
+                (3u64, "private"),
+                (4u64, "exchange_id = 1 || private || exchange_id = 2"),
+            ])
+            .unwrap();
+        let mut builder = atree.make_event();
+        builder.with_integer("exchange_id", 1).unwrap();
+        builder.with_boolean("private", false).unwrap();
+        let event = builder.build().unwrap();
+        let mut results = atree.search(&event).unwrap().matches().to_vec();
+        results.sort();
 
-        let result = atree.insert(&1u64, AN_EXPRESSION_WITH_OR_OPERATORS);
-
-        assert!(result.is_ok());
+        assert_eq!(5, atree.nodes.len());
+        assert_eq!(vec![&1u64, &2u64, &4u64], results);
     }
 
     #[test]
-    fn can_insert_an_expression_with_mixed_operators() {
+    fn keep_the_cached_expressions_valid_after_compacting() {
         let definitions = [
-            AttributeDefinition::boolean("private"),
             AttributeDefinition::integer("exchange_id"),
-            AttributeDefinition::string_list("deal_ids"),
-            AttributeDefinition::integer_list("segment_ids"),
             AttributeDefinition::string("country"),
-            AttributeDefinition::string("city"),
         ];
         let mut atree = ATree::new(&definitions).unwrap();
+        atree.enable_expression_cache();
+        atree.insert(&1u64, "country = 'US'").unwrap();
+        atree
+            .insert(&2u64, "exchange_id = 1 and country = 'CA'")
+            .unwrap();
+        atree.delete(&1u64);
+        atree.compact();
+        let nodes = atree.nodes.len();
 
-        let result = atree.insert(&1u64, A_COMPLEX_EXPRESSION);
+        atree
+            .insert(&3u64, "country = 'CA' and exchange_id = 1")
+            .unwrap();
+        let mut builder = atree.make_event();
+        builder.with_integer("exchange_id", 1).unwrap();
+        builder.with_string("country", "CA").unwrap();
+        let event = builder.build().unwrap();
+        let mut results = atree.search(&event).unwrap().matches().to_vec();
+        results.sort();
 
-        assert!(result.is_ok());
+        assert_eq!(nodes, atree.nodes.len());
+        assert_eq!(vec![&2u64, &3u64], results);
     }
 
     #[test]
-    fn can_insert_multiple_expressions_with_mixed_operators() {
+    fn return_the_same_matches_after_compacting() {
         let definitions = [
             AttributeDefinition::boolean("private"),
             AttributeDefinition::integer("exchange_id"),
@@ -1089,285 +3462,646 @@ mod tests {
             AttributeDefinition::string("city"),
         ];
         let mut atree = ATree::new(&definitions).unwrap();
+        atree.enable_predicate_index();
+        for id in 0..50u64 {
+            let expression = match id % 4 {
+                0 => A_COMPLEX_EXPRESSION.to_string(),
+                1 => ANOTHER_COMPLEX_EXPRESSION.to_string(),
+                2 => format!(r#"exchange_id = {id} and deal_ids one of ["deal-{id}", "deal-1"]"#),
+                _ => format!("country = 'country-{id}' or city in ['QC', 'city-{id}']"),
+            };
+            atree.insert(&id, &expression).unwrap();
+        }
+        for id in (0..50u64).filter(|id| id % 3 != 0) {
+            atree.delete(&id);
+        }
+        let mut compacted = atree.clone();
+
+        compacted.compact();
+
+        assert_eq!(atree.nodes.len(), compacted.nodes.len());
+        assert_eq!(compacted.nodes.len(), compacted.nodes.capacity());
+        assert!(compacted.memory_usage().total() < atree.memory_usage().total());
+        let events = [("CA", 1, "deal-1", "QC"), ("country-3", 6, "deal-6", "MTL")];
+        for (country, exchange_id, deal, city) in events {
+            let build = |atree: &ATree<u64>| {
+                let mut builder = atree.make_event();
+                builder.with_integer("exchange_id", exchange_id).unwrap();
+                builder.with_boolean("private", false).unwrap();
+                builder.with_string_list("deal_ids", &[deal]).unwrap();
+                builder.with_integer_list("segment_ids", &[2]).unwrap();
+                builder.with_string("country", country).unwrap();
+                builder.with_string("city", city).unwrap();
+                builder.build().unwrap()
+            };
+            let mut expected = atree.search(&build(&atree)).unwrap().matches().to_vec();
+            let mut results = compacted
+                .search(&build(&compacted))
+                .unwrap()
+                .matches()
+                .to_vec();
+            expected.sort();
+            results.sort();
+            assert!(!expected.is_empty());
+            assert_eq!(expected, results);
+        }
+    }
 
-        assert!(atree.insert(&1u64, A_COMPLEX_EXPRESSION).is_ok());
-        assert!(atree.insert(&2u64, ANOTHER_COMPLEX_EXPRESSION).is_ok());
+    #[test]
+    fn do_not_confuse_the_strings_interned_after_compacting() {
+        let definitions = [AttributeDefinition::string("country")];
+        let mut atree = ATree::new(&definitions).unwrap();
+        atree.insert(&1u64, "country = 'CA'").unwrap();
+        atree.insert(&2u64, "country = 'US'").unwrap();
+        atree.delete(&1);
+        atree.compact();
+
+        // The new string gets the ID that the remaining one had before compacting.
+        atree.insert(&3u64, "country = 'FR'").unwrap();
+        atree.insert(&4u64, "country = 'US'").unwrap();
+
+        assert_eq!(2, atree.nodes.len());
+        for (country, expected) in [("FR", vec![&3u64]), ("US", vec![&2u64, &4u64])] {
+            let mut builder = atree.make_event();
+            builder.with_string("country", country).unwrap();
+            let event = builder.build().unwrap();
+            let mut results = atree.search(&event).unwrap().matches().to_vec();
+            results.sort();
+            assert_eq!(expected, results);
+        }
     }
 
     #[test]
-    fn can_search_an_empty_tree() {
+    fn return_the_same_matches_when_searching_a_batch_of_events() {
         let definitions = [
             AttributeDefinition::boolean("private"),
             AttributeDefinition::integer("exchange_id"),
             AttributeDefinition::string_list("deal_ids"),
-            AttributeDefinition::string_list("deals"),
             AttributeDefinition::integer_list("segment_ids"),
             AttributeDefinition::string("country"),
             AttributeDefinition::string("city"),
         ];
-        let atree = ATree::new(&definitions).unwrap();
-        let mut builder = atree.make_event();
-        builder.with_boolean("private", false).unwrap();
-        let event = builder.build().unwrap();
-
-        let expected: Vec<&u64> = vec![];
-        let actual = atree.search(&event).unwrap().matches().to_vec();
-        assert_eq!(expected, actual);
+        let expressions = [
+            A_COMPLEX_EXPRESSION,
+            ANOTHER_COMPLEX_EXPRESSION,
+            "exchange_id = 1",
+            "exchange_id = 1 and not private",
+            "exchange_id = 2 or (private and country = 'CA')",
+            r#"deal_ids one of ["deal-1"] and segment_ids one of [1, 2] and country in ['CA', 'US']"#,
+            "segment_ids all of [1, 2, 3, 4] or city is null",
+            "not (private or exchange_id > 2)",
+        ];
+        let mut atree = ATree::new(&definitions).unwrap();
+        for (id, expression) in expressions.iter().enumerate() {
+            atree.insert(&(id as u64), expression).unwrap();
+        }
+        let countries = ["CA", "US", "FR", "GB"];
+        let events = (0..150)
+            .map(|i| {
+                let mut builder = atree.make_event();
+                builder.with_integer("exchange_id", i % 4).unwrap();
+                builder.with_boolean("private", i % 3 == 0).unwrap();
+                builder
+                    .with_string_list("deal_ids", &[["deal-1", "deal-2"][i as usize % 2]])
+                    .unwrap();
+                builder
+                    .with_integer_list("segment_ids", &[i % 5, (i + 1) % 5])
+                    .unwrap();
+                builder
+                    .with_string("country", countries[i as usize % 4])
+                    .unwrap();
+                if i % 7 != 0 {
+                    builder.with_string("city", "QC").unwrap();
+                }
+                builder.build().unwrap()
+            })
+            .collect::<Vec<_>>();
+        let mut indexed = atree.clone();
+        indexed.enable_predicate_index();
+
+        for atree in [&atree, &indexed] {
+            let reports = atree.search_batch(&events).unwrap();
+
+            assert_eq!(events.len(), reports.len());
+            for (event, report) in events.iter().zip(reports) {
+                let mut expected = atree.search(event).unwrap().matches().to_vec();
+                let mut results = report.matches().to_vec();
+                expected.sort();
+                results.sort();
+                assert_eq!(expected, results);
+            }
+        }
     }
 
     #[test]
-    fn can_search_a_single_predicate() {
+    fn return_the_same_matches_when_searching_in_parallel() {
         let definitions = [
             AttributeDefinition::boolean("private"),
             AttributeDefinition::integer("exchange_id"),
-            AttributeDefinition::string_list("deal_ids"),
-            AttributeDefinition::string_list("deals"),
             AttributeDefinition::integer_list("segment_ids"),
             AttributeDefinition::string("country"),
-            AttributeDefinition::string("city"),
         ];
+        let countries = ["CA", "US", "FR", "GB"];
+        let expressions = (0..600)
+            .map(|i| match i % 4 {
+                0 => format!("exchange_id = {}", i % 13),
+                1 => format!(
+                    "exchange_id = {} and (segment_ids one of [{}] or country = '{}')",
+                    i % 5,
+                    i % 17,
+                    countries[i % 4]
+                ),
+                2 => format!("not private and segment_ids none of [{}, {}]", i % 7, i % 9),
+                _ => format!(
+                    "(private or exchange_id > {}) and country in ['{}', '{}']",
+                    i % 11,
+                    countries[i % 4],
+                    countries[(i + 1) % 4]
+                ),
+            })
+            .collect::<Vec<_>>();
         let mut atree = ATree::new(&definitions).unwrap();
-        atree.insert(&1u64, "private").unwrap();
+        for (id, expression) in expressions.iter().enumerate() {
+            atree.insert(&(id as u64), expression).unwrap();
+        }
+        let mut indexed = atree.clone();
+        indexed.enable_predicate_index();
+        let pool = ThreadPool::new(4).with_threshold(0);
+
+        for atree in [&atree, &indexed] {
+            for i in 0..20 {
+                let mut builder = atree.make_event();
+                builder.with_integer("exchange_id", i % 13).unwrap();
+                builder.with_boolean("private", i % 3 == 0).unwrap();
+                builder
+                    .with_integer_list("segment_ids", &[i % 17, i % 9, i % 7])
+                    .unwrap();
+                builder
+                    .with_string("country", countries[i as usize % 4])
+                    .unwrap();
+                let event = builder.build().unwrap();
+
+                let mut expected = atree.search(&event).unwrap().matches().to_vec();
+                let mut results = atree
+                    .search_parallel(&event, &pool)
+                    .unwrap()
+                    .matches()
+                    .to_vec();
+                expected.sort();
+                results.sort();
+                assert!(!expected.is_empty());
+                assert_eq!(expected, results);
+            }
+        }
+    }
+
+    #[test]
+    fn search_on_the_calling_thread_under_the_threshold() {
+        let definitions = [AttributeDefinition::integer("exchange_id")];
+        let mut atree = ATree::new(&definitions).unwrap();
+        atree.insert(&1u64, "exchange_id = 1").unwrap();
+        let pool = ThreadPool::new(2);
         let mut builder = atree.make_event();
-        builder.with_boolean("private", true).unwrap();
+        builder.with_integer("exchange_id", 1).unwrap();
         let event = builder.build().unwrap();
 
-        let expected = vec![&1u64];
-        let actual = atree.search(&event).unwrap().matches().to_vec();
-        assert_eq!(expected, actual);
+        let results = atree.search_parallel(&event, &pool).unwrap();
+
+        assert!(atree.nodes.len() < pool.threshold());
+        assert_eq!(vec![&1u64], results.matches());
     }
 
     #[test]
-    fn ignore_results_that_are_not_matched() {
+    fn move_the_access_child_to_the_predicate_that_rarely_succeeds() {
         let definitions = [
-            AttributeDefinition::boolean("private"),
-            AttributeDefinition::integer("exchange_id"),
-            AttributeDefinition::string_list("deal_ids"),
-            AttributeDefinition::string_list("deals"),
-            AttributeDefinition::integer_list("segment_ids"),
             AttributeDefinition::string("country"),
-            AttributeDefinition::string("city"),
+            AttributeDefinition::string_list("deal_ids"),
         ];
         let mut atree = ATree::new(&definitions).unwrap();
-        atree.insert(&1u64, "private").unwrap();
-        atree.insert(&2u64, A_COMPLEX_EXPRESSION).unwrap();
+        atree
+            .insert(&1u64, r#"country = 'US' and deal_ids one of ["deal-1"]"#)
+            .unwrap();
+        atree.enable_outcome_sampling(1);
         let mut builder = atree.make_event();
-        builder.with_boolean("private", false).unwrap();
+        builder.with_string("country", "US").unwrap();
+        builder.with_string_list("deal_ids", &["deal-2"]).unwrap();
         let event = builder.build().unwrap();
+        for _ in 0..20 {
+            assert!(atree.search(&event).unwrap().matches().is_empty());
+        }
 
-        let expected: Vec<&u64> = vec![];
-        let actual = atree.search(&event).unwrap().matches().to_vec();
-        assert_eq!(expected, actual);
+        atree.reoptimize();
+
+        let root_id = atree.roots[0];
+        let [first, second] = atree.nodes[root_id].children() else {
+            panic!("expected two children");
+        };
+        // Only the deal predicate fails for the sampled event.
+        assert_eq!(Some(false), atree.nodes[*first].evaluate(&event));
+        assert_eq!([*first], *atree.predicates);
+        assert_eq!([root_id], atree.nodes[*first].parents());
+        assert!(atree.nodes[*second].parents().is_empty());
+        let mut builder = atree.make_event();
+        builder.with_string("country", "US").unwrap();
+        builder.with_string_list("deal_ids", &["deal-1"]).unwrap();
+        let event = builder.build().unwrap();
+        assert_eq!(vec![&1u64], atree.search(&event).unwrap().matches());
     }
 
     #[test]
-    fn can_search_simple_expressions() {
+    fn return_the_same_matches_after_reoptimizing() {
         let definitions = [
             AttributeDefinition::boolean("private"),
             AttributeDefinition::integer("exchange_id"),
             AttributeDefinition::string_list("deal_ids"),
-            AttributeDefinition::string_list("deals"),
             AttributeDefinition::integer_list("segment_ids"),
             AttributeDefinition::string("country"),
             AttributeDefinition::string("city"),
         ];
+        let expressions = [
+            A_COMPLEX_EXPRESSION,
+            ANOTHER_COMPLEX_EXPRESSION,
+            "exchange_id = 1 and not private",
+            "exchange_id = 2 or (private and country = 'CA')",
+            r#"deal_ids one of ["deal-1"] and segment_ids one of [1, 2] and country in ['CA', 'US']"#,
+            "segment_ids all of [1, 2, 3, 4] or city is null",
+            "country = 'US' and exchange_id = 1 and not private",
+        ];
+        let countries = ["CA", "US", "FR", "GB"];
+        let events = |atree: &ATree<u64>| {
+            (0..60)
+                .map(|i| {
+                    let mut builder = atree.make_event();
+                    builder.with_integer("exchange_id", i % 4).unwrap();
+                    builder.with_boolean("private", i % 3 == 0).unwrap();
+                    builder
+                        .with_string_list("deal_ids", &[["deal-1", "deal-2"][i as usize % 2]])
+                        .unwrap();
+                    builder
+                        .with_integer_list("segment_ids", &[i % 5, (i + 1) % 5])
+                        .unwrap();
+                    builder
+                        .with_string("country", countries[i as usize % 4])
+                        .unwrap();
+                    if i % 7 != 0 {
+                        builder.with_string("city", "QC").unwrap();
+                    }
+                    builder.build().unwrap()
+                })
+                .collect::<Vec<_>>()
+        };
         let mut atree = ATree::new(&definitions).unwrap();
-        atree.insert(&1u64, "private").unwrap();
-        atree.insert(&2u64, "not private").unwrap();
-        let mut builder = atree.make_event();
-        builder.with_boolean("private", true).unwrap();
-        let event = builder.build().unwrap();
+        for (id, expression) in expressions.iter().enumerate() {
+            atree.insert(&(id as u64), expression).unwrap();
+        }
+        let mut indexed = atree.clone();
+        indexed.enable_predicate_index();
+
+        for mut atree in [atree, indexed] {
+            let events = events(&atree);
+            let expected = events
+                .iter()
+                .map(|event| {
+                    let mut matches = atree.search(event).unwrap().matches().to_vec();
+                    matches.sort();
+                    matches.into_iter().copied().collect::<Vec<_>>()
+                })
+                .collect::<Vec<_>>();
+            atree.enable_outcome_sampling(2);
+            for event in &events {
+                atree.search(event).unwrap();
+            }
 
-        let expected = vec![&1u64];
-        let mut actual = atree.search(&event).unwrap().matches().to_vec();
-        actual.sort();
-        assert_eq!(expected, actual);
+            atree.reoptimize();
+
+            for (event, expected) in events.iter().zip(expected) {
+                let mut results = atree.search(event).unwrap().matches().to_vec();
+                results.sort();
+                assert_eq!(expected, results.into_iter().copied().collect::<Vec<_>>());
+            }
+        }
     }
 
     #[test]
-    fn can_search_complex_expressions() {
+    fn return_the_same_matches_when_searching_the_changed_attributes_only() {
         let definitions = [
             AttributeDefinition::boolean("private"),
             AttributeDefinition::integer("exchange_id"),
             AttributeDefinition::string_list("deal_ids"),
-            AttributeDefinition::string_list("deals"),
             AttributeDefinition::integer_list("segment_ids"),
             AttributeDefinition::string("country"),
             AttributeDefinition::string("city"),
         ];
+        let expressions = [
+            A_COMPLEX_EXPRESSION,
+            ANOTHER_COMPLEX_EXPRESSION,
+            "exchange_id = 1 and not private",
+            "exchange_id = 2 or (private and country = 'CA')",
+            r#"deal_ids one of ["deal-1"] and segment_ids one of [1, 2] and country in ['CA', 'US']"#,
+            "segment_ids all of [1, 2, 3, 4] or city is null",
+            "country = 'US' and exchange_id = 1 and not private",
+            "not private and country = 'CA'",
+        ];
         let mut atree = ATree::new(&definitions).unwrap();
+        for (id, expression) in expressions.iter().enumerate() {
+            atree.insert(&(id as u64), expression).unwrap();
+        }
+        let mut indexed = atree.clone();
+        indexed.enable_predicate_index();
+
+        for atree in [atree, indexed] {
+            let exchange_id = atree.attribute("exchange_id").unwrap();
+            let private = atree.attribute("private").unwrap();
+            let city = atree.attribute("city").unwrap();
+            let event = |i: i64, country: &str| {
+                let mut builder = atree.make_event();
+                builder.set_integer(exchange_id, i % 3).unwrap();
+                builder.set_boolean(private, i % 4 == 0).unwrap();
+                builder
+                    .with_string_list("deal_ids", &["deal-1", "deal-2"])
+                    .unwrap();
+                builder.with_integer_list("segment_ids", &[1, 2]).unwrap();
+                builder.with_string("country", country).unwrap();
+                if i % 5 != 0 {
+                    builder.set_string(city, "QC").unwrap();
+                }
+                builder.build().unwrap()
+            };
+            let sorted = |matches: &[&u64]| {
+                let mut matches = matches.iter().map(|id| **id).collect::<Vec<_>>();
+                matches.sort_unstable();
+                matches
+            };
+
+            for country in ["CA", "US"] {
+                let mut context = atree.make_delta_context();
+                let base = event(1, country);
+                let expected = sorted(atree.search(&base).unwrap().matches());
+                assert_eq!(
+                    expected,
+                    sorted(atree.search_base(&mut context, &base).unwrap())
+                );
 
-        atree.insert(&1, A_COMPLEX_EXPRESSION).unwrap();
-        atree.insert(&2, AN_EXPRESSION_WITH_AND_OPERATORS).unwrap();
-        atree.insert(&3, AN_EXPRESSION_WITH_OR_OPERATORS).unwrap();
-        let mut builder = atree.make_event();
-        builder.with_integer("exchange_id", 1).unwrap();
-        builder.with_boolean("private", true).unwrap();
-        builder
-            .with_string_list("deal_ids", &["deal-1", "deal-2"])
-            .unwrap();
-        builder
-            .with_string_list("deals", &["deal-1", "deal-2"])
-            .unwrap();
-        builder.with_integer_list("segment_ids", &[2, 3]).unwrap();
-        builder.with_string("country", "FR").unwrap();
-        let event = builder.build().unwrap();
-
-        let expected = vec![&2, &3];
-        let mut actual = atree.search(&event).unwrap().matches().to_vec();
-        actual.sort();
-        assert_eq!(expected, actual);
+                for i in 0..20 {
+                    let event = event(i, country);
+                    let expected = sorted(atree.search(&event).unwrap().matches());
+                    let changed = [exchange_id, private, city];
+                    let matches = atree.search_delta(&mut context, &event, &changed).unwrap();
+                    assert_eq!(expected, sorted(matches));
+                }
+            }
+        }
     }
 
     #[test]
-    fn can_search_a_tree_with_multiple_shared_sub_expressions() {
+    fn keep_the_results_of_the_delta_searches_bounded() {
         let definitions = [
-            AttributeDefinition::boolean("private"),
             AttributeDefinition::integer("exchange_id"),
-            AttributeDefinition::string_list("deals"),
-            AttributeDefinition::integer_list("segment_ids"),
-            AttributeDefinition::string("country"),
-            AttributeDefinition::string("city"),
+            AttributeDefinition::boolean("private"),
         ];
         let mut atree = ATree::new(&definitions).unwrap();
-        [
-            (
-                1,
-                r#"exchange_id = 1 and not private and deals one of ["deal-1", "deal-2"]"#,
-            ),
-            (
-                2,
-                r#"exchange_id = 1 and not private and deals one of ["deal-2", "deal-3"]"#,
-            ),
-            (
-                3,
-                r#"exchange_id = 1 and not private and deals one of ["deal-2", "deal-3"] and segment_ids one of [1, 2, 3, 4]"#,
-            ),
-            (
-                4,
-                r#"exchange_id = 1 and not private and deals one of ["deal-2", "deal-3"] and segment_ids one of [5, 6, 7, 8] and country in ["CA", "US"]"#,
-            ),
-        ].into_iter().for_each(|(id, expression)| {
-                atree.insert(&id, expression).unwrap()
-        });
-
-        let mut builder = atree.make_event();
-        builder.with_boolean("private", false).unwrap();
-        builder.with_integer("exchange_id", 1).unwrap();
-        builder
-            .with_string_list("deals", &["deal-1", "deal-3"])
-            .unwrap();
-        builder.with_integer_list("segment_ids", &[2, 3]).unwrap();
-        builder.with_string("country", "CA").unwrap();
-        let event = builder.build().unwrap();
+        for i in 0..200u64 {
+            let expression = format!("exchange_id > {i} and not private");
+            atree.insert(&i, &expression).unwrap();
+        }
+        let exchange_id = atree.attribute("exchange_id").unwrap();
+        let event = |exchange_id| {
+            let mut builder = atree.make_event();
+            builder.with_integer("exchange_id", exchange_id).unwrap();
+            builder.with_boolean("private", false).unwrap();
+            builder.build().unwrap()
+        };
+        let mut context = atree.make_delta_context();
+        atree.search_base(&mut context, &event(100)).unwrap();
+        let dirty = context.dirty_buckets();
+
+        for i in 0..1000 {
+            let matches = atree
+                .search_delta(&mut context, &event(i % 300), &[exchange_id])
+                .unwrap();
+            assert_eq!((i % 300).min(200) as usize, matches.len());
+        }
 
-        let mut matches = atree.search(&event).unwrap().matches().to_vec();
-        matches.sort();
-        assert_eq!(vec![&1, &2, &3], matches);
+        assert_eq!(dirty, context.dirty_buckets());
     }
 
     #[test]
-    fn can_delete_a_single_predicate() {
-        let definitions = [AttributeDefinition::boolean("private")];
+    fn stop_the_search_once_enough_matches_are_found() {
+        let definitions = [
+            AttributeDefinition::integer("exchange_id"),
+            AttributeDefinition::boolean("private"),
+        ];
         let mut atree = ATree::new(&definitions).unwrap();
-        atree.insert(&1u64, "private").unwrap();
-        let mut builder = atree.make_event();
-        builder.with_boolean("private", true).unwrap();
-        let event = builder.build().unwrap();
-
-        let results = atree.search(&event).unwrap().matches().to_vec();
-        assert_eq!(vec![&1u64], results);
+        for i in 0..20u64 {
+            let expression = format!("exchange_id > {} and not private", i % 10);
+            atree.insert(&i, &expression).unwrap();
+        }
+        let event = |exchange_id| {
+            let mut builder = atree.make_event();
+            builder.with_integer("exchange_id", exchange_id).unwrap();
+            builder.with_boolean("private", false).unwrap();
+            builder.build().unwrap()
+        };
 
-        atree.delete(&1u64);
-        let mut builder = atree.make_event();
-        builder.with_boolean("private", true).unwrap();
-        let event = builder.build().unwrap();
-        let results = atree.search(&event).unwrap().matches().to_vec();
-        assert!(results.is_empty());
+        let all = atree.search(&event(5)).unwrap().matches().to_vec();
+        let limited = atree.search_limit(&event(5), 3).unwrap().matches().to_vec();
+
+        assert_eq!(10, all.len());
+        assert_eq!(3, limited.len());
+        assert!(limited.iter().all(|id| all.contains(id)));
+        assert!(atree
+            .search_limit(&event(5), 0)
+            .unwrap()
+            .matches()
+            .is_empty());
+        assert_eq!(
+            all.len(),
+            atree.search_limit(&event(5), 100).unwrap().matches().len()
+        );
+        assert!(atree.search_any(&event(5)).unwrap());
+        assert!(!atree.search_any(&event(0)).unwrap());
     }
 
     #[test]
-    fn deleting_an_expression_only_removes_the_id_not_the_expression_if_it_is_still_referenced() {
+    fn return_the_matches_with_the_highest_priorities() {
         let definitions = [
             AttributeDefinition::boolean("private"),
             AttributeDefinition::integer("exchange_id"),
             AttributeDefinition::string_list("deal_ids"),
-            AttributeDefinition::string_list("deals"),
             AttributeDefinition::integer_list("segment_ids"),
             AttributeDefinition::string("country"),
             AttributeDefinition::string("city"),
         ];
-        let an_expression = "private or exchange_id = 1";
-        let another_expression =
-            r#"private or exchange_id = 1 or deal_ids one of ["deal-1", "deal-2"]"#;
+        let expressions = [
+            A_COMPLEX_EXPRESSION,
+            ANOTHER_COMPLEX_EXPRESSION,
+            "exchange_id = 1 and not private",
+            "exchange_id = 1 and not private",
+            "exchange_id = 2 or (private and country = 'CA')",
+            r#"deal_ids one of ["deal-1"] and segment_ids one of [1, 2] and country in ['CA', 'US']"#,
+            "segment_ids all of [1, 2, 3, 4] or city is null",
+            "country = 'US' and exchange_id = 1 and not private",
+            "exchange_id = 1",
+        ];
         let mut atree = ATree::new(&definitions).unwrap();
-        atree.insert(&1u64, an_expression).unwrap();
-        atree.insert(&2u64, another_expression).unwrap();
+        for (id, expression) in expressions.iter().enumerate() {
+            let priority = (id as u32 * 7) % 5;
+            atree
+                .insert_with_priority(&(id as u64), expression, priority)
+                .unwrap();
+        }
+        let mut indexed = atree.clone();
+        indexed.enable_predicate_index();
+
+        for atree in [atree, indexed] {
+            for i in 0..30i64 {
+                let mut builder = atree.make_event();
+                builder.with_integer("exchange_id", i % 3).unwrap();
+                builder.with_boolean("private", i % 4 == 0).unwrap();
+                builder
+                    .with_string_list("deal_ids", &[["deal-1", "deal-2"][i as usize % 2]])
+                    .unwrap();
+                builder
+                    .with_integer_list("segment_ids", &[i % 5, (i + 1) % 5])
+                    .unwrap();
+                builder
+                    .with_string("country", ["CA", "US", "FR"][i as usize % 3])
+                    .unwrap();
+                if i % 7 != 0 {
+                    builder.with_string("city", "QC").unwrap();
+                }
+                let event = builder.build().unwrap();
+                let priority = |id: &u64| (*id as u32 * 7) % 5;
+                let mut expected = atree
+                    .search(&event)
+                    .unwrap()
+                    .matches()
+                    .iter()
+                    .map(|id| priority(id))
+                    .collect::<Vec<_>>();
+                expected.sort_unstable_by(|a, b| b.cmp(a));
+
+                for k in 1..4 {
+                    let report = atree.search_top_k(&event, k).unwrap();
+                    let priorities = report
+                        .matches()
+                        .iter()
+                        .map(|id| priority(id))
+                        .collect::<Vec<_>>();
+                    assert_eq!(&expected[..k.min(expected.len())], priorities);
+                }
+            }
+        }
+    }
+
+    #[test]
+    fn forget_the_priority_of_a_deleted_subscription() {
+        let definitions = [AttributeDefinition::integer("exchange_id")];
+        let mut atree = ATree::new(&definitions).unwrap();
+        atree
+            .insert_with_priority(&1u64, "exchange_id = 1", 1)
+            .unwrap();
+        atree
+            .insert_with_priority(&2u64, "exchange_id = 1", 2)
+            .unwrap();
+        atree
+            .insert_with_priority(&3u64, "exchange_id = 1", 3)
+            .unwrap();
+        atree.delete(&2);
         let mut builder = atree.make_event();
         builder.with_integer("exchange_id", 1).unwrap();
         let event = builder.build().unwrap();
 
-        let results = atree.search(&event).unwrap().matches().to_vec();
-        assert_eq!(vec![&1u64, &2u64], results);
+        let report = atree.search_top_k(&event, 2).unwrap();
 
-        atree.delete(&1u64);
+        assert_eq!([&3, &1], report.matches());
+    }
+
+    #[test]
+    fn forget_every_occurrence_of_a_subscription_inserted_twice_for_an_expression() {
+        let definitions = [AttributeDefinition::integer("exchange_id")];
+        let mut atree = ATree::new(&definitions).unwrap();
+        atree
+            .insert_with_priority(&1u64, "exchange_id = 1", 1)
+            .unwrap();
+        atree
+            .insert_with_priority(&2u64, "exchange_id = 1", 2)
+            .unwrap();
+        atree
+            .insert_with_priority(&1u64, "exchange_id = 1", 3)
+            .unwrap();
+        atree.delete(&1);
         let mut builder = atree.make_event();
         builder.with_integer("exchange_id", 1).unwrap();
         let event = builder.build().unwrap();
-        let results = atree.search(&event).unwrap().matches().to_vec();
-        assert_eq!(vec![&2u64], results);
+
+        assert_eq!([&2], atree.search(&event).unwrap().matches());
+        assert_eq!([&2], atree.search_top_k(&event, 2).unwrap().matches());
     }
 
     #[test]
-    fn deleting_an_expression_only_removes_the_id_not_the_expression_if_it_has_multiple_subscription_ids(
-    ) {
+    fn can_match_an_expression_that_is_already_a_sub_expression() {
         let definitions = [
             AttributeDefinition::boolean("private"),
             AttributeDefinition::integer("exchange_id"),
+            AttributeDefinition::string_list("deal_ids"),
         ];
-        let an_expression = "private or exchange_id = 1";
         let mut atree = ATree::new(&definitions).unwrap();
-        atree.insert(&1u64, an_expression).unwrap();
-        atree.insert(&2u64, an_expression).unwrap();
+        atree
+            .insert(&1u64, r#"private and deal_ids one of ["deal-1"]"#)
+            .unwrap();
+        atree
+            .insert(&2u64, r#"deal_ids one of ["deal-1"]"#)
+            .unwrap();
         let mut builder = atree.make_event();
-        builder.with_integer("exchange_id", 1).unwrap();
+        builder.with_boolean("private", false).unwrap();
+        builder.with_string_list("deal_ids", &["deal-1"]).unwrap();
         let event = builder.build().unwrap();
 
         let results = atree.search(&event).unwrap().matches().to_vec();
-        assert_eq!(vec![&1u64, &2u64], results);
 
-        atree.delete(&1u64);
-        let mut builder = atree.make_event();
-        builder.with_integer("exchange_id", 1).unwrap();
-        let event = builder.build().unwrap();
-        let results = atree.search(&event).unwrap().matches().to_vec();
         assert_eq!(vec![&2u64], results);
     }
 
     #[test]
-    fn can_delete_root_node_when_all_references_are_deleted() {
+    fn can_match_string_lists_that_contain_strings_seen_before() {
         let definitions = [
-            AttributeDefinition::boolean("private"),
-            AttributeDefinition::integer("exchange_id"),
+            AttributeDefinition::string("country"),
+            AttributeDefinition::string_list("deal_ids"),
         ];
-        let an_expression = "private or exchange_id = 1";
         let mut atree = ATree::new(&definitions).unwrap();
-        atree.insert(&1u64, an_expression).unwrap();
-        atree.insert(&2u64, an_expression).unwrap();
+        atree.insert(&1u64, "country = 'US'").unwrap();
+        atree
+            .insert(&2u64, "country in ['AR', 'CA', 'FR', 'US']")
+            .unwrap();
+        atree
+            .insert(&3u64, r#"deal_ids one of ["deal-3"]"#)
+            .unwrap();
+        atree
+            .insert(&4u64, r#"deal_ids all of ["deal-1", "deal-2", "deal-3"]"#)
+            .unwrap();
         let mut builder = atree.make_event();
-        builder.with_integer("exchange_id", 1).unwrap();
+        builder.with_string("country", "US").unwrap();
+        builder
+            .with_string_list("deal_ids", &["deal-1", "deal-3"])
+            .unwrap();
         let event = builder.build().unwrap();
 
-        let results = atree.search(&event).unwrap().matches().to_vec();
-        assert_eq!(vec![&1u64, &2u64], results);
+        let mut results = atree.search(&event).unwrap().matches().to_vec();
+        results.sort();
 
-        atree.delete(&1u64);
-        atree.delete(&2u64);
-        let mut builder = atree.make_event();
-        builder.with_integer("exchange_id", 1).unwrap();
-        let event = builder.build().unwrap();
-        let results = atree.search(&event).unwrap().matches().to_vec();
-        assert!(results.is_empty());
+        assert_eq!(vec![&1u64, &2u64, &3u64, &4u64], results);
+    }
+
+    #[test]
+    fn return_no_reports_for_an_empty_batch() {
+        let definitions = [AttributeDefinition::integer("exchange_id")];
+        let mut atree = ATree::new(&definitions).unwrap();
+        atree.insert(&1u64, "exchange_id = 1").unwrap();
+
+        let reports = atree.search_batch(&[]).unwrap();
+
+        assert!(reports.is_empty());
     }
 
     #[test]
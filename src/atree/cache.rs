@@ -0,0 +1,229 @@
+use super::ExpressionId;
+use crate::lexer::{Lexer, Token};
+use std::{collections::HashMap, mem::size_of};
+
+/// The expressions inserted so far by the hash of their normalized text (see [`normalize()`]).
+///
+/// The entries refer to the IDs of the expressions instead of their nodes so that the entries of
+/// the deleted expressions are recognized (and dropped) when they are looked up.
+#[derive(Clone, Debug, Default)]
+pub(super) struct ExpressionCache {
+    expressions: HashMap<u128, ExpressionId>,
+}
+
+impl ExpressionCache {
+    #[inline]
+    pub(super) fn get(&self, key: u128) -> Option<ExpressionId> {
+        self.expressions.get(&key).copied()
+    }
+
+    #[inline]
+    pub(super) fn insert(&mut self, key: u128, expression_id: ExpressionId) {
+        self.expressions.insert(key, expression_id);
+    }
+
+    #[inline]
+    pub(super) fn remove(&mut self, key: u128) {
+        self.expressions.remove(&key);
+    }
+
+    /// Translate the IDs of the expressions with `remap` and drop the entries it has no ID for.
+    pub(super) fn remap(&mut self, remap: impl Fn(ExpressionId) -> Option<ExpressionId>) {
+        self.expressions
+            .retain(|_, expression_id| match remap(*expression_id) {
+                Some(remapped) => {
+                    *expression_id = remapped;
+                    true
+                }
+                None => false,
+            });
+        self.expressions.shrink_to_fit();
+    }
+
+    pub(super) fn memory_usage(&self) -> usize {
+        // Every bucket of the hash map also has a control byte.
+        self.expressions.capacity() * (size_of::<(u128, ExpressionId)>() + 1)
+    }
+}
+
+/// The 128-bit hash of the normalized text of the expression or `None` if it cannot be lexed.
+///
+/// The expression is normalized by hashing its tokens instead of its text so that the whitespace,
+/// the quotes of the strings and the spelling of the operators (e.g. `&&` or `and`) do not
+/// matter. When the top level of the expression chains its terms with a single operator (e.g.
+/// `a and b and c`), the terms are hashed regardless of their order since swapping them does not
+/// change the matches.
+pub(super) fn normalize(expression: &str) -> Option<u128> {
+    let mut ordered = Fnv128::new();
+    let mut term = Fnv128::new();
+    let mut terms = 0u128;
+    let mut operator = None;
+    let mut is_chain = true;
+    let mut depth = 0usize;
+    let mut is_empty = true;
+    for token in Lexer::new(expression) {
+        let (start, token, end) = token.ok()?;
+        is_empty = false;
+        match token {
+            Token::LeftParenthesis | Token::LeftSquareBracket => depth += 1,
+            // An unbalanced expression is invalid; it is left to the parser to report it.
+            Token::RightParenthesis | Token::RightSquareBracket => depth = depth.checked_sub(1)?,
+            Token::And | Token::Or if depth == 0 => {
+                let tag = tag(&token);
+                is_chain &= operator.is_none_or(|operator| operator == tag);
+                operator = Some(tag);
+                terms = terms.wrapping_add(term.finish());
+                term = Fnv128::new();
+                ordered.write_token(&token, &expression[start..end]);
+                continue;
+            }
+            _ => {}
+        }
+        ordered.write_token(&token, &expression[start..end]);
+        term.write_token(&token, &expression[start..end]);
+    }
+    if is_empty {
+        return None;
+    }
+
+    match operator {
+        Some(operator) if is_chain => {
+            let terms = terms.wrapping_add(term.finish());
+            let mut chain = Fnv128::new();
+            chain.write(&[CHAIN, operator]);
+            chain.write(&terms.to_le_bytes());
+            Some(chain.finish())
+        }
+        _ => Some(ordered.finish()),
+    }
+}
+
+/// The tag written before the terms of a chain so that it cannot be mistaken for the tokens of
+/// another expression.
+const CHAIN: u8 = u8::MAX;
+
+/// A distinct tag per kind of token; the aliases of an operator share the same one.
+fn tag(token: &Token<'_>) -> u8 {
+    match token {
+        Token::LessThan => 0,
+        Token::LessThanEqual => 1,
+        Token::GreaterThan => 2,
+        Token::GreaterThanEqual => 3,
+        Token::Not => 4,
+        Token::Equal => 5,
+        Token::NotEqual => 6,
+        Token::In => 7,
+        Token::NotIn => 8,
+        Token::OneOf => 9,
+        Token::NoneOf => 10,
+        Token::AllOf => 11,
+        Token::IsNull => 12,
+        Token::IsNotNull => 13,
+        Token::IsEmpty => 14,
+        Token::IsNotEmpty => 15,
+        Token::And => 16,
+        Token::Or => 17,
+        Token::LeftParenthesis => 18,
+        Token::RightParenthesis => 19,
+        Token::LeftSquareBracket => 20,
+        Token::RightSquareBracket => 21,
+        Token::Comma => 22,
+        Token::IntegerLiteral(_) => 23,
+        Token::StringLiteral(_) => 24,
+        Token::FloatLiteral(_) => 25,
+        Token::BooleanLiteral(_) => 26,
+        Token::Identifier(_) => 27,
+    }
+}
+
+/// The 128-bit variant of the FNV-1a hash.
+struct Fnv128(u128);
+
+impl Fnv128 {
+    const OFFSET_BASIS: u128 = 0x6c62_272e_07bb_0142_62b8_2175_6295_c58d;
+    const PRIME: u128 = 0x0000_0000_0100_0000_0000_0000_0000_013b;
+
+    #[inline]
+    fn new() -> Self {
+        Self(Self::OFFSET_BASIS)
+    }
+
+    #[inline]
+    fn write(&mut self, bytes: &[u8]) {
+        for byte in bytes {
+            self.0 ^= u128::from(*byte);
+            self.0 = self.0.wrapping_mul(Self::PRIME);
+        }
+    }
+
+    /// Write the token along with its value; the values are prefixed by their length so that
+    /// different sequences of tokens cannot write the same bytes.
+    #[inline]
+    fn write_token(&mut self, token: &Token<'_>, text: &str) {
+        self.write(&[tag(token)]);
+        let value = match token {
+            Token::IntegerLiteral(value) => {
+                self.write(&value.to_le_bytes());
+                return;
+            }
+            Token::BooleanLiteral(value) => {
+                self.write(&[u8::from(*value)]);
+                return;
+            }
+            Token::StringLiteral(value) | Token::Identifier(value) => value,
+            Token::FloatLiteral(_) => text,
+            _ => return,
+        };
+        self.write(&(value.len() as u64).to_le_bytes());
+        self.write(value.as_bytes());
+    }
+
+    #[inline]
+    fn finish(&self) -> u128 {
+        self.0
+    }
+}
+
+#[cfg(test)]
+mod tests {
+    use super::*;
+
+    #[test]
+    fn ignore_the_whitespace_and_the_spelling_of_the_operators() {
+        assert_eq!(
+            normalize("exchange_id = 1 and (private or country in ['CA', 'US'])"),
+            normalize(r#"exchange_id=1 &&(private||country in [ "CA","US" ])"#)
+        );
+    }
+
+    #[test]
+    fn ignore_the_order_of_the_terms_of_a_chain() {
+        assert_eq!(
+            normalize("exchange_id = 1 and private and not deleted"),
+            normalize("not deleted and exchange_id = 1 and private")
+        );
+        assert_eq!(normalize("(a and b) or c"), normalize("c or (a and b)"));
+    }
+
+    #[test]
+    fn keep_the_order_of_the_terms_of_different_operators() {
+        assert_ne!(normalize("a and b or c"), normalize("c or a and b"));
+        assert_ne!(normalize("a and b"), normalize("a or b"));
+        assert_ne!(normalize("(a and b) or c"), normalize("(a or b) and c"));
+    }
+
+    #[test]
+    fn tell_apart_expressions_with_different_values() {
+        assert_ne!(normalize("exchange_id = 1"), normalize("exchange_id = 10"));
+        assert_ne!(normalize("country = 'a b'"), normalize("country = 'a' b"));
+        assert_ne!(normalize("a and b"), normalize("a and b and"));
+        assert_ne!(normalize("a"), normalize("(a)"));
+    }
+
+    #[test]
+    fn return_none_on_expressions_that_cannot_be_lexed_or_are_unbalanced() {
+        assert_eq!(None, normalize(""));
+        assert_eq!(None, normalize("exchange_id = 1 and $"));
+        assert_eq!(None, normalize("a) and (b"));
+    }
+}
@@ -0,0 +1,202 @@
+use super::Entry;
+use std::{cmp::Ordering, collections::BinaryHeap, time::Instant};
+
+/// Collects the subscriptions of the nodes that match an event during a search and tells the
+/// search when it can stop early.
+///
+/// The collectors can also observe the steps of the search to keep statistics about it; the
+/// other collectors ignore them so that the observations compile to nothing.
+pub(super) trait Collector<'a, T> {
+    /// Collect the subscriptions of a node that matched the event.
+    fn collect(&mut self, node: &'a Entry<T>);
+
+    /// Whether the answer is known so that the rest of the search can be skipped.
+    #[inline]
+    fn is_done(&self) -> bool {
+        false
+    }
+
+    /// Whether the node (and thus the nodes above it) cannot change the answer so that it does
+    /// not have to be evaluated.
+    #[inline]
+    fn can_skip(&self, _node: &Entry<T>) -> bool {
+        false
+    }
+
+    /// The instant a stage of the search starts at, for the collectors that time the stages.
+    #[inline]
+    fn start(&self) -> Option<Instant> {
+        None
+    }
+
+    /// Observe a step of the search.
+    #[inline]
+    fn observe(&mut self, _probe: Probe) {}
+}
+
+/// A step of a search observed by a [`Collector`].
+#[derive(Clone, Copy, Debug)]
+#[cfg_attr(not(feature = "stats"), allow(dead_code))]
+pub(super) enum Probe {
+    /// A predicate was evaluated.
+    Evaluated,
+    /// A predicate was not evaluated eagerly since nothing needs its result yet.
+    Delayed,
+    /// A predicate was not evaluated eagerly since it already was or since it cannot change the
+    /// answer.
+    Skipped,
+    /// A node was popped from the queue of the level (the first queue being the one of the nodes
+    /// right above the predicates).
+    Popped(usize),
+    /// An `and` node failed because of one of its children without being evaluated.
+    ShortCircuit,
+    /// A stage of the search that started at the instant is over.
+    Finished(Stage, Option<Instant>),
+}
+
+/// The stages of a search.
+#[derive(Clone, Copy, Debug)]
+pub(super) enum Stage {
+    /// The evaluation of the predicates.
+    Predicates,
+    /// The evaluation of the nodes above the predicates, level by level.
+    Levels,
+}
+
+/// Collects all the matches.
+impl<'a, T> Collector<'a, T> for Vec<&'a T> {
+    #[inline]
+    fn collect(&mut self, node: &'a Entry<T>) {
+        self.extend(node.subscription_ids.iter());
+    }
+}
+
+/// Collects the first matches up to a limit.
+pub(super) struct Limit<'a, T> {
+    matches: Vec<&'a T>,
+    limit: usize,
+}
+
+impl<'a, T> Limit<'a, T> {
+    pub(super) fn new(limit: usize) -> Self {
+        Self {
+            matches: Vec::with_capacity(limit.min(64)),
+            limit,
+        }
+    }
+
+    pub(super) fn into_matches(self) -> Vec<&'a T> {
+        self.matches
+    }
+}
+
+impl<'a, T> Collector<'a, T> for Limit<'a, T> {
+    #[inline]
+    fn collect(&mut self, node: &'a Entry<T>) {
+        let missing = self.limit - self.matches.len();
+        self.matches
+            .extend(node.subscription_ids.iter().take(missing));
+    }
+
+    #[inline]
+    fn is_done(&self) -> bool {
+        self.matches.len() >= self.limit
+    }
+}
+
+/// Collects the matches with the highest priorities.
+///
+/// Once `k` matches are known, the nodes whose bound is not above the lowest priority kept so
+/// far cannot bring anything better and are skipped.
+pub(super) struct TopK<'a, T> {
+    ranked: BinaryHeap<Ranked<'a, T>>,
+    k: usize,
+    found: usize,
+}
+
+impl<'a, T> TopK<'a, T> {
+    pub(super) fn new(k: usize) -> Self {
+        Self {
+            ranked: BinaryHeap::with_capacity(k.min(64)),
+            k,
+            found: 0,
+        }
+    }
+
+    /// The matches from the highest priority to the lowest; the matches of the same priority are
+    /// kept in the order they were found.
+    pub(super) fn into_matches(self) -> Vec<&'a T> {
+        self.ranked
+            .into_sorted_vec()
+            .into_iter()
+            .map(|ranked| ranked.subscription_id)
+            .collect()
+    }
+
+    #[inline]
+    fn is_full(&self) -> bool {
+        self.ranked.len() >= self.k
+    }
+}
+
+impl<'a, T> Collector<'a, T> for TopK<'a, T> {
+    #[inline]
+    fn collect(&mut self, node: &'a Entry<T>) {
+        let subscriptions = node.subscription_ids.iter().zip(&node.priorities);
+        for (subscription_id, priority) in subscriptions {
+            let ranked = Ranked {
+                priority: *priority,
+                order: self.found,
+                subscription_id,
+            };
+            self.found += 1;
+            if !self.is_full() {
+                self.ranked.push(ranked);
+            } else if let Some(mut lowest) = self.ranked.peek_mut() {
+                if ranked.priority > lowest.priority {
+                    *lowest = ranked;
+                }
+            }
+        }
+    }
+
+    #[inline]
+    fn can_skip(&self, node: &Entry<T>) -> bool {
+        self.is_full()
+            && self
+                .ranked
+                .peek()
+                .is_some_and(|lowest| node.bound <= lowest.priority)
+    }
+}
+
+/// A match ordered so that the greatest one is the first to be dropped, i.e. the one with the
+/// lowest priority that was found last.
+struct Ranked<'a, T> {
+    priority: u32,
+    order: usize,
+    subscription_id: &'a T,
+}
+
+impl<T> PartialEq for Ranked<'_, T> {
+    fn eq(&self, other: &Self) -> bool {
+        self.cmp(other) == Ordering::Equal
+    }
+}
+
+impl<T> Eq for Ranked<'_, T> {}
+
+impl<T> PartialOrd for Ranked<'_, T> {
+    fn partial_cmp(&self, other: &Self) -> Option<Ordering> {
+        Some(self.cmp(other))
+    }
+}
+
+impl<T> Ord for Ranked<'_, T> {
+    fn cmp(&self, other: &Self) -> Ordering {
+        other
+            .priority
+            .cmp(&self.priority)
+            .then(self.order.cmp(&other.order))
+    }
+}
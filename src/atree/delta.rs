@@ -0,0 +1,156 @@
+use super::{lazy_evaluate, Entry, NodeId, SearchContext};
+use crate::{
+    evaluation::EvaluationResult,
+    events::{AttributeHandle, Event},
+};
+use slab::Slab;
+
+/// Buffers that keep the evaluation of a base event to search the events that only differ from
+/// it by a few attributes with [`crate::ATree::search_delta()`].
+///
+/// The context maps each attribute to the predicates that reference it and each node to all of
+/// its parents, so it is built for the state of the [`crate::ATree`] it was made from and has to
+/// be made again after the tree is modified.
+#[derive(Debug)]
+pub struct DeltaContext<'atree, T> {
+    /// The leaves that reference each attribute, indexed by the attribute ID.
+    leaves: Vec<Vec<NodeId>>,
+    /// All the parents of each node; unlike the parents kept by the nodes, they include the
+    /// `and` nodes for which the node is not the access child.
+    parents: Vec<Vec<NodeId>>,
+    /// The buffers of the search of the base event; its results are the ones of the base event.
+    base: SearchContext<'atree, T>,
+    has_base: bool,
+    /// The nodes whose subscriptions matched the base event.
+    matched: Vec<NodeId>,
+    /// The results of the base event with the ones of the nodes affected by a delta reset.
+    results: EvaluationResult,
+    affected: Vec<bool>,
+    affected_ids: Vec<NodeId>,
+    pending: Vec<NodeId>,
+    matches: Vec<&'atree T>,
+}
+
+impl<'atree, T> DeltaContext<'atree, T> {
+    pub(super) fn new(nodes: &Slab<Entry<T>>, attributes: usize, max_level: usize) -> Self {
+        let mut leaves = vec![Vec::new(); attributes];
+        let mut parents = vec![Vec::new(); nodes.capacity()];
+        for (node_id, entry) in nodes {
+            match entry.node.predicate() {
+                Some(predicate) => leaves[predicate.attribute().index()].push(node_id),
+                None => {
+                    for child_id in entry.children() {
+                        parents[*child_id].push(node_id);
+                    }
+                }
+            }
+        }
+        Self {
+            leaves,
+            parents,
+            base: SearchContext::new(nodes.capacity(), max_level),
+            has_base: false,
+            matched: Vec::new(),
+            results: EvaluationResult::new(nodes.capacity()),
+            affected: vec![false; nodes.capacity()],
+            affected_ids: Vec::new(),
+            pending: Vec::new(),
+            matches: Vec::new(),
+        }
+    }
+
+    /// Whether a base event was searched with this context.
+    #[inline]
+    pub(super) const fn has_base(&self) -> bool {
+        self.has_base
+    }
+
+    #[inline]
+    pub(super) fn base_mut(&mut self) -> &mut SearchContext<'atree, T> {
+        &mut self.base
+    }
+
+    /// Keep the results of the search that was just made with the base context as the base.
+    pub(super) fn rebase(&mut self, nodes: &Slab<Entry<T>>) -> &[&'atree T] {
+        self.results.copy_from(&self.base.results);
+        self.matched.clear();
+        self.matched.extend(
+            self.base
+                .results
+                .outcomes()
+                .filter(|(node_id, result)| {
+                    *result == Some(true) && !nodes[*node_id].subscription_ids.is_empty()
+                })
+                .map(|(node_id, _)| node_id),
+        );
+        self.has_base = true;
+        &self.base.matches
+    }
+
+    /// The amount of buckets of the results listed as modified.
+    #[cfg(test)]
+    pub(super) fn dirty_buckets(&self) -> usize {
+        self.results.dirty_buckets()
+    }
+}
+
+/// Search the event that only differs from the base event by the changed attributes.
+///
+/// Only the predicates that reference the changed attributes and the nodes above them are
+/// evaluated again; the results of all the other nodes are the ones of the base event. The
+/// results are put back to the ones of the base event afterwards so that the next delta starts
+/// from the base event again.
+pub(super) fn search<'a, 'c, T>(
+    nodes: &'a Slab<Entry<T>>,
+    context: &'c mut DeltaContext<'a, T>,
+    event: &Event,
+    changed: &[AttributeHandle],
+) -> &'c [&'a T] {
+    let DeltaContext {
+        leaves,
+        parents,
+        base,
+        matched,
+        results,
+        affected,
+        affected_ids,
+        pending,
+        matches,
+        ..
+    } = context;
+
+    for handle in changed {
+        if let Some(leaves) = leaves.get(handle.index()) {
+            pending.extend_from_slice(leaves);
+        }
+    }
+    while let Some(node_id) = pending.pop() {
+        if affected[node_id] {
+            continue;
+        }
+        affected[node_id] = true;
+        affected_ids.push(node_id);
+        results.reset(node_id);
+        pending.extend_from_slice(&parents[node_id]);
+    }
+
+    matches.clear();
+    for node_id in matched.iter().filter(|node_id| !affected[**node_id]) {
+        matches.extend(nodes[*node_id].subscription_ids.iter());
+    }
+    // The nodes under the affected ones are either affected or have the same result as for the
+    // base event, so evaluating the affected subscribers lazily finds all the new matches.
+    for node_id in affected_ids.iter() {
+        let is_subscribed = !nodes[*node_id].subscription_ids.is_empty();
+        if is_subscribed && !results.is_evaluated(*node_id) {
+            lazy_evaluate(*node_id, event, nodes, results, matches);
+        }
+    }
+
+    for node_id in affected_ids.drain(..) {
+        affected[node_id] = false;
+        results.restore(node_id, &base.results);
+    }
+    results.restore_dirty(&base.results);
+    matches
+}
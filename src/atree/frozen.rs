@@ -0,0 +1,849 @@
+use super::{ATree, ATreeNode, NodeId, Report};
+use crate::{
+    ast::Operator,
+    error::{ATreeError, SnapshotError},
+    evaluation::EvaluationResult,
+    events::{AttributeHandle, AttributeTable, Event, EventBuilder, EventError},
+    index::PredicateIndex,
+    mmap::Mmap,
+    opcodes::CompiledPredicate,
+    strings::StringTable,
+};
+use image::Slice;
+use std::{ops::Range, path::Path, sync::Arc};
+
+mod image;
+
+pub(super) use image::save;
+
+type FrozenId = u32;
+
+/// An immutable snapshot of an [`ATree`] whose layout is optimized for searching.
+///
+/// The nodes are numbered in level order: the predicates that are evaluated eagerly come first,
+/// grouped by their attribute so that the groups of the undefined attributes are skipped as a
+/// whole, followed by the other predicates and then by each level of i-nodes and r-nodes. Instead
+/// of having a heap allocation per node, the children, the parents and the subscription IDs of
+/// all the nodes are stored contiguously in shared arrays and each node only keeps the ranges
+/// that refer to them. Only the fields that are needed by the search (i.e. the operator, the level
+/// and the ranges) are kept in the nodes; the bookkeeping of the [`ATree`] (i.e. the expression
+/// IDs, the costs and the use counts) is left behind. The predicates are compiled into a dense
+/// array of opcodes that are specialized for the types of their attributes.
+///
+/// A [`FrozenATree`] is created with the [`ATree::freeze()`] function and does not reflect the
+/// insertions and deletions that are made to the [`ATree`] afterwards. It can also be written as a
+/// frozen image with [`ATree::save_frozen()`] and searched in place from the mapped file with
+/// [`FrozenATree::load_mmap()`].
+///
+/// # Examples
+///
+/// ```rust
+/// use a_tree::{ATree, AttributeDefinition};
+///
+/// let definitions = [
+///     AttributeDefinition::boolean("private"),
+///     AttributeDefinition::integer("exchange_id")
+/// ];
+/// let mut atree = ATree::new(&definitions).unwrap();
+/// atree.insert(&1u64, "exchange_id = 5 and not private").unwrap();
+/// atree.insert(&2u64, "private").unwrap();
+/// let frozen = atree.freeze();
+///
+/// let mut builder = frozen.make_event();
+/// builder.with_integer("exchange_id", 5).unwrap();
+/// builder.with_boolean("private", false).unwrap();
+/// let event = builder.build().unwrap();
+///
+/// let report = frozen.search(&event).unwrap();
+/// assert_eq!(report.matches(), [&1u64]);
+/// ```
+#[derive(Clone, Debug)]
+pub struct FrozenATree<T> {
+    nodes: Slice<FrozenNode>,
+    predicates: Vec<CompiledPredicate>,
+    children: Slice<FrozenId>,
+    parents: Slice<FrozenId>,
+    subscription_ids: Slice<T>,
+    eager_predicates: usize,
+    /// The range of the eager predicates of each attribute followed by the one of the null checks.
+    groups: Vec<Range<usize>>,
+    /// The range of the nodes of each level, starting from the second one.
+    levels: Vec<Range<usize>>,
+    max_level: usize,
+    index: Option<PredicateIndex>,
+    strings: StringTable,
+    attributes: AttributeTable,
+}
+
+impl<T: Clone> FrozenATree<T> {
+    pub(super) fn new(atree: &ATree<T>) -> Self {
+        Self::with_order(atree).0
+    }
+
+    /// Freeze the [`ATree`] and return the IDs of its nodes in the order they were numbered.
+    fn with_order(atree: &ATree<T>) -> (Self, Vec<NodeId>) {
+        let mut order = Vec::with_capacity(atree.nodes.len());
+        let mut groups = Vec::with_capacity(atree.predicates.groups.len());
+        for group in &atree.predicates.groups {
+            let start = order.len();
+            order.extend_from_slice(group);
+            groups.push(start..order.len());
+        }
+        let mut others = atree
+            .nodes
+            .iter()
+            .filter(|(node_id, _)| !atree.predicates.contains(*node_id))
+            .map(|(node_id, entry)| (entry.level(), node_id))
+            .collect::<Vec<_>>();
+        others.sort_unstable();
+        order.extend(others.into_iter().map(|(_, node_id)| node_id));
+
+        let mut ids = vec![FrozenId::MAX; atree.nodes.capacity()];
+        for (id, node_id) in order.iter().enumerate() {
+            ids[*node_id] = to_frozen_id(id);
+        }
+
+        let mut nodes = Vec::with_capacity(order.len());
+        let mut predicates = Vec::with_capacity(atree.predicates.len());
+        let mut all_children = Vec::with_capacity(order.len());
+        let mut all_parents = Vec::with_capacity(order.len());
+        let mut all_subscription_ids = Vec::with_capacity(atree.nodes_by_ids.len());
+        let mut levels = vec![0..0; atree.max_level - 1];
+        for node_id in &order {
+            let entry = &atree.nodes[*node_id];
+            let (kind, children, parents): (_, &[NodeId], &[NodeId]) = match &entry.node {
+                ATreeNode::LNode(node) => {
+                    predicates.push(CompiledPredicate::compile(&node.predicate));
+                    (Kind::Leaf, &[], &node.parents)
+                }
+                ATreeNode::INode(node) => {
+                    (Kind::from(&node.operator), &node.children, &node.parents)
+                }
+                ATreeNode::RNode(node) => (Kind::from(&node.operator), &node.children, &[]),
+            };
+            let children = extend(&mut all_children, children.iter().map(|id| ids[*id]));
+            let parents = extend(&mut all_parents, parents.iter().map(|id| ids[*id]));
+            let subscription_ids = extend(
+                &mut all_subscription_ids,
+                entry.subscription_ids.iter().cloned(),
+            );
+            if let Some(level) = entry.level().checked_sub(2) {
+                let id = nodes.len();
+                let range = &mut levels[level];
+                let start = if range.start == range.end {
+                    id
+                } else {
+                    range.start
+                };
+                *range = start..id + 1;
+            }
+            nodes.push(FrozenNode {
+                children,
+                parents,
+                subscription_ids,
+                level: to_frozen_id(entry.level()),
+                kind,
+            });
+        }
+
+        let eager_predicates = atree.predicates.len();
+        let index = atree.index.as_ref().map(|_| {
+            let mut index = PredicateIndex::new(atree.attributes.len());
+            for (predicate_id, node_id) in order[..eager_predicates].iter().enumerate() {
+                if let Some(predicate) = atree.nodes[*node_id].node.predicate() {
+                    index.insert(predicate_id, predicate);
+                }
+            }
+            index
+        });
+        let frozen = Self {
+            nodes: nodes.into(),
+            predicates,
+            children: all_children.into(),
+            parents: all_parents.into(),
+            subscription_ids: all_subscription_ids.into(),
+            eager_predicates,
+            groups,
+            levels,
+            max_level: atree.max_level,
+            index,
+            strings: atree.strings.clone(),
+            attributes: atree.attributes.clone(),
+        };
+        (frozen, order)
+    }
+}
+
+impl FrozenATree<u64> {
+    /// Load a [`FrozenATree`] from the bytes of a frozen image written by
+    /// [`ATree::save_frozen()`].
+    ///
+    /// The arrays of records are copied out of the bytes; use [`FrozenATree::load_mmap()`] to
+    /// search them in place instead. An error is returned if the bytes are not a frozen image, if
+    /// its version is not supported or if it is corrupted.
+    pub fn load(bytes: &[u8]) -> Result<Self, SnapshotError> {
+        image::load(bytes, None)
+    }
+
+    /// Load a [`FrozenATree`] from a frozen image file written by [`ATree::save_frozen()`] and
+    /// search it in place.
+    ///
+    /// The file is mapped in memory (on Unix) and only its header, its attributes, its strings and
+    /// its predicates are decoded. The nodes, their children, their parents and their
+    /// subscription IDs are fixed-width little-endian records that are read straight from the
+    /// mapped pages, which stay mapped as long as the [`FrozenATree`] or one of its clones lives.
+    /// They are checked once when the file is loaded; on the big-endian targets, and where files
+    /// cannot be mapped, they are copied instead.
+    ///
+    /// # Examples
+    ///
+    /// ```rust
+    /// use a_tree::{ATree, AttributeDefinition, FrozenATree};
+    ///
+    /// let definitions = [
+    ///     AttributeDefinition::boolean("private"),
+    ///     AttributeDefinition::integer("exchange_id")
+    /// ];
+    /// let mut atree = ATree::new(&definitions).unwrap();
+    /// atree.insert(&1u64, "exchange_id = 5 and not private").unwrap();
+    ///
+    /// let path = std::env::temp_dir().join(format!("a-tree-doc-{}", std::process::id()));
+    /// atree.save_frozen(&mut std::fs::File::create(&path).unwrap()).unwrap();
+    /// let frozen = FrozenATree::load_mmap(&path).unwrap();
+    /// # std::fs::remove_file(&path).unwrap();
+    ///
+    /// let mut builder = frozen.make_event();
+    /// builder.with_integer("exchange_id", 5).unwrap();
+    /// builder.with_boolean("private", false).unwrap();
+    /// let event = builder.build().unwrap();
+    /// assert_eq!(frozen.search(&event).unwrap().matches(), [&1u64]);
+    /// ```
+    pub fn load_mmap<P: AsRef<Path>>(path: P) -> Result<Self, SnapshotError> {
+        let mapping = Arc::new(Mmap::open(path)?);
+        let frozen = image::load(&mapping, Some(&mapping))?;
+        mapping.advise_normal();
+        Ok(frozen)
+    }
+}
+
+impl<T> FrozenATree<T> {
+    /// Create a new [`EventBuilder`] to be able to generate an [`Event`] that will be usable for
+    /// finding the matching arbitrary boolean expressions inside the [`FrozenATree`] via the
+    /// [`FrozenATree::search()`] function.
+    #[inline]
+    pub fn make_event(&'_ self) -> EventBuilder<'_> {
+        EventBuilder::new(&self.attributes, &self.strings)
+    }
+
+    /// Resolve the [`AttributeHandle`] of the specified attribute to set it in the events without
+    /// looking up its name.
+    #[inline]
+    pub fn attribute(&self, name: &str) -> Result<AttributeHandle, EventError> {
+        self.attributes.handle(name)
+    }
+
+    /// Create a new [`FrozenSearchContext`] that can be reused between the searches made with the
+    /// [`FrozenATree::search_with()`] function.
+    #[inline]
+    pub fn make_search_context(&'_ self) -> FrozenSearchContext<'_, T> {
+        FrozenSearchContext::new(self.nodes.len(), self.max_level)
+    }
+
+    /// Search the [`FrozenATree`] for arbitrary boolean expressions that match the [`Event`].
+    pub fn search(&'_ self, event: &Event) -> Result<Report<'_, T>, ATreeError<'_>> {
+        let mut context = self.make_search_context();
+        self.search_with(&mut context, event)?;
+        Ok(Report::new(context.matches))
+    }
+
+    /// Search the [`FrozenATree`] for arbitrary boolean expressions that match the [`Event`] by
+    /// reusing the buffers of the [`FrozenSearchContext`].
+    pub fn search_with<'a, 'c>(
+        &'a self,
+        context: &'c mut FrozenSearchContext<'a, T>,
+        event: &Event,
+    ) -> Result<&'c [&'a T], ATreeError<'a>> {
+        let levels = self.max_level - 1;
+        context.prepare(self.nodes.len(), levels);
+        let FrozenSearchContext {
+            results,
+            queues,
+            candidates,
+            matches,
+            ..
+        } = context;
+        self.process_predicates(event, candidates, matches, results, &mut queues[..]);
+
+        for level in 0..levels {
+            while let Some(node_id) = queues[level].pop() {
+                let node_id = node_id as NodeId;
+                if results.is_evaluated(node_id) {
+                    continue;
+                }
+
+                let result = self.evaluate_node(node_id, event, results, matches);
+                self.add_matches(result, node_id, matches);
+                self.propagate(node_id, result, results, &mut queues[..]);
+            }
+        }
+
+        Ok(matches)
+    }
+
+    /// Search the [`FrozenATree`] like [`FrozenATree::search_with()`] but by sweeping the levels
+    /// in the order of their nodes instead of going through queues.
+    ///
+    /// The parents of the evaluated nodes are marked in a bitmap instead of being pushed into
+    /// the queue of their level, so a node that many children schedule is only visited once. Since
+    /// the nodes of a level are numbered contiguously, each level is then evaluated in memory order
+    /// while the children of the next node are prefetched. This pays off on the deep trees whose
+    /// i-nodes are shared by many expressions; on the shallow ones, the bitmap of every level is
+    /// scanned for a handful of nodes. The matches are the same but can come in another order.
+    ///
+    /// # Examples
+    ///
+    /// ```rust
+    /// use a_tree::{ATree, AttributeDefinition};
+    ///
+    /// let definitions = [
+    ///     AttributeDefinition::boolean("private"),
+    ///     AttributeDefinition::integer("exchange_id")
+    /// ];
+    /// let mut atree = ATree::new(&definitions).unwrap();
+    /// atree.insert(&1u64, "exchange_id = 5 and not private").unwrap();
+    /// atree.insert(&2u64, "(exchange_id = 5 or private) and exchange_id > 1").unwrap();
+    /// let frozen = atree.freeze();
+    ///
+    /// let mut builder = frozen.make_event();
+    /// builder.with_integer("exchange_id", 5).unwrap();
+    /// builder.with_boolean("private", false).unwrap();
+    /// let event = builder.build().unwrap();
+    ///
+    /// let mut context = frozen.make_search_context();
+    /// let mut matches = frozen.search_sweep(&mut context, &event).unwrap().to_vec();
+    /// matches.sort();
+    /// assert_eq!(matches, [&1u64, &2u64]);
+    /// ```
+    pub fn search_sweep<'a, 'c>(
+        &'a self,
+        context: &'c mut FrozenSearchContext<'a, T>,
+        event: &Event,
+    ) -> Result<&'c [&'a T], ATreeError<'a>> {
+        context.prepare(self.nodes.len(), self.max_level - 1);
+        let FrozenSearchContext {
+            results,
+            scheduled,
+            candidates,
+            matches,
+            ..
+        } = context;
+        self.process_predicates(event, candidates, matches, results, scheduled);
+
+        for level in &self.levels {
+            // The parents are always on a higher level, so the bits of the level do not change
+            // once it is taken out of a word.
+            for word_id in level.start / Scheduled::BITS..level.end.div_ceil(Scheduled::BITS) {
+                let mut pending = scheduled.take(word_id, level);
+                while pending != 0 {
+                    let node_id = word_id * Scheduled::BITS + pending.trailing_zeros() as usize;
+                    pending &= pending - 1;
+                    if pending != 0 {
+                        let next_id = word_id * Scheduled::BITS + pending.trailing_zeros() as usize;
+                        self.prefetch_children(next_id);
+                    }
+                    if results.is_evaluated(node_id) {
+                        continue;
+                    }
+
+                    let result = self.evaluate_node(node_id, event, results, matches);
+                    self.add_matches(result, node_id, matches);
+                    self.propagate(node_id, result, results, scheduled);
+                }
+            }
+        }
+
+        Ok(matches)
+    }
+
+    /// Start loading the children of the node that is evaluated next.
+    #[inline]
+    fn prefetch_children(&self, node_id: NodeId) {
+        let start = self.nodes[node_id].children.start as usize;
+        if let Some(child_id) = self.children.get(start) {
+            prefetch(child_id);
+        }
+    }
+
+    /// Evaluate the predicates that are evaluated eagerly and schedule their parents.
+    #[inline]
+    fn process_predicates<'a, S: Schedule + ?Sized>(
+        &'a self,
+        event: &Event,
+        candidates: &mut Vec<NodeId>,
+        matches: &mut Vec<&'a T>,
+        results: &mut EvaluationResult,
+        schedule: &mut S,
+    ) {
+        if let Some(index) = &self.index {
+            index.candidates(event, candidates);
+            for predicate_id in candidates.iter() {
+                self.process_predicate(*predicate_id, event, matches, results, schedule);
+            }
+        } else {
+            let null_checks = self.groups.last().cloned().unwrap_or_default();
+            let groups = event.defined().map(|id| self.groups[id.index()].clone());
+            for predicate_id in std::iter::once(null_checks).chain(groups).flatten() {
+                self.process_predicate(predicate_id, event, matches, results, schedule);
+            }
+        }
+    }
+
+    #[inline]
+    fn process_predicate<'a, S: Schedule + ?Sized>(
+        &'a self,
+        predicate_id: NodeId,
+        event: &Event,
+        matches: &mut Vec<&'a T>,
+        results: &mut EvaluationResult,
+        schedule: &mut S,
+    ) {
+        let node = &self.nodes[predicate_id];
+        // Same as for the `ATree`, the evaluation of the predicates without subscribers and
+        // parents is delayed until there is a need for it.
+        let delay_evaluation = node.subscription_ids.is_empty() && node.parents.is_empty();
+        if delay_evaluation || results.is_evaluated(predicate_id) {
+            return;
+        }
+
+        let result = self.predicates[predicate_id].evaluate(event);
+        results.set_result(predicate_id, result);
+        self.add_matches(result, predicate_id, matches);
+        self.propagate(predicate_id, result, results, schedule);
+    }
+
+    #[inline]
+    fn propagate<S: Schedule + ?Sized>(
+        &self,
+        node_id: NodeId,
+        result: Option<bool>,
+        results: &mut EvaluationResult,
+        schedule: &mut S,
+    ) {
+        for parent_id in &self.parents[self.nodes[node_id].parents.range()] {
+            let parent = &self.nodes[*parent_id as NodeId];
+            let is_evaluated = results.is_evaluated(*parent_id as NodeId);
+            if !is_evaluated && matches!(parent.kind, Kind::And) && !result.unwrap_or(true) {
+                results.set_result(*parent_id as NodeId, Some(false));
+                continue;
+            }
+
+            if !is_evaluated {
+                schedule.schedule(*parent_id, parent.level);
+            }
+        }
+    }
+
+    #[inline]
+    fn evaluate_node<'a>(
+        &'a self,
+        node_id: NodeId,
+        event: &Event,
+        results: &mut EvaluationResult,
+        matches: &mut Vec<&'a T>,
+    ) -> Option<bool> {
+        let node = &self.nodes[node_id];
+        let children = &self.children[node.children.range()];
+        let result = match node.kind {
+            Kind::And => {
+                let mut acc = Some(true);
+                for child_id in children {
+                    match self.lazy_evaluate(*child_id as NodeId, event, results, matches) {
+                        Some(false) => {
+                            acc = Some(false);
+                            break;
+                        }
+                        None => acc = None,
+                        Some(true) => {}
+                    }
+                }
+                acc
+            }
+            Kind::Or => {
+                let mut acc = Some(false);
+                for child_id in children {
+                    match self.lazy_evaluate(*child_id as NodeId, event, results, matches) {
+                        Some(true) => {
+                            acc = Some(true);
+                            break;
+                        }
+                        None => acc = None,
+                        Some(false) => {}
+                    }
+                }
+                acc
+            }
+            Kind::Leaf => unreachable!("evaluating l-node {node_id} as an operator; this is a bug"),
+        };
+        results.set_result(node_id, result);
+        result
+    }
+
+    #[inline]
+    fn lazy_evaluate<'a>(
+        &'a self,
+        node_id: NodeId,
+        event: &Event,
+        results: &mut EvaluationResult,
+        matches: &mut Vec<&'a T>,
+    ) -> Option<bool> {
+        if results.is_evaluated(node_id) {
+            return results.get_result(node_id);
+        }
+        let result = match self.predicates.get(node_id) {
+            Some(predicate) => {
+                let result = predicate.evaluate(event);
+                results.set_result(node_id, result);
+                result
+            }
+            None => self.evaluate_node(node_id, event, results, matches),
+        };
+        self.add_matches(result, node_id, matches);
+        result
+    }
+
+    #[inline]
+    fn add_matches<'a>(&'a self, result: Option<bool>, node_id: NodeId, matches: &mut Vec<&'a T>) {
+        if let Some(true) = result {
+            let subscription_ids = self.nodes[node_id].subscription_ids.range();
+            matches.extend(self.subscription_ids[subscription_ids].iter());
+        }
+    }
+}
+
+/// Where the parents of the evaluated nodes are put until their level is evaluated.
+trait Schedule {
+    fn schedule(&mut self, node_id: FrozenId, level: FrozenId);
+}
+
+/// The queues of [`FrozenATree::search_with()`], one per level starting from the second one.
+impl Schedule for [Vec<FrozenId>] {
+    #[inline]
+    fn schedule(&mut self, node_id: FrozenId, level: FrozenId) {
+        self[level as usize - 2].push(node_id);
+    }
+}
+
+/// The nodes scheduled by [`FrozenATree::search_sweep()`] as a bit per node.
+///
+/// All the levels are swept by every search, which clears all the bits it set.
+#[derive(Debug, Default)]
+struct Scheduled(Vec<u64>);
+
+impl Scheduled {
+    const BITS: usize = u64::BITS as usize;
+
+    #[inline]
+    fn reserve(&mut self, nodes: usize) {
+        let words = nodes.div_ceil(Self::BITS);
+        if self.0.len() < words {
+            self.0.resize(words, 0);
+        }
+    }
+
+    /// Take the scheduled nodes of the word that are in the range.
+    #[inline]
+    fn take(&mut self, word_id: usize, range: &Range<usize>) -> u64 {
+        let start = word_id * Self::BITS;
+        let low = range.start.saturating_sub(start);
+        let high = (range.end - start).min(Self::BITS);
+        let mask = (u64::MAX >> (Self::BITS - (high - low))) << low;
+        let bits = self.0[word_id] & mask;
+        self.0[word_id] &= !mask;
+        bits
+    }
+}
+
+impl Schedule for Scheduled {
+    #[inline]
+    fn schedule(&mut self, node_id: FrozenId, _: FrozenId) {
+        let node_id = node_id as usize;
+        self.0[node_id / Self::BITS] |= 1 << (node_id % Self::BITS);
+    }
+}
+
+/// Hint the CPU to load the cache line of the value before it is used.
+#[inline(always)]
+fn prefetch<U>(value: &U) {
+    #[cfg(target_arch = "x86_64")]
+    // SAFETY: a prefetch is only a hint that cannot fault and SSE is part of every x86_64 CPU.
+    unsafe {
+        use std::arch::x86_64::{_mm_prefetch, _MM_HINT_T0};
+        _mm_prefetch::<_MM_HINT_T0>((value as *const U).cast());
+    }
+    #[cfg(not(target_arch = "x86_64"))]
+    let _ = value;
+}
+
+#[inline]
+fn to_frozen_id(value: usize) -> FrozenId {
+    FrozenId::try_from(value)
+        .unwrap_or_else(|_| panic!("{value} does not fit in the frozen A-Tree's 32-bit offsets"))
+}
+
+#[inline]
+fn extend<U>(values: &mut Vec<U>, iter: impl Iterator<Item = U>) -> Span {
+    let start = to_frozen_id(values.len());
+    values.extend(iter);
+    Span {
+        start,
+        end: to_frozen_id(values.len()),
+    }
+}
+
+/// The layout is fixed so that the nodes can be read in place from a frozen image.
+#[derive(Clone, Copy, Debug)]
+#[repr(C)]
+struct FrozenNode {
+    children: Span,
+    parents: Span,
+    subscription_ids: Span,
+    level: FrozenId,
+    kind: Kind,
+}
+
+#[derive(Clone, Copy, Debug)]
+#[repr(C)]
+struct Span {
+    start: FrozenId,
+    end: FrozenId,
+}
+
+impl Span {
+    #[inline]
+    const fn range(&self) -> Range<usize> {
+        self.start as usize..self.end as usize
+    }
+
+    #[inline]
+    const fn is_empty(&self) -> bool {
+        self.start == self.end
+    }
+}
+
+#[derive(Clone, Copy, Debug)]
+#[repr(u8)]
+enum Kind {
+    Leaf,
+    And,
+    Or,
+}
+
+impl From<&Operator> for Kind {
+    #[inline]
+    fn from(operator: &Operator) -> Self {
+        match operator {
+            Operator::And => Self::And,
+            Operator::Or => Self::Or,
+        }
+    }
+}
+
+/// Buffers that are reused between the searches made with the [`FrozenATree::search_with()`]
+/// and [`FrozenATree::search_sweep()`] functions.
+#[derive(Debug)]
+pub struct FrozenSearchContext<'atree, T> {
+    results: EvaluationResult,
+    queues: Vec<Vec<FrozenId>>,
+    scheduled: Scheduled,
+    candidates: Vec<NodeId>,
+    matches: Vec<&'atree T>,
+}
+
+impl<T> FrozenSearchContext<'_, T> {
+    const DEFAULT_CAPACITY: usize = 50;
+
+    fn new(nodes: usize, max_level: usize) -> Self {
+        Self {
+            results: EvaluationResult::new(nodes),
+            queues: vec![Vec::with_capacity(Self::DEFAULT_CAPACITY); max_level - 1],
+            scheduled: Scheduled::default(),
+            candidates: Vec::with_capacity(Self::DEFAULT_CAPACITY),
+            matches: Vec::with_capacity(Self::DEFAULT_CAPACITY),
+        }
+    }
+
+    #[inline]
+    fn prepare(&mut self, nodes: usize, levels: usize) {
+        self.results.clear();
+        self.results.reserve(nodes);
+        if self.queues.len() < levels {
+            self.queues
+                .resize_with(levels, || Vec::with_capacity(Self::DEFAULT_CAPACITY));
+        }
+        self.queues.iter_mut().for_each(Vec::clear);
+        self.scheduled.reserve(nodes);
+        self.candidates.clear();
+        self.matches.clear();
+    }
+}
+
+#[cfg(test)]
+mod tests {
+    use super::*;
+    use crate::events::AttributeDefinition;
+
+    fn is_sync_and_send<T: Send + Sync>() {}
+
+    #[test]
+    fn support_sync_and_send_traits() {
+        is_sync_and_send::<FrozenATree<u64>>();
+    }
+
+    #[test]
+    fn number_the_nodes_in_level_order() {
+        let definitions = [
+            AttributeDefinition::boolean("private"),
+            AttributeDefinition::integer("exchange_id"),
+            AttributeDefinition::string("country"),
+        ];
+        let mut atree = ATree::new(&definitions).unwrap();
+        atree
+            .insert(&1u64, "exchange_id = 1 and (private or country = 'CA')")
+            .unwrap();
+        atree.insert(&2u64, "exchange_id = 2").unwrap();
+
+        let frozen = atree.freeze();
+
+        assert!(frozen.nodes.windows(2).all(|w| w[0].level <= w[1].level));
+        assert!(frozen.nodes[..frozen.predicates.len()]
+            .iter()
+            .all(|node| matches!(node.kind, Kind::Leaf)));
+        assert_eq!(atree.predicates.len(), frozen.eager_predicates);
+        for (level, range) in frozen.levels.iter().enumerate() {
+            assert!(frozen.nodes[range.clone()]
+                .iter()
+                .all(|node| node.level as usize == level + 2));
+        }
+        let swept = frozen
+            .levels
+            .iter()
+            .map(ExactSizeIterator::len)
+            .sum::<usize>();
+        let internal = frozen.nodes.iter().filter(|node| node.level > 1).count();
+        assert_eq!(internal, swept);
+    }
+
+    #[test]
+    fn sweep_the_levels_that_span_many_words_of_the_bitmap() {
+        let definitions = [
+            AttributeDefinition::integer("exchange_id"),
+            AttributeDefinition::integer("placement_id"),
+            AttributeDefinition::boolean("private"),
+        ];
+        let mut atree = ATree::new(&definitions).unwrap();
+        for id in 0..200u64 {
+            let expression = format!(
+                "(exchange_id = {} or placement_id = {}) and (private or exchange_id > {})",
+                id % 7,
+                id,
+                id % 5
+            );
+            atree.insert(&id, &expression).unwrap();
+        }
+        let frozen = atree.freeze();
+        let mut context = frozen.make_search_context();
+
+        for i in 0..20 {
+            let mut builder = frozen.make_event();
+            builder.with_integer("exchange_id", i % 7).unwrap();
+            builder.with_integer("placement_id", i * 10).unwrap();
+            builder.with_boolean("private", i % 2 == 0).unwrap();
+            let event = builder.build().unwrap();
+
+            let mut expected = atree.search(&event).unwrap().matches().to_vec();
+            let mut results = frozen.search_sweep(&mut context, &event).unwrap().to_vec();
+            expected.sort();
+            results.sort();
+            assert_eq!(expected, results);
+            assert!(context.scheduled.0.iter().all(|word| *word == 0));
+        }
+    }
+
+    #[test]
+    fn can_search_an_empty_tree() {
+        let definitions = [AttributeDefinition::integer("exchange_id")];
+        let atree = ATree::<u64>::new(&definitions).unwrap();
+        let frozen = atree.freeze();
+        let mut builder = frozen.make_event();
+        builder.with_integer("exchange_id", 1).unwrap();
+        let event = builder.build().unwrap();
+
+        let report = frozen.search(&event).unwrap();
+
+        assert!(report.matches().is_empty());
+    }
+
+    #[test]
+    fn return_the_same_matches_as_the_atree() {
+        let definitions = [
+            AttributeDefinition::boolean("private"),
+            AttributeDefinition::integer("exchange_id"),
+            AttributeDefinition::string_list("deal_ids"),
+            AttributeDefinition::integer_list("segment_ids"),
+            AttributeDefinition::string("country"),
+            AttributeDefinition::string("city"),
+        ];
+        let expressions = [
+            r#"exchange_id = 1 and not private and deal_ids one of ["deal-1", "deal-2"] and segment_ids one of [1, 2, 3] and country = 'CA' and city in ['QC'] or country = 'US' and city in ['AZ']"#,
+            "exchange_id = 1",
+            "exchange_id = 1 and not private",
+            "exchange_id = 2 or (private and country = 'CA')",
+            r#"deal_ids one of ["deal-1"] and segment_ids one of [1, 2] and country in ['CA', 'US']"#,
+            "segment_ids all of [1, 2, 3, 4] or city is null",
+            "not (private or exchange_id > 2)",
+            "exchange_id = 3 and city = 'QC'",
+        ];
+        let mut atree = ATree::new(&definitions).unwrap();
+        for (id, expression) in expressions.iter().enumerate() {
+            atree.insert(&(id as u64), expression).unwrap();
+        }
+        // Leave some holes in the nodes of the `ATree`.
+        atree.delete(&1u64);
+        atree.delete(&7u64);
+        let mut indexed = atree.clone();
+        indexed.enable_predicate_index();
+        let countries = ["CA", "US", "FR", "GB"];
+
+        for atree in [&atree, &indexed] {
+            let frozen = atree.freeze();
+            let mut context = frozen.make_search_context();
+            for i in 0..150 {
+                let mut builder = atree.make_event();
+                builder.with_integer("exchange_id", i % 4).unwrap();
+                builder.with_boolean("private", i % 3 == 0).unwrap();
+                builder
+                    .with_string_list("deal_ids", &[["deal-1", "deal-2"][i as usize % 2]])
+                    .unwrap();
+                builder
+                    .with_integer_list("segment_ids", &[i % 5, (i + 1) % 5])
+                    .unwrap();
+                builder
+                    .with_string("country", countries[i as usize % 4])
+                    .unwrap();
+                if i % 7 != 0 {
+                    builder.with_string("city", "QC").unwrap();
+                }
+                let event = builder.build().unwrap();
+
+                let mut expected = atree.search(&event).unwrap().matches().to_vec();
+                let mut results = frozen.search_with(&mut context, &event).unwrap().to_vec();
+                let mut swept = frozen.search_sweep(&mut context, &event).unwrap().to_vec();
+                expected.sort();
+                results.sort();
+                swept.sort();
+                assert_eq!(expected, results);
+                assert_eq!(expected, swept);
+            }
+        }
+    }
+}
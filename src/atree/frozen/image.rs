@@ -0,0 +1,666 @@
+//! The frozen images, i.e. the files from which a [`FrozenATree`] is searched in place.
+//!
+//! An image starts like a snapshot with a header, the attributes, the strings and the predicates,
+//! which are decoded when it is loaded. The nodes, the children, the parents and the subscription
+//! IDs follow as arrays of fixed-width little-endian records that are aligned on 8 bytes from the
+//! start of the file. Since a mapping starts on a page boundary, these arrays are referenced
+//! straight from the mapped pages on the little-endian targets; they are only copied elsewhere or
+//! when the bytes are not aligned.
+use super::{FrozenATree, FrozenId, FrozenNode, Kind, Span};
+use crate::{
+    atree::{ATree, NodeId},
+    encoding::{Decoder, Encoder},
+    error::SnapshotError,
+    events::AttributeTable,
+    index::PredicateIndex,
+    mmap::Mmap,
+    opcodes::CompiledPredicate,
+    predicates::Predicate,
+    strings::StringTable,
+};
+use std::{
+    fmt::{self, Debug},
+    io::{self, BufWriter, Write},
+    ops::{Deref, Range},
+    ptr::NonNull,
+    sync::Arc,
+};
+
+/// The bytes every frozen image starts with.
+const MAGIC: [u8; 8] = *b"ATREEFRZ";
+/// The version of the format; it must be incremented on every incompatible change.
+const VERSION: u32 = 1;
+/// Set when the predicate index was enabled; it is rebuilt when the image is loaded.
+const PREDICATE_INDEX: u32 = 1;
+/// The alignment of the arrays of records from the start of the image.
+const ALIGNMENT: usize = 8;
+
+const _: () = assert!(std::mem::size_of::<FrozenNode>() == 32);
+
+/// Write the frozen image of an [`ATree`].
+///
+/// All the values are written in little endian in the following order:
+///
+/// 1. the header, i.e. the magic bytes, the version and the flags;
+/// 2. the attributes with their names and their types ordered by their IDs;
+/// 3. the strings ordered by their IDs;
+/// 4. the maximum level, the amount of eager predicates, the ranges of the groups and the levels;
+/// 5. the predicates of the l-nodes in the order of their IDs;
+/// 6. the lengths of the arrays of records followed by the nodes, the children, the parents and
+///    the subscription IDs, each starting on an aligned offset.
+pub(in crate::atree) fn save<W: Write>(atree: &ATree<u64>, writer: &mut W) -> io::Result<()> {
+    let (frozen, order) = FrozenATree::with_order(atree);
+    let mut encoder = Encoder::new(Vec::new());
+    encoder.bytes(&MAGIC)?;
+    encoder.value(&VERSION)?;
+    let flags = if frozen.index.is_some() {
+        PREDICATE_INDEX
+    } else {
+        0
+    };
+    encoder.value(&flags)?;
+
+    frozen.attributes.encode(&mut encoder)?;
+    frozen.strings.encode(&mut encoder)?;
+    encoder.value(&frozen.max_level)?;
+    encoder.value(&frozen.eager_predicates)?;
+    encoder.list(&frozen.groups, encode_range)?;
+    encoder.list(&frozen.levels, encode_range)?;
+    encoder.list(&order[..frozen.predicates.len()], |encoder, node_id| {
+        let predicate = atree.nodes[*node_id].node.predicate();
+        predicate
+            .expect("the first frozen nodes should be l-nodes; this is a bug")
+            .encode(encoder)
+    })?;
+    encoder.value(&frozen.nodes.len())?;
+    encoder.value(&frozen.children.len())?;
+    encoder.value(&frozen.parents.len())?;
+    encoder.value(&frozen.subscription_ids.len())?;
+
+    let mut writer = RecordWriter {
+        writer: BufWriter::new(writer),
+        position: 0,
+    };
+    writer.write(&encoder.into_inner())?;
+    writer.records(&frozen.nodes)?;
+    writer.records(&frozen.children)?;
+    writer.records(&frozen.parents)?;
+    writer.records(&frozen.subscription_ids)?;
+    writer.writer.flush()
+}
+
+/// Load a [`FrozenATree`] from its image.
+///
+/// The arrays of records are referenced from the mapping, when there is one and the layout of the
+/// records allows it, and copied otherwise. Every record is checked so that a corrupted image
+/// returns an error instead of making the searches panic.
+pub(super) fn load(
+    bytes: &[u8],
+    mapping: Option<&Arc<Mmap>>,
+) -> Result<FrozenATree<u64>, SnapshotError> {
+    let mut decoder = Decoder::new(bytes);
+    if decoder.bytes(MAGIC.len()).ok() != Some(&MAGIC[..]) {
+        return Err(SnapshotError::InvalidMagic);
+    }
+    let version = decoder.value::<u32>()?;
+    if version != VERSION {
+        return Err(SnapshotError::UnsupportedVersion(version));
+    }
+    let flags = decoder.value::<u32>()?;
+
+    let attributes = AttributeTable::decode(&mut decoder)?;
+    let strings = StringTable::decode(&mut decoder)?;
+    let max_level = decoder.value::<usize>()?;
+    let eager_predicates = decoder.value::<usize>()?;
+    let groups = decoder.list(decode_range)?;
+    let levels = decoder.list(decode_range)?;
+    let predicates = decoder.list(|decoder| Predicate::decode(decoder, &attributes))?;
+    if eager_predicates > predicates.len() {
+        return Err(SnapshotError::Corrupted);
+    }
+    let nodes = decoder.value::<usize>()?;
+    let children = decoder.value::<usize>()?;
+    let parents = decoder.value::<usize>()?;
+    let subscription_ids = decoder.value::<usize>()?;
+
+    let mut reader = RecordReader {
+        bytes,
+        mapping,
+        position: bytes.len() - decoder.remaining(),
+    };
+    let nodes = reader.records::<FrozenNode>(nodes)?;
+    let children = reader.records::<FrozenId>(children)?;
+    let parents = reader.records::<FrozenId>(parents)?;
+    let subscription_ids = reader.records::<u64>(subscription_ids)?;
+    if reader.position != bytes.len() {
+        return Err(SnapshotError::Corrupted);
+    }
+
+    let index = (flags & PREDICATE_INDEX != 0).then(|| {
+        let mut index = PredicateIndex::new(attributes.len());
+        for (predicate_id, predicate) in predicates[..eager_predicates].iter().enumerate() {
+            index.insert(predicate_id, predicate);
+        }
+        index
+    });
+    let frozen = FrozenATree {
+        nodes,
+        predicates: predicates.iter().map(CompiledPredicate::compile).collect(),
+        children,
+        parents,
+        subscription_ids,
+        eager_predicates,
+        groups,
+        levels,
+        max_level,
+        index,
+        strings,
+        attributes,
+    };
+    if !is_well_formed(&frozen) {
+        return Err(SnapshotError::Corrupted);
+    }
+    Ok(frozen)
+}
+
+/// Whether the [`FrozenATree`] can be searched: the predicates come first, every range is in
+/// bounds, the children of a node are below it, its parents are operators above it and the
+/// levels cover the operators of their level.
+fn is_well_formed<T>(frozen: &FrozenATree<T>) -> bool {
+    let nodes = &frozen.nodes[..];
+    let leaves = frozen.predicates.len();
+    let is_in = |span: &Span, length: usize| span.start <= span.end && span.end as usize <= length;
+    let is_well_formed_node = |(node_id, node): (NodeId, &FrozenNode)| {
+        let level = node.level as usize;
+        let has_valid_level = if node_id < leaves {
+            matches!(node.kind, Kind::Leaf) && level == 1 && node.children.is_empty()
+        } else {
+            !matches!(node.kind, Kind::Leaf) && (2..=frozen.max_level).contains(&level)
+        };
+        let is_below = |child_id: &FrozenId| {
+            nodes
+                .get(*child_id as NodeId)
+                .is_some_and(|child| child.level < node.level)
+        };
+        let is_above = |parent_id: &FrozenId| {
+            nodes
+                .get(*parent_id as NodeId)
+                .is_some_and(|parent| parent.level > node.level)
+        };
+        has_valid_level
+            && is_in(&node.children, frozen.children.len())
+            && is_in(&node.parents, frozen.parents.len())
+            && is_in(&node.subscription_ids, frozen.subscription_ids.len())
+            && frozen.children[node.children.range()].iter().all(is_below)
+            && frozen.parents[node.parents.range()].iter().all(is_above)
+    };
+    let is_well_formed_level = |(level, range): (usize, &Range<usize>)| {
+        range.start <= range.end
+            && range.end <= nodes.len()
+            && nodes[range.clone()]
+                .iter()
+                .all(|node| node.level as usize == level + 2)
+    };
+    let swept = frozen
+        .levels
+        .iter()
+        .map(ExactSizeIterator::len)
+        .sum::<usize>();
+
+    frozen.max_level >= 1
+        && frozen.levels.len() == frozen.max_level - 1
+        && leaves <= nodes.len()
+        && frozen.groups.len() == frozen.attributes.len() + 1
+        && frozen
+            .groups
+            .iter()
+            .all(|group| group.start <= group.end && group.end <= frozen.eager_predicates)
+        && frozen.levels.iter().enumerate().all(is_well_formed_level)
+        && swept == nodes.len() - leaves
+        && nodes.iter().enumerate().all(is_well_formed_node)
+}
+
+#[inline]
+fn encode_range<W: Write>(encoder: &mut Encoder<W>, range: &Range<usize>) -> io::Result<()> {
+    encoder.value(&range.start)?;
+    encoder.value(&range.end)
+}
+
+#[inline]
+fn decode_range(decoder: &mut Decoder<'_>) -> Result<Range<usize>, SnapshotError> {
+    Ok(decoder.value()?..decoder.value()?)
+}
+
+/// Writes the arrays of records of an image on aligned offsets.
+struct RecordWriter<W> {
+    writer: W,
+    position: usize,
+}
+
+impl<W: Write> RecordWriter<W> {
+    #[inline]
+    fn write(&mut self, bytes: &[u8]) -> io::Result<()> {
+        self.writer.write_all(bytes)?;
+        self.position += bytes.len();
+        Ok(())
+    }
+
+    fn records<R: Record>(&mut self, records: &[R]) -> io::Result<()> {
+        let padding = self.position.next_multiple_of(ALIGNMENT) - self.position;
+        self.write(&[0; ALIGNMENT][..padding])?;
+        let mut bytes = Vec::with_capacity(std::mem::size_of::<R>());
+        for record in records {
+            bytes.clear();
+            record.write(&mut bytes);
+            self.write(&bytes)?;
+        }
+        Ok(())
+    }
+}
+
+/// Reads the arrays of records of an image from aligned offsets.
+struct RecordReader<'a> {
+    bytes: &'a [u8],
+    mapping: Option<&'a Arc<Mmap>>,
+    position: usize,
+}
+
+impl RecordReader<'_> {
+    fn records<R: Record>(&mut self, length: usize) -> Result<Slice<R>, SnapshotError> {
+        let start = self.position.next_multiple_of(ALIGNMENT);
+        let end = length
+            .checked_mul(std::mem::size_of::<R>())
+            .and_then(|size| size.checked_add(start))
+            .filter(|end| *end <= self.bytes.len())
+            .ok_or(SnapshotError::Truncated)?;
+        self.position = end;
+
+        let section = &self.bytes[start..end];
+        let mut records = section.chunks_exact(std::mem::size_of::<R>());
+        match self.mapping {
+            Some(mapping)
+                if cfg!(target_endian = "little")
+                    && section.as_ptr().align_offset(std::mem::align_of::<R>()) == 0 =>
+            {
+                if !records.all(|record| R::read(record).is_some()) {
+                    return Err(SnapshotError::Corrupted);
+                }
+                // SAFETY: the section is aligned, its records were all checked to be valid and
+                // their layout in memory is the one of their bytes on the little-endian targets.
+                Ok(unsafe { Slice::mapped(section, length, mapping) })
+            }
+            _ => records
+                .map(R::read)
+                .collect::<Option<Vec<_>>>()
+                .map(Slice::from)
+                .ok_or(SnapshotError::Corrupted),
+        }
+    }
+}
+
+/// A value that is stored as a fixed-width little-endian record in a frozen image.
+///
+/// # Safety
+///
+/// The layout of the type in memory on a little-endian target must be the one of the bytes written
+/// by [`Record::write()`], and every record for which [`Record::read()`] returns a value must be a
+/// valid value when it is read in place.
+unsafe trait Record: Copy {
+    fn write(&self, bytes: &mut Vec<u8>);
+
+    fn read(bytes: &[u8]) -> Option<Self>;
+}
+
+macro_rules! impl_record_for_integers {
+    ($($integer:ty),*) => {
+        $(
+            // SAFETY: the integers are written in little endian and accept every bit pattern.
+            unsafe impl Record for $integer {
+                #[inline]
+                fn write(&self, bytes: &mut Vec<u8>) {
+                    bytes.extend_from_slice(&self.to_le_bytes());
+                }
+
+                #[inline]
+                fn read(bytes: &[u8]) -> Option<Self> {
+                    Some(<$integer>::from_le_bytes(bytes.try_into().ok()?))
+                }
+            }
+        )*
+    };
+}
+
+impl_record_for_integers!(u32, u64);
+
+// SAFETY: the node is `repr(C)` with 7 32-bit fields followed by the `u8` of its kind and 3 bytes
+// of padding, which is what is written; only the valid kinds are read.
+unsafe impl Record for FrozenNode {
+    fn write(&self, bytes: &mut Vec<u8>) {
+        let fields = [
+            self.children.start,
+            self.children.end,
+            self.parents.start,
+            self.parents.end,
+            self.subscription_ids.start,
+            self.subscription_ids.end,
+            self.level,
+        ];
+        for field in fields {
+            field.write(bytes);
+        }
+        bytes.extend_from_slice(&[self.kind as u8, 0, 0, 0]);
+    }
+
+    fn read(bytes: &[u8]) -> Option<Self> {
+        let field = |index: usize| FrozenId::read(&bytes[index * 4..index * 4 + 4]);
+        let span = |index: usize| {
+            Some(Span {
+                start: field(index)?,
+                end: field(index + 1)?,
+            })
+        };
+        let kind = match bytes.get(28)? {
+            0 => Kind::Leaf,
+            1 => Kind::And,
+            2 => Kind::Or,
+            _ => return None,
+        };
+        Some(Self {
+            children: span(0)?,
+            parents: span(2)?,
+            subscription_ids: span(4)?,
+            level: field(6)?,
+            kind,
+        })
+    }
+}
+
+/// A read-only array that is either owned or read in place from a mapped image.
+pub(super) struct Slice<T> {
+    pointer: NonNull<T>,
+    length: usize,
+    owner: Owner<T>,
+}
+
+enum Owner<T> {
+    Vec(Vec<T>),
+    Mapping(Arc<Mmap>),
+}
+
+impl<T> Slice<T> {
+    /// Create an array of the records that are stored in the bytes of the mapping.
+    ///
+    /// # Safety
+    ///
+    /// The bytes must be part of the mapping, be aligned for `T` and hold `length` valid values.
+    unsafe fn mapped(bytes: &[u8], length: usize, mapping: &Arc<Mmap>) -> Self {
+        Self {
+            pointer: NonNull::from(bytes).cast(),
+            length,
+            owner: Owner::Mapping(Arc::clone(mapping)),
+        }
+    }
+
+    #[cfg(test)]
+    fn is_mapped(&self) -> bool {
+        matches!(self.owner, Owner::Mapping(_))
+    }
+}
+
+impl<T> From<Vec<T>> for Slice<T> {
+    #[inline]
+    fn from(mut values: Vec<T>) -> Self {
+        // The heap buffer of the vector does not move along with it.
+        let pointer = NonNull::from(&mut values[..]).cast();
+        Self {
+            pointer,
+            length: values.len(),
+            owner: Owner::Vec(values),
+        }
+    }
+}
+
+impl<T> Deref for Slice<T> {
+    type Target = [T];
+
+    #[inline]
+    fn deref(&self) -> &Self::Target {
+        // SAFETY: the pointer refers to `length` values that live as long as their owner.
+        unsafe { std::slice::from_raw_parts(self.pointer.as_ptr(), self.length) }
+    }
+}
+
+impl<T: Clone> Clone for Slice<T> {
+    fn clone(&self) -> Self {
+        match &self.owner {
+            Owner::Vec(values) => Self::from(values.clone()),
+            Owner::Mapping(mapping) => Self {
+                pointer: self.pointer,
+                length: self.length,
+                owner: Owner::Mapping(Arc::clone(mapping)),
+            },
+        }
+    }
+}
+
+impl<T: Debug> Debug for Slice<T> {
+    fn fmt(&self, formatter: &mut fmt::Formatter<'_>) -> fmt::Result {
+        Debug::fmt(&**self, formatter)
+    }
+}
+
+// SAFETY: the values are only read through shared references, whether they are owned or mapped.
+unsafe impl<T: Send + Sync> Send for Slice<T> {}
+unsafe impl<T: Sync> Sync for Slice<T> {}
+
+#[cfg(test)]
+mod tests {
+    use super::*;
+    use crate::events::AttributeDefinition;
+
+    const AN_EXPRESSION: &str = r#"exchange_id = 1 and deal_ids one of ["deal-1", "deal-2"]"#;
+
+    fn an_atree() -> ATree<u64> {
+        let definitions = [
+            AttributeDefinition::boolean("private"),
+            AttributeDefinition::integer("exchange_id"),
+            AttributeDefinition::string_list("deal_ids"),
+            AttributeDefinition::integer_list("segment_ids"),
+            AttributeDefinition::string("country"),
+        ];
+        let mut atree = ATree::new(&definitions).unwrap();
+        atree.insert(&1, AN_EXPRESSION).unwrap();
+        atree
+            .insert(&2, "exchange_id = 1 and not private or country = 'CA'")
+            .unwrap();
+        atree
+            .insert(&3, "segment_ids all of [1, 2] and country in ['CA', 'US']")
+            .unwrap();
+        atree
+            .insert(&4, "not private and (country is null or exchange_id > 2)")
+            .unwrap();
+        atree.insert(&5, AN_EXPRESSION).unwrap();
+        atree.delete(&2);
+        atree
+    }
+
+    fn image(atree: &ATree<u64>) -> Vec<u8> {
+        let mut bytes = Vec::new();
+        atree.save_frozen(&mut bytes).unwrap();
+        bytes
+    }
+
+    fn search(frozen: &FrozenATree<u64>, i: i64) -> Vec<u64> {
+        let mut builder = frozen.make_event();
+        builder.with_integer("exchange_id", i % 4).unwrap();
+        builder.with_boolean("private", i % 3 == 0).unwrap();
+        builder
+            .with_string_list("deal_ids", &[["deal-1", "deal-3"][i as usize % 2]])
+            .unwrap();
+        builder
+            .with_integer_list("segment_ids", &[i % 3, (i + 1) % 3])
+            .unwrap();
+        if i % 5 != 0 {
+            builder
+                .with_string("country", ["CA", "US", "FR"][i as usize % 3])
+                .unwrap();
+        }
+        let event = builder.build().unwrap();
+        let mut matches = frozen
+            .search(&event)
+            .unwrap()
+            .matches()
+            .iter()
+            .map(|id| **id)
+            .collect::<Vec<_>>();
+        matches.sort();
+        matches
+    }
+
+    fn assert_same_matches(expected: &FrozenATree<u64>, actual: &FrozenATree<u64>) {
+        for i in 0..60 {
+            assert_eq!(search(expected, i), search(actual, i));
+        }
+    }
+
+    fn a_path() -> std::path::PathBuf {
+        std::env::temp_dir().join(format!(
+            "a-tree-frozen-{}-{:?}",
+            std::process::id(),
+            std::thread::current().id()
+        ))
+    }
+
+    #[test]
+    fn return_the_same_matches_as_the_frozen_atree() {
+        let atree = an_atree();
+        let mut indexed = atree.clone();
+        indexed.enable_predicate_index();
+
+        for atree in [&atree, &indexed] {
+            let loaded = FrozenATree::load(&image(atree)).unwrap();
+
+            assert_same_matches(&atree.freeze(), &loaded);
+            assert_eq!(atree.index.is_some(), loaded.index.is_some());
+        }
+    }
+
+    #[test]
+    fn search_the_arrays_in_place_from_the_mapped_file() {
+        let atree = an_atree();
+        let path = a_path();
+        std::fs::write(&path, image(&atree)).unwrap();
+
+        let loaded = FrozenATree::load_mmap(&path);
+        std::fs::remove_file(&path).unwrap();
+        let loaded = loaded.unwrap();
+
+        assert_same_matches(&atree.freeze(), &loaded);
+        if cfg!(all(unix, target_endian = "little")) {
+            assert!(loaded.nodes.is_mapped());
+            assert!(loaded.children.is_mapped());
+            assert!(loaded.parents.is_mapped());
+            assert!(loaded.subscription_ids.is_mapped());
+        }
+        // The clones share the mapping that outlives the file.
+        assert_same_matches(&atree.freeze(), &loaded.clone());
+    }
+
+    #[test]
+    fn copy_the_arrays_when_the_bytes_are_not_mapped() {
+        let loaded = FrozenATree::load(&image(&an_atree())).unwrap();
+
+        assert!(!loaded.nodes.is_mapped());
+        assert!(!loaded.subscription_ids.is_mapped());
+    }
+
+    #[test]
+    fn align_the_arrays_of_records() {
+        let atree = an_atree();
+        let frozen = atree.freeze();
+        let bytes = image(&atree);
+        let records = frozen.nodes.len() * 32
+            + (frozen.children.len() * 4).next_multiple_of(ALIGNMENT)
+            + (frozen.parents.len() * 4).next_multiple_of(ALIGNMENT)
+            + frozen.subscription_ids.len() * 8;
+
+        assert_eq!(0, (bytes.len() - records) % ALIGNMENT);
+    }
+
+    #[test]
+    fn can_load_the_image_of_an_empty_tree() {
+        let definitions = [AttributeDefinition::integer("exchange_id")];
+        let atree = ATree::<u64>::new(&definitions).unwrap();
+
+        let loaded = FrozenATree::load(&image(&atree)).unwrap();
+
+        let mut builder = loaded.make_event();
+        builder.with_integer("exchange_id", 1).unwrap();
+        let event = builder.build().unwrap();
+        assert!(loaded.search(&event).unwrap().matches().is_empty());
+    }
+
+    #[test]
+    fn return_an_error_when_the_magic_bytes_are_wrong() {
+        let mut bytes = image(&an_atree());
+        bytes[0] = b'X';
+
+        assert!(matches!(
+            FrozenATree::load(&bytes),
+            Err(SnapshotError::InvalidMagic)
+        ));
+    }
+
+    #[test]
+    fn return_an_error_when_the_version_is_not_supported() {
+        let mut bytes = image(&an_atree());
+        bytes[MAGIC.len()..MAGIC.len() + 4].copy_from_slice(&(VERSION + 1).to_le_bytes());
+
+        assert!(matches!(
+            FrozenATree::load(&bytes),
+            Err(SnapshotError::UnsupportedVersion(version)) if version == VERSION + 1
+        ));
+    }
+
+    #[test]
+    fn return_an_error_when_the_image_is_truncated() {
+        let bytes = image(&an_atree());
+
+        for length in 0..bytes.len() {
+            assert!(FrozenATree::load(&bytes[..length]).is_err());
+        }
+    }
+
+    #[test]
+    fn return_an_error_when_a_record_is_corrupted() {
+        let atree = an_atree();
+        let frozen = atree.freeze();
+        let bytes = image(&atree);
+        let subscription_ids = bytes.len() - frozen.subscription_ids.len() * 8;
+        let parents = subscription_ids - (frozen.parents.len() * 4).next_multiple_of(ALIGNMENT);
+        let children = parents - (frozen.children.len() * 4).next_multiple_of(ALIGNMENT);
+        let nodes = children - frozen.nodes.len() * 32;
+        let last = nodes + (frozen.nodes.len() - 1) * 32;
+        let corruptions = [
+            // The kind of the first node.
+            (nodes + 28, 7),
+            // The level of the first node.
+            (nodes + 24, 0xff),
+            // The end of the children of the last node.
+            (last + 4, 0xff),
+            // The first child.
+            (children + 3, 0xff),
+            // The first parent.
+            (parents + 3, 0xff),
+        ];
+
+        for (offset, value) in corruptions {
+            let mut bytes = bytes.clone();
+            bytes[offset] = value;
+            assert!(
+                matches!(FrozenATree::load(&bytes), Err(SnapshotError::Corrupted)),
+                "{offset}"
+            );
+        }
+    }
+}
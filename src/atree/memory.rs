@@ -0,0 +1,186 @@
+use super::{
+    ATree, ATreeNode, Entry, ExpressionCache, INode, LNode, NodeId, Predicates, RNode, Roots,
+};
+use crate::{ast::combine_ids, index::PredicateIndex};
+use slab::Slab;
+use std::{
+    collections::HashMap,
+    hash::Hash,
+    mem::{size_of, take},
+};
+
+/// The memory used by an [`ATree`], in bytes.
+///
+/// The amounts are computed from the capacities of the buffers so they include the space that
+/// is reserved but not used yet. The memory owned by the subscription IDs themselves (e.g. the
+/// characters of a `String`) is not counted.
+#[derive(Clone, Copy, Debug, Default, Eq, PartialEq)]
+pub struct MemoryUsage {
+    /// The slots of the nodes, including the vacant ones left behind by the deletions.
+    pub nodes: usize,
+    /// The subscriptions, the priorities, the parents and the children of the nodes.
+    pub node_vectors: usize,
+    /// The lists of the predicates, the predicates evaluated eagerly and the predicate index.
+    pub predicates: usize,
+    /// The interned strings.
+    pub strings: usize,
+    /// The maps from the expressions and from the subscriptions to their nodes, the roots and the
+    /// expression cache.
+    pub maps: usize,
+}
+
+impl MemoryUsage {
+    /// The memory used by the whole [`ATree`], in bytes.
+    pub fn total(&self) -> usize {
+        self.nodes + self.node_vectors + self.predicates + self.strings + self.maps
+    }
+}
+
+pub(super) fn usage<T>(atree: &ATree<T>) -> MemoryUsage {
+    let mut node_vectors = 0;
+    let mut predicates = atree.predicates.memory_usage()
+        + atree.index.as_ref().map_or(0, PredicateIndex::memory_usage);
+    for (_, entry) in &atree.nodes {
+        node_vectors += entry.subscription_ids.capacity() * size_of::<T>()
+            + entry.priorities.capacity() * size_of::<u32>();
+        node_vectors += match &entry.node {
+            ATreeNode::LNode(LNode { parents, .. }) => vector(parents),
+            ATreeNode::INode(INode {
+                parents, children, ..
+            }) => vector(parents) + vector(children),
+            ATreeNode::RNode(RNode { children, .. }) => vector(children),
+        };
+        predicates += entry
+            .node
+            .predicate()
+            .map_or(0, |predicate| predicate.heap_size());
+    }
+
+    MemoryUsage {
+        nodes: atree.nodes.capacity() * size_of::<Entry<T>>(),
+        node_vectors,
+        predicates,
+        strings: atree.strings.memory_usage(),
+        maps: map(&atree.expression_to_node)
+            + map(&atree.nodes_by_ids)
+            + atree.roots.memory_usage()
+            + atree
+                .expression_cache
+                .as_ref()
+                .map_or(0, ExpressionCache::memory_usage),
+    }
+}
+
+/// Renumber the nodes densely, drop the strings that are not referenced by any predicate and
+/// release the memory that is reserved but not used.
+pub(super) fn compact<T: Eq + Hash>(atree: &mut ATree<T>) {
+    let mut used = vec![false; atree.strings.len()];
+    for (_, entry) in &atree.nodes {
+        if let Some(predicate) = entry.node.predicate() {
+            for id in predicate.strings() {
+                used[id.index()] = true;
+            }
+        }
+    }
+    let strings = atree.strings.retain(&used);
+
+    // The nodes keep their relative order so that the new IDs are their ranks.
+    let previous = take(&mut atree.nodes);
+    let mut ids = vec![0; previous.capacity()];
+    for (id, (node_id, _)) in previous.iter().enumerate() {
+        ids[node_id] = id;
+    }
+    let renumber = |node_ids: &mut Vec<NodeId>| {
+        node_ids
+            .iter_mut()
+            .for_each(|node_id| *node_id = ids[*node_id]);
+        node_ids.shrink_to_fit();
+    };
+
+    let mut nodes = Slab::with_capacity(previous.len());
+    for (_, mut entry) in previous {
+        entry.subscription_ids.shrink_to_fit();
+        entry.priorities.shrink_to_fit();
+        match &mut entry.node {
+            ATreeNode::LNode(LNode {
+                parents, predicate, ..
+            }) => {
+                renumber(parents);
+                predicate.remap_strings(&strings);
+            }
+            ATreeNode::INode(INode {
+                parents, children, ..
+            }) => {
+                renumber(parents);
+                renumber(children);
+            }
+            ATreeNode::RNode(RNode { children, .. }) => renumber(children),
+        }
+        nodes.insert(entry);
+    }
+    // The IDs of the expressions are derived from the string IDs of their predicates so they
+    // are computed again from the leaves up.
+    let mut by_levels = (0..nodes.len()).collect::<Vec<_>>();
+    by_levels.sort_by_key(|node_id| nodes[*node_id].level());
+    for node_id in by_levels {
+        let id = match &nodes[node_id].node {
+            ATreeNode::LNode(LNode { predicate, .. }) => predicate.id(),
+            node => match node.children() {
+                [left, right] => combine_ids(&node.operator(), nodes[*left].id, nodes[*right].id),
+                children => unreachable!("{children:?} are not the operands of a binary operator"),
+            },
+        };
+        nodes[node_id].id = id;
+    }
+
+    if let Some(cache) = atree.expression_cache.as_mut() {
+        // The entries of the deleted expressions are dropped along the way.
+        let expression_to_node = &atree.expression_to_node;
+        cache.remap(|expression_id| {
+            let node_id = expression_to_node.get(&expression_id)?;
+            Some(nodes[ids[*node_id]].id)
+        });
+    }
+    atree.expression_to_node = nodes
+        .iter()
+        .map(|(node_id, entry)| (entry.id, node_id))
+        .collect();
+    atree.nodes_by_ids.shrink_to_fit();
+    atree
+        .nodes_by_ids
+        .values_mut()
+        .for_each(|node_id| *node_id = ids[*node_id]);
+    let mut roots = Roots::with_capacity(atree.roots.len());
+    for node_id in atree.roots.iter() {
+        roots.insert(ids[*node_id], nodes[ids[*node_id]].level());
+    }
+    atree.roots = roots;
+
+    let mut predicates = Predicates::with_capacity(atree.attributes.len(), atree.predicates.len());
+    for node_id in atree.predicates.iter() {
+        if let Some(predicate) = nodes[ids[*node_id]].node.predicate() {
+            predicates.insert(ids[*node_id], predicate);
+        }
+    }
+    atree.predicates = predicates;
+    if let Some(index) = atree.index.as_mut() {
+        *index = PredicateIndex::new(atree.attributes.len());
+        for node_id in atree.predicates.iter() {
+            if let Some(predicate) = nodes[*node_id].node.predicate() {
+                index.insert(*node_id, predicate);
+            }
+        }
+    }
+    atree.nodes = nodes;
+}
+
+#[inline]
+fn vector<V>(values: &Vec<V>) -> usize {
+    values.capacity() * size_of::<V>()
+}
+
+#[inline]
+fn map<K, V>(map: &HashMap<K, V>) -> usize {
+    // Every bucket of the hash map also has a control byte.
+    map.capacity() * (size_of::<(K, V)>() + 1)
+}
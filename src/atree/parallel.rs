@@ -0,0 +1,211 @@
+use super::{add_matches, evaluate_and, evaluate_or, Entry, NodeId};
+use crate::{ast::Operator, evaluation::SharedEvaluationResult, events::Event, pool::ThreadPool};
+use slab::Slab;
+use std::sync::{
+    atomic::{AtomicUsize, Ordering},
+    Mutex,
+};
+
+/// The amount of nodes that a thread takes at once; a stage with fewer nodes than that is not
+/// worth waking up the workers for.
+const CHUNK_SIZE: usize = 64;
+
+/// What a thread of a parallel search found so far.
+struct Worker<'a, T> {
+    matches: Vec<&'a T>,
+    /// The nodes to evaluate at each level, starting with the parents of the predicates.
+    queues: Vec<Vec<NodeId>>,
+}
+
+/// Search the nodes for the expressions matching the event over the threads of the pool.
+///
+/// The predicates are evaluated first and then each level of nodes, one after the other. Within
+/// a stage, the threads take chunks of the nodes until there is none left and record their
+/// results in a [`SharedEvaluationResult`]; the nodes that they queue for the next levels are
+/// merged at the end of the stage. Each node can only be evaluated once all the levels under it
+/// are done, so the end of a stage is the only point where the threads wait for each other.
+pub(super) fn search<'a, T: Sync>(
+    nodes: &'a Slab<Entry<T>>,
+    predicates: &[NodeId],
+    levels: usize,
+    event: &Event,
+    pool: &ThreadPool,
+) -> Vec<&'a T> {
+    let results = SharedEvaluationResult::new(nodes.capacity());
+    let mut workers = (0..pool.threads())
+        .map(|_| {
+            Mutex::new(Worker {
+                matches: Vec::new(),
+                queues: vec![Vec::new(); levels],
+            })
+        })
+        .collect::<Vec<_>>();
+
+    run(pool, &workers, predicates, |worker, predicate_id| {
+        process_predicate(predicate_id, nodes, event, &results, worker)
+    });
+
+    let mut pending = Vec::new();
+    for level in 0..levels {
+        pending.clear();
+        for worker in &mut workers {
+            let worker = worker.get_mut().unwrap();
+            pending.append(&mut worker.queues[level]);
+        }
+        // The same parent can be queued by many of its children.
+        pending.sort_unstable();
+        pending.dedup();
+        pending.retain(|node_id| !results.is_evaluated(*node_id));
+
+        run(pool, &workers, &pending, |worker, node_id| {
+            process_node(node_id, nodes, event, &results, worker)
+        });
+    }
+
+    workers
+        .into_iter()
+        .flat_map(|worker| worker.into_inner().unwrap().matches)
+        .collect()
+}
+
+/// Hand the nodes over to the threads of the pool in chunks until all of them are processed.
+fn run<'a, T, F>(pool: &ThreadPool, workers: &[Mutex<Worker<'a, T>>], node_ids: &[NodeId], f: F)
+where
+    T: Sync,
+    F: Fn(&mut Worker<'a, T>, NodeId) + Sync,
+{
+    if node_ids.len() <= CHUNK_SIZE {
+        let mut worker = workers[0].lock().unwrap();
+        node_ids.iter().for_each(|node_id| f(&mut worker, *node_id));
+        return;
+    }
+
+    let next = AtomicUsize::new(0);
+    pool.broadcast(&|index| {
+        // Each thread has its own worker so the lock is never contended.
+        let mut worker = workers[index].lock().unwrap();
+        loop {
+            let start = next.fetch_add(CHUNK_SIZE, Ordering::Relaxed);
+            if start >= node_ids.len() {
+                break;
+            }
+            let end = (start + CHUNK_SIZE).min(node_ids.len());
+            node_ids[start..end]
+                .iter()
+                .for_each(|node_id| f(&mut worker, *node_id));
+        }
+    });
+}
+
+#[inline]
+fn process_predicate<'a, T>(
+    predicate_id: NodeId,
+    nodes: &'a Slab<Entry<T>>,
+    event: &Event,
+    results: &SharedEvaluationResult,
+    worker: &mut Worker<'a, T>,
+) {
+    let node = &nodes[predicate_id];
+    // Same as for the sequential search, the predicates without subscribers and parents are
+    // only evaluated if there is a need for it.
+    let delay_evaluation = node.subscription_ids.is_empty() && node.parents().is_empty();
+    if delay_evaluation || results.is_evaluated(predicate_id) {
+        return;
+    }
+
+    let result = node.evaluate(event);
+    if results.set_result(predicate_id, result) {
+        add_matches(result, node, &mut worker.matches);
+        propagate(node, result, nodes, results, worker);
+    }
+}
+
+#[inline]
+fn process_node<'a, T>(
+    node_id: NodeId,
+    nodes: &'a Slab<Entry<T>>,
+    event: &Event,
+    results: &SharedEvaluationResult,
+    worker: &mut Worker<'a, T>,
+) {
+    if results.is_evaluated(node_id) {
+        return;
+    }
+
+    let node = &nodes[node_id];
+    let result = evaluate_node(node, event, nodes, results, &mut worker.matches);
+    if results.set_result(node_id, result) {
+        add_matches(result, node, &mut worker.matches);
+        if !node.is_root() {
+            propagate(node, result, nodes, results, worker);
+        }
+    }
+}
+
+#[inline]
+fn propagate<'a, T>(
+    node: &Entry<T>,
+    result: Option<bool>,
+    nodes: &'a Slab<Entry<T>>,
+    results: &SharedEvaluationResult,
+    worker: &mut Worker<'a, T>,
+) {
+    for parent_id in node.parents() {
+        if results.is_evaluated(*parent_id) {
+            continue;
+        }
+
+        let parent = &nodes[*parent_id];
+        if matches!(parent.operator(), Operator::And) && !result.unwrap_or(true) {
+            results.set_result(*parent_id, Some(false));
+        } else {
+            worker.queues[parent.level() - 2].push(*parent_id);
+        }
+    }
+}
+
+#[inline]
+fn evaluate_node<'a, T>(
+    node: &'a Entry<T>,
+    event: &Event,
+    nodes: &'a Slab<Entry<T>>,
+    results: &SharedEvaluationResult,
+    matches: &mut Vec<&'a T>,
+) -> Option<bool> {
+    let children = node
+        .children()
+        .iter()
+        .map(|child_id| lazy_evaluate(*child_id, event, nodes, results, matches));
+    match node.operator() {
+        Operator::And => evaluate_and(children),
+        Operator::Or => evaluate_or(children),
+    }
+}
+
+/// Evaluate a child that was not reached by the previous stages.
+///
+/// Two threads can evaluate the same child at once; only the one that records its result first
+/// adds its matches.
+#[inline]
+fn lazy_evaluate<'a, T>(
+    node_id: NodeId,
+    event: &Event,
+    nodes: &'a Slab<Entry<T>>,
+    results: &SharedEvaluationResult,
+    matches: &mut Vec<&'a T>,
+) -> Option<bool> {
+    if results.is_evaluated(node_id) {
+        return results.get_result(node_id);
+    }
+
+    let node = &nodes[node_id];
+    let result = if node.is_leaf() {
+        node.evaluate(event)
+    } else {
+        evaluate_node(node, event, nodes, results, matches)
+    };
+    if results.set_result(node_id, result) {
+        add_matches(result, node, matches);
+    }
+    result
+}
@@ -0,0 +1,650 @@
+use super::{ATree, ATreeNode, Entry, INode, LNode, NodeId, Outcomes, Predicates, RNode, Roots};
+use crate::{
+    ast::Operator,
+    encoding::{Decoder, Encoder, Persist},
+    error::SnapshotError,
+    events::AttributeTable,
+    predicates::Predicate,
+    strings::StringTable,
+};
+use slab::Slab;
+use std::{
+    collections::HashMap,
+    fmt::Debug,
+    hash::Hash,
+    io::{self, BufWriter, Write},
+};
+
+/// The bytes every snapshot starts with.
+const MAGIC: [u8; 8] = *b"ATREESNP";
+/// The version of the format; it must be incremented on every incompatible change.
+const VERSION: u32 = 2;
+/// Set when the predicate index was enabled; it is rebuilt when the snapshot is loaded.
+const PREDICATE_INDEX: u32 = 1;
+/// Set when the expression cache was enabled; it is enabled again, empty, when the snapshot is
+/// loaded.
+const EXPRESSION_CACHE: u32 = 2;
+
+const LNODE: u8 = 0;
+const INODE: u8 = 1;
+const RNODE: u8 = 2;
+
+/// Write the snapshot of an [`ATree`].
+///
+/// All the values are written in little endian in the following order:
+///
+/// 1. the header, i.e. the magic bytes, the version and the flags;
+/// 2. the attributes with their names and their types ordered by their IDs;
+/// 3. the strings ordered by their IDs;
+/// 4. the maximum level, the roots and the predicates that are evaluated eagerly;
+/// 5. the nodes along with their slab keys;
+/// 6. the expressions to nodes and the subscription IDs to nodes mappings.
+pub(super) fn save<T, W>(atree: &ATree<T>, writer: &mut W) -> io::Result<()>
+where
+    T: Persist,
+    W: Write,
+{
+    let mut encoder = Encoder::new(BufWriter::new(writer));
+    encoder.bytes(&MAGIC)?;
+    encoder.value(&VERSION)?;
+    let mut flags = 0;
+    if atree.index.is_some() {
+        flags |= PREDICATE_INDEX;
+    }
+    if atree.expression_cache.is_some() {
+        flags |= EXPRESSION_CACHE;
+    }
+    encoder.value(&flags)?;
+
+    atree.attributes.encode(&mut encoder)?;
+    atree.strings.encode(&mut encoder)?;
+    encoder.value(&atree.max_level)?;
+    encoder.list(&atree.roots, |encoder, node_id| encoder.value(node_id))?;
+    encoder.list(&atree.predicates, |encoder, node_id| encoder.value(node_id))?;
+
+    encoder.value(&atree.nodes.len())?;
+    for (node_id, entry) in &atree.nodes {
+        encoder.value(&node_id)?;
+        encode_entry(entry, &mut encoder)?;
+    }
+
+    encoder.value(&atree.expression_to_node.len())?;
+    for (expression_id, node_id) in &atree.expression_to_node {
+        encoder.value(expression_id)?;
+        encoder.value(node_id)?;
+    }
+    encoder.value(&atree.nodes_by_ids.len())?;
+    for (subscription_id, node_id) in &atree.nodes_by_ids {
+        encoder.value(subscription_id)?;
+        encoder.value(node_id)?;
+    }
+
+    encoder.into_inner().flush()
+}
+
+/// Rebuild an [`ATree`] from its snapshot.
+///
+/// Every reference to a node and the shape of every node are checked so that a corrupted snapshot
+/// returns an error instead of making the searches or the updates panic. The nodes are renumbered
+/// densely in the order of their keys so that a corrupted key cannot make the slab allocate up to
+/// it; the snapshot of a tree without holes keeps its node IDs.
+pub(super) fn load<T>(bytes: &[u8]) -> Result<ATree<T>, SnapshotError>
+where
+    T: Eq + Hash + Clone + Debug + Persist,
+{
+    let mut decoder = Decoder::new(bytes);
+    if decoder.bytes(MAGIC.len()).ok() != Some(&MAGIC[..]) {
+        return Err(SnapshotError::InvalidMagic);
+    }
+    let version = decoder.value::<u32>()?;
+    if version != VERSION {
+        return Err(SnapshotError::UnsupportedVersion(version));
+    }
+    let flags = decoder.value::<u32>()?;
+
+    let attributes = AttributeTable::decode(&mut decoder)?;
+    let strings = StringTable::decode(&mut decoder)?;
+    // The maximum level is recomputed from the roots instead.
+    let _ = decoder.value::<usize>()?;
+    let root_ids = decoder.list(Decoder::value::<NodeId>)?;
+    let predicate_ids = decoder.list(Decoder::value::<NodeId>)?;
+
+    let length = decoder.length()?;
+    let mut entries = Vec::with_capacity(length);
+    for _ in 0..length {
+        let key = decoder.value::<NodeId>()?;
+        entries.push((key, decode_entry::<T>(&mut decoder, &attributes)?));
+    }
+    entries.sort_unstable_by_key(|(key, _)| *key);
+    if entries
+        .windows(2)
+        .any(|entries| entries[0].0 == entries[1].0)
+    {
+        // Two nodes had the same key.
+        return Err(SnapshotError::Corrupted);
+    }
+    let keys = entries.iter().map(|(key, _)| *key).collect::<Vec<_>>();
+    // Translate the key of a node into its dense ID.
+    let remap = |key: &NodeId| {
+        keys.binary_search(key)
+            .map_err(|_| SnapshotError::Corrupted)
+    };
+    let remap_all = |keys: &mut Vec<NodeId>| {
+        keys.iter_mut()
+            .try_for_each(|key| remap(key).map(|node_id| *key = node_id))
+    };
+
+    let length = decoder.length()?;
+    let mut expression_to_node = HashMap::with_capacity(length);
+    for _ in 0..length {
+        expression_to_node.insert(decoder.value()?, remap(&decoder.value()?)?);
+    }
+    let length = decoder.length()?;
+    let mut nodes_by_ids = HashMap::with_capacity(length);
+    for _ in 0..length {
+        nodes_by_ids.insert(decoder.value::<T>()?, remap(&decoder.value()?)?);
+    }
+    if !decoder.is_empty() {
+        return Err(SnapshotError::Corrupted);
+    }
+
+    let mut nodes = Slab::with_capacity(entries.len());
+    for (_, mut entry) in entries {
+        match &mut entry.node {
+            ATreeNode::LNode(node) => remap_all(&mut node.parents)?,
+            ATreeNode::INode(node) => {
+                remap_all(&mut node.parents)?;
+                remap_all(&mut node.children)?;
+            }
+            ATreeNode::RNode(node) => remap_all(&mut node.children)?,
+        }
+        nodes.insert(entry);
+    }
+    if !nodes.iter().all(|(_, entry)| is_well_formed(entry, &nodes)) {
+        return Err(SnapshotError::Corrupted);
+    }
+
+    let mut predicates = Predicates::with_capacity(attributes.len(), predicate_ids.len());
+    for key in predicate_ids {
+        let node_id = remap(&key)?;
+        let Some(predicate) = nodes[node_id].node.predicate() else {
+            return Err(SnapshotError::Corrupted);
+        };
+        predicates.insert(node_id, predicate);
+    }
+    let mut roots = Roots::with_capacity(root_ids.len());
+    for key in root_ids {
+        let node_id = remap(&key)?;
+        roots.insert(node_id, nodes[node_id].level());
+    }
+    let max_level = roots.max_level();
+    if nodes.iter().any(|(_, entry)| entry.level() > max_level) {
+        return Err(SnapshotError::Corrupted);
+    }
+
+    let mut atree = ATree {
+        nodes,
+        strings,
+        attributes,
+        roots,
+        max_level,
+        predicates,
+        index: None,
+        sampling: None,
+        expression_cache: None,
+        expression_to_node,
+        nodes_by_ids,
+    };
+    if flags & PREDICATE_INDEX != 0 {
+        atree.enable_predicate_index();
+    }
+    if flags & EXPRESSION_CACHE != 0 {
+        atree.enable_expression_cache();
+    }
+    Ok(atree)
+}
+
+/// Whether the node can be searched and updated: it is used, its operator has two children under
+/// it and its parents are operators above it.
+fn is_well_formed<T>(entry: &Entry<T>, nodes: &Slab<Entry<T>>) -> bool {
+    let is_above = |parent_id: &NodeId| {
+        let parent = &nodes[*parent_id];
+        !parent.is_leaf() && parent.level() > entry.level()
+    };
+    let is_below = |child_id: &NodeId| nodes[*child_id].level() < entry.level();
+    let (parents, children): (&[NodeId], &[NodeId]) = match &entry.node {
+        ATreeNode::LNode(node) => (&node.parents, &[]),
+        ATreeNode::INode(node) => (&node.parents, &node.children),
+        ATreeNode::RNode(node) => (&[], &node.children),
+    };
+    let has_valid_children = entry.is_leaf() || (entry.level() >= 2 && children.len() == 2);
+    entry.use_count > 0
+        && has_valid_children
+        && parents.iter().all(is_above)
+        && children.iter().all(is_below)
+}
+
+fn encode_entry<T, W>(entry: &Entry<T>, encoder: &mut Encoder<W>) -> io::Result<()>
+where
+    T: Persist,
+    W: Write,
+{
+    encoder.value(&entry.id)?;
+    encoder.value(&entry.use_count)?;
+    encoder.value(&entry.cost)?;
+    encoder.list(&entry.subscription_ids, |encoder, subscription_id| {
+        encoder.value(subscription_id)
+    })?;
+    encoder.list(&entry.priorities, |encoder, priority| {
+        encoder.value(priority)
+    })?;
+    encoder.value(&entry.bound)?;
+    match &entry.node {
+        ATreeNode::LNode(node) => {
+            encoder.value(&LNODE)?;
+            encoder.value(&node.level)?;
+            encoder.list(&node.parents, |encoder, node_id| encoder.value(node_id))?;
+            node.predicate.encode(encoder)
+        }
+        ATreeNode::INode(node) => {
+            encoder.value(&INODE)?;
+            encoder.value(&node.level)?;
+            encoder.list(&node.parents, |encoder, node_id| encoder.value(node_id))?;
+            encoder.list(&node.children, |encoder, node_id| encoder.value(node_id))?;
+            encode_operator(&node.operator, encoder)
+        }
+        ATreeNode::RNode(node) => {
+            encoder.value(&RNODE)?;
+            encoder.value(&node.level)?;
+            encoder.list(&node.children, |encoder, node_id| encoder.value(node_id))?;
+            encode_operator(&node.operator, encoder)
+        }
+    }
+}
+
+fn decode_entry<T: Persist>(
+    decoder: &mut Decoder<'_>,
+    attributes: &AttributeTable,
+) -> Result<Entry<T>, SnapshotError> {
+    let id = decoder.value()?;
+    let use_count = decoder.value()?;
+    let cost = decoder.value()?;
+    let subscription_ids = decoder.list(Decoder::value::<T>)?;
+    let priorities = decoder.list(Decoder::value::<u32>)?;
+    if priorities.len() != subscription_ids.len() {
+        return Err(SnapshotError::Corrupted);
+    }
+    let bound = decoder.value()?;
+    let node = match decoder.value::<u8>()? {
+        LNODE => ATreeNode::LNode(LNode {
+            level: decoder.value()?,
+            parents: decoder.list(Decoder::value::<NodeId>)?,
+            predicate: Predicate::decode(decoder, attributes)?,
+        }),
+        INODE => ATreeNode::INode(INode {
+            level: decoder.value()?,
+            parents: decoder.list(Decoder::value::<NodeId>)?,
+            children: decoder.list(Decoder::value::<NodeId>)?,
+            operator: decode_operator(decoder)?,
+        }),
+        RNODE => ATreeNode::RNode(RNode {
+            level: decoder.value()?,
+            children: decoder.list(Decoder::value::<NodeId>)?,
+            operator: decode_operator(decoder)?,
+        }),
+        _ => return Err(SnapshotError::Corrupted),
+    };
+    Ok(Entry {
+        id,
+        subscription_ids,
+        priorities,
+        bound,
+        node,
+        use_count,
+        cost,
+        outcomes: Outcomes::default(),
+    })
+}
+
+#[inline]
+fn encode_operator<W: Write>(operator: &Operator, encoder: &mut Encoder<W>) -> io::Result<()> {
+    match operator {
+        Operator::And => encoder.value(&0u8),
+        Operator::Or => encoder.value(&1u8),
+    }
+}
+
+#[inline]
+fn decode_operator(decoder: &mut Decoder<'_>) -> Result<Operator, SnapshotError> {
+    match decoder.value::<u8>()? {
+        0 => Ok(Operator::And),
+        1 => Ok(Operator::Or),
+        _ => Err(SnapshotError::Corrupted),
+    }
+}
+
+#[cfg(test)]
+mod tests {
+    use super::*;
+    use crate::events::AttributeDefinition;
+
+    const AN_EXPRESSION: &str = r#"exchange_id = 1 and deal_ids one of ["deal-1", "deal-2"] and not private and country in ["CA", "US"] and price > 1.5"#;
+    const ANOTHER_EXPRESSION: &str =
+        r#"(exchange_id = 1 or country = "FR") and segment_ids all of [1, 2] or price is null"#;
+
+    fn definitions() -> [AttributeDefinition; 6] {
+        [
+            AttributeDefinition::boolean("private"),
+            AttributeDefinition::integer("exchange_id"),
+            AttributeDefinition::string_list("deal_ids"),
+            AttributeDefinition::integer_list("segment_ids"),
+            AttributeDefinition::string("country"),
+            AttributeDefinition::float("price"),
+        ]
+    }
+
+    fn an_atree() -> ATree<u64> {
+        let mut atree = ATree::new(&definitions()).unwrap();
+        atree.insert(&1, AN_EXPRESSION).unwrap();
+        atree.insert(&2, ANOTHER_EXPRESSION).unwrap();
+        atree.insert(&3, "exchange_id = 1").unwrap();
+        atree.insert(&4, "exchange_id = 2 or private").unwrap();
+        atree.delete(&4);
+        atree
+    }
+
+    fn snapshot<T: Eq + Hash + Clone + Debug + Persist>(atree: &ATree<T>) -> Vec<u8> {
+        let mut bytes = Vec::new();
+        atree.save(&mut bytes).unwrap();
+        bytes
+    }
+
+    fn search(atree: &ATree<u64>) -> Vec<u64> {
+        let mut builder = atree.make_event();
+        builder.with_integer("exchange_id", 1).unwrap();
+        builder.with_boolean("private", false).unwrap();
+        builder
+            .with_string_list("deal_ids", &["deal-2", "deal-3"])
+            .unwrap();
+        builder.with_integer_list("segment_ids", &[1, 2]).unwrap();
+        builder.with_string("country", "CA").unwrap();
+        builder.with_float("price", 2, 0).unwrap();
+        let event = builder.build().unwrap();
+        let mut matches = atree
+            .search(&event)
+            .unwrap()
+            .matches()
+            .iter()
+            .map(|id| **id)
+            .collect::<Vec<_>>();
+        matches.sort_unstable();
+        matches
+    }
+
+    #[test]
+    fn keep_the_priorities_of_the_subscriptions() {
+        let mut atree = an_atree();
+        atree
+            .insert_with_priority(&5, "exchange_id = 1 and not private", 10)
+            .unwrap();
+
+        let loaded = ATree::<u64>::load(&snapshot(&atree)).unwrap();
+
+        let mut builder = loaded.make_event();
+        builder.with_integer("exchange_id", 1).unwrap();
+        builder.with_boolean("private", false).unwrap();
+        let event = builder.build().unwrap();
+        assert_eq!([&5], loaded.search_top_k(&event, 1).unwrap().matches());
+    }
+
+    #[test]
+    fn return_the_same_matches_after_a_round_trip() {
+        let atree = an_atree();
+
+        let loaded = ATree::<u64>::load(&snapshot(&atree)).unwrap();
+
+        assert_eq!(vec![1, 2, 3], search(&atree));
+        assert_eq!(search(&atree), search(&loaded));
+        assert_eq!(atree.nodes.len(), loaded.nodes.len());
+        assert_eq!(atree.max_level, loaded.max_level);
+        assert_eq!(&*atree.predicates, &*loaded.predicates);
+    }
+
+    #[test]
+    fn keep_the_predicate_index_after_a_round_trip() {
+        let mut atree = an_atree();
+        atree.enable_predicate_index();
+
+        let loaded = ATree::<u64>::load(&snapshot(&atree)).unwrap();
+
+        assert!(loaded.index.is_some());
+        assert_eq!(search(&atree), search(&loaded));
+    }
+
+    #[test]
+    fn keep_the_expression_cache_enabled_after_a_round_trip() {
+        let mut atree = an_atree();
+        atree.enable_expression_cache();
+
+        let mut loaded = ATree::<u64>::load(&snapshot(&atree)).unwrap();
+        let unchanged = ATree::<u64>::load(&snapshot(&an_atree())).unwrap();
+        loaded.insert(&10u64, "exchange_id = 10").unwrap();
+
+        let key = super::super::cache::normalize("exchange_id=10").unwrap();
+        let cache = loaded.expression_cache.as_ref().unwrap();
+        assert!(cache.get(key).is_some());
+        assert!(unchanged.expression_cache.is_none());
+    }
+
+    #[test]
+    fn can_keep_updating_a_loaded_tree() {
+        let atree = an_atree();
+        let mut loaded = ATree::<u64>::load(&snapshot(&atree)).unwrap();
+
+        loaded.insert(&5, r#"country = "CA""#).unwrap();
+        loaded.insert(&6, AN_EXPRESSION).unwrap();
+        loaded.delete(&3);
+
+        assert_eq!(vec![1, 2, 5, 6], search(&loaded));
+        assert_eq!(atree.nodes_by_ids.len() + 1, loaded.nodes_by_ids.len());
+    }
+
+    #[test]
+    fn can_load_a_snapshot_from_a_mapped_file() {
+        let atree = an_atree();
+        let path = std::env::temp_dir().join(format!(
+            "a-tree-snapshot-{}-{:?}",
+            std::process::id(),
+            std::thread::current().id()
+        ));
+        std::fs::write(&path, snapshot(&atree)).unwrap();
+
+        let loaded = ATree::<u64>::load_mmap(&path);
+        std::fs::remove_file(&path).unwrap();
+
+        assert_eq!(search(&atree), search(&loaded.unwrap()));
+    }
+
+    #[test]
+    fn return_an_error_when_the_magic_bytes_are_wrong() {
+        let mut bytes = snapshot(&an_atree());
+        bytes[0] = b'X';
+
+        assert!(matches!(
+            ATree::<u64>::load(&bytes),
+            Err(SnapshotError::InvalidMagic)
+        ));
+    }
+
+    #[test]
+    fn return_an_error_when_the_version_is_not_supported() {
+        let mut bytes = snapshot(&an_atree());
+        bytes[MAGIC.len()..MAGIC.len() + 4].copy_from_slice(&(VERSION + 1).to_le_bytes());
+
+        assert!(matches!(
+            ATree::<u64>::load(&bytes),
+            Err(SnapshotError::UnsupportedVersion(version)) if version == VERSION + 1
+        ));
+    }
+
+    #[test]
+    fn return_an_error_when_the_snapshot_is_truncated() {
+        let bytes = snapshot(&an_atree());
+
+        for length in 0..bytes.len() {
+            assert!(ATree::<u64>::load(&bytes[..length]).is_err());
+        }
+    }
+
+    #[test]
+    fn recompute_the_maximum_level_from_the_roots() {
+        let loaded = load_corrupted(|atree| atree.max_level = 0).unwrap();
+
+        assert_eq!(an_atree().max_level, loaded.max_level);
+        assert_eq!(vec![1, 2, 3], search(&loaded));
+    }
+
+    #[test]
+    fn return_an_error_when_a_parent_is_an_l_node() {
+        let result = load_corrupted(|atree| {
+            let leaf_id = find(atree, |entry| entry.is_leaf());
+            let other_id = find(atree, |entry| {
+                entry.is_leaf() && entry.id != atree.nodes[leaf_id].id
+            });
+            parents(atree, leaf_id).push(other_id);
+        });
+
+        assert!(matches!(result, Err(SnapshotError::Corrupted)));
+    }
+
+    #[test]
+    fn return_an_error_when_a_parent_is_not_above_its_child() {
+        let result = load_corrupted(|atree| {
+            let leaf_id = find(atree, |entry| {
+                entry.is_leaf() && !entry.parents().is_empty()
+            });
+            let parent_level = atree.nodes[atree.nodes[leaf_id].parents()[0]].level();
+            if let ATreeNode::LNode(node) = &mut atree.nodes[leaf_id].node {
+                node.level = parent_level;
+            }
+        });
+
+        assert!(matches!(result, Err(SnapshotError::Corrupted)));
+    }
+
+    #[test]
+    fn return_an_error_when_an_operator_is_on_the_first_level() {
+        let result = load_corrupted(|atree| {
+            let node_id = find(atree, |entry| matches!(entry.node, ATreeNode::INode(_)));
+            if let ATreeNode::INode(node) = &mut atree.nodes[node_id].node {
+                node.level = 1;
+            }
+        });
+
+        assert!(matches!(result, Err(SnapshotError::Corrupted)));
+    }
+
+    #[test]
+    fn return_an_error_when_an_operator_does_not_have_two_children() {
+        let extra_child = load_corrupted(|atree| {
+            let node_id = find(atree, |entry| matches!(entry.node, ATreeNode::INode(_)));
+            let child_id = atree.nodes[node_id].children()[0];
+            if let ATreeNode::INode(node) = &mut atree.nodes[node_id].node {
+                node.children.push(child_id);
+            }
+        });
+        let missing_child = load_corrupted(|atree| {
+            let node_id = find(atree, |entry| matches!(entry.node, ATreeNode::RNode(_)));
+            if let ATreeNode::RNode(node) = &mut atree.nodes[node_id].node {
+                node.children.pop();
+            }
+        });
+
+        assert!(matches!(extra_child, Err(SnapshotError::Corrupted)));
+        assert!(matches!(missing_child, Err(SnapshotError::Corrupted)));
+    }
+
+    #[test]
+    fn return_an_error_when_a_node_is_not_used() {
+        let result = load_corrupted(|atree| {
+            let node_id = find(atree, |entry| matches!(entry.node, ATreeNode::RNode(_)));
+            atree.nodes[node_id].use_count = 0;
+        });
+
+        assert!(matches!(result, Err(SnapshotError::Corrupted)));
+    }
+
+    #[test]
+    fn renumber_the_nodes_instead_of_allocating_up_to_their_keys() {
+        let mut atree = an_atree();
+        atree.insert(&5, "exchange_id = 5").unwrap();
+        atree.delete(&1);
+        let mut bytes = snapshot(&atree);
+
+        let loaded = ATree::<u64>::load(&bytes).unwrap();
+        assert_eq!(loaded.nodes.len(), loaded.nodes.capacity());
+        assert_eq!(search(&atree), search(&loaded));
+
+        // Make the key of the first node huge; the references to it are then dangling.
+        let mut prefix = Encoder::new(Vec::new());
+        prefix.bytes(&MAGIC).unwrap();
+        prefix.value(&VERSION).unwrap();
+        prefix.value(&0u32).unwrap();
+        atree.attributes.encode(&mut prefix).unwrap();
+        atree.strings.encode(&mut prefix).unwrap();
+        prefix.value(&atree.max_level).unwrap();
+        prefix
+            .list(&atree.roots, |encoder, node_id| encoder.value(node_id))
+            .unwrap();
+        prefix
+            .list(&atree.predicates, |encoder, node_id| encoder.value(node_id))
+            .unwrap();
+        prefix.value(&atree.nodes.len()).unwrap();
+        let offset = prefix.into_inner().len();
+        bytes[offset..offset + 8].copy_from_slice(&(u64::MAX >> 1).to_le_bytes());
+
+        assert!(matches!(
+            ATree::<u64>::load(&bytes),
+            Err(SnapshotError::Corrupted)
+        ));
+    }
+
+    fn load_corrupted(corrupt: impl FnOnce(&mut ATree<u64>)) -> Result<ATree<u64>, SnapshotError> {
+        let mut atree = an_atree();
+        corrupt(&mut atree);
+        ATree::<u64>::load(&snapshot(&atree))
+    }
+
+    fn find(atree: &ATree<u64>, predicate: impl Fn(&Entry<u64>) -> bool) -> NodeId {
+        atree
+            .nodes
+            .iter()
+            .find(|(_, entry)| predicate(entry))
+            .map(|(node_id, _)| node_id)
+            .unwrap()
+    }
+
+    fn parents(atree: &mut ATree<u64>, node_id: NodeId) -> &mut Vec<NodeId> {
+        match &mut atree.nodes[node_id].node {
+            ATreeNode::LNode(node) => &mut node.parents,
+            ATreeNode::INode(node) => &mut node.parents,
+            ATreeNode::RNode(_) => unreachable!(),
+        }
+    }
+
+    #[test]
+    fn can_save_string_subscription_ids() {
+        let mut atree = ATree::new(&definitions()).unwrap();
+        atree
+            .insert(&"campaign-1".to_string(), "exchange_id = 1")
+            .unwrap();
+
+        let loaded = ATree::<String>::load(&snapshot(&atree)).unwrap();
+
+        let mut builder = loaded.make_event();
+        builder.with_integer("exchange_id", 1).unwrap();
+        let event = builder.build().unwrap();
+        let report = loaded.search(&event).unwrap();
+        assert_eq!(report.matches(), [&"campaign-1".to_string()]);
+    }
+}
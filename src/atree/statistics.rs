@@ -0,0 +1,195 @@
+use super::{add_parent, add_predicate, Entry, NodeId, Predicates};
+use crate::{ast::Operator, evaluation::EvaluationResult, index::PredicateIndex};
+use slab::Slab;
+use std::{
+    cell::Cell,
+    sync::atomic::{AtomicU32, Ordering},
+};
+
+thread_local! {
+    /// The searches made by the current thread; counting them per thread keeps the threads that
+    /// search the same tree from contending on a shared counter.
+    static SEARCHES: Cell<u64> = const { Cell::new(0) };
+}
+
+/// Decides which searches record the outcomes of the nodes they evaluated.
+#[derive(Clone, Debug)]
+pub(super) struct Sampling {
+    period: u64,
+}
+
+impl Sampling {
+    pub(super) fn new(period: u64) -> Self {
+        Self {
+            period: period.max(1),
+        }
+    }
+
+    /// Whether the outcomes of the current search have to be recorded.
+    #[inline]
+    pub(super) fn is_due(&self) -> bool {
+        SEARCHES.with(|searches| {
+            let count = searches.get();
+            searches.set(count.wrapping_add(1));
+            count % self.period == 0
+        })
+    }
+}
+
+/// The outcomes of a node observed by the sampled searches.
+///
+/// The counters are updated through a shared reference by the searches; they are approximate
+/// and stop counting once they saturate.
+#[derive(Debug, Default)]
+pub(super) struct Outcomes {
+    evaluations: AtomicU32,
+    successes: AtomicU32,
+    failures: AtomicU32,
+}
+
+impl Outcomes {
+    #[inline]
+    fn record(&self, result: Option<bool>) {
+        if self.evaluations.load(Ordering::Relaxed) == u32::MAX {
+            return;
+        }
+        self.evaluations.fetch_add(1, Ordering::Relaxed);
+        match result {
+            Some(true) => {
+                self.successes.fetch_add(1, Ordering::Relaxed);
+            }
+            Some(false) => {
+                self.failures.fetch_add(1, Ordering::Relaxed);
+            }
+            None => {}
+        }
+    }
+
+    /// The chance that the node short-circuits its parent (i.e. that it fails under an `and`
+    /// node or that it succeeds under an `or` node).
+    ///
+    /// The chance is smoothed so that a node that was never sampled is as likely to
+    /// short-circuit as not.
+    #[inline]
+    fn short_circuit(&self, operator: &Operator) -> f64 {
+        let outcomes = match operator {
+            Operator::And => &self.failures,
+            Operator::Or => &self.successes,
+        };
+        let outcomes = f64::from(outcomes.load(Ordering::Relaxed));
+        let evaluations = f64::from(self.evaluations.load(Ordering::Relaxed));
+        (outcomes + 1.0) / (evaluations + 2.0)
+    }
+}
+
+impl Clone for Outcomes {
+    fn clone(&self) -> Self {
+        let copy = |counter: &AtomicU32| AtomicU32::new(counter.load(Ordering::Relaxed));
+        Self {
+            evaluations: copy(&self.evaluations),
+            successes: copy(&self.successes),
+            failures: copy(&self.failures),
+        }
+    }
+}
+
+/// Record the outcomes of the nodes evaluated by a search.
+pub(super) fn record<T>(nodes: &Slab<Entry<T>>, results: &EvaluationResult) {
+    for (node_id, result) in results.outcomes() {
+        nodes[node_id].outcomes.record(result);
+    }
+}
+
+/// Reorder the children of all the nodes by their cost per chance of short-circuiting their
+/// parent and move the access child of the `and` nodes to the child with the lowest expected
+/// cost.
+pub(super) fn reoptimize<T>(
+    nodes: &mut Slab<Entry<T>>,
+    predicates: &mut Predicates,
+    index: &mut Option<PredicateIndex>,
+) {
+    let parent_ids = nodes
+        .iter()
+        .filter(|(_, entry)| !entry.is_leaf())
+        .map(|(node_id, _)| node_id)
+        .collect::<Vec<_>>();
+    let mut children = Vec::new();
+    for parent_id in parent_ids {
+        let operator = nodes[parent_id].operator();
+        children.clear();
+        children.extend_from_slice(nodes[parent_id].children());
+        let rank = |child_id: &NodeId| {
+            let child = &nodes[*child_id];
+            cost(child) / child.outcomes.short_circuit(&operator)
+        };
+        // The sort is stable so that the children that rank the same keep their order.
+        children.sort_by(|left, right| rank(left).total_cmp(&rank(right)));
+        nodes[parent_id]
+            .node
+            .children_mut()
+            .copy_from_slice(&children);
+
+        if matches!(operator, Operator::And) {
+            choose_access_child(parent_id, &children, nodes, predicates, index);
+        }
+    }
+}
+
+/// Move the access child of the `and` node to the child that minimizes the expected cost of
+/// evaluating the node: the access child is always evaluated while the other children are only
+/// evaluated when it did not fail.
+fn choose_access_child<T>(
+    parent_id: NodeId,
+    children: &[NodeId],
+    nodes: &mut Slab<Entry<T>>,
+    predicates: &mut Predicates,
+    index: &mut Option<PredicateIndex>,
+) {
+    let total = children
+        .iter()
+        .map(|child_id| cost(&nodes[*child_id]))
+        .sum::<f64>();
+    let expected_cost = |child_id: NodeId| {
+        let child = &nodes[child_id];
+        let cost = cost(child);
+        cost + (1.0 - child.outcomes.short_circuit(&Operator::And)) * (total - cost)
+    };
+    let Some(current_id) = children
+        .iter()
+        .copied()
+        .find(|child_id| nodes[*child_id].parents().contains(&parent_id))
+    else {
+        return;
+    };
+    let best_id = children
+        .iter()
+        .copied()
+        .min_by(|left, right| expected_cost(*left).total_cmp(&expected_cost(*right)))
+        .unwrap_or(current_id);
+    if expected_cost(best_id) >= expected_cost(current_id) {
+        return;
+    }
+
+    let current = &mut nodes[current_id];
+    current.node.remove_parent(parent_id);
+    // The previous access child no longer has to be evaluated eagerly if nothing else needs it.
+    let is_needed = !current.parents().is_empty() || !current.subscription_ids.is_empty();
+    if let (false, Some(predicate)) = (is_needed, current.node.predicate()) {
+        if predicates.remove(current_id, predicate) {
+            if let Some(index) = index.as_mut() {
+                index.remove(current_id, predicate);
+            }
+        }
+    }
+    add_parent(&mut nodes[best_id], parent_id);
+    add_predicate(best_id, nodes, predicates, index);
+}
+
+/// The cost of evaluating the node.
+///
+/// The static costs of the cheapest predicates are zero, which would rank them first whatever
+/// their outcomes, so every evaluation is counted as a unit of work on top of them.
+#[inline]
+fn cost<T>(entry: &Entry<T>) -> f64 {
+    entry.cost as f64 + 1.0
+}
@@ -0,0 +1,204 @@
+use super::{
+    collectors::{Collector, Probe, Stage},
+    Entry,
+};
+use std::{ops::AddAssign, time::Duration, time::Instant};
+
+/// What the searches made with [`crate::ATree::search_with_stats()`] did.
+///
+/// The statistics of many searches can be added together (e.g. to keep a [`SearchStats`] per
+/// thread and export them once in a while).
+#[derive(Clone, Debug, Default, Eq, PartialEq)]
+pub struct SearchStats {
+    /// The searches that were made.
+    pub searches: u64,
+    /// The predicates that were evaluated, either eagerly or because a node needed them.
+    pub predicates_evaluated: u64,
+    /// The predicates that were not evaluated eagerly since nothing needed their result yet
+    /// (i.e. the predicates without subscriptions nor parents).
+    pub predicates_delayed: u64,
+    /// The predicates that were not evaluated eagerly since they already were or since they could
+    /// not change the answer of the search.
+    pub predicates_skipped: u64,
+    /// The nodes popped from the queue of each level; the first entry is for the nodes right
+    /// above the predicates.
+    pub nodes_popped: Vec<u64>,
+    /// The `and` nodes that failed because of a child without being evaluated.
+    pub and_short_circuits: u64,
+    /// The matches that were found.
+    pub matches: u64,
+    /// The time spent evaluating the predicates.
+    pub predicates_time: Duration,
+    /// The time spent evaluating the nodes above the predicates.
+    pub levels_time: Duration,
+}
+
+impl AddAssign<&SearchStats> for SearchStats {
+    fn add_assign(&mut self, other: &SearchStats) {
+        self.searches += other.searches;
+        self.predicates_evaluated += other.predicates_evaluated;
+        self.predicates_delayed += other.predicates_delayed;
+        self.predicates_skipped += other.predicates_skipped;
+        if self.nodes_popped.len() < other.nodes_popped.len() {
+            self.nodes_popped.resize(other.nodes_popped.len(), 0);
+        }
+        for (popped, other) in self.nodes_popped.iter_mut().zip(&other.nodes_popped) {
+            *popped += other;
+        }
+        self.and_short_circuits += other.and_short_circuits;
+        self.matches += other.matches;
+        self.predicates_time += other.predicates_time;
+        self.levels_time += other.levels_time;
+    }
+}
+
+/// Collects all the matches while recording the steps of the search in the [`SearchStats`].
+pub(super) struct Instrumented<'c, 's, C> {
+    collector: &'c mut C,
+    stats: &'s mut SearchStats,
+}
+
+impl<'c, 's, C> Instrumented<'c, 's, C> {
+    pub(super) fn new(collector: &'c mut C, stats: &'s mut SearchStats) -> Self {
+        Self { collector, stats }
+    }
+}
+
+impl<'a, T, C: Collector<'a, T>> Collector<'a, T> for Instrumented<'_, '_, C> {
+    #[inline]
+    fn collect(&mut self, node: &'a Entry<T>) {
+        self.stats.matches += node.subscription_ids.len() as u64;
+        self.collector.collect(node);
+    }
+
+    #[inline]
+    fn is_done(&self) -> bool {
+        self.collector.is_done()
+    }
+
+    #[inline]
+    fn can_skip(&self, node: &Entry<T>) -> bool {
+        self.collector.can_skip(node)
+    }
+
+    #[inline]
+    fn start(&self) -> Option<Instant> {
+        Some(Instant::now())
+    }
+
+    #[inline]
+    fn observe(&mut self, probe: Probe) {
+        let stats = &mut *self.stats;
+        match probe {
+            Probe::Evaluated => stats.predicates_evaluated += 1,
+            Probe::Delayed => stats.predicates_delayed += 1,
+            Probe::Skipped => stats.predicates_skipped += 1,
+            Probe::Popped(level) => {
+                if stats.nodes_popped.len() <= level {
+                    stats.nodes_popped.resize(level + 1, 0);
+                }
+                stats.nodes_popped[level] += 1;
+            }
+            Probe::ShortCircuit => stats.and_short_circuits += 1,
+            Probe::Finished(stage, Some(start)) => {
+                let elapsed = start.elapsed();
+                match stage {
+                    Stage::Predicates => stats.predicates_time += elapsed,
+                    Stage::Levels => stats.levels_time += elapsed,
+                }
+            }
+            Probe::Finished(_, None) => {}
+        }
+    }
+}
+
+#[cfg(test)]
+mod tests {
+    use super::*;
+    use crate::{ATree, AttributeDefinition};
+
+    #[test]
+    fn record_what_the_search_did() {
+        let definitions = [
+            AttributeDefinition::boolean("private"),
+            AttributeDefinition::integer("exchange_id"),
+            AttributeDefinition::string("country"),
+        ];
+        let mut atree = ATree::new(&definitions).unwrap();
+        atree
+            .insert(&1u64, "exchange_id = 1 and country = 'CA'")
+            .unwrap();
+        atree.insert(&2u64, "exchange_id = 1 or private").unwrap();
+        atree.insert(&3u64, "private").unwrap();
+        let mut builder = atree.make_event();
+        builder.with_integer("exchange_id", 1).unwrap();
+        builder.with_string("country", "CA").unwrap();
+        builder.with_boolean("private", false).unwrap();
+        let event = builder.build().unwrap();
+        let mut context = atree.make_search_context();
+        let mut stats = SearchStats::default();
+
+        let mut matches = atree
+            .search_with_stats(&mut context, &event, &mut stats)
+            .unwrap()
+            .to_vec();
+        matches.sort();
+
+        assert_eq!(vec![&1u64, &2u64], matches);
+        assert_eq!(1, stats.searches);
+        assert_eq!(2, stats.matches);
+        assert_eq!(3, stats.predicates_evaluated);
+        assert_eq!(vec![3], stats.nodes_popped);
+        assert_eq!(0, stats.and_short_circuits);
+    }
+
+    #[test]
+    fn only_evaluate_the_null_checks_of_the_undefined_attributes() {
+        let definitions = [
+            AttributeDefinition::boolean("private"),
+            AttributeDefinition::integer("exchange_id"),
+            AttributeDefinition::string("country"),
+        ];
+        let mut atree = ATree::new(&definitions).unwrap();
+        atree.insert(&1u64, "exchange_id = 1").unwrap();
+        atree.insert(&2u64, "country = 'CA' or private").unwrap();
+        atree.insert(&3u64, "not private").unwrap();
+        atree.insert(&4u64, "country is null").unwrap();
+        let mut builder = atree.make_event();
+        builder.with_integer("exchange_id", 1).unwrap();
+        let event = builder.build().unwrap();
+        let mut context = atree.make_search_context();
+        let mut stats = SearchStats::default();
+
+        let mut matches = atree
+            .search_with_stats(&mut context, &event, &mut stats)
+            .unwrap()
+            .to_vec();
+        matches.sort();
+
+        assert_eq!(vec![&1u64, &4u64], matches);
+        assert_eq!(2, stats.predicates_evaluated);
+        assert!(stats.nodes_popped.iter().all(|popped| *popped == 0));
+    }
+
+    #[test]
+    fn add_up_the_statistics_of_many_searches() {
+        let mut stats = SearchStats {
+            searches: 1,
+            nodes_popped: vec![2],
+            ..Default::default()
+        };
+        let other = SearchStats {
+            searches: 2,
+            matches: 3,
+            nodes_popped: vec![1, 4],
+            ..Default::default()
+        };
+
+        stats += &other;
+
+        assert_eq!(3, stats.searches);
+        assert_eq!(3, stats.matches);
+        assert_eq!(vec![3, 4], stats.nodes_popped);
+    }
+}
@@ -0,0 +1,200 @@
+use crate::{
+    ast::{Arena, NodeRef},
+    error::ATreeError,
+    events::AttributeTable,
+    parser::{self, ATreeParseError},
+    strings::{StringRemap, StringTable},
+};
+use std::{num::NonZeroUsize, thread};
+
+/// The amount of expressions under which spreading the work over another thread is not worth it.
+const MIN_EXPRESSIONS_PER_THREAD: usize = 1024;
+
+/// The roots of some optimized expressions along with the [`Arena`] their nodes are in.
+pub type Chunk<T> = (Arena, Vec<(T, NodeRef)>);
+
+/// Parse and optimize the expressions over all the available cores.
+///
+/// Each thread allocates the nodes of its expressions in an [`Arena`] of its own. The chunks are
+/// in the same order as the expressions. If some expressions are invalid, the error of the first
+/// one is returned and the [`StringTable`] is left untouched.
+pub fn parse<'a, T: Send>(
+    expressions: Vec<(T, &'a str)>,
+    attributes: &AttributeTable,
+    strings: &mut StringTable,
+) -> Result<Vec<Chunk<T>>, ATreeError<'a>> {
+    let cores = thread::available_parallelism().map_or(1, NonZeroUsize::get);
+    let threads = cores.min(expressions.len() / MIN_EXPRESSIONS_PER_THREAD);
+    parse_with(expressions, attributes, strings, threads)
+}
+
+/// Parse and optimize the expressions with the specified amount of threads.
+///
+/// Parsing interns the strings of the expressions so each thread interns them in its own
+/// [`StringTable`]. The tables are then merged in the tree's table one after the other and each
+/// thread remaps the string IDs of its expressions before optimizing them since the optimization
+/// hashes the predicates (i.e. their string IDs).
+fn parse_with<'a, T: Send>(
+    expressions: Vec<(T, &'a str)>,
+    attributes: &AttributeTable,
+    strings: &mut StringTable,
+    threads: usize,
+) -> Result<Vec<Chunk<T>>, ATreeError<'a>> {
+    if threads <= 1 {
+        let mut local = StringTable::new();
+        let chunk =
+            parse_chunk(expressions, attributes, &mut local).map_err(ATreeError::ParseError)?;
+        let remap = strings.merge(&local);
+        return Ok(vec![optimize_chunk(chunk, &remap)]);
+    }
+
+    let chunk_size = expressions.len().div_ceil(threads);
+    let mut expressions = expressions.into_iter();
+    let chunks = (0..threads)
+        .map(|_| expressions.by_ref().take(chunk_size).collect::<Vec<_>>())
+        .filter(|chunk| !chunk.is_empty())
+        .collect::<Vec<_>>();
+
+    let parsed = thread::scope(|scope| {
+        let handles = chunks
+            .into_iter()
+            .map(|chunk| {
+                scope.spawn(move || {
+                    let mut local = StringTable::new();
+                    parse_chunk(chunk, attributes, &mut local).map(|chunk| (chunk, local))
+                })
+            })
+            .collect::<Vec<_>>();
+        handles.into_iter().map(join).collect::<Vec<_>>()
+    });
+    let parsed = parsed
+        .into_iter()
+        .collect::<Result<Vec<_>, ATreeParseError<'a>>>()
+        .map_err(ATreeError::ParseError)?;
+    let parsed = parsed
+        .into_iter()
+        .map(|(chunk, local)| (chunk, strings.merge(&local)))
+        .collect::<Vec<_>>();
+
+    let optimized = thread::scope(|scope| {
+        let handles = parsed
+            .into_iter()
+            .map(|(chunk, remap)| scope.spawn(move || optimize_chunk(chunk, &remap)))
+            .collect::<Vec<_>>();
+        handles.into_iter().map(join).collect::<Vec<_>>()
+    });
+    Ok(optimized)
+}
+
+#[inline]
+fn parse_chunk<'a, T>(
+    expressions: Vec<(T, &'a str)>,
+    attributes: &AttributeTable,
+    strings: &mut StringTable,
+) -> Result<Chunk<T>, ATreeParseError<'a>> {
+    let length = expressions
+        .iter()
+        .map(|(_, expression)| expression.len())
+        .sum();
+    let mut arena = Arena::for_input(length);
+    let roots = expressions
+        .into_iter()
+        .map(|(subscription_id, expression)| {
+            let root = parser::parse(expression, attributes, strings, &mut arena)?;
+            Ok((subscription_id, root))
+        })
+        .collect::<Result<_, _>>()?;
+    Ok((arena, roots))
+}
+
+#[inline]
+fn optimize_chunk<T>((mut arena, mut roots): Chunk<T>, remap: &StringRemap) -> Chunk<T> {
+    arena.remap_strings(remap);
+    for (_, root) in &mut roots {
+        *root = arena.optimize(*root);
+    }
+    (arena, roots)
+}
+
+#[inline]
+fn join<U>(handle: thread::ScopedJoinHandle<'_, U>) -> U {
+    handle
+        .join()
+        .unwrap_or_else(|error| std::panic::resume_unwind(error))
+}
+
+#[cfg(test)]
+mod tests {
+    use super::*;
+    use crate::{events::AttributeDefinition, test_utils::Expression};
+    use lalrpop_util::ParseError;
+
+    fn parse_expressions<'a>(
+        expressions: &[(u64, &'a str)],
+        threads: usize,
+    ) -> Result<(Vec<(u64, Expression)>, StringTable), ATreeError<'a>> {
+        let definitions = [
+            AttributeDefinition::integer("exchange_id"),
+            AttributeDefinition::string("country"),
+            AttributeDefinition::string_list("deal_ids"),
+        ];
+        let attributes = AttributeTable::new(&definitions).unwrap();
+        let mut strings = StringTable::new();
+        let chunks = parse_with(expressions.to_vec(), &attributes, &mut strings, threads)?;
+        let nodes = chunks
+            .into_iter()
+            .flat_map(|(arena, roots)| {
+                roots
+                    .into_iter()
+                    .map(move |(subscription_id, root)| (subscription_id, arena.expression(root)))
+                    .collect::<Vec<_>>()
+            })
+            .collect();
+        Ok((nodes, strings))
+    }
+
+    #[test]
+    fn produce_the_same_expressions_as_a_serial_parse() {
+        let expressions = (0..100u64)
+            .map(|i| {
+                format!(
+                    r#"exchange_id = {i} and country in ["C{}", "C{}"] or deal_ids one of ["deal-{}", "deal-{i}"]"#,
+                    i % 7,
+                    (i * 3) % 11,
+                    100 - i
+                )
+            })
+            .collect::<Vec<_>>();
+        let expressions = expressions
+            .iter()
+            .enumerate()
+            .map(|(i, expression)| (i as u64, expression.as_str()))
+            .collect::<Vec<_>>();
+
+        let (expected, expected_strings) = parse_expressions(&expressions, 1).unwrap();
+        let (nodes, strings) = parse_expressions(&expressions, 4).unwrap();
+
+        assert_eq!(expected, nodes);
+        for i in 0..100 {
+            let value = format!("deal-{i}");
+            assert_eq!(expected_strings.get(&value), strings.get(&value));
+        }
+    }
+
+    #[test]
+    fn return_the_error_of_the_first_invalid_expression() {
+        let mut expressions = vec![(0u64, "exchange_id = 1"); 10];
+        expressions[3].1 = "exchange_id =";
+        expressions[8].1 = "exchange_id = 1 and";
+
+        let result = parse_expressions(&expressions, 4);
+
+        assert!(matches!(
+            result,
+            Err(ATreeError::ParseError(ParseError::UnrecognizedEof {
+                location: 13,
+                ..
+            }))
+        ));
+    }
+}
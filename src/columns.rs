@@ -0,0 +1,807 @@
+use crate::{
+    events::{
+        AttributeHandle, AttributeKind, AttributeTable, AttributeValue, Event, EventError, ListPool,
+    },
+    strings::StringTable,
+};
+use rust_decimal::Decimal;
+
+/// The largest scale of a [`Decimal`]; building one with a larger scale panics.
+const MAX_SCALE: u32 = 28;
+
+/// A bitmap packed in the least significant bit order of the Arrow format.
+///
+/// The `offset` is the position of the first bit of the array in the bytes.
+#[derive(Clone, Copy, Debug)]
+pub struct Bitmap<'a> {
+    bytes: &'a [u8],
+    offset: usize,
+}
+
+impl<'a> Bitmap<'a> {
+    pub fn new(bytes: &'a [u8], offset: usize) -> Self {
+        Self { bytes, offset }
+    }
+
+    #[inline]
+    fn get(&self, i: usize) -> bool {
+        let i = self.offset + i;
+        self.bytes[i / 8] & (1 << (i % 8)) != 0
+    }
+
+    #[inline]
+    fn holds(&self, length: usize) -> bool {
+        (self.offset + length).div_ceil(8) <= self.bytes.len()
+    }
+}
+
+/// An array of integers with an optional validity bitmap (i.e. the values of a list column).
+#[derive(Clone, Copy, Debug)]
+pub struct IntegerArray<'a> {
+    values: &'a [i64],
+    validity: Option<Bitmap<'a>>,
+}
+
+impl<'a> IntegerArray<'a> {
+    pub fn new(values: &'a [i64]) -> Self {
+        Self {
+            values,
+            validity: None,
+        }
+    }
+
+    /// Skip the values whose bit is unset in the bitmap.
+    pub fn with_validity(self, validity: Bitmap<'a>) -> Self {
+        Self {
+            validity: Some(validity),
+            ..self
+        }
+    }
+
+    #[inline]
+    fn has_valid_validity(&self) -> bool {
+        self.validity
+            .is_none_or(|validity| validity.holds(self.values.len()))
+    }
+}
+
+/// An array of UTF-8 strings laid out as an Arrow `utf8` array.
+///
+/// The string `i` is `data[offsets[i]..offsets[i + 1]]`.
+#[derive(Clone, Copy, Debug)]
+pub struct StringArray<'a> {
+    offsets: &'a [i32],
+    data: &'a [u8],
+    validity: Option<Bitmap<'a>>,
+}
+
+impl<'a> StringArray<'a> {
+    pub fn new(offsets: &'a [i32], data: &'a [u8]) -> Self {
+        Self {
+            offsets,
+            data,
+            validity: None,
+        }
+    }
+
+    /// Skip the strings whose bit is unset in the bitmap when they are part of a list.
+    pub fn with_validity(self, validity: Bitmap<'a>) -> Self {
+        Self {
+            validity: Some(validity),
+            ..self
+        }
+    }
+
+    #[inline]
+    fn len(&self) -> usize {
+        self.offsets.len().saturating_sub(1)
+    }
+
+    #[inline]
+    fn has_valid_validity(&self) -> bool {
+        self.validity
+            .is_none_or(|validity| validity.holds(self.len()))
+    }
+
+    #[inline]
+    fn get(&self, i: usize) -> Option<Result<&'a str, &'static str>> {
+        if self.validity.is_some_and(|validity| !validity.get(i)) {
+            return None;
+        }
+        Some(
+            range(self.offsets, i, self.data.len()).and_then(|(start, end)| {
+                std::str::from_utf8(&self.data[start..end]).map_err(|_| "invalid UTF-8")
+            }),
+        )
+    }
+}
+
+#[derive(Clone, Copy, Debug)]
+enum ColumnValues<'a> {
+    Boolean(Bitmap<'a>),
+    Integer(&'a [i64]),
+    Float(&'a [i64], u32),
+    String(StringArray<'a>),
+    IntegerList(&'a [i32], IntegerArray<'a>),
+    StringList(&'a [i32], StringArray<'a>),
+}
+
+impl ColumnValues<'_> {
+    #[inline]
+    fn kind(&self) -> AttributeKind {
+        match self {
+            Self::Boolean(_) => AttributeKind::Boolean,
+            Self::Integer(_) => AttributeKind::Integer,
+            Self::Float(_, _) => AttributeKind::Float,
+            Self::String(_) => AttributeKind::String,
+            Self::IntegerList(_, _) => AttributeKind::IntegerList,
+            Self::StringList(_, _) => AttributeKind::StringList,
+        }
+    }
+
+    #[inline]
+    fn holds(&self, rows: usize) -> bool {
+        match self {
+            Self::Boolean(values) => values.holds(rows),
+            Self::Integer(values) | Self::Float(values, _) => values.len() >= rows,
+            Self::String(values) => values.len() >= rows,
+            Self::IntegerList(offsets, _) | Self::StringList(offsets, _) => offsets.len() > rows,
+        }
+    }
+
+    /// Whether the validity bitmap of the values, if any, covers all of them.
+    #[inline]
+    fn has_valid_validity(&self) -> bool {
+        match self {
+            Self::Boolean(_) | Self::Integer(_) | Self::Float(_, _) => true,
+            Self::String(values) | Self::StringList(_, values) => values.has_valid_validity(),
+            Self::IntegerList(_, values) => values.has_valid_validity(),
+        }
+    }
+}
+
+/// The values of an attribute for all the events of a batch.
+///
+/// The buffers follow the layout of the [Arrow columnar format] so that they can be handed over
+/// without copying them: the lists use 32 bits offsets into their values and the `undefined`
+/// values are the ones whose bit is unset in the validity bitmap.
+///
+/// [Arrow columnar format]: https://arrow.apache.org/docs/format/Columnar.html
+#[derive(Clone, Copy, Debug)]
+pub struct Column<'a> {
+    attribute: AttributeHandle,
+    validity: Option<Bitmap<'a>>,
+    values: ColumnValues<'a>,
+}
+
+impl<'a> Column<'a> {
+    /// Create a column of booleans packed in a bitmap.
+    pub fn boolean(attribute: AttributeHandle, values: Bitmap<'a>) -> Self {
+        Self::with_values(attribute, ColumnValues::Boolean(values))
+    }
+
+    /// Create a column of integers.
+    pub fn integer(attribute: AttributeHandle, values: &'a [i64]) -> Self {
+        Self::with_values(attribute, ColumnValues::Integer(values))
+    }
+
+    /// Create a column of floats represented as decimals sharing the same scale (e.g. 123.45 is
+    /// 12345 with a scale of 2); the scale is at most 28.
+    pub fn float(attribute: AttributeHandle, numbers: &'a [i64], scale: u32) -> Self {
+        Self::with_values(attribute, ColumnValues::Float(numbers, scale))
+    }
+
+    /// Create a column of strings.
+    pub fn string(attribute: AttributeHandle, values: StringArray<'a>) -> Self {
+        Self::with_values(attribute, ColumnValues::String(values))
+    }
+
+    /// Create a column of lists of integers; the list `i` is `values[offsets[i]..offsets[i + 1]]`.
+    pub fn integer_list(
+        attribute: AttributeHandle,
+        offsets: &'a [i32],
+        values: IntegerArray<'a>,
+    ) -> Self {
+        Self::with_values(attribute, ColumnValues::IntegerList(offsets, values))
+    }
+
+    /// Create a column of lists of strings; the list `i` is `values[offsets[i]..offsets[i + 1]]`.
+    pub fn string_list(
+        attribute: AttributeHandle,
+        offsets: &'a [i32],
+        values: StringArray<'a>,
+    ) -> Self {
+        Self::with_values(attribute, ColumnValues::StringList(offsets, values))
+    }
+
+    /// Leave the attribute `undefined` for the events whose bit is unset in the bitmap.
+    pub fn with_validity(self, validity: Bitmap<'a>) -> Self {
+        Self {
+            validity: Some(validity),
+            ..self
+        }
+    }
+
+    #[inline]
+    fn with_values(attribute: AttributeHandle, values: ColumnValues<'a>) -> Self {
+        Self {
+            attribute,
+            validity: None,
+            values,
+        }
+    }
+}
+
+/// The events of a batch filled from [`Column`]s.
+///
+/// The events and the buffers of their lists are kept between the batches so that filling a
+/// batch does not allocate once the batch has grown enough.
+#[derive(Default, Debug)]
+pub struct EventBatch {
+    events: Vec<Event>,
+    rows: usize,
+    lists: ListPool,
+    covered: Vec<bool>,
+    undefined: Vec<usize>,
+}
+
+impl EventBatch {
+    pub fn new() -> Self {
+        Self::default()
+    }
+
+    /// Get the events of the last filled batch.
+    #[inline]
+    pub fn events(&self) -> &[Event] {
+        &self.events[..self.rows]
+    }
+
+    /// Fill the batch with `rows` events whose attributes are taken from the columns.
+    ///
+    /// The attributes without a column are left `undefined`. On error, the batch is left empty.
+    pub(crate) fn fill(
+        &mut self,
+        attributes: &AttributeTable,
+        strings: &StringTable,
+        rows: usize,
+        columns: &[Column<'_>],
+    ) -> Result<(), EventError> {
+        self.rows = 0;
+        self.validate(attributes, rows, columns)?;
+
+        if self
+            .events
+            .first()
+            .is_some_and(|event| event.len() != attributes.len())
+        {
+            self.events.clear();
+        }
+        if self.events.len() < rows {
+            self.events
+                .resize_with(rows, || Event::undefined(attributes.len()));
+        }
+
+        for (row, event) in self.events[..rows].iter_mut().enumerate() {
+            event.update(|values| {
+                for index in &self.undefined {
+                    self.lists.recycle(&mut values[*index]);
+                }
+                for column in columns {
+                    let value = &mut values[column.attribute.index()];
+                    if column.validity.is_some_and(|validity| !validity.get(row)) {
+                        self.lists.recycle(value);
+                        continue;
+                    }
+                    fill_value(&mut self.lists, strings, attributes, column, row, value)?;
+                }
+                Ok(())
+            })?;
+        }
+        self.rows = rows;
+        Ok(())
+    }
+
+    fn validate(
+        &mut self,
+        attributes: &AttributeTable,
+        rows: usize,
+        columns: &[Column<'_>],
+    ) -> Result<(), EventError> {
+        self.covered.clear();
+        self.covered.resize(attributes.len(), false);
+        for column in columns {
+            let id = column.attribute.id();
+            let Some(covered) = self.covered.get_mut(id.index()) else {
+                return Err(EventError::NonExistingAttribute(id.to_string()));
+            };
+            let expected = attributes.by_id(id);
+            let actual = column.values.kind();
+            if expected != actual {
+                return Err(EventError::WrongType {
+                    name: attributes.name(id).to_owned(),
+                    expected,
+                    actual,
+                });
+            }
+            let invalid = |reason| EventError::InvalidColumn {
+                name: attributes.name(id).to_owned(),
+                reason,
+            };
+            if std::mem::replace(covered, true) {
+                return Err(invalid("the attribute has more than one column"));
+            }
+            if !column.values.holds(rows) {
+                return Err(invalid(
+                    "the column has fewer values than the batch has events",
+                ));
+            }
+            if column
+                .validity
+                .is_some_and(|validity| !validity.holds(rows))
+            {
+                return Err(invalid("the validity bitmap is shorter than the batch"));
+            }
+            if matches!(column.values, ColumnValues::Float(_, scale) if scale > MAX_SCALE) {
+                return Err(invalid("the scale of the floats is greater than 28"));
+            }
+            if !column.values.has_valid_validity() {
+                return Err(invalid(
+                    "the validity bitmap of the values is shorter than the values",
+                ));
+            }
+        }
+
+        self.undefined.clear();
+        let uncovered = self
+            .covered
+            .iter()
+            .enumerate()
+            .filter(|(_, covered)| !**covered);
+        self.undefined.extend(uncovered.map(|(index, _)| index));
+        Ok(())
+    }
+}
+
+#[inline]
+fn fill_value(
+    lists: &mut ListPool,
+    strings: &StringTable,
+    attributes: &AttributeTable,
+    column: &Column<'_>,
+    row: usize,
+    value: &mut AttributeValue,
+) -> Result<(), EventError> {
+    let invalid = |reason| EventError::InvalidColumn {
+        name: attributes.name(column.attribute.id()).to_owned(),
+        reason,
+    };
+    match column.values {
+        ColumnValues::Boolean(values) => {
+            lists.recycle(value);
+            *value = AttributeValue::Boolean(values.get(row));
+        }
+        ColumnValues::Integer(values) => {
+            lists.recycle(value);
+            *value = AttributeValue::Integer(values[row]);
+        }
+        ColumnValues::Float(numbers, scale) => {
+            lists.recycle(value);
+            *value = AttributeValue::Float(Decimal::new(numbers[row], scale));
+        }
+        ColumnValues::String(values) => {
+            let string = values.get(row).transpose().map_err(invalid)?;
+            lists.recycle(value);
+            if let Some(string) = string {
+                *value = AttributeValue::String(strings.get(string));
+            }
+        }
+        ColumnValues::IntegerList(offsets, values) => {
+            let (start, end) = range(offsets, row, values.values.len()).map_err(invalid)?;
+            let mut list = lists.integer_list(value);
+            match values.validity {
+                Some(validity) => list.extend(
+                    (start..end)
+                        .filter(|i| validity.get(*i))
+                        .map(|i| values.values[i]),
+                ),
+                None => list.extend_from_slice(&values.values[start..end]),
+            }
+            list.sort_unstable();
+            list.dedup();
+            *value = AttributeValue::IntegerList(list);
+        }
+        ColumnValues::StringList(offsets, values) => {
+            let (start, end) = range(offsets, row, values.len()).map_err(invalid)?;
+            let mut list = lists.string_list(value);
+            for i in start..end {
+                match values.get(i) {
+                    Some(Ok(string)) => list.push(strings.get(string)),
+                    Some(Err(reason)) => {
+                        *value = AttributeValue::StringList(list);
+                        return Err(invalid(reason));
+                    }
+                    None => {}
+                }
+            }
+            list.sort_unstable();
+            list.dedup();
+            *value = AttributeValue::StringList(list);
+        }
+    }
+    Ok(())
+}
+
+/// Get the range of the element `i` from the offsets of an Arrow array.
+#[inline]
+fn range(offsets: &[i32], i: usize, length: usize) -> Result<(usize, usize), &'static str> {
+    let (Some(start), Some(end)) = (offsets.get(i), offsets.get(i + 1)) else {
+        return Err("the offsets are shorter than the array");
+    };
+    match (usize::try_from(*start), usize::try_from(*end)) {
+        (Ok(start), Ok(end)) if start <= end && end <= length => Ok((start, end)),
+        _ => Err("the offsets are out of bounds"),
+    }
+}
+
+#[cfg(test)]
+mod tests {
+    use super::*;
+    use crate::{events::AttributeDefinition, ATree};
+
+    fn attributes() -> AttributeTable {
+        AttributeTable::new(&[
+            AttributeDefinition::boolean("private"),
+            AttributeDefinition::integer("exchange_id"),
+            AttributeDefinition::string("country"),
+            AttributeDefinition::string_list("deal_ids"),
+        ])
+        .unwrap()
+    }
+
+    fn handle(attributes: &AttributeTable, name: &str) -> AttributeHandle {
+        attributes.handle(name).unwrap()
+    }
+
+    #[test]
+    fn match_the_same_expressions_as_the_events_built_one_by_one() {
+        let definitions = [
+            AttributeDefinition::boolean("private"),
+            AttributeDefinition::integer("exchange_id"),
+            AttributeDefinition::float("bidfloor"),
+            AttributeDefinition::string("country"),
+            AttributeDefinition::integer_list("segment_ids"),
+            AttributeDefinition::string_list("deal_ids"),
+        ];
+        let mut atree = ATree::new(&definitions).unwrap();
+        atree.insert(&1u64, "private and exchange_id = 1").unwrap();
+        atree
+            .insert(&2u64, r#"country = "FR" or bidfloor > 1.5"#)
+            .unwrap();
+        atree.insert(&3u64, "segment_ids one of [2, 3]").unwrap();
+        atree
+            .insert(&4u64, r#"deal_ids all of ["deal-1", "deal-2"]"#)
+            .unwrap();
+        atree.insert(&5u64, "exchange_id is null").unwrap();
+        let handle = |name| atree.attribute(name).unwrap();
+        let private = [0b10];
+        let exchange_ids = [1, 1];
+        let exchange_ids_validity = [0b01];
+        let bidfloors = [100, 200];
+        let countries = StringArray::new(&[0, 2, 4], b"FRUS");
+        let segment_ids = [1, 3, 2];
+        let deal_ids = StringArray::new(&[0, 6, 12], b"deal-1deal-2");
+        let columns = [
+            Column::boolean(handle("private"), Bitmap::new(&private, 0)),
+            Column::integer(handle("exchange_id"), &exchange_ids)
+                .with_validity(Bitmap::new(&exchange_ids_validity, 0)),
+            Column::float(handle("bidfloor"), &bidfloors, 2),
+            Column::string(handle("country"), countries),
+            Column::integer_list(
+                handle("segment_ids"),
+                &[0, 1, 3],
+                IntegerArray::new(&segment_ids),
+            ),
+            Column::string_list(handle("deal_ids"), &[0, 0, 2], deal_ids),
+        ];
+        let mut expected = Vec::new();
+        for row in 0..2 {
+            let mut builder = atree.make_event();
+            builder.with_boolean("private", row == 1).unwrap();
+            if row == 0 {
+                builder.with_integer("exchange_id", 1).unwrap();
+            }
+            builder.with_float("bidfloor", 100 * (row + 1), 2).unwrap();
+            builder
+                .with_string("country", ["FR", "US"][row as usize])
+                .unwrap();
+            builder
+                .with_integer_list("segment_ids", [&[1][..], &[3, 2]][row as usize])
+                .unwrap();
+            builder
+                .with_string_list("deal_ids", [&[][..], &["deal-1", "deal-2"]][row as usize])
+                .unwrap();
+            expected.push(builder.build().unwrap());
+        }
+        let mut batch = EventBatch::new();
+
+        let reports = atree.search_columns(&mut batch, 2, &columns).unwrap();
+
+        let expected = atree.search_batch(&expected).unwrap();
+        for (report, expected) in reports.iter().zip(&expected) {
+            let mut matches = report.matches().to_vec();
+            matches.sort();
+            let mut expected = expected.matches().to_vec();
+            expected.sort();
+            assert_eq!(expected, matches);
+        }
+        let mut matches = reports.iter().map(|report| report.matches().to_vec());
+        let mut first = matches.next().unwrap();
+        first.sort();
+        assert_eq!(vec![&2u64, &4], first);
+        let mut second = matches.next().unwrap();
+        second.sort();
+        assert_eq!(vec![&2u64, &3, &4, &5], second);
+    }
+
+    #[test]
+    fn leave_the_attributes_without_column_undefined() {
+        let attributes = attributes();
+        let strings = StringTable::new();
+        let exchange_id = handle(&attributes, "exchange_id");
+        let mut batch = EventBatch::new();
+
+        batch
+            .fill(
+                &attributes,
+                &strings,
+                2,
+                &[Column::integer(exchange_id, &[1, 2])],
+            )
+            .unwrap();
+
+        assert_eq!(2, batch.events().len());
+        for event in batch.events() {
+            assert!(matches!(
+                event[exchange_id.id()],
+                AttributeValue::Integer(_)
+            ));
+            let private = handle(&attributes, "private").id();
+            assert!(matches!(event[private], AttributeValue::Undefined));
+        }
+    }
+
+    #[test]
+    fn skip_the_null_values_of_the_lists() {
+        let attributes = attributes();
+        let mut strings = StringTable::new();
+        let deal_1 = strings.get_or_update("deal-1");
+        let deal_ids = handle(&attributes, "deal_ids");
+        let values =
+            StringArray::new(&[0, 6, 12], b"deal-1deal-2").with_validity(Bitmap::new(&[0b01], 0));
+        let mut batch = EventBatch::new();
+
+        batch
+            .fill(
+                &attributes,
+                &strings,
+                1,
+                &[Column::string_list(deal_ids, &[0, 2], values)],
+            )
+            .unwrap();
+
+        assert!(matches!(
+            &batch.events()[0][deal_ids.id()],
+            AttributeValue::StringList(values) if values == &[deal_1]
+        ));
+    }
+
+    #[test]
+    fn reuse_the_events_between_the_batches() {
+        let attributes = attributes();
+        let strings = StringTable::new();
+        let deal_ids = handle(&attributes, "deal_ids");
+        let private = handle(&attributes, "private");
+        let values = StringArray::new(&[0, 6, 12], b"deal-1deal-2");
+        let mut batch = EventBatch::new();
+        batch
+            .fill(
+                &attributes,
+                &strings,
+                3,
+                &[Column::string_list(deal_ids, &[0, 1, 2, 2], values)],
+            )
+            .unwrap();
+
+        batch
+            .fill(
+                &attributes,
+                &strings,
+                1,
+                &[Column::boolean(private, Bitmap::new(&[0b1], 0))],
+            )
+            .unwrap();
+
+        assert_eq!(1, batch.events().len());
+        assert!(matches!(
+            batch.events()[0][deal_ids.id()],
+            AttributeValue::Undefined
+        ));
+        assert!(matches!(
+            batch.events()[0][private.id()],
+            AttributeValue::Boolean(true)
+        ));
+    }
+
+    #[test]
+    fn return_an_error_when_the_column_does_not_match_the_attribute_type() {
+        let attributes = attributes();
+        let strings = StringTable::new();
+        let private = handle(&attributes, "private");
+        let mut batch = EventBatch::new();
+
+        let result = batch.fill(&attributes, &strings, 1, &[Column::integer(private, &[1])]);
+
+        assert!(matches!(result, Err(EventError::WrongType { .. })));
+        assert!(batch.events().is_empty());
+    }
+
+    #[test]
+    fn return_an_error_when_an_attribute_has_two_columns() {
+        let attributes = attributes();
+        let strings = StringTable::new();
+        let exchange_id = handle(&attributes, "exchange_id");
+        let mut batch = EventBatch::new();
+        let column = Column::integer(exchange_id, &[1]);
+
+        let result = batch.fill(&attributes, &strings, 1, &[column, column]);
+
+        assert!(matches!(result, Err(EventError::InvalidColumn { .. })));
+    }
+
+    #[test]
+    fn return_an_error_when_a_column_is_shorter_than_the_batch() {
+        let attributes = attributes();
+        let strings = StringTable::new();
+        let exchange_id = handle(&attributes, "exchange_id");
+        let private = handle(&attributes, "private");
+        let mut batch = EventBatch::new();
+
+        let integers = batch.fill(
+            &attributes,
+            &strings,
+            2,
+            &[Column::integer(exchange_id, &[1])],
+        );
+        let bitmap = batch.fill(
+            &attributes,
+            &strings,
+            9,
+            &[Column::boolean(private, Bitmap::new(&[0xff], 0))],
+        );
+
+        assert!(matches!(integers, Err(EventError::InvalidColumn { .. })));
+        assert!(matches!(bitmap, Err(EventError::InvalidColumn { .. })));
+    }
+
+    #[test]
+    fn return_an_error_when_the_validity_of_the_values_is_shorter_than_the_values() {
+        let attributes = AttributeTable::new(&[
+            AttributeDefinition::string("country"),
+            AttributeDefinition::integer_list("segment_ids"),
+            AttributeDefinition::string_list("deal_ids"),
+        ])
+        .unwrap();
+        let strings = StringTable::new();
+        let country = handle(&attributes, "country");
+        let deal_ids = handle(&attributes, "deal_ids");
+        let segment_ids = handle(&attributes, "segment_ids");
+        let values = [1, 2, 3, 4, 5, 6, 7, 8, 9];
+        let offsets = [0, 9];
+        let string_offsets = [0, 1, 2, 3, 4, 5, 6, 7, 8, 9];
+        let validity = [0xff];
+        let string_values = StringArray::new(&string_offsets, b"abcdefghi")
+            .with_validity(Bitmap::new(&validity, 0));
+        let mut batch = EventBatch::new();
+
+        let string = batch.fill(
+            &attributes,
+            &strings,
+            1,
+            &[Column::string(country, string_values)],
+        );
+        let string_list = batch.fill(
+            &attributes,
+            &strings,
+            1,
+            &[Column::string_list(deal_ids, &offsets, string_values)],
+        );
+        let integer_list = batch.fill(
+            &attributes,
+            &strings,
+            1,
+            &[Column::integer_list(
+                segment_ids,
+                &offsets,
+                IntegerArray::new(&values).with_validity(Bitmap::new(&validity, 0)),
+            )],
+        );
+
+        for result in [string, string_list, integer_list] {
+            assert!(matches!(
+                result,
+                Err(EventError::InvalidColumn {
+                    reason: "the validity bitmap of the values is shorter than the values",
+                    ..
+                })
+            ));
+        }
+    }
+
+    #[test]
+    fn return_an_error_when_the_scale_of_the_floats_is_too_large() {
+        let attributes = AttributeTable::new(&[AttributeDefinition::float("bidfloor")]).unwrap();
+        let strings = StringTable::new();
+        let bidfloor = handle(&attributes, "bidfloor");
+        let mut batch = EventBatch::new();
+
+        let result = batch.fill(
+            &attributes,
+            &strings,
+            1,
+            &[Column::float(bidfloor, &[15], MAX_SCALE + 1)],
+        );
+        let largest = batch.fill(
+            &attributes,
+            &strings,
+            1,
+            &[Column::float(bidfloor, &[15], MAX_SCALE)],
+        );
+
+        assert!(matches!(
+            result,
+            Err(EventError::InvalidColumn {
+                reason: "the scale of the floats is greater than 28",
+                ..
+            })
+        ));
+        assert!(largest.is_ok());
+    }
+
+    #[test]
+    fn return_an_error_when_the_offsets_are_out_of_bounds() {
+        let attributes = attributes();
+        let strings = StringTable::new();
+        let deal_ids = handle(&attributes, "deal_ids");
+        let values = StringArray::new(&[0, 6], b"deal-1");
+        let mut batch = EventBatch::new();
+
+        let result = batch.fill(
+            &attributes,
+            &strings,
+            1,
+            &[Column::string_list(deal_ids, &[0, 2], values)],
+        );
+
+        assert!(matches!(result, Err(EventError::InvalidColumn { .. })));
+        assert!(batch.events().is_empty());
+    }
+
+    #[test]
+    fn return_an_error_when_a_string_is_not_valid_utf_8() {
+        let attributes = attributes();
+        let strings = StringTable::new();
+        let country = handle(&attributes, "country");
+        let values = StringArray::new(&[0, 2], &[0xc3, 0x28]);
+        let mut batch = EventBatch::new();
+
+        let result = batch.fill(&attributes, &strings, 1, &[Column::string(country, values)]);
+
+        assert!(matches!(
+            result,
+            Err(EventError::InvalidColumn {
+                reason: "invalid UTF-8",
+                ..
+            })
+        ));
+    }
+}
@@ -0,0 +1,234 @@
+use crate::error::SnapshotError;
+use rust_decimal::Decimal;
+use std::io::{self, Write};
+
+/// A subscription ID that can be written in an [`crate::ATree`] snapshot.
+///
+/// The values are written in little endian so that the snapshots can be loaded on any platform.
+pub trait Persist: Sized {
+    /// Write the value at the end of the snapshot.
+    fn persist<W: Write>(&self, writer: &mut W) -> io::Result<()>;
+
+    /// Read a value from the start of the bytes and advance them past it.
+    fn restore(bytes: &mut &[u8]) -> Result<Self, SnapshotError>;
+}
+
+macro_rules! impl_persist_for_integers {
+    ($($integer:ty),*) => {
+        $(
+            impl Persist for $integer {
+                #[inline]
+                fn persist<W: Write>(&self, writer: &mut W) -> io::Result<()> {
+                    writer.write_all(&self.to_le_bytes())
+                }
+
+                #[inline]
+                fn restore(bytes: &mut &[u8]) -> Result<Self, SnapshotError> {
+                    let value = take(bytes, std::mem::size_of::<$integer>())?;
+                    Ok(<$integer>::from_le_bytes(value.try_into().unwrap()))
+                }
+            }
+        )*
+    };
+}
+
+impl_persist_for_integers!(u8, u16, u32, u64, u128, i8, i16, i32, i64, i128);
+
+impl Persist for usize {
+    #[inline]
+    fn persist<W: Write>(&self, writer: &mut W) -> io::Result<()> {
+        (*self as u64).persist(writer)
+    }
+
+    #[inline]
+    fn restore(bytes: &mut &[u8]) -> Result<Self, SnapshotError> {
+        usize::try_from(u64::restore(bytes)?).map_err(|_| SnapshotError::Corrupted)
+    }
+}
+
+impl Persist for String {
+    #[inline]
+    fn persist<W: Write>(&self, writer: &mut W) -> io::Result<()> {
+        self.len().persist(writer)?;
+        writer.write_all(self.as_bytes())
+    }
+
+    #[inline]
+    fn restore(bytes: &mut &[u8]) -> Result<Self, SnapshotError> {
+        let length = usize::restore(bytes)?;
+        let value = take(bytes, length)?;
+        String::from_utf8(value.to_vec()).map_err(|_| SnapshotError::Corrupted)
+    }
+}
+
+/// Writes the snapshot of an [`crate::ATree`].
+pub struct Encoder<W> {
+    writer: W,
+}
+
+impl<W: Write> Encoder<W> {
+    pub fn new(writer: W) -> Self {
+        Self { writer }
+    }
+
+    #[inline]
+    pub fn value<V: Persist>(&mut self, value: &V) -> io::Result<()> {
+        value.persist(&mut self.writer)
+    }
+
+    #[inline]
+    pub fn bytes(&mut self, value: &[u8]) -> io::Result<()> {
+        self.writer.write_all(value)
+    }
+
+    #[inline]
+    pub fn decimal(&mut self, value: &Decimal) -> io::Result<()> {
+        self.bytes(&value.serialize())
+    }
+
+    /// Write the length of the values followed by each value.
+    #[inline]
+    pub fn list<V, F>(&mut self, values: &[V], mut f: F) -> io::Result<()>
+    where
+        F: FnMut(&mut Self, &V) -> io::Result<()>,
+    {
+        self.value(&values.len())?;
+        values.iter().try_for_each(|value| f(self, value))
+    }
+
+    pub fn into_inner(self) -> W {
+        self.writer
+    }
+}
+
+/// Reads the snapshot of an [`crate::ATree`].
+///
+/// The values are read straight from the underlying bytes (e.g. the mapped pages of a file)
+/// without buffering them.
+pub struct Decoder<'a> {
+    bytes: &'a [u8],
+}
+
+impl<'a> Decoder<'a> {
+    pub fn new(bytes: &'a [u8]) -> Self {
+        Self { bytes }
+    }
+
+    #[inline]
+    pub fn value<V: Persist>(&mut self) -> Result<V, SnapshotError> {
+        V::restore(&mut self.bytes)
+    }
+
+    #[inline]
+    pub fn bytes(&mut self, length: usize) -> Result<&'a [u8], SnapshotError> {
+        take(&mut self.bytes, length)
+    }
+
+    #[inline]
+    pub fn decimal(&mut self) -> Result<Decimal, SnapshotError> {
+        let bytes = self.bytes(16)?;
+        Ok(Decimal::deserialize(bytes.try_into().unwrap()))
+    }
+
+    /// Read a length followed by that many values.
+    #[inline]
+    pub fn list<V, F>(&mut self, mut f: F) -> Result<Vec<V>, SnapshotError>
+    where
+        F: FnMut(&mut Self) -> Result<V, SnapshotError>,
+    {
+        let length = self.length()?;
+        (0..length).map(|_| f(self)).collect()
+    }
+
+    /// Read the length of a collection.
+    ///
+    /// Every element takes at least a byte so a length that exceeds the remaining bytes can only
+    /// come from a corrupted snapshot; rejecting it avoids allocating a huge collection for it.
+    #[inline]
+    pub fn length(&mut self) -> Result<usize, SnapshotError> {
+        let length = self.value::<usize>()?;
+        if length > self.bytes.len() {
+            return Err(SnapshotError::Truncated);
+        }
+        Ok(length)
+    }
+
+    #[inline]
+    pub fn is_empty(&self) -> bool {
+        self.bytes.is_empty()
+    }
+
+    /// The amount of bytes that are left to read.
+    #[inline]
+    pub fn remaining(&self) -> usize {
+        self.bytes.len()
+    }
+}
+
+#[inline]
+fn take<'a>(bytes: &mut &'a [u8], length: usize) -> Result<&'a [u8], SnapshotError> {
+    if bytes.len() < length {
+        return Err(SnapshotError::Truncated);
+    }
+    let (value, rest) = bytes.split_at(length);
+    *bytes = rest;
+    Ok(value)
+}
+
+#[cfg(test)]
+mod tests {
+    use super::*;
+
+    #[test]
+    fn can_read_back_the_written_values() {
+        let mut encoder = Encoder::new(Vec::new());
+        encoder.value(&42u64).unwrap();
+        encoder.value(&-3i32).unwrap();
+        encoder.value(&"deal-1".to_string()).unwrap();
+        encoder.decimal(&Decimal::new(314, 2)).unwrap();
+        encoder
+            .list(&[1i64, 2, 3], |encoder, value| encoder.value(value))
+            .unwrap();
+        let bytes = encoder.into_inner();
+        let mut decoder = Decoder::new(&bytes);
+
+        assert_eq!(42u64, decoder.value::<u64>().unwrap());
+        assert_eq!(-3i32, decoder.value::<i32>().unwrap());
+        assert_eq!("deal-1", decoder.value::<String>().unwrap());
+        assert_eq!(Decimal::new(314, 2), decoder.decimal().unwrap());
+        assert_eq!(
+            vec![1i64, 2, 3],
+            decoder.list(|decoder| decoder.value::<i64>()).unwrap()
+        );
+        assert!(decoder.is_empty());
+    }
+
+    #[test]
+    fn write_the_integers_in_little_endian() {
+        let mut encoder = Encoder::new(Vec::new());
+
+        encoder.value(&0x0102_0304u32).unwrap();
+
+        assert_eq!(vec![4, 3, 2, 1], encoder.into_inner());
+    }
+
+    #[test]
+    fn return_an_error_when_the_bytes_are_truncated() {
+        let mut decoder = Decoder::new(&[1, 2, 3]);
+
+        assert!(matches!(
+            decoder.value::<u64>(),
+            Err(SnapshotError::Truncated)
+        ));
+    }
+
+    #[test]
+    fn return_an_error_when_a_length_exceeds_the_remaining_bytes() {
+        let mut encoder = Encoder::new(Vec::new());
+        encoder.value(&u64::MAX).unwrap();
+        let bytes = encoder.into_inner();
+        let mut decoder = Decoder::new(&bytes);
+
+        assert!(decoder.list(|decoder| decoder.value::<u8>()).is_err());
+    }
+}
@@ -16,3 +16,17 @@ pub enum ATreeError<'a> {
     #[error("failed with {0:?}")]
     Event(EventError),
 }
+
+#[derive(Debug, Error)]
+pub enum SnapshotError {
+    #[error("failed to access the snapshot with {0:?}")]
+    Io(#[from] std::io::Error),
+    #[error("the file is not an A-Tree snapshot")]
+    InvalidMagic,
+    #[error("unsupported snapshot version {0}")]
+    UnsupportedVersion(u32),
+    #[error("the snapshot is truncated")]
+    Truncated,
+    #[error("the snapshot is corrupted")]
+    Corrupted,
+}
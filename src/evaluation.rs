@@ -1,8 +1,11 @@
+use std::sync::atomic::{AtomicU64, Ordering};
+
 #[derive(Debug)]
 pub struct EvaluationResult {
     failed: Vec<u64>,
     success: Vec<u64>,
     evaluated: Vec<u64>,
+    dirty: Vec<usize>,
 }
 
 impl EvaluationResult {
@@ -14,9 +17,77 @@ impl EvaluationResult {
             failed: vec![0; size],
             success: vec![0; size],
             evaluated: vec![0; size],
+            dirty: vec![],
+        }
+    }
+
+    /// Grow the results so that they can hold the specified amount of expressions.
+    #[inline]
+    pub fn reserve(&mut self, expressions: usize) {
+        let size = expressions / Self::EXPRESSIONS_PER_BUCKET + 1;
+        if size > self.evaluated.len() {
+            self.failed.resize(size, 0);
+            self.success.resize(size, 0);
+            self.evaluated.resize(size, 0);
         }
     }
 
+    /// Reset the results by only clearing the buckets that were modified since the last clear.
+    #[inline]
+    pub fn clear(&mut self) {
+        for bucket in self.dirty.drain(..) {
+            self.failed[bucket] = 0;
+            self.success[bucket] = 0;
+            self.evaluated[bucket] = 0;
+        }
+    }
+
+    /// Make these results the same as the other ones while keeping the allocated buffers.
+    pub fn copy_from(&mut self, other: &Self) {
+        self.failed.clone_from(&other.failed);
+        self.success.clone_from(&other.success);
+        self.evaluated.clone_from(&other.evaluated);
+        self.dirty.clone_from(&other.dirty);
+    }
+
+    /// Forget the result of the expression so that it has to be evaluated again.
+    #[inline]
+    pub fn reset(&mut self, id: usize) {
+        Self::clear_bit(&mut self.failed, id);
+        Self::clear_bit(&mut self.success, id);
+        Self::clear_bit(&mut self.evaluated, id);
+    }
+
+    /// Put back the result that the expression has in the other results.
+    ///
+    /// The bucket of the expression is not listed again: if the other results evaluated it, it is
+    /// already listed since they were copied.
+    #[inline]
+    pub fn restore(&mut self, id: usize, other: &Self) {
+        self.reset(id);
+        let bucket = id / Self::EXPRESSIONS_PER_BUCKET;
+        let mask = 1u64 << (id % Self::EXPRESSIONS_PER_BUCKET);
+        self.failed[bucket] |= other.failed[bucket] & mask;
+        self.success[bucket] |= other.success[bucket] & mask;
+        self.evaluated[bucket] |= other.evaluated[bucket] & mask;
+    }
+
+    /// Forget the buckets listed since the results were copied from the other ones.
+    ///
+    /// Every expression evaluated since the copy must have been restored beforehand so that the
+    /// buckets left out are either listed by the other results or empty.
+    #[inline]
+    pub fn restore_dirty(&mut self, other: &Self) {
+        debug_assert!(self.dirty.starts_with(&other.dirty));
+        self.dirty.truncate(other.dirty.len());
+    }
+
+    /// The amount of buckets listed as modified since the last clear.
+    #[cfg(test)]
+    pub fn dirty_buckets(&self) -> usize {
+        self.dirty.len()
+    }
+
     #[inline]
     pub fn is_evaluated(&self, id: usize) -> bool {
         let evaluated = Self::get_bit(&self.evaluated, id);
@@ -35,6 +106,10 @@ impl EvaluationResult {
             None => {}
         }
 
+        let bucket = id / Self::EXPRESSIONS_PER_BUCKET;
+        if self.evaluated[bucket] == 0 {
+            self.dirty.push(bucket);
+        }
         Self::set_bit(&mut self.evaluated, id);
     }
 
@@ -49,12 +124,34 @@ impl EvaluationResult {
         Some(!failed && success)
     }
 
+    /// Iterate over the expressions evaluated since the last clear along with their results.
+    pub fn outcomes(&self) -> impl Iterator<Item = (usize, Option<bool>)> + '_ {
+        self.dirty.iter().flat_map(move |bucket| {
+            let mut evaluated = self.evaluated[*bucket];
+            std::iter::from_fn(move || {
+                if evaluated == 0 {
+                    return None;
+                }
+                let id =
+                    bucket * Self::EXPRESSIONS_PER_BUCKET + evaluated.trailing_zeros() as usize;
+                evaluated &= evaluated - 1;
+                Some((id, self.get_result(id)))
+            })
+        })
+    }
+
     #[inline]
     const fn set_bit(entries: &mut [u64], id: usize) {
         let position_in_entry: usize = id % Self::EXPRESSIONS_PER_BUCKET;
         entries[id / Self::EXPRESSIONS_PER_BUCKET] |= 1u64 << position_in_entry;
     }
 
+    #[inline]
+    const fn clear_bit(entries: &mut [u64], id: usize) {
+        let position_in_entry: usize = id % Self::EXPRESSIONS_PER_BUCKET;
+        entries[id / Self::EXPRESSIONS_PER_BUCKET] &= !(1u64 << position_in_entry);
+    }
+
     #[inline]
     const fn get_bit(entries: &[u64], id: usize) -> u64 {
         let entry = entries[id / Self::EXPRESSIONS_PER_BUCKET];
@@ -63,6 +160,192 @@ impl EvaluationResult {
     }
 }
 
+/// The results of the evaluation of expressions that are shared by the threads of a parallel
+/// search.
+///
+/// The results use the same buckets as [`EvaluationResult`] but their bits are set atomically.
+/// An expression can be evaluated by more than one thread at once (e.g. a child shared by two
+/// nodes); they all find the same result and only the first one to record it claims it.
+#[derive(Debug)]
+pub struct SharedEvaluationResult {
+    failed: Vec<AtomicU64>,
+    success: Vec<AtomicU64>,
+    evaluated: Vec<AtomicU64>,
+}
+
+impl SharedEvaluationResult {
+    pub fn new(expressions: usize) -> Self {
+        let size = expressions / EvaluationResult::EXPRESSIONS_PER_BUCKET + 1;
+        let buckets = || (0..size).map(|_| AtomicU64::new(0)).collect();
+        Self {
+            failed: buckets(),
+            success: buckets(),
+            evaluated: buckets(),
+        }
+    }
+
+    #[inline]
+    pub fn is_evaluated(&self, id: usize) -> bool {
+        let (bucket, bit) = Self::position(id);
+        self.evaluated[bucket].load(Ordering::Acquire) & bit != 0
+    }
+
+    /// Record the result of the expression and return whether it was not evaluated before.
+    ///
+    /// The result is published before the expression is marked as evaluated so that a thread
+    /// that sees it as evaluated also sees its result.
+    #[inline]
+    pub fn set_result(&self, id: usize, result: Option<bool>) -> bool {
+        let (bucket, bit) = Self::position(id);
+        match result {
+            Some(true) => {
+                self.success[bucket].fetch_or(bit, Ordering::Relaxed);
+            }
+            Some(false) => {
+                self.failed[bucket].fetch_or(bit, Ordering::Relaxed);
+            }
+            None => {}
+        }
+        self.evaluated[bucket].fetch_or(bit, Ordering::Release) & bit == 0
+    }
+
+    #[inline]
+    pub fn get_result(&self, id: usize) -> Option<bool> {
+        debug_assert!(self.is_evaluated(id));
+        let (bucket, bit) = Self::position(id);
+        let failed = self.failed[bucket].load(Ordering::Relaxed) & bit != 0;
+        let success = self.success[bucket].load(Ordering::Relaxed) & bit != 0;
+        if !failed && !success {
+            return None;
+        }
+        Some(!failed && success)
+    }
+
+    #[inline]
+    const fn position(id: usize) -> (usize, u64) {
+        let bucket = id / EvaluationResult::EXPRESSIONS_PER_BUCKET;
+        (
+            bucket,
+            1u64 << (id % EvaluationResult::EXPRESSIONS_PER_BUCKET),
+        )
+    }
+}
+
+/// The results of the evaluation of expressions over a batch of events.
+///
+/// Each expression that is part of the results is assigned a slot that holds one bit per event
+/// (using the same 64-bit buckets as [`EvaluationResult`]). Only the successes are kept since an
+/// expression can only match if its sub-expressions succeeded.
+#[derive(Debug)]
+pub struct BatchEvaluationResult {
+    buckets: usize,
+    slots: Vec<usize>,
+    success: Vec<u64>,
+    evaluated: Vec<u64>,
+}
+
+impl BatchEvaluationResult {
+    const EVENTS_PER_BUCKET: usize = 64;
+    const NO_SLOT: usize = usize::MAX;
+
+    pub fn new(expressions: usize, events: usize) -> Self {
+        Self {
+            buckets: Self::buckets_for(events),
+            slots: vec![Self::NO_SLOT; expressions],
+            success: vec![],
+            evaluated: vec![],
+        }
+    }
+
+    /// The amount of buckets that are needed to hold one bit per event.
+    #[inline]
+    pub const fn buckets_for(events: usize) -> usize {
+        events.div_ceil(Self::EVENTS_PER_BUCKET)
+    }
+
+    /// Set the bits of all the events from the batch.
+    pub fn fill(events: usize, entries: &mut [u64]) {
+        entries.fill(u64::MAX);
+        let remainder = events % Self::EVENTS_PER_BUCKET;
+        if remainder != 0 {
+            if let Some(last) = entries.last_mut() {
+                *last = (1u64 << remainder) - 1;
+            }
+        }
+    }
+
+    /// Iterate over the events whose bit is set.
+    #[inline]
+    pub fn events(entries: &[u64]) -> impl Iterator<Item = usize> + '_ {
+        entries.iter().enumerate().flat_map(|(bucket, entry)| {
+            let mut entry = *entry;
+            std::iter::from_fn(move || {
+                if entry == 0 {
+                    return None;
+                }
+                let position = entry.trailing_zeros() as usize;
+                entry &= entry - 1;
+                Some(bucket * Self::EVENTS_PER_BUCKET + position)
+            })
+        })
+    }
+
+    #[inline]
+    pub const fn set_bit(entries: &mut [u64], event: usize) {
+        entries[event / Self::EVENTS_PER_BUCKET] |= 1u64 << (event % Self::EVENTS_PER_BUCKET);
+    }
+
+    #[inline]
+    pub fn contains(&self, id: usize) -> bool {
+        self.slots[id] != Self::NO_SLOT
+    }
+
+    /// Add the expression to the results; returns `false` if it was already present.
+    #[inline]
+    pub fn insert(&mut self, id: usize) -> bool {
+        if self.contains(id) {
+            return false;
+        }
+
+        self.slots[id] = self.success.len() / self.buckets;
+        self.success.resize(self.success.len() + self.buckets, 0);
+        self.evaluated
+            .resize(self.evaluated.len() + self.buckets, 0);
+        true
+    }
+
+    /// Get the events for which the expression succeeded.
+    #[inline]
+    pub fn success(&self, id: usize) -> Option<&[u64]> {
+        self.range(id).map(|range| &self.success[range])
+    }
+
+    /// Get the events for which the expression was evaluated.
+    #[inline]
+    pub fn evaluated(&self, id: usize) -> Option<&[u64]> {
+        self.range(id).map(|range| &self.evaluated[range])
+    }
+
+    /// Record the results of the expression for the evaluated events.
+    pub fn set_results(&mut self, id: usize, success: &[u64], evaluated: &[u64]) {
+        self.insert(id);
+        if let Some(range) = self.range(id) {
+            let entries = self.success[range.clone()].iter_mut().zip(success);
+            entries.for_each(|(entry, success)| *entry |= success);
+            let entries = self.evaluated[range].iter_mut().zip(evaluated);
+            entries.for_each(|(entry, evaluated)| *entry |= evaluated);
+        }
+    }
+
+    #[inline]
+    fn range(&self, id: usize) -> Option<std::ops::Range<usize>> {
+        match self.slots[id] {
+            Self::NO_SLOT => None,
+            slot => Some(slot * self.buckets..(slot + 1) * self.buckets),
+        }
+    }
+}
+
 #[cfg(test)]
 mod tests {
     use super::*;
@@ -128,6 +411,141 @@ mod tests {
         assert_eq!(None, results.get_result(AN_ID));
     }
 
+    #[test]
+    fn clearing_the_results_resets_the_evaluated_expressions() {
+        let mut results = EvaluationResult::new(SIZE);
+        results.set_result(AN_ID, Some(true));
+        results.set_result(AN_ID_THAT_EXCEEDS_U64, Some(false));
+
+        results.clear();
+
+        assert!(!results.is_evaluated(AN_ID));
+        assert!(!results.is_evaluated(AN_ID_THAT_EXCEEDS_U64));
+        results.set_result(AN_ID, None);
+        assert_eq!(None, results.get_result(AN_ID));
+    }
+
+    #[test]
+    fn restore_a_reset_result_from_other_results() {
+        let mut base = EvaluationResult::new(SIZE);
+        base.set_result(AN_ID, Some(true));
+        let mut results = EvaluationResult::new(SIZE_LESS_THAN_64);
+        results.copy_from(&base);
+        results.set_result(AN_ID_THAT_EXCEEDS_U64, Some(false));
+
+        results.reset(AN_ID);
+        assert!(!results.is_evaluated(AN_ID));
+        results.set_result(AN_ID, Some(false));
+        results.restore(AN_ID, &base);
+        results.restore(AN_ID_THAT_EXCEEDS_U64, &base);
+
+        assert_eq!(Some(true), results.get_result(AN_ID));
+        assert!(!results.is_evaluated(AN_ID_THAT_EXCEEDS_U64));
+    }
+
+    #[test]
+    fn forget_the_buckets_listed_since_the_copy_once_restored() {
+        let mut base = EvaluationResult::new(SIZE);
+        base.set_result(AN_ID, Some(true));
+        let mut results = EvaluationResult::new(SIZE);
+        results.copy_from(&base);
+
+        for _ in 0..10 {
+            results.reset(AN_ID);
+            results.set_result(AN_ID, Some(false));
+            results.set_result(AN_ID_THAT_EXCEEDS_U64, None);
+            results.restore(AN_ID, &base);
+            results.restore(AN_ID_THAT_EXCEEDS_U64, &base);
+            results.restore_dirty(&base);
+        }
+
+        assert_eq!(1, results.dirty_buckets());
+        assert_eq!(
+            vec![(AN_ID, Some(true))],
+            results.outcomes().collect::<Vec<_>>()
+        );
+    }
+
+    #[test]
+    fn iterate_over_the_evaluated_expressions_and_their_results() {
+        let mut results = EvaluationResult::new(SIZE);
+        results.set_result(AN_ID_THAT_EXCEEDS_U64, Some(false));
+        results.set_result(AN_ID, Some(true));
+        results.set_result(AN_ID + 1, None);
+
+        let mut outcomes = results.outcomes().collect::<Vec<_>>();
+        outcomes.sort_unstable();
+
+        assert_eq!(
+            vec![
+                (AN_ID, Some(true)),
+                (AN_ID + 1, None),
+                (AN_ID_THAT_EXCEEDS_U64, Some(false))
+            ],
+            outcomes
+        );
+    }
+
+    #[test]
+    fn can_reserve_more_expressions() {
+        let mut results = EvaluationResult::new(SIZE_LESS_THAN_64);
+
+        results.reserve(SIZE);
+        results.set_result(AN_ID_THAT_EXCEEDS_U64, Some(true));
+
+        assert_eq!(Some(true), results.get_result(AN_ID_THAT_EXCEEDS_U64));
+    }
+
+    #[test]
+    fn only_claim_a_shared_result_the_first_time_it_is_set() {
+        let results = SharedEvaluationResult::new(SIZE);
+
+        assert!(!results.is_evaluated(AN_ID_THAT_EXCEEDS_U64));
+        assert!(results.set_result(AN_ID_THAT_EXCEEDS_U64, Some(true)));
+        assert!(!results.set_result(AN_ID_THAT_EXCEEDS_U64, Some(true)));
+        assert!(results.set_result(AN_ID, None));
+
+        assert!(results.is_evaluated(AN_ID_THAT_EXCEEDS_U64));
+        assert_eq!(Some(true), results.get_result(AN_ID_THAT_EXCEEDS_U64));
+        assert_eq!(None, results.get_result(AN_ID));
+    }
+
+    #[test]
+    fn can_record_the_results_over_a_batch_of_events() {
+        let events = 70;
+        let mut results = BatchEvaluationResult::new(SIZE, events);
+        let mut success = vec![0; BatchEvaluationResult::buckets_for(events)];
+        let mut evaluated = success.clone();
+        BatchEvaluationResult::fill(events, &mut evaluated);
+        BatchEvaluationResult::set_bit(&mut success, 3);
+        BatchEvaluationResult::set_bit(&mut success, AN_ID_THAT_EXCEEDS_U64);
+
+        results.set_results(AN_ID, &success, &evaluated);
+
+        assert!(results.contains(AN_ID));
+        assert!(!results.contains(AN_ID_THAT_EXCEEDS_U64));
+        assert_eq!(Some(&evaluated[..]), results.evaluated(AN_ID));
+        let events = BatchEvaluationResult::events(results.success(AN_ID).unwrap());
+        assert_eq!(vec![3, AN_ID_THAT_EXCEEDS_U64], events.collect::<Vec<_>>());
+    }
+
+    #[test]
+    fn do_not_reinsert_an_expression_that_is_already_present() {
+        let mut results = BatchEvaluationResult::new(SIZE, SIZE);
+
+        assert!(results.insert(AN_ID));
+        assert!(!results.insert(AN_ID));
+    }
+
+    #[test]
+    fn only_fill_the_events_part_of_the_batch() {
+        let mut entries = vec![0; BatchEvaluationResult::buckets_for(AN_ID_THAT_EXCEEDS_U64)];
+
+        BatchEvaluationResult::fill(AN_ID_THAT_EXCEEDS_U64, &mut entries);
+
+        assert_eq!(vec![u64::MAX, 0b111], entries);
+    }
+
     #[test]
     fn can_set_id_that_exceeds_u64() {
         let mut results = EvaluationResult::new(SIZE);
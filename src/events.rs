@@ -1,12 +1,14 @@
 use crate::{
+    encoding::{Decoder, Encoder},
+    error::SnapshotError,
     predicates::PredicateKind,
     strings::{StringId, StringTable},
 };
-use itertools::Itertools;
 use rust_decimal::Decimal;
 use std::{
     collections::HashMap,
     fmt::{Display, Formatter},
+    io::{self, Write},
     ops::Index,
 };
 use thiserror::Error;
@@ -25,6 +27,8 @@ pub enum EventError {
         expected: AttributeKind,
         actual: AttributeKind,
     },
+    #[error("{name:?}: invalid column => {reason}")]
+    InvalidColumn { name: String, reason: &'static str },
     #[error("{name:?}: mismatching types => expected: {expected:?}, found: {actual:?}")]
     MismatchingTypes {
         name: String,
@@ -37,11 +41,16 @@ pub enum EventError {
 ///
 /// During the builder creation, it will set all the attributes to `undefined`. If some attributes
 /// are not assigned, they will be left `undefined`.
+///
+/// The attributes can either be set by name or by [`AttributeHandle`]; the latter skips the
+/// lookup of the attribute's name. After a search, the builder can be [`EventBuilder::reset()`]
+/// to build another event while keeping its allocations.
 #[derive(Debug)]
 pub struct EventBuilder<'atree> {
-    by_ids: Vec<AttributeValue>,
+    event: Event,
     attributes: &'atree AttributeTable,
     strings: &'atree StringTable,
+    lists: ListPool,
 }
 
 impl<'atree> EventBuilder<'atree> {
@@ -49,7 +58,8 @@ impl<'atree> EventBuilder<'atree> {
         Self {
             attributes,
             strings,
-            by_ids: vec![AttributeValue::Undefined; attributes.len()],
+            event: Event::undefined(attributes.len()),
+            lists: ListPool::default(),
         }
     }
 
@@ -78,44 +88,75 @@ impl<'atree> EventBuilder<'atree> {
     /// let event = builder.build().unwrap();
     /// ```
     pub fn build(self) -> Result<Event, EventError> {
-        Ok(Event(self.by_ids))
+        Ok(self.event)
+    }
+
+    /// Get the [`Event`] that is being built without consuming the builder.
+    ///
+    /// # Examples
+    ///
+    /// ```rust
+    /// use a_tree::{ATree, AttributeDefinition};
+    ///
+    /// let definitions = [AttributeDefinition::integer("exchange_id")];
+    /// let mut atree = ATree::new(&definitions).unwrap();
+    /// atree.insert(&1u64, "exchange_id = 1").unwrap();
+    /// let exchange_id = atree.attribute("exchange_id").unwrap();
+    ///
+    /// let mut builder = atree.make_event();
+    /// for i in 0..3 {
+    ///     builder.reset();
+    ///     builder.set_integer(exchange_id, i).unwrap();
+    ///     let report = atree.search(builder.event()).unwrap();
+    ///     assert_eq!(i == 1, !report.matches().is_empty());
+    /// }
+    /// ```
+    #[inline]
+    pub fn event(&self) -> &Event {
+        &self.event
+    }
+
+    /// Set all the attributes back to `undefined` so that the builder can be reused for another
+    /// [`Event`].
+    ///
+    /// The buffers of the list attributes are kept to be reused by the next lists.
+    pub fn reset(&mut self) {
+        for value in &mut self.event.values {
+            self.lists.recycle(value);
+        }
+        self.event.defined.fill(0);
     }
 
     /// Set the specified boolean attribute.
     ///
     /// The specified attribute must exist within the [`crate::ATree`] and its type must be boolean.
     pub fn with_boolean(&mut self, name: &str, value: bool) -> Result<(), EventError> {
-        self.add_value(name, AttributeKind::Boolean, || {
-            AttributeValue::Boolean(value)
-        })
+        let handle = self.resolve(name)?;
+        self.set_boolean(handle, value)
     }
 
     /// Set the specified integer attribute.
     ///
     /// The specified attribute must exist within the [`crate::ATree`] and its type must be integer.
     pub fn with_integer(&mut self, name: &str, value: i64) -> Result<(), EventError> {
-        self.add_value(name, AttributeKind::Integer, || {
-            AttributeValue::Integer(value)
-        })
+        let handle = self.resolve(name)?;
+        self.set_integer(handle, value)
     }
 
     /// Set the specified float attribute.
     ///
     /// The specified attribute must exist within the [`crate::ATree`] and its type must be float.
     pub fn with_float(&mut self, name: &str, number: i64, scale: u32) -> Result<(), EventError> {
-        self.add_value(name, AttributeKind::Float, || {
-            AttributeValue::Float(Decimal::new(number, scale))
-        })
+        let handle = self.resolve(name)?;
+        self.set_float(handle, number, scale)
     }
 
     /// Set the specified string attribute.
     ///
     /// The specified attribute must exist within the [`crate::ATree`] and its type must be string.
     pub fn with_string(&mut self, name: &str, value: &str) -> Result<(), EventError> {
-        self.add_value(name, AttributeKind::String, || {
-            let string_index = self.strings.get(value);
-            AttributeValue::String(string_index)
-        })
+        let handle = self.resolve(name)?;
+        self.set_string(handle, value)
     }
 
     /// Set the specified list of integers attribute.
@@ -123,22 +164,16 @@ impl<'atree> EventBuilder<'atree> {
     /// The specified attribute must exist within the [`crate::ATree`] and its type must be a list
     /// of integers.
     pub fn with_integer_list(&mut self, name: &str, value: &[i64]) -> Result<(), EventError> {
-        self.add_value(name, AttributeKind::IntegerList, || {
-            let values = value.iter().sorted().unique().cloned().collect_vec();
-            AttributeValue::IntegerList(values)
-        })
+        let handle = self.resolve(name)?;
+        self.set_integer_list(handle, value)
     }
 
     /// Set the specified attribute to `undefined`.
     ///
     /// The specified attribute must exist within the [`crate::ATree`].
     pub fn with_undefined(&mut self, name: &str) -> Result<(), EventError> {
-        let index = self
-            .attributes
-            .by_name(name)
-            .ok_or_else(|| EventError::NonExistingAttribute(name.to_string()))?;
-        self.by_ids[index.0] = AttributeValue::Undefined;
-        Ok(())
+        let handle = self.resolve(name)?;
+        self.set_undefined(handle)
     }
 
     /// Set the specified string list attribute.
@@ -146,50 +181,339 @@ impl<'atree> EventBuilder<'atree> {
     /// The specified attribute must exist within the [`crate::ATree`] and its type must be a list
     /// of strings.
     pub fn with_string_list(&mut self, name: &str, values: &[&str]) -> Result<(), EventError> {
-        self.add_value(name, AttributeKind::StringList, || {
-            let values: Vec<_> = values
-                .iter()
-                .map(|v| self.strings.get(v))
-                .sorted()
-                .unique()
-                .collect();
-            AttributeValue::StringList(values)
-        })
+        let handle = self.resolve(name)?;
+        self.set_string_list(handle, values)
+    }
+
+    /// Set the boolean attribute referred by the [`AttributeHandle`].
+    ///
+    /// The handle must come from the same [`crate::ATree`] and the attribute's type must be
+    /// boolean.
+    #[inline]
+    pub fn set_boolean(&mut self, handle: AttributeHandle, value: bool) -> Result<(), EventError> {
+        let slot = self.slot(handle, AttributeKind::Boolean)?;
+        *slot = AttributeValue::Boolean(value);
+        Ok(())
+    }
+
+    /// Set the integer attribute referred by the [`AttributeHandle`].
+    ///
+    /// The handle must come from the same [`crate::ATree`] and the attribute's type must be
+    /// integer.
+    #[inline]
+    pub fn set_integer(&mut self, handle: AttributeHandle, value: i64) -> Result<(), EventError> {
+        let slot = self.slot(handle, AttributeKind::Integer)?;
+        *slot = AttributeValue::Integer(value);
+        Ok(())
+    }
+
+    /// Set the float attribute referred by the [`AttributeHandle`].
+    ///
+    /// The handle must come from the same [`crate::ATree`] and the attribute's type must be float.
+    #[inline]
+    pub fn set_float(
+        &mut self,
+        handle: AttributeHandle,
+        number: i64,
+        scale: u32,
+    ) -> Result<(), EventError> {
+        let slot = self.slot(handle, AttributeKind::Float)?;
+        *slot = AttributeValue::Float(Decimal::new(number, scale));
+        Ok(())
+    }
+
+    /// Set the string attribute referred by the [`AttributeHandle`].
+    ///
+    /// The handle must come from the same [`crate::ATree`] and the attribute's type must be
+    /// string.
+    #[inline]
+    pub fn set_string(&mut self, handle: AttributeHandle, value: &str) -> Result<(), EventError> {
+        let string_index = self.strings.get(value);
+        let slot = self.slot(handle, AttributeKind::String)?;
+        *slot = AttributeValue::String(string_index);
+        Ok(())
+    }
+
+    /// Set the list of integers attribute referred by the [`AttributeHandle`].
+    ///
+    /// The handle must come from the same [`crate::ATree`] and the attribute's type must be a list
+    /// of integers.
+    pub fn set_integer_list(
+        &mut self,
+        handle: AttributeHandle,
+        values: &[i64],
+    ) -> Result<(), EventError> {
+        self.check(handle, AttributeKind::IntegerList)?;
+        let slot = self.event.define(handle.0);
+        let mut list = self.lists.integer_list(slot);
+        list.extend_from_slice(values);
+        list.sort_unstable();
+        list.dedup();
+        *slot = AttributeValue::IntegerList(list);
+        Ok(())
+    }
+
+    /// Set the list of strings attribute referred by the [`AttributeHandle`].
+    ///
+    /// The handle must come from the same [`crate::ATree`] and the attribute's type must be a list
+    /// of strings.
+    pub fn set_string_list(
+        &mut self,
+        handle: AttributeHandle,
+        values: &[&str],
+    ) -> Result<(), EventError> {
+        self.check(handle, AttributeKind::StringList)?;
+        let slot = self.event.define(handle.0);
+        let mut list = self.lists.string_list(slot);
+        list.extend(values.iter().map(|value| self.strings.get(value)));
+        list.sort_unstable();
+        list.dedup();
+        *slot = AttributeValue::StringList(list);
+        Ok(())
+    }
+
+    /// Set the string attribute referred by the [`AttributeHandle`] to an interned string.
+    ///
+    /// The ID must come from [`crate::ATree::intern`] on the same [`crate::ATree`]; the string is
+    /// not hashed again.
+    #[inline]
+    pub fn set_string_id(
+        &mut self,
+        handle: AttributeHandle,
+        id: StringId,
+    ) -> Result<(), EventError> {
+        let slot = self.slot(handle, AttributeKind::String)?;
+        *slot = AttributeValue::String(id);
+        Ok(())
+    }
+
+    /// Set the list of strings attribute referred by the [`AttributeHandle`] to interned strings.
+    ///
+    /// The IDs must come from [`crate::ATree::intern`] on the same [`crate::ATree`]; the strings
+    /// are not hashed again.
+    pub fn set_string_id_list(
+        &mut self,
+        handle: AttributeHandle,
+        ids: &[StringId],
+    ) -> Result<(), EventError> {
+        self.check(handle, AttributeKind::StringList)?;
+        let slot = self.event.define(handle.0);
+        let mut list = self.lists.string_list(slot);
+        list.extend_from_slice(ids);
+        list.sort_unstable();
+        list.dedup();
+        *slot = AttributeValue::StringList(list);
+        Ok(())
+    }
+
+    /// Set the attribute referred by the [`AttributeHandle`] to `undefined`.
+    ///
+    /// The handle must come from the same [`crate::ATree`].
+    #[inline]
+    pub fn set_undefined(&mut self, handle: AttributeHandle) -> Result<(), EventError> {
+        if handle.0.index() >= self.event.len() {
+            return Err(EventError::NonExistingAttribute(handle.0.to_string()));
+        }
+        self.event.undefine(handle.0);
+        Ok(())
+    }
+
+    #[inline]
+    fn resolve(&self, name: &str) -> Result<AttributeHandle, EventError> {
+        self.attributes.handle(name)
     }
 
     #[inline]
-    fn add_value<F>(&mut self, name: &str, actual: AttributeKind, f: F) -> Result<(), EventError>
-    where
-        F: FnOnce() -> AttributeValue,
-    {
-        let index = self
-            .attributes
-            .by_name(name)
-            .ok_or_else(|| EventError::NonExistingAttribute(name.to_string()))?;
-        let expected = self.attributes.by_id(index);
+    fn slot(
+        &mut self,
+        handle: AttributeHandle,
+        actual: AttributeKind,
+    ) -> Result<&mut AttributeValue, EventError> {
+        self.check(handle, actual)?;
+        Ok(self.event.define(handle.0))
+    }
+
+    #[inline]
+    fn check(&self, handle: AttributeHandle, actual: AttributeKind) -> Result<(), EventError> {
+        let id = handle.0;
+        if id.index() >= self.attributes.len() {
+            return Err(EventError::NonExistingAttribute(id.to_string()));
+        }
+        let expected = self.attributes.by_id(id);
         if expected != actual {
             return Err(EventError::WrongType {
-                name: name.to_owned(),
+                name: self.attributes.name(id).to_owned(),
                 expected,
                 actual,
             });
         }
-        self.by_ids[index.0] = f();
         Ok(())
     }
 }
 
+/// The buffers of the list attributes that are kept to be reused by the next events.
+#[derive(Default, Debug)]
+pub(crate) struct ListPool {
+    integers: Vec<Vec<i64>>,
+    strings: Vec<Vec<StringId>>,
+}
+
+impl ListPool {
+    /// Set the value to `undefined` and keep its list buffer if it has one.
+    #[inline]
+    pub(crate) fn recycle(&mut self, value: &mut AttributeValue) {
+        match std::mem::replace(value, AttributeValue::Undefined) {
+            AttributeValue::IntegerList(mut values) => {
+                values.clear();
+                self.integers.push(values);
+            }
+            AttributeValue::StringList(mut values) => {
+                values.clear();
+                self.strings.push(values);
+            }
+            _ => {}
+        }
+    }
+
+    /// Take an empty buffer for a list of integers, preferably the one already in the value.
+    #[inline]
+    pub(crate) fn integer_list(&mut self, value: &mut AttributeValue) -> Vec<i64> {
+        match std::mem::replace(value, AttributeValue::Undefined) {
+            AttributeValue::IntegerList(mut values) => {
+                values.clear();
+                values
+            }
+            other => {
+                *value = other;
+                self.recycle(value);
+                self.integers.pop().unwrap_or_default()
+            }
+        }
+    }
+
+    /// Take an empty buffer for a list of strings, preferably the one already in the value.
+    #[inline]
+    pub(crate) fn string_list(&mut self, value: &mut AttributeValue) -> Vec<StringId> {
+        match std::mem::replace(value, AttributeValue::Undefined) {
+            AttributeValue::StringList(mut values) => {
+                values.clear();
+                values
+            }
+            other => {
+                *value = other;
+                self.recycle(value);
+                self.strings.pop().unwrap_or_default()
+            }
+        }
+    }
+}
+
+/// A pre-resolved reference to an attribute of an [`crate::ATree`].
+///
+/// Setting an attribute of an [`EventBuilder`] through its handle avoids looking up its name for
+/// each [`Event`]. The handle is only valid for the [`crate::ATree`] that returned it (or its
+/// frozen/loaded copies that share the same attribute definitions).
+#[derive(Clone, Copy, Eq, PartialEq, Debug, Hash)]
+pub struct AttributeHandle(AttributeId);
+
+impl AttributeHandle {
+    #[inline]
+    pub(crate) fn id(&self) -> AttributeId {
+        self.0
+    }
+
+    /// Get the position of the attribute in the definitions of the [`crate::ATree`].
+    #[inline]
+    pub fn index(&self) -> usize {
+        self.0.index()
+    }
+
+    /// Create a handle from the position of the attribute in the definitions of the
+    /// [`crate::ATree`].
+    ///
+    /// The validity of the handle is checked when setting the attribute.
+    #[inline]
+    pub fn from_index(index: usize) -> Self {
+        Self(AttributeId::new(index))
+    }
+}
+
 /// An event that can be used by the [`crate::atree::ATree`] structure to match arbitrary boolean
 /// expressions
 #[derive(Clone, Debug)]
-pub struct Event(Vec<AttributeValue>);
+pub struct Event {
+    values: Vec<AttributeValue>,
+    /// A bit per attribute that is set when the attribute is not `undefined`.
+    defined: Vec<u64>,
+}
+
+impl Event {
+    #[inline]
+    pub(crate) fn undefined(attributes: usize) -> Self {
+        Self {
+            values: vec![AttributeValue::Undefined; attributes],
+            defined: vec![0; attributes.div_ceil(u64::BITS as usize)],
+        }
+    }
+
+    #[inline]
+    pub(crate) fn len(&self) -> usize {
+        self.values.len()
+    }
+
+    /// The attributes that have a value in the event, in the order of their IDs.
+    #[inline]
+    pub(crate) fn defined(&self) -> impl Iterator<Item = AttributeId> + '_ {
+        self.defined.iter().enumerate().flat_map(|(word_id, word)| {
+            let mut word = *word;
+            std::iter::from_fn(move || {
+                if word == 0 {
+                    return None;
+                }
+                let bit = word.trailing_zeros() as usize;
+                word &= word - 1;
+                Some(AttributeId(word_id * u64::BITS as usize + bit))
+            })
+        })
+    }
+
+    /// Get the value of the attribute to set it; the attribute is marked as defined.
+    #[inline]
+    pub(crate) fn define(&mut self, id: AttributeId) -> &mut AttributeValue {
+        let bits = u64::BITS as usize;
+        self.defined[id.0 / bits] |= 1 << (id.0 % bits);
+        &mut self.values[id.0]
+    }
+
+    #[inline]
+    pub(crate) fn undefine(&mut self, id: AttributeId) {
+        let bits = u64::BITS as usize;
+        self.defined[id.0 / bits] &= !(1 << (id.0 % bits));
+        self.values[id.0] = AttributeValue::Undefined;
+    }
+
+    /// Give a mutable access to all the values; the defined attributes are recomputed from the
+    /// values afterwards.
+    #[inline]
+    pub(crate) fn update<R>(&mut self, update: impl FnOnce(&mut [AttributeValue]) -> R) -> R {
+        let result = update(&mut self.values);
+        self.defined.fill(0);
+        let bits = u64::BITS as usize;
+        for (id, value) in self.values.iter().enumerate() {
+            if !matches!(value, AttributeValue::Undefined) {
+                self.defined[id / bits] |= 1 << (id % bits);
+            }
+        }
+        result
+    }
+}
 
 impl Index<AttributeId> for Event {
     type Output = AttributeValue;
 
     #[inline]
     fn index(&self, index: AttributeId) -> &Self::Output {
-        &self.0[index.0]
+        &self.values[index.0]
     }
 }
 
@@ -213,6 +537,18 @@ pub struct AttributeTable {
 #[derive(Clone, Copy, Eq, Ord, PartialEq, PartialOrd, Debug, Hash)]
 pub struct AttributeId(usize);
 
+impl AttributeId {
+    #[inline]
+    pub(crate) fn new(index: usize) -> Self {
+        Self(index)
+    }
+
+    #[inline]
+    pub(crate) fn index(&self) -> usize {
+        self.0
+    }
+}
+
 impl Display for AttributeId {
     fn fmt(&self, formatter: &mut Formatter<'_>) -> std::fmt::Result {
         write!(formatter, "attribute({})", self.0)
@@ -247,10 +583,52 @@ impl AttributeTable {
         self.by_ids[id.0].clone()
     }
 
+    /// Resolve the [`AttributeHandle`] of the specified attribute.
+    #[inline]
+    pub fn handle(&self, name: &str) -> Result<AttributeHandle, EventError> {
+        self.by_name(name)
+            .map(AttributeHandle)
+            .ok_or_else(|| EventError::NonExistingAttribute(name.to_string()))
+    }
+
+    /// Get the name of the specified attribute.
+    ///
+    /// This does a linear scan so it should be kept out of the hot paths (e.g. for error
+    /// reporting).
+    pub fn name(&self, id: AttributeId) -> &str {
+        self.by_names
+            .iter()
+            .find_map(|(name, other)| (*other == id).then_some(name.as_str()))
+            .unwrap_or_default()
+    }
+
     #[inline]
     pub fn len(&self) -> usize {
         self.by_ids.len()
     }
+
+    pub(crate) fn encode<W: Write>(&self, encoder: &mut Encoder<W>) -> io::Result<()> {
+        let mut names = vec![""; self.by_ids.len()];
+        for (name, id) in &self.by_names {
+            names[id.0] = name;
+        }
+        encoder.value(&names.len())?;
+        for (name, kind) in names.iter().zip(&self.by_ids) {
+            encoder.value(&name.len())?;
+            encoder.bytes(name.as_bytes())?;
+            encoder.value(&kind.tag())?;
+        }
+        Ok(())
+    }
+
+    pub(crate) fn decode(decoder: &mut Decoder<'_>) -> Result<Self, SnapshotError> {
+        let definitions = decoder.list(|decoder| {
+            let name = decoder.value::<String>()?;
+            let kind = AttributeKind::from_tag(decoder.value()?)?;
+            Ok(AttributeDefinition { name, kind })
+        })?;
+        Self::new(&definitions).map_err(|_| SnapshotError::Corrupted)
+    }
 }
 
 /// The definition of an attribute that is usable by the [`crate::atree::ATree`]
@@ -270,6 +648,33 @@ pub enum AttributeKind {
     StringList,
 }
 
+impl AttributeKind {
+    #[inline]
+    const fn tag(&self) -> u8 {
+        match self {
+            Self::Boolean => 0,
+            Self::Integer => 1,
+            Self::Float => 2,
+            Self::String => 3,
+            Self::IntegerList => 4,
+            Self::StringList => 5,
+        }
+    }
+
+    #[inline]
+    fn from_tag(tag: u8) -> Result<Self, SnapshotError> {
+        match tag {
+            0 => Ok(Self::Boolean),
+            1 => Ok(Self::Integer),
+            2 => Ok(Self::Float),
+            3 => Ok(Self::String),
+            4 => Ok(Self::IntegerList),
+            5 => Ok(Self::StringList),
+            _ => Err(SnapshotError::Corrupted),
+        }
+    }
+}
+
 impl AttributeDefinition {
     /// Create a boolean attribute definition.
     pub fn boolean(name: &str) -> Self {
@@ -499,4 +904,156 @@ mod tests {
 
         assert!(result.is_err());
     }
+
+    #[test]
+    fn can_set_the_attributes_through_their_handles() {
+        let attributes = AttributeTable::new(&[
+            AttributeDefinition::boolean("private"),
+            AttributeDefinition::integer_list("segment_ids"),
+        ])
+        .unwrap();
+        let strings = StringTable::new();
+        let private = attributes.handle("private").unwrap();
+        let segment_ids = attributes.handle("segment_ids").unwrap();
+        let mut builder = EventBuilder::new(&attributes, &strings);
+
+        builder.set_boolean(private, true).unwrap();
+        builder
+            .set_integer_list(segment_ids, &[3, 1, 3, 2])
+            .unwrap();
+
+        let event = builder.build().unwrap();
+        assert!(matches!(event[private.0], AttributeValue::Boolean(true)));
+        assert!(matches!(
+            &event[segment_ids.0],
+            AttributeValue::IntegerList(values) if values == &[1, 2, 3]
+        ));
+    }
+
+    #[test]
+    fn set_the_same_strings_by_their_interned_ids_as_by_their_values() {
+        let attributes = AttributeTable::new(&[
+            AttributeDefinition::string("country"),
+            AttributeDefinition::string_list("deals"),
+        ])
+        .unwrap();
+        let mut strings = StringTable::new();
+        let deal = strings.get_or_update("deal-1");
+        let another_deal = strings.get_or_update("deal-2");
+        let country = attributes.handle("country").unwrap();
+        let deals = attributes.handle("deals").unwrap();
+        let mut builder = EventBuilder::new(&attributes, &strings);
+
+        builder.set_string_id(country, deal).unwrap();
+        builder
+            .set_string_id_list(deals, &[another_deal, deal, another_deal])
+            .unwrap();
+
+        assert!(builder.set_string_id(deals, deal).is_err());
+        let event = builder.build().unwrap();
+        assert!(matches!(event[country.0], AttributeValue::String(id) if id == deal));
+        assert!(matches!(
+            &event[deals.0],
+            AttributeValue::StringList(ids) if ids == &[deal, another_deal]
+        ));
+        assert_eq!(strings.get("deal-2"), another_deal);
+    }
+
+    #[test]
+    fn return_an_error_when_setting_an_attribute_with_a_handle_of_the_wrong_type() {
+        let attributes = AttributeTable::new(&[
+            AttributeDefinition::boolean("private"),
+            AttributeDefinition::integer("exchange_id"),
+        ])
+        .unwrap();
+        let strings = StringTable::new();
+        let exchange_id = attributes.handle("exchange_id").unwrap();
+        let mut builder = EventBuilder::new(&attributes, &strings);
+
+        let result = builder.set_boolean(exchange_id, true);
+
+        assert_eq!(
+            Err(EventError::WrongType {
+                name: "exchange_id".to_string(),
+                expected: AttributeKind::Integer,
+                actual: AttributeKind::Boolean
+            }),
+            result
+        );
+    }
+
+    #[test]
+    fn return_an_error_when_setting_an_attribute_with_an_out_of_bounds_handle() {
+        let attributes = AttributeTable::new(&[AttributeDefinition::boolean("private")]).unwrap();
+        let strings = StringTable::new();
+        let mut builder = EventBuilder::new(&attributes, &strings);
+
+        let handle = AttributeHandle::from_index(1);
+
+        assert!(matches!(
+            builder.set_boolean(handle, true),
+            Err(EventError::NonExistingAttribute(_))
+        ));
+        assert!(matches!(
+            builder.set_undefined(handle),
+            Err(EventError::NonExistingAttribute(_))
+        ));
+    }
+
+    #[test]
+    fn reset_all_the_attributes_to_undefined_and_reuse_the_list_buffers() {
+        let attributes = AttributeTable::new(&[
+            AttributeDefinition::integer("exchange_id"),
+            AttributeDefinition::integer_list("segment_ids"),
+        ])
+        .unwrap();
+        let strings = StringTable::new();
+        let exchange_id = attributes.handle("exchange_id").unwrap();
+        let segment_ids = attributes.handle("segment_ids").unwrap();
+        let mut builder = EventBuilder::new(&attributes, &strings);
+        builder.set_integer(exchange_id, 1).unwrap();
+        builder
+            .set_integer_list(segment_ids, &[1, 2, 3, 4])
+            .unwrap();
+        let buffer = match &builder.event()[segment_ids.0] {
+            AttributeValue::IntegerList(values) => values.as_ptr(),
+            _ => unreachable!(),
+        };
+
+        builder.reset();
+
+        assert!(builder
+            .event()
+            .values
+            .iter()
+            .all(|value| matches!(value, AttributeValue::Undefined)));
+        assert_eq!(0, builder.event().defined().count());
+        builder.set_integer_list(segment_ids, &[5, 6]).unwrap();
+        assert!(matches!(
+            &builder.event()[segment_ids.0],
+            AttributeValue::IntegerList(values) if values == &[5, 6] && values.as_ptr() == buffer
+        ));
+    }
+
+    #[test]
+    fn track_the_attributes_that_are_defined() {
+        let definitions = (0..70)
+            .map(|i| AttributeDefinition::integer(&format!("attribute_{i}")))
+            .collect::<Vec<_>>();
+        let attributes = AttributeTable::new(&definitions).unwrap();
+        let strings = StringTable::new();
+        let mut builder = EventBuilder::new(&attributes, &strings);
+        for i in [1, 3, 64, 69] {
+            builder
+                .set_integer(AttributeHandle::from_index(i), 1)
+                .unwrap();
+        }
+        builder
+            .set_undefined(AttributeHandle::from_index(3))
+            .unwrap();
+
+        let defined = builder.event().defined().map(|id| id.0).collect::<Vec<_>>();
+
+        assert_eq!(vec![1, 64, 69], defined);
+    }
 }
@@ -0,0 +1,441 @@
+use crate::{
+    events::{AttributeId, AttributeValue, Event},
+    predicates::{
+        ComparisonOperator, ComparisonValue, EqualityOperator, ListLiteral, ListOperator,
+        Predicate, PredicateKind, PrimitiveLiteral, SetOperator,
+    },
+    strings::StringId,
+};
+use rust_decimal::Decimal;
+use std::{collections::HashMap, mem::size_of};
+
+type NodeId = usize;
+
+/// Inverted index over the predicates that are evaluated eagerly during a search.
+///
+/// The predicates are grouped by attribute. For each attribute, the predicates that can only be
+/// true for a specific value (i.e. `=`, `in`, `one of` and the boolean variables) are put in hash
+/// buckets keyed by that value and the comparisons are kept sorted by their threshold. Every other
+/// predicate (i.e. the negations and the null checks) is kept in a residual list that is always
+/// returned.
+///
+/// The index returns a superset of the predicates that can be true for an [`Event`]. This is
+/// enough for the search since the result of a node can only be true if at least one of its
+/// predicates is true.
+#[derive(Clone, Debug)]
+pub struct PredicateIndex {
+    by_attributes: Vec<AttributeIndex>,
+}
+
+impl PredicateIndex {
+    pub fn new(attributes: usize) -> Self {
+        Self {
+            by_attributes: vec![AttributeIndex::default(); attributes],
+        }
+    }
+
+    pub fn insert(&mut self, node_id: NodeId, predicate: &Predicate) {
+        let index = &mut self.by_attributes[predicate.attribute().index()];
+        match predicate.kind() {
+            PredicateKind::Variable => index.booleans[1].push(node_id),
+            PredicateKind::NegatedVariable => index.booleans[0].push(node_id),
+            PredicateKind::Equality(EqualityOperator::Equal, value) => {
+                index.insert_value(IndexKey::from(value), node_id);
+            }
+            PredicateKind::Set(SetOperator::In, values)
+            | PredicateKind::List(ListOperator::OneOf, values) => {
+                for key in keys(values) {
+                    index.insert_value(key, node_id);
+                }
+            }
+            PredicateKind::Comparison(operator, ComparisonValue::Integer(value)) => {
+                index.integers.insert(operator, *value, node_id);
+            }
+            PredicateKind::Comparison(operator, ComparisonValue::Float(value)) => {
+                index.floats.insert(operator, *value, node_id);
+            }
+            _ => index.residuals.push(node_id),
+        }
+    }
+
+    pub fn remove(&mut self, node_id: NodeId, predicate: &Predicate) {
+        let index = &mut self.by_attributes[predicate.attribute().index()];
+        match predicate.kind() {
+            PredicateKind::Variable => remove_node(&mut index.booleans[1], node_id),
+            PredicateKind::NegatedVariable => remove_node(&mut index.booleans[0], node_id),
+            PredicateKind::Equality(EqualityOperator::Equal, value) => {
+                index.remove_value(&IndexKey::from(value), node_id);
+            }
+            PredicateKind::Set(SetOperator::In, values)
+            | PredicateKind::List(ListOperator::OneOf, values) => {
+                for key in keys(values) {
+                    index.remove_value(&key, node_id);
+                }
+            }
+            PredicateKind::Comparison(operator, ComparisonValue::Integer(value)) => {
+                index.integers.remove(operator, value, node_id);
+            }
+            PredicateKind::Comparison(operator, ComparisonValue::Float(value)) => {
+                index.floats.remove(operator, value, node_id);
+            }
+            _ => remove_node(&mut index.residuals, node_id),
+        }
+    }
+
+    /// The memory used by the index, in bytes.
+    pub fn memory_usage(&self) -> usize {
+        let nodes = |nodes: &Vec<NodeId>| nodes.capacity() * size_of::<NodeId>();
+        self.by_attributes
+            .iter()
+            .map(|index| {
+                let buckets = index.by_values.capacity()
+                    * (size_of::<(IndexKey, Vec<NodeId>)>() + 1)
+                    + index.by_values.values().map(nodes).sum::<usize>();
+                buckets
+                    + index.integers.memory_usage()
+                    + index.floats.memory_usage()
+                    + index.booleans.iter().map(nodes).sum::<usize>()
+                    + nodes(&index.residuals)
+            })
+            .sum::<usize>()
+            + self.by_attributes.capacity() * size_of::<AttributeIndex>()
+    }
+
+    /// Collect the predicates that might be true for the [`Event`].
+    ///
+    /// The same predicate can be returned multiple times (e.g. a `one of` predicate that shares
+    /// many values with the event).
+    pub fn candidates(&self, event: &Event, candidates: &mut Vec<NodeId>) {
+        for (id, index) in self.by_attributes.iter().enumerate() {
+            candidates.extend_from_slice(&index.residuals);
+            match &event[AttributeId::new(id)] {
+                AttributeValue::Boolean(value) => {
+                    candidates.extend_from_slice(&index.booleans[usize::from(*value)]);
+                }
+                AttributeValue::Integer(value) => {
+                    index.extend_value(&IndexKey::Integer(*value), candidates);
+                    index.integers.candidates(value, candidates);
+                }
+                AttributeValue::Float(value) => {
+                    index.extend_value(&IndexKey::Float(*value), candidates);
+                    index.floats.candidates(value, candidates);
+                }
+                AttributeValue::String(value) => {
+                    index.extend_value(&IndexKey::String(*value), candidates);
+                }
+                AttributeValue::IntegerList(values) => {
+                    for value in values {
+                        index.extend_value(&IndexKey::Integer(*value), candidates);
+                    }
+                }
+                AttributeValue::StringList(values) => {
+                    for value in values {
+                        index.extend_value(&IndexKey::String(*value), candidates);
+                    }
+                }
+                AttributeValue::Undefined => {}
+            }
+        }
+    }
+}
+
+#[derive(Clone, Debug, Default)]
+struct AttributeIndex {
+    by_values: HashMap<IndexKey, Vec<NodeId>>,
+    integers: Thresholds<i64>,
+    floats: Thresholds<Decimal>,
+    booleans: [Vec<NodeId>; 2],
+    residuals: Vec<NodeId>,
+}
+
+impl AttributeIndex {
+    #[inline]
+    fn insert_value(&mut self, key: IndexKey, node_id: NodeId) {
+        self.by_values.entry(key).or_default().push(node_id);
+    }
+
+    #[inline]
+    fn remove_value(&mut self, key: &IndexKey, node_id: NodeId) {
+        if let Some(nodes) = self.by_values.get_mut(key) {
+            remove_node(nodes, node_id);
+            if nodes.is_empty() {
+                self.by_values.remove(key);
+            }
+        }
+    }
+
+    #[inline]
+    fn extend_value(&self, key: &IndexKey, candidates: &mut Vec<NodeId>) {
+        if let Some(nodes) = self.by_values.get(key) {
+            candidates.extend_from_slice(nodes);
+        }
+    }
+}
+
+#[derive(Eq, PartialEq, Hash, Clone, Debug)]
+enum IndexKey {
+    Integer(i64),
+    Float(Decimal),
+    String(StringId),
+}
+
+impl From<&PrimitiveLiteral> for IndexKey {
+    fn from(value: &PrimitiveLiteral) -> Self {
+        match value {
+            PrimitiveLiteral::Integer(value) => Self::Integer(*value),
+            PrimitiveLiteral::Float(value) => Self::Float(*value),
+            PrimitiveLiteral::String(value) => Self::String(*value),
+        }
+    }
+}
+
+fn keys(values: &ListLiteral) -> Vec<IndexKey> {
+    match values {
+        ListLiteral::IntegerList(values) => values.iter().map(IndexKey::Integer).collect(),
+        ListLiteral::StringList(values) => values.iter().copied().map(IndexKey::String).collect(),
+    }
+}
+
+/// The comparisons of an attribute sorted by their threshold so that the ones that are true for a
+/// value are always a contiguous range.
+#[derive(Clone, Debug)]
+struct Thresholds<V> {
+    less_than: Vec<(V, NodeId)>,
+    less_than_equal: Vec<(V, NodeId)>,
+    greater_than: Vec<(V, NodeId)>,
+    greater_than_equal: Vec<(V, NodeId)>,
+}
+
+impl<V> Default for Thresholds<V> {
+    fn default() -> Self {
+        Self {
+            less_than: vec![],
+            less_than_equal: vec![],
+            greater_than: vec![],
+            greater_than_equal: vec![],
+        }
+    }
+}
+
+impl<V: Ord + Copy> Thresholds<V> {
+    fn insert(&mut self, operator: &ComparisonOperator, threshold: V, node_id: NodeId) {
+        let entries = self.entries_mut(operator);
+        let position = entries.partition_point(|(value, _)| *value <= threshold);
+        entries.insert(position, (threshold, node_id));
+    }
+
+    fn remove(&mut self, operator: &ComparisonOperator, threshold: &V, node_id: NodeId) {
+        let entries = self.entries_mut(operator);
+        let start = entries.partition_point(|(value, _)| value < threshold);
+        if let Some(offset) = entries[start..]
+            .iter()
+            .take_while(|(value, _)| value == threshold)
+            .position(|(_, id)| *id == node_id)
+        {
+            entries.remove(start + offset);
+        }
+    }
+
+    fn candidates(&self, value: &V, candidates: &mut Vec<NodeId>) {
+        // `value < threshold`
+        let start = self.less_than.partition_point(|(t, _)| t <= value);
+        candidates.extend(self.less_than[start..].iter().map(|(_, id)| *id));
+        // `value <= threshold`
+        let start = self.less_than_equal.partition_point(|(t, _)| t < value);
+        candidates.extend(self.less_than_equal[start..].iter().map(|(_, id)| *id));
+        // `value > threshold`
+        let end = self.greater_than.partition_point(|(t, _)| t < value);
+        candidates.extend(self.greater_than[..end].iter().map(|(_, id)| *id));
+        // `value >= threshold`
+        let end = self.greater_than_equal.partition_point(|(t, _)| t <= value);
+        candidates.extend(self.greater_than_equal[..end].iter().map(|(_, id)| *id));
+    }
+
+    fn memory_usage(&self) -> usize {
+        [
+            &self.less_than,
+            &self.less_than_equal,
+            &self.greater_than,
+            &self.greater_than_equal,
+        ]
+        .iter()
+        .map(|entries| entries.capacity() * size_of::<(V, NodeId)>())
+        .sum()
+    }
+
+    #[inline]
+    fn entries_mut(&mut self, operator: &ComparisonOperator) -> &mut Vec<(V, NodeId)> {
+        match operator {
+            ComparisonOperator::LessThan => &mut self.less_than,
+            ComparisonOperator::LessThanEqual => &mut self.less_than_equal,
+            ComparisonOperator::GreaterThan => &mut self.greater_than,
+            ComparisonOperator::GreaterThanEqual => &mut self.greater_than_equal,
+        }
+    }
+}
+
+#[inline]
+fn remove_node(nodes: &mut Vec<NodeId>, node_id: NodeId) {
+    if let Some(position) = nodes.iter().position(|id| *id == node_id) {
+        nodes.swap_remove(position);
+    }
+}
+
+#[cfg(test)]
+mod tests {
+    use super::*;
+    use crate::{
+        events::{AttributeDefinition, AttributeTable, EventBuilder},
+        predicates::NullOperator,
+        strings::StringTable,
+        test_utils::predicates::{
+            comparison_integer, equal, greater_than, greater_than_equal, integer_list, is_null,
+            less_than, less_than_equal, negated_variable, not_equal, one_of, predicate,
+            primitive_integer, primitive_string, set_in, string_list, variable,
+        },
+    };
+
+    #[test]
+    fn return_the_equality_predicates_that_match_the_value() {
+        let attributes = define_attributes();
+        let mut strings = StringTable::new();
+        let ca = strings.get_or_update("CA");
+        let us = strings.get_or_update("US");
+        let mut index = PredicateIndex::new(attributes.len());
+        index.insert(0, &equal!(&attributes, "country", primitive_string!(ca)));
+        index.insert(1, &equal!(&attributes, "country", primitive_string!(us)));
+        index.insert(
+            2,
+            &equal!(&attributes, "exchange_id", primitive_integer!(1)),
+        );
+        let mut builder = EventBuilder::new(&attributes, &strings);
+        builder.with_string("country", "CA").unwrap();
+        builder.with_integer("exchange_id", 1).unwrap();
+        let event = builder.build().unwrap();
+
+        assert_eq!(vec![0, 2], sorted_candidates(&index, &event));
+    }
+
+    #[test]
+    fn return_the_set_and_list_predicates_that_contain_one_of_the_values() {
+        let attributes = define_attributes();
+        let mut strings = StringTable::new();
+        let deal_1 = strings.get_or_update("deal-1");
+        let deal_2 = strings.get_or_update("deal-2");
+        let mut index = PredicateIndex::new(attributes.len());
+        index.insert(
+            0,
+            &set_in!(&attributes, "exchange_id", integer_list!(vec![1, 2, 3])),
+        );
+        index.insert(
+            1,
+            &set_in!(&attributes, "exchange_id", integer_list!(vec![4, 5])),
+        );
+        index.insert(
+            2,
+            &one_of!(&attributes, "deals", string_list!(vec![deal_1, deal_2])),
+        );
+        index.insert(
+            3,
+            &one_of!(&attributes, "deals", string_list!(vec![deal_2])),
+        );
+        let mut builder = EventBuilder::new(&attributes, &strings);
+        builder.with_integer("exchange_id", 2).unwrap();
+        builder.with_string_list("deals", &["deal-1"]).unwrap();
+        let event = builder.build().unwrap();
+
+        assert_eq!(vec![0, 2], sorted_candidates(&index, &event));
+    }
+
+    #[test]
+    fn return_the_comparisons_that_are_true_for_the_value() {
+        let attributes = define_attributes();
+        let strings = StringTable::new();
+        let mut index = PredicateIndex::new(attributes.len());
+        let predicates = [
+            less_than!(&attributes, "exchange_id", comparison_integer!(5)),
+            less_than!(&attributes, "exchange_id", comparison_integer!(10)),
+            less_than_equal!(&attributes, "exchange_id", comparison_integer!(5)),
+            less_than_equal!(&attributes, "exchange_id", comparison_integer!(4)),
+            greater_than!(&attributes, "exchange_id", comparison_integer!(5)),
+            greater_than!(&attributes, "exchange_id", comparison_integer!(1)),
+            greater_than_equal!(&attributes, "exchange_id", comparison_integer!(5)),
+            greater_than_equal!(&attributes, "exchange_id", comparison_integer!(6)),
+        ];
+        for (id, predicate) in predicates.iter().enumerate() {
+            index.insert(id, predicate);
+        }
+        let mut builder = EventBuilder::new(&attributes, &strings);
+        builder.with_integer("exchange_id", 5).unwrap();
+        let event = builder.build().unwrap();
+
+        assert_eq!(vec![1, 2, 5, 6], sorted_candidates(&index, &event));
+    }
+
+    #[test]
+    fn return_the_boolean_variables_that_match_the_value() {
+        let attributes = define_attributes();
+        let strings = StringTable::new();
+        let mut index = PredicateIndex::new(attributes.len());
+        index.insert(0, &variable!(&attributes, "private"));
+        index.insert(1, &negated_variable!(&attributes, "private"));
+        let mut builder = EventBuilder::new(&attributes, &strings);
+        builder.with_boolean("private", false).unwrap();
+        let event = builder.build().unwrap();
+
+        assert_eq!(vec![1], sorted_candidates(&index, &event));
+    }
+
+    #[test]
+    fn always_return_the_residual_predicates() {
+        let attributes = define_attributes();
+        let mut strings = StringTable::new();
+        let ca = strings.get_or_update("CA");
+        let mut index = PredicateIndex::new(attributes.len());
+        index.insert(
+            0,
+            &not_equal!(&attributes, "country", primitive_string!(ca)),
+        );
+        index.insert(1, &is_null!(&attributes, "exchange_id"));
+        let event = EventBuilder::new(&attributes, &strings).build().unwrap();
+
+        assert_eq!(vec![0, 1], sorted_candidates(&index, &event));
+    }
+
+    #[test]
+    fn do_not_return_removed_predicates() {
+        let attributes = define_attributes();
+        let strings = StringTable::new();
+        let mut index = PredicateIndex::new(attributes.len());
+        let a_predicate = set_in!(&attributes, "exchange_id", integer_list!(vec![1, 2, 3]));
+        let another_predicate = less_than!(&attributes, "exchange_id", comparison_integer!(5));
+        index.insert(0, &a_predicate);
+        index.insert(1, &another_predicate);
+        index.insert(2, &is_null!(&attributes, "exchange_id"));
+        index.remove(0, &a_predicate);
+        index.remove(1, &another_predicate);
+        let mut builder = EventBuilder::new(&attributes, &strings);
+        builder.with_integer("exchange_id", 2).unwrap();
+        let event = builder.build().unwrap();
+
+        assert_eq!(vec![2], sorted_candidates(&index, &event));
+    }
+
+    fn sorted_candidates(index: &PredicateIndex, event: &Event) -> Vec<NodeId> {
+        let mut candidates = vec![];
+        index.candidates(event, &mut candidates);
+        candidates.sort();
+        candidates.dedup();
+        candidates
+    }
+
+    fn define_attributes() -> AttributeTable {
+        let definitions = vec![
+            AttributeDefinition::string_list("deals"),
+            AttributeDefinition::integer("exchange_id"),
+            AttributeDefinition::boolean("private"),
+            AttributeDefinition::string("country"),
+        ];
+        AttributeTable::new(&definitions).unwrap()
+    }
+}
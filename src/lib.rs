@@ -74,6 +74,8 @@
 //!   sub-expression `(B ∧ C)` and will make both expression refer to the common node);
 //! * Convert the strings to IDs to accelerate comparison and search;
 //! * Sort the lists of strings/integers and remove duplicates;
+//! * Compare the sorted lists with SIMD kernels selected at runtime (AVX-512, AVX2, SSE4.1 or
+//!   NEON) and fall back to galloping search when one list is much smaller than the other;
 //! * Sort the sub-expressions by cost:
 //!     * variable substitution/null checks/empty checks < set operations < lists operations
 //!     * the length of the lists has an impact on that cost too for set operations and lists
@@ -84,21 +86,93 @@
 //! * _Zero suppression filter_: Reduce the amount of nodes to evaluate by applying
 //!   De Morgan's laws and eliminating the NOT nodes;
 //! * _Propagation on demand_: Choose an access child for the AND operators and only
-//!   propagate the result if the access child is true.
+//!   propagate the result if the access child is true;
+//! * _Predicate index_ (opt-in via [`ATree::enable_predicate_index()`]): Group the predicates by
+//!   attribute and by value so that a search only evaluates the predicates that can be true for the
+//!   event along with the negations and the null checks.
+//! * _Frozen layout_ (opt-in via [`ATree::freeze()`]): Copy the nodes into contiguous arrays
+//!   numbered in level order so that the search does not chase a pointer on every hop. The
+//!   predicates are compiled into flat opcodes that are specialized for the types of their
+//!   attributes so that evaluating them only dispatches once. [`FrozenATree::search_sweep()`]
+//!   schedules the nodes in a bitmap and sweeps each level in memory order instead of queueing
+//!   them. The arrays can be written as a frozen image with [`ATree::save_frozen()`] and searched
+//!   in place from the mapped file with [`FrozenATree::load_mmap()`].
+//! * _Parallel bulk loading_ (via [`ATree::insert_bulk_parallel()`]): Parse and optimize the
+//!   expressions over all the available cores with a string table per thread that is merged in
+//!   the tree's one afterwards.
+//! * _Expression cache_ (opt-in via [`ATree::enable_expression_cache()`]): Look the expressions
+//!   up by a hash of their normalized tokens before parsing them so that inserting a duplicate
+//!   only subscribes to its existing node.
+//! * _Reusable events_ (via [`ATree::attribute()`] and [`EventBuilder::reset()`]): Resolve the
+//!   attributes once into [`AttributeHandle`]s and keep the builder's list buffers between the
+//!   events.
+//! * _Columnar batches_ (via [`ATree::search_columns()`]): Fill the events of a batch straight
+//!   from Arrow-like columns and reuse them from one batch to the next.
+//! * _Interned strings_ (via [`ATree::intern()`]): Keep the strings in a single buffer hashed
+//!   with FxHash and set the frequent ones in the events by their [`StringId`] instead of hashing
+//!   them for every event.
+//! * _Parallel search_ (opt-in via [`ATree::search_parallel()`]): Spread the evaluation of a
+//!   single event over the threads of a [`ThreadPool`], one stage per level of the tree, for the
+//!   trees that are large enough for it to pay off.
+//! * _Adaptive ordering_ (opt-in via [`ATree::enable_outcome_sampling()`] and
+//!   [`ATree::reoptimize()`]): Sample the outcomes of the nodes during the searches and reorder
+//!   the children (and the access children of the `and` nodes) by their observed selectivity per
+//!   unit of cost.
+//! * _Early exit_ ([`ATree::search_any()`], [`ATree::search_limit()`] and
+//!   [`ATree::search_top_k()`]): Stop processing the levels as soon as the answer is known; for
+//!   the top-k searches, every node keeps the highest priority of the subscriptions above it so
+//!   that the nodes that cannot beat the current matches are never evaluated.
+//! * _Integer sets_: Keep the integer lists of the predicates inline when they are tiny and as
+//!   a bitmap over their range when they are dense so that checking a value is a single bit test.
+//! * _Delta searches_ ([`ATree::search_base()`] and [`ATree::search_delta()`]): Keep the
+//!   evaluation of a base event and only evaluate again the predicates that reference the
+//!   attributes that changed along with the nodes above them.
+//! * _Sharding_ (via [`ShardedATree`]): Partition the subscriptions across many smaller trees
+//!   that are searched at the same time by the threads of a [`ThreadPool`], which can be pinned
+//!   to the CPUs of a NUMA node with [`ThreadPool::pin()`].
+//!
+//! # Cargo features
+//!
+//! * `stats`: Add `ATree::search_with_stats()` to record what the searches do (the predicates
+//!   evaluated and delayed, the nodes popped per level, the short-circuits, the matches and the
+//!   time spent in each stage) in a `SearchStats`. The other searches are not instrumented
+//!   whether the feature is enabled or not.
 mod ast;
 mod atree;
+mod bulk;
+mod columns;
+mod encoding;
 mod error;
 mod evaluation;
 mod events;
+mod index;
 mod lexer;
+mod lists;
+mod mmap;
+mod opcodes;
 mod parser;
+mod pool;
 mod predicates;
+mod sets;
+mod sharded;
+mod shared;
 mod strings;
 #[cfg(test)]
 mod test_utils;
 
 pub use crate::{
-    atree::{ATree, Report},
-    error::ATreeError,
-    events::{AttributeDefinition, Event, EventBuilder, EventError},
+    atree::{
+        ATree, DeltaContext, FrozenATree, FrozenSearchContext, MemoryUsage, Report, SearchContext,
+    },
+    columns::{Bitmap, Column, EventBatch, IntegerArray, StringArray},
+    encoding::Persist,
+    error::{ATreeError, SnapshotError},
+    events::{AttributeDefinition, AttributeHandle, Event, EventBuilder, EventError},
+    pool::ThreadPool,
+    sharded::{ShardPolicy, ShardedATree},
+    shared::{ReadGuard, SharedATree},
+    strings::StringId,
 };
+
+#[cfg(feature = "stats")]
+pub use crate::atree::SearchStats;
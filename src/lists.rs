@@ -0,0 +1,584 @@
+//! Operations on the sorted lists of unique values (i.e. integers and strings) that are used by the
+//! set and list predicates.
+//!
+//! The operations are vectorized when the CPU supports it (AVX-512, AVX2 or SSE4.1 on `x86_64` and
+//! NEON on `aarch64`); the best kernel is picked at runtime. When the lists have very different
+//! sizes, the smallest list is searched in the largest one with a galloping (exponential) search
+//! instead. The scalar sorted merge is kept as the fallback.
+use crate::strings::StringId;
+use std::{cmp::Ordering, sync::OnceLock};
+
+/// The amount of elements under which a linear scan is faster than a binary search.
+const LINEAR_SCAN_LIMIT: usize = 32;
+/// The size ratio between two lists over which the galloping search is used.
+const GALLOPING_RATIO: usize = 32;
+
+/// A value that can be compared by the vectorized kernels via its 64-bit representation.
+pub trait Lane: Ord + Copy {
+    /// Reinterpret the values as their 64-bit representation, if they have one.
+    fn as_bits(values: &[Self]) -> Option<&[u64]>;
+}
+
+impl Lane for i64 {
+    #[inline]
+    fn as_bits(values: &[Self]) -> Option<&[u64]> {
+        // SAFETY: `i64` and `u64` have the same size and alignment.
+        Some(unsafe { std::slice::from_raw_parts(values.as_ptr().cast(), values.len()) })
+    }
+}
+
+impl Lane for StringId {
+    #[inline]
+    fn as_bits(values: &[Self]) -> Option<&[u64]> {
+        #[cfg(target_pointer_width = "64")]
+        {
+            // SAFETY: `StringId` is a transparent wrapper over an `usize` that is 64 bits wide.
+            Some(unsafe { std::slice::from_raw_parts(values.as_ptr().cast(), values.len()) })
+        }
+        #[cfg(not(target_pointer_width = "64"))]
+        {
+            let _ = values;
+            None
+        }
+    }
+}
+
+/// Check if the sorted list contains the value.
+#[inline]
+pub fn contains<T: Lane>(haystack: &[T], needle: &T) -> bool {
+    contains_with(kernel(), haystack, needle)
+}
+
+/// Check if the sorted lists have at least one value in common.
+#[inline]
+pub fn intersects<T: Lane>(left: &[T], right: &[T]) -> bool {
+    intersects_with(kernel(), left, right)
+}
+
+/// Check if all the values of the left sorted list are part of the right sorted list.
+#[inline]
+pub fn is_subset<T: Lane>(left: &[T], right: &[T]) -> bool {
+    is_subset_with(kernel(), left, right)
+}
+
+#[inline]
+fn contains_with<T: Lane>(kernel: Kernel, haystack: &[T], needle: &T) -> bool {
+    if haystack.len() > LINEAR_SCAN_LIMIT {
+        return haystack.binary_search(needle).is_ok();
+    }
+
+    match (
+        T::as_bits(haystack),
+        T::as_bits(std::slice::from_ref(needle)),
+    ) {
+        (Some(haystack), Some(needle)) => kernel.contains(haystack, needle[0]),
+        _ => haystack.contains(needle),
+    }
+}
+
+#[inline]
+fn intersects_with<T: Lane>(kernel: Kernel, left: &[T], right: &[T]) -> bool {
+    if left.is_empty() || right.is_empty() {
+        return false;
+    }
+
+    let (small, large) = if left.len() <= right.len() {
+        (left, right)
+    } else {
+        (right, left)
+    };
+    if large.len() / small.len() >= GALLOPING_RATIO {
+        return intersects_galloping(small, large);
+    }
+
+    match (T::as_bits(left), T::as_bits(right)) {
+        (Some(left_bits), Some(right_bits)) => {
+            kernel.count_common(left, right, left_bits, right_bits, 1) > 0
+        }
+        _ => count_common_scalar(left, right, 1) > 0,
+    }
+}
+
+#[inline]
+fn is_subset_with<T: Lane>(kernel: Kernel, left: &[T], right: &[T]) -> bool {
+    if left.len() > right.len() {
+        return false;
+    }
+
+    match (left.first(), left.last()) {
+        (Some(first), Some(last)) if *first < right[0] || *last > right[right.len() - 1] => {
+            return false;
+        }
+        (None, _) | (_, None) => return true,
+        _ => {}
+    }
+
+    if right.len() / left.len() >= GALLOPING_RATIO {
+        return is_subset_galloping(left, right);
+    }
+
+    let limit = left.len();
+    match (T::as_bits(left), T::as_bits(right)) {
+        (Some(left_bits), Some(right_bits)) => {
+            kernel.count_common(left, right, left_bits, right_bits, limit) == limit
+        }
+        _ => count_common_scalar(left, right, limit) == limit,
+    }
+}
+
+/// Search for the first position that is greater or equal to the target by doubling the search
+/// range until it contains the target.
+#[inline]
+fn gallop<T: Ord>(values: &[T], target: &T) -> usize {
+    let mut bound = 1;
+    while bound < values.len() && values[bound] < *target {
+        bound *= 2;
+    }
+    let start = bound / 2;
+    let end = values.len().min(bound + 1);
+    start + values[start..end].partition_point(|value| value < target)
+}
+
+fn intersects_galloping<T: Ord>(small: &[T], large: &[T]) -> bool {
+    let mut position = 0;
+    for value in small {
+        position += gallop(&large[position..], value);
+        if position >= large.len() {
+            return false;
+        }
+        if large[position] == *value {
+            return true;
+        }
+    }
+    false
+}
+
+fn is_subset_galloping<T: Ord>(left: &[T], right: &[T]) -> bool {
+    let mut position = 0;
+    for value in left {
+        position += gallop(&right[position..], value);
+        if position >= right.len() || right[position] != *value {
+            return false;
+        }
+    }
+    true
+}
+
+/// Count the values in common between both sorted lists, stopping as soon as the limit is
+/// reached.
+fn count_common_scalar<T: Ord>(left: &[T], right: &[T], limit: usize) -> usize {
+    let mut i = 0usize;
+    let mut j = 0usize;
+    let mut count = 0usize;
+    while i < left.len() && j < right.len() && count < limit {
+        match left[i].cmp(&right[j]) {
+            Ordering::Less => {
+                i += 1;
+            }
+            Ordering::Equal => {
+                count += 1;
+                i += 1;
+                j += 1;
+            }
+            Ordering::Greater => {
+                j += 1;
+            }
+        }
+    }
+    count
+}
+
+/// Count the values in common between both sorted lists by comparing blocks of `B` values at
+/// once; the `block` function returns the amount of values from the left block that are present
+/// in the right block. The block that has the smallest last value is the one that moves forward.
+#[inline(always)]
+fn count_common_blocks<T: Ord, const B: usize>(
+    left: &[T],
+    right: &[T],
+    left_bits: &[u64],
+    right_bits: &[u64],
+    limit: usize,
+    block: impl Fn(*const u64, *const u64) -> u32,
+) -> usize {
+    let mut i = 0usize;
+    let mut j = 0usize;
+    let mut count = 0usize;
+    while i + B <= left.len() && j + B <= right.len() {
+        count += block(left_bits[i..].as_ptr(), right_bits[j..].as_ptr()) as usize;
+        if count >= limit {
+            return count;
+        }
+
+        match left[i + B - 1].cmp(&right[j + B - 1]) {
+            Ordering::Less => {
+                i += B;
+            }
+            Ordering::Equal => {
+                i += B;
+                j += B;
+            }
+            Ordering::Greater => {
+                j += B;
+            }
+        }
+    }
+    count + count_common_scalar(&left[i..], &right[j..], limit - count)
+}
+
+#[derive(Clone, Copy, Debug, PartialEq, Eq)]
+enum Kernel {
+    Scalar,
+    #[cfg(target_arch = "x86_64")]
+    Sse41,
+    #[cfg(target_arch = "x86_64")]
+    Avx2,
+    #[cfg(target_arch = "x86_64")]
+    Avx512,
+    #[cfg(target_arch = "aarch64")]
+    Neon,
+}
+
+impl Kernel {
+    fn detect() -> Self {
+        if cfg!(miri) {
+            return Self::Scalar;
+        }
+
+        #[cfg(target_arch = "x86_64")]
+        {
+            if std::arch::is_x86_feature_detected!("avx512f") {
+                return Self::Avx512;
+            }
+            if std::arch::is_x86_feature_detected!("avx2") {
+                return Self::Avx2;
+            }
+            if std::arch::is_x86_feature_detected!("sse4.1") {
+                return Self::Sse41;
+            }
+        }
+
+        #[cfg(target_arch = "aarch64")]
+        {
+            if std::arch::is_aarch64_feature_detected!("neon") {
+                return Self::Neon;
+            }
+        }
+
+        Self::Scalar
+    }
+
+    fn contains(self, haystack: &[u64], needle: u64) -> bool {
+        match self {
+            Self::Scalar => haystack.contains(&needle),
+            // SAFETY: the kernels are only used when the CPU supports them.
+            #[cfg(target_arch = "x86_64")]
+            Self::Sse41 => unsafe { x86::contains_sse41(haystack, needle) },
+            #[cfg(target_arch = "x86_64")]
+            Self::Avx2 => unsafe { x86::contains_avx2(haystack, needle) },
+            #[cfg(target_arch = "x86_64")]
+            Self::Avx512 => unsafe { x86::contains_avx512(haystack, needle) },
+            #[cfg(target_arch = "aarch64")]
+            Self::Neon => unsafe { aarch64::contains_neon(haystack, needle) },
+        }
+    }
+
+    fn count_common<T: Ord>(
+        self,
+        left: &[T],
+        right: &[T],
+        left_bits: &[u64],
+        right_bits: &[u64],
+        limit: usize,
+    ) -> usize {
+        match self {
+            Self::Scalar => count_common_scalar(left, right, limit),
+            // SAFETY: the kernels are only used when the CPU supports them.
+            #[cfg(target_arch = "x86_64")]
+            Self::Sse41 => unsafe { x86::count_sse41(left, right, left_bits, right_bits, limit) },
+            #[cfg(target_arch = "x86_64")]
+            Self::Avx2 => unsafe { x86::count_avx2(left, right, left_bits, right_bits, limit) },
+            #[cfg(target_arch = "x86_64")]
+            Self::Avx512 => unsafe { x86::count_avx512(left, right, left_bits, right_bits, limit) },
+            #[cfg(target_arch = "aarch64")]
+            Self::Neon => unsafe { aarch64::count_neon(left, right, left_bits, right_bits, limit) },
+        }
+    }
+}
+
+#[inline]
+fn kernel() -> Kernel {
+    static KERNEL: OnceLock<Kernel> = OnceLock::new();
+    *KERNEL.get_or_init(Kernel::detect)
+}
+
+/// Linear scan of the haystack by blocks of `B` values, the remainder is scanned one by one.
+#[inline(always)]
+fn contains_blocks<const B: usize>(
+    haystack: &[u64],
+    needle: u64,
+    block: impl Fn(*const u64, *const u64) -> u32,
+) -> bool {
+    let needles = [needle; B];
+    let mut chunks = haystack.chunks_exact(B);
+    if chunks.any(|chunk| block(chunk.as_ptr(), needles.as_ptr()) != 0) {
+        return true;
+    }
+    chunks.remainder().contains(&needle)
+}
+
+#[cfg(target_arch = "x86_64")]
+mod x86 {
+    use super::{contains_blocks, count_common_blocks};
+    use std::arch::x86_64::*;
+
+    #[target_feature(enable = "sse4.1")]
+    unsafe fn block_sse41(left: *const u64, right: *const u64) -> u32 {
+        let values = _mm_loadu_si128(left.cast());
+        let first = _mm_cmpeq_epi64(values, _mm_set1_epi64x(*right as i64));
+        let second = _mm_cmpeq_epi64(values, _mm_set1_epi64x(*right.add(1) as i64));
+        let matches = _mm_or_si128(first, second);
+        (_mm_movemask_pd(_mm_castsi128_pd(matches)) as u32).count_ones()
+    }
+
+    #[target_feature(enable = "avx2")]
+    unsafe fn block_avx2(left: *const u64, right: *const u64) -> u32 {
+        let values = _mm256_loadu_si256(left.cast());
+        let mut matches = _mm256_setzero_si256();
+        for k in 0..4 {
+            let other = _mm256_set1_epi64x(*right.add(k) as i64);
+            matches = _mm256_or_si256(matches, _mm256_cmpeq_epi64(values, other));
+        }
+        (_mm256_movemask_pd(_mm256_castsi256_pd(matches)) as u32).count_ones()
+    }
+
+    #[target_feature(enable = "avx512f")]
+    unsafe fn block_avx512(left: *const u64, right: *const u64) -> u32 {
+        let values = _mm512_loadu_epi64(left.cast());
+        let mut matches: __mmask8 = 0;
+        for k in 0..8 {
+            let other = _mm512_set1_epi64(*right.add(k) as i64);
+            matches |= _mm512_cmpeq_epi64_mask(values, other);
+        }
+        matches.count_ones()
+    }
+
+    #[target_feature(enable = "sse4.1")]
+    pub(super) unsafe fn contains_sse41(haystack: &[u64], needle: u64) -> bool {
+        contains_blocks::<2>(haystack, needle, |a, b| block_sse41(a, b))
+    }
+
+    #[target_feature(enable = "avx2")]
+    pub(super) unsafe fn contains_avx2(haystack: &[u64], needle: u64) -> bool {
+        contains_blocks::<4>(haystack, needle, |a, b| block_avx2(a, b))
+    }
+
+    #[target_feature(enable = "avx512f")]
+    pub(super) unsafe fn contains_avx512(haystack: &[u64], needle: u64) -> bool {
+        contains_blocks::<8>(haystack, needle, |a, b| block_avx512(a, b))
+    }
+
+    #[target_feature(enable = "sse4.1")]
+    pub(super) unsafe fn count_sse41<T: Ord>(
+        left: &[T],
+        right: &[T],
+        left_bits: &[u64],
+        right_bits: &[u64],
+        limit: usize,
+    ) -> usize {
+        count_common_blocks::<T, 2>(left, right, left_bits, right_bits, limit, |a, b| {
+            block_sse41(a, b)
+        })
+    }
+
+    #[target_feature(enable = "avx2")]
+    pub(super) unsafe fn count_avx2<T: Ord>(
+        left: &[T],
+        right: &[T],
+        left_bits: &[u64],
+        right_bits: &[u64],
+        limit: usize,
+    ) -> usize {
+        count_common_blocks::<T, 4>(left, right, left_bits, right_bits, limit, |a, b| {
+            block_avx2(a, b)
+        })
+    }
+
+    #[target_feature(enable = "avx512f")]
+    pub(super) unsafe fn count_avx512<T: Ord>(
+        left: &[T],
+        right: &[T],
+        left_bits: &[u64],
+        right_bits: &[u64],
+        limit: usize,
+    ) -> usize {
+        count_common_blocks::<T, 8>(left, right, left_bits, right_bits, limit, |a, b| {
+            block_avx512(a, b)
+        })
+    }
+}
+
+#[cfg(target_arch = "aarch64")]
+mod aarch64 {
+    use super::{contains_blocks, count_common_blocks};
+    use std::arch::aarch64::*;
+
+    #[target_feature(enable = "neon")]
+    unsafe fn block_neon(left: *const u64, right: *const u64) -> u32 {
+        let values = vld1q_u64(left);
+        let first = vceqq_u64(values, vdupq_n_u64(*right));
+        let second = vceqq_u64(values, vdupq_n_u64(*right.add(1)));
+        let matches = vorrq_u64(first, second);
+        (vgetq_lane_u64::<0>(matches) & 1) as u32 + (vgetq_lane_u64::<1>(matches) & 1) as u32
+    }
+
+    #[target_feature(enable = "neon")]
+    pub(super) unsafe fn contains_neon(haystack: &[u64], needle: u64) -> bool {
+        contains_blocks::<2>(haystack, needle, |a, b| block_neon(a, b))
+    }
+
+    #[target_feature(enable = "neon")]
+    pub(super) unsafe fn count_neon<T: Ord>(
+        left: &[T],
+        right: &[T],
+        left_bits: &[u64],
+        right_bits: &[u64],
+        limit: usize,
+    ) -> usize {
+        count_common_blocks::<T, 2>(left, right, left_bits, right_bits, limit, |a, b| {
+            block_neon(a, b)
+        })
+    }
+}
+
+#[cfg(test)]
+mod tests {
+    use super::*;
+    use itertools::Itertools;
+    use proptest::prelude::{proptest, *};
+
+    fn available_kernels() -> Vec<Kernel> {
+        let mut kernels = vec![Kernel::Scalar];
+        #[cfg(target_arch = "x86_64")]
+        if !cfg!(miri) {
+            if std::arch::is_x86_feature_detected!("sse4.1") {
+                kernels.push(Kernel::Sse41);
+            }
+            if std::arch::is_x86_feature_detected!("avx2") {
+                kernels.push(Kernel::Avx2);
+            }
+            if std::arch::is_x86_feature_detected!("avx512f") {
+                kernels.push(Kernel::Avx512);
+            }
+        }
+        #[cfg(target_arch = "aarch64")]
+        if !cfg!(miri) && std::arch::is_aarch64_feature_detected!("neon") {
+            kernels.push(Kernel::Neon);
+        }
+        kernels
+    }
+
+    fn sorted(values: impl IntoIterator<Item = i64>) -> Vec<i64> {
+        values.into_iter().sorted().unique().collect_vec()
+    }
+
+    fn assert_same_as_scalar(left: &[i64], right: &[i64]) {
+        let expected_intersects = left.iter().any(|value| right.contains(value));
+        let expected_is_subset = left.iter().all(|value| right.contains(value));
+        for kernel in available_kernels() {
+            assert_eq!(
+                expected_intersects,
+                intersects_with(kernel, left, right),
+                "{kernel:?}: {left:?} intersects {right:?}"
+            );
+            assert_eq!(
+                expected_is_subset,
+                is_subset_with(kernel, left, right),
+                "{kernel:?}: {left:?} is subset of {right:?}"
+            );
+            for value in left {
+                assert_eq!(
+                    right.contains(value),
+                    contains_with(kernel, right, value),
+                    "{kernel:?}: {right:?} contains {value}"
+                );
+            }
+        }
+    }
+
+    #[test]
+    fn return_false_when_intersecting_with_an_empty_list() {
+        assert!(!intersects::<i64>(&[], &[1, 2, 3]));
+        assert!(!intersects::<i64>(&[1, 2, 3], &[]));
+    }
+
+    #[test]
+    fn an_empty_list_is_a_subset_of_any_list() {
+        assert!(is_subset::<i64>(&[], &[1, 2, 3]));
+        assert!(is_subset::<i64>(&[], &[]));
+        assert!(!is_subset::<i64>(&[1], &[]));
+    }
+
+    #[test]
+    fn can_find_the_common_values_across_blocks() {
+        let left = sorted((0..40).map(|i| i * 3));
+        let right = sorted((0..40).map(|i| i * 5 + 1));
+        let disjoint = sorted((0..40).map(|i| i * 3 + 1));
+        let subset = sorted((0..17).map(|i| i * 6));
+
+        assert_same_as_scalar(&left, &right);
+        assert_same_as_scalar(&left, &disjoint);
+        assert_same_as_scalar(&subset, &left);
+        assert_same_as_scalar(&left, &left);
+    }
+
+    #[test]
+    fn compare_negative_integers_with_their_order() {
+        let left = sorted([-9, -5, -3, -1, 0, 2, 4, 6, 8, 10]);
+        let right = sorted([-10, -8, -6, -4, -2, 1, 3, 5, 7, 10]);
+
+        assert_same_as_scalar(&left, &right);
+        assert_same_as_scalar(&right, &left);
+    }
+
+    #[test]
+    fn can_gallop_through_very_asymmetric_lists() {
+        let large = sorted((0..5000).map(|i| i * 2));
+        let small = sorted([3, 101, 4001, 9998]);
+        let subset = sorted([0, 100, 4000, 9998]);
+
+        assert!(intersects(&small, &large));
+        assert!(intersects(&large, &small));
+        assert!(!intersects(&sorted([3, 101, 4001]), &large));
+        assert!(is_subset(&subset, &large));
+        assert!(!is_subset(&small, &large));
+    }
+
+    #[test]
+    fn can_compare_string_ids() {
+        let left = (1..20).step_by(2).map(StringId::new).collect_vec();
+        let right = (1..40).step_by(3).map(StringId::new).collect_vec();
+
+        for kernel in available_kernels() {
+            assert!(intersects_with(kernel, &left, &right));
+            assert!(!is_subset_with(kernel, &left, &right));
+            assert!(is_subset_with(kernel, &left[..1], &right));
+            assert!(contains_with(kernel, &right, &StringId::new(7)));
+            assert!(!contains_with(kernel, &right, &StringId::new(8)));
+        }
+    }
+
+    proptest! {
+        #[test]
+        #[cfg_attr(miri, ignore)]
+        fn return_the_same_results_as_the_scalar_implementation(
+            left in prop::collection::vec(any::<i64>(), 0..300),
+            right in prop::collection::vec(any::<i64>(), 0..300)
+        ) {
+            let left = sorted(left);
+            let right = sorted(right);
+
+            assert_same_as_scalar(&left, &right);
+            assert_same_as_scalar(&right, &left);
+        }
+    }
+}
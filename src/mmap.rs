@@ -0,0 +1,113 @@
+use std::{fs::File, io, ops::Deref, path::Path};
+
+/// A read-only view of the whole content of a file.
+///
+/// On Unix, the file is mapped in memory so that its pages are only read from the disk (or the
+/// page cache) when they are accessed. Elsewhere, the file is read in memory.
+pub struct Mmap {
+    #[cfg(unix)]
+    pointer: *mut libc::c_void,
+    #[cfg(unix)]
+    length: usize,
+    #[cfg(not(unix))]
+    bytes: Vec<u8>,
+}
+
+impl Mmap {
+    #[cfg(unix)]
+    pub fn open<P: AsRef<Path>>(path: P) -> io::Result<Self> {
+        use std::os::unix::io::AsRawFd;
+
+        let file = File::open(path)?;
+        let length = usize::try_from(file.metadata()?.len())
+            .map_err(|error| io::Error::new(io::ErrorKind::InvalidData, error))?;
+        if length == 0 {
+            // Empty mappings are not allowed.
+            return Ok(Self {
+                pointer: std::ptr::null_mut(),
+                length,
+            });
+        }
+
+        // SAFETY: The mapping is private and read-only; it stays valid after the file is closed.
+        let pointer = unsafe {
+            libc::mmap(
+                std::ptr::null_mut(),
+                length,
+                libc::PROT_READ,
+                libc::MAP_PRIVATE,
+                file.as_raw_fd(),
+                0,
+            )
+        };
+        if pointer == libc::MAP_FAILED {
+            return Err(io::Error::last_os_error());
+        }
+        // The snapshots are decoded from the start to the end.
+        // SAFETY: The range is the one that was just mapped; the advice is only a hint.
+        unsafe {
+            libc::madvise(pointer, length, libc::MADV_SEQUENTIAL);
+        }
+        Ok(Self { pointer, length })
+    }
+
+    #[cfg(not(unix))]
+    pub fn open<P: AsRef<Path>>(path: P) -> io::Result<Self> {
+        use std::io::Read;
+
+        let mut bytes = Vec::new();
+        File::open(path)?.read_to_end(&mut bytes)?;
+        Ok(Self { bytes })
+    }
+
+    /// Tell the kernel that the pages are not read sequentially anymore (e.g. once a frozen image
+    /// is decoded and only its records are accessed by the searches).
+    #[cfg(unix)]
+    pub fn advise_normal(&self) {
+        if self.length != 0 {
+            // SAFETY: The range is the one that was mapped; the advice is only a hint.
+            unsafe {
+                libc::madvise(self.pointer, self.length, libc::MADV_NORMAL);
+            }
+        }
+    }
+
+    #[cfg(not(unix))]
+    pub fn advise_normal(&self) {}
+}
+
+// SAFETY: the mapping is private and read-only so its pages can be read from any thread.
+unsafe impl Send for Mmap {}
+unsafe impl Sync for Mmap {}
+
+impl Deref for Mmap {
+    type Target = [u8];
+
+    #[cfg(unix)]
+    #[inline]
+    fn deref(&self) -> &Self::Target {
+        if self.length == 0 {
+            return &[];
+        }
+        // SAFETY: The pointer refers to a mapping of `length` bytes that lives as long as `self`.
+        unsafe { std::slice::from_raw_parts(self.pointer.cast::<u8>(), self.length) }
+    }
+
+    #[cfg(not(unix))]
+    #[inline]
+    fn deref(&self) -> &Self::Target {
+        &self.bytes
+    }
+}
+
+#[cfg(unix)]
+impl Drop for Mmap {
+    fn drop(&mut self) {
+        if self.length != 0 {
+            // SAFETY: The mapping was created by `Mmap::open()` and is not referenced anymore.
+            unsafe {
+                libc::munmap(self.pointer, self.length);
+            }
+        }
+    }
+}
@@ -0,0 +1,360 @@
+use crate::{
+    events::{AttributeId, AttributeValue, Event},
+    lists,
+    predicates::{
+        ComparisonOperator, ComparisonValue, EqualityOperator, ListLiteral, ListOperator,
+        NullOperator, Predicate, PredicateKind, PrimitiveLiteral, SetOperator,
+    },
+    sets::IntegerSet,
+    strings::StringId,
+};
+use rust_decimal::Decimal;
+use std::cmp::Ordering;
+
+/// A [`Predicate`] lowered to a single opcode that is specialized for the type of its attribute.
+///
+/// Evaluating a [`Predicate`] goes through its kind, then its operator and then the type of the
+/// value of the attribute; a compiled predicate only has to dispatch once on its opcode.
+#[derive(Clone, Debug)]
+pub struct CompiledPredicate {
+    attribute: AttributeId,
+    opcode: Opcode,
+}
+
+impl CompiledPredicate {
+    pub fn compile(predicate: &Predicate) -> Self {
+        Self {
+            attribute: predicate.attribute(),
+            opcode: Opcode::from(predicate.kind()),
+        }
+    }
+
+    #[inline]
+    pub fn evaluate(&self, event: &Event) -> Option<bool> {
+        let value = &event[self.attribute];
+        let result = match (&self.opcode, value) {
+            (Opcode::IsNull, value) => matches!(value, AttributeValue::Undefined),
+            (Opcode::IsNotNull, value) => !matches!(value, AttributeValue::Undefined),
+            (_, AttributeValue::Undefined) => return None,
+            (Opcode::IsTrue, AttributeValue::Boolean(value)) => *value,
+            (Opcode::IsFalse, AttributeValue::Boolean(value)) => !*value,
+
+            (Opcode::IntLess(b), AttributeValue::Integer(a)) => a < b,
+            (Opcode::IntLessEqual(b), AttributeValue::Integer(a)) => a <= b,
+            (Opcode::IntGreaterEqual(b), AttributeValue::Integer(a)) => a >= b,
+            (Opcode::IntGreater(b), AttributeValue::Integer(a)) => a > b,
+            (Opcode::FloatLess(b), AttributeValue::Float(a)) => b.compare(a).is_lt(),
+            (Opcode::FloatLessEqual(b), AttributeValue::Float(a)) => b.compare(a).is_le(),
+            (Opcode::FloatGreaterEqual(b), AttributeValue::Float(a)) => b.compare(a).is_ge(),
+            (Opcode::FloatGreater(b), AttributeValue::Float(a)) => b.compare(a).is_gt(),
+
+            (Opcode::IntEqual(b), AttributeValue::Integer(a)) => a == b,
+            (Opcode::IntNotEqual(b), AttributeValue::Integer(a)) => a != b,
+            (Opcode::FloatEqual(b), AttributeValue::Float(a)) => b.compare(a).is_eq(),
+            (Opcode::FloatNotEqual(b), AttributeValue::Float(a)) => b.compare(a).is_ne(),
+            (Opcode::StrEqual(b), AttributeValue::String(a)) => a == b,
+            (Opcode::StrNotEqual(b), AttributeValue::String(a)) => a != b,
+
+            (Opcode::IntIn(haystack), AttributeValue::Integer(needle)) => {
+                haystack.contains(*needle)
+            }
+            (Opcode::IntNotIn(haystack), AttributeValue::Integer(needle)) => {
+                !haystack.contains(*needle)
+            }
+            (Opcode::StrIn(haystack), AttributeValue::String(needle)) => {
+                lists::contains(haystack, needle)
+            }
+            (Opcode::StrNotIn(haystack), AttributeValue::String(needle)) => {
+                !lists::contains(haystack, needle)
+            }
+
+            (Opcode::IntOneOf(right), AttributeValue::IntegerList(left)) => right.intersects(left),
+            (Opcode::IntNoneOf(right), AttributeValue::IntegerList(left)) => {
+                !right.intersects(left)
+            }
+            (Opcode::IntAllOf(right), AttributeValue::IntegerList(left)) => right.is_superset(left),
+            (Opcode::IntNotAllOf(right), AttributeValue::IntegerList(left)) => {
+                !right.is_superset(left)
+            }
+            (Opcode::StrOneOf(right), AttributeValue::StringList(left)) => {
+                lists::intersects(left, right)
+            }
+            (Opcode::StrNoneOf(right), AttributeValue::StringList(left)) => {
+                !lists::intersects(left, right)
+            }
+            (Opcode::StrAllOf(right), AttributeValue::StringList(left)) => {
+                lists::is_subset(left, right)
+            }
+            (Opcode::StrNotAllOf(right), AttributeValue::StringList(left)) => {
+                !lists::is_subset(left, right)
+            }
+
+            (Opcode::IsEmpty, AttributeValue::IntegerList(list)) => list.is_empty(),
+            (Opcode::IsEmpty, AttributeValue::StringList(list)) => list.is_empty(),
+            (Opcode::IsNotEmpty, AttributeValue::IntegerList(list)) => !list.is_empty(),
+            (Opcode::IsNotEmpty, AttributeValue::StringList(list)) => !list.is_empty(),
+            (opcode, value) => {
+                unreachable!("Opcode {opcode:?} for {value:?} should never happen. This is a bug.")
+            }
+        };
+        Some(result)
+    }
+}
+
+#[derive(Clone, Debug)]
+enum Opcode {
+    IsTrue,
+    IsFalse,
+    IntLess(i64),
+    IntLessEqual(i64),
+    IntGreaterEqual(i64),
+    IntGreater(i64),
+    FloatLess(FloatLiteral),
+    FloatLessEqual(FloatLiteral),
+    FloatGreaterEqual(FloatLiteral),
+    FloatGreater(FloatLiteral),
+    IntEqual(i64),
+    IntNotEqual(i64),
+    FloatEqual(FloatLiteral),
+    FloatNotEqual(FloatLiteral),
+    StrEqual(StringId),
+    StrNotEqual(StringId),
+    IntIn(IntegerSet),
+    IntNotIn(IntegerSet),
+    StrIn(Box<[StringId]>),
+    StrNotIn(Box<[StringId]>),
+    IntOneOf(IntegerSet),
+    IntNoneOf(IntegerSet),
+    IntAllOf(IntegerSet),
+    IntNotAllOf(IntegerSet),
+    StrOneOf(Box<[StringId]>),
+    StrNoneOf(Box<[StringId]>),
+    StrAllOf(Box<[StringId]>),
+    StrNotAllOf(Box<[StringId]>),
+    IsNull,
+    IsNotNull,
+    IsEmpty,
+    IsNotEmpty,
+}
+
+impl From<&PredicateKind> for Opcode {
+    fn from(kind: &PredicateKind) -> Self {
+        match kind {
+            PredicateKind::Variable => Self::IsTrue,
+            PredicateKind::NegatedVariable => Self::IsFalse,
+            PredicateKind::Comparison(operator, ComparisonValue::Integer(value)) => {
+                let value = *value;
+                match operator {
+                    ComparisonOperator::LessThan => Self::IntLess(value),
+                    ComparisonOperator::LessThanEqual => Self::IntLessEqual(value),
+                    ComparisonOperator::GreaterThanEqual => Self::IntGreaterEqual(value),
+                    ComparisonOperator::GreaterThan => Self::IntGreater(value),
+                }
+            }
+            PredicateKind::Comparison(operator, ComparisonValue::Float(value)) => {
+                let value = FloatLiteral::new(*value);
+                match operator {
+                    ComparisonOperator::LessThan => Self::FloatLess(value),
+                    ComparisonOperator::LessThanEqual => Self::FloatLessEqual(value),
+                    ComparisonOperator::GreaterThanEqual => Self::FloatGreaterEqual(value),
+                    ComparisonOperator::GreaterThan => Self::FloatGreater(value),
+                }
+            }
+            PredicateKind::Equality(operator, value) => match (operator, value) {
+                (EqualityOperator::Equal, PrimitiveLiteral::Integer(value)) => {
+                    Self::IntEqual(*value)
+                }
+                (EqualityOperator::NotEqual, PrimitiveLiteral::Integer(value)) => {
+                    Self::IntNotEqual(*value)
+                }
+                (EqualityOperator::Equal, PrimitiveLiteral::Float(value)) => {
+                    Self::FloatEqual(FloatLiteral::new(*value))
+                }
+                (EqualityOperator::NotEqual, PrimitiveLiteral::Float(value)) => {
+                    Self::FloatNotEqual(FloatLiteral::new(*value))
+                }
+                (EqualityOperator::Equal, PrimitiveLiteral::String(value)) => {
+                    Self::StrEqual(*value)
+                }
+                (EqualityOperator::NotEqual, PrimitiveLiteral::String(value)) => {
+                    Self::StrNotEqual(*value)
+                }
+            },
+            PredicateKind::Set(operator, values) => match (operator, values) {
+                (SetOperator::In, ListLiteral::IntegerList(values)) => Self::IntIn(values.clone()),
+                (SetOperator::NotIn, ListLiteral::IntegerList(values)) => {
+                    Self::IntNotIn(values.clone())
+                }
+                (SetOperator::In, ListLiteral::StringList(values)) => {
+                    Self::StrIn(values.as_slice().into())
+                }
+                (SetOperator::NotIn, ListLiteral::StringList(values)) => {
+                    Self::StrNotIn(values.as_slice().into())
+                }
+            },
+            PredicateKind::List(operator, ListLiteral::IntegerList(values)) => {
+                let values = values.clone();
+                match operator {
+                    ListOperator::OneOf => Self::IntOneOf(values),
+                    ListOperator::NoneOf => Self::IntNoneOf(values),
+                    ListOperator::AllOf => Self::IntAllOf(values),
+                    ListOperator::NotAllOf => Self::IntNotAllOf(values),
+                }
+            }
+            PredicateKind::List(operator, ListLiteral::StringList(values)) => {
+                let values = values.as_slice().into();
+                match operator {
+                    ListOperator::OneOf => Self::StrOneOf(values),
+                    ListOperator::NoneOf => Self::StrNoneOf(values),
+                    ListOperator::AllOf => Self::StrAllOf(values),
+                    ListOperator::NotAllOf => Self::StrNotAllOf(values),
+                }
+            }
+            PredicateKind::Null(NullOperator::IsNull) => Self::IsNull,
+            PredicateKind::Null(NullOperator::IsNotNull) => Self::IsNotNull,
+            PredicateKind::Null(NullOperator::IsEmpty) => Self::IsEmpty,
+            PredicateKind::Null(NullOperator::IsNotEmpty) => Self::IsNotEmpty,
+        }
+    }
+}
+
+/// A float literal along with its mantissa and its scale so that it can be compared with the
+/// values of the same scale without rescaling any of them.
+#[derive(Clone, Debug)]
+struct FloatLiteral {
+    mantissa: i128,
+    scale: u32,
+    value: Decimal,
+}
+
+impl FloatLiteral {
+    fn new(value: Decimal) -> Self {
+        Self {
+            mantissa: value.mantissa(),
+            scale: value.scale(),
+            value,
+        }
+    }
+
+    /// Compare the value of the event with the literal.
+    #[inline]
+    fn compare(&self, value: &Decimal) -> Ordering {
+        if value.scale() == self.scale {
+            value.mantissa().cmp(&self.mantissa)
+        } else {
+            value.cmp(&self.value)
+        }
+    }
+}
+
+#[cfg(test)]
+mod tests {
+    use super::*;
+    use crate::{
+        ast::{Arena, OptimizedNode},
+        events::{AttributeDefinition, AttributeTable, EventBuilder},
+        parser,
+        strings::StringTable,
+    };
+
+    #[test]
+    fn evaluate_the_same_way_as_the_predicates() {
+        let definitions = [
+            AttributeDefinition::boolean("private"),
+            AttributeDefinition::integer("exchange_id"),
+            AttributeDefinition::float("price"),
+            AttributeDefinition::string("country"),
+            AttributeDefinition::integer_list("segment_ids"),
+            AttributeDefinition::string_list("deal_ids"),
+        ];
+        let attributes = AttributeTable::new(&definitions).unwrap();
+        let mut strings = StringTable::new();
+        let expressions = [
+            "private",
+            "not private",
+            "exchange_id < 5",
+            "exchange_id <= 5",
+            "exchange_id > 5",
+            "exchange_id >= 5",
+            "exchange_id = 5",
+            "exchange_id <> 5",
+            "exchange_id in [1, 5, 9]",
+            "exchange_id not in [1, 5, 9]",
+            "exchange_id is null",
+            "exchange_id is not null",
+            "price < 2.5",
+            "price <= 2.50",
+            "price > 2.5",
+            "price >= 2.5",
+            "price = 2.5",
+            "price <> 2.5",
+            "country = 'CA'",
+            "country <> 'CA'",
+            "country in ['CA', 'US']",
+            "country not in ['CA', 'US']",
+            "segment_ids one of [1, 2]",
+            "segment_ids none of [1, 2]",
+            "segment_ids all of [1, 2]",
+            "segment_ids is empty",
+            "segment_ids is not empty",
+            r#"deal_ids one of ["deal-1", "deal-2"]"#,
+            r#"deal_ids none of ["deal-1", "deal-2"]"#,
+            r#"deal_ids all of ["deal-1", "deal-2"]"#,
+        ];
+        let predicates = expressions
+            .iter()
+            .map(|expression| {
+                let mut arena = Arena::default();
+                let root =
+                    parser::parse(expression, &attributes, &mut strings, &mut arena).unwrap();
+                let root = arena.optimize(root);
+                match arena.node(root) {
+                    OptimizedNode::Value(predicate) => predicate.clone(),
+                    node => panic!("{expression} is not a single predicate: {node:?}"),
+                }
+            })
+            .collect::<Vec<_>>();
+        let events = (0..8i64)
+            .map(|i| {
+                let mut builder = EventBuilder::new(&attributes, &strings);
+                builder.with_boolean("private", i % 2 == 0).unwrap();
+                if i != 7 {
+                    builder.with_integer("exchange_id", i + 2).unwrap();
+                    builder
+                        .with_float("price", 2 + i % 2, i as u32 % 3)
+                        .unwrap();
+                    builder
+                        .with_string("country", ["CA", "US", "FR"][i as usize % 3])
+                        .unwrap();
+                }
+                builder
+                    .with_integer_list("segment_ids", &[1, 2, 3][..i as usize % 4])
+                    .unwrap();
+                builder
+                    .with_string_list("deal_ids", &["deal-1", "deal-2"][..i as usize % 3])
+                    .unwrap();
+                builder.build().unwrap()
+            })
+            .collect::<Vec<_>>();
+
+        for predicate in &predicates {
+            let compiled = CompiledPredicate::compile(predicate);
+            for event in &events {
+                assert_eq!(
+                    predicate.evaluate(event),
+                    compiled.evaluate(event),
+                    "{predicate}"
+                );
+            }
+        }
+    }
+
+    #[test]
+    fn compare_the_floats_of_a_different_scale() {
+        let literal = FloatLiteral::new(Decimal::new(250, 2));
+
+        assert_eq!(Ordering::Equal, literal.compare(&Decimal::new(25, 1)));
+        assert_eq!(Ordering::Less, literal.compare(&Decimal::new(249, 2)));
+        assert_eq!(Ordering::Greater, literal.compare(&Decimal::new(3, 0)));
+    }
+}
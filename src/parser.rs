@@ -1,5 +1,5 @@
 use crate::{
-    ast::Node,
+    ast::{Arena, NodeRef},
     error::ParserError,
     events::AttributeTable,
     lexer::{Lexer, Token},
@@ -13,21 +13,24 @@ use self::grammar::TreeParser;
 
 pub type ATreeParseError<'a> = ParseError<usize, Token<'a>, ParserError>;
 
+/// Parse the expression into the [`Arena`] and return the root of its nodes.
+///
+/// The nodes of an invalid expression might be left in the [`Arena`] but they are not referenced.
 #[inline]
 pub fn parse<'a>(
     input: &'a str,
     attributes: &AttributeTable,
     strings: &mut StringTable,
-) -> Result<Node, ATreeParseError<'a>> {
+    arena: &mut Arena,
+) -> Result<NodeRef, ATreeParseError<'a>> {
     let lexer = Lexer::new(input);
-    TreeParser::new().parse(attributes, strings, lexer)
+    TreeParser::new().parse(attributes, strings, arena, lexer)
 }
 
 #[cfg(test)]
 mod tests {
     use super::*;
     use crate::{
-        ast::*,
         events::AttributeDefinition,
         predicates::{
             ComparisonOperator, ComparisonValue, EqualityOperator, ListLiteral, ListOperator,
@@ -41,6 +44,7 @@ mod tests {
                 not_equal, one_of, predicate, primitive_integer, set_in, set_not_in, string_list,
                 variable,
             },
+            Expression,
         },
     };
 
@@ -597,6 +601,32 @@ mod tests {
         );
     }
 
+    #[test]
+    fn sort_the_string_lists_by_their_ids() {
+        let mut strings = StringTable::new();
+        strings.get_or_update("deal-3");
+        let attributes = define_attributes();
+
+        let parsed = parse(
+            r##"deal in ["deal-1", "deal-2", "deal-3"]"##,
+            &attributes,
+            &mut strings,
+        );
+
+        assert_eq!(
+            Ok(value!(set_in!(
+                &attributes,
+                "deal",
+                string_list!(vec![
+                    strings.get("deal-3"),
+                    strings.get("deal-1"),
+                    strings.get("deal-2")
+                ])
+            ))),
+            parsed
+        );
+    }
+
     #[test]
     fn can_parse_not_in_expression() {
         let mut strings = StringTable::new();
@@ -955,6 +985,44 @@ mod tests {
         );
     }
 
+    #[test]
+    fn can_parse_many_expressions_in_the_same_arena() {
+        let mut strings = StringTable::new();
+        let attributes = define_attributes();
+        let mut arena = Arena::default();
+
+        let first = super::parse(
+            "private and price < 15",
+            &attributes,
+            &mut strings,
+            &mut arena,
+        );
+        let second = super::parse("not private", &attributes, &mut strings, &mut arena);
+
+        assert_eq!(
+            and!(
+                value!(variable!(&attributes, "private")),
+                value!(less_than!(&attributes, "price", comparison_integer!(15)))
+            ),
+            arena.expression(first.unwrap())
+        );
+        assert_eq!(
+            not!(value!(variable!(&attributes, "private"))),
+            arena.expression(second.unwrap())
+        );
+    }
+
+    /// Parse the expression in an arena of its own and return it boxed to compare it with the
+    /// expected one.
+    fn parse<'a>(
+        input: &'a str,
+        attributes: &AttributeTable,
+        strings: &mut StringTable,
+    ) -> Result<Expression, ATreeParseError<'a>> {
+        let mut arena = Arena::default();
+        super::parse(input, attributes, strings, &mut arena).map(|root| arena.expression(root))
+    }
+
     fn define_attributes() -> AttributeTable {
         let definitions = vec![
             AttributeDefinition::string_list("deals"),
@@ -0,0 +1,333 @@
+use std::{
+    fmt, io,
+    num::NonZeroUsize,
+    panic::{self, AssertUnwindSafe},
+    sync::{
+        mpsc::{self, SendError, Sender},
+        Mutex,
+    },
+    thread::{self, JoinHandle},
+};
+
+/// A pool of worker threads that spread the search of a single event with
+/// [`crate::ATree::search_parallel()`].
+///
+/// The threads are started once by [`ThreadPool::new()`] and are kept waiting for work until the
+/// pool is dropped, so a search does not pay for spawning them. The calling thread only waits
+/// for the work to be done: a pool of `n` threads starts `n` workers, so pinning them never
+/// changes the affinity of the caller.
+///
+/// Splitting a search is only worth it for large trees; the searches of the trees that have
+/// fewer nodes than the [`ThreadPool::with_threshold()`] are left on the calling thread.
+///
+/// # Examples
+///
+/// ```rust
+/// use a_tree::{ATree, AttributeDefinition, ThreadPool};
+///
+/// let definitions = [AttributeDefinition::integer("exchange_id")];
+/// let mut atree = ATree::new(&definitions).unwrap();
+/// atree.insert(&1u64, "exchange_id = 5").unwrap();
+/// let pool = ThreadPool::new(4).with_threshold(0);
+///
+/// let mut builder = atree.make_event();
+/// builder.with_integer("exchange_id", 5).unwrap();
+/// let report = atree.search_parallel(&builder.build().unwrap(), &pool).unwrap();
+/// assert_eq!(report.matches(), [&1u64]);
+/// ```
+pub struct ThreadPool {
+    workers: Vec<Worker>,
+    threshold: usize,
+}
+
+impl ThreadPool {
+    /// The amount of nodes under which a search is not split by default.
+    pub const DEFAULT_THRESHOLD: usize = 100_000;
+
+    /// Create a pool of the specified amount of worker threads.
+    ///
+    /// A pool of zero threads is treated as a pool of one thread.
+    pub fn new(threads: usize) -> Self {
+        let workers = (0..threads.max(1)).map(Worker::spawn).collect();
+        Self {
+            workers,
+            threshold: Self::DEFAULT_THRESHOLD,
+        }
+    }
+
+    /// Create a pool with one thread per available core.
+    pub fn with_available_parallelism() -> Self {
+        Self::new(thread::available_parallelism().map_or(1, NonZeroUsize::get))
+    }
+
+    /// Set the amount of nodes from which the searches of a tree are split across the threads.
+    pub fn with_threshold(mut self, nodes: usize) -> Self {
+        self.threshold = nodes;
+        self
+    }
+
+    /// The amount of worker threads of the pool.
+    #[inline]
+    pub fn threads(&self) -> usize {
+        self.workers.len()
+    }
+
+    /// The amount of nodes from which the searches of a tree are split across the threads.
+    #[inline]
+    pub fn threshold(&self) -> usize {
+        self.threshold
+    }
+
+    /// Restrict the thread of the pool with the specified index to the specified CPUs.
+    ///
+    /// The indexes go from `0` to [`ThreadPool::threads()`] (excluded); the calling thread is never
+    /// pinned. Pinning the workers to the CPUs of a NUMA node keeps the memory they allocate and
+    /// the tasks they run (e.g. the shards of a [`crate::ShardedATree`]) on that node. Pinning is
+    /// only supported on Linux; an [`io::ErrorKind::Unsupported`] error is returned elsewhere.
+    ///
+    /// # Examples
+    ///
+    /// ```rust
+    /// use a_tree::ThreadPool;
+    ///
+    /// let pool = ThreadPool::new(2);
+    /// // A pool of two threads only has the workers 0 and 1.
+    /// assert!(pool.pin(2, &[0]).is_err());
+    /// ```
+    pub fn pin(&self, thread: usize, cpus: &[usize]) -> io::Result<()> {
+        if thread >= self.threads() {
+            return Err(io::Error::new(
+                io::ErrorKind::InvalidInput,
+                format!("the pool has no thread {thread}"),
+            ));
+        }
+        let result = Mutex::new(Ok(()));
+        self.broadcast(&|index| {
+            if index == thread {
+                *result.lock().unwrap() = set_affinity(cpus);
+            }
+        });
+        result.into_inner().unwrap()
+    }
+
+    /// Run the task on every thread of the pool with the index of the thread and wait for all of
+    /// them to be done.
+    ///
+    /// The calling thread only waits for the workers. If a task panics, the panic is resumed on
+    /// the calling thread once all the other tasks are done.
+    pub(crate) fn broadcast<F: Fn(usize) + Sync>(&self, task: &F) {
+        let task: &(dyn Fn(usize) + Sync) = task;
+        // SAFETY: the workers only use the task before reporting that they are done and this
+        // function does not return (or unwind) before all of them did, so the task outlives them.
+        let task = unsafe {
+            std::mem::transmute::<&(dyn Fn(usize) + Sync), &'static (dyn Fn(usize) + Sync)>(task)
+        };
+        let (done, finished) = mpsc::channel();
+        let mut stranded = Vec::new();
+        for (index, worker) in self.workers.iter().enumerate() {
+            let job = Job {
+                task,
+                index,
+                done: done.clone(),
+            };
+            // A worker only stops when the pool is dropped; its share is run here otherwise.
+            if let Err(SendError(job)) = worker.jobs.send(job) {
+                stranded.push(job.index);
+            }
+        }
+        drop(done);
+
+        let mut outcome =
+            panic::catch_unwind(AssertUnwindSafe(|| stranded.into_iter().for_each(task)));
+        // The senders of the jobs are dropped once they ran, which ends the iteration.
+        for result in finished.iter() {
+            outcome = outcome.and(result);
+        }
+        if let Err(payload) = outcome {
+            panic::resume_unwind(payload);
+        }
+    }
+}
+
+impl Drop for ThreadPool {
+    fn drop(&mut self) {
+        let handles = self
+            .workers
+            .drain(..)
+            .map(|worker| worker.handle)
+            .collect::<Vec<_>>();
+        // Dropping the senders stops the workers once they are done with their jobs.
+        for handle in handles {
+            let _ = handle.join();
+        }
+    }
+}
+
+impl fmt::Debug for ThreadPool {
+    fn fmt(&self, f: &mut fmt::Formatter<'_>) -> fmt::Result {
+        f.debug_struct("ThreadPool")
+            .field("threads", &self.threads())
+            .field("threshold", &self.threshold)
+            .finish()
+    }
+}
+
+#[cfg(target_os = "linux")]
+fn set_affinity(cpus: &[usize]) -> io::Result<()> {
+    // SAFETY: the set is a plain bitset for which all zeroes is the empty set.
+    let mut set: libc::cpu_set_t = unsafe { std::mem::zeroed() };
+    let capacity = 8 * std::mem::size_of::<libc::cpu_set_t>();
+    for cpu in cpus {
+        if *cpu >= capacity {
+            return Err(io::Error::new(
+                io::ErrorKind::InvalidInput,
+                format!("the CPU {cpu} is out of range"),
+            ));
+        }
+        // SAFETY: the CPU was checked to fit in the set.
+        unsafe { libc::CPU_SET(*cpu, &mut set) };
+    }
+    // SAFETY: the set outlives the call and `0` targets the calling thread.
+    let result = unsafe { libc::sched_setaffinity(0, std::mem::size_of_val(&set), &set) };
+    if result != 0 {
+        return Err(io::Error::last_os_error());
+    }
+    Ok(())
+}
+
+#[cfg(not(target_os = "linux"))]
+fn set_affinity(_cpus: &[usize]) -> io::Result<()> {
+    Err(io::Error::new(
+        io::ErrorKind::Unsupported,
+        "pinning threads is only supported on Linux",
+    ))
+}
+
+struct Job {
+    task: &'static (dyn Fn(usize) + Sync),
+    index: usize,
+    done: Sender<thread::Result<()>>,
+}
+
+struct Worker {
+    jobs: Sender<Job>,
+    handle: JoinHandle<()>,
+}
+
+impl Worker {
+    fn spawn(index: usize) -> Self {
+        let (jobs, receiver) = mpsc::channel::<Job>();
+        let handle = thread::Builder::new()
+            .name(format!("a-tree-worker-{index}"))
+            .spawn(move || {
+                for job in receiver {
+                    let result = panic::catch_unwind(AssertUnwindSafe(|| (job.task)(job.index)));
+                    let _ = job.done.send(result);
+                }
+            })
+            .expect("failed to spawn a worker thread");
+        Self { jobs, handle }
+    }
+}
+
+#[cfg(test)]
+mod tests {
+    use super::*;
+    use std::{
+        collections::HashSet,
+        sync::atomic::{AtomicUsize, Ordering},
+    };
+
+    #[test]
+    fn run_the_task_once_on_every_thread() {
+        let pool = ThreadPool::new(4);
+        let indexes = Mutex::new(Vec::new());
+
+        pool.broadcast(&|index| indexes.lock().unwrap().push(index));
+
+        let mut indexes = indexes.into_inner().unwrap();
+        indexes.sort_unstable();
+        assert_eq!(vec![0, 1, 2, 3], indexes);
+    }
+
+    #[test]
+    fn run_the_task_on_a_single_worker_when_the_pool_has_no_threads() {
+        let pool = ThreadPool::new(0);
+        let calls = AtomicUsize::new(0);
+
+        pool.broadcast(&|_| {
+            calls.fetch_add(1, Ordering::Relaxed);
+        });
+
+        assert_eq!(1, pool.threads());
+        assert_eq!(1, calls.into_inner());
+    }
+
+    #[test]
+    fn run_the_tasks_on_the_workers_instead_of_the_calling_thread() {
+        let pool = ThreadPool::new(3);
+        let caller = thread::current().id();
+        let threads = Mutex::new(HashSet::new());
+
+        pool.broadcast(&|_| {
+            threads.lock().unwrap().insert(thread::current().id());
+        });
+
+        let threads = threads.into_inner().unwrap();
+        assert_eq!(3, threads.len());
+        assert!(!threads.contains(&caller));
+    }
+
+    #[test]
+    #[cfg(target_os = "linux")]
+    fn pin_the_worker_to_the_specified_cpus() {
+        fn affinity() -> Vec<usize> {
+            // SAFETY: the set can be all zeroes and is only read once filled by the call.
+            let mut set: libc::cpu_set_t = unsafe { std::mem::zeroed() };
+            unsafe { libc::sched_getaffinity(0, std::mem::size_of_val(&set), &mut set) };
+            (0..8 * std::mem::size_of_val(&set))
+                .filter(|cpu| unsafe { libc::CPU_ISSET(*cpu, &set) })
+                .collect()
+        }
+        let pool = ThreadPool::new(2);
+        let caller = affinity();
+        let cpu = caller[0];
+
+        assert!(pool.pin(0, &[cpu]).is_ok());
+        assert!(pool.pin(1, &[cpu]).is_ok());
+        let cpus = Mutex::new(vec![Vec::new(); 2]);
+        pool.broadcast(&|index| cpus.lock().unwrap()[index] = affinity());
+        assert_eq!(vec![vec![cpu]; 2], cpus.into_inner().unwrap());
+        assert_eq!(caller, affinity());
+    }
+
+    #[test]
+    fn return_an_error_when_pinning_a_thread_that_does_not_exist_or_an_invalid_cpu() {
+        let pool = ThreadPool::new(2);
+
+        assert!(pool.pin(2, &[0]).is_err());
+        assert!(pool.pin(1, &[usize::MAX]).is_err());
+    }
+
+    #[test]
+    fn resume_the_panic_of_a_worker_once_all_the_tasks_are_done() {
+        let pool = ThreadPool::new(3);
+        let calls = AtomicUsize::new(0);
+
+        let result = panic::catch_unwind(AssertUnwindSafe(|| {
+            pool.broadcast(&|index| {
+                calls.fetch_add(1, Ordering::Relaxed);
+                if index == 2 {
+                    panic!("worker failure");
+                }
+            })
+        }));
+
+        assert!(result.is_err());
+        assert_eq!(3, calls.load(Ordering::Relaxed));
+        pool.broadcast(&|_| {
+            calls.fetch_add(1, Ordering::Relaxed);
+        });
+        assert_eq!(6, calls.into_inner());
+    }
+}
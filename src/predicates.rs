@@ -1,11 +1,16 @@
 use crate::{
+    encoding::{Decoder, Encoder},
+    error::SnapshotError,
     events::{AttributeId, AttributeKind, AttributeTable, AttributeValue, Event, EventError},
-    strings::StringId,
+    lists::{self, Lane},
+    sets::IntegerSet,
+    strings::{StringId, StringRemap},
 };
 use rust_decimal::Decimal;
 use std::{
     fmt::{Display, Formatter},
     hash::{Hash, Hasher},
+    io::{self, Write},
     ops::Not,
 };
 
@@ -46,6 +51,219 @@ impl Predicate {
         self.kind.cost()
     }
 
+    #[inline]
+    pub fn attribute(&self) -> AttributeId {
+        self.attribute
+    }
+
+    #[inline]
+    pub fn kind(&self) -> &PredicateKind {
+        &self.kind
+    }
+
+    /// The string IDs referenced by the predicate.
+    pub fn strings(&self) -> &[StringId] {
+        match &self.kind {
+            PredicateKind::Set(_, ListLiteral::StringList(values))
+            | PredicateKind::List(_, ListLiteral::StringList(values)) => values,
+            PredicateKind::Equality(_, PrimitiveLiteral::String(value)) => {
+                std::slice::from_ref(value)
+            }
+            _ => &[],
+        }
+    }
+
+    /// The memory allocated by the lists of the predicate, in bytes.
+    pub fn heap_size(&self) -> usize {
+        match &self.kind {
+            PredicateKind::Set(_, values) | PredicateKind::List(_, values) => match values {
+                ListLiteral::IntegerList(values) => values.heap_size(),
+                ListLiteral::StringList(values) => {
+                    values.capacity() * std::mem::size_of::<StringId>()
+                }
+            },
+            _ => 0,
+        }
+    }
+
+    /// Negate the predicate in place (i.e. without moving it out of where it is stored).
+    #[inline]
+    pub fn negate(&mut self) {
+        // A variable is a cheap placeholder to move the kind out while it is negated.
+        let kind = std::mem::replace(&mut self.kind, PredicateKind::Variable);
+        self.kind = !kind;
+    }
+
+    /// Translate the string IDs of the predicate to the ones of another table (e.g. the table
+    /// their table was merged in or the table once its unused strings were dropped).
+    pub fn remap_strings(&mut self, remap: &StringRemap) {
+        match &mut self.kind {
+            PredicateKind::Set(_, ListLiteral::StringList(values))
+            | PredicateKind::List(_, ListLiteral::StringList(values)) => {
+                values
+                    .iter_mut()
+                    .for_each(|value| *value = remap.get(*value));
+                // The lists are searched by their string IDs so they have to be sorted by them.
+                values.sort_unstable();
+            }
+            PredicateKind::Equality(_, PrimitiveLiteral::String(value)) => {
+                *value = remap.get(*value);
+            }
+            _ => {}
+        }
+    }
+
+    pub(crate) fn encode<W: Write>(&self, encoder: &mut Encoder<W>) -> io::Result<()> {
+        encoder.value(&self.attribute.index())?;
+        match &self.kind {
+            PredicateKind::Variable => encoder.value(&0u8),
+            PredicateKind::NegatedVariable => encoder.value(&1u8),
+            PredicateKind::Set(operator, values) => {
+                let operator: u8 = match operator {
+                    SetOperator::NotIn => 0,
+                    SetOperator::In => 1,
+                };
+                encoder.bytes(&[2, operator])?;
+                encode_list(values, encoder)
+            }
+            PredicateKind::Comparison(operator, value) => {
+                let operator: u8 = match operator {
+                    ComparisonOperator::LessThan => 0,
+                    ComparisonOperator::LessThanEqual => 1,
+                    ComparisonOperator::GreaterThanEqual => 2,
+                    ComparisonOperator::GreaterThan => 3,
+                };
+                encoder.bytes(&[3, operator])?;
+                match value {
+                    ComparisonValue::Integer(value) => {
+                        encoder.value(&0u8)?;
+                        encoder.value(value)
+                    }
+                    ComparisonValue::Float(value) => {
+                        encoder.value(&1u8)?;
+                        encoder.decimal(value)
+                    }
+                }
+            }
+            PredicateKind::Equality(operator, value) => {
+                let operator: u8 = match operator {
+                    EqualityOperator::Equal => 0,
+                    EqualityOperator::NotEqual => 1,
+                };
+                encoder.bytes(&[4, operator])?;
+                match value {
+                    PrimitiveLiteral::Integer(value) => {
+                        encoder.value(&0u8)?;
+                        encoder.value(value)
+                    }
+                    PrimitiveLiteral::Float(value) => {
+                        encoder.value(&1u8)?;
+                        encoder.decimal(value)
+                    }
+                    PrimitiveLiteral::String(value) => {
+                        encoder.value(&2u8)?;
+                        encoder.value(value)
+                    }
+                }
+            }
+            PredicateKind::List(operator, values) => {
+                let operator: u8 = match operator {
+                    ListOperator::OneOf => 0,
+                    ListOperator::NoneOf => 1,
+                    ListOperator::AllOf => 2,
+                    ListOperator::NotAllOf => 3,
+                };
+                encoder.bytes(&[5, operator])?;
+                encode_list(values, encoder)
+            }
+            PredicateKind::Null(operator) => {
+                let operator: u8 = match operator {
+                    NullOperator::IsNull => 0,
+                    NullOperator::IsNotNull => 1,
+                    NullOperator::IsEmpty => 2,
+                    NullOperator::IsNotEmpty => 3,
+                };
+                encoder.bytes(&[6, operator])
+            }
+        }
+    }
+
+    pub(crate) fn decode(
+        decoder: &mut Decoder<'_>,
+        attributes: &AttributeTable,
+    ) -> Result<Self, SnapshotError> {
+        let attribute = decoder.value::<usize>()?;
+        if attribute >= attributes.len() {
+            return Err(SnapshotError::Corrupted);
+        }
+        let attribute = AttributeId::new(attribute);
+        let kind = match decoder.value::<u8>()? {
+            0 => PredicateKind::Variable,
+            1 => PredicateKind::NegatedVariable,
+            2 => {
+                let operator = match decoder.value::<u8>()? {
+                    0 => SetOperator::NotIn,
+                    1 => SetOperator::In,
+                    _ => return Err(SnapshotError::Corrupted),
+                };
+                PredicateKind::Set(operator, decode_list(decoder)?)
+            }
+            3 => {
+                let operator = match decoder.value::<u8>()? {
+                    0 => ComparisonOperator::LessThan,
+                    1 => ComparisonOperator::LessThanEqual,
+                    2 => ComparisonOperator::GreaterThanEqual,
+                    3 => ComparisonOperator::GreaterThan,
+                    _ => return Err(SnapshotError::Corrupted),
+                };
+                let value = match decoder.value::<u8>()? {
+                    0 => ComparisonValue::Integer(decoder.value()?),
+                    1 => ComparisonValue::Float(decoder.decimal()?),
+                    _ => return Err(SnapshotError::Corrupted),
+                };
+                PredicateKind::Comparison(operator, value)
+            }
+            4 => {
+                let operator = match decoder.value::<u8>()? {
+                    0 => EqualityOperator::Equal,
+                    1 => EqualityOperator::NotEqual,
+                    _ => return Err(SnapshotError::Corrupted),
+                };
+                let value = match decoder.value::<u8>()? {
+                    0 => PrimitiveLiteral::Integer(decoder.value()?),
+                    1 => PrimitiveLiteral::Float(decoder.decimal()?),
+                    2 => PrimitiveLiteral::String(decoder.value()?),
+                    _ => return Err(SnapshotError::Corrupted),
+                };
+                PredicateKind::Equality(operator, value)
+            }
+            5 => {
+                let operator = match decoder.value::<u8>()? {
+                    0 => ListOperator::OneOf,
+                    1 => ListOperator::NoneOf,
+                    2 => ListOperator::AllOf,
+                    3 => ListOperator::NotAllOf,
+                    _ => return Err(SnapshotError::Corrupted),
+                };
+                PredicateKind::List(operator, decode_list(decoder)?)
+            }
+            6 => {
+                let operator = match decoder.value::<u8>()? {
+                    0 => NullOperator::IsNull,
+                    1 => NullOperator::IsNotNull,
+                    2 => NullOperator::IsEmpty,
+                    3 => NullOperator::IsNotEmpty,
+                    _ => return Err(SnapshotError::Corrupted),
+                };
+                PredicateKind::Null(operator)
+            }
+            _ => return Err(SnapshotError::Corrupted),
+        };
+        validate_predicate("", &kind, &attributes.by_id(attribute))
+            .map_err(|_| SnapshotError::Corrupted)?;
+        Ok(Self { attribute, kind })
+    }
+
     pub fn evaluate(&self, event: &Event) -> Option<bool> {
         let value = &event[self.attribute];
         match (&self.kind, value) {
@@ -83,6 +301,32 @@ impl Display for Predicate {
     }
 }
 
+#[inline]
+fn encode_list<W: Write>(values: &ListLiteral, encoder: &mut Encoder<W>) -> io::Result<()> {
+    match values {
+        ListLiteral::IntegerList(values) => {
+            encoder.value(&0u8)?;
+            let values = values.iter().collect::<Vec<_>>();
+            encoder.list(&values, |encoder, value| encoder.value(value))
+        }
+        ListLiteral::StringList(values) => {
+            encoder.value(&1u8)?;
+            encoder.list(values, |encoder, value| encoder.value(value))
+        }
+    }
+}
+
+#[inline]
+fn decode_list(decoder: &mut Decoder<'_>) -> Result<ListLiteral, SnapshotError> {
+    match decoder.value::<u8>()? {
+        0 => Ok(ListLiteral::IntegerList(
+            decoder.list(Decoder::value::<i64>)?.into(),
+        )),
+        1 => Ok(ListLiteral::StringList(decoder.list(Decoder::value)?)),
+        _ => Err(SnapshotError::Corrupted),
+    }
+}
+
 fn validate_predicate(
     name: &str,
     kind: &PredicateKind,
@@ -230,19 +474,20 @@ impl SetOperator {
             (ListLiteral::StringList(haystack), AttributeValue::String(needle)) => {
                 self.apply(haystack, needle)
             }
-            (ListLiteral::IntegerList(haystack), AttributeValue::Integer(needle)) => {
-                self.apply(haystack, needle)
-            }
+            (ListLiteral::IntegerList(haystack), AttributeValue::Integer(needle)) => match self {
+                Self::In => haystack.contains(*needle),
+                Self::NotIn => !haystack.contains(*needle),
+            },
             (a, b) => {
                 unreachable!("Set operation ({self:?}) in haystack {a:?} for {b:?} should never happen. This is a bug.")
             }
         }
     }
 
-    fn apply<T: Ord>(&self, haystack: &[T], needle: &T) -> bool {
+    fn apply<T: Lane>(&self, haystack: &[T], needle: &T) -> bool {
         match self {
-            Self::In => haystack.binary_search(needle).is_ok(),
-            Self::NotIn => haystack.binary_search(needle).is_err(),
+            Self::In => lists::contains(haystack, needle),
+            Self::NotIn => !lists::contains(haystack, needle),
         }
     }
 }
@@ -363,16 +608,19 @@ impl ListOperator {
             (ListLiteral::StringList(right), AttributeValue::StringList(left)) => {
                 self.apply(left, right)
             }
-            (ListLiteral::IntegerList(right), AttributeValue::IntegerList(left)) => {
-                self.apply(left, right)
-            }
+            (ListLiteral::IntegerList(right), AttributeValue::IntegerList(left)) => match self {
+                Self::OneOf => right.intersects(left),
+                Self::NoneOf => !right.intersects(left),
+                Self::AllOf => right.is_superset(left),
+                Self::NotAllOf => !right.is_superset(left),
+            },
             (a, b) => {
                 unreachable!("List operations ({self:?}) between {a:?} and {b:?} should never happen. This is a bug.")
             }
         }
     }
 
-    fn apply<T: Ord>(&self, left: &[T], right: &[T]) -> bool {
+    fn apply<T: Lane>(&self, left: &[T], right: &[T]) -> bool {
         match self {
             Self::OneOf => one_of(left, right),
             Self::NoneOf => none_of(left, right),
@@ -394,70 +642,23 @@ impl Display for ListOperator {
 }
 
 #[inline]
-fn none_of<T: Ord>(left: &[T], right: &[T]) -> bool {
+fn none_of<T: Lane>(left: &[T], right: &[T]) -> bool {
     !one_of(left, right)
 }
 
-fn one_of<T: Ord>(left: &[T], right: &[T]) -> bool {
-    use std::cmp::Ordering;
-
-    if left.is_empty() || right.is_empty() {
-        return false;
-    }
-
-    let mut i = 0usize;
-    let mut j = 0usize;
-    while j < left.len() && i < right.len() {
-        let x = &left[j];
-        let y = &right[i];
-        match y.cmp(x) {
-            Ordering::Less => {
-                i += 1;
-            }
-            Ordering::Equal => {
-                return true;
-            }
-            Ordering::Greater => {
-                j += 1;
-            }
-        }
-    }
-
-    false
+#[inline]
+fn one_of<T: Lane>(left: &[T], right: &[T]) -> bool {
+    lists::intersects(left, right)
 }
 
 #[inline]
-fn not_all_of<T: Ord>(left: &[T], right: &[T]) -> bool {
+fn not_all_of<T: Lane>(left: &[T], right: &[T]) -> bool {
     !all_of(left, right)
 }
 
-fn all_of<T: Ord>(left: &[T], right: &[T]) -> bool {
-    use std::cmp::Ordering;
-
-    if left.len() > right.len() {
-        return false;
-    }
-
-    let mut i = 0usize;
-    let mut j = 0usize;
-    while j < left.len() && i < right.len() {
-        let x = &left[j];
-        let y = &right[i];
-        match y.cmp(x) {
-            Ordering::Less => {
-                i += 1;
-            }
-            Ordering::Equal => {
-                i += 1;
-                j += 1;
-            }
-            Ordering::Greater => {
-                break;
-            }
-        }
-    }
-
-    j >= left.len()
+#[inline]
+fn all_of<T: Lane>(left: &[T], right: &[T]) -> bool {
+    lists::is_subset(left, right)
 }
 
 #[derive(Hash, Eq, PartialEq, Clone, Debug)]
@@ -514,7 +715,7 @@ impl Display for NullOperator {
 
 #[derive(Hash, Eq, PartialEq, Clone, Debug)]
 pub enum ListLiteral {
-    IntegerList(Vec<i64>),
+    IntegerList(IntegerSet),
     StringList(Vec<StringId>),
 }
 
@@ -762,7 +963,7 @@ mod tests {
         let predicate = Predicate::new(
             &attributes,
             "exchange_id",
-            PredicateKind::Set(SetOperator::NotIn, ListLiteral::IntegerList(vec![])),
+            PredicateKind::Set(SetOperator::NotIn, ListLiteral::IntegerList(vec![].into())),
         )
         .unwrap();
 
@@ -0,0 +1,254 @@
+//! The representations of the integer lists of the set and list predicates.
+//!
+//! The representation is picked from the size and the density of the values when the list is
+//! built: the smallest lists are kept inline without any heap allocation, the dense ranges are
+//! kept as a bitmap over their range and the other lists are kept as sorted arrays.
+use crate::lists;
+use std::fmt::{self, Debug, Formatter};
+
+/// The amount of values that are kept inline.
+const INLINE_CAPACITY: usize = 2;
+/// The amount of values from which a bitmap is considered.
+const BITMAP_THRESHOLD: usize = 64;
+const BITS_PER_WORD: usize = u64::BITS as usize;
+
+/// A set of unique integers.
+#[derive(Clone, Eq, PartialEq, Hash)]
+pub enum IntegerSet {
+    Inline {
+        len: u8,
+        values: [i64; INLINE_CAPACITY],
+    },
+    Sorted(Box<[i64]>),
+    Bitmap(Box<RangeBitmap>),
+}
+
+impl IntegerSet {
+    /// Build the set from sorted unique values.
+    fn from_sorted(values: Vec<i64>) -> Self {
+        if values.len() <= INLINE_CAPACITY {
+            let mut inline = [0; INLINE_CAPACITY];
+            inline[..values.len()].copy_from_slice(&values);
+            return Self::Inline {
+                len: values.len() as u8,
+                values: inline,
+            };
+        }
+
+        let (min, max) = (values[0], values[values.len() - 1]);
+        let span = (i128::from(max) - i128::from(min) + 1) as u128;
+        // The bitmap takes a bit per value of the range while the array takes 64 bits per value.
+        if values.len() >= BITMAP_THRESHOLD && span <= (values.len() * BITS_PER_WORD) as u128 {
+            return Self::Bitmap(Box::new(RangeBitmap::new(min, span as usize, &values)));
+        }
+        Self::Sorted(values.into_boxed_slice())
+    }
+
+    #[inline]
+    pub fn len(&self) -> usize {
+        match self {
+            Self::Inline { len, .. } => *len as usize,
+            Self::Sorted(values) => values.len(),
+            Self::Bitmap(bitmap) => bitmap.len,
+        }
+    }
+
+    /// The memory allocated by the set, in bytes.
+    pub fn heap_size(&self) -> usize {
+        match self {
+            Self::Inline { .. } => 0,
+            Self::Sorted(values) => std::mem::size_of_val::<[i64]>(values),
+            Self::Bitmap(bitmap) => {
+                std::mem::size_of::<RangeBitmap>() + std::mem::size_of_val::<[u64]>(&bitmap.words)
+            }
+        }
+    }
+
+    /// Iterate over the values in ascending order.
+    pub fn iter(&self) -> impl Iterator<Item = i64> + '_ {
+        let (values, bitmap): (&[i64], _) = match self {
+            Self::Inline { len, values } => (&values[..*len as usize], None),
+            Self::Sorted(values) => (values, None),
+            Self::Bitmap(bitmap) => (&[], Some(bitmap.iter())),
+        };
+        values.iter().copied().chain(bitmap.into_iter().flatten())
+    }
+
+    /// Check if the set contains the value.
+    #[inline]
+    pub fn contains(&self, needle: i64) -> bool {
+        match self {
+            Self::Inline { len, values } => values[..*len as usize].contains(&needle),
+            Self::Sorted(values) => lists::contains(values, &needle),
+            Self::Bitmap(bitmap) => bitmap.contains(needle),
+        }
+    }
+
+    /// Check if the set has at least one value in common with the sorted list.
+    #[inline]
+    pub fn intersects(&self, list: &[i64]) -> bool {
+        match self {
+            Self::Inline { len, values } => values[..*len as usize]
+                .iter()
+                .any(|value| lists::contains(list, value)),
+            Self::Sorted(values) => lists::intersects(list, values),
+            Self::Bitmap(bitmap) => bitmap.in_range(list).iter().any(|v| bitmap.contains(*v)),
+        }
+    }
+
+    /// Check if all the values of the sorted list are part of the set.
+    #[inline]
+    pub fn is_superset(&self, list: &[i64]) -> bool {
+        if list.len() > self.len() {
+            return false;
+        }
+        match self {
+            Self::Inline { len, values } => {
+                let values = &values[..*len as usize];
+                list.iter().all(|value| values.contains(value))
+            }
+            Self::Sorted(values) => lists::is_subset(list, values),
+            Self::Bitmap(bitmap) => {
+                bitmap.in_range(list).len() == list.len()
+                    && list.iter().all(|value| bitmap.contains(*value))
+            }
+        }
+    }
+}
+
+impl From<Vec<i64>> for IntegerSet {
+    fn from(mut values: Vec<i64>) -> Self {
+        values.sort_unstable();
+        values.dedup();
+        Self::from_sorted(values)
+    }
+}
+
+impl FromIterator<i64> for IntegerSet {
+    fn from_iter<I: IntoIterator<Item = i64>>(iter: I) -> Self {
+        Self::from(iter.into_iter().collect::<Vec<_>>())
+    }
+}
+
+impl Debug for IntegerSet {
+    fn fmt(&self, formatter: &mut Formatter<'_>) -> fmt::Result {
+        formatter.debug_list().entries(self.iter()).finish()
+    }
+}
+
+/// The values of a dense range as a bit per value of the range.
+#[derive(Clone, Eq, PartialEq, Hash, Debug)]
+pub struct RangeBitmap {
+    min: i64,
+    max: i64,
+    len: usize,
+    words: Box<[u64]>,
+}
+
+impl RangeBitmap {
+    fn new(min: i64, span: usize, values: &[i64]) -> Self {
+        let mut words = vec![0u64; span.div_ceil(BITS_PER_WORD)];
+        for value in values {
+            let offset = value.abs_diff(min) as usize;
+            words[offset / BITS_PER_WORD] |= 1 << (offset % BITS_PER_WORD);
+        }
+        Self {
+            min,
+            max: values[values.len() - 1],
+            len: values.len(),
+            words: words.into_boxed_slice(),
+        }
+    }
+
+    #[inline]
+    fn contains(&self, value: i64) -> bool {
+        if value < self.min || value > self.max {
+            return false;
+        }
+        let offset = value.abs_diff(self.min) as usize;
+        self.words[offset / BITS_PER_WORD] & (1 << (offset % BITS_PER_WORD)) != 0
+    }
+
+    /// The part of the sorted list that falls within the range of the bitmap.
+    #[inline]
+    fn in_range<'a>(&self, list: &'a [i64]) -> &'a [i64] {
+        let start = list.partition_point(|value| *value < self.min);
+        let end = list.partition_point(|value| *value <= self.max);
+        &list[start..end.max(start)]
+    }
+
+    fn iter(&self) -> impl Iterator<Item = i64> + '_ {
+        self.words
+            .iter()
+            .enumerate()
+            .flat_map(move |(index, word)| {
+                let mut word = *word;
+                std::iter::from_fn(move || {
+                    if word == 0 {
+                        return None;
+                    }
+                    let offset = index * BITS_PER_WORD + word.trailing_zeros() as usize;
+                    word &= word - 1;
+                    Some(self.min.wrapping_add(offset as i64))
+                })
+            })
+    }
+}
+
+#[cfg(test)]
+mod tests {
+    use super::*;
+
+    #[test]
+    fn pick_the_representation_from_the_size_and_the_density() {
+        let inline = IntegerSet::from(vec![3, 1]);
+        let sparse = IntegerSet::from((0..100).map(|i| i * 1000).collect::<Vec<_>>());
+        let dense = IntegerSet::from((0..50_000).filter(|i| i % 3 != 0).collect::<Vec<_>>());
+
+        assert!(matches!(inline, IntegerSet::Inline { len: 2, .. }));
+        assert!(matches!(sparse, IntegerSet::Sorted(_)));
+        assert!(matches!(dense, IntegerSet::Bitmap(_)));
+        assert_eq!(vec![1, 3], inline.iter().collect::<Vec<_>>());
+        assert_eq!(33_333, dense.len());
+    }
+
+    #[test]
+    fn answer_the_same_in_every_representation() {
+        let values = (-100..200).filter(|i| i % 3 == 0).collect::<Vec<_>>();
+        let dense = IntegerSet::from(values.clone());
+        let sorted = IntegerSet::from_sorted_array(values.clone());
+        let lists: [&[i64]; 5] = [&[], &[-99, 5, 300], &[-300, 0, 3], &[0, 3, 6, 9], &[6, 201]];
+
+        assert!(matches!(dense, IntegerSet::Bitmap(_)));
+        assert_eq!(values, dense.iter().collect::<Vec<_>>());
+        for value in -150..250 {
+            assert_eq!(sorted.contains(value), dense.contains(value), "{value}");
+        }
+        for list in lists {
+            assert_eq!(sorted.intersects(list), dense.intersects(list), "{list:?}");
+            assert_eq!(
+                sorted.is_superset(list),
+                dense.is_superset(list),
+                "{list:?}"
+            );
+        }
+        assert!(dense.is_superset(&[0, 3, 6, 9]));
+        assert!(!dense.is_superset(&[0, 3, 201]));
+    }
+
+    #[test]
+    fn handle_the_bounds_of_the_integers() {
+        let set = IntegerSet::from(vec![i64::MIN, 0, i64::MAX]);
+
+        assert!(matches!(set, IntegerSet::Sorted(_)));
+        assert!(set.contains(i64::MIN));
+        assert!(set.contains(i64::MAX));
+        assert!(!set.contains(1));
+    }
+
+    impl IntegerSet {
+        fn from_sorted_array(values: Vec<i64>) -> Self {
+            Self::Sorted(values.into_boxed_slice())
+        }
+    }
+}
@@ -0,0 +1,408 @@
+use crate::{
+    atree::{ATree, Report},
+    error::ATreeError,
+    events::{AttributeDefinition, Event, EventBuilder},
+    lexer::{Lexer, Token},
+    pool::ThreadPool,
+};
+use std::{
+    collections::hash_map::DefaultHasher,
+    fmt::Debug,
+    hash::{Hash, Hasher},
+    sync::Mutex,
+};
+
+/// The function that chooses the shard of a subscription among the specified amount of shards.
+pub type ShardPolicy<T> = Box<dyn Fn(&T, usize) -> usize + Send + Sync>;
+
+/// An [`ATree`] partitioned in many smaller [`ATree`]s that are searched at the same time.
+///
+/// Every subscription belongs to a single shard that is chosen by the hash of its ID or by a
+/// caller policy (see [`ShardedATree::with_policy()`]). A search scatters the [`Event`] to all
+/// the shards over the threads of a [`ThreadPool`] and merges their matches: the shard `i` is
+/// always searched by the thread `i % threads` so that pinning the threads of the pool to the
+/// CPUs of a NUMA node (see [`ThreadPool::pin()`]) keeps the shards they search on that node.
+/// The bulk insertions with [`ShardedATree::insert_bulk()`] build each shard on the thread that
+/// searches it so that its memory is allocated on the same node.
+///
+/// The shards intern the strings of every expression in the same order so that their string
+/// tables stay identical and the events built by [`ShardedATree::make_event()`] are valid for
+/// all of them. For the same reason, the shards cannot be compacted individually.
+///
+/// # Examples
+///
+/// ```rust
+/// use a_tree::{AttributeDefinition, ShardedATree, ThreadPool};
+///
+/// let definitions = [
+///     AttributeDefinition::boolean("private"),
+///     AttributeDefinition::string("country")
+/// ];
+/// let mut sharded = ShardedATree::new(&definitions, 4).unwrap();
+/// sharded.insert(&1u64, r#"country = "CA""#).unwrap();
+/// sharded.insert(&2u64, r#"country = "US" and private"#).unwrap();
+/// sharded.insert(&3u64, "not private").unwrap();
+/// let pool = ThreadPool::new(2);
+///
+/// let mut builder = sharded.make_event();
+/// builder.with_string("country", "CA").unwrap();
+/// builder.with_boolean("private", false).unwrap();
+/// let report = sharded.search(&builder.build().unwrap(), &pool).unwrap();
+/// let mut matches = report.matches().to_vec();
+/// matches.sort();
+/// assert_eq!(matches, [&1u64, &3u64]);
+/// ```
+pub struct ShardedATree<T> {
+    shards: Vec<ATree<T>>,
+    policy: ShardPolicy<T>,
+}
+
+impl<T: Eq + Hash + Clone + Debug> ShardedATree<T> {
+    /// Create a new [`ShardedATree`] with the specified amount of shards that assigns the
+    /// subscriptions to the shards by the hash of their IDs.
+    ///
+    /// See [`ATree::new()`] for more details on the attributes. A [`ShardedATree`] of zero
+    /// shards is treated as one of a single shard.
+    pub fn new(
+        definitions: &'_ [AttributeDefinition],
+        shards: usize,
+    ) -> Result<Self, ATreeError<'_>> {
+        Self::with_policy(
+            definitions,
+            shards,
+            Box::new(|subscription_id, shards| {
+                let mut hasher = DefaultHasher::new();
+                subscription_id.hash(&mut hasher);
+                (hasher.finish() % shards as u64) as usize
+            }),
+        )
+    }
+
+    /// Create a new [`ShardedATree`] with the specified amount of shards that assigns the
+    /// subscriptions to the shards with the specified policy.
+    ///
+    /// The policy is called with the ID of the subscription and the amount of shards; it has to
+    /// return the same shard for the same ID since the deletions are routed with it as well. The
+    /// shards it returns are wrapped around the amount of shards.
+    ///
+    /// # Examples
+    ///
+    /// ```rust
+    /// use a_tree::{AttributeDefinition, ShardedATree};
+    ///
+    /// let definitions = [AttributeDefinition::integer("exchange_id")];
+    /// let policy = Box::new(|subscription_id: &u64, shards: usize| *subscription_id as usize % shards);
+    /// let mut sharded = ShardedATree::with_policy(&definitions, 2, policy).unwrap();
+    /// sharded.insert(&1u64, "exchange_id = 1").unwrap();
+    /// sharded.insert(&3u64, "exchange_id = 3").unwrap();
+    ///
+    /// assert_eq!(0, sharded.shard(0).memory_usage().nodes);
+    /// assert_ne!(0, sharded.shard(1).memory_usage().nodes);
+    /// ```
+    pub fn with_policy(
+        definitions: &'_ [AttributeDefinition],
+        shards: usize,
+        policy: ShardPolicy<T>,
+    ) -> Result<Self, ATreeError<'_>> {
+        let atree = ATree::new(definitions)?;
+        Ok(Self {
+            shards: vec![atree; shards.max(1)],
+            policy,
+        })
+    }
+
+    /// Insert an arbitrary boolean expression in the shard of its subscription.
+    ///
+    /// See [`ATree::insert()`] for more details.
+    pub fn insert<'a>(
+        &mut self,
+        subscription_id: &T,
+        expression: &'a str,
+    ) -> Result<(), ATreeError<'a>> {
+        self.intern(expression);
+        let shard = self.shard_of(subscription_id);
+        self.shards[shard].insert(subscription_id, expression)
+    }
+
+    /// Insert many arbitrary boolean expressions at once; each shard is built by the thread of
+    /// the pool that searches it.
+    ///
+    /// If one of the expressions is invalid, an error is returned and none of them is inserted.
+    ///
+    /// # Examples
+    ///
+    /// ```rust
+    /// use a_tree::{AttributeDefinition, ShardedATree, ThreadPool};
+    ///
+    /// let definitions = [AttributeDefinition::integer("exchange_id")];
+    /// let mut sharded = ShardedATree::new(&definitions, 2).unwrap();
+    /// let pool = ThreadPool::new(2);
+    /// let expressions = [(1u64, "exchange_id = 1"), (2u64, "exchange_id = 2")];
+    /// assert!(sharded.insert_bulk(expressions, &pool).is_ok());
+    /// assert!(sharded.insert_bulk([(3u64, "exchange_id ="), (4u64, "exchange_id = 4")], &pool).is_err());
+    /// ```
+    pub fn insert_bulk<'a, I>(
+        &mut self,
+        expressions: I,
+        pool: &ThreadPool,
+    ) -> Result<(), ATreeError<'a>>
+    where
+        I: IntoIterator<Item = (T, &'a str)>,
+        T: Send,
+    {
+        let mut partitions = vec![vec![]; self.shards.len()];
+        for (subscription_id, expression) in expressions {
+            self.intern(expression);
+            partitions[self.shard_of(&subscription_id)].push((subscription_id, expression));
+        }
+
+        let threads = pool.threads();
+        let shards = self
+            .shards
+            .iter_mut()
+            .zip(partitions)
+            .map(|(shard, partition)| Mutex::new((shard, Some(partition), None)))
+            .collect::<Vec<_>>();
+        let error = Mutex::new(None);
+        // The expressions are all parsed before any of them is inserted so that an invalid one
+        // leaves every shard untouched.
+        pool.broadcast(&|thread| {
+            for shard in shards.iter().skip(thread).step_by(threads) {
+                let (atree, partition, batch) = &mut *shard.lock().unwrap();
+                match atree.parse_batch(partition.take().unwrap_or_default()) {
+                    Ok(parsed) => *batch = Some(parsed),
+                    Err(parse_error) => {
+                        error.lock().unwrap().get_or_insert(parse_error);
+                    }
+                }
+            }
+        });
+        if let Some(error) = error.into_inner().unwrap() {
+            return Err(error);
+        }
+
+        pool.broadcast(&|thread| {
+            for shard in shards.iter().skip(thread).step_by(threads) {
+                let (atree, _, batch) = &mut *shard.lock().unwrap();
+                if let Some(batch) = batch.take() {
+                    atree.insert_batch(batch);
+                }
+            }
+        });
+        Ok(())
+    }
+
+    /// Delete the specified expression from the shard of its subscription.
+    pub fn delete(&mut self, subscription_id: &T) {
+        let shard = self.shard_of(subscription_id);
+        self.shards[shard].delete(subscription_id);
+    }
+
+    /// Build an inverted index over the predicates of every shard.
+    ///
+    /// See [`ATree::enable_predicate_index()`] for more details.
+    pub fn enable_predicate_index(&mut self) {
+        self.shards
+            .iter_mut()
+            .for_each(ATree::enable_predicate_index);
+    }
+
+    /// Create a new [`EventBuilder`] to build an [`Event`] that can be searched in every shard.
+    #[inline]
+    pub fn make_event(&'_ self) -> EventBuilder<'_> {
+        self.shards[0].make_event()
+    }
+
+    /// Search every shard for arbitrary boolean expressions that match the [`Event`] and merge
+    /// their matches.
+    ///
+    /// The shards are spread over the threads of the pool: the shard `i` is searched by the
+    /// thread `i % threads`. The matches are grouped by thread instead of being in a given order.
+    pub fn search(
+        &'_ self,
+        event: &Event,
+        pool: &ThreadPool,
+    ) -> Result<Report<'_, T>, ATreeError<'_>>
+    where
+        T: Sync,
+    {
+        let threads = pool.threads();
+        let matches = (0..threads.min(self.shards.len()))
+            .map(|_| Mutex::new(vec![]))
+            .collect::<Vec<_>>();
+        let error = Mutex::new(None);
+        pool.broadcast(&|thread| {
+            let Some(matches) = matches.get(thread) else {
+                return;
+            };
+            let mut matches = matches.lock().unwrap();
+            for shard in self.shards.iter().skip(thread).step_by(threads) {
+                match shard.search(event) {
+                    Ok(report) => matches.extend_from_slice(report.matches()),
+                    Err(search_error) => {
+                        error.lock().unwrap().get_or_insert(search_error);
+                    }
+                }
+            }
+        });
+        if let Some(error) = error.into_inner().unwrap() {
+            return Err(error);
+        }
+
+        let matches = matches
+            .into_iter()
+            .flat_map(|matches| matches.into_inner().unwrap())
+            .collect();
+        Ok(Report::new(matches))
+    }
+
+    /// The amount of shards.
+    #[inline]
+    pub fn shards(&self) -> usize {
+        self.shards.len()
+    }
+
+    /// Get the shard with the specified index, e.g. to inspect its memory usage.
+    ///
+    /// # Panics
+    ///
+    /// Panics if the index is greater than or equal to [`ShardedATree::shards()`].
+    #[inline]
+    pub fn shard(&self, index: usize) -> &ATree<T> {
+        &self.shards[index]
+    }
+
+    #[inline]
+    fn shard_of(&self, subscription_id: &T) -> usize {
+        (self.policy)(subscription_id, self.shards.len()) % self.shards.len()
+    }
+
+    /// Add the strings of the expression to every shard in the same order so that they keep the
+    /// same IDs everywhere.
+    fn intern(&mut self, expression: &str) {
+        for token in Lexer::new(expression) {
+            // The invalid expressions are left to the parser to report.
+            let Ok((_, Token::StringLiteral(value), _)) = token else {
+                continue;
+            };
+            for shard in &mut self.shards {
+                shard.intern(value);
+            }
+        }
+    }
+}
+
+impl<T> Debug for ShardedATree<T> {
+    fn fmt(&self, f: &mut std::fmt::Formatter<'_>) -> std::fmt::Result {
+        f.debug_struct("ShardedATree")
+            .field("shards", &self.shards.len())
+            .finish_non_exhaustive()
+    }
+}
+
+#[cfg(test)]
+mod tests {
+    use super::*;
+
+    fn definitions() -> [AttributeDefinition; 3] {
+        [
+            AttributeDefinition::boolean("private"),
+            AttributeDefinition::integer("exchange_id"),
+            AttributeDefinition::string_list("deals"),
+        ]
+    }
+
+    fn sorted<'a>(report: &Report<'a, u64>) -> Vec<&'a u64> {
+        let mut matches = report.matches().to_vec();
+        matches.sort_unstable();
+        matches
+    }
+
+    #[test]
+    fn return_the_matches_of_every_shard() {
+        let mut sharded = ShardedATree::new(&definitions(), 3).unwrap();
+        for subscription_id in 0..30u64 {
+            let expression = format!("exchange_id = {}", subscription_id % 2);
+            sharded.insert(&subscription_id, &expression).unwrap();
+        }
+        let pool = ThreadPool::new(2);
+
+        let mut builder = sharded.make_event();
+        builder.with_integer("exchange_id", 1).unwrap();
+        let report = sharded.search(&builder.build().unwrap(), &pool).unwrap();
+
+        let expected = (0..30u64).filter(|id| id % 2 == 1).collect::<Vec<_>>();
+        assert_eq!(expected.iter().collect::<Vec<_>>(), sorted(&report));
+    }
+
+    #[test]
+    fn keep_the_string_ids_of_the_shards_aligned() {
+        let policy: ShardPolicy<u64> = Box::new(|subscription_id, _| *subscription_id as usize);
+        let mut sharded = ShardedATree::with_policy(&definitions(), 2, policy).unwrap();
+        sharded
+            .insert(&0, r#"deals one of ["deal-1", "deal-2"]"#)
+            .unwrap();
+        sharded.insert(&1, r#"deals one of ["deal-3"]"#).unwrap();
+        let pool = ThreadPool::new(1);
+
+        let mut builder = sharded.make_event();
+        builder.with_string_list("deals", &["deal-3"]).unwrap();
+        let report = sharded.search(&builder.build().unwrap(), &pool).unwrap();
+
+        assert_eq!(vec![&1u64], sorted(&report));
+    }
+
+    #[test]
+    fn delete_the_subscription_from_its_shard() {
+        let mut sharded = ShardedATree::new(&definitions(), 4).unwrap();
+        sharded.insert(&1u64, "private").unwrap();
+        sharded.insert(&2u64, "private").unwrap();
+        let pool = ThreadPool::new(4);
+
+        sharded.delete(&1u64);
+
+        let mut builder = sharded.make_event();
+        builder.with_boolean("private", true).unwrap();
+        let report = sharded.search(&builder.build().unwrap(), &pool).unwrap();
+        assert_eq!(vec![&2u64], sorted(&report));
+    }
+
+    #[test]
+    fn insert_nothing_when_an_expression_of_the_bulk_is_invalid() {
+        let mut sharded = ShardedATree::new(&definitions(), 4).unwrap();
+        let pool = ThreadPool::new(2);
+        let expressions = (0..16u64)
+            .map(|id| (id, "private"))
+            .chain([(16, "private and")]);
+
+        assert!(sharded.insert_bulk(expressions, &pool).is_err());
+
+        let mut builder = sharded.make_event();
+        builder.with_boolean("private", true).unwrap();
+        let report = sharded.search(&builder.build().unwrap(), &pool).unwrap();
+        assert!(report.matches().is_empty());
+    }
+
+    #[test]
+    fn search_the_shards_built_in_bulk() {
+        let mut sharded = ShardedATree::new(&definitions(), 3).unwrap();
+        let pool = ThreadPool::new(4);
+        let expressions = (0..20u64).map(|id| {
+            let expression = if id % 4 == 0 {
+                r#"deals one of ["deal-1"] and not private"#
+            } else {
+                "exchange_id = 2"
+            };
+            (id, expression)
+        });
+
+        sharded.insert_bulk(expressions, &pool).unwrap();
+
+        let mut builder = sharded.make_event();
+        builder.with_boolean("private", false).unwrap();
+        builder.with_string_list("deals", &["deal-1"]).unwrap();
+        let report = sharded.search(&builder.build().unwrap(), &pool).unwrap();
+        let expected = [0u64, 4, 8, 12, 16];
+        assert_eq!(expected.iter().collect::<Vec<_>>(), sorted(&report));
+    }
+}
@@ -0,0 +1,399 @@
+use crate::{atree::ATree, error::ATreeError, events::AttributeDefinition};
+use std::{
+    cell::UnsafeCell,
+    fmt::Debug,
+    hash::Hash,
+    ops::Deref,
+    sync::{
+        atomic::{AtomicUsize, Ordering},
+        Mutex, MutexGuard,
+    },
+    thread,
+};
+
+/// An [`ATree`] that can be searched by many threads while it is being updated.
+///
+/// The [`SharedATree`] keeps two copies of the [`ATree`] (i.e. a _left-right_ double buffer):
+/// the readers search the active copy while the writers apply their insertions and deletions to
+/// the standby copy. The writes are only visible to the readers once they are published with
+/// [`SharedATree::publish()`], which swaps the copies atomically, waits for the readers that are
+/// still on the previous copy to be done and replays the pending writes on it. A single publish
+/// can therefore cover many updates.
+///
+/// The readers never wait on a lock: acquiring a snapshot with [`SharedATree::read()`] only
+/// increments a counter. The writers are serialized with each other and a publish waits for the
+/// snapshots of the previous copy to be dropped, so the snapshots should be short-lived.
+///
+/// # Examples
+///
+/// ```rust
+/// use a_tree::{AttributeDefinition, SharedATree};
+///
+/// let definitions = [
+///     AttributeDefinition::boolean("private"),
+///     AttributeDefinition::integer("exchange_id")
+/// ];
+/// let shared = SharedATree::new(&definitions).unwrap();
+/// shared.insert(&1u64, "exchange_id = 5").unwrap();
+/// shared.insert(&2u64, "private").unwrap();
+///
+/// let search = |shared: &SharedATree<u64>| {
+///     let atree = shared.read();
+///     let mut builder = atree.make_event();
+///     builder.with_integer("exchange_id", 5).unwrap();
+///     builder.with_boolean("private", false).unwrap();
+///     let event = builder.build().unwrap();
+///     atree.search(&event).unwrap().matches().len()
+/// };
+/// assert_eq!(0, search(&shared));
+///
+/// shared.publish();
+/// assert_eq!(1, search(&shared));
+/// ```
+pub struct SharedATree<T> {
+    trees: [UnsafeCell<ATree<T>>; 2],
+    readers: [ReaderCount; 2],
+    active: AtomicUsize,
+    pending: Mutex<Vec<Write<T>>>,
+}
+
+// SAFETY: the active copy is only read through shared references and the standby copy is only
+// modified by the writer that holds the `pending` lock once all of its readers are gone.
+unsafe impl<T: Send + Sync> Sync for SharedATree<T> {}
+unsafe impl<T: Send> Send for SharedATree<T> {}
+
+impl<T: Eq + Hash + Clone + Debug> SharedATree<T> {
+    /// Create a new [`SharedATree`] with the attributes that can be used by the inserted
+    /// arbitrary boolean expressions along with their types.
+    ///
+    /// See [`ATree::new()`] for more details.
+    pub fn new(definitions: &'_ [AttributeDefinition]) -> Result<Self, ATreeError<'_>> {
+        let atree = ATree::new(definitions)?;
+        Ok(Self::from(atree))
+    }
+
+    /// Insert an arbitrary boolean expression in the standby copy of the [`SharedATree`].
+    ///
+    /// The expression is only visible to the searches once [`SharedATree::publish()`] is called.
+    pub fn insert<'a>(
+        &self,
+        subscription_id: &T,
+        expression: &'a str,
+    ) -> Result<(), ATreeError<'a>> {
+        let mut pending = self.lock();
+        let result = self
+            .standby(&mut pending)
+            .insert(subscription_id, expression);
+        pending.push(Write::Insert(
+            subscription_id.clone(),
+            expression.to_owned(),
+        ));
+        result
+    }
+
+    /// Delete the specified expression from the standby copy of the [`SharedATree`].
+    ///
+    /// The expression keeps being matched by the searches until [`SharedATree::publish()`] is
+    /// called.
+    pub fn delete(&self, subscription_id: &T) {
+        let mut pending = self.lock();
+        self.standby(&mut pending).delete(subscription_id);
+        pending.push(Write::Delete(subscription_id.clone()));
+    }
+
+    /// Build an inverted index over the predicates of the [`SharedATree`].
+    ///
+    /// See [`ATree::enable_predicate_index()`] for more details. As for the other writes, the
+    /// index is only used by the searches once [`SharedATree::publish()`] is called.
+    pub fn enable_predicate_index(&self) {
+        let mut pending = self.lock();
+        self.standby(&mut pending).enable_predicate_index();
+        pending.push(Write::EnablePredicateIndex);
+    }
+
+    /// Make the pending writes visible to the searches.
+    ///
+    /// The copies are swapped so that the new searches see the writes right away. This function
+    /// then waits for the searches that are still running on the previous copy before replaying
+    /// the writes on it.
+    pub fn publish(&self) {
+        let mut pending = self.lock();
+        if pending.is_empty() {
+            return;
+        }
+
+        // Only the writers modify the active copy and they are serialized by the lock.
+        let previous = self.active.load(Ordering::Relaxed);
+        self.active.store(1 - previous, Ordering::SeqCst);
+        self.readers[previous].wait_until_empty();
+
+        // SAFETY: the readers moved to the other copy and the lock is held.
+        let atree = unsafe { &mut *self.trees[previous].get() };
+        for write in pending.drain(..) {
+            match write {
+                Write::Insert(subscription_id, expression) => {
+                    // The insertions that failed are replayed as well since parsing them might
+                    // have interned some strings and both copies have to agree on their IDs.
+                    let _ = atree.insert(&subscription_id, &expression);
+                }
+                Write::Delete(subscription_id) => atree.delete(&subscription_id),
+                Write::EnablePredicateIndex => atree.enable_predicate_index(),
+            }
+        }
+    }
+
+    #[inline]
+    fn lock(&self) -> MutexGuard<'_, Vec<Write<T>>> {
+        self.pending
+            .lock()
+            .expect("a writer panicked while updating the shared A-Tree")
+    }
+
+    #[inline]
+    fn standby<'g>(&self, _pending: &'g mut MutexGuard<'_, Vec<Write<T>>>) -> &'g mut ATree<T> {
+        let standby = 1 - self.active.load(Ordering::Relaxed);
+        // SAFETY: the readers of the standby copy are all gone since the last publish and holding
+        // the lock prevents the other writers from modifying it at the same time.
+        unsafe { &mut *self.trees[standby].get() }
+    }
+}
+
+impl<T> SharedATree<T> {
+    /// Get a snapshot of the [`SharedATree`] that can be searched without blocking.
+    ///
+    /// The snapshot does not see the writes that are published after it was acquired. Holding
+    /// it prevents the next [`SharedATree::publish()`] from completing, so it should be dropped
+    /// as soon as the search is done.
+    #[inline]
+    pub fn read(&self) -> ReadGuard<'_, T> {
+        loop {
+            let side = self.active.load(Ordering::SeqCst);
+            self.readers[side].0.fetch_add(1, Ordering::SeqCst);
+            // The copies might have been swapped between the load and the increment in which
+            // case the writer might not have seen this reader.
+            if self.active.load(Ordering::SeqCst) == side {
+                return ReadGuard { shared: self, side };
+            }
+            self.readers[side].0.fetch_sub(1, Ordering::Release);
+        }
+    }
+}
+
+impl<T: Clone> From<ATree<T>> for SharedATree<T> {
+    fn from(atree: ATree<T>) -> Self {
+        Self {
+            trees: [UnsafeCell::new(atree.clone()), UnsafeCell::new(atree)],
+            readers: [ReaderCount::default(), ReaderCount::default()],
+            active: AtomicUsize::new(0),
+            pending: Mutex::new(Vec::new()),
+        }
+    }
+}
+
+impl<T> Debug for SharedATree<T> {
+    fn fmt(&self, f: &mut std::fmt::Formatter<'_>) -> std::fmt::Result {
+        f.debug_struct("SharedATree")
+            .field("active", &self.active)
+            .field("readers", &self.readers)
+            .finish_non_exhaustive()
+    }
+}
+
+/// A snapshot of a [`SharedATree`] returned by the [`SharedATree::read()`] function.
+///
+/// It dereferences to the [`ATree`] so it can be searched like one.
+pub struct ReadGuard<'a, T> {
+    shared: &'a SharedATree<T>,
+    side: usize,
+}
+
+impl<T> Deref for ReadGuard<'_, T> {
+    type Target = ATree<T>;
+
+    #[inline]
+    fn deref(&self) -> &Self::Target {
+        // SAFETY: the writers do not modify a copy that still has readers.
+        unsafe { &*self.shared.trees[self.side].get() }
+    }
+}
+
+impl<T> Drop for ReadGuard<'_, T> {
+    #[inline]
+    fn drop(&mut self) {
+        self.shared.readers[self.side]
+            .0
+            .fetch_sub(1, Ordering::Release);
+    }
+}
+
+impl<T> Debug for ReadGuard<'_, T> {
+    fn fmt(&self, f: &mut std::fmt::Formatter<'_>) -> std::fmt::Result {
+        f.debug_struct("ReadGuard")
+            .field("side", &self.side)
+            .finish_non_exhaustive()
+    }
+}
+
+/// A reader count that lives on its own cache line so that the readers of one copy do not
+/// contend with the readers of the other.
+#[derive(Debug, Default)]
+#[repr(align(64))]
+struct ReaderCount(AtomicUsize);
+
+impl ReaderCount {
+    const SPINS_BEFORE_YIELDING: usize = 64;
+
+    #[inline]
+    fn wait_until_empty(&self) {
+        let mut spins = 0;
+        while self.0.load(Ordering::Acquire) != 0 {
+            if spins < Self::SPINS_BEFORE_YIELDING {
+                spins += 1;
+                std::hint::spin_loop();
+            } else {
+                thread::yield_now();
+            }
+        }
+    }
+}
+
+#[derive(Debug)]
+enum Write<T> {
+    Insert(T, String),
+    Delete(T),
+    EnablePredicateIndex,
+}
+
+#[cfg(test)]
+mod tests {
+    use super::*;
+    use std::sync::atomic::AtomicBool;
+
+    fn is_sync_and_send<T: Send + Sync>() {}
+
+    fn search(shared: &SharedATree<u64>, exchange_id: i64) -> Vec<u64> {
+        let atree = shared.read();
+        let mut builder = atree.make_event();
+        builder.with_integer("exchange_id", exchange_id).unwrap();
+        builder.with_string("country", "CA").unwrap();
+        let event = builder.build().unwrap();
+        let mut matches = atree
+            .search(&event)
+            .unwrap()
+            .matches()
+            .iter()
+            .map(|id| **id)
+            .collect::<Vec<_>>();
+        matches.sort();
+        matches
+    }
+
+    fn definitions() -> [AttributeDefinition; 2] {
+        [
+            AttributeDefinition::integer("exchange_id"),
+            AttributeDefinition::string("country"),
+        ]
+    }
+
+    #[test]
+    fn support_sync_and_send_traits() {
+        is_sync_and_send::<SharedATree<u64>>();
+    }
+
+    #[test]
+    fn only_show_the_writes_once_they_are_published() {
+        let shared = SharedATree::new(&definitions()).unwrap();
+        shared.insert(&1, "exchange_id = 1").unwrap();
+        shared
+            .insert(&2, "exchange_id = 1 and country = 'CA'")
+            .unwrap();
+
+        assert!(search(&shared, 1).is_empty());
+
+        shared.publish();
+
+        assert_eq!(vec![1, 2], search(&shared, 1));
+    }
+
+    #[test]
+    fn apply_the_writes_to_both_copies() {
+        let shared = SharedATree::new(&definitions()).unwrap();
+        shared.insert(&1, "exchange_id = 1").unwrap();
+        shared
+            .insert(&2, "exchange_id = 1 and country = 'CA'")
+            .unwrap();
+        shared.publish();
+        shared.delete(&1);
+        shared.publish();
+        assert_eq!(vec![2], search(&shared, 1));
+
+        shared
+            .insert(&3, "exchange_id = 1 or country = 'US'")
+            .unwrap();
+        shared.publish();
+
+        assert_eq!(vec![2, 3], search(&shared, 1));
+    }
+
+    #[test]
+    fn return_an_error_on_invalid_expressions_and_keep_the_copies_in_sync() {
+        let shared = SharedATree::new(&definitions()).unwrap();
+
+        assert!(shared.insert(&1, "country in ['FR', 'CA'] and").is_err());
+
+        shared.insert(&2, "country = 'CA'").unwrap();
+        shared.publish();
+        assert_eq!(vec![2], search(&shared, 1));
+        shared.insert(&3, "exchange_id = 1").unwrap();
+        shared.publish();
+        assert_eq!(vec![2, 3], search(&shared, 1));
+    }
+
+    #[test]
+    fn keep_the_snapshots_unchanged_while_they_are_held() {
+        let shared = SharedATree::new(&definitions()).unwrap();
+        shared.insert(&1, "exchange_id = 1").unwrap();
+        shared.publish();
+        let atree = shared.read();
+        let mut builder = atree.make_event();
+        builder.with_integer("exchange_id", 1).unwrap();
+        let event = builder.build().unwrap();
+
+        shared.delete(&1);
+
+        assert_eq!([&1], atree.search(&event).unwrap().matches());
+    }
+
+    #[test]
+    fn can_search_while_publishing_writes() {
+        const WRITES: u64 = 200;
+        let shared = SharedATree::new(&definitions()).unwrap();
+        let done = AtomicBool::new(false);
+
+        thread::scope(|scope| {
+            for _ in 0..4 {
+                scope.spawn(|| {
+                    let mut seen = 0;
+                    while !done.load(Ordering::Acquire) {
+                        let matches = search(&shared, 1);
+                        // The writes are published in order so the snapshots only grow.
+                        assert!(matches.len() >= seen);
+                        assert!(matches.iter().copied().eq(0..matches.len() as u64));
+                        seen = matches.len();
+                    }
+                });
+            }
+
+            for id in 0..WRITES {
+                shared.insert(&id, "exchange_id = 1").unwrap();
+                if id % 10 == 9 {
+                    shared.publish();
+                }
+            }
+            shared.publish();
+            done.store(true, Ordering::Release);
+        });
+
+        assert_eq!((0..WRITES).collect::<Vec<_>>(), search(&shared, 1));
+    }
+}
@@ -1,44 +1,239 @@
-use std::collections::HashMap;
+use crate::{
+    encoding::{Decoder, Encoder, Persist},
+    error::SnapshotError,
+};
+use hashbrown::HashTable;
+use rustc_hash::FxBuildHasher;
+use std::{
+    fmt,
+    hash::BuildHasher,
+    io::{self, Write},
+};
 
-#[derive(Clone, Debug)]
-pub struct StringTable {
-    by_values: HashMap<String, usize>,
-    counter: usize,
+/// The hasher of the strings.
+///
+/// The hashes are never exposed outside of the table so a fast non-cryptographic hash is used
+/// instead of the default SipHash.
+pub type StringHasher = FxBuildHasher;
+
+/// Interns the strings of the expressions and of the events as [`StringId`].
+///
+/// The strings are stored one after the other in a single buffer and the hash table only holds
+/// their IDs, so adding a string does not allocate it on its own.
+#[derive(Clone)]
+pub struct StringTable<S = StringHasher> {
+    by_values: HashTable<usize>,
+    arena: String,
+    /// The string of the ID `i` is `arena[offsets[i]..offsets[i + 1]]`.
+    offsets: Vec<usize>,
+    hasher: S,
+}
+
+impl<S> fmt::Debug for StringTable<S> {
+    fn fmt(&self, f: &mut fmt::Formatter<'_>) -> fmt::Result {
+        let values = (1..self.offsets.len() - 1)
+            .map(|id| &self.arena[self.offsets[id]..self.offsets[id + 1]]);
+        f.debug_list().entries(values).finish()
+    }
 }
 
 impl StringTable {
+    pub fn new() -> Self {
+        Self::with_hasher(StringHasher::default())
+    }
+}
+
+impl<S: BuildHasher> StringTable<S> {
     const SENTINEL_ID: usize = 0;
 
-    pub fn new() -> Self {
+    pub fn with_hasher(hasher: S) -> Self {
         Self {
-            by_values: HashMap::new(),
-            counter: 1,
+            by_values: HashTable::new(),
+            arena: String::new(),
+            // The sentinel is an empty string that can never be found.
+            offsets: vec![0, 0],
+            hasher,
         }
     }
 
     pub fn get(&self, value: &str) -> StringId {
+        let hash = self.hasher.hash_one(value);
         let index = self
             .by_values
-            .get(value)
+            .find(hash, |id| self.value(*id) == value)
             .cloned()
             .unwrap_or(Self::SENTINEL_ID);
         StringId(index)
     }
 
     pub fn get_or_update(&mut self, value: &str) -> StringId {
-        let counter = self.by_values.entry(value.to_string()).or_insert_with(|| {
-            let counter = self.counter;
-            self.counter += 1;
-            counter
+        let hash = self.hasher.hash_one(value);
+        let Self {
+            by_values,
+            arena,
+            offsets,
+            hasher,
+        } = self;
+        let value_of = |id: usize| &arena[offsets[id]..offsets[id + 1]];
+        if let Some(id) = by_values.find(hash, |id| value_of(*id) == value) {
+            return StringId(*id);
+        }
+
+        let id = offsets.len() - 1;
+        by_values.insert_unique(hash, id, |id| {
+            hasher.hash_one(&arena[offsets[*id]..offsets[*id + 1]])
         });
+        arena.push_str(value);
+        offsets.push(arena.len());
+        StringId(id)
+    }
+
+    /// Add the strings of another table to this one.
+    ///
+    /// The new strings are added in the order they were added to the other table, so merging
+    /// tables one after the other assigns the same IDs as interning all their strings in a single
+    /// table. The returned [`StringRemap`] translates the IDs of the other table to the IDs of
+    /// this one.
+    pub fn merge<T: BuildHasher>(&mut self, other: &StringTable<T>) -> StringRemap {
+        let mut ids = vec![StringId(Self::SENTINEL_ID); other.len()];
+        for (id, value) in other.values().enumerate().skip(1) {
+            ids[id] = self.get_or_update(value);
+        }
+        StringRemap(ids)
+    }
+
+    /// Drop the strings whose IDs are not flagged as used.
+    ///
+    /// The kept strings keep their relative order but get new IDs; the returned [`StringRemap`]
+    /// translates the previous IDs to the new ones and the dropped strings to the sentinel.
+    pub fn retain(&mut self, used: &[bool]) -> StringRemap {
+        let is_used = |id: usize| used.get(id).copied().unwrap_or(false);
+        let (kept, size) = (1..self.len())
+            .filter(|id| is_used(*id))
+            .fold((0, 0), |(kept, size), id| {
+                (kept + 1, size + self.value(id).len())
+            });
+        self.by_values = HashTable::with_capacity(kept);
+        let arena = std::mem::replace(&mut self.arena, String::with_capacity(size));
+        let offsets = std::mem::replace(&mut self.offsets, Vec::with_capacity(kept + 2));
+        self.offsets.extend([0, 0]);
+
+        let mut ids = vec![StringId(Self::SENTINEL_ID); offsets.len() - 1];
+        for id in (1..offsets.len() - 1).filter(|id| is_used(*id)) {
+            ids[id] = self.get_or_update(&arena[offsets[id]..offsets[id + 1]]);
+        }
+        StringRemap(ids)
+    }
 
-        StringId(*counter)
+    /// The memory used by the table, in bytes.
+    pub fn memory_usage(&self) -> usize {
+        self.arena.capacity()
+            + self.offsets.capacity() * std::mem::size_of::<usize>()
+            // Every bucket of the hash table also has a control byte.
+            + self.by_values.capacity() * (std::mem::size_of::<usize>() + 1)
+    }
+
+    /// The amount of IDs in the table (including the sentinel).
+    #[inline]
+    pub(crate) fn len(&self) -> usize {
+        self.offsets.len() - 1
+    }
+
+    #[inline]
+    fn value(&self, id: usize) -> &str {
+        &self.arena[self.offsets[id]..self.offsets[id + 1]]
+    }
+
+    /// The strings ordered by their IDs.
+    fn values(&self) -> impl Iterator<Item = &str> {
+        (0..self.len()).map(|id| self.value(id))
+    }
+
+    pub(crate) fn encode<W: Write>(&self, encoder: &mut Encoder<W>) -> io::Result<()> {
+        let values = self.values().skip(1).collect::<Vec<_>>();
+        encoder.list(&values, |encoder, value| {
+            encoder.value(&value.len())?;
+            encoder.bytes(value.as_bytes())
+        })
+    }
+}
+
+impl StringTable {
+    pub(crate) fn decode(decoder: &mut Decoder<'_>) -> Result<Self, SnapshotError> {
+        let length = decoder.length()?;
+        let mut table = Self::new();
+        table.offsets.reserve(length);
+        for _ in 0..length {
+            let size = decoder.value::<usize>()?;
+            let value =
+                std::str::from_utf8(decoder.bytes(size)?).map_err(|_| SnapshotError::Corrupted)?;
+            let count = table.len();
+            table.get_or_update(value);
+            // The strings of a table are unique so a duplicate would shift all the following IDs.
+            if table.len() == count {
+                return Err(SnapshotError::Corrupted);
+            }
+        }
+        Ok(table)
+    }
+}
+
+/// Translation of the [`StringId`] of a [`StringTable`] to the ones of another table it was
+/// merged in.
+#[derive(Clone, Debug)]
+pub struct StringRemap(Vec<StringId>);
+
+impl StringRemap {
+    #[inline]
+    pub fn get(&self, id: StringId) -> StringId {
+        self.0[id.0]
     }
 }
 
+/// The ID of a string interned by an [`crate::ATree`].
+///
+/// Resolving the strings that appear in many events (e.g. a dictionary of deal IDs) once with
+/// [`crate::ATree::intern`] and then setting their IDs with
+/// [`crate::EventBuilder::set_string_id`] skips hashing them for every event.
 #[derive(Clone, Copy, Eq, Ord, PartialEq, PartialOrd, Debug, Hash)]
+#[repr(transparent)]
 pub struct StringId(usize);
 
+impl StringId {
+    /// The index of the ID, e.g. to pass it across the FFI.
+    #[inline]
+    pub fn index(self) -> usize {
+        self.0
+    }
+
+    /// Rebuild an ID from its [`StringId::index`].
+    ///
+    /// An unknown index behaves like a string that does not appear in any expression.
+    #[inline]
+    pub fn from_index(index: usize) -> Self {
+        Self(index)
+    }
+}
+
+impl Persist for StringId {
+    #[inline]
+    fn persist<W: Write>(&self, writer: &mut W) -> io::Result<()> {
+        self.0.persist(writer)
+    }
+
+    #[inline]
+    fn restore(bytes: &mut &[u8]) -> Result<Self, SnapshotError> {
+        usize::restore(bytes).map(Self)
+    }
+}
+
+#[cfg(test)]
+impl StringId {
+    pub const fn new(id: usize) -> Self {
+        Self(id)
+    }
+}
+
 #[cfg(test)]
 mod tests {
     use super::*;
@@ -73,6 +268,70 @@ mod tests {
         assert_eq!(id, table.get_or_update(A_KEY));
     }
 
+    #[test]
+    fn can_find_all_the_strings_stored_in_the_same_buffer() {
+        let mut table = StringTable::new();
+        let values = (0..1000).map(|i| format!("deal-{i}")).collect::<Vec<_>>();
+
+        let ids = values
+            .iter()
+            .map(|value| table.get_or_update(value))
+            .collect::<Vec<_>>();
+
+        for (value, id) in values.iter().zip(ids) {
+            assert_eq!(id, table.get(value));
+        }
+        assert_eq!(StringId(0), table.get(""));
+        assert_eq!(StringId(0), table.get("deal-"));
+    }
+
+    #[test]
+    fn keep_the_ids_of_the_strings_when_reading_back_a_table() {
+        let mut table = StringTable::new();
+        let id = table.get_or_update(A_KEY);
+        let another_id = table.get_or_update(ANOTHER_KEY);
+        let mut encoder = Encoder::new(Vec::new());
+        table.encode(&mut encoder).unwrap();
+        let bytes = encoder.into_inner();
+
+        let table = StringTable::decode(&mut Decoder::new(&bytes)).unwrap();
+
+        assert_eq!(id, table.get(A_KEY));
+        assert_eq!(another_id, table.get(ANOTHER_KEY));
+        assert_eq!(another_id.0 + 1, table.len());
+    }
+
+    #[test]
+    fn can_translate_the_ids_of_a_merged_table() {
+        let mut table = StringTable::new();
+        let mut other = StringTable::new();
+        let existing_id = table.get_or_update(ANOTHER_KEY);
+        let id = other.get_or_update(A_KEY);
+        let another_id = other.get_or_update(ANOTHER_KEY);
+
+        let remap = table.merge(&other);
+
+        assert_eq!(table.get(A_KEY), remap.get(id));
+        assert_eq!(existing_id, remap.get(another_id));
+        assert_eq!(table.get("missing"), remap.get(other.get("missing")));
+    }
+
+    #[test]
+    fn drop_the_strings_that_are_not_used_anymore() {
+        let mut table = StringTable::new();
+        let unused_id = table.get_or_update(A_KEY);
+        let id = table.get_or_update(ANOTHER_KEY);
+        let mut used = vec![false; table.len()];
+        used[id.0] = true;
+
+        let remap = table.retain(&used);
+
+        assert_eq!(StringId(0), table.get(A_KEY));
+        assert_eq!(StringId(0), remap.get(unused_id));
+        assert_eq!(table.get(ANOTHER_KEY), remap.get(id));
+        assert_eq!(2, table.len());
+    }
+
     #[test]
     fn can_add_multiple_strings() {
         let mut table = StringTable::new();
@@ -1,25 +1,34 @@
+/// A boxed expression to write the expected expressions of the tests.
+#[derive(PartialEq, Clone, Debug)]
+pub enum Expression {
+    And(Box<Expression>, Box<Expression>),
+    Or(Box<Expression>, Box<Expression>),
+    Not(Box<Expression>),
+    Value(crate::predicates::Predicate),
+}
+
 pub mod ast {
     macro_rules! or {
         ($left:expr, $right:expr) => {
-            Node::Or(Box::new($left), Box::new($right))
+            $crate::test_utils::Expression::Or(Box::new($left), Box::new($right))
         };
     }
 
     macro_rules! and {
         ($left:expr, $right:expr) => {
-            Node::And(Box::new($left), Box::new($right))
+            $crate::test_utils::Expression::And(Box::new($left), Box::new($right))
         };
     }
 
     macro_rules! not {
         ($value:expr) => {
-            Node::Not(Box::new($value))
+            $crate::test_utils::Expression::Not(Box::new($value))
         };
     }
 
     macro_rules! value {
         ($value:expr) => {
-            Node::Value($value)
+            $crate::test_utils::Expression::Value($value)
         };
     }
 
@@ -30,27 +39,7 @@ pub mod ast {
 }
 
 pub mod optimized_node {
-    macro_rules! or {
-        ($left:expr, $right:expr) => {
-            OptimizedNode::Or(Box::new($left), Box::new($right))
-        };
-    }
-
-    macro_rules! and {
-        ($left:expr, $right:expr) => {
-            OptimizedNode::And(Box::new($left), Box::new($right))
-        };
-    }
-
-    macro_rules! value {
-        ($value:expr) => {
-            OptimizedNode::Value($value)
-        };
-    }
-
-    pub(crate) use and;
-    pub(crate) use or;
-    pub(crate) use value;
+    pub(crate) use super::ast::{and, or, value};
 }
 
 pub mod predicates {
@@ -236,7 +225,10 @@ pub mod predicates {
 
     macro_rules! integer_list {
         ($value:expr) => {
-            ListLiteral::IntegerList($value)
+            ListLiteral::IntegerList({
+                let values: Vec<i64> = $value;
+                values.into()
+            })
         };
     }
 